@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * port/posix/posix_capture_file.c
+ *
+ * Capture log sink and replay source on a POSIX file
+ */
+
+#include <stddef.h>     /* For NULL */
+#include <fcntl.h>      /* For O_xxxx */
+#include <sys/types.h>  /* For ssize_t */
+#include <sys/stat.h>   /* For S_IRUSR */
+#include <sys/uio.h>    /* For writev */
+#include <unistd.h>     /* For open, close, read */
+#include <string.h>     /* For memset */
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_capture.h"
+
+#include "posix_capture_file.h"
+
+/** Local declarations */
+
+/* Read exactly size bytes.  Returns size, 0 at the end of the file, or -1 if
+ * the file ends or fails part way */
+static ssize_t pcfRead(int fd, void* data, size_t size);
+
+/** Local implementations */
+static ssize_t pcfRead(int fd, void* data, size_t size)
+{
+    ssize_t rc = 0;
+    size_t count = 0;
+
+    while (count < size) {
+        rc = read(fd, (uint8_t*)data + count, size - count);
+        if (rc <= 0) {
+            return ((rc == 0) && (count == 0)) ? 0 : -1;
+        }
+        count += rc;
+    }
+    return size;
+}
+
+/** Public functions */
+int posixCaptureFile_Init(void* c, const void* cf)
+{
+    posixCaptureFileContext* context = c;
+    const posixCaptureFileConfig* config = cf;
+    whCaptureLogHeader header = {0};
+    int ret = 0;
+    int rc = 0;
+
+    if ((context == NULL) || (config == NULL) || (config->filename == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(context, 0, sizeof(*context));
+    context->magic = WH_COMM_MAGIC_NATIVE;
+    if (config->write != 0) {
+        rc = open(config->filename, O_WRONLY | O_CREAT | O_TRUNC,
+                S_IRUSR | S_IWUSR);
+    } else {
+        rc = open(config->filename, O_RDONLY);
+    }
+    if (rc < 0) {
+        return WH_ERROR_ABORTED;
+    }
+    context->fd_p1 = rc + 1;
+
+    if (config->write != 0) {
+        header.magic = WH_CAPTURE_LOG_MAGIC;
+        header.version = WH_CAPTURE_LOG_VERSION;
+        header.record_len = sizeof(whCaptureRecord);
+        if (write(context->fd_p1 - 1, &header, sizeof(header)) !=
+                (ssize_t)sizeof(header)) {
+            ret = WH_ERROR_ABORTED;
+        }
+    } else {
+        if (pcfRead(context->fd_p1 - 1, &header, sizeof(header)) !=
+                (ssize_t)sizeof(header)) {
+            ret = WH_ERROR_ABORTED;
+        } else if (header.magic != WH_CAPTURE_LOG_MAGIC) {
+            /* Captured with the other byte order, or not a log at all */
+            context->magic = WH_COMM_MAGIC_SWAP;
+            if (wh_Translate32(context->magic, header.magic) !=
+                    WH_CAPTURE_LOG_MAGIC) {
+                ret = WH_ERROR_ABORTED;
+            }
+        }
+        if (    (ret == 0) &&
+                ((wh_Translate16(context->magic, header.version) !=
+                        WH_CAPTURE_LOG_VERSION) ||
+                (wh_Translate16(context->magic, header.record_len) !=
+                        sizeof(whCaptureRecord))) ){
+            ret = WH_ERROR_ABORTED;
+        }
+    }
+    if (ret != 0) {
+        (void)posixCaptureFile_Cleanup(context);
+    }
+    return ret;
+}
+
+int posixCaptureFile_Cleanup(void* c)
+{
+    posixCaptureFileContext* context = c;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    if (context->fd_p1 != 0) {
+        (void)close(context->fd_p1 - 1);
+        context->fd_p1 = 0;
+    }
+    return 0;
+}
+
+void posixCaptureFile_Sink(void* c, const whCaptureRecord* record,
+        const void* packet)
+{
+    posixCaptureFileContext* context = c;
+    struct iovec iov[2];
+
+    if (    (context == NULL) ||
+            (context->fd_p1 == 0) ||
+            (record == NULL) ||
+            ((packet == NULL) && (record->size > 0)) ){
+        return;
+    }
+    iov[0].iov_base = (void*)record;
+    iov[0].iov_len = sizeof(*record);
+    iov[1].iov_base = (void*)packet;
+    iov[1].iov_len = record->size;
+    (void)writev(context->fd_p1 - 1, iov, 2);
+}
+
+int posixCaptureFile_Read(void* c, whCaptureRecord* record, uint16_t size,
+        void* packet)
+{
+    posixCaptureFileContext* context = c;
+    ssize_t rc = 0;
+
+    if (    (context == NULL) ||
+            (context->fd_p1 == 0) ||
+            (record == NULL) ||
+            ((packet == NULL) && (size > 0)) ){
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = pcfRead(context->fd_p1 - 1, record, sizeof(*record));
+    if (rc == 0) {
+        return WH_ERROR_NOTFOUND;
+    }
+    if (rc != (ssize_t)sizeof(*record)) {
+        return WH_ERROR_ABORTED;
+    }
+    record->time = wh_Translate64(context->magic, record->time);
+    record->size = wh_Translate16(context->magic, record->size);
+    if (record->size > size) {
+        return WH_ERROR_NOSPACE;
+    }
+    if (pcfRead(context->fd_p1 - 1, packet, record->size) != record->size) {
+        return WH_ERROR_ABORTED;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * port/posix/posix_capture_file.h
+ */
+
+#ifndef PORT_POSIX_POSIX_CAPTURE_FILE_H_
+#define PORT_POSIX_POSIX_CAPTURE_FILE_H_
+
+/*
+ * Capture logs kept in a file.  A context opened for writing truncates the
+ * file, writes the log header and is then used as the sink of a
+ * whCaptureConfig.  Each record is written with a single writev, so servers
+ * on several threads may share one context.  A context opened for reading is
+ * used as the source of a whReplayConfig, and reads logs captured in either
+ * byte order.
+ */
+
+#include <stdint.h>
+
+#include "wolfhsm/wh_capture.h"
+
+/* In memory context structure associated with a log file */
+typedef struct posixCaptureFileContext_t {
+    int fd_p1;              /* fd + 1, so fd == 0 is invalid */
+    uint16_t magic;         /* WH_COMM_MAGIC_NATIVE or _SWAP of the log */
+    uint8_t padding[2];
+} posixCaptureFileContext;
+
+/* In memory configuration structure associated with a log file */
+typedef struct posixCaptureFileConfig_t {
+    const char* filename;   /* Null terminated */
+    uint8_t write;          /* Nonzero to create a new log, else read one */
+    uint8_t padding[7];
+} posixCaptureFileConfig;
+
+int posixCaptureFile_Init(void* c, const void* cf);
+int posixCaptureFile_Cleanup(void* c);
+
+/* whCaptureSinkCb.  Records that cannot be written are dropped */
+void posixCaptureFile_Sink(void* c, const whCaptureRecord* record,
+        const void* packet);
+
+/* whReplayReadCb */
+int posixCaptureFile_Read(void* c, whCaptureRecord* record, uint16_t size,
+        void* packet);
+
+#endif /* PORT_POSIX_POSIX_CAPTURE_FILE_H_ */
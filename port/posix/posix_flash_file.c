@@ -26,6 +26,7 @@
 #include <fcntl.h>      /* For O_xxxx */
 #include <sys/types.h>  /* For off_t, stat */
 #include <sys/stat.h>   /* For fstat */
+#include <sys/mman.h>   /* For mmap, msync, munmap */
 #include <unistd.h>     /* For open, close, pread, pwrite */
 #include <errno.h>      /* For errno */
 #include <string.h>     /* For memset, memcpy */
@@ -38,6 +39,7 @@
 enum {
     PFF_VERIFY_BUFFER_LEN = 64,
     PFF_BLANKCHECK_BUFFER_LEN = 64,
+    PFF_FILL_BUFFER_LEN = 256,
 };
 
 /** Local declarations */
@@ -47,20 +49,46 @@ enum {
  * bytes starting at offset */
 static ssize_t pfill(int filedes, int c, size_t size, off_t offset);
 
+/* Flush the pages of a mapped file covering size bytes at offset */
+static int pffSync(posixFlashFileContext* context, uint32_t offset,
+        uint32_t size);
+
 /** Local implementations */
 static ssize_t pfill(int filedes, int c, size_t size, off_t offset)
 {
-    int rc = 0;
-    uint8_t data = (uint8_t)c;
+    ssize_t rc = 0;
+    uint8_t data[PFF_FILL_BUFFER_LEN];
     size_t count = 0;
+    size_t this_size = 0;
+
+    memset(data, c, sizeof(data));
     while (count < size) {
-        rc = pwrite(filedes, &data, sizeof(data), offset + count);
-        if (rc != sizeof(data)) return rc;
-        count += sizeof(data);
+        this_size = size - count;
+        if (this_size > sizeof(data)) {
+            this_size = sizeof(data);
+        }
+        rc = pwrite(filedes, data, this_size, offset + count);
+        if (rc != (ssize_t)this_size) {
+            return -1;
+        }
+        count += this_size;
     }
     return size;
 }
 
+static int pffSync(posixFlashFileContext* context, uint32_t offset,
+        uint32_t size)
+{
+    /* msync requires a page aligned start */
+    uint32_t page = (uint32_t)sysconf(_SC_PAGESIZE);
+    uint32_t start = offset - (offset % page);
+
+    if (msync(context->map + start, offset + size - start, MS_SYNC) != 0) {
+        return WH_ERROR_ABORTED;
+    }
+    return 0;
+}
+
 
 int posixFlashFile_Init(   void* c,
                         const void* cf)
@@ -77,14 +105,17 @@ int posixFlashFile_Init(   void* c,
         return WH_ERROR_BADARGS;
     }
 
-    /* Open the storage backend */
-    rc = open(config->filename, O_RDWR|O_CREAT|O_SYNC, S_IRUSR | S_IWUSR);
+    /* Open the storage backend.  A mapped file is flushed with msync */
+    rc = open(config->filename,
+              O_RDWR | O_CREAT | (config->use_mmap ? 0 : O_SYNC),
+              S_IRUSR | S_IWUSR);
     if (rc >= 0) {
         /* File is open, setup context */
         memset(context, 0, sizeof(*context));
         context->fd_p1 = rc + 1;
         context->partition_size = config->partition_size;
         context->erased_byte = config->erased_byte;
+        context->sync_mode = config->sync_mode;
 
         rc = fstat(context->fd_p1 - 1, &st);
         if (rc == 0) {
@@ -110,6 +141,17 @@ int posixFlashFile_Init(   void* c,
             }
         }
 
+        if ((ret == 0) && (config->use_mmap != 0)) {
+            void* map = mmap(NULL, MAX_OFFSET(context),
+                             PROT_READ | PROT_WRITE, MAP_SHARED,
+                             context->fd_p1 - 1, 0);
+            if (map == MAP_FAILED) {
+                ret = WH_ERROR_ABORTED;
+            } else {
+                context->map = map;
+            }
+        }
+
         if (ret != 0) {
             /* Error at some point. Clean up */
             posixFlashFile_Cleanup(context);
@@ -129,6 +171,13 @@ int posixFlashFile_Cleanup(void* c)
         return WH_ERROR_BADARGS;
     }
 
+    if (context->map != NULL) {
+        /* Ignore errors here */
+        (void)msync(context->map, MAX_OFFSET(context), MS_SYNC);
+        (void)munmap(context->map, MAX_OFFSET(context));
+        context->map = NULL;
+    }
+
     if(context->fd_p1 > 0) {
         /* Ignore errors here */
         (void)close(context->fd_p1 - 1);
@@ -188,6 +237,11 @@ int posixFlashFile_Read(   void* c,
         return 0;
     }
 
+    if (context->map != NULL) {
+        memcpy(data, context->map + offset, size);
+        return 0;
+    }
+
     ssize_t rc = pread( context->fd_p1 - 1,
                         (void*) data,
                         (size_t) size,
@@ -219,6 +273,14 @@ int posixFlashFile_Program(void* c,
         return WH_ERROR_LOCKED;
     }
 
+    if (context->map != NULL) {
+        memcpy(context->map + offset, data, size);
+        if (context->sync_mode >= POSIX_FLASH_FILE_SYNC_PROGRAM) {
+            return pffSync(context, offset, size);
+        }
+        return 0;
+    }
+
     ssize_t rc = pwrite(    context->fd_p1 - 1,
                             (void*) data,
                             (size_t) size,
@@ -251,6 +313,13 @@ int posixFlashFile_Verify( void* c,
         return 0;
     }
 
+    if (context->map != NULL) {
+        if (memcmp(data, context->map + offset, size) != 0) {
+            return WH_ERROR_NOTVERIFIED;
+        }
+        return 0;
+    }
+
     while (offset < end_offset) {
         uint32_t this_size = sizeof(buffer);
         int ret = 0;
@@ -291,6 +360,14 @@ int posixFlashFile_Erase(void* c,
         return WH_ERROR_LOCKED;
     }
 
+    if (context->map != NULL) {
+        memset(context->map + offset, context->erased_byte, size);
+        if (context->sync_mode >= POSIX_FLASH_FILE_SYNC_ERASE) {
+            return pffSync(context, offset, size);
+        }
+        return 0;
+    }
+
     ssize_t rc = pfill( context->fd_p1 - 1,
                         context->erased_byte,
                         (size_t) size,
@@ -322,6 +399,18 @@ int posixFlashFile_BlankCheck(void* c,
         return 0;
     }
 
+    if (context->map != NULL) {
+        const uint8_t* p = context->map + offset;
+        while (size > 0) {
+            if (*p != context->erased_byte) {
+                return WH_ERROR_NOTBLANK;
+            }
+            p++;
+            size--;
+        }
+        return 0;
+    }
+
     memset(erased, context->erased_byte, sizeof(erased));
 
     while (offset < end_offset) {
@@ -345,3 +434,18 @@ int posixFlashFile_BlankCheck(void* c,
     }
     return ret;
 }
+
+int posixFlashFile_Sync(void* c)
+{
+    posixFlashFileContext* context = c;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (context->map == NULL) {
+        /* Writes are synchronous already */
+        return 0;
+    }
+    return pffSync(context, 0, MAX_OFFSET(context));
+}
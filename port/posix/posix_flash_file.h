@@ -30,17 +30,29 @@
  * the erase will cover half of the entire space and atomic updates will
  * require fully copying the "active" half NVM to the "inactive" half and
  * updating the initial flags to update the state.
+ *
+ * With use_mmap set, the file is mapped once at Init and every operation works
+ * on the mapping, so only the flushes selected by sync_mode reach the kernel.
  */
 
 #include "wolfhsm/wh_flash.h"
 
+/* Points at which a mapped file is flushed with msync */
+enum {
+    POSIX_FLASH_FILE_SYNC_CLEANUP = 0,  /* Only on Cleanup or Sync */
+    POSIX_FLASH_FILE_SYNC_ERASE   = 1,  /* Also after every Erase */
+    POSIX_FLASH_FILE_SYNC_PROGRAM = 2,  /* Also after every Program */
+};
+
 /* In memory context structure associated with a flash instance */
 typedef struct posixFlashFileContext_t {
     int fd_p1;              /* fd + 1, so fd == 0 is invalid */
     int unlocked;
+    uint8_t* map;           /* Mapped file, or NULL to use pread/pwrite */
     uint32_t partition_size;
     uint8_t erased_byte;
-    uint8_t padding[3];
+    uint8_t sync_mode;      /* POSIX_FLASH_FILE_SYNC_* */
+    uint8_t padding[2];
 } posixFlashFileContext;
 
 /* In memory configuration structure associated with an NVM instance */
@@ -48,7 +60,9 @@ typedef struct posixFlashFileConfig_t {
     const char* filename;       /* Null terminated */
     uint32_t partition_size;
     uint8_t erased_byte;
-    uint8_t padding[3];
+    uint8_t use_mmap;           /* Nonzero to map the file into memory */
+    uint8_t sync_mode;          /* POSIX_FLASH_FILE_SYNC_* when mapped */
+    uint8_t padding[1];
 } posixFlashFileConfig;
 
 int posixFlashFile_Init(void* c, const void* cf);
@@ -65,6 +79,9 @@ int posixFlashFile_Verify(void* c, uint32_t offset, uint32_t size,
         const uint8_t* data);
 int posixFlashFile_BlankCheck(void* c, uint32_t offset, uint32_t size);
 
+/* Flush a mapped file to storage.  Nothing to do without use_mmap */
+int posixFlashFile_Sync(void* c);
+
 #define POSIX_FLASH_FILE_CB                         \
 {                                                   \
     .Init = posixFlashFile_Init,                    \
@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * port/posix/posix_transport_shm.c
+ *
+ * Implementation of transport callbacks using POSIX shared memory
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#if defined(__linux__)
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_transport_mem.h"
+#include "port/posix/posix_transport_shm.h"
+
+
+/** Local declarations */
+
+/* Round a buffer size up so the following buffer is 8-byte aligned */
+#define PTSHM_ALIGN(_size) (((_size) + 7) & ~((size_t)7))
+
+/* Total mapped size for the given request and response buffer sizes */
+#define PTSHM_MAP_SIZE(_req, _resp) \
+    (sizeof(posixTransportShmHeader) + PTSHM_ALIGN(_req) + (_resp))
+
+/* Map the object behind fd and set up the memory transport over it */
+static int posixTransportShm_Map(posixTransportShmContext* c,
+        uint16_t req_size, uint16_t resp_size, int clear);
+
+/* Unmap and close the shared memory object */
+static void posixTransportShm_Unmap(posixTransportShmContext* c);
+
+/* Client: open and map the object once the server has initialized it */
+static int posixTransportShm_Attach(posixTransportShmContext* c);
+
+/* Client: unmap the object if the server has shut down */
+static int posixTransportShm_CheckServer(posixTransportShmContext* c);
+
+#if defined(__linux__)
+/* Memory transport hooks that sleep on and wake the futex words */
+static int posixTransportShm_Notify(void* arg);
+static int posixTransportShm_Wait(void* arg);
+#endif
+
+
+/** Local implementations */
+
+static int posixTransportShm_Map(posixTransportShmContext* c,
+        uint16_t req_size, uint16_t resp_size, int clear)
+{
+    int rc = 0;
+    void* map = NULL;
+    uint8_t* req = NULL;
+    whTransportMemConfig tmcf[1] = {{0}};
+
+    map = mmap(NULL, c->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            c->fd_p1 - 1, 0);
+    if (map == MAP_FAILED) {
+        return WH_ERROR_ABORTED;
+    }
+    c->header = (volatile posixTransportShmHeader*)map;
+
+    req = (uint8_t*)map + sizeof(posixTransportShmHeader);
+    tmcf->req       = req;
+    tmcf->req_size  = req_size;
+    tmcf->resp      = req + PTSHM_ALIGN(req_size);
+    tmcf->resp_size = resp_size;
+
+#if defined(__linux__)
+    if (c->wait_timeout_ms > 0) {
+        tmcf->notify_cb = posixTransportShm_Notify;
+        tmcf->wait_cb   = posixTransportShm_Wait;
+        tmcf->cb_arg    = c;
+    }
+#endif
+
+    if (clear != 0) {
+        rc = wh_TransportMem_InitClear(c->mem, tmcf, NULL, NULL);
+    } else {
+        rc = wh_TransportMem_Init(c->mem, tmcf, NULL, NULL);
+    }
+    if (rc != 0) {
+        posixTransportShm_Unmap(c);
+    }
+    return rc;
+}
+
+static void posixTransportShm_Unmap(posixTransportShmContext* c)
+{
+    if (c->mem->initialized != 0) {
+        (void)wh_TransportMem_Cleanup(c->mem);
+    }
+    if (c->header != NULL) {
+        (void)munmap((void*)c->header, c->map_size);
+        c->header = NULL;
+    }
+    if (c->fd_p1 != 0) {
+        close(c->fd_p1 - 1);
+        c->fd_p1 = 0;
+    }
+    c->wait_event = NULL;
+    c->peer_event = NULL;
+    c->map_size = 0;
+}
+
+static int posixTransportShm_Attach(posixTransportShmContext* c)
+{
+    int rc = 0;
+    int fd = -1;
+    struct stat st;
+    posixTransportShmHeader header;
+
+    if (c->connected != 0) {
+        return 0;
+    }
+
+    fd = shm_open(c->name, O_RDWR, 0);
+    if (fd < 0) {
+        /* Server has not created the object yet */
+        return (errno == ENOENT) ? WH_ERROR_NOTREADY : WH_ERROR_ABORTED;
+    }
+
+    /* Read the header to size the mapping */
+    memset(&header, 0, sizeof(header));
+    if (    (fstat(fd, &st) != 0) ||
+            (st.st_size < (off_t)sizeof(header)) ||
+            (pread(fd, &header, sizeof(header), 0) != sizeof(header)) ||
+            (header.magic != PTSHM_MAGIC) ||
+            (st.st_size < (off_t)PTSHM_MAP_SIZE(header.req_size,
+                                                 header.resp_size))) {
+        /* Server is still initializing */
+        close(fd);
+        return WH_ERROR_NOTREADY;
+    }
+
+    c->fd_p1 = fd + 1;
+    c->map_size = PTSHM_MAP_SIZE(header.req_size, header.resp_size);
+    rc = posixTransportShm_Map(c, header.req_size, header.resp_size, 0);
+    if (rc != 0) {
+        return rc;
+    }
+    c->wait_event = &c->header->client_event;
+    c->peer_event = &c->header->server_event;
+
+    c->connected = 1;
+    if (c->connectcb != NULL) {
+        c->connectcb(c->connectcb_arg, WH_COMM_CONNECTED);
+    }
+    return 0;
+}
+
+static int posixTransportShm_CheckServer(posixTransportShmContext* c)
+{
+    if (c->header->magic == PTSHM_MAGIC) {
+        return 0;
+    }
+    posixTransportShm_Unmap(c);
+    c->connected = 0;
+    if (c->connectcb != NULL) {
+        c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
+    }
+    return WH_ERROR_NOTREADY;
+}
+
+#if defined(__linux__)
+static int posixTransportShm_Notify(void* arg)
+{
+    posixTransportShmContext* c = arg;
+
+    __atomic_store_n(c->peer_event, 1, __ATOMIC_RELEASE);
+    (void)syscall(SYS_futex, c->peer_event, FUTEX_WAKE, 1, NULL, NULL, 0);
+    return 0;
+}
+
+static int posixTransportShm_Wait(void* arg)
+{
+    posixTransportShmContext* c = arg;
+    struct timespec ts;
+
+    /* A notify that arrived since the last wait leaves the word set, so the
+     * futex returns at once rather than missing the wakeup */
+    if (__atomic_exchange_n(c->wait_event, 0, __ATOMIC_ACQ_REL) != 0) {
+        return 0;
+    }
+
+    ts.tv_sec = c->wait_timeout_ms / 1000;
+    ts.tv_nsec = (c->wait_timeout_ms % 1000) * 1000000l;
+    (void)syscall(SYS_futex, c->wait_event, FUTEX_WAIT, 0, &ts, NULL, 0);
+    (void)__atomic_exchange_n(c->wait_event, 0, __ATOMIC_ACQ_REL);
+    return 0;
+}
+#endif
+
+
+/** Client functions */
+
+int posixTransportShm_InitConnect(void* context, const void* config,
+        whCommSetConnectedCb connectcb, void* connectcb_arg)
+{
+    posixTransportShmContext* c = context;
+    const posixTransportShmConfig* cf = config;
+    int rc = 0;
+
+    if (    (c == NULL) ||
+            (cf == NULL) ||
+            (cf->name == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->name = cf->name;
+    c->wait_timeout_ms = cf->wait_timeout_ms;
+    c->connectcb = connectcb;
+    c->connectcb_arg = connectcb_arg;
+
+    /* Map now if the server is ready. Otherwise retry on first use */
+    rc = posixTransportShm_Attach(c);
+    if (rc == WH_ERROR_NOTREADY) {
+        rc = 0;
+    }
+    return rc;
+}
+
+int posixTransportShm_SendRequest(void* context, uint16_t size,
+        const void* data)
+{
+    posixTransportShmContext* c = context;
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    rc = posixTransportShm_Attach(c);
+    if (rc == 0) {
+        rc = posixTransportShm_CheckServer(c);
+    }
+    if (rc == 0) {
+        rc = wh_TransportMem_SendRequest(c->mem, size, data);
+    }
+    return rc;
+}
+
+int posixTransportShm_RecvResponse(void* context, uint16_t *out_size,
+        void* data)
+{
+    posixTransportShmContext* c = context;
+    int rc = 0;
+    int alive = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    rc = posixTransportShm_Attach(c);
+    if (rc == 0) {
+        /* A response sent before the server shut down is still valid, so
+         * only give up if the server was already gone before checking */
+        alive = (c->header->magic == PTSHM_MAGIC);
+        __sync_synchronize();
+        rc = wh_TransportMem_RecvResponse(c->mem, out_size, data);
+        if ((rc == WH_ERROR_NOTREADY) && (alive == 0)) {
+            (void)posixTransportShm_CheckServer(c);
+        }
+    }
+    return rc;
+}
+
+int posixTransportShm_AcquireSendRequest(void* context, uint16_t *out_size,
+        void** out_buffer)
+{
+    posixTransportShmContext* c = context;
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    rc = posixTransportShm_Attach(c);
+    if (rc == 0) {
+        rc = posixTransportShm_CheckServer(c);
+    }
+    if (rc == 0) {
+        rc = wh_TransportMem_AcquireSendRequest(c->mem, out_size, out_buffer);
+    }
+    return rc;
+}
+
+int posixTransportShm_AcquireRecvResponse(void* context, uint16_t *out_size,
+        void** out_buffer)
+{
+    posixTransportShmContext* c = context;
+    int rc = 0;
+    int alive = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    rc = posixTransportShm_Attach(c);
+    if (rc == 0) {
+        /* A response sent before the server shut down is still valid, so
+         * only give up if the server was already gone before checking */
+        alive = (c->header->magic == PTSHM_MAGIC);
+        __sync_synchronize();
+        rc = wh_TransportMem_AcquireRecvResponse(c->mem, out_size, out_buffer);
+        if ((rc == WH_ERROR_NOTREADY) && (alive == 0)) {
+            (void)posixTransportShm_CheckServer(c);
+        }
+    }
+    return rc;
+}
+
+int posixTransportShm_CleanupConnect(void* context)
+{
+    posixTransportShmContext* c = context;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    posixTransportShm_Unmap(c);
+    if (c->connected != 0) {
+        c->connected = 0;
+        if (c->connectcb != NULL) {
+            c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
+        }
+    }
+    return 0;
+}
+
+
+/** Server functions */
+
+int posixTransportShm_InitListen(void* context, const void* config,
+        whCommSetConnectedCb connectcb, void* connectcb_arg)
+{
+    posixTransportShmContext* c = context;
+    const posixTransportShmConfig* cf = config;
+    uint16_t req_size = 0;
+    uint16_t resp_size = 0;
+    int fd = -1;
+    int rc = 0;
+
+    if (    (c == NULL) ||
+            (cf == NULL) ||
+            (cf->name == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    req_size = (cf->req_size != 0) ? cf->req_size : PTSHM_BUFFER_SIZE;
+    resp_size = (cf->resp_size != 0) ? cf->resp_size : PTSHM_BUFFER_SIZE;
+    if (    (req_size <= sizeof(whTransportMemCsr)) ||
+            (resp_size <= sizeof(whTransportMemCsr))) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->name = cf->name;
+    c->wait_timeout_ms = cf->wait_timeout_ms;
+    c->connectcb = connectcb;
+    c->connectcb_arg = connectcb_arg;
+    c->map_size = PTSHM_MAP_SIZE(req_size, resp_size);
+
+    /* Start from a zeroed object, even if a previous server left one */
+    fd = shm_open(c->name, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return WH_ERROR_ABORTED;
+    }
+    c->fd_p1 = fd + 1;
+
+    if (ftruncate(fd, c->map_size) != 0) {
+        rc = WH_ERROR_ABORTED;
+    }
+    if (rc == 0) {
+        rc = posixTransportShm_Map(c, req_size, resp_size, 1);
+    }
+    if (rc != 0) {
+        posixTransportShm_Unmap(c);
+        (void)shm_unlink(c->name);
+        return rc;
+    }
+    c->header->req_size = req_size;
+    c->header->resp_size = resp_size;
+    c->wait_event = &c->header->server_event;
+    c->peer_event = &c->header->client_event;
+
+    /* Publish the object to clients */
+    __sync_synchronize();
+    c->header->magic = PTSHM_MAGIC;
+
+    c->connected = 1;
+    if (c->connectcb != NULL) {
+        c->connectcb(c->connectcb_arg, WH_COMM_CONNECTED);
+    }
+    return 0;
+}
+
+int posixTransportShm_RecvRequest(void* context, uint16_t *out_size,
+        void* data)
+{
+    posixTransportShmContext* c = context;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    return wh_TransportMem_RecvRequest(c->mem, out_size, data);
+}
+
+int posixTransportShm_SendResponse(void* context, uint16_t size,
+        const void* data)
+{
+    posixTransportShmContext* c = context;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    return wh_TransportMem_SendResponse(c->mem, size, data);
+}
+
+int posixTransportShm_AcquireRecvRequest(void* context, uint16_t *out_size,
+        void** out_buffer)
+{
+    posixTransportShmContext* c = context;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    return wh_TransportMem_AcquireRecvRequest(c->mem, out_size, out_buffer);
+}
+
+int posixTransportShm_AcquireSendResponse(void* context, uint16_t *out_size,
+        void** out_buffer)
+{
+    posixTransportShmContext* c = context;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    return wh_TransportMem_AcquireSendResponse(c->mem, out_size, out_buffer);
+}
+
+int posixTransportShm_CleanupListen(void* context)
+{
+    posixTransportShmContext* c = context;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (c->header != NULL) {
+        /* Tell a mapped client the server is gone, and wake it to notice */
+        __sync_synchronize();
+        c->header->magic = 0;
+#if defined(__linux__)
+        if (c->peer_event != NULL) {
+            posixTransportShm_Notify(c);
+        }
+#endif
+    }
+    posixTransportShm_Unmap(c);
+    if (c->name != NULL) {
+        (void)shm_unlink(c->name);
+    }
+    if (c->connected != 0) {
+        c->connected = 0;
+        if (c->connectcb != NULL) {
+            c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * port/posix/posix_transport_shm.h
+ *
+ * wolfHSM Transport binding using a POSIX shared memory object
+ */
+
+#ifndef PORT_POSIX_POSIX_TRANSPORT_SHM_H_
+#define PORT_POSIX_POSIX_TRANSPORT_SHM_H_
+
+/* Example usage:
+ *
+ * posixTransportShmConfig ptshmcfg[1] = {{
+ *      .name = "/wolfhsm",
+ *      .wait_timeout_ms = 10,
+ * }};
+ *
+ * whTransportClientCb ptshmccb[1] = {PTSHM_CLIENT_CB};
+ * posixTransportShmClientContext ptshmcc[1] = {0};
+ * whCommClientConfig ccc[1] = {{
+ *      .transport_cb = ptshmccb,
+ *      .transport_context = ptshmcc,
+ *      .transport_config = ptshmcfg,
+ *      .client_id = 1234,
+ * }}
+ * whCommClient cc[1] ={0};
+ * wh_CommClient_Init(cc, ccc);
+ *
+ * whTransportServerCb ptshmscb[1] = {PTSHM_SERVER_CB};
+ * posixTransportShmServerContext ptshmsc[1] = {0};
+ * whCommServerConfig csc[1] = {{
+ *      .transport_cb = ptshmscb,
+ *      .transport_context = ptshmsc,
+ *      .transport_config = ptshmcfg,
+ *      .server_id = 5678,
+ * }}
+ * whCommServer cs[1] = {0};
+ * wh_CommServer_Init(cs, csc);
+ *
+ * The server creates, sizes and maps the shared memory object and unlinks it
+ * on cleanup.  The client maps the existing object, so client and server may
+ * run in separate processes and start in either order.  Until the server has
+ * initialized the object, client sends and receives return WH_ERROR_NOTREADY.
+ *
+ * Requests and responses use the whTransportMemCsr protocol of
+ * wh_transport_mem.h.  On Linux, a non-zero wait_timeout_ms lets a side that
+ * finds nothing to receive sleep on a futex in the shared object until the
+ * peer notifies it or the timeout expires, instead of spinning.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_transport_mem.h"
+
+/* Request and response buffer size used when the config leaves it as 0 */
+#define PTSHM_BUFFER_SIZE (sizeof(whTransportMemCsr) + WH_COMM_MTU)
+
+/* Identifies an initialized shared memory object */
+#define PTSHM_MAGIC 0x5748534Dul /* "WHSM" */
+
+/** Common configuration structure */
+typedef struct {
+    const char* name;       /* Shared memory object name, e.g. "/wolfhsm" */
+    uint16_t req_size;      /* Server only. Request buffer including CSR */
+    uint16_t resp_size;     /* Server only. Response buffer including CSR */
+    int wait_timeout_ms;    /* Opt: Max futex sleep. 0 polls without sleeping */
+} posixTransportShmConfig;
+
+/** Layout of the start of the shared memory object.  The request buffer
+ * follows immediately, then the response buffer at the next 8-byte boundary */
+typedef struct {
+    uint32_t magic;         /* PTSHM_MAGIC once the server is ready */
+    uint32_t server_event;  /* Futex word the server sleeps on */
+    uint32_t client_event;  /* Futex word the client sleeps on */
+    uint16_t req_size;
+    uint16_t resp_size;
+} posixTransportShmHeader;
+
+/** Common context */
+typedef struct {
+    whTransportMemContext mem[1];
+    whCommSetConnectedCb connectcb;
+    void* connectcb_arg;
+    const char* name;
+    volatile posixTransportShmHeader* header;
+    volatile uint32_t* wait_event; /* This side's futex word */
+    volatile uint32_t* peer_event; /* The peer's futex word */
+    size_t map_size;
+    int fd_p1;              /* fd plus 1 so 0 is invalid */
+    int wait_timeout_ms;
+    int connected;
+    uint8_t padding[4];
+} posixTransportShmContext;
+
+/* Naming conveniences. Reuses the same types. */
+typedef posixTransportShmContext posixTransportShmClientContext;
+typedef posixTransportShmContext posixTransportShmServerContext;
+
+/** Client functions */
+int posixTransportShm_InitConnect(void* context, const void* config,
+        whCommSetConnectedCb connectcb, void* connectcb_arg);
+int posixTransportShm_SendRequest(void* context, uint16_t size,
+        const void* data);
+int posixTransportShm_RecvResponse(void* context, uint16_t *out_size,
+        void* data);
+int posixTransportShm_AcquireSendRequest(void* context, uint16_t *out_size,
+        void** out_buffer);
+int posixTransportShm_AcquireRecvResponse(void* context, uint16_t *out_size,
+        void** out_buffer);
+int posixTransportShm_CleanupConnect(void* context);
+
+#define PTSHM_CLIENT_CB                                     \
+{                                                           \
+    .Init =         posixTransportShm_InitConnect,          \
+    .Send =         posixTransportShm_SendRequest,          \
+    .Recv =         posixTransportShm_RecvResponse,         \
+    .Cleanup =      posixTransportShm_CleanupConnect,       \
+    .AcquireSend =  posixTransportShm_AcquireSendRequest,   \
+    .AcquireRecv =  posixTransportShm_AcquireRecvResponse,  \
+}
+
+/** Server functions */
+int posixTransportShm_InitListen(void* context, const void* config,
+        whCommSetConnectedCb connectcb, void* connectcb_arg);
+int posixTransportShm_RecvRequest(void* context, uint16_t *out_size,
+        void* data);
+int posixTransportShm_SendResponse(void* context, uint16_t size,
+        const void* data);
+int posixTransportShm_AcquireRecvRequest(void* context, uint16_t *out_size,
+        void** out_buffer);
+int posixTransportShm_AcquireSendResponse(void* context, uint16_t *out_size,
+        void** out_buffer);
+int posixTransportShm_CleanupListen(void* context);
+
+#define PTSHM_SERVER_CB                                     \
+{                                                           \
+    .Init =         posixTransportShm_InitListen,           \
+    .Recv =         posixTransportShm_RecvRequest,          \
+    .Send =         posixTransportShm_SendResponse,         \
+    .Cleanup =      posixTransportShm_CleanupListen,        \
+    .AcquireRecv =  posixTransportShm_AcquireRecvRequest,   \
+    .AcquireSend =  posixTransportShm_AcquireSendResponse,  \
+}
+
+#endif /* PORT_POSIX_POSIX_TRANSPORT_SHM_H_ */
@@ -35,6 +35,10 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <poll.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
 
 #include "wolfhsm/wh_error.h"
 #include "wolfhsm/wh_comm.h"
@@ -49,13 +53,23 @@ static int posixTransportTcp_MakeNonBlocking(int fd);
 /* Server utility function to make a socket no linger and reuse addr */
 static int posixTransportTcp_MakeNoLinger(int sock);
 
-/* Common send/write function with a byte buffer */
-static int posixTransportTcp_Send(int fd, uint16_t* buffer_offset,
-        uint8_t* buffer, uint16_t size, const void* data);
+/* Common utility function to disable Nagle's algorithm on a connection */
+static int posixTransportTcp_MakeNoDelay(int sock);
 
-/* Common recv/read function with a byte buffer */
-static int posixTransportTcp_Recv(int fd, uint16_t* buffer_offset,
-        uint8_t* buffer, uint16_t *out_size, void* data);
+/* Common send/write function that gathers the length prefix and packet */
+static int posixTransportTcp_Send(int fd, posixTransportTcpStream* stream,
+        uint16_t size, const void* data);
+
+/* Common recv/read function that scatters into the caller's buffer */
+static int posixTransportTcp_Recv(int fd, posixTransportTcpStream* stream,
+        uint16_t *out_size, void* data);
+
+/* Server utility function to create a non-blocking listening socket */
+static int posixTransportTcp_Listen(const posixTransportTcpConfig* cf,
+        struct sockaddr_in* addr, int backlog, int* out_fd_p1);
+
+/* Reset the framing state, discarding any partial or queued packets */
+static void posixTransportTcp_ResetStream(posixTransportTcpStream* stream);
 
 /** Local implementations */
 static int posixTransportTcp_MakeNonBlocking(int fd)
@@ -96,34 +110,72 @@ static int posixTransportTcp_MakeNoLinger(int sock)
     return 0;
 }
 
-static int posixTransportTcp_Send(int fd, uint16_t* buffer_offset,
-        uint8_t* buffer, uint16_t size, const void* data)
+static int posixTransportTcp_MakeNoDelay(int sock)
+{
+    int enable = 1;
+    int rc = 0;
+
+    rc = setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (rc != 0) {
+        return WH_ERROR_ABORTED;
+    }
+    return 0;
+}
+
+static void posixTransportTcp_ResetStream(posixTransportTcpStream* stream)
+{
+    stream->tx_len = 0;
+    stream->rx_len = 0;
+    stream->tx_offset = 0;
+    stream->rx_len_offset = 0;
+    stream->rx_offset = 0;
+    stream->queued_start = 0;
+    stream->queued_end = 0;
+}
+
+static int posixTransportTcp_Send(int fd, posixTransportTcpStream* stream,
+        uint16_t size, const void* data)
 {
     int rc = 0;
-    int send_size = 0;
-    uint32_t* packet_len = (uint32_t*)&(buffer[0]);
-    void* packet_data = &(buffer[sizeof(uint32_t)]);
+    struct iovec iov[2];
+    struct msghdr msg;
+    int iov_count = 0;
+    uint32_t offset = 0;
+    uint32_t remaining_size = 0;
 
     if (    (fd < 0) ||
-            (buffer_offset == NULL) ||
-            (buffer == NULL) ||
+            (stream == NULL) ||
             (size == 0) ||
             (size > PTT_PACKET_MAX_SIZE) ||
             (data == NULL) ) {
         return WH_ERROR_BADARGS;
     }
 
-    if(*buffer_offset == 0) {
-        /* Initial write.  Copy data to buffer */
-        /* Prepend packet data with the size in network order */
-        *packet_len = htonl((uint32_t)size);
-        memcpy(packet_data, data, size);
-        send_size = sizeof(uint32_t) + size;
+    if (stream->tx_offset == 0) {
+        /* Initial write. Prefix the packet with the size in network order */
+        stream->tx_len = htonl((uint32_t)size);
     }
-    int remaining_size = send_size - *buffer_offset;
-
+    offset = stream->tx_offset;
+    remaining_size = sizeof(stream->tx_len) + size - offset;
+
+    /* Gather whatever remains of the prefix and the packet */
+    if (offset < sizeof(stream->tx_len)) {
+        iov[iov_count].iov_base = (uint8_t*)&stream->tx_len + offset;
+        iov[iov_count].iov_len = sizeof(stream->tx_len) - offset;
+        iov_count++;
+        offset = 0;
+    } else {
+        offset -= sizeof(stream->tx_len);
+    }
+    iov[iov_count].iov_base = (uint8_t*)data + offset;
+    iov[iov_count].iov_len = size - offset;
+    iov_count++;
 
-    rc = send(fd, &(buffer[*buffer_offset]), remaining_size, MSG_NOSIGNAL);
+    /* sendmsg rather than writev so MSG_NOSIGNAL can suppress SIGPIPE */
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_count;
+    rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
 
     if (rc < 0) {
         switch (errno) {
@@ -134,101 +186,211 @@ static int posixTransportTcp_Send(int fd, uint16_t* buffer_offset,
 
         default:
             /* Other error. Assume fatal. */
-            *buffer_offset = 0;
+            stream->tx_offset = 0;
             return WH_ERROR_ABORTED;
         }
     }
 
-    if(rc != remaining_size) {
+    if ((uint32_t)rc != remaining_size) {
         /* Incomplete write */
-        *buffer_offset += rc;
+        stream->tx_offset += rc;
         return WH_ERROR_NOTREADY;
     }
 
     /* All good. Reset state */
-    *buffer_offset = 0;
+    stream->tx_offset = 0;
     return 0;
 }
 
-static int posixTransportTcp_Recv(int fd, uint16_t* buffer_offset,
-        uint8_t* buffer, uint16_t *out_size, void* data)
+static int posixTransportTcp_Recv(int fd, posixTransportTcpStream* stream,
+        uint16_t *out_size, void* data)
 {
     int rc = 0;
-    uint32_t* packet_len = (uint32_t*)&(buffer[0]);
-    void* packet_data = &(buffer[sizeof(uint32_t)]);
+    struct iovec iov[2];
+    int iov_count = 0;
+    uint8_t* dest = data;
     uint32_t packet_size = 0;
-    uint32_t size_remaining = 0;
+    uint32_t avail = 0;
+    uint32_t count = 0;
 
     if (    (fd < 0) ||
-            (buffer_offset == NULL) ||
-            (*buffer_offset > PTT_BUFFER_SIZE) ||
-            (buffer == NULL) ) {
+            (stream == NULL) ||
+            (stream->queued_start > stream->queued_end) ||
+            (stream->queued_end > sizeof(stream->buffer)) ||
+            (data == NULL) ) {
         return WH_ERROR_BADARGS;
     }
 
-    if(*buffer_offset < sizeof(uint32_t)) {
-        /* Try to read the size */
-        rc = read(fd,
-                &(buffer[*buffer_offset]),
-                sizeof(uint32_t) - *buffer_offset);
+    while (1) {
+        /* Consume bytes already queued by an earlier read */
+        avail = stream->queued_end - stream->queued_start;
+        if (    (avail > 0) &&
+                (stream->rx_len_offset < sizeof(stream->rx_len))) {
+            count = sizeof(stream->rx_len) - stream->rx_len_offset;
+            if (count > avail) {
+                count = avail;
+            }
+            memcpy((uint8_t*)&stream->rx_len + stream->rx_len_offset,
+                    &stream->buffer[stream->queued_start], count);
+            stream->rx_len_offset += count;
+            stream->queued_start += count;
+            avail -= count;
+        }
+
+        if (stream->rx_len_offset == sizeof(stream->rx_len)) {
+            /* Have the size */
+            packet_size = ntohl(stream->rx_len);
+            if ((packet_size == 0) || (packet_size > PTT_PACKET_MAX_SIZE)) {
+                /* Bad recv'ed size.  Assume fatal */
+                posixTransportTcp_ResetStream(stream);
+                return WH_ERROR_ABORTED;
+            }
+            if (    (avail > 0) &&
+                    (stream->rx_offset < packet_size)) {
+                count = packet_size - stream->rx_offset;
+                if (count > avail) {
+                    count = avail;
+                }
+                memcpy(dest + stream->rx_offset,
+                        &stream->buffer[stream->queued_start], count);
+                stream->rx_offset += count;
+                stream->queued_start += count;
+            }
+            if (stream->rx_offset == packet_size) {
+                /* Got complete packet. */
+                break;
+            }
+        }
+        if (stream->queued_start < stream->queued_end) {
+            /* More queued data to process */
+            continue;
+        }
+        stream->queued_start = 0;
+        stream->queued_end = 0;
+
+        /* Read the rest of this packet directly into the caller's buffer and
+         * queue anything after it.  Until the size is known, read
+         * speculatively into the caller's buffer. */
+        iov_count = 0;
+        if (stream->rx_len_offset < sizeof(stream->rx_len)) {
+            iov[iov_count].iov_base =
+                    (uint8_t*)&stream->rx_len + stream->rx_len_offset;
+            iov[iov_count].iov_len =
+                    sizeof(stream->rx_len) - stream->rx_len_offset;
+            iov_count++;
+            iov[iov_count].iov_base = dest;
+            iov[iov_count].iov_len = PTT_PACKET_MAX_SIZE;
+            iov_count++;
+        } else {
+            iov[iov_count].iov_base = dest + stream->rx_offset;
+            iov[iov_count].iov_len = packet_size - stream->rx_offset;
+            iov_count++;
+            iov[iov_count].iov_base = stream->buffer;
+            iov[iov_count].iov_len = sizeof(stream->buffer);
+            iov_count++;
+        }
+        rc = readv(fd, iov, iov_count);
         if (rc < 0) {
             switch (errno) {
             case EAGAIN:
+            case EINPROGRESS:
             case EINTR:
                 /* Not connected yet or no recv data */
                 return WH_ERROR_NOTREADY;
 
             default:
                 /* Other error. Assume fatal. */
-                *buffer_offset = 0;
+                posixTransportTcp_ResetStream(stream);
                 return WH_ERROR_ABORTED;
             }
         }
-        *buffer_offset += rc;
+        if (rc == 0) {
+            /* Peer closed the connection */
+            return WH_ERROR_NOTREADY;
+        }
+
+        count = rc;
+        if (stream->rx_len_offset < sizeof(stream->rx_len)) {
+            if (count < iov[0].iov_len) {
+                stream->rx_len_offset += count;
+                continue;
+            }
+            count -= iov[0].iov_len;
+            stream->rx_len_offset = sizeof(stream->rx_len);
+            packet_size = ntohl(stream->rx_len);
+            if ((packet_size == 0) || (packet_size > PTT_PACKET_MAX_SIZE)) {
+                /* Bad recv'ed size.  Assume fatal */
+                posixTransportTcp_ResetStream(stream);
+                return WH_ERROR_ABORTED;
+            }
+            if (count > packet_size) {
+                /* Queue the start of the next packet */
+                memcpy(stream->buffer, dest + packet_size, count - packet_size);
+                stream->queued_end = count - packet_size;
+                count = packet_size;
+            }
+            stream->rx_offset = count;
+        } else {
+            if (count > iov[0].iov_len) {
+                stream->queued_end = count - iov[0].iov_len;
+                count = iov[0].iov_len;
+            }
+            stream->rx_offset += count;
+        }
     }
-    if(*buffer_offset < sizeof(uint32_t)) {
-        return WH_ERROR_NOTREADY;
+
+    if (out_size != NULL) {
+        *out_size = packet_size;
     }
-    /* Have the size */
-    packet_size = ntohl(*packet_len);
-    size_remaining = packet_size - (*buffer_offset - sizeof(uint32_t));
-    if ( (packet_size == 0) || (packet_size > PTT_PACKET_MAX_SIZE)) {
-        /* Bad recv'ed size.  Assume fatal */
-        *buffer_offset = 0;
-        return WH_ERROR_ABORTED;
+    stream->rx_len_offset = 0;
+    stream->rx_offset = 0;
+    return 0;
+}
+
+static int posixTransportTcp_Listen(const posixTransportTcpConfig* cf,
+        struct sockaddr_in* addr, int backlog, int* out_fd_p1)
+{
+    int rc = 0;
+    int fd = -1;
+
+    rc = inet_pton(AF_INET, cf->server_ip_string, &addr->sin_addr);
+    if (rc != 1) {
+        /* rc == -1 means errno set. rc == 0 means string is not understood. */
+        return WH_ERROR_BADARGS;
     }
-    /* Read the rest of the packet */
-    rc = read(fd,
-            &(buffer[*buffer_offset]),
-            size_remaining);
-    if (rc < 0) {
-        switch (errno) {
-        case EAGAIN:
-        case EINPROGRESS:
-        case EINTR:
-            /* No recv data */
-            return WH_ERROR_NOTREADY;
+    addr->sin_port = htons(cf->server_port);
+    addr->sin_family = AF_INET;
 
-        default:
-            /* Other error. Assume fatal. */
-            *buffer_offset = 0;
-            return WH_ERROR_ABORTED;
-        }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return WH_ERROR_ABORTED;
     }
-    *buffer_offset += rc;
-    size_remaining -= rc;
-    if (size_remaining > 0) {
-        return WH_ERROR_NOTREADY;
+
+    /* Make socket non-blocking */
+    rc = posixTransportTcp_MakeNonBlocking(fd);
+    if (rc != 0) {
+        close(fd);
+        return WH_ERROR_ABORTED;
     }
 
-    /* Got complete packet. */
-    if (data != NULL) {
-        memcpy(data, packet_data, packet_size);
+    /* Ensure listen port does not linger */
+    rc = posixTransportTcp_MakeNoLinger(fd);
+    /* Ok to fail to linger.  Annoying, but ok. */
+
+    rc = bind(fd, (struct sockaddr*)addr, sizeof(*addr));
+    if (rc < 0) {
+        perror("bind failed\n");
+        close(fd);
+        return WH_ERROR_ABORTED;
     }
-    if (out_size != NULL) {
-        *out_size = packet_size;
+
+    rc = listen(fd, backlog);
+    if (rc < 0) {
+        close(fd);
+        return WH_ERROR_ABORTED;
     }
-    *buffer_offset = 0;
+
+    *out_fd_p1 = fd + 1;
     return 0;
 }
 
@@ -315,10 +477,6 @@ int posixTransportTcp_SendRequest(void* context,
         return WH_ERROR_BADARGS;
     }
 
-    if (c->request_sent == 1) {
-        return WH_ERROR_NOTREADY;
-    }
-
     /* Handle late/slow connect */
     if (c->connected == 0) {
         /* Ensure writeable */
@@ -342,20 +500,21 @@ int posixTransportTcp_SendRequest(void* context,
             return WH_ERROR_NOTREADY;
         }
         c->connected = 1;
+        /* Small request packets should not wait on Nagle's algorithm */
+        (void)posixTransportTcp_MakeNoDelay(c->connect_fd_p1 - 1);
     }
 
     rc = posixTransportTcp_Send(
             c->connect_fd_p1 - 1,
-            &c->buffer_offset,
-            c->buffer,
+            c->stream,
             size, data);
 
     if (rc != WH_ERROR_NOTREADY) {
-        /* Reset state */
-        c->buffer_offset = 0;
         if (rc == 0) {
-            c->request_sent = 1;
+            /* Requests may be pipelined. Responses arrive in order */
+            c->request_sent++;
         } else {
+            posixTransportTcp_ResetStream(c->stream);
             /* Assume fatal error and trigger disconnect */
             if (c->connectcb != NULL) {
                 c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
@@ -375,22 +534,23 @@ int posixTransportTcp_RecvResponse(void* context,
         return WH_ERROR_BADARGS;
     }
 
-    if (c->request_sent != 1) {
+    if (c->request_sent == 0) {
         return WH_ERROR_NOTREADY;
     }
 
     rc = posixTransportTcp_Recv(
             c->connect_fd_p1 - 1,
-            &c->buffer_offset,
-            c->buffer,
+            c->stream,
             out_size,
             data);
 
     if (rc != WH_ERROR_NOTREADY) {
-        /* Success or fatal.  Reset state either way */
-        c->buffer_offset = 0;
-        c->request_sent = 0;
-        if (rc != 0) {
+        if (rc == 0) {
+            c->request_sent--;
+        } else {
+            /* Discard all outstanding requests */
+            c->request_sent = 0;
+            posixTransportTcp_ResetStream(c->stream);
             /* Assume fatal error and trigger disconnect */
             if (c->connectcb != NULL) {
                 c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
@@ -437,47 +597,9 @@ int posixTransportTcp_InitListen(void* context, const void* config,
 
     memset(c, 0, sizeof(*c));
 
-    rc = inet_pton(AF_INET, cf->server_ip_string, &c->server_addr.sin_addr);
-    if (rc != 1) {
-        /* rc == -1 means errno set. rc == 0 means string is not understood. */
-        return WH_ERROR_BADARGS;
-    }
-    c->server_addr.sin_port = htons(cf->server_port);
-    c->server_addr.sin_family = AF_INET;
-
-    rc = socket(AF_INET, SOCK_STREAM, 0);
-    if (rc < 0) {
-        return WH_ERROR_ABORTED;
-    }
-    c->listen_fd_p1 = rc + 1;
-
-    /* Make socket non-blocking */
-    rc = posixTransportTcp_MakeNonBlocking(c->listen_fd_p1 - 1);
+    rc = posixTransportTcp_Listen(cf, &c->server_addr, 1, &c->listen_fd_p1);
     if (rc != 0) {
-        close(c->listen_fd_p1 - 1);
-        c->listen_fd_p1 = 0;
-        return WH_ERROR_ABORTED;
-    }
-
-    /* Ensure listen port does not linger */
-    rc = posixTransportTcp_MakeNoLinger(c->listen_fd_p1 - 1);
-    /* Ok to fail to linger.  Annoying, but ok. */
-
-    rc = bind(c->listen_fd_p1 - 1,
-            (struct sockaddr*)&c->server_addr,
-            sizeof(c->server_addr));
-    if (rc < 0) {
-        perror("bind failed\n");
-        close(c->listen_fd_p1 - 1);
-        c->listen_fd_p1 = 0;
-        return WH_ERROR_ABORTED;
-    }
-
-    rc = listen(c->listen_fd_p1 - 1, 1);
-    if (rc < 0) {
-        close(c->listen_fd_p1 - 1);
-        c->listen_fd_p1 = 0;
-        return WH_ERROR_ABORTED;
+        return rc;
     }
 
     c->connectcb = connectcb;
@@ -523,6 +645,9 @@ int posixTransportTcp_RecvRequest(void* context,
             }
         }
         c->accept_fd_p1 = rc + 1;
+        posixTransportTcp_ResetStream(c->stream);
+        /* Small response packets should not wait on Nagle's algorithm */
+        (void)posixTransportTcp_MakeNoDelay(c->accept_fd_p1 - 1);
     }
 
     if (c->request_recv == 1) {
@@ -532,17 +657,15 @@ int posixTransportTcp_RecvRequest(void* context,
 
     rc = posixTransportTcp_Recv(
             c->accept_fd_p1 - 1,
-            &c->buffer_offset,
-            c->buffer,
+            c->stream,
             out_size,
             data);
 
     if (rc != WH_ERROR_NOTREADY) {
-        /* Success or fatal.  Reset state either way */
-        c->buffer_offset = 0;
         if (rc == 0) {
             c->request_recv = 1;
         } else {
+            posixTransportTcp_ResetStream(c->stream);
             /* Assume fatal error and trigger disconnect */
             if (c->connectcb != NULL) {
                 c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
@@ -572,16 +695,14 @@ int posixTransportTcp_SendResponse(void* context,
 
     rc = posixTransportTcp_Send(
             c->accept_fd_p1 - 1,
-            &c->buffer_offset,
-            c->buffer,
+            c->stream,
             size, data);
 
     if (rc != WH_ERROR_NOTREADY) {
-        /* Reset state */
-        c->buffer_offset = 0;
         if (rc == 0) {
             c->request_recv = 0;
         } else {
+            posixTransportTcp_ResetStream(c->stream);
             /* Assume fatal error and trigger disconnect */
             if (c->connectcb != NULL) {
                 c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
@@ -614,3 +735,363 @@ int posixTransportTcp_CleanupListen(void* context)
 
     return 0;
 }
+
+
+/** Multi-client server functions */
+#if defined(__linux__)
+
+/* Close a mux server's connection and report the disconnect */
+static void posixTransportTcpMux_Drop(posixTransportTcpMuxContext* mux,
+        posixTransportTcpMuxServerContext* c)
+{
+    if (c->accept_fd_p1 == 0) {
+        return;
+    }
+    (void)epoll_ctl(mux->epoll_fd_p1 - 1, EPOLL_CTL_DEL,
+            c->accept_fd_p1 - 1, NULL);
+    close(c->accept_fd_p1 - 1);
+    c->accept_fd_p1 = 0;
+    c->request_recv = 0;
+    posixTransportTcp_ResetStream(c->stream);
+    if (c->connectcb != NULL) {
+        c->connectcb(c->connectcb_arg, WH_COMM_DISCONNECTED);
+    }
+}
+
+/* Check for request bytes not yet taken by RecvRequest */
+static int posixTransportTcpMux_HasInput(posixTransportTcpMuxServerContext* c)
+{
+    uint8_t byte = 0;
+
+    if (c->stream->queued_start < c->stream->queued_end) {
+        return 1;
+    }
+    return (recv(c->accept_fd_p1 - 1, &byte, sizeof(byte),
+            MSG_PEEK | MSG_DONTWAIT) > 0) ? 1 : 0;
+}
+
+/* Accept all pending connections into free server slots */
+static int posixTransportTcpMux_Accept(posixTransportTcpMuxContext* mux)
+{
+    int rc = 0;
+    int fd = -1;
+    int slot = 0;
+    struct epoll_event ev;
+    posixTransportTcpMuxServerContext* c = NULL;
+
+    while (1) {
+        fd = accept(mux->listen_fd_p1 - 1, NULL, NULL);
+        if (fd < 0) {
+            switch (errno) {
+            case EAGAIN:
+            case EINTR:
+                /* No more pending clients */
+                return 0;
+
+            default:
+                /* Other error. Assume fatal. */
+                return WH_ERROR_ABORTED;
+            }
+        }
+
+        /* Find a server that is not connected */
+        c = NULL;
+        for (slot = 0; slot < PTT_MUX_MAX_CLIENTS; slot++) {
+            if (    (mux->servers[slot] != NULL) &&
+                    (mux->servers[slot]->accept_fd_p1 == 0)) {
+                c = mux->servers[slot];
+                break;
+            }
+        }
+        if (    (c == NULL) ||
+                (posixTransportTcp_MakeNonBlocking(fd) != 0)) {
+            /* No server available for this client */
+            close(fd);
+            continue;
+        }
+        (void)posixTransportTcp_MakeNoDelay(fd);
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u32 = slot;
+        rc = epoll_ctl(mux->epoll_fd_p1 - 1, EPOLL_CTL_ADD, fd, &ev);
+        if (rc != 0) {
+            close(fd);
+            continue;
+        }
+
+        c->accept_fd_p1 = fd + 1;
+        c->request_recv = 0;
+        posixTransportTcp_ResetStream(c->stream);
+        if (c->connectcb != NULL) {
+            c->connectcb(c->connectcb_arg, WH_COMM_CONNECTED);
+        }
+    }
+}
+
+int posixTransportTcpMux_Init(posixTransportTcpMuxContext* mux,
+        const posixTransportTcpConfig* config)
+{
+    int rc = 0;
+    struct epoll_event ev;
+
+    if ((mux == NULL) || (config == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(mux, 0, sizeof(*mux));
+
+    rc = epoll_create1(0);
+    if (rc < 0) {
+        return WH_ERROR_ABORTED;
+    }
+    mux->epoll_fd_p1 = rc + 1;
+
+    rc = posixTransportTcp_Listen(config, &mux->server_addr,
+            PTT_MUX_MAX_CLIENTS, &mux->listen_fd_p1);
+    if (rc == 0) {
+        /* The listening socket uses the slot index past all servers */
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = PTT_MUX_MAX_CLIENTS;
+        if (epoll_ctl(mux->epoll_fd_p1 - 1, EPOLL_CTL_ADD,
+                mux->listen_fd_p1 - 1, &ev) != 0) {
+            rc = WH_ERROR_ABORTED;
+        }
+    }
+    if (rc != 0) {
+        (void)posixTransportTcpMux_Cleanup(mux);
+    }
+    return rc;
+}
+
+int posixTransportTcpMux_Wait(posixTransportTcpMuxContext* mux,
+        int timeout_ms, uint32_t* out_ready)
+{
+    int rc = 0;
+    int i = 0;
+    uint32_t slot = 0;
+    uint32_t ready = 0;
+    struct epoll_event events[PTT_MUX_MAX_CLIENTS + 1];
+    posixTransportTcpMuxServerContext* c = NULL;
+
+    if (    (mux == NULL) ||
+            (mux->epoll_fd_p1 == 0) ||
+            (out_ready == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Packets already queued from an earlier read need no system call */
+    for (slot = 0; slot < PTT_MUX_MAX_CLIENTS; slot++) {
+        c = mux->servers[slot];
+        if (    (c != NULL) &&
+                (c->accept_fd_p1 != 0) &&
+                (c->stream->queued_start < c->stream->queued_end)) {
+            ready |= (1ul << slot);
+        }
+    }
+
+    rc = epoll_wait(mux->epoll_fd_p1 - 1, events,
+            sizeof(events) / sizeof(events[0]),
+            (ready != 0) ? 0 : timeout_ms);
+    if (rc < 0) {
+        if (errno == EINTR) {
+            rc = 0;
+        } else {
+            return WH_ERROR_ABORTED;
+        }
+    }
+
+    for (i = 0; i < rc; i++) {
+        slot = events[i].data.u32;
+        if (slot == PTT_MUX_MAX_CLIENTS) {
+            if (posixTransportTcpMux_Accept(mux) != 0) {
+                return WH_ERROR_ABORTED;
+            }
+            continue;
+        }
+        c = mux->servers[slot];
+        if (c == NULL) {
+            continue;
+        }
+        if (    ((events[i].events & EPOLLERR) != 0) ||
+                (((events[i].events & (EPOLLRDHUP | EPOLLHUP)) != 0) &&
+                 (c->request_recv == 0) &&
+                 (posixTransportTcpMux_HasInput(c) == 0))) {
+            /* Client has gone away and left nothing to handle */
+            posixTransportTcpMux_Drop(mux, c);
+            ready &= ~(1ul << slot);
+        } else if ((events[i].events & EPOLLIN) != 0) {
+            /* Requests sent just before a hang up are still read */
+            ready |= (1ul << slot);
+        }
+    }
+
+    *out_ready = ready;
+    return (ready != 0) ? 0 : WH_ERROR_NOTREADY;
+}
+
+int posixTransportTcpMux_GetSlot(posixTransportTcpMuxServerContext* context,
+        int* out_slot)
+{
+    int slot = 0;
+
+    if ((context == NULL) || (context->mux == NULL) || (out_slot == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+    for (slot = 0; slot < PTT_MUX_MAX_CLIENTS; slot++) {
+        if (context->mux->servers[slot] == context) {
+            *out_slot = slot;
+            return 0;
+        }
+    }
+    return WH_ERROR_NOTFOUND;
+}
+
+int posixTransportTcpMux_Cleanup(posixTransportTcpMuxContext* mux)
+{
+    int slot = 0;
+
+    if (mux == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    for (slot = 0; slot < PTT_MUX_MAX_CLIENTS; slot++) {
+        if (mux->servers[slot] != NULL) {
+            posixTransportTcpMux_Drop(mux, mux->servers[slot]);
+            mux->servers[slot]->mux = NULL;
+            mux->servers[slot] = NULL;
+        }
+    }
+    if (mux->listen_fd_p1 != 0) {
+        close(mux->listen_fd_p1 - 1);
+        mux->listen_fd_p1 = 0;
+    }
+    if (mux->epoll_fd_p1 != 0) {
+        close(mux->epoll_fd_p1 - 1);
+        mux->epoll_fd_p1 = 0;
+    }
+    return 0;
+}
+
+int posixTransportTcpMux_InitServer(void* context, const void* config,
+        whCommSetConnectedCb connectcb, void* connectcb_arg)
+{
+    posixTransportTcpMuxServerContext* c = context;
+    const posixTransportTcpMuxServerConfig* cf = config;
+    int slot = 0;
+
+    if (    (c == NULL) ||
+            (cf == NULL) ||
+            (cf->mux == NULL) ||
+            (cf->mux->epoll_fd_p1 == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(c, 0, sizeof(*c));
+
+    /* Claim a free slot in the mux */
+    for (slot = 0; slot < PTT_MUX_MAX_CLIENTS; slot++) {
+        if (cf->mux->servers[slot] == NULL) {
+            break;
+        }
+    }
+    if (slot == PTT_MUX_MAX_CLIENTS) {
+        return WH_ERROR_NOSPACE;
+    }
+    cf->mux->servers[slot] = c;
+    c->mux = cf->mux;
+
+    /* Connected is reported once a client is accepted */
+    c->connectcb = connectcb;
+    c->connectcb_arg = connectcb_arg;
+    return 0;
+}
+
+int posixTransportTcpMux_RecvRequest(void* context,
+        uint16_t* out_size, void* data)
+{
+    int rc = 0;
+    posixTransportTcpMuxServerContext* c = context;
+    if (    (c == NULL) ||
+            (c->mux == NULL) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (    (c->accept_fd_p1 == 0) ||
+            (c->request_recv == 1)) {
+        /* No client yet or already working on a request. */
+        return WH_ERROR_NOTREADY;
+    }
+
+    rc = posixTransportTcp_Recv(
+            c->accept_fd_p1 - 1,
+            c->stream,
+            out_size,
+            data);
+
+    if (rc != WH_ERROR_NOTREADY) {
+        if (rc == 0) {
+            c->request_recv = 1;
+        } else {
+            /* Assume fatal error and drop the client */
+            posixTransportTcpMux_Drop(c->mux, c);
+        }
+    }
+    return rc;
+}
+
+int posixTransportTcpMux_SendResponse(void* context,
+        uint16_t size, const void* data)
+{
+    int rc = 0;
+    posixTransportTcpMuxServerContext* c = context;
+    if (    (c == NULL) ||
+            (c->mux == NULL) ||
+            (c->accept_fd_p1 == 0) ||
+            (size == 0) ||
+            (size > PTT_PACKET_MAX_SIZE) ||
+            (data == NULL) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (c->request_recv == 0) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    rc = posixTransportTcp_Send(
+            c->accept_fd_p1 - 1,
+            c->stream,
+            size, data);
+
+    if (rc != WH_ERROR_NOTREADY) {
+        if (rc == 0) {
+            c->request_recv = 0;
+        } else {
+            /* Assume fatal error and drop the client */
+            posixTransportTcpMux_Drop(c->mux, c);
+        }
+    }
+    return rc;
+}
+
+int posixTransportTcpMux_CleanupServer(void* context)
+{
+    posixTransportTcpMuxServerContext* c = context;
+    int slot = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (c->mux != NULL) {
+        posixTransportTcpMux_Drop(c->mux, c);
+        if (posixTransportTcpMux_GetSlot(c, &slot) == 0) {
+            c->mux->servers[slot] = NULL;
+        }
+        c->mux = NULL;
+    }
+    return 0;
+}
+
+#endif /* __linux__ */
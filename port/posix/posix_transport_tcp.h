@@ -72,6 +72,29 @@ typedef struct {
 } posixTransportTcpConfig;
 
 
+/** Common stream framing state
+ *
+ * Packets are framed with a 4-byte length prefix in network order.  Sends
+ * gather the prefix and the caller's packet into a single system call, and
+ * receives scatter the payload directly into the caller's buffer.  Bytes of
+ * later packets that arrive in the same read are queued in buffer and
+ * consumed by subsequent receives without another system call.  If a send or
+ * receive returns WH_ERROR_NOTREADY partway through a packet, the next call
+ * must pass the same packet or buffer to continue it.
+ */
+typedef struct {
+    uint32_t tx_len;        /* Length prefix being sent, network order */
+    uint32_t rx_len;        /* Length prefix being received, network order */
+    uint16_t tx_offset;     /* Bytes of the current packet sent */
+    uint16_t rx_len_offset; /* Bytes of rx_len received */
+    uint16_t rx_offset;     /* Payload bytes received into the caller buffer */
+    uint16_t queued_start;  /* Queued bytes of later packets in buffer */
+    uint16_t queued_end;
+    uint8_t buffer[PTT_BUFFER_SIZE];
+    uint8_t padding[2];
+} posixTransportTcpStream;
+
+
 /** Client context and functions */
 
 typedef struct {
@@ -80,10 +103,9 @@ typedef struct {
     struct sockaddr_in server_addr;
     int connect_fd_p1;      /* fd plus 1 so 0 is invalid */
     int connected;
-    int request_sent;
-    uint16_t buffer_offset;
-    uint8_t buffer[PTT_BUFFER_SIZE];
-    uint8_t padding[6];
+    int request_sent;       /* Number of requests awaiting a response */
+    uint8_t padding[4];
+    posixTransportTcpStream stream[1];
 } posixTransportTcpClientContext;
 
 int posixTransportTcp_InitConnect(void* context, const void* config,
@@ -113,9 +135,8 @@ typedef struct {
     int listen_fd_p1;       /* fd plus 1 so 0 is invalid */
     int accept_fd_p1;       /* fd plus 1 so 0 is invalid */
     int request_recv;
-    uint16_t buffer_offset;
-    uint8_t buffer[PTT_BUFFER_SIZE];
-    uint8_t padding[6];
+    uint8_t padding[4];
+    posixTransportTcpStream stream[1];
 } posixTransportTcpServerContext;
 
 int posixTransportTcp_InitListen(void* context, const void* config,
@@ -134,4 +155,96 @@ int posixTransportTcp_CleanupListen(void* context);
     .Cleanup =  posixTransportTcp_CleanupListen,    \
 }
 
+
+/** Multi-client server using epoll (Linux only)
+ *
+ * A posixTransportTcpMuxContext owns the listening socket and an epoll set.
+ * Each whCommServer uses a posixTransportTcpMuxServerContext as its transport
+ * and is bound to one accepted connection at a time, so one process can
+ * serve up to PTT_MUX_MAX_CLIENTS clients.  The server loop blocks in
+ * posixTransportTcpMux_Wait, which accepts new connections, reports closed
+ * ones through each server's connect callback and returns a bitmask of the
+ * servers with received data to process.
+ *
+ * posixTransportTcpMuxContext mux[1] = {0};
+ * posixTransportTcpMux_Init(mux, pttcfg);
+ *
+ * wh_TransportServer_Cb pttmscb[1] = {PTT_MUX_SERVER_CB};
+ * posixTransportTcpMuxServerConfig pttmscfg[1] = {{ .mux = mux }};
+ * posixTransportTcpMuxServerContext pttmsc[N] = {0};
+ * ... one whCommServerConfig per server using pttmsc[i] ...
+ *
+ * while (1) {
+ *     posixTransportTcpMux_Wait(mux, -1, &ready);
+ *     ... service each whCommServer whose bit is set in ready ...
+ * }
+ */
+#if defined(__linux__)
+
+#ifndef PTT_MUX_MAX_CLIENTS
+#define PTT_MUX_MAX_CLIENTS 8
+#endif
+#if PTT_MUX_MAX_CLIENTS > 32
+#error "PTT_MUX_MAX_CLIENTS must fit in the 32-bit ready mask"
+#endif
+
+typedef struct posixTransportTcpMuxServerContext_t
+    posixTransportTcpMuxServerContext;
+
+typedef struct {
+    posixTransportTcpMuxServerContext* servers[PTT_MUX_MAX_CLIENTS];
+    struct sockaddr_in server_addr;
+    int listen_fd_p1;       /* fd plus 1 so 0 is invalid */
+    int epoll_fd_p1;        /* fd plus 1 so 0 is invalid */
+} posixTransportTcpMuxContext;
+
+typedef struct {
+    posixTransportTcpMuxContext* mux;
+} posixTransportTcpMuxServerConfig;
+
+struct posixTransportTcpMuxServerContext_t {
+    posixTransportTcpMuxContext* mux;
+    whCommSetConnectedCb connectcb;
+    void* connectcb_arg;
+    int accept_fd_p1;       /* fd plus 1 so 0 is invalid */
+    int request_recv;
+    posixTransportTcpStream stream[1];
+};
+
+/* Open the listening socket and epoll set shared by the mux servers */
+int posixTransportTcpMux_Init(posixTransportTcpMuxContext* mux,
+        const posixTransportTcpConfig* config);
+
+/* Wait up to timeout_ms (-1 for forever) for activity.  Accepts pending
+ * connections and drops closed ones.  On success, bit i of out_ready is set
+ * if the server in slot i has received data.  Returns WH_ERROR_NOTREADY if
+ * the timeout expired with nothing to process. */
+int posixTransportTcpMux_Wait(posixTransportTcpMuxContext* mux,
+        int timeout_ms, uint32_t* out_ready);
+
+/* Get the slot index of a mux server transport for use with the ready mask */
+int posixTransportTcpMux_GetSlot(posixTransportTcpMuxServerContext* context,
+        int* out_slot);
+
+/* Close all connections, the listening socket and the epoll set */
+int posixTransportTcpMux_Cleanup(posixTransportTcpMuxContext* mux);
+
+int posixTransportTcpMux_InitServer(void* context, const void* config,
+        whCommSetConnectedCb connectcb, void* connectcb_arg);
+int posixTransportTcpMux_RecvRequest(void* context, uint16_t *out_size,
+        void* data);
+int posixTransportTcpMux_SendResponse(void* context, uint16_t size,
+        const void* data);
+int posixTransportTcpMux_CleanupServer(void* context);
+
+#define PTT_MUX_SERVER_CB                               \
+{                                                       \
+    .Init =     posixTransportTcpMux_InitServer,        \
+    .Recv =     posixTransportTcpMux_RecvRequest,       \
+    .Send =     posixTransportTcpMux_SendResponse,      \
+    .Cleanup =  posixTransportTcpMux_CleanupServer,     \
+}
+
+#endif /* __linux__ */
+
 #endif /* WH_TRANSPORT_TCP_H_ */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_capture.c
+ *
+ * Request stream capture
+ */
+
+#ifdef WOLFHSM_CAPTURE
+
+#include <stdint.h>
+#include <stddef.h>     /* For NULL */
+#include <string.h>     /* For memset */
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_nvm.h"
+#include "wolfhsm/wh_capture.h"
+
+static whCaptureConfig whCapture;
+
+/* Copy of a request with its sensitive payload zeroed */
+static uint64_t whCaptureRedacted[WH_COMM_MTU_U64_COUNT];
+
+/* Bytes at the start of a request that are kept by redaction */
+static uint16_t _wh_Capture_Kept(const whCommHeader* hdr, uint16_t size)
+{
+    uint16_t kind = wh_Translate16(hdr->magic, hdr->kind);
+    uint16_t action = WH_MESSAGE_ACTION(kind);
+    uint16_t keep = size;
+
+    switch (WH_MESSAGE_GROUP(kind)) {
+    case WH_MESSAGE_GROUP_KEY:
+    case WH_MESSAGE_GROUP_SHE:
+        keep = sizeof(*hdr);
+        break;
+    case WH_MESSAGE_GROUP_NVM:
+        if (action == WH_MESSAGE_NVM_ACTION_ADDOBJECT) {
+            keep = sizeof(*hdr) + sizeof(whMessageNvm_AddObjectRequest);
+        } else if (action == WH_MESSAGE_NVM_ACTION_ADDOBJECTAPPEND) {
+            keep = sizeof(*hdr) + sizeof(whMessageNvm_AddObjectAppendRequest);
+        }
+        break;
+    default:
+        break;
+    }
+    return (keep < size) ? keep : size;
+}
+
+int wh_Capture_Init(const whCaptureConfig* config)
+{
+    memset(&whCapture, 0, sizeof(whCapture));
+    if (config != NULL) {
+        whCapture = *config;
+    }
+    return 0;
+}
+
+void wh_Capture_Request(uint8_t server_id, uint8_t client_id, uint16_t size,
+        const void* packet)
+{
+    whCaptureRecord record = {0};
+    uint16_t keep = 0;
+
+    if (whCapture.sink_cb == NULL) {
+        return;
+    }
+    record.time = (whCapture.time_cb != NULL) ?
+            whCapture.time_cb(whCapture.context) : 0;
+    record.size = size;
+    record.server_id = server_id;
+    record.client_id = client_id;
+    if (    (whCapture.redact != 0) &&
+            (packet != NULL) &&
+            (size >= sizeof(whCommHeader)) &&
+            (size <= sizeof(whCaptureRedacted)) ) {
+        keep = _wh_Capture_Kept((const whCommHeader*)packet, size);
+        memcpy(whCaptureRedacted, packet, keep);
+        memset((uint8_t*)whCaptureRedacted + keep, 0, size - keep);
+        packet = whCaptureRedacted;
+    }
+    whCapture.sink_cb(whCapture.context, &record, packet);
+}
+
+#endif /* WOLFHSM_CAPTURE */
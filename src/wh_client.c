@@ -39,8 +39,12 @@
 #include "wolfssl/wolfcrypt/wc_port.h"
 #include "wolfssl/wolfcrypt/cryptocb.h"
 #include "wolfssl/wolfcrypt/curve25519.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
 #include "wolfssl/wolfcrypt/rsa.h"
 #include "wolfssl/wolfcrypt/ecc.h"
+#include "wolfssl/wolfcrypt/sha256.h"
+#include "wolfssl/wolfcrypt/hmac.h"
+#include "wolfssl/wolfcrypt/cmac.h"
 #endif
 
 /* Message definitions */
@@ -85,10 +89,21 @@ int wh_Client_Cleanup(whClientContext* c)
     (void)wolfCrypt_Cleanup();
 #endif  /* WOLFHSM_NO_CRYPTO */
 
+    /* Also wipes any cached RNG output */
     memset(c, 0, sizeof(*c));
     return 0;
 }
 
+int wh_Client_SetRequestClass(whClientContext* c, uint16_t cls)
+{
+    if ((c == NULL) || (cls >= WH_COMM_CLASS_COUNT)) {
+        return WH_ERROR_BADARGS;
+    }
+    c->comm->aux = (uint16_t)((c->comm->aux & WH_COMM_AUX_SESSION_MASK) |
+            (cls << WH_COMM_AUX_CLASS_SHIFT));
+    return 0;
+}
+
 int wh_Client_SendRequest(whClientContext* c,
         uint16_t group, uint16_t action,
         uint16_t data_size, const void* data)
@@ -100,9 +115,18 @@ int wh_Client_SendRequest(whClientContext* c,
     if (c == NULL) {
         return WH_ERROR_BADARGS;
     }
+    if (c->pending_count >= WH_CLIENT_MAX_PENDING) {
+        /* Wait for the oldest response before sending more */
+        return WH_ERROR_NOTREADY;
+    }
     rc = wh_CommClient_SendRequest(c->comm, WH_COMM_MAGIC_NATIVE, kind, &req_id,
         data_size, data);
     if (rc == 0) {
+        whClientPendingRequest* p = &c->pending[
+                (c->pending_head + c->pending_count) % WH_CLIENT_MAX_PENDING];
+        p->seq = req_id;
+        p->kind = kind;
+        c->pending_count++;
         c->last_req_kind = kind;
         c->last_req_id = req_id;
     }
@@ -118,6 +142,8 @@ int wh_Client_RecvResponse(whClientContext *c,
     uint16_t resp_kind = 0;
     uint16_t resp_id = 0;
     uint16_t resp_size = 0;
+    uint16_t expected_kind = 0;
+    uint16_t expected_id = 0;
 
     if (c == NULL) {
         return WH_ERROR_BADARGS;
@@ -127,10 +153,20 @@ int wh_Client_RecvResponse(whClientContext *c,
                 &resp_magic, &resp_kind, &resp_id,
                 &resp_size, data);
     if (rc == 0) {
+        if (c->pending_count > 0) {
+            /* Responses arrive in request order. Complete the oldest */
+            expected_kind = c->pending[c->pending_head].kind;
+            expected_id = c->pending[c->pending_head].seq;
+            c->pending_head = (c->pending_head + 1) % WH_CLIENT_MAX_PENDING;
+            c->pending_count--;
+        } else {
+            expected_kind = c->last_req_kind;
+            expected_id = c->last_req_id;
+        }
         /* Validate response */
         if (    (resp_magic != WH_COMM_MAGIC_NATIVE) ||
-                (resp_kind != c->last_req_kind) ||
-                (resp_id != c->last_req_id) ){
+                (resp_kind != expected_kind) ||
+                (resp_id != expected_id) ){
             /* Invalid or unexpected message */
             rc = WH_ERROR_ABORTED;
         } else {
@@ -149,6 +185,39 @@ int wh_Client_RecvResponse(whClientContext *c,
     return rc;
 }
 
+int wh_Client_GetPendingCount(whClientContext* c, uint16_t* out_count)
+{
+    if ((c == NULL) || (out_count == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+    *out_count = c->pending_count;
+    return 0;
+}
+
+int wh_Client_PeekPending(whClientContext* c, uint16_t* out_group,
+                          uint16_t* out_action, uint16_t* out_seq)
+{
+    whClientPendingRequest* p = NULL;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    if (c->pending_count == 0) {
+        return WH_ERROR_NOTREADY;
+    }
+    p = &c->pending[c->pending_head];
+    if (out_group != NULL) {
+        *out_group = WH_MESSAGE_GROUP(p->kind);
+    }
+    if (out_action != NULL) {
+        *out_action = WH_MESSAGE_ACTION(p->kind);
+    }
+    if (out_seq != NULL) {
+        *out_seq = p->seq;
+    }
+    return 0;
+}
+
 int wh_Client_CommInitRequest(whClientContext* c)
 {
     whMessageCommInitRequest msg = {0};
@@ -159,6 +228,7 @@ int wh_Client_CommInitRequest(whClientContext* c)
 
    /* Populate the message.*/
    msg.client_id = c->comm->client_id;
+   msg.max_data_len = WH_COMM_DATA_LEN;
 
    return wh_Client_SendRequest(c,
            WH_MESSAGE_GROUP_COMM, WH_MESSAGE_COMM_ACTION_INIT,
@@ -197,11 +267,25 @@ int wh_Client_CommInitResponse(whClientContext* c,
             if (out_serverid != NULL) {
                 *out_serverid = msg.server_id;
             }
+            /* Adopt the negotiated data size if it is usable locally */
+            if (    (msg.max_data_len >= WH_COMM_DATA_LEN_MIN) &&
+                    (msg.max_data_len <= WH_COMM_DATA_LEN)) {
+                c->comm->max_data_len = (uint16_t)msg.max_data_len;
+            }
         }
     }
     return rc;
 }
 
+int wh_Client_GetMaxDataLen(whClientContext* c, uint16_t* out_len)
+{
+    if ((c == NULL) || (out_len == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+    *out_len = c->comm->max_data_len;
+    return 0;
+}
+
 int wh_Client_CommInit(whClientContext* c,
                         uint32_t *out_clientid,
                         uint32_t *out_serverid)
@@ -359,6 +443,73 @@ int wh_Client_Echo(whClientContext* c, uint16_t snd_len, const void* snd_data,
     return rc;
 }
 
+int wh_Client_GetStatsRequest(whClientContext* c, uint16_t index,
+        uint16_t flags)
+{
+    whMessageCommStatsRequest msg = {0};
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    msg.index = index;
+    msg.flags = flags;
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_COMM, WH_MESSAGE_COMM_ACTION_STATS,
+            sizeof(msg), &msg);
+}
+
+int wh_Client_GetStatsResponse(whClientContext* c, uint16_t* out_count,
+        whMessageCommStatsEntry* out_entry)
+{
+    int rc = 0;
+    whMessageCommStatsResponse msg = {0};
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_RecvResponse(c,
+            &resp_group, &resp_action,
+            &resp_size, &msg);
+    if (rc == 0) {
+        /* Validate response */
+        if (    (resp_group != WH_MESSAGE_GROUP_COMM) ||
+                (resp_action != WH_MESSAGE_COMM_ACTION_STATS) ||
+                (resp_size != sizeof(msg)) ){
+            /* Invalid message */
+            rc = WH_ERROR_ABORTED;
+        } else {
+            /* Valid message */
+            if (out_count != NULL) {
+                *out_count = msg.entry_count;
+            }
+            rc = msg.rc;
+            if ((rc == 0) && (out_entry != NULL)) {
+                *out_entry = msg.entry;
+            }
+        }
+    }
+    return rc;
+}
+
+int wh_Client_GetStats(whClientContext* c, uint16_t index, uint16_t flags,
+        uint16_t* out_count, whMessageCommStatsEntry* out_entry)
+{
+    int rc = 0;
+
+    rc = wh_Client_GetStatsRequest(c, index, flags);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_GetStatsResponse(c, out_count, out_entry);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
 int wh_Client_CustomCbRequest(whClientContext* c, const whMessageCustomCb_Request* req)
 {
     if (NULL == c || req == NULL || req->id >= WH_CUSTOM_CB_NUM_CALLBACKS) {
@@ -468,6 +619,126 @@ int wh_Client_CustomCbCheckRegistered(whClientContext* c, uint16_t id, int* resp
 }
 
 
+uint8_t* wh_Client_CustomCbBulkGetDataPtr(whClientContext* c)
+{
+    uint8_t* data = NULL;
+
+    if (c == NULL) {
+        return NULL;
+    }
+
+    data = wh_CommClient_GetDataPtr(c->comm);
+    if (data == NULL) {
+        return NULL;
+    }
+    return data + sizeof(whMessageCustomCb_BulkHeader);
+}
+
+int wh_Client_CustomCbBulkRequest(whClientContext* c, uint16_t id,
+                                  const uint8_t* data, uint16_t size)
+{
+    whMessageCustomCb_BulkHeader* hdr = NULL;
+    uint8_t* payload = NULL;
+
+    if (    (c == NULL) ||
+            (id >= WH_CUSTOM_CB_NUM_CALLBACKS) ||
+            ((data == NULL) && (size != 0)) ||
+            (size > c->comm->max_data_len - sizeof(*hdr))) {
+        return WH_ERROR_BADARGS;
+    }
+
+    payload = wh_Client_CustomCbBulkGetDataPtr(c);
+    if (payload == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    hdr = (whMessageCustomCb_BulkHeader*)(payload - sizeof(*hdr));
+
+    hdr->id = id;
+    hdr->type = WH_MESSAGE_CUSTOM_CB_TYPE_BULK;
+    hdr->rc = 0;
+    hdr->err = 0;
+    if ((size != 0) && (data != payload)) {
+        memmove(payload, data, size);
+    }
+
+    /* Sent from the comm buffer itself, so not copied again */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CUSTOM, id,
+            sizeof(*hdr) + size, hdr);
+}
+
+int wh_Client_CustomCbBulkResponse(whClientContext* c, int32_t* out_rc,
+                                   uint8_t* data, uint16_t* inout_size)
+{
+    const whMessageCustomCb_BulkHeader* hdr = NULL;
+    uint8_t* payload = NULL;
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+    uint16_t len = 0;
+    int rc = 0;
+
+    if ((c == NULL) || (out_rc == NULL) || (inout_size == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    payload = wh_Client_CustomCbBulkGetDataPtr(c);
+    if (payload == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    hdr = (const whMessageCustomCb_BulkHeader*)(payload - sizeof(*hdr));
+
+    rc = wh_Client_RecvResponse(c, &resp_group, &resp_action, &resp_size,
+            (void*)hdr);
+    if (rc != WH_ERROR_OK) {
+        return rc;
+    }
+
+    if (    (resp_size < sizeof(*hdr)) ||
+            (resp_group != WH_MESSAGE_GROUP_CUSTOM) ||
+            (resp_action >= WH_CUSTOM_CB_NUM_CALLBACKS) ||
+            (hdr->type != WH_MESSAGE_CUSTOM_CB_TYPE_BULK)) {
+        /* message invalid */
+        return WH_ERROR_ABORTED;
+    }
+    if (hdr->err != WH_ERROR_OK) {
+        return hdr->err;
+    }
+
+    len = resp_size - sizeof(*hdr);
+    if ((data != NULL) && (data != payload)) {
+        if (len > *inout_size) {
+            return WH_ERROR_NOSPACE;
+        }
+        memcpy(data, payload, len);
+    }
+    *out_rc = hdr->rc;
+    *inout_size = len;
+
+    return WH_ERROR_OK;
+}
+
+int wh_Client_CustomCbBulk(whClientContext* c, uint16_t id,
+                           const uint8_t* req_data, uint16_t req_size,
+                           int32_t* out_rc, uint8_t* resp_data,
+                           uint16_t* inout_resp_size)
+{
+    int rc = 0;
+
+    do {
+        rc = wh_Client_CustomCbBulkRequest(c, id, req_data, req_size);
+    } while (rc == WH_ERROR_NOTREADY);
+
+    if (rc == WH_ERROR_OK) {
+        do {
+            rc = wh_Client_CustomCbBulkResponse(c, out_rc, resp_data,
+                    inout_resp_size);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+
+    return rc;
+}
+
+
 #ifndef WOLFHSM_NO_CRYPTO
 
 int wh_Client_KeyCacheRequest_ex(whClientContext* c, uint32_t flags,
@@ -479,6 +750,10 @@ int wh_Client_KeyCacheRequest_ex(whClientContext* c, uint32_t flags,
     uint8_t* packIn = (uint8_t*)(&packet->keyCacheReq + 1);
     if (c == NULL || in == NULL || inSz == 0)
         return WH_ERROR_BADARGS;
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+    if (keyId != WOLFHSM_KEYID_ERASED)
+        wh_Client_PubKeyCacheEvict(c, keyId);
+#endif
     packet->keyCacheReq.id = keyId;
     packet->keyCacheReq.flags = flags;
     packet->keyCacheReq.sz = inSz;
@@ -546,6 +821,9 @@ int wh_Client_KeyEvictRequest(whClientContext* c, uint16_t keyId)
     whPacket packet[1] = {0};
     if (c == NULL || keyId == WOLFHSM_KEYID_ERASED)
         return WH_ERROR_BADARGS;
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+    wh_Client_PubKeyCacheEvict(c, keyId);
+#endif
     /* set the keyId */
     packet->keyEvictReq.id = keyId;
     /* write request */
@@ -649,108 +927,942 @@ int wh_Client_KeyExport(whClientContext* c, uint16_t keyId,
     return ret;
 }
 
-int wh_Client_KeyCommitRequest(whClientContext* c, whNvmId keyId)
+int wh_Client_KeyCacheDmaRequest_ex(whClientContext* c, uint32_t flags,
+    uint8_t* label, uint32_t labelSz, const uint8_t* in, uint32_t inSz,
+    uint16_t keyId)
 {
     whPacket packet[1] = {0};
-    if (c == NULL || keyId == WOLFHSM_KEYID_ERASED)
+    if (c == NULL || in == NULL || inSz == 0)
         return WH_ERROR_BADARGS;
-    /* set keyId */
-    packet->keyCommitReq.id = keyId;
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+    if (keyId != WOLFHSM_KEYID_ERASED)
+        wh_Client_PubKeyCacheEvict(c, keyId);
+#endif
+    packet->keyCacheDmaReq.keyAddr = (uint64_t)(uintptr_t)in;
+    packet->keyCacheDmaReq.id = keyId;
+    packet->keyCacheDmaReq.flags = flags;
+    packet->keyCacheDmaReq.sz = inSz;
+    if (label == NULL)
+        packet->keyCacheDmaReq.labelSz = 0;
+    else {
+        if (labelSz > WOLFHSM_NVM_LABEL_LEN)
+            labelSz = WOLFHSM_NVM_LABEL_LEN;
+        packet->keyCacheDmaReq.labelSz = labelSz;
+        XMEMCPY(packet->keyCacheDmaReq.label, label, labelSz);
+    }
     /* write request */
-    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_COMMIT,
-            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyCommitReq),
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_CACHE_DMA,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyCacheDmaReq),
             (uint8_t*)packet);
 }
 
-int wh_Client_KeyCommitResponse(whClientContext* c)
+int wh_Client_KeyCacheDmaRequest(whClientContext* c, uint32_t flags,
+    uint8_t* label, uint32_t labelSz, const uint8_t* in, uint32_t inSz)
+{
+    return wh_Client_KeyCacheDmaRequest_ex(c, flags, label, labelSz, in, inSz,
+        WOLFHSM_KEYID_ERASED);
+}
+
+int wh_Client_KeyCacheDmaResponse(whClientContext* c, uint16_t* keyId)
+{
+    return wh_Client_KeyCacheResponse(c, keyId);
+}
+
+int wh_Client_KeyCacheDma(whClientContext* c, uint32_t flags,
+    uint8_t* label, uint32_t labelSz, const uint8_t* in, uint32_t inSz,
+    uint16_t* keyId)
+{
+    int ret;
+    if (keyId == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_KeyCacheDmaRequest_ex(c, flags, label, labelSz, in, inSz,
+        *keyId);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_KeyCacheDmaResponse(c, keyId);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+int wh_Client_KeyExportDmaRequest(whClientContext* c, uint16_t keyId,
+    uint8_t* out, uint32_t outSz)
+{
+    whPacket packet[1] = {0};
+    if (c == NULL || keyId == WOLFHSM_KEYID_ERASED || out == NULL ||
+        outSz == 0)
+        return WH_ERROR_BADARGS;
+    packet->keyExportDmaReq.keyAddr = (uint64_t)(uintptr_t)out;
+    packet->keyExportDmaReq.sz = outSz;
+    packet->keyExportDmaReq.id = keyId;
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_EXPORT_DMA,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyExportDmaReq),
+            (uint8_t*)packet);
+}
+
+int wh_Client_KeyExportDmaResponse(whClientContext* c, uint8_t* label,
+    uint32_t labelSz, uint32_t* outSz)
 {
     uint16_t group;
     uint16_t action;
     uint16_t size;
     int ret;
     whPacket packet[1] = {0};
-    if (c == NULL)
+    if (c == NULL || outSz == NULL)
         return WH_ERROR_BADARGS;
     ret = wh_Client_RecvResponse(c, &group, &action, &size, (uint8_t*)packet);
     if (ret == 0) {
         if (packet->rc != 0)
             ret = packet->rc;
+        else {
+            *outSz = packet->keyExportRes.len;
+            if (label != NULL) {
+                if (labelSz > sizeof(packet->keyExportRes.label))
+                    labelSz = sizeof(packet->keyExportRes.label);
+                XMEMCPY(label, packet->keyExportRes.label, labelSz);
+            }
+        }
     }
     return ret;
 }
 
-int wh_Client_KeyCommit(whClientContext* c, whNvmId keyId)
+int wh_Client_KeyExportDma(whClientContext* c, uint16_t keyId,
+    uint8_t* label, uint32_t labelSz, uint8_t* out, uint32_t* outSz)
 {
     int ret;
-    ret = wh_Client_KeyCommitRequest(c, keyId);
+    if (outSz == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_KeyExportDmaRequest(c, keyId, out, *outSz);
     if (ret == 0) {
         do {
-            ret = wh_Client_KeyCommitResponse(c);
+            ret = wh_Client_KeyExportDmaResponse(c, label, labelSz, outSz);
         } while (ret == WH_ERROR_NOTREADY);
     }
     return ret;
 }
 
-int wh_Client_KeyEraseRequest(whClientContext* c, whNvmId keyId)
+int wh_Client_KeyExportPublicRequest(whClientContext* c, uint16_t keyId,
+    uint32_t type)
 {
     whPacket packet[1] = {0};
     if (c == NULL || keyId == WOLFHSM_KEYID_ERASED)
         return WH_ERROR_BADARGS;
-    /* set keyId */
-    packet->keyEraseReq.id = keyId;
+    packet->keyExportPublicReq.id = keyId;
+    packet->keyExportPublicReq.type = type;
     /* write request */
-    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_ERASE,
-            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyEraseReq),
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_EXPORT_PUBLIC,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyExportPublicReq),
             (uint8_t*)packet);
 }
 
-int wh_Client_KeyEraseResponse(whClientContext* c)
+int wh_Client_KeyExportPublicResponse(whClientContext* c, uint8_t* label,
+    uint32_t labelSz, uint8_t* out, uint32_t* outSz)
+{
+    /* same response as a full export */
+    return wh_Client_KeyExportResponse(c, label, labelSz, out, outSz);
+}
+
+int wh_Client_KeyExportPublic(whClientContext* c, uint16_t keyId,
+    uint32_t type, uint8_t* label, uint32_t labelSz, uint8_t* out,
+    uint32_t* outSz)
+{
+    int ret;
+    ret = wh_Client_KeyExportPublicRequest(c, keyId, type);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_KeyExportPublicResponse(c, label, labelSz, out,
+                outSz);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+int wh_Client_KeyGenerationRequest(whClientContext* c)
+{
+    whPacket packet[1] = {0};
+    if (c == NULL)
+        return WH_ERROR_BADARGS;
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_GENERATION,
+            WOLFHSM_PACKET_STUB_SIZE, (uint8_t*)packet);
+}
+
+int wh_Client_KeyGenerationResponse(whClientContext* c, uint32_t* outGeneration)
 {
     uint16_t group;
     uint16_t action;
     uint16_t size;
     int ret;
     whPacket packet[1] = {0};
-    if (c == NULL)
+    if (c == NULL || outGeneration == NULL)
         return WH_ERROR_BADARGS;
     ret = wh_Client_RecvResponse(c, &group, &action, &size, (uint8_t*)packet);
     if (ret == 0) {
         if (packet->rc != 0)
             ret = packet->rc;
+        else
+            *outGeneration = packet->keyGenerationRes.generation;
     }
     return ret;
 }
 
-int wh_Client_KeyErase(whClientContext* c, whNvmId keyId)
+int wh_Client_KeyGeneration(whClientContext* c, uint32_t* outGeneration)
 {
     int ret;
-    ret = wh_Client_KeyEraseRequest(c, keyId);
+    ret = wh_Client_KeyGenerationRequest(c);
     if (ret == 0) {
         do {
-            ret = wh_Client_KeyEraseResponse(c);
+            ret = wh_Client_KeyGenerationResponse(c, outGeneration);
         } while (ret == WH_ERROR_NOTREADY);
     }
     return ret;
 }
 
-#ifdef HAVE_CURVE25519
-void wh_Client_SetKeyCurve25519(curve25519_key* key, whNvmId keyId)
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+void wh_Client_PubKeyCacheEvict(whClientContext* c, uint16_t keyId)
 {
-    key->devCtx = (void*)((intptr_t)keyId);
+    int i;
+    if (c == NULL)
+        return;
+    for (i = 0; i < WH_CLIENT_PUBKEY_CACHE_COUNT; i++) {
+        if (keyId == WOLFHSM_KEYID_ERASED || c->pubkey[i].keyId == keyId) {
+            c->pubkey[i].keyId = WOLFHSM_KEYID_ERASED;
+            c->pubkey[i].len = 0;
+        }
+    }
 }
 #endif
 
-#ifndef NO_RSA
-void wh_Client_SetKeyRsa(RsaKey* key, whNvmId keyId)
+int wh_Client_KeyCommitRequest(whClientContext* c, whNvmId keyId)
 {
-    key->devCtx = (void*)((intptr_t)keyId);
-}
+    whPacket packet[1] = {0};
+    if (c == NULL || keyId == WOLFHSM_KEYID_ERASED)
+        return WH_ERROR_BADARGS;
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+    /* Keys are NVM objects, so committing one changes NVM metadata */
+    wh_Client_NvmCacheFlush(c);
 #endif
+    /* set keyId */
+    packet->keyCommitReq.id = keyId;
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_COMMIT,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyCommitReq),
+            (uint8_t*)packet);
+}
 
-#ifndef NO_AES
-void wh_Client_SetKeyAes(Aes* key, whNvmId keyId)
+int wh_Client_KeyCommitResponse(whClientContext* c)
 {
-    key->devCtx = (void*)((intptr_t)keyId);
-}
-#endif
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    whPacket packet[1] = {0};
+    if (c == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_RecvResponse(c, &group, &action, &size, (uint8_t*)packet);
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+    }
+    return ret;
+}
+
+int wh_Client_KeyCommit(whClientContext* c, whNvmId keyId)
+{
+    int ret;
+    ret = wh_Client_KeyCommitRequest(c, keyId);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_KeyCommitResponse(c);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+int wh_Client_KeyEraseRequest(whClientContext* c, whNvmId keyId)
+{
+    whPacket packet[1] = {0};
+    if (c == NULL || keyId == WOLFHSM_KEYID_ERASED)
+        return WH_ERROR_BADARGS;
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+    wh_Client_PubKeyCacheEvict(c, keyId);
+#endif
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+    wh_Client_NvmCacheFlush(c);
+#endif
+    /* set keyId */
+    packet->keyEraseReq.id = keyId;
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_ERASE,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyEraseReq),
+            (uint8_t*)packet);
+}
+
+int wh_Client_KeyEraseResponse(whClientContext* c)
+{
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    whPacket packet[1] = {0};
+    if (c == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_RecvResponse(c, &group, &action, &size, (uint8_t*)packet);
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+    }
+    return ret;
+}
+
+int wh_Client_KeyErase(whClientContext* c, whNvmId keyId)
+{
+    int ret;
+    ret = wh_Client_KeyEraseRequest(c, keyId);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_KeyEraseResponse(c);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+#if !defined(NO_RSA) && defined(WOLFSSL_KEY_GEN)
+int wh_Client_RsaKeyGenStartRequest(whClientContext* c, uint32_t size,
+    uint32_t e)
+{
+    whPacket packet[1] = {0};
+    if (c == NULL)
+        return WH_ERROR_BADARGS;
+    packet->keyRsakgStartReq.size = size;
+    packet->keyRsakgStartReq.e = e;
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY,
+            WH_KEY_RSA_KEYGEN_START,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyRsakgStartReq),
+            (uint8_t*)packet);
+}
+
+int wh_Client_RsaKeyGenStartResponse(whClientContext* c, uint16_t* jobId)
+{
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    whPacket packet[1] = {0};
+    if (c == NULL || jobId == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_RecvResponse(c, &group, &action, &size, (uint8_t*)packet);
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        else
+            *jobId = packet->keyJobStartRes.jobId;
+    }
+    return ret;
+}
+
+int wh_Client_RsaKeyGenStart(whClientContext* c, uint32_t size, uint32_t e,
+    uint16_t* jobId)
+{
+    int ret;
+    ret = wh_Client_RsaKeyGenStartRequest(c, size, e);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RsaKeyGenStartResponse(c, jobId);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+int wh_Client_KeyJobStatusRequest(whClientContext* c, uint16_t jobId)
+{
+    whPacket packet[1] = {0};
+    if (c == NULL || jobId == 0)
+        return WH_ERROR_BADARGS;
+    packet->keyJobStatusReq.jobId = jobId;
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_KEY, WH_KEY_JOB_STATUS,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyJobStatusReq),
+            (uint8_t*)packet);
+}
+
+int wh_Client_KeyJobStatusResponse(whClientContext* c, int* done,
+    uint16_t* keyId)
+{
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    whPacket packet[1] = {0};
+    if (c == NULL || done == NULL || keyId == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_RecvResponse(c, &group, &action, &size, (uint8_t*)packet);
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        else {
+            *done = (packet->keyJobStatusRes.done != 0);
+            *keyId = packet->keyJobStatusRes.keyId;
+        }
+    }
+    return ret;
+}
+
+int wh_Client_KeyJobStatus(whClientContext* c, uint16_t jobId, int* done,
+    uint16_t* keyId)
+{
+    int ret;
+    ret = wh_Client_KeyJobStatusRequest(c, jobId);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_KeyJobStatusResponse(c, done, keyId);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+int wh_Client_KeyJobWait(whClientContext* c, uint16_t jobId, uint16_t* keyId)
+{
+    int ret;
+    int done = 0;
+    do {
+        ret = wh_Client_KeyJobStatus(c, jobId, &done, keyId);
+    } while (ret == 0 && done == 0);
+    return ret;
+}
+#endif /* !NO_RSA && WOLFSSL_KEY_GEN */
+
+#ifdef HAVE_CURVE25519
+void wh_Client_SetKeyCurve25519(curve25519_key* key, whNvmId keyId)
+{
+    key->devCtx = (void*)((intptr_t)keyId);
+}
+#endif
+
+#ifdef HAVE_ED25519
+void wh_Client_SetKeyEd25519(ed25519_key* key, whNvmId keyId)
+{
+    key->devCtx = (void*)((intptr_t)keyId);
+}
+#endif
+
+#ifndef NO_RSA
+void wh_Client_SetKeyRsa(RsaKey* key, whNvmId keyId)
+{
+    key->devCtx = (void*)((intptr_t)keyId);
+}
+#endif
+
+#ifndef NO_AES
+void wh_Client_SetKeyAes(Aes* key, whNvmId keyId)
+{
+    key->devCtx = (void*)((intptr_t)keyId);
+}
+#endif
+
+#ifndef NO_HMAC
+void wh_Client_SetKeyHmac(Hmac* hmac, whNvmId keyId)
+{
+    /* the stream handle goes above the key id once the server opens one */
+    hmac->devCtx = (void*)((intptr_t)keyId);
+}
+#endif
+
+#ifdef WOLFSSL_CMAC
+void wh_Client_SetKeyCmac(Cmac* cmac, whNvmId keyId)
+{
+    /* the stream handle goes above the key id once the server opens one */
+    cmac->devCtx = (void*)((intptr_t)keyId);
+}
+#endif
+
+#if !defined(NO_AES) && (defined(HAVE_AES_CBC) || defined(HAVE_AESGCM))
+int wh_Client_AesStreamInitRequest(whClientContext* c, Aes* aes, int type,
+    int enc, const uint8_t* iv, uint32_t ivSz)
+{
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint8_t* key = (uint8_t*)(&packet->cipherStreamInitReq + 1);
+    uint32_t keyLen;
+    if (c == NULL || aes == NULL || (iv == NULL && ivSz != 0))
+        return WH_ERROR_BADARGS;
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    /* the key is the cached key id */
+    keyLen = sizeof(uint32_t);
+    XMEMCPY(key, (uint8_t*)&aes->devCtx, keyLen);
+#else
+    keyLen = aes->keylen;
+    if (keyLen > AES_MAX_KEY_SIZE / 8)
+        return WH_ERROR_BADARGS;
+    XMEMCPY(key, aes->devKey, keyLen);
+#endif
+    if (WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cipherStreamInitReq) +
+            keyLen + ivSz > c->comm->max_data_len)
+        return WH_ERROR_BADARGS;
+    packet->cipherStreamInitReq.type = type;
+    packet->cipherStreamInitReq.enc = enc;
+    packet->cipherStreamInitReq.keyLen = keyLen;
+    packet->cipherStreamInitReq.ivSz = ivSz;
+    if (ivSz > 0)
+        XMEMCPY(key + keyLen, iv, ivSz);
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO,
+            WH_CRYPTO_CIPHER_STREAM_INIT,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cipherStreamInitReq) +
+            keyLen + ivSz, rawPacket);
+}
+
+int wh_Client_AesStreamInitResponse(whClientContext* c, uint32_t* handle)
+{
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    whPacket packet[1] = {0};
+    if (c == NULL || handle == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_RecvResponse(c, &group, &action, &size, (uint8_t*)packet);
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        else
+            *handle = packet->cipherStreamInitRes.handle;
+    }
+    return ret;
+}
+
+int wh_Client_AesStreamInit(whClientContext* c, Aes* aes, int type, int enc,
+    const uint8_t* iv, uint32_t ivSz, uint32_t* handle)
+{
+    int ret;
+    ret = wh_Client_AesStreamInitRequest(c, aes, type, enc, iv, ivSz);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_AesStreamInitResponse(c, handle);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+int wh_Client_AesStreamUpdateRequest(whClientContext* c, uint32_t handle,
+    const uint8_t* in, uint32_t sz, const uint8_t* authIn, uint32_t authInSz)
+{
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint8_t* data = (uint8_t*)(&packet->cipherStreamUpdateReq + 1);
+    if (c == NULL || handle == 0 || (in == NULL && sz != 0) ||
+            (authIn == NULL && authInSz != 0))
+        return WH_ERROR_BADARGS;
+    /* each update has to fit one request */
+    if (sz > WH_COMM_DATA_LEN || authInSz > WH_COMM_DATA_LEN ||
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cipherStreamUpdateReq) +
+            sz + authInSz > c->comm->max_data_len)
+        return WH_ERROR_BADARGS;
+    packet->cipherStreamUpdateReq.handle = handle;
+    packet->cipherStreamUpdateReq.sz = sz;
+    packet->cipherStreamUpdateReq.authInSz = authInSz;
+    if (sz > 0)
+        XMEMCPY(data, in, sz);
+    if (authInSz > 0)
+        XMEMCPY(data + sz, authIn, authInSz);
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO,
+            WH_CRYPTO_CIPHER_STREAM_UPDATE,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cipherStreamUpdateReq) +
+            sz + authInSz, rawPacket);
+}
+
+int wh_Client_AesStreamUpdateResponse(whClientContext* c, uint8_t* out,
+    uint32_t* outSz)
+{
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    if (c == NULL || outSz == NULL || (out == NULL && *outSz != 0))
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_RecvResponse(c, &group, &action, &size, rawPacket);
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        else if (packet->cipherStreamUpdateRes.sz > *outSz)
+            ret = WH_ERROR_ABORTED;
+        else {
+            *outSz = packet->cipherStreamUpdateRes.sz;
+            if (*outSz > 0)
+                XMEMCPY(out, (uint8_t*)(&packet->cipherStreamUpdateRes + 1),
+                    *outSz);
+        }
+    }
+    return ret;
+}
+
+int wh_Client_AesStreamUpdate(whClientContext* c, uint32_t handle,
+    const uint8_t* in, uint32_t sz, const uint8_t* authIn, uint32_t authInSz,
+    uint8_t* out)
+{
+    int ret;
+    uint32_t outSz = sz;
+    ret = wh_Client_AesStreamUpdateRequest(c, handle, in, sz, authIn,
+        authInSz);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_AesStreamUpdateResponse(c, out, &outSz);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
+int wh_Client_AesStreamFinalRequest(whClientContext* c, uint32_t handle,
+    const uint8_t* authTag, uint32_t authTagSz)
+{
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint16_t size = WOLFHSM_PACKET_STUB_SIZE +
+        sizeof(packet->cipherStreamFinalReq);
+    if (c == NULL || handle == 0 || authTagSz > AES_BLOCK_SIZE)
+        return WH_ERROR_BADARGS;
+    packet->cipherStreamFinalReq.handle = handle;
+    packet->cipherStreamFinalReq.authTagSz = authTagSz;
+    /* the tag to check when decrypting */
+    if (authTag != NULL) {
+        XMEMCPY((uint8_t*)(&packet->cipherStreamFinalReq + 1), authTag,
+            authTagSz);
+        size += authTagSz;
+    }
+    /* write request */
+    return wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO,
+            WH_CRYPTO_CIPHER_STREAM_FINAL, size, rawPacket);
+}
+
+int wh_Client_AesStreamFinalResponse(whClientContext* c, uint8_t* authTag,
+    uint32_t authTagSz)
+{
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    if (c == NULL)
+        return WH_ERROR_BADARGS;
+    ret = wh_Client_RecvResponse(c, &group, &action, &size, rawPacket);
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        /* the tag made when encrypting */
+        else if (packet->cipherStreamFinalRes.authTagSz > 0) {
+            if (authTag == NULL ||
+                    packet->cipherStreamFinalRes.authTagSz > authTagSz)
+                ret = WH_ERROR_ABORTED;
+            else {
+                XMEMCPY(authTag,
+                    (uint8_t*)(&packet->cipherStreamFinalRes + 1),
+                    packet->cipherStreamFinalRes.authTagSz);
+            }
+        }
+    }
+    return ret;
+}
+
+int wh_Client_AesStreamFinal(whClientContext* c, uint32_t handle,
+    uint8_t* authTag, uint32_t authTagSz)
+{
+    int ret;
+    ret = wh_Client_AesStreamFinalRequest(c, handle, authTag, authTagSz);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_AesStreamFinalResponse(c, authTag, authTagSz);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+#endif /* !NO_AES && (HAVE_AES_CBC || HAVE_AESGCM) */
+
+#if !defined(NO_AES) && (defined(HAVE_AES_CBC) || defined(HAVE_AESGCM))
+/* Run an AES operation with the server reading and writing client memory */
+static int _wh_Client_AesDma(whClientContext* c, Aes* aes, int type, int enc,
+    const uint8_t* iv, uint32_t ivSz, const uint8_t* in, uint32_t sz,
+    uint8_t* out, const uint8_t* authIn, uint32_t authInSz, uint8_t* authTag,
+    uint32_t authTagSz)
+{
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint8_t* key = (uint8_t*)(&packet->cipherDmaReq + 1);
+    uint32_t keyLen;
+    uint32_t tagLen;
+    uint32_t used;
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    if (c == NULL || aes == NULL || (iv == NULL && ivSz != 0) ||
+            (sz != 0 && (in == NULL || out == NULL)) ||
+            (authIn == NULL && authInSz != 0) ||
+            (authTag == NULL && authTagSz != 0) || authTagSz > AES_BLOCK_SIZE)
+        return WH_ERROR_BADARGS;
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    /* the key is the cached key id */
+    keyLen = sizeof(uint32_t);
+    XMEMCPY(key, (uint8_t*)&aes->devCtx, keyLen);
+#else
+    keyLen = aes->keylen;
+    if (keyLen > AES_MAX_KEY_SIZE / 8)
+        return WH_ERROR_BADARGS;
+    XMEMCPY(key, aes->devKey, keyLen);
+#endif
+    /* only the tag to check goes in the request */
+    tagLen = (enc == 1) ? 0 : authTagSz;
+    /* compare ivSz to the space left, adding it could wrap */
+    used = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cipherDmaReq) + keyLen +
+        tagLen;
+    if (used > c->comm->max_data_len || ivSz > c->comm->max_data_len - used)
+        return WH_ERROR_BADARGS;
+    packet->cipherDmaReq.inAddr = (uint64_t)(uintptr_t)in;
+    packet->cipherDmaReq.outAddr = (uint64_t)(uintptr_t)out;
+    packet->cipherDmaReq.authInAddr = (uint64_t)(uintptr_t)authIn;
+    packet->cipherDmaReq.type = type;
+    packet->cipherDmaReq.enc = enc;
+    packet->cipherDmaReq.keyLen = keyLen;
+    packet->cipherDmaReq.sz = sz;
+    packet->cipherDmaReq.ivSz = ivSz;
+    packet->cipherDmaReq.authInSz = authInSz;
+    packet->cipherDmaReq.authTagSz = authTagSz;
+    if (ivSz > 0)
+        XMEMCPY(key + keyLen, iv, ivSz);
+    if (tagLen > 0)
+        XMEMCPY(key + keyLen + ivSz, authTag, tagLen);
+    /* write request */
+    ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO,
+            WH_CRYPTO_CIPHER_DMA,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cipherDmaReq) +
+            keyLen + ivSz + tagLen, rawPacket);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &action, &size,
+                rawPacket);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        /* the tag made when encrypting */
+        else if (packet->cipherDmaRes.authTagSz > authTagSz)
+            ret = WH_ERROR_ABORTED;
+        else if (packet->cipherDmaRes.authTagSz > 0) {
+            XMEMCPY(authTag, (uint8_t*)(&packet->cipherDmaRes + 1),
+                packet->cipherDmaRes.authTagSz);
+        }
+    }
+    return ret;
+}
+#endif /* !NO_AES && (HAVE_AES_CBC || HAVE_AESGCM) */
+
+#if !defined(NO_AES) && defined(HAVE_AES_CBC)
+int wh_Client_AesCbcDma(whClientContext* c, Aes* aes, int enc,
+    const uint8_t* iv, const uint8_t* in, uint32_t sz, uint8_t* out)
+{
+    return _wh_Client_AesDma(c, aes, WC_CIPHER_AES_CBC, enc, iv, AES_IV_SIZE,
+        in, sz, out, NULL, 0, NULL, 0);
+}
+#endif
+
+#if !defined(NO_AES) && defined(HAVE_AESGCM)
+int wh_Client_AesGcmDma(whClientContext* c, Aes* aes, int enc,
+    const uint8_t* iv, uint32_t ivSz, const uint8_t* in, uint32_t sz,
+    const uint8_t* authIn, uint32_t authInSz, uint8_t* authTag,
+    uint32_t authTagSz, uint8_t* out)
+{
+    return _wh_Client_AesDma(c, aes, WC_CIPHER_AES_GCM, enc, iv, ivSz, in, sz,
+        out, authIn, authInSz, authTag, authTagSz);
+}
+#endif
+
+#ifndef NO_SHA256
+int wh_Client_Sha256Dma(whClientContext* c, const uint8_t* in, uint32_t sz,
+    uint8_t* hash)
+{
+    whPacket packet[1] = {0};
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    if (c == NULL || hash == NULL || (in == NULL && sz != 0))
+        return WH_ERROR_BADARGS;
+    packet->hashDmaReq.inAddr = (uint64_t)(uintptr_t)in;
+    packet->hashDmaReq.type = WC_HASH_TYPE_SHA256;
+    packet->hashDmaReq.sz = sz;
+    /* write request */
+    ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO,
+            WH_CRYPTO_HASH_DMA,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->hashDmaReq),
+            (uint8_t*)packet);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &action, &size,
+                (uint8_t*)packet);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        else if (packet->hashDmaRes.digestSz != WC_SHA256_DIGEST_SIZE)
+            ret = WH_ERROR_ABORTED;
+        else {
+            XMEMCPY(hash, (uint8_t*)(&packet->hashDmaRes + 1),
+                WC_SHA256_DIGEST_SIZE);
+        }
+    }
+    return ret;
+}
+#endif /* !NO_SHA256 */
+
+#ifdef HAVE_ECC
+int wh_Client_EccVerifyBatch(whClientContext* c, int curveId,
+    const whClientEccVerifyItem* items, uint32_t count, int* results)
+{
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    wh_Packet_pk_ecc_verify_item item = {0};
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    uint32_t start = 0;
+    uint32_t n;
+    uint32_t i;
+    int ret = 0;
+    if (c == NULL || (count > 0 && (items == NULL || results == NULL)))
+        return WH_ERROR_BADARGS;
+    while (ret == 0 && start < count) {
+        /* pack as many items as fit in one message */
+        size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEccVerifyBatchReq);
+        n = 0;
+        while (start + n < count && n < WH_PACKET_ECC_VERIFY_BATCH_MAX) {
+            const whClientEccVerifyItem* it = &items[start + n];
+            if (size + sizeof(item) + it->sigSz + it->hashSz >
+                    c->comm->max_data_len) {
+                break;
+            }
+            item.keyId = it->keyId;
+            item.sigSz = it->sigSz;
+            item.hashSz = it->hashSz;
+            XMEMCPY(rawPacket + size, &item, sizeof(item));
+            size += sizeof(item);
+            XMEMCPY(rawPacket + size, it->sig, it->sigSz);
+            size += it->sigSz;
+            XMEMCPY(rawPacket + size, it->hash, it->hashSz);
+            size += it->hashSz;
+            n++;
+        }
+        if (n == 0)
+            return WH_ERROR_BADARGS;
+        packet->pkEccVerifyBatchReq.curveId = curveId;
+        packet->pkEccVerifyBatchReq.count = n;
+        ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO,
+                WH_CRYPTO_ECDSA_VERIFY_BATCH, size, rawPacket);
+        if (ret == 0) {
+            do {
+                ret = wh_Client_RecvResponse(c, &group, &action, &size,
+                    rawPacket);
+            } while (ret == WH_ERROR_NOTREADY);
+        }
+        if (ret == 0) {
+            if (packet->rc != 0)
+                ret = packet->rc;
+            else if (packet->pkEccVerifyBatchRes.count != n)
+                ret = WH_ERROR_ABORTED;
+        }
+        if (ret == 0) {
+            for (i = 0; i < n; i++) {
+                if (packet->pkEccVerifyBatchRes.failed & (1U << i))
+                    results[start + i] = WH_ERROR_ABORTED;
+                else
+                    results[start + i] =
+                        (packet->pkEccVerifyBatchRes.valid >> i) & 1;
+            }
+            start += n;
+        }
+    }
+    return ret;
+}
+
+int wh_Client_EccSharedSecretCache(whClientContext* c, int curveId,
+    whKeyId privateKeyId, whKeyId publicKeyId, uint32_t flags, whKeyId* keyId)
+{
+    whPacket packet[1] = {0};
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    if (c == NULL || keyId == NULL)
+        return WH_ERROR_BADARGS;
+    packet->pkEcdhReq.type = WC_PK_TYPE_ECDH;
+    packet->pkEcdhReq.privateKeyId = privateKeyId;
+    packet->pkEcdhReq.publicKeyId = publicKeyId;
+    packet->pkEcdhReq.curveId = curveId;
+    packet->pkEcdhReq.options = WH_PACKET_PK_SECRET_CACHE;
+    packet->pkEcdhReq.keyId = *keyId;
+    packet->pkEcdhReq.flags = flags;
+    /* write request */
+    ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO, WC_ALGO_TYPE_PK,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEcdhReq),
+            (uint8_t*)packet);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &action, &size,
+                (uint8_t*)packet);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        else
+            *keyId = (whKeyId)packet->pkEcdhRes.keyId;
+    }
+    return ret;
+}
+#endif /* HAVE_ECC */
+
+#ifdef HAVE_CURVE25519
+int wh_Client_Curve25519SharedSecretCache(whClientContext* c,
+    whKeyId privateKeyId, whKeyId publicKeyId, int endian, uint32_t flags,
+    whKeyId* keyId)
+{
+    whPacket packet[1] = {0};
+    uint16_t group;
+    uint16_t action;
+    uint16_t size;
+    int ret;
+    if (c == NULL || keyId == NULL)
+        return WH_ERROR_BADARGS;
+    packet->pkCurve25519Req.type = WC_PK_TYPE_CURVE25519;
+    packet->pkCurve25519Req.privateKeyId = privateKeyId;
+    packet->pkCurve25519Req.publicKeyId = publicKeyId;
+    packet->pkCurve25519Req.endian = endian;
+    packet->pkCurve25519Req.options = WH_PACKET_PK_SECRET_CACHE;
+    packet->pkCurve25519Req.keyId = *keyId;
+    packet->pkCurve25519Req.flags = flags;
+    /* write request */
+    ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_CRYPTO, WC_ALGO_TYPE_PK,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkCurve25519Req),
+            (uint8_t*)packet);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &action, &size,
+                (uint8_t*)packet);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0) {
+        if (packet->rc != 0)
+            ret = packet->rc;
+        else
+            *keyId = (whKeyId)packet->pkCurve25519Res.keyId;
+    }
+    return ret;
+}
+#endif /* HAVE_CURVE25519 */
 #endif  /* !WOLFHSM_NO_CRYPTO */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_client_batch.c
+ */
+
+/* System libraries */
+#include <stdint.h>
+#include <stdlib.h>  /* For NULL */
+#include <string.h>  /* For memset, memcpy */
+
+/* Common WolfHSM types and defines shared with the server */
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_batch.h"
+
+#include "wolfhsm/wh_client.h"
+
+#ifndef WOLFHSM_NO_BATCH
+
+int wh_Client_BatchInit(whClientBatch* batch)
+{
+    if (batch == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(batch, 0, sizeof(*batch));
+    batch->size = sizeof(whMessageBatch_Header);
+    return 0;
+}
+
+int wh_Client_BatchAdd(whClientContext* c, whClientBatch* batch,
+        uint16_t group, uint16_t action, uint16_t data_size, const void* data)
+{
+    uint8_t* buffer = NULL;
+    whMessageBatch_Header* hdr = NULL;
+    whMessageBatch_Entry* entry = NULL;
+
+    if (    (c == NULL) ||
+            (batch == NULL) ||
+            ((data == NULL) && (data_size != 0)) ||
+            (group == WH_MESSAGE_GROUP_BATCH)) {
+        return WH_ERROR_BADARGS;
+    }
+    if (batch->size + sizeof(*entry) + data_size > c->comm->max_data_len) {
+        return WH_ERROR_NOSPACE;
+    }
+
+    buffer = (uint8_t*)batch->buffer;
+    entry = (whMessageBatch_Entry*)(buffer + batch->size);
+    entry->kind = WH_MESSAGE_KIND(group, action);
+    entry->size = data_size;
+    entry->rc = 0;
+    if (data_size != 0) {
+        memcpy(entry + 1, data, data_size);
+    }
+    batch->size += sizeof(*entry) + data_size;
+
+    /* Pad to the next entry, unless this is the last one that fits */
+    if (WH_MESSAGE_BATCH_PADDED(batch->size) <= c->comm->max_data_len) {
+        memset(buffer + batch->size, 0,
+                WH_MESSAGE_BATCH_PADDED(batch->size) - batch->size);
+        batch->size = WH_MESSAGE_BATCH_PADDED(batch->size);
+    }
+
+    batch->count++;
+    hdr = (whMessageBatch_Header*)buffer;
+    hdr->count = batch->count;
+    return 0;
+}
+
+int wh_Client_BatchRequest(whClientContext* c, whClientBatch* batch)
+{
+    if ((c == NULL) || (batch == NULL) || (batch->count == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_BATCH, WH_MESSAGE_BATCH_ACTION_REQUEST,
+            batch->size, batch->buffer);
+}
+
+int wh_Client_BatchResponse(whClientContext* c, whClientBatch* batch)
+{
+    int rc = 0;
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+
+    if ((c == NULL) || (batch == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_RecvResponse(c,
+            &resp_group, &resp_action,
+            &resp_size, batch->buffer);
+    if (rc == 0) {
+        /* Validate response */
+        if (    (resp_group != WH_MESSAGE_GROUP_BATCH) ||
+                (resp_action != WH_MESSAGE_BATCH_ACTION_REQUEST) ||
+                (resp_size < sizeof(whMessageBatch_Header)) ){
+            /* Invalid message */
+            rc = WH_ERROR_ABORTED;
+        } else {
+            /* Valid message. Prepare to read the results */
+            batch->size = resp_size;
+            batch->count = ((whMessageBatch_Header*)batch->buffer)->count;
+            batch->offset = sizeof(whMessageBatch_Header);
+            batch->index = 0;
+        }
+    }
+    return rc;
+}
+
+int wh_Client_Batch(whClientContext* c, whClientBatch* batch)
+{
+    int rc = 0;
+    if ((c == NULL) || (batch == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+    do {
+        rc = wh_Client_BatchRequest(c, batch);
+    } while (rc == WH_ERROR_NOTREADY);
+
+    if (rc == 0) {
+        do {
+            rc = wh_Client_BatchResponse(c, batch);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+int wh_Client_BatchGetResult(whClientBatch* batch, uint16_t* out_group,
+        uint16_t* out_action, int32_t* out_rc,
+        uint16_t* out_size, const void** out_data)
+{
+    const uint8_t* buffer = NULL;
+    const whMessageBatch_Entry* entry = NULL;
+
+    if (batch == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    if (batch->index >= batch->count) {
+        return WH_ERROR_NOTFOUND;
+    }
+
+    buffer = (const uint8_t*)batch->buffer;
+    entry = (const whMessageBatch_Entry*)(buffer + batch->offset);
+    if (    (batch->offset + sizeof(*entry) > batch->size) ||
+            (batch->offset + sizeof(*entry) + entry->size > batch->size)) {
+        /* Malformed response */
+        return WH_ERROR_ABORTED;
+    }
+
+    if (out_group != NULL) {
+        *out_group = WH_MESSAGE_GROUP(entry->kind);
+    }
+    if (out_action != NULL) {
+        *out_action = WH_MESSAGE_ACTION(entry->kind);
+    }
+    if (out_rc != NULL) {
+        *out_rc = entry->rc;
+    }
+    if (out_size != NULL) {
+        *out_size = entry->size;
+    }
+    if (out_data != NULL) {
+        *out_data = entry + 1;
+    }
+
+    batch->offset += sizeof(*entry) + WH_MESSAGE_BATCH_PADDED(entry->size);
+    batch->index++;
+    return 0;
+}
+
+#endif /* WOLFHSM_NO_BATCH */
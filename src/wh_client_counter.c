@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_client_counter.c
+ */
+
+/* System libraries */
+#include <stdint.h>
+#include <stdlib.h>  /* For NULL */
+#include <string.h>  /* For memset, memcpy */
+
+/* Common WolfHSM types and defines shared with the server */
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_counter.h"
+
+#include "wolfhsm/wh_client.h"
+
+static int _wh_Client_CounterRequest(whClientContext* c, uint16_t action,
+        whCounterId id, uint32_t value)
+{
+    whMessageCounter_Request msg = {0};
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    msg.id = id;
+    msg.value = value;
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_COUNTER, action,
+            sizeof(msg), &msg);
+}
+
+static int _wh_Client_CounterResponse(whClientContext* c, uint16_t action,
+        int32_t *out_rc, uint32_t *out_value)
+{
+    whMessageCounter_Response msg = {0};
+    int rc = 0;
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_RecvResponse(c,
+            &resp_group, &resp_action,
+            &resp_size, &msg);
+    if (rc == 0) {
+        /* Validate response */
+        if (    (resp_group != WH_MESSAGE_GROUP_COUNTER) ||
+                (resp_action != action) ||
+                (resp_size != sizeof(msg)) ){
+            /* Invalid message */
+            rc = WH_ERROR_ABORTED;
+        } else {
+            /* Valid message */
+            if (out_rc != NULL) {
+                *out_rc = msg.rc;
+            }
+            if (out_value != NULL) {
+                *out_value = msg.value;
+            }
+        }
+    }
+    return rc;
+}
+
+/** Counter Init */
+int wh_Client_CounterInitRequest(whClientContext* c, whCounterId id,
+        uint32_t value)
+{
+    return _wh_Client_CounterRequest(c, WH_MESSAGE_COUNTER_ACTION_INIT,
+            id, value);
+}
+
+int wh_Client_CounterInitResponse(whClientContext* c, int32_t *out_rc,
+        uint32_t *out_value)
+{
+    return _wh_Client_CounterResponse(c, WH_MESSAGE_COUNTER_ACTION_INIT,
+            out_rc, out_value);
+}
+
+int wh_Client_CounterInit(whClientContext* c, whCounterId id, uint32_t value,
+        int32_t *out_rc, uint32_t *out_value)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_CounterInitRequest(c, id, value);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_CounterInitResponse(c, out_rc, out_value);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+/** Counter Increment */
+int wh_Client_CounterIncrementRequest(whClientContext* c, whCounterId id)
+{
+    return _wh_Client_CounterRequest(c, WH_MESSAGE_COUNTER_ACTION_INCREMENT,
+            id, 0);
+}
+
+int wh_Client_CounterIncrementResponse(whClientContext* c, int32_t *out_rc,
+        uint32_t *out_value)
+{
+    return _wh_Client_CounterResponse(c, WH_MESSAGE_COUNTER_ACTION_INCREMENT,
+            out_rc, out_value);
+}
+
+int wh_Client_CounterIncrement(whClientContext* c, whCounterId id,
+        int32_t *out_rc, uint32_t *out_value)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_CounterIncrementRequest(c, id);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_CounterIncrementResponse(c, out_rc, out_value);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+/** Counter Read */
+int wh_Client_CounterReadRequest(whClientContext* c, whCounterId id)
+{
+    return _wh_Client_CounterRequest(c, WH_MESSAGE_COUNTER_ACTION_READ,
+            id, 0);
+}
+
+int wh_Client_CounterReadResponse(whClientContext* c, int32_t *out_rc,
+        uint32_t *out_value)
+{
+    return _wh_Client_CounterResponse(c, WH_MESSAGE_COUNTER_ACTION_READ,
+            out_rc, out_value);
+}
+
+int wh_Client_CounterRead(whClientContext* c, whCounterId id,
+        int32_t *out_rc, uint32_t *out_value)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_CounterReadRequest(c, id);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_CounterReadResponse(c, out_rc, out_value);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+/** Counter Destroy */
+int wh_Client_CounterDestroyRequest(whClientContext* c, whCounterId id)
+{
+    return _wh_Client_CounterRequest(c, WH_MESSAGE_COUNTER_ACTION_DESTROY,
+            id, 0);
+}
+
+int wh_Client_CounterDestroyResponse(whClientContext* c, int32_t *out_rc)
+{
+    return _wh_Client_CounterResponse(c, WH_MESSAGE_COUNTER_ACTION_DESTROY,
+            out_rc, NULL);
+}
+
+int wh_Client_CounterDestroy(whClientContext* c, whCounterId id,
+        int32_t *out_rc)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_CounterDestroyRequest(c, id);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_CounterDestroyResponse(c, out_rc);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
@@ -47,6 +47,10 @@
 #include "wolfssl/wolfcrypt/aes.h"
 #include "wolfssl/wolfcrypt/cmac.h"
 #include "wolfssl/wolfcrypt/rsa.h"
+#include "wolfssl/wolfcrypt/sha256.h"
+#include "wolfssl/wolfcrypt/sha512.h"
+#include "wolfssl/wolfcrypt/hmac.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
 #include "wolfssl/wolfcrypt/cryptocb.h"
 #include "wolfhsm/wh_packet.h"
 #include "wolfhsm/wh_error.h"
@@ -54,6 +58,627 @@
 #include "wolfhsm/wh_message.h"
 #include "wolfhsm/wh_cryptocb.h"
 
+#if !defined(NO_SHA256) || defined(WOLFSSL_SHA384) || defined(WOLFSSL_SHA512)
+/* Send a hash or HMAC update, split to fit the packet, or the final request.
+ * The server keeps the state in a stream, opened when handle is 0 */
+static int _wh_Client_HashCb(whClientContext* ctx, uint16_t action,
+    uint32_t type, uint32_t keyId, uint32_t* handle, const uint8_t* in,
+    uint32_t inSz, uint8_t* digest)
+{
+    int ret = 0;
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint8_t* data = (uint8_t*)(&packet->hashReq + 1);
+    uint16_t group = WH_MESSAGE_GROUP_CRYPTO;
+    uint16_t respAction;
+    uint16_t dataSz;
+    uint32_t max = ctx->comm->max_data_len - WOLFHSM_PACKET_STUB_SIZE -
+        sizeof(packet->hashReq);
+    uint32_t sz;
+    int final = (digest != NULL);
+
+    do {
+        sz = (inSz > max) ? max : inSz;
+        packet->hashReq.type = type;
+        packet->hashReq.handle = *handle;
+        packet->hashReq.keyId = keyId;
+        packet->hashReq.sz = sz;
+        /* finish with the last chunk */
+        packet->hashReq.final = (final && sz == inSz);
+        if (sz > 0)
+            XMEMCPY(data, in, sz);
+        ret = wh_Client_SendRequest(ctx, group, action,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->hashReq) + sz,
+            rawPacket);
+        if (ret == 0) {
+            do {
+                ret = wh_Client_RecvResponse(ctx, &group, &respAction,
+                    &dataSz, rawPacket);
+            } while (ret == WH_ERROR_NOTREADY);
+        }
+        if (ret == 0 && packet->rc != 0)
+            ret = packet->rc;
+        /* the server closes the stream on failure and on final */
+        if (ret != 0) {
+            *handle = 0;
+            break;
+        }
+        *handle = packet->hashRes.handle;
+        if (packet->hashRes.digestSz > 0) {
+            XMEMCPY(digest, (uint8_t*)(&packet->hashRes + 1),
+                packet->hashRes.digestSz);
+        }
+        in += sz;
+        inSz -= sz;
+    } while (inSz > 0);
+    return ret;
+}
+
+#if defined(WOLF_CRYPTO_CB_COPY) || defined(WOLF_CRYPTO_CB_FREE)
+/* The devCtx of a wolfCrypt hash struct, which holds its stream handle, and
+ * the size of the struct */
+static void** _wh_Client_HashDevCtx(int type, void* obj, uint32_t* objSz)
+{
+    uint32_t sz;
+    void** devCtx;
+
+    switch (type) {
+#ifndef NO_SHA256
+    case WC_HASH_TYPE_SHA256:
+        sz = sizeof(wc_Sha256);
+        devCtx = &((wc_Sha256*)obj)->devCtx;
+        break;
+#endif
+#ifdef WOLFSSL_SHA384
+    case WC_HASH_TYPE_SHA384:
+        sz = sizeof(wc_Sha384);
+        devCtx = &((wc_Sha384*)obj)->devCtx;
+        break;
+#endif
+#ifdef WOLFSSL_SHA512
+    case WC_HASH_TYPE_SHA512:
+        sz = sizeof(wc_Sha512);
+        devCtx = &((wc_Sha512*)obj)->devCtx;
+        break;
+#endif
+    default:
+        return NULL;
+    }
+    if (objSz != NULL)
+        *objSz = sz;
+    return devCtx;
+}
+#endif /* WOLF_CRYPTO_CB_COPY || WOLF_CRYPTO_CB_FREE */
+
+#if defined(WOLF_CRYPTO_CB_FREE)
+/* Close the stream of a hash or HMAC freed before its final */
+static void _wh_Client_HashClose(whClientContext* ctx, uint16_t action,
+    uint32_t type, uint32_t keyId, uint32_t handle)
+{
+    uint8_t digest[WC_MAX_DIGEST_SIZE];
+
+    if (handle != 0) {
+        (void)_wh_Client_HashCb(ctx, action, type, keyId, &handle, NULL, 0,
+            digest);
+        XMEMSET(digest, 0, sizeof(digest));
+    }
+}
+#endif /* WOLF_CRYPTO_CB_FREE */
+
+#ifdef WOLF_CRYPTO_CB_COPY
+/* Copy a hash struct, giving the copy its own stream holding a copy of the
+ * server state. Otherwise both would use one stream and the final of either,
+ * as in wc_Sha256GetHash, would close it under the other */
+static int _wh_Client_HashCopy(whClientContext* ctx, int type, void* src,
+    void* dst)
+{
+    int ret = 0;
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint16_t group = WH_MESSAGE_GROUP_CRYPTO;
+    uint16_t respAction;
+    uint16_t dataSz;
+    uint32_t objSz = 0;
+    uint32_t handle;
+    void** srcCtx = _wh_Client_HashDevCtx(type, src, &objSz);
+    void** dstCtx = _wh_Client_HashDevCtx(type, dst, NULL);
+
+    if (srcCtx == NULL || dstCtx == NULL)
+        return CRYPTOCB_UNAVAILABLE;
+    /* what wolfCrypt's own copy does, which is skipped when this handles it */
+    XMEMCPY(dst, src, objSz);
+#ifdef WOLFSSL_SMALL_STACK_CACHE
+#ifndef NO_SHA256
+    if (type == WC_HASH_TYPE_SHA256)
+        ((wc_Sha256*)dst)->W = NULL;
+#endif
+#if defined(WOLFSSL_SHA384) || defined(WOLFSSL_SHA512)
+    if (type == WC_HASH_TYPE_SHA384 || type == WC_HASH_TYPE_SHA512)
+        ((wc_Sha512*)dst)->W = NULL;
+#endif
+#endif /* WOLFSSL_SMALL_STACK_CACHE */
+    handle = (uint32_t)((uintptr_t)*srcCtx);
+    *dstCtx = NULL;
+    if (handle == 0) {
+        /* nothing on the server yet */
+        return 0;
+    }
+
+    packet->hashReq.type = type;
+    packet->hashReq.handle = handle;
+    ret = wh_Client_SendRequest(ctx, group, WH_CRYPTO_HASH_STREAM_COPY,
+        WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->hashReq), rawPacket);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(ctx, &group, &respAction, &dataSz,
+                rawPacket);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0 && packet->rc != 0)
+        ret = packet->rc;
+    if (ret == 0)
+        *dstCtx = (void*)((uintptr_t)packet->hashRes.handle);
+    return ret;
+}
+#endif /* WOLF_CRYPTO_CB_COPY */
+#endif /* !NO_SHA256 || WOLFSSL_SHA384 || WOLFSSL_SHA512 */
+
+#ifdef WOLFSSL_CMAC
+/* Send a CMAC update, split to fit the packet, or the final request. The
+ * server keeps the state in a stream, opened with key, or the cached keyId
+ * if key is NULL, when handle is 0 */
+static int _wh_Client_CmacCb(whClientContext* ctx, uint32_t* handle,
+    whKeyId keyId, const uint8_t* key, uint32_t keySz, const uint8_t* in,
+    uint32_t inSz, uint8_t* out, uint32_t* outSz)
+{
+    int ret = 0;
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint8_t* data = (uint8_t*)(&packet->cmacReq + 1);
+    uint16_t group = WH_MESSAGE_GROUP_CRYPTO;
+    uint16_t respAction;
+    uint16_t dataSz;
+    uint32_t max = ctx->comm->max_data_len - WOLFHSM_PACKET_STUB_SIZE -
+        sizeof(packet->cmacReq) - keySz;
+    uint32_t sz;
+    int final = (out != NULL);
+    int last;
+
+    if (keySz > AES_MAX_KEY_SIZE / 8)
+        return WH_ERROR_BADARGS;
+    do {
+        sz = (inSz > max) ? max : inSz;
+        packet->cmacReq.handle = *handle;
+        packet->cmacReq.type = WC_CMAC_AES;
+        packet->cmacReq.inSz = sz;
+        packet->cmacReq.keySz = keySz;
+        packet->cmacReq.outSz = final ? *outSz : 0;
+        packet->cmacReq.keyId = keyId;
+        /* finish with the last chunk */
+        last = (final && sz == inSz);
+        packet->cmacReq.final = last;
+        if (sz > 0)
+            XMEMCPY(data, in, sz);
+        if (keySz > 0)
+            XMEMCPY(data + sz, key, keySz);
+        ret = wh_Client_SendRequest(ctx, group, WC_ALGO_TYPE_CMAC,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cmacReq) + sz + keySz,
+            rawPacket);
+        if (ret == 0) {
+            do {
+                ret = wh_Client_RecvResponse(ctx, &group, &respAction,
+                    &dataSz, rawPacket);
+            } while (ret == WH_ERROR_NOTREADY);
+        }
+        if (ret == 0 && packet->rc != 0)
+            ret = packet->rc;
+        /* the server closes the stream on failure and on final */
+        if (ret != 0) {
+            *handle = 0;
+            break;
+        }
+        *handle = packet->cmacRes.handle;
+        if (last) {
+            *outSz = packet->cmacRes.outSz;
+            XMEMCPY(out, (uint8_t*)(&packet->cmacRes + 1), *outSz);
+        }
+        /* the key is only needed to open the stream */
+        keySz = 0;
+        in += sz;
+        inSz -= sz;
+    } while (inSz > 0);
+    return ret;
+}
+#endif /* WOLFSSL_CMAC */
+
+#ifdef WOLF_CRYPTO_CB_FREE
+/* Close the server stream of a hash or MAC freed before its final */
+static void _wh_Client_StreamFree(whClientContext* ctx, int algo, int type,
+    void* obj)
+{
+#if !defined(NO_SHA256) || defined(WOLFSSL_SHA384) || defined(WOLFSSL_SHA512)
+    void** devCtx;
+#ifndef NO_HMAC
+    Hmac* hmac;
+#endif
+#endif
+#ifdef WOLFSSL_CMAC
+    Cmac* cmac;
+    uint32_t handle;
+    uint8_t out[AES_BLOCK_SIZE];
+    uint32_t outSz = sizeof(out);
+#endif
+
+    switch (algo) {
+#if !defined(NO_SHA256) || defined(WOLFSSL_SHA384) || defined(WOLFSSL_SHA512)
+    case WC_ALGO_TYPE_HASH:
+        devCtx = _wh_Client_HashDevCtx(type, obj, NULL);
+        if (devCtx != NULL) {
+            _wh_Client_HashClose(ctx, WC_ALGO_TYPE_HASH, type, 0,
+                (uint32_t)((uintptr_t)*devCtx));
+            *devCtx = NULL;
+        }
+        break;
+#ifndef NO_HMAC
+    case WC_ALGO_TYPE_HMAC:
+        /* keep the key id, drop the handle */
+        hmac = (Hmac*)obj;
+        _wh_Client_HashClose(ctx, WC_ALGO_TYPE_HMAC, hmac->macType,
+            (uint32_t)((uintptr_t)hmac->devCtx & 0xFFFF),
+            (uint32_t)(((uintptr_t)hmac->devCtx >> 16) & 0xFFFF));
+        hmac->devCtx = (void*)((uintptr_t)hmac->devCtx & 0xFFFF);
+        break;
+#endif /* !NO_HMAC */
+#endif /* !NO_SHA256 || WOLFSSL_SHA384 || WOLFSSL_SHA512 */
+#ifdef WOLFSSL_CMAC
+    case WC_ALGO_TYPE_CMAC:
+        /* keep the key id, drop the handle */
+        cmac = (Cmac*)obj;
+        handle = (uint32_t)(((uintptr_t)cmac->devCtx >> 16) & 0xFFFF);
+        if (handle != 0) {
+            (void)_wh_Client_CmacCb(ctx, &handle, WOLFHSM_KEYID_ERASED, NULL,
+                0, NULL, 0, out, &outSz);
+            XMEMSET(out, 0, sizeof(out));
+        }
+        cmac->devCtx = (void*)((uintptr_t)cmac->devCtx & 0xFFFF);
+        break;
+#endif /* WOLFSSL_CMAC */
+    default:
+        (void)ctx;
+        (void)type;
+        (void)obj;
+        break;
+    }
+}
+#endif /* WOLF_CRYPTO_CB_FREE */
+
+#ifndef WC_NO_RNG
+/* Fetch sz bytes of server RNG output, split to fit the packet */
+static int _wh_Client_RngFetch(whClientContext* ctx, uint8_t* out,
+    uint32_t sz)
+{
+    int ret = 0;
+    uint8_t rawPacket[WH_COMM_DATA_LEN] = {0};
+    whPacket* packet = (whPacket*)rawPacket;
+    uint16_t group = WH_MESSAGE_GROUP_CRYPTO;
+    uint16_t action;
+    uint16_t dataSz;
+    uint32_t max = ctx->comm->max_data_len - WOLFHSM_PACKET_STUB_SIZE -
+        sizeof(packet->rngRes);
+    uint32_t chunk;
+
+    while (ret == 0 && sz > 0) {
+        chunk = (sz > max) ? max : sz;
+        packet->rngReq.sz = chunk;
+        ret = wh_Client_SendRequest(ctx, group, WC_ALGO_TYPE_RNG,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->rngReq), rawPacket);
+        if (ret == 0) {
+            do {
+                ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
+                    rawPacket);
+            } while (ret == WH_ERROR_NOTREADY);
+        }
+        if (ret == 0) {
+            if (packet->rc != 0)
+                ret = packet->rc;
+            else if (packet->rngRes.sz != chunk)
+                ret = WH_ERROR_ABORTED;
+        }
+        if (ret == 0) {
+            XMEMCPY(out, (uint8_t*)(&packet->rngRes + 1), chunk);
+            out += chunk;
+            sz -= chunk;
+        }
+    }
+    XMEMSET(rawPacket, 0, sizeof(rawPacket));
+    return ret;
+}
+
+#if WH_CLIENT_RNG_CACHE_SIZE > 0
+/* Serve sz bytes from the client RNG cache, refilling it as needed. Requests
+ * at least as large as the cache go to the server directly */
+static int _wh_Client_RngCached(whClientContext* ctx, uint8_t* out,
+    uint32_t sz)
+{
+    int ret = 0;
+    uint32_t take;
+
+    while (ret == 0 && sz > 0) {
+        if (ctx->rng_count == 0) {
+            if (sz >= WH_CLIENT_RNG_CACHE_SIZE)
+                return _wh_Client_RngFetch(ctx, out, sz);
+            ret = _wh_Client_RngFetch(ctx, ctx->rng_cache,
+                WH_CLIENT_RNG_CACHE_SIZE);
+            if (ret == 0)
+                ctx->rng_count = WH_CLIENT_RNG_CACHE_SIZE;
+            continue;
+        }
+        /* hand out from the end, and wipe what was handed out */
+        take = (sz > ctx->rng_count) ? ctx->rng_count : sz;
+        ctx->rng_count -= take;
+        XMEMCPY(out, ctx->rng_cache + ctx->rng_count, take);
+        XMEMSET(ctx->rng_cache + ctx->rng_count, 0, take);
+        out += take;
+        sz -= take;
+    }
+    return ret;
+}
+#endif /* WH_CLIENT_RNG_CACHE_SIZE > 0 */
+#endif /* !WC_NO_RNG */
+
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+/* Public part of keyId from the client cache, exported from the server on
+ * first use and again once the server key generation moves on, as the key
+ * may since have been replaced by another client or in NVM. Returns NULL if
+ * the server has no public part to give */
+static whClientPubKey* _wh_Client_PubKeyGet(whClientContext* ctx,
+    uint16_t keyId, uint32_t type)
+{
+    int i;
+    int ret;
+    uint32_t sz;
+    uint32_t generation = 0;
+    whClientPubKey* pub = NULL;
+    whClientPubKey* freePub = NULL;
+
+    if (keyId == WOLFHSM_KEYID_ERASED)
+        return NULL;
+    if (wh_Client_KeyGeneration(ctx, &generation) != 0)
+        return NULL;
+    for (i = 0; i < WH_CLIENT_PUBKEY_CACHE_COUNT; i++) {
+        if (ctx->pubkey[i].keyId == keyId && ctx->pubkey[i].type == type) {
+            pub = &ctx->pubkey[i];
+            break;
+        }
+        if (freePub == NULL && ctx->pubkey[i].keyId == WOLFHSM_KEYID_ERASED)
+            freePub = &ctx->pubkey[i];
+    }
+    if (pub != NULL && pub->generation == generation)
+        return (pub->len > 0) ? pub : NULL;
+    if (pub == NULL)
+        pub = freePub;
+    if (pub == NULL) {
+        pub = &ctx->pubkey[ctx->pubkey_next];
+        ctx->pubkey_next = (ctx->pubkey_next + 1) %
+            WH_CLIENT_PUBKEY_CACHE_COUNT;
+    }
+    sz = sizeof(pub->key);
+    ret = wh_Client_KeyExportPublic(ctx, keyId, type, NULL, 0, pub->key, &sz);
+    /* a refusal is remembered only until the generation moves on, a key
+     * changed since the generation was read is fetched again next time */
+    pub->keyId = keyId;
+    pub->type = type;
+    pub->generation = generation;
+    pub->len = (ret == 0) ? sz : 0;
+    return (pub->len > 0) ? pub : NULL;
+}
+
+/* Run RSA public operations and ECDSA verification with the cached public
+ * key. Returns CRYPTOCB_UNAVAILABLE to leave the operation to the server */
+static int _wh_Client_PkLocal(whClientContext* ctx, wc_CryptoInfo* info)
+{
+    int ret = CRYPTOCB_UNAVAILABLE;
+    whClientPubKey* pub;
+#ifndef NO_RSA
+    RsaKey rsa[1];
+    word32 idx = 0;
+#endif
+#ifdef HAVE_ECC
+    ecc_key ecc[1];
+    int curveId;
+#endif
+
+#ifdef WH_CLIENT_ASYNC_CRYPTO
+    /* a repeated call must collect the outstanding server response */
+    if (ctx->async_type != WC_PK_TYPE_NONE)
+        return CRYPTOCB_UNAVAILABLE;
+#endif
+    switch (info->pk.type) {
+#ifndef NO_RSA
+    case WC_PK_TYPE_RSA:
+        if (info->pk.rsa.type != RSA_PUBLIC_ENCRYPT &&
+            info->pk.rsa.type != RSA_PUBLIC_DECRYPT)
+            break;
+        pub = _wh_Client_PubKeyGet(ctx,
+            (uint16_t)(intptr_t)info->pk.rsa.key->devCtx, WOLFHSM_KEYFLAG_RSA);
+        if (pub == NULL || wc_InitRsaKey_ex(rsa, NULL, INVALID_DEVID) != 0)
+            break;
+        if (wc_RsaPublicKeyDecode(pub->key, &idx, rsa, pub->len) == 0) {
+            ret = wc_RsaFunction(info->pk.rsa.in, info->pk.rsa.inLen,
+                info->pk.rsa.out, info->pk.rsa.outLen, info->pk.rsa.type, rsa,
+                info->pk.rsa.rng);
+        }
+        wc_FreeRsaKey(rsa);
+        break;
+#endif /* !NO_RSA */
+#ifdef HAVE_ECC
+    case WC_PK_TYPE_ECDSA_VERIFY:
+        curveId = wc_ecc_get_curve_id(info->pk.eccverify.key->idx);
+        if (curveId < 0)
+            break;
+        pub = _wh_Client_PubKeyGet(ctx,
+            (uint16_t)(intptr_t)info->pk.eccverify.key->devCtx,
+            WOLFHSM_KEYFLAG_ECC);
+        if (pub == NULL || wc_ecc_init_ex(ecc, NULL, INVALID_DEVID) != 0)
+            break;
+        /* cached as qx | qy */
+        if (wc_ecc_import_unsigned(ecc, pub->key, pub->key + pub->len / 2,
+                NULL, curveId) == 0) {
+            ret = wc_ecc_verify_hash(info->pk.eccverify.sig,
+                info->pk.eccverify.siglen, info->pk.eccverify.hash,
+                info->pk.eccverify.hashlen, info->pk.eccverify.res, ecc);
+        }
+        wc_ecc_free(ecc);
+        break;
+#endif /* HAVE_ECC */
+    default:
+        break;
+    }
+    return ret;
+}
+#endif /* WH_CLIENT_PUBKEY_CACHE_COUNT > 0 */
+
+#ifdef WH_CLIENT_ASYNC_CRYPTO
+/* Key and output identifying an operation that may be asynchronous.
+ * Returns 0 for operations that always wait */
+static int _wh_Client_AsyncOp(const wc_CryptoInfo* info, const void** key,
+    const void** out)
+{
+    if (info->algo_type != WC_ALGO_TYPE_PK)
+        return 0;
+    switch (info->pk.type) {
+#ifndef NO_RSA
+#ifdef WOLFSSL_KEY_GEN
+    case WC_PK_TYPE_RSA_KEYGEN:
+        *key = info->pk.rsakg.key;
+        break;
+#endif
+    case WC_PK_TYPE_RSA:
+        *key = info->pk.rsa.key;
+        *out = info->pk.rsa.out;
+        break;
+#endif /* !NO_RSA */
+#ifdef HAVE_ECC
+    case WC_PK_TYPE_EC_KEYGEN:
+        *key = info->pk.eckg.key;
+        break;
+    case WC_PK_TYPE_ECDH:
+        *key = info->pk.ecdh.private_key;
+        *out = info->pk.ecdh.out;
+        break;
+    case WC_PK_TYPE_ECDSA_SIGN:
+        *key = info->pk.eccsign.key;
+        *out = info->pk.eccsign.out;
+        break;
+    case WC_PK_TYPE_ECDSA_VERIFY:
+        *key = info->pk.eccverify.key;
+        *out = info->pk.eccverify.res;
+        break;
+#endif /* HAVE_ECC */
+#ifdef HAVE_CURVE25519
+    case WC_PK_TYPE_CURVE25519_KEYGEN:
+        *key = info->pk.curve25519kg.key;
+        break;
+    case WC_PK_TYPE_CURVE25519:
+        *key = info->pk.curve25519.private_key;
+        *out = info->pk.curve25519.out;
+        break;
+#endif /* HAVE_CURVE25519 */
+#ifdef HAVE_ED25519
+    case WC_PK_TYPE_ED25519_KEYGEN:
+        *key = info->pk.ed25519kg.key;
+        break;
+    case WC_PK_TYPE_ED25519_SIGN:
+        *key = info->pk.ed25519sign.key;
+        *out = info->pk.ed25519sign.out;
+        break;
+    case WC_PK_TYPE_ED25519_VERIFY:
+        *key = info->pk.ed25519verify.key;
+        *out = info->pk.ed25519verify.res;
+        break;
+#endif /* HAVE_ED25519 */
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+int wh_Client_SetAsyncCrypto(whClientContext* c, int enable)
+{
+    if (c == NULL)
+        return WH_ERROR_BADARGS;
+    if (c->async_type != WC_PK_TYPE_NONE)
+        return WH_ERROR_NOTREADY;
+    c->async_enabled = (enable != 0);
+    return 0;
+}
+
+int wh_Client_CancelAsyncCrypto(whClientContext* c)
+{
+    int ret;
+    uint8_t rawPacket[WH_COMM_DATA_LEN];
+    uint16_t group;
+    uint16_t action;
+    uint16_t dataSz;
+
+    if (c == NULL)
+        return WH_ERROR_BADARGS;
+    if (c->async_type == WC_PK_TYPE_NONE)
+        return 0;
+    /* the response still arrives, and has to be read before the next one */
+    do {
+        ret = wh_Client_RecvResponse(c, &group, &action, &dataSz, rawPacket);
+    } while (ret == WH_ERROR_NOTREADY);
+    XMEMSET(rawPacket, 0, sizeof(rawPacket));
+    c->async_type = WC_PK_TYPE_NONE;
+    c->async_key = NULL;
+    c->async_out = NULL;
+    return ret;
+}
+#endif /* WH_CLIENT_ASYNC_CRYPTO */
+
+/* Send a public key request in rawPacket and receive its response into it */
+static int _wh_Client_PkRequest(whClientContext* ctx, wc_CryptoInfo* info,
+    uint16_t size, uint8_t* rawPacket)
+{
+    int ret;
+    uint16_t group;
+    uint16_t action;
+    uint16_t dataSz;
+#ifdef WH_CLIENT_ASYNC_CRYPTO
+    const void* key = NULL;
+    const void* out = NULL;
+
+    if (ctx->async_enabled && _wh_Client_AsyncOp(info, &key, &out)) {
+        if (ctx->async_type == WC_PK_TYPE_NONE) {
+            ret = wh_Client_SendRequest(ctx, WH_MESSAGE_GROUP_CRYPTO,
+                WC_ALGO_TYPE_PK, size, rawPacket);
+            if (ret == 0) {
+                ctx->async_type = info->pk.type;
+                ctx->async_key = key;
+                ctx->async_out = out;
+            }
+            return (ret == 0 || ret == WH_ERROR_NOTREADY) ? WC_PENDING_E : ret;
+        }
+        /* the call repeats the outstanding operation */
+        ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz, rawPacket);
+        if (ret == WH_ERROR_NOTREADY)
+            return WC_PENDING_E;
+        ctx->async_type = WC_PK_TYPE_NONE;
+        return ret;
+    }
+#endif
+    ret = wh_Client_SendRequest(ctx, WH_MESSAGE_GROUP_CRYPTO, WC_ALGO_TYPE_PK,
+        size, rawPacket);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
+                rawPacket);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    return ret;
+}
+
 int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
 {
 #if 0
@@ -80,10 +705,39 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
     uint8_t* iv;
     uint8_t* sig;
     uint8_t* hash;
+#if !defined(NO_SHA256) || defined(WOLFSSL_SHA384) || defined(WOLFSSL_SHA512)
+    void** devCtx;
+#endif
+#if !defined(NO_SHA256) || defined(WOLFSSL_SHA384) || \
+    defined(WOLFSSL_SHA512) || defined(WOLFSSL_CMAC)
+    uint32_t handle;
+#endif
+#ifdef WOLFSSL_CMAC
+    uintptr_t cmacCtx;
+#endif
+#ifdef HAVE_ED25519
+    uint32_t max = ctx->comm->max_data_len - WOLFHSM_PACKET_STUB_SIZE;
+#endif
 
     if (devId == INVALID_DEVID || info == NULL)
         return BAD_FUNC_ARG;
 
+#ifdef WH_CLIENT_ASYNC_CRYPTO
+    /* responses arrive in order, so nothing else may use the connection
+     * until the outstanding operation is repeated or cancelled. Only public
+     * key callers know to retry on WC_PENDING_E */
+    if (ctx->async_type != WC_PK_TYPE_NONE) {
+        const void* asyncKey = NULL;
+        const void* asyncOut = NULL;
+        if (info->algo_type != WC_ALGO_TYPE_PK)
+            return BAD_STATE_E;
+        if (!_wh_Client_AsyncOp(info, &asyncKey, &asyncOut) ||
+                info->pk.type != ctx->async_type ||
+                asyncKey != ctx->async_key || asyncOut != ctx->async_out)
+            return WC_PENDING_E;
+    }
+#endif
+
     XMEMSET(rawPacket, 0, sizeof(rawPacket));
 
     switch (info->algo_type)
@@ -250,6 +904,11 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
         }
         break;
     case WC_ALGO_TYPE_PK:
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+        ret = _wh_Client_PkLocal(ctx, info);
+        if (ret != CRYPTOCB_UNAVAILABLE)
+            break;
+#endif
         /* set type */
         packet->pkAnyReq.type = info->pk.type;
         switch (info->pk.type)
@@ -262,16 +921,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             /* set e */
             packet->pkRsakgReq.e = info->pk.rsakg.e;
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkRsakgReq),
                 rawPacket);
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -297,18 +949,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             /* set in */
             XMEMCPY(in, info->pk.rsa.in, info->pk.rsa.inLen);
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
-                WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkRsaReq)
-                    + info->pk.rsa.inLen,
-                rawPacket);
-            /* read response */
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
+            ret = _wh_Client_PkRequest(ctx, info,
+                WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkRsaReq) +
+                    info->pk.rsa.inLen, rawPacket);
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -325,17 +968,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             packet->pkRsaGetSizeReq.keyId =
                 (intptr_t)(info->pk.rsa_get_size.key->devCtx);
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkRsaGetSizeReq),
                 rawPacket);
-            /* read response */
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -354,17 +989,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             /* set curveId */
             packet->pkEckgReq.curveId = info->pk.eckg.curveId;
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEckgReq),
                 rawPacket);
-            /* read response */
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -387,17 +1014,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             packet->pkEcdhReq.curveId =
                 wc_ecc_get_curve_id(info->pk.ecdh.private_key->idx);
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEcdhReq),
                 rawPacket);
-            /* read response */
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -422,18 +1041,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             /* set in */
             XMEMCPY(in, info->pk.eccsign.in, info->pk.eccsign.inlen);
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEccSignReq) +
-                    info->pk.eccsign.inlen,
-                rawPacket);
-            /* read response */
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
+                    info->pk.eccsign.inlen, rawPacket);
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -462,18 +1072,10 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             XMEMCPY(sig, info->pk.eccverify.sig, info->pk.eccverify.siglen);
             XMEMCPY(hash, info->pk.eccverify.hash, info->pk.eccverify.hashlen);
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEccVerifyReq) +
-                info->pk.eccverify.siglen + info->pk.eccverify.hashlen,
+                    info->pk.eccverify.siglen + info->pk.eccverify.hashlen,
                 rawPacket);
-            /* read response */
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -491,17 +1093,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             packet->pkEccCheckReq.curveId =
                 wc_ecc_get_curve_id(info->pk.eccverify.key->idx);
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEccCheckReq),
                 rawPacket);
-            /* read response */
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -512,16 +1106,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
         case WC_PK_TYPE_CURVE25519_KEYGEN:
             packet->pkCurve25519kgReq.sz = info->pk.curve25519kg.size;
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkCurve25519kgReq),
                 rawPacket);
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -543,16 +1130,9 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
                 (intptr_t)(info->pk.curve25519.public_key->devCtx);
             packet->pkCurve25519Req.endian = info->pk.curve25519.endian;
             /* write request */
-            ret = wh_Client_SendRequest(ctx, group,
-                WC_ALGO_TYPE_PK,
+            ret = _wh_Client_PkRequest(ctx, info,
                 WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkCurve25519Req),
                 rawPacket);
-            if (ret == 0) {
-                do {
-                    ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                        rawPacket);
-                } while (ret == WH_ERROR_NOTREADY);
-            }
             if (ret == 0) {
                 if (packet->rc != 0)
                     ret = packet->rc;
@@ -564,6 +1144,112 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
             }
             break;
 #endif /* HAVE_CURVE25519 */
+#ifdef HAVE_ED25519
+        case WC_PK_TYPE_ED25519_KEYGEN:
+            packet->pkEd25519kgReq.sz = info->pk.ed25519kg.size;
+            /* write request */
+            ret = _wh_Client_PkRequest(ctx, info,
+                WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEd25519kgReq),
+                rawPacket);
+            if (ret == 0) {
+                if (packet->rc != 0)
+                    ret = packet->rc;
+                /* read out */
+                else {
+                    info->pk.ed25519kg.key->devCtx =
+                        (void*)((intptr_t)packet->pkEd25519kgRes.keyId);
+                    /* set metadata */
+                    info->pk.ed25519kg.key->pubKeySet = 1;
+                    info->pk.ed25519kg.key->privKeySet = 1;
+                }
+            }
+            break;
+        case WC_PK_TYPE_ED25519_SIGN:
+            /* in and context are after the fixed size fields */
+            in = (uint8_t*)(&packet->pkEd25519SignReq + 1);
+            out = (uint8_t*)(&packet->pkEd25519SignRes + 1);
+            if (sizeof(packet->pkEd25519SignReq) + info->pk.ed25519sign.inLen +
+                    info->pk.ed25519sign.contextLen > max) {
+                /* use Ed25519ph for messages larger than a packet */
+                ret = BAD_FUNC_ARG;
+                break;
+            }
+            packet->pkEd25519SignReq.keyId =
+                (intptr_t)info->pk.ed25519sign.key->devCtx;
+            packet->pkEd25519SignReq.sz = info->pk.ed25519sign.inLen;
+            packet->pkEd25519SignReq.signType = info->pk.ed25519sign.type;
+            packet->pkEd25519SignReq.contextSz =
+                info->pk.ed25519sign.contextLen;
+            XMEMCPY(in, info->pk.ed25519sign.in, info->pk.ed25519sign.inLen);
+            if (info->pk.ed25519sign.contextLen > 0) {
+                XMEMCPY(in + info->pk.ed25519sign.inLen,
+                    info->pk.ed25519sign.context,
+                    info->pk.ed25519sign.contextLen);
+            }
+            /* write request */
+            ret = _wh_Client_PkRequest(ctx, info,
+                WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEd25519SignReq) +
+                    info->pk.ed25519sign.inLen +
+                    info->pk.ed25519sign.contextLen, rawPacket);
+            if (ret == 0) {
+                if (packet->rc != 0)
+                    ret = packet->rc;
+                else if (packet->pkEd25519SignRes.sz >
+                        *info->pk.ed25519sign.outLen) {
+                    ret = BUFFER_E;
+                }
+                /* read out */
+                else {
+                    XMEMCPY(info->pk.ed25519sign.out, out,
+                        packet->pkEd25519SignRes.sz);
+                    *info->pk.ed25519sign.outLen = packet->pkEd25519SignRes.sz;
+                }
+            }
+            break;
+        case WC_PK_TYPE_ED25519_VERIFY:
+            /* sig, msg and context are after the fixed size fields */
+            sig = (uint8_t*)(&packet->pkEd25519VerifyReq + 1);
+            in = sig + info->pk.ed25519verify.sigLen;
+            if (sizeof(packet->pkEd25519VerifyReq) +
+                    info->pk.ed25519verify.sigLen +
+                    info->pk.ed25519verify.msgLen +
+                    info->pk.ed25519verify.contextLen > max) {
+                ret = BAD_FUNC_ARG;
+                break;
+            }
+            packet->pkEd25519VerifyReq.keyId =
+                (intptr_t)info->pk.ed25519verify.key->devCtx;
+            packet->pkEd25519VerifyReq.sigSz = info->pk.ed25519verify.sigLen;
+            packet->pkEd25519VerifyReq.sz = info->pk.ed25519verify.msgLen;
+            packet->pkEd25519VerifyReq.signType = info->pk.ed25519verify.type;
+            packet->pkEd25519VerifyReq.contextSz =
+                info->pk.ed25519verify.contextLen;
+            /* invalid unless the server says otherwise */
+            *info->pk.ed25519verify.res = 0;
+            XMEMCPY(sig, info->pk.ed25519verify.sig,
+                info->pk.ed25519verify.sigLen);
+            XMEMCPY(in, info->pk.ed25519verify.msg,
+                info->pk.ed25519verify.msgLen);
+            if (info->pk.ed25519verify.contextLen > 0) {
+                XMEMCPY(in + info->pk.ed25519verify.msgLen,
+                    info->pk.ed25519verify.context,
+                    info->pk.ed25519verify.contextLen);
+            }
+            /* write request */
+            ret = _wh_Client_PkRequest(ctx, info,
+                WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEd25519VerifyReq) +
+                    info->pk.ed25519verify.sigLen +
+                    info->pk.ed25519verify.msgLen +
+                    info->pk.ed25519verify.contextLen, rawPacket);
+            if (ret == 0) {
+                if (packet->rc != 0)
+                    ret = packet->rc;
+                /* read out */
+                else
+                    *info->pk.ed25519verify.res = packet->pkEd25519VerifyRes.res;
+            }
+            break;
+#endif /* HAVE_ED25519 */
         case WC_PK_TYPE_NONE:
         default:
             ret = CRYPTOCB_UNAVAILABLE;
@@ -572,28 +1258,119 @@ int wolfHSM_CryptoCb(int devId, wc_CryptoInfo* info, void* inCtx)
         break;
 #ifndef WC_NO_RNG
     case WC_ALGO_TYPE_RNG:
-        /* out is after the fixed size fields */
-        out = (uint8_t*)(&packet->rngRes + 1);
-        /* set sz */
-        packet->rngReq.sz = info->rng.sz;
-        /* write request */
-        ret = wh_Client_SendRequest(ctx, group, WC_ALGO_TYPE_RNG,
-            WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->rngReq), rawPacket);
-        if (ret == 0) {
-            do {
-                ret = wh_Client_RecvResponse(ctx, &group, &action, &dataSz,
-                    rawPacket);
-            } while (ret == WH_ERROR_NOTREADY);
+#if WH_CLIENT_RNG_CACHE_SIZE > 0
+        ret = _wh_Client_RngCached(ctx, info->rng.out, info->rng.sz);
+#else
+        ret = _wh_Client_RngFetch(ctx, info->rng.out, info->rng.sz);
+#endif
+        break;
+#endif /* !WC_NO_RNG */
+#if !defined(NO_SHA256) || defined(WOLFSSL_SHA384) || defined(WOLFSSL_SHA512)
+    case WC_ALGO_TYPE_HASH:
+        /* the stream handle is kept in devCtx between updates. A copy made
+         * with wc_Sha256Copy or GetHash gets its own stream through the copy
+         * callback when wolfCrypt has one, and otherwise shares it */
+        switch (info->hash.type) {
+#ifndef NO_SHA256
+        case WC_HASH_TYPE_SHA256:
+            devCtx = &info->hash.sha256->devCtx;
+            break;
+#endif
+#ifdef WOLFSSL_SHA384
+        case WC_HASH_TYPE_SHA384:
+            devCtx = &info->hash.sha384->devCtx;
+            break;
+#endif
+#ifdef WOLFSSL_SHA512
+        case WC_HASH_TYPE_SHA512:
+            devCtx = &info->hash.sha512->devCtx;
+            break;
+#endif
+        default:
+            devCtx = NULL;
+            break;
         }
-        if (ret == 0) {
-            if (packet->rc != 0)
-                ret = packet->rc;
-            /* read out */
-            else
-                XMEMCPY(info->rng.out, out, packet->rngRes.sz);
+        if (devCtx == NULL) {
+            ret = CRYPTOCB_UNAVAILABLE;
+            break;
+        }
+        handle = (uint32_t)((uintptr_t)*devCtx);
+        ret = _wh_Client_HashCb(ctx, WC_ALGO_TYPE_HASH, info->hash.type, 0,
+            &handle, info->hash.in, info->hash.inSz, info->hash.digest);
+        if (ret == NOT_COMPILED_IN && *devCtx == NULL) {
+            /* the server lacks this hash and nothing is on it yet, so let
+             * wolfCrypt hash locally */
+            ret = CRYPTOCB_UNAVAILABLE;
         }
+        *devCtx = (void*)((uintptr_t)handle);
         break;
-#endif /* !WC_NO_RNG */
+#ifndef NO_HMAC
+    case WC_ALGO_TYPE_HMAC:
+        /* devCtx holds the key id from wh_Client_SetKeyHmac in the low 16
+         * bits and the stream handle above them */
+        devCtx = &info->hmac.hmac->devCtx;
+        if (*devCtx == NULL) {
+            /* no cached key, so wolfCrypt has the key from wc_HmacSetKey */
+            ret = CRYPTOCB_UNAVAILABLE;
+            break;
+        }
+        handle = (uint32_t)(((uintptr_t)*devCtx >> 16) & 0xFFFF);
+        ret = _wh_Client_HashCb(ctx, WC_ALGO_TYPE_HMAC, info->hmac.macType,
+            (uint32_t)((uintptr_t)*devCtx & 0xFFFF), &handle, info->hmac.in,
+            info->hmac.inSz, info->hmac.digest);
+        *devCtx = (void*)(((uintptr_t)*devCtx & 0xFFFF) |
+            ((uintptr_t)handle << 16));
+        break;
+#endif /* !NO_HMAC */
+#endif /* !NO_SHA256 || WOLFSSL_SHA384 || WOLFSSL_SHA512 */
+#ifdef WOLFSSL_CMAC
+    case WC_ALGO_TYPE_CMAC:
+        /* devCtx holds the key id from wh_Client_SetKeyCmac in the low 16
+         * bits and the stream handle above them */
+        cmacCtx = (uintptr_t)info->cmac.cmac->devCtx;
+        handle = (uint32_t)((cmacCtx >> 16) & 0xFFFF);
+        if (info->cmac.key != NULL) {
+            /* open the stream with the key, and for the one shot functions
+             * also do the update and final */
+            handle = 0;
+            ret = _wh_Client_CmacCb(ctx, &handle, WOLFHSM_KEYID_ERASED,
+                info->cmac.key, info->cmac.keySz, info->cmac.in,
+                info->cmac.inSz, info->cmac.out, info->cmac.outSz);
+        }
+        else if (info->cmac.in == NULL && info->cmac.out == NULL) {
+            /* wc_InitCmac_ex without a key, set it with wh_Client_SetKeyCmac */
+            ret = 0;
+        }
+        else if (handle == 0 && (cmacCtx & 0xFFFF) == 0) {
+            /* no key set */
+            ret = BAD_FUNC_ARG;
+        }
+        else {
+            ret = _wh_Client_CmacCb(ctx, &handle, (whKeyId)(cmacCtx & 0xFFFF),
+                NULL, 0, info->cmac.in, info->cmac.inSz, info->cmac.out,
+                info->cmac.outSz);
+        }
+        info->cmac.cmac->devCtx = (void*)((cmacCtx & 0xFFFF) |
+            ((uintptr_t)handle << 16));
+        break;
+#endif /* WOLFSSL_CMAC */
+#if defined(WOLF_CRYPTO_CB_COPY) && \
+    (!defined(NO_SHA256) || defined(WOLFSSL_SHA384) || defined(WOLFSSL_SHA512))
+    case WC_ALGO_TYPE_COPY:
+        if (info->copy.algo == WC_ALGO_TYPE_HASH) {
+            ret = _wh_Client_HashCopy(ctx, info->copy.type, info->copy.src,
+                info->copy.dst);
+        }
+        break;
+#endif
+#ifdef WOLF_CRYPTO_CB_FREE
+    case WC_ALGO_TYPE_FREE:
+        _wh_Client_StreamFree(ctx, info->free.algo, info->free.type,
+            info->free.obj);
+        /* wolfCrypt still frees the rest of the struct */
+        ret = CRYPTOCB_UNAVAILABLE;
+        break;
+#endif
     case WC_ALGO_TYPE_NONE:
     default:
         ret = CRYPTOCB_UNAVAILABLE;
@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_client_mux.c
+ *
+ * Multiplexed client.  Each slot's comm uses a transport that forwards its
+ * requests to the shared transport under a new sequence number, and routes
+ * each response received by any slot back to the slot that sent the request.
+ */
+
+/* System libraries */
+#include <stdint.h>
+#include <stdlib.h>  /* For NULL */
+#include <string.h>  /* For memset, memcpy */
+
+/* Common WolfHSM types and defines shared with the server */
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_error.h"
+
+/* Components */
+#include "wolfhsm/wh_comm.h"
+
+#ifndef WOLFHSM_NO_CRYPTO
+#include "wolfhsm/wh_cryptocb.h"
+#include "wolfssl/wolfcrypt/settings.h"
+#include "wolfssl/wolfcrypt/error-crypt.h"
+#include "wolfssl/wolfcrypt/cryptocb.h"
+#endif
+
+#include "wolfhsm/wh_client.h"
+
+static void _wh_ClientMux_Lock(whClientMux* mux)
+{
+    if (mux->lock_cb != NULL) {
+        mux->lock_cb(mux->cb_context);
+    }
+}
+
+static void _wh_ClientMux_Unlock(whClientMux* mux)
+{
+    if (mux->unlock_cb != NULL) {
+        mux->unlock_cb(mux->cb_context);
+    }
+}
+
+static void _wh_ClientMux_Yield(whClientMux* mux)
+{
+    if (mux->yield_cb != NULL) {
+        mux->yield_cb(mux->cb_context);
+    }
+}
+
+/* Receive a response from the shared transport into buffer and find the slot
+ * that sent its request, restoring the slot's own sequence number.  Sets
+ * *out_slot to NULL for a response no slot is waiting for, such as one to a
+ * released slot. Called with the lock held */
+static int _wh_ClientMux_Poll(whClientMux* mux, void* buffer,
+        uint16_t* inout_size, whClientMuxSlot** out_slot)
+{
+    whCommHeader* hdr = (whCommHeader*)buffer;
+    uint16_t seq = 0;
+    int rc = 0;
+    int i;
+
+    *out_slot = NULL;
+    if (mux->inflight == 0) {
+        /* Some transports return their last response again */
+        return WH_ERROR_NOTREADY;
+    }
+    rc = mux->transport_cb->Recv(mux->transport_context, inout_size, buffer);
+    if (rc == 0) {
+        mux->inflight--;
+    }
+    if ((rc == 0) && (*inout_size >= sizeof(*hdr))) {
+        seq = wh_Translate16(hdr->magic, hdr->seq);
+        for (i = 0; i < WH_CLIENT_MUX_SLOT_COUNT; i++) {
+            whClientMuxSlot* s = &mux->slot[i];
+            if ((s->inflight != 0) && (s->ready == 0) &&
+                    (s->wire_seq == seq)) {
+                hdr->seq = s->seq;
+                *out_slot = s;
+                break;
+            }
+        }
+    }
+    return rc;
+}
+
+/* Keep a response that arrived for another slot until it receives */
+static void _wh_ClientMux_Route(whClientMuxSlot* target, const void* buffer,
+        uint16_t size)
+{
+    memcpy(target->rx, buffer, size);
+    target->rx_size = size;
+    target->ready = 1;
+}
+
+static int _wh_ClientMux_SlotInit(void* context, const void* config,
+        whCommSetConnectedCb connectcb, void* connectcb_arg)
+{
+    (void)config;
+    (void)connectcb;
+    (void)connectcb_arg;
+    /* The shared transport is initialized by wh_ClientMux_Init */
+    return (context != NULL) ? 0 : WH_ERROR_BADARGS;
+}
+
+static int _wh_ClientMux_SlotSend(void* context, uint16_t size,
+        const void* data)
+{
+    whClientMuxSlot* slot = (whClientMuxSlot*)context;
+    whClientMux* mux = NULL;
+    whCommHeader* hdr = NULL;
+    whClientMuxSlot* target = NULL;
+    uint16_t seq = 0;
+    uint16_t wire_seq = 0;
+    uint16_t rx_size = 0;
+    int rc = 0;
+
+    if ((slot == NULL) || (data == NULL) || (size < sizeof(*hdr))) {
+        return WH_ERROR_BADARGS;
+    }
+    mux = slot->mux;
+    hdr = slot->client->comm->hdr;
+    if ((const void*)hdr != data) {
+        return WH_ERROR_BADARGS;
+    }
+
+    _wh_ClientMux_Lock(mux);
+    if (slot->inflight != 0) {
+        _wh_ClientMux_Unlock(mux);
+        return WH_ERROR_NOTREADY;
+    }
+
+    seq = hdr->seq;
+    if (++mux->seq == 0) {
+        ++mux->seq;
+    }
+    wire_seq = mux->seq;
+    hdr->seq = wh_Translate16(hdr->magic, wire_seq);
+    do {
+        rc = WH_ERROR_NOTREADY;
+        if (mux->inflight < mux->max_inflight) {
+            rc = mux->transport_cb->Send(mux->transport_context, size, data);
+        }
+        if (rc == WH_ERROR_NOTREADY) {
+            /* Make room by taking a response off the transport. rx is free
+             * as this slot has nothing outstanding */
+            rx_size = sizeof(slot->rx);
+            if ((_wh_ClientMux_Poll(mux, slot->rx, &rx_size, &target) == 0) &&
+                    (target != NULL)) {
+                _wh_ClientMux_Route(target, slot->rx, rx_size);
+            }
+            _wh_ClientMux_Unlock(mux);
+            _wh_ClientMux_Yield(mux);
+            _wh_ClientMux_Lock(mux);
+        }
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        mux->inflight++;
+        slot->wire_seq = wire_seq;
+        slot->seq = seq;
+        slot->inflight = 1;
+    }
+    _wh_ClientMux_Unlock(mux);
+    hdr->seq = seq;
+    return rc;
+}
+
+static int _wh_ClientMux_SlotRecv(void* context, uint16_t* out_size,
+        void* data)
+{
+    whClientMuxSlot* slot = (whClientMuxSlot*)context;
+    whClientMux* mux = NULL;
+    whClientMuxSlot* target = NULL;
+    int rc = 0;
+
+    if ((slot == NULL) || (out_size == NULL) || (data == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+    mux = slot->mux;
+
+    _wh_ClientMux_Lock(mux);
+    if (slot->ready != 0) {
+        /* Received earlier by another slot */
+        memcpy(data, slot->rx, slot->rx_size);
+        *out_size = slot->rx_size;
+        slot->ready = 0;
+        slot->inflight = 0;
+    } else if (slot->inflight == 0) {
+        rc = WH_ERROR_NOTREADY;
+    } else {
+        rc = _wh_ClientMux_Poll(mux, data, out_size, &target);
+        if (rc == 0) {
+            if (target == slot) {
+                slot->inflight = 0;
+            } else {
+                if (target != NULL) {
+                    _wh_ClientMux_Route(target, data, *out_size);
+                }
+                rc = WH_ERROR_NOTREADY;
+            }
+        }
+    }
+    _wh_ClientMux_Unlock(mux);
+    return rc;
+}
+
+static int _wh_ClientMux_SlotCleanup(void* context)
+{
+    /* The shared transport is cleaned up by wh_ClientMux_Cleanup */
+    return (context != NULL) ? 0 : WH_ERROR_BADARGS;
+}
+
+static const whTransportClientCb _whClientMuxSlotCb = {
+    .Init    = _wh_ClientMux_SlotInit,
+    .Send    = _wh_ClientMux_SlotSend,
+    .Recv    = _wh_ClientMux_SlotRecv,
+    .Cleanup = _wh_ClientMux_SlotCleanup,
+};
+
+#ifndef WOLFHSM_NO_CRYPTO
+/* Run each wolfCrypt operation on a free slot */
+static int _wh_ClientMux_CryptoCb(int devId, wc_CryptoInfo* info, void* ctx)
+{
+    whClientMux* mux = (whClientMux*)ctx;
+    whClientContext* client = NULL;
+    int ret = 0;
+
+    if (mux == NULL) {
+        return BAD_FUNC_ARG;
+    }
+    while ((ret = wh_ClientMux_Acquire(mux, &client)) == WH_ERROR_NOTREADY) {
+        _wh_ClientMux_Yield(mux);
+    }
+    if (ret == 0) {
+        ret = wolfHSM_CryptoCb(devId, info, client);
+        (void)wh_ClientMux_Release(mux, client);
+    }
+    return ret;
+}
+#endif /* !WOLFHSM_NO_CRYPTO */
+
+int wh_ClientMux_Init(whClientMux* mux, const whClientMuxConfig* config)
+{
+    whCommClientConfig cc_conf[1];
+    whClientConfig c_conf[1];
+    int rc = 0;
+    int i;
+
+    if ((mux == NULL) || (config == NULL) || (config->comm == NULL) ||
+            (config->comm->transport_cb == NULL) ||
+            (config->comm->transport_cb->Send == NULL) ||
+            (config->comm->transport_cb->Recv == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(mux, 0, sizeof(*mux));
+    mux->transport_cb = config->comm->transport_cb;
+    mux->transport_context = config->comm->transport_context;
+    mux->lock_cb = config->lock_cb;
+    mux->unlock_cb = config->unlock_cb;
+    mux->yield_cb = config->yield_cb;
+    mux->cb_context = config->cb_context;
+    mux->max_inflight = (config->max_inflight > 0) ? config->max_inflight : 1;
+
+    if (mux->transport_cb->Init != NULL) {
+        rc = mux->transport_cb->Init(mux->transport_context,
+                config->comm->transport_config, NULL, NULL);
+    }
+
+    memset(cc_conf, 0, sizeof(cc_conf));
+    cc_conf->transport_cb = &_whClientMuxSlotCb;
+    cc_conf->client_id = config->comm->client_id;
+    c_conf->comm = cc_conf;
+    for (i = 0; (rc == 0) && (i < WH_CLIENT_MUX_SLOT_COUNT); i++) {
+        whClientMuxSlot* slot = &mux->slot[i];
+        /* Report the connection once, through the first slot */
+        cc_conf->connect_cb = (i == 0) ? config->comm->connect_cb : NULL;
+        cc_conf->transport_context = slot;
+        slot->mux = mux;
+        rc = wh_Client_Init(slot->client, c_conf);
+    }
+#ifndef WOLFHSM_NO_CRYPTO
+    if (rc == 0) {
+        /* Replaces the registration made by each slot */
+        rc = wc_CryptoCb_RegisterDevice(WOLFHSM_DEV_ID, _wh_ClientMux_CryptoCb,
+                mux);
+    }
+#endif
+    if (rc != 0) {
+        (void)wh_ClientMux_Cleanup(mux);
+    }
+    return rc;
+}
+
+int wh_ClientMux_Cleanup(whClientMux* mux)
+{
+    int i;
+
+    if (mux == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    for (i = 0; i < WH_CLIENT_MUX_SLOT_COUNT; i++) {
+        if (mux->slot[i].mux != NULL) {
+            (void)wh_Client_Cleanup(mux->slot[i].client);
+        }
+    }
+    if ((mux->transport_cb != NULL) && (mux->transport_cb->Cleanup != NULL)) {
+        (void)mux->transport_cb->Cleanup(mux->transport_context);
+    }
+    memset(mux, 0, sizeof(*mux));
+    return 0;
+}
+
+int wh_ClientMux_Acquire(whClientMux* mux, whClientContext** out_client)
+{
+    int rc = WH_ERROR_NOTREADY;
+    int i;
+
+    if ((mux == NULL) || (out_client == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    _wh_ClientMux_Lock(mux);
+    for (i = 0; i < WH_CLIENT_MUX_SLOT_COUNT; i++) {
+        if (mux->slot[i].busy == 0) {
+            mux->slot[i].busy = 1;
+            *out_client = mux->slot[i].client;
+            rc = 0;
+            break;
+        }
+    }
+    _wh_ClientMux_Unlock(mux);
+    return rc;
+}
+
+int wh_ClientMux_Release(whClientMux* mux, whClientContext* client)
+{
+    whClientMuxSlot* slot = NULL;
+    int rc = 0;
+    int i;
+
+    if ((mux == NULL) || (client == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+    for (i = 0; i < WH_CLIENT_MUX_SLOT_COUNT; i++) {
+        if (mux->slot[i].client == client) {
+            slot = &mux->slot[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    _wh_ClientMux_Lock(mux);
+    /* Check busy under the lock so two releases cannot both free the slot */
+    if (slot->busy == 0) {
+        rc = WH_ERROR_BADARGS;
+    }
+    else {
+        /* Forget any outstanding request. Its response no longer matches */
+        slot->inflight = 0;
+        slot->ready = 0;
+        client->pending_head = 0;
+        client->pending_count = 0;
+        slot->busy = 0;
+    }
+    _wh_ClientMux_Unlock(mux);
+    return rc;
+}
@@ -34,6 +34,69 @@
 
 #include "wolfhsm/wh_client.h"
 
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+void wh_Client_NvmCacheFlush(whClientContext* c)
+{
+    int i = 0;
+
+    if (c == NULL) {
+        return;
+    }
+    for (i = 0; i < WH_CLIENT_NVM_CACHE_COUNT; i++) {
+        c->nvm_meta[i].id = WH_NVM_INVALID_ID;
+    }
+}
+
+/* Drop the cache once a response shows the server NVM changed */
+static void _wh_Client_NvmSeen(whClientContext* c, uint32_t generation)
+{
+    if (generation != c->nvm_generation) {
+        wh_Client_NvmCacheFlush(c);
+        c->nvm_generation = generation;
+    }
+}
+
+static whClientNvmMeta* _wh_Client_NvmCacheFind(whClientContext* c,
+        whNvmId id)
+{
+    int i = 0;
+
+    for (i = 0; i < WH_CLIENT_NVM_CACHE_COUNT; i++) {
+        if (c->nvm_meta[i].id == id) {
+            return &c->nvm_meta[i];
+        }
+    }
+    return NULL;
+}
+
+static void _wh_Client_NvmCacheAdd(whClientContext* c, whNvmId id,
+        int32_t server_rc, const whNvmMetadata* meta)
+{
+    whClientNvmMeta* e = NULL;
+
+    if (id == WH_NVM_INVALID_ID) {
+        return;
+    }
+    e = _wh_Client_NvmCacheFind(c, id);
+    if (e == NULL) {
+        e = _wh_Client_NvmCacheFind(c, WH_NVM_INVALID_ID);
+    }
+    if (e == NULL) {
+        e = &c->nvm_meta[c->nvm_meta_next];
+        c->nvm_meta_next = (c->nvm_meta_next + 1) % WH_CLIENT_NVM_CACHE_COUNT;
+    }
+    e->rc = server_rc;
+    e->id = id;
+    memcpy(&e->meta, meta, sizeof(e->meta));
+}
+
+/* Sending a change makes the cache stale before its response arrives */
+#define _wh_Client_NvmChanged(_c) wh_Client_NvmCacheFlush(_c)
+#else
+#define _wh_Client_NvmSeen(_c, _generation) do { } while (0)
+#define _wh_Client_NvmChanged(_c) do { } while (0)
+#endif /* WH_CLIENT_NVM_CACHE_COUNT > 0 */
+
 /** NVM Init */
 int wh_Client_NvmInitRequest(whClientContext* c)
 {
@@ -147,6 +210,7 @@ int wh_Client_NvmCleanupResponse(whClientContext* c, int32_t *out_rc)
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -288,6 +352,7 @@ int wh_Client_NvmAddObjectRequest(whClientContext* c,
         memcpy(payload, data, len);
     }
 
+    _wh_Client_NvmChanged(c);
     return wh_Client_SendRequest(c,
             WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_ADDOBJECT,
             hdr_len + len, buffer);
@@ -317,6 +382,7 @@ int wh_Client_NvmAddObjectResponse(whClientContext* c, int32_t *out_rc)
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -350,6 +416,221 @@ int wh_Client_NvmAddObject(whClientContext* c,
     return rc;
 }
 
+/** NVM AddObject streaming */
+static int _wh_Client_NvmStreamResponse(whClientContext* c, uint16_t action,
+        int32_t *out_rc)
+{
+    whMessageNvm_SimpleResponse msg = {0};
+    int rc = 0;
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+
+    if (c == NULL){
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_RecvResponse(c,
+            &resp_group, &resp_action,
+            &resp_size, &msg);
+    if (rc == 0) {
+        /* Validate response */
+        if (    (resp_group != WH_MESSAGE_GROUP_NVM) ||
+                (resp_action != action) ||
+                (resp_size != sizeof(msg)) ){
+            /* Invalid message */
+            rc = WH_ERROR_ABORTED;
+        } else {
+            /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
+            if (out_rc != NULL) {
+                *out_rc = msg.rc;
+            }
+        }
+    }
+    return rc;
+}
+
+int wh_Client_NvmAddObjectBeginRequest(whClientContext* c,
+        whNvmId id, whNvmAccess access, whNvmFlags flags,
+        whNvmSize label_len, uint8_t* label,
+        whNvmSize len)
+{
+    whMessageNvm_AddObjectRequest msg = {0};
+
+    if (    (c == NULL) ||
+            ((label == NULL) && (label_len > 0)) ||
+            (label_len > WOLFHSM_NVM_LABEL_LEN) ){
+        return WH_ERROR_BADARGS;
+    }
+
+    msg.id = id;
+    msg.access = access;
+    msg.flags = flags;
+    msg.len = len;
+    if(label_len > 0) {
+        memcpy(msg.label, label, label_len);
+    }
+
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_ADDOBJECTBEGIN,
+            sizeof(msg), &msg);
+}
+
+int wh_Client_NvmAddObjectBeginResponse(whClientContext* c, int32_t *out_rc)
+{
+    return _wh_Client_NvmStreamResponse(c,
+            WH_MESSAGE_NVM_ACTION_ADDOBJECTBEGIN, out_rc);
+}
+
+int wh_Client_NvmAddObjectBegin(whClientContext* c,
+        whNvmId id, whNvmAccess access, whNvmFlags flags,
+        whNvmSize label_len, uint8_t* label,
+        whNvmSize len, int32_t *out_rc)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_NvmAddObjectBeginRequest(c,
+                id, access, flags,
+                label_len, label,
+                len);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_NvmAddObjectBeginResponse(c, out_rc);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+int wh_Client_NvmAddObjectAppendRequest(whClientContext* c,
+        whNvmSize len, const uint8_t* data)
+{
+    uint8_t buffer[WH_COMM_DATA_LEN] = {0};
+    whMessageNvm_AddObjectAppendRequest* msg =
+            (whMessageNvm_AddObjectAppendRequest*)buffer;
+    uint16_t hdr_len = sizeof(*msg);
+    uint8_t* payload = (uint8_t*)buffer + hdr_len;
+
+    if (    (c == NULL) ||
+            ((data == NULL) && (len > 0)) ||
+            (len > WH_MESSAGE_NVM_MAX_APPEND_LEN) ){
+        return WH_ERROR_BADARGS;
+    }
+
+    msg->data_len = len;
+    if(len > 0) {
+        memcpy(payload, data, len);
+    }
+
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_ADDOBJECTAPPEND,
+            hdr_len + len, buffer);
+}
+
+int wh_Client_NvmAddObjectAppendResponse(whClientContext* c, int32_t *out_rc)
+{
+    return _wh_Client_NvmStreamResponse(c,
+            WH_MESSAGE_NVM_ACTION_ADDOBJECTAPPEND, out_rc);
+}
+
+int wh_Client_NvmAddObjectAppend(whClientContext* c,
+        whNvmSize len, const uint8_t* data, int32_t *out_rc)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_NvmAddObjectAppendRequest(c, len, data);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_NvmAddObjectAppendResponse(c, out_rc);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+int wh_Client_NvmAddObjectCommitRequest(whClientContext* c)
+{
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    _wh_Client_NvmChanged(c);
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_ADDOBJECTCOMMIT,
+            0, NULL);
+}
+
+int wh_Client_NvmAddObjectCommitResponse(whClientContext* c, int32_t *out_rc)
+{
+    return _wh_Client_NvmStreamResponse(c,
+            WH_MESSAGE_NVM_ACTION_ADDOBJECTCOMMIT, out_rc);
+}
+
+int wh_Client_NvmAddObjectCommit(whClientContext* c, int32_t *out_rc)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_NvmAddObjectCommitRequest(c);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_NvmAddObjectCommitResponse(c, out_rc);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+int wh_Client_NvmAddObjectStream(whClientContext* c,
+        whNvmId id, whNvmAccess access, whNvmFlags flags,
+        whNvmSize label_len, uint8_t* label,
+        whNvmSize len, const uint8_t* data, int32_t *out_rc)
+{
+    int32_t server_rc = 0;
+    whNvmSize offset = 0;
+    whNvmSize chunk = 0;
+    int rc = 0;
+
+    if (    (c == NULL) ||
+            ((data == NULL) && (len > 0)) ){
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_NvmAddObjectBegin(c, id, access, flags,
+            label_len, label, len, &server_rc);
+    while ((rc == 0) && (server_rc == 0) && (offset < len)) {
+        chunk = len - offset;
+        if (chunk > WH_MESSAGE_NVM_MAX_APPEND_LEN) {
+            chunk = WH_MESSAGE_NVM_MAX_APPEND_LEN;
+        }
+        rc = wh_Client_NvmAddObjectAppend(c, chunk, data + offset,
+                &server_rc);
+        offset += chunk;
+    }
+    if ((rc == 0) && (server_rc == 0)) {
+        rc = wh_Client_NvmAddObjectCommit(c, &server_rc);
+    }
+    if ((rc == 0) && (out_rc != NULL)) {
+        *out_rc = server_rc;
+    }
+    return rc;
+}
+
 /** NVM List */
 int wh_Client_NvmListRequest(whClientContext* c,
         whNvmAccess access, whNvmFlags flags, whNvmId start_id)
@@ -394,6 +675,7 @@ int wh_Client_NvmListResponse(whClientContext* c, int32_t *out_rc,
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -473,6 +755,7 @@ int wh_Client_NvmGetMetadataResponse(whClientContext* c, int32_t *out_rc,
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -505,10 +788,62 @@ int wh_Client_NvmGetMetadata(whClientContext* c, whNvmId id,
         whNvmSize label_len, uint8_t* label)
 {
     int rc = 0;
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+    whClientNvmMeta* e = NULL;
+    whClientNvmMeta fetched = {0};
+#endif
 
     if (c == NULL) {
         return WH_ERROR_BADARGS;
     }
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+    if (id == WH_NVM_INVALID_ID) {
+        /* Not cacheable, so let the server answer */
+        e = &fetched;
+    } else {
+        e = _wh_Client_NvmCacheFind(c, id);
+    }
+    if (e == NULL) {
+        e = &fetched;
+        do {
+            rc = wh_Client_NvmGetMetadataRequest(c, id);
+        } while (rc == WH_ERROR_NOTREADY);
+        if (rc == 0) {
+            do {
+                rc = wh_Client_NvmGetMetadataResponse(c, &e->rc,
+                        &e->meta.id, &e->meta.access, &e->meta.flags,
+                        &e->meta.len, sizeof(e->meta.label), e->meta.label);
+            } while (rc == WH_ERROR_NOTREADY);
+        }
+        /* Not NOTFOUND, which another client's add would leave stale */
+        if ((rc == 0) && (e->rc == WH_ERROR_OK)) {
+            _wh_Client_NvmCacheAdd(c, id, e->rc, &e->meta);
+        }
+    }
+    if (rc == 0) {
+        if (out_rc != NULL) {
+            *out_rc = e->rc;
+        }
+        if (out_id != NULL) {
+            *out_id = e->meta.id;
+        }
+        if (out_access != NULL) {
+            *out_access = e->meta.access;
+        }
+        if (out_flags != NULL) {
+            *out_flags = e->meta.flags;
+        }
+        if (out_len != NULL) {
+            *out_len = e->meta.len;
+        }
+        if (label != NULL) {
+            if (label_len > sizeof(e->meta.label)) {
+                label_len = sizeof(e->meta.label);
+            }
+            memcpy(label, e->meta.label, label_len);
+        }
+    }
+#else
     do {
         rc = wh_Client_NvmGetMetadataRequest(c, id);
     } while (rc == WH_ERROR_NOTREADY);
@@ -519,6 +854,116 @@ int wh_Client_NvmGetMetadata(whClientContext* c, whNvmId id,
                     label_len, label);
         } while (rc == WH_ERROR_NOTREADY);
     }
+#endif /* WH_CLIENT_NVM_CACHE_COUNT > 0 */
+    return rc;
+}
+
+/** NVM ListMetadata */
+int wh_Client_NvmListMetadataRequest(whClientContext* c,
+        whNvmAccess access, whNvmFlags flags, whNvmId start_id,
+        whNvmId max_count)
+{
+    whMessageNvm_ListMetadataRequest msg = {0};
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    msg.access = access;
+    msg.flags = flags;
+    msg.startId = start_id;
+    msg.max_count = max_count;
+
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_LISTMETADATA,
+            sizeof(msg), &msg);
+}
+
+int wh_Client_NvmListMetadataResponse(whClientContext* c, int32_t *out_rc,
+        whNvmId *out_count, whNvmId max_count, whNvmId *out_returned,
+        whNvmMetadata* out_meta)
+{
+    uint8_t buffer[WH_COMM_DATA_LEN] = {0};
+    whMessageNvm_ListMetadataResponse msg = {0};
+    const whMessageNvm_ListMetadataEntry* entries =
+            (const whMessageNvm_ListMetadataEntry*)(buffer + sizeof(msg));
+    int rc = 0;
+    int i = 0;
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+
+    if (    (c == NULL) ||
+            ((max_count > 0) && (out_meta == NULL)) ){
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_RecvResponse(c,
+            &resp_group, &resp_action,
+            &resp_size, buffer);
+    if (rc == 0) {
+        if (resp_size >= sizeof(msg)) {
+            memcpy(&msg, buffer, sizeof(msg));
+        }
+        /* Validate response */
+        if (    (resp_group != WH_MESSAGE_GROUP_NVM) ||
+                (resp_action != WH_MESSAGE_NVM_ACTION_LISTMETADATA) ||
+                (resp_size < sizeof(msg)) ||
+                (resp_size != sizeof(msg) + msg.returned * sizeof(*entries)) ){
+            /* Invalid message */
+            rc = WH_ERROR_ABORTED;
+        } else {
+            /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
+            if (msg.returned > max_count) {
+                msg.returned = max_count;
+            }
+            for (i = 0; i < msg.returned; i++) {
+                out_meta[i].id = entries[i].id;
+                out_meta[i].access = entries[i].access;
+                out_meta[i].flags = entries[i].flags;
+                out_meta[i].len = entries[i].len;
+                memcpy(out_meta[i].label, entries[i].label,
+                        sizeof(out_meta[i].label));
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+                _wh_Client_NvmCacheAdd(c, out_meta[i].id, WH_ERROR_OK,
+                        &out_meta[i]);
+#endif
+            }
+            if (out_rc != NULL) {
+                *out_rc = msg.rc;
+            }
+            if (out_count != NULL) {
+                *out_count = msg.count;
+            }
+            if (out_returned != NULL) {
+                *out_returned = msg.returned;
+            }
+        }
+    }
+    return rc;
+}
+
+int wh_Client_NvmListMetadata(whClientContext* c,
+        whNvmAccess access, whNvmFlags flags, whNvmId start_id,
+        whNvmId max_count, int32_t *out_rc, whNvmId *out_count,
+        whNvmId *out_returned, whNvmMetadata* out_meta)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    do {
+        rc = wh_Client_NvmListMetadataRequest(c, access, flags, start_id,
+                max_count);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_NvmListMetadataResponse(c, out_rc, out_count,
+                    max_count, out_returned, out_meta);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
     return rc;
 }
 
@@ -540,6 +985,7 @@ int wh_Client_NvmDestroyObjectsRequest(whClientContext* c,
         msg.list[counter] = id_list[counter];
     }
 
+    _wh_Client_NvmChanged(c);
     return wh_Client_SendRequest(c,
             WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_DESTROYOBJECTS,
             sizeof(msg), &msg);
@@ -569,6 +1015,7 @@ int wh_Client_NvmDestroyObjectsResponse(whClientContext* c, int32_t *out_rc)
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -620,7 +1067,7 @@ int wh_Client_NvmReadRequest(whClientContext* c,
 int wh_Client_NvmReadResponse(whClientContext* c, int32_t *out_rc,
         whNvmSize *out_len, uint8_t* data)
 {
-    uint8_t buffer[WH_MESSAGE_NVM_MAX_READ_LEN] = {0};
+    uint8_t buffer[WH_COMM_DATA_LEN] = {0};
     whMessageNvm_ReadResponse* msg = (whMessageNvm_ReadResponse*)buffer;
     uint16_t hdr_len = sizeof(*msg);
     uint8_t* payload = buffer + hdr_len;
@@ -697,6 +1144,7 @@ int wh_Client_NvmAddObjectDma32Request(whClientContext* c,
     msg.data_hostaddr = data_hostaddr;
     msg.data_len = data_len;
 
+    _wh_Client_NvmChanged(c);
     return wh_Client_SendRequest(c,
             WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_ADDOBJECTDMA32,
             sizeof(msg), &msg);
@@ -726,6 +1174,7 @@ int wh_Client_NvmAddObjectDma32Response(whClientContext* c, int32_t *out_rc)
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -771,6 +1220,7 @@ int wh_Client_NvmAddObjectDma64Request(whClientContext* c,
     msg.data_hostaddr = data_hostaddr;
     msg.data_len = data_len;
 
+    _wh_Client_NvmChanged(c);
     return wh_Client_SendRequest(c,
             WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_ADDOBJECTDMA64,
             sizeof(msg), &msg);
@@ -800,6 +1250,7 @@ int wh_Client_NvmAddObjectDma64Response(whClientContext* c, int32_t *out_rc)
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -918,6 +1369,7 @@ int wh_Client_NvmReadDma32Response(whClientContext* c, int32_t *out_rc)
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -991,6 +1443,7 @@ int wh_Client_NvmReadDma64Response(whClientContext* c, int32_t *out_rc)
             rc = WH_ERROR_ABORTED;
         } else {
             /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
             if (out_rc != NULL) {
                 *out_rc = msg.rc;
             }
@@ -1064,3 +1517,165 @@ int wh_Client_NvmReadDma(whClientContext* c,
     return WH_ERROR_BADARGS;
 }
 
+
+/** NVM AddObjectDmaSg */
+int wh_Client_NvmAddObjectDmaSgRequest(whClientContext* c,
+        whNvmMetadata* metadata, uint16_t seg_count, const whDmaSegment* segs)
+{
+    whMessageNvm_AddObjectDmaSgRequest msg = {0};
+
+    if (    (c == NULL) ||
+            (metadata == NULL) ||
+            (seg_count > WH_DMA_MAX_SEGMENTS) ||
+            ((seg_count > 0) && (segs == NULL)) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    msg.metadata_hostaddr = (uint64_t)((uintptr_t)metadata);
+    msg.seg_count = seg_count;
+    msg.addr64 = (sizeof(uintptr_t) == sizeof(uint64_t));
+    if (seg_count > 0) {
+        memcpy(msg.segs, segs, seg_count * sizeof(*segs));
+    }
+
+    _wh_Client_NvmChanged(c);
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_ADDOBJECTDMASG,
+            sizeof(msg), &msg);
+}
+
+int wh_Client_NvmAddObjectDmaSgResponse(whClientContext* c, int32_t *out_rc)
+{
+    whMessageNvm_SimpleResponse msg = {0};
+    int rc = 0;
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+
+    if (c == NULL){
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_RecvResponse(c,
+            &resp_group, &resp_action,
+            &resp_size, &msg);
+    if (rc == 0) {
+        /* Validate response */
+        if (    (resp_group != WH_MESSAGE_GROUP_NVM) ||
+                (resp_action != WH_MESSAGE_NVM_ACTION_ADDOBJECTDMASG) ||
+                (resp_size != sizeof(msg)) ){
+            /* Invalid message */
+            rc = WH_ERROR_ABORTED;
+        } else {
+            /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
+            if (out_rc != NULL) {
+                *out_rc = msg.rc;
+            }
+        }
+    }
+    return rc;
+}
+
+int wh_Client_NvmAddObjectDmaSg(whClientContext* c,
+        whNvmMetadata* metadata, uint16_t seg_count, const whDmaSegment* segs,
+        int32_t *out_rc)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_NvmAddObjectDmaSgRequest(c,
+                metadata, seg_count, segs);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_NvmAddObjectDmaSgResponse(c, out_rc);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+/** NVM ReadDmaSg */
+int wh_Client_NvmReadDmaSgRequest(whClientContext* c,
+        whNvmId id, whNvmSize offset, uint16_t seg_count,
+        const whDmaSegment* segs)
+{
+    whMessageNvm_ReadDmaSgRequest msg = {0};
+
+    if (    (c == NULL) ||
+            (seg_count > WH_DMA_MAX_SEGMENTS) ||
+            ((seg_count > 0) && (segs == NULL)) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    msg.id = id;
+    msg.offset = offset;
+    msg.seg_count = seg_count;
+    msg.addr64 = (sizeof(uintptr_t) == sizeof(uint64_t));
+    if (seg_count > 0) {
+        memcpy(msg.segs, segs, seg_count * sizeof(*segs));
+    }
+
+    return wh_Client_SendRequest(c,
+            WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_READDMASG,
+            sizeof(msg), &msg);
+}
+
+int wh_Client_NvmReadDmaSgResponse(whClientContext* c, int32_t *out_rc)
+{
+    whMessageNvm_SimpleResponse msg = {0};
+    int rc = 0;
+    uint16_t resp_group = 0;
+    uint16_t resp_action = 0;
+    uint16_t resp_size = 0;
+
+    if (c == NULL){
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = wh_Client_RecvResponse(c,
+            &resp_group, &resp_action,
+            &resp_size, &msg);
+    if (rc == 0) {
+        /* Validate response */
+        if (    (resp_group != WH_MESSAGE_GROUP_NVM) ||
+                (resp_action != WH_MESSAGE_NVM_ACTION_READDMASG) ||
+                (resp_size != sizeof(msg)) ){
+            /* Invalid message */
+            rc = WH_ERROR_ABORTED;
+        } else {
+            /* Valid message */
+            _wh_Client_NvmSeen(c, msg.generation);
+            if (out_rc != NULL) {
+                *out_rc = msg.rc;
+            }
+        }
+    }
+    return rc;
+}
+
+int wh_Client_NvmReadDmaSg(whClientContext* c,
+        whNvmId id, whNvmSize offset, uint16_t seg_count,
+        const whDmaSegment* segs, int32_t *out_rc)
+{
+    int rc = 0;
+
+    if (c == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    do {
+        rc = wh_Client_NvmReadDmaSgRequest(c,
+                id, offset, seg_count, segs);
+    } while (rc == WH_ERROR_NOTREADY);
+    if (rc == 0) {
+        do {
+            rc = wh_Client_NvmReadDmaSgResponse(c, out_rc);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
@@ -129,10 +129,12 @@ int wh_Client_SheSecureBoot(whClientContext* c, uint8_t* bootloader,
     while (ret == 0 && bootloaderSent < bootloaderLen) {
         if (packet->rc != WOLFHSM_SHE_ERC_NO_ERROR)
             return packet->rc;
-        /* send what's left in the size available */
-        packet->sheSecureBootUpdateReq.sz = ((bootloaderLen - bootloaderSent)
-            % (WH_COMM_DATA_LEN - sizeof(packet->sheSecureBootUpdateReq)));
-        justSent = packet->sheSecureBootUpdateReq.sz;
+        /* send what's left in the negotiated size available */
+        justSent = c->comm->max_data_len - WOLFHSM_PACKET_STUB_SIZE -
+            sizeof(packet->sheSecureBootUpdateReq);
+        if (justSent > bootloaderLen - bootloaderSent)
+            justSent = bootloaderLen - bootloaderSent;
+        packet->sheSecureBootUpdateReq.sz = justSent;
         memcpy(in, bootloader + bootloaderSent,
             packet->sheSecureBootUpdateReq.sz);
         ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_SHE,
@@ -167,6 +169,63 @@ int wh_Client_SheSecureBoot(whClientContext* c, uint8_t* bootloader,
     return ret;
 }
 
+int wh_Client_SheSecureBootDma(whClientContext* c, uint8_t* bootloader,
+    uint32_t bootloaderLen)
+{
+    int ret;
+    uint16_t group;
+    uint16_t action;
+    uint16_t dataSz;
+    whPacket* packet;
+    if (c == NULL || bootloader == NULL || bootloaderLen == 0)
+        return WH_ERROR_BADARGS;
+    packet = (whPacket*)wh_CommClient_GetDataPtr(c->comm);
+    /* send init sub command */
+    packet->sheSecureBootInitReq.sz = bootloaderLen;
+    ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_SHE,
+        WH_SHE_SECURE_BOOT_INIT, WOLFHSM_PACKET_STUB_SIZE +
+        sizeof(packet->sheSecureBootInitReq), (uint8_t*)packet);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &action, &dataSz,
+                (uint8_t*)packet);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0 && packet->rc != WOLFHSM_SHE_ERC_NO_ERROR)
+        return packet->rc;
+    /* have the server cmac the whole bootloader in place */
+    if (ret == 0) {
+        packet->sheSecureBootDmaReq.addr = (uint64_t)(uintptr_t)bootloader;
+        packet->sheSecureBootDmaReq.sz = bootloaderLen;
+        ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_SHE,
+            WH_SHE_SECURE_BOOT_DMA, WOLFHSM_PACKET_STUB_SIZE +
+            sizeof(packet->sheSecureBootDmaReq), (uint8_t*)packet);
+    }
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &action, &dataSz,
+                (uint8_t*)packet);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0 && packet->rc != WOLFHSM_SHE_ERC_NO_ERROR)
+        return packet->rc;
+    /* send finish sub command */
+    if (ret == 0) {
+        ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_SHE,
+            WH_SHE_SECURE_BOOT_FINISH, WOLFHSM_PACKET_STUB_SIZE,
+            (uint8_t*)packet);
+    }
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &action, &dataSz,
+                (uint8_t*)packet);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0)
+        ret = packet->rc;
+    return ret;
+}
+
 int wh_Client_SheGetStatusRequest(whClientContext* c)
 {
     int ret;
@@ -277,6 +336,77 @@ int wh_Client_SheLoadKey(whClientContext* c, uint8_t* messageOne,
     return ret;
 }
 
+int wh_Client_SheLoadKeyBatch(whClientContext* c, uint32_t count,
+    uint8_t* messageOne, uint8_t* messageTwo, uint8_t* messageThree,
+    uint8_t* messageFour, uint8_t* messageFive, uint32_t* loaded)
+{
+    int ret = 0;
+    uint32_t i;
+    uint32_t max;
+    uint32_t sent;
+    uint32_t done = 0;
+    uint16_t group;
+    uint16_t action;
+    uint16_t dataSz;
+    wh_Packet_she_load_key_req* in;
+    wh_Packet_she_load_key_res* out;
+    whPacket* packet;
+    if (c == NULL || messageOne == NULL || messageTwo == NULL ||
+        messageThree == NULL || messageFour == NULL || messageFive == NULL)
+        return WH_ERROR_BADARGS;
+    packet = (whPacket*)wh_CommClient_GetDataPtr(c->comm);
+    /* tuples and results are after the fixed sized fields */
+    in = (wh_Packet_she_load_key_req*)(&packet->sheLoadKeyBatchReq + 1);
+    out = (wh_Packet_she_load_key_res*)(&packet->sheLoadKeyBatchRes + 1);
+    max = (c->comm->max_data_len - WOLFHSM_PACKET_STUB_SIZE -
+        sizeof(packet->sheLoadKeyBatchReq)) / sizeof(*in);
+    if (max == 0)
+        return WH_ERROR_ABORTED;
+    while (ret == 0 && done < count) {
+        sent = count - done;
+        if (sent > max)
+            sent = max;
+        packet->sheLoadKeyBatchReq.count = sent;
+        for (i = 0; i < sent; i++) {
+            memcpy(in[i].messageOne, messageOne + (done + i) * WOLFHSM_SHE_M1_SZ,
+                WOLFHSM_SHE_M1_SZ);
+            memcpy(in[i].messageTwo, messageTwo + (done + i) * WOLFHSM_SHE_M2_SZ,
+                WOLFHSM_SHE_M2_SZ);
+            memcpy(in[i].messageThree,
+                messageThree + (done + i) * WOLFHSM_SHE_M3_SZ,
+                WOLFHSM_SHE_M3_SZ);
+        }
+        ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_SHE,
+            WH_SHE_LOAD_KEY_BATCH, WOLFHSM_PACKET_STUB_SIZE +
+            sizeof(packet->sheLoadKeyBatchReq) + sent * sizeof(*in),
+            (uint8_t*)packet);
+        if (ret == 0) {
+            do {
+                ret = wh_Client_RecvResponse(c, &group, &action, &dataSz,
+                    (uint8_t*)packet);
+            } while (ret == WH_ERROR_NOTREADY);
+        }
+        if (ret == 0 && packet->rc != WOLFHSM_SHE_ERC_NO_ERROR)
+            ret = packet->rc;
+        if (ret == 0 && packet->sheLoadKeyBatchRes.count > sent)
+            ret = WH_ERROR_ABORTED;
+        if (ret == 0) {
+            /* copy out messages 4 and 5 of the loaded keys */
+            for (i = 0; i < packet->sheLoadKeyBatchRes.count; i++) {
+                memcpy(messageFour + (done + i) * WOLFHSM_SHE_M4_SZ,
+                    out[i].messageFour, WOLFHSM_SHE_M4_SZ);
+                memcpy(messageFive + (done + i) * WOLFHSM_SHE_M5_SZ,
+                    out[i].messageFive, WOLFHSM_SHE_M5_SZ);
+            }
+            done += packet->sheLoadKeyBatchRes.count;
+            ret = packet->sheLoadKeyBatchRes.status;
+        }
+    }
+    if (loaded != NULL)
+        *loaded = done;
+    return ret;
+}
+
 int wh_Client_SheLoadPlainKeyRequest(whClientContext* c, uint8_t* key,
     uint32_t keySz)
 {
@@ -765,6 +895,74 @@ int wh_Client_SheDecCbc(whClientContext* c, uint8_t keyId, uint8_t* iv,
     return ret;
 }
 
+static int _SheCipherDma(whClientContext* c, uint16_t action, uint8_t keyId,
+    uint8_t* iv, uint8_t* in, uint8_t* out, uint32_t sz)
+{
+    int ret;
+    uint16_t group;
+    uint16_t respAction;
+    uint16_t dataSz;
+    whPacket* packet;
+    if (c == NULL || in == NULL || out == NULL || sz == 0 ||
+        (sz % WOLFHSM_SHE_KEY_SZ) != 0)
+        return WH_ERROR_BADARGS;
+    packet = (whPacket*)wh_CommClient_GetDataPtr(c->comm);
+    packet->sheCipherDmaReq.inAddr = (uint64_t)(uintptr_t)in;
+    packet->sheCipherDmaReq.outAddr = (uint64_t)(uintptr_t)out;
+    packet->sheCipherDmaReq.sz = sz;
+    packet->sheCipherDmaReq.keyId = keyId;
+    if (iv != NULL)
+        memcpy(packet->sheCipherDmaReq.iv, iv, WOLFHSM_SHE_KEY_SZ);
+    else
+        memset(packet->sheCipherDmaReq.iv, 0, WOLFHSM_SHE_KEY_SZ);
+    ret = wh_Client_SendRequest(c, WH_MESSAGE_GROUP_SHE, action,
+        WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->sheCipherDmaReq),
+        (uint8_t*)packet);
+    if (ret == 0) {
+        do {
+            ret = wh_Client_RecvResponse(c, &group, &respAction, &dataSz,
+                (uint8_t*)packet);
+        } while (ret == WH_ERROR_NOTREADY);
+    }
+    if (ret == 0) {
+        if (packet->rc != WOLFHSM_SHE_ERC_NO_ERROR)
+            ret = packet->rc;
+        else if (packet->sheCipherDmaRes.sz != sz)
+            ret = WH_ERROR_ABORTED;
+        else if (iv != NULL)
+            memcpy(iv, packet->sheCipherDmaRes.iv, WOLFHSM_SHE_KEY_SZ);
+    }
+    return ret;
+}
+
+int wh_Client_SheEncEcbDma(whClientContext* c, uint8_t keyId, uint8_t* in,
+    uint8_t* out, uint32_t sz)
+{
+    return _SheCipherDma(c, WH_SHE_ENC_ECB_DMA, keyId, NULL, in, out, sz);
+}
+
+int wh_Client_SheEncCbcDma(whClientContext* c, uint8_t keyId, uint8_t* iv,
+    uint32_t ivSz, uint8_t* in, uint8_t* out, uint32_t sz)
+{
+    if (iv == NULL || ivSz < WOLFHSM_SHE_KEY_SZ)
+        return WH_ERROR_BADARGS;
+    return _SheCipherDma(c, WH_SHE_ENC_CBC_DMA, keyId, iv, in, out, sz);
+}
+
+int wh_Client_SheDecEcbDma(whClientContext* c, uint8_t keyId, uint8_t* in,
+    uint8_t* out, uint32_t sz)
+{
+    return _SheCipherDma(c, WH_SHE_DEC_ECB_DMA, keyId, NULL, in, out, sz);
+}
+
+int wh_Client_SheDecCbcDma(whClientContext* c, uint8_t keyId, uint8_t* iv,
+    uint32_t ivSz, uint8_t* in, uint8_t* out, uint32_t sz)
+{
+    if (iv == NULL || ivSz < WOLFHSM_SHE_KEY_SZ)
+        return WH_ERROR_BADARGS;
+    return _SheCipherDma(c, WH_SHE_DEC_CBC_DMA, keyId, iv, in, out, sz);
+}
+
 int wh_Client_SheGenerateMacRequest(whClientContext* c, uint8_t keyId,
     uint8_t* in, uint32_t sz)
 {
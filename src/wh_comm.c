@@ -27,6 +27,8 @@
 
 #include "wolfhsm/wh_error.h"
 #include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_trace.h"
+#include "wolfhsm/wh_capture.h"
 
 /** Utility functions */
 uint8_t wh_Translate8(uint16_t magic, uint8_t val)
@@ -46,7 +48,7 @@ uint32_t wh_Translate32(uint16_t magic, uint32_t val)
     return WH_COMM_FLAGS_SWAPTEST(magic) ? val :
             ((val & 0xFF000000ul) >> 24) |
             ((val & 0xFF0000ul) >> 8) |
-            ((val & 0xFF00ul) >> 8) |
+            ((val & 0xFF00ul) << 8) |
             ((val & 0xFFul) << 24);
 }
 
@@ -63,6 +65,67 @@ uint64_t wh_Translate64(uint16_t magic, uint64_t val)
             ((val & 0xFFull) << 56);
 }
 
+void wh_CommSwapFields(uint16_t magic, const whCommField* fields, void* msg,
+        uint16_t size)
+{
+    uint8_t* p = NULL;
+    uint16_t i = 0;
+    uint16_t v16 = 0;
+    uint32_t v32 = 0;
+    uint64_t v64 = 0;
+
+    if (    (WH_COMM_FLAGS_SWAPTEST(magic)) ||
+            (fields == NULL) ||
+            (msg == NULL) ) {
+        return;
+    }
+
+    for (; fields->size != 0; fields++) {
+        for (i = 0; i < fields->count; i++) {
+            if (fields->offset + (uint32_t)i * fields->stride + fields->size >
+                    size) {
+                break;
+            }
+            p = (uint8_t*)msg + fields->offset + i * fields->stride;
+            /* Fields of packed messages may be unaligned */
+            switch (fields->size) {
+            case sizeof(v16):
+                memcpy(&v16, p, sizeof(v16));
+                v16 = wh_Translate16(magic, v16);
+                memcpy(p, &v16, sizeof(v16));
+                break;
+            case sizeof(v32):
+                memcpy(&v32, p, sizeof(v32));
+                v32 = wh_Translate32(magic, v32);
+                memcpy(p, &v32, sizeof(v32));
+                break;
+            case sizeof(v64):
+                memcpy(&v64, p, sizeof(v64));
+                v64 = wh_Translate64(magic, v64);
+                memcpy(p, &v64, sizeof(v64));
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+int wh_CommTranslate(uint16_t magic, const whCommField* fields,
+        uint16_t size, const void* src, void* dest)
+{
+    if (    (fields == NULL) ||
+            (src == NULL) ||
+            (dest == NULL)  ) {
+        return WH_ERROR_BADARGS;
+    }
+    if (src != dest) {
+        memmove(dest, src, size);
+    }
+    wh_CommSwapFields(magic, fields, dest, size);
+    return 0;
+}
+
 
 /** Client functions */
 
@@ -80,6 +143,7 @@ int wh_CommClient_Init(whCommClient* context, const whCommClientConfig* config)
     context->transport_context = config->transport_context;
     context->client_id = config->client_id;
     context->connect_cb = config->connect_cb;
+    context->max_data_len = WH_COMM_DATA_LEN;
     if (context->transport_cb->Init != NULL) {
         rc = context->transport_cb->Init(context->transport_context,
                 config->transport_config, NULL, NULL);
@@ -106,28 +170,52 @@ int wh_CommClient_SendRequest(whCommClient* context, uint16_t magic,
 {
     int rc = WH_ERROR_NOTREADY;
 
-    if (context == NULL) {
+    if (    (context == NULL) ||
+            (data_size > context->max_data_len)) {
         return WH_ERROR_BADARGS;
     }
 
     if ((context->initialized != 0) &&
         (context->transport_cb != NULL) &&
         (context->transport_cb->Send != NULL)) {
+        whCommHeader* hdr = context->hdr;
+        uint8_t* hdr_data = context->data;
+
+        WH_TRACE(WH_TRACE_CLIENT_REQUEST, kind,
+                WH_TRACE_SEQ_SIZE(context->seq + 1, data_size));
+        if (context->transport_cb->AcquireSend != NULL) {
+            /* Build the request directly in the transport's buffer */
+            uint16_t lent_size = 0;
+            void* lent = NULL;
+            rc = context->transport_cb->AcquireSend(
+                    context->transport_context, &lent_size, &lent);
+            if (rc != 0) {
+                return rc;
+            }
+            if (sizeof(*hdr) + data_size > lent_size) {
+                return WH_ERROR_BADARGS;
+            }
+            hdr = (whCommHeader*)lent;
+            hdr_data = (uint8_t*)lent + sizeof(*hdr);
+        }
 
-        context->hdr->magic = magic;
-        context->hdr->kind = wh_Translate16(magic, kind);
-        context->hdr->seq = wh_Translate16(magic, context->seq + 1);
+        hdr->magic = magic;
+        hdr->kind = wh_Translate16(magic, kind);
+        hdr->seq = wh_Translate16(magic, context->seq + 1);
+        hdr->aux = wh_Translate16(magic, context->aux);
         if (    (data != NULL) &&
                 (data_size != 0) &&
-                (data != context->data)) {
-            memcpy(context->data, data, data_size);
+                (data != hdr_data)) {
+            memcpy(hdr_data, data, data_size);
         }
         rc = context->transport_cb->Send(context->transport_context,
-                sizeof(*(context->hdr)) + data_size,
-                context->packet);
+                sizeof(*hdr) + data_size,
+                hdr);
         if (rc == 0) {
             context->seq++;
             if (out_seq != NULL) *out_seq = context->seq;
+            WH_TRACE(WH_TRACE_TRANSPORT_SEND, kind,
+                    WH_TRACE_SEQ_SIZE(context->seq, data_size));
         }
     }
     return rc;
@@ -154,21 +242,36 @@ int wh_CommClient_RecvResponse(whCommClient* context,
     if ((context->initialized != 0) &&
         (context->transport_cb != NULL) &&
         (context->transport_cb->Recv != NULL)) {
-
-        rc = context->transport_cb->Recv(context->transport_context,
-                &size,
-                context->packet);
+        whCommHeader* hdr = context->hdr;
+        uint8_t* hdr_data = context->data;
+
+        if (context->transport_cb->AcquireRecv != NULL) {
+            /* Parse the response directly from the transport's buffer */
+            void* lent = NULL;
+            rc = context->transport_cb->AcquireRecv(
+                    context->transport_context, &size, &lent);
+            if (rc == 0) {
+                hdr = (whCommHeader*)lent;
+                hdr_data = (uint8_t*)lent + sizeof(*hdr);
+            }
+        } else {
+            rc = context->transport_cb->Recv(context->transport_context,
+                    &size,
+                    context->packet);
+        }
         if (rc == 0) {
-            if (size >= sizeof(*context->hdr)) {
-                data_size = size - sizeof(*context->hdr);
-                magic = context->hdr->magic;
-                kind = wh_Translate16(magic, context->hdr->kind);
-                seq = wh_Translate16(magic, context->hdr->seq);
+            if (size >= sizeof(*hdr)) {
+                data_size = size - sizeof(*hdr);
+                magic = hdr->magic;
+                kind = wh_Translate16(magic, hdr->kind);
+                seq = wh_Translate16(magic, hdr->seq);
                 if (    (data != NULL) &&
                         (data_size != 0) &&
-                        (data != context->data)) {
-                    memcpy(data, context->data, data_size);
+                        (data != hdr_data)) {
+                    memcpy(data, hdr_data, data_size);
                 }
+                WH_TRACE(WH_TRACE_TRANSPORT_RECV, kind,
+                        WH_TRACE_SEQ_SIZE(seq, data_size));
                 if (out_magic != NULL) *out_magic = magic;
                 if (out_kind != NULL) *out_kind = kind;
                 if (out_seq != NULL) *out_seq = seq;
@@ -236,6 +339,7 @@ int wh_CommServer_Init(whCommServer* context, const whCommServerConfig* config,
     context->transport_context = config->transport_context;
     context->transport_cb = config->transport_cb;
     context->server_id = config->server_id;
+    context->max_data_len = WH_COMM_DATA_LEN;
     if (context->transport_cb->Init != NULL) {
         rc = context->transport_cb->Init(context->transport_context,
                 config->transport_config, connectcb, connectcb_arg);
@@ -260,8 +364,7 @@ int wh_CommServer_RecvRequest(whCommServer* context,
     uint16_t size = sizeof(context->packet);
     uint16_t data_size = 0;
 
-    if (    (context == NULL) ||
-            (data == NULL)) {
+    if (context == NULL) {
         return WH_ERROR_BADARGS;
     }
 
@@ -269,9 +372,24 @@ int wh_CommServer_RecvRequest(whCommServer* context,
         (context->transport_cb != NULL) &&
         (context->transport_cb->Recv != NULL)) {
 
-        rc = context->transport_cb->Recv(context->transport_context,
-                &size,
-                context->packet);
+        if (context->transport_cb->AcquireRecv != NULL) {
+            /* The client can still write the lent buffer, so take a private
+             * copy before anything in it is checked */
+            void* lent = NULL;
+            rc = context->transport_cb->AcquireRecv(
+                    context->transport_context, &size, &lent);
+            if (rc == 0) {
+                if ((lent == NULL) || (size > sizeof(context->packet))) {
+                    rc = WH_ERROR_ABORTED;
+                } else {
+                    memcpy(context->packet, lent, size);
+                }
+            }
+        } else {
+            rc = context->transport_cb->Recv(context->transport_context,
+                    &size,
+                    context->packet);
+        }
         if (rc == 0) {
             if (size >= sizeof(*context->hdr)) {
 
@@ -279,6 +397,7 @@ int wh_CommServer_RecvRequest(whCommServer* context,
                 magic = context->hdr->magic;
                 kind = wh_Translate16(magic, context->hdr->kind);
                 seq = wh_Translate16(magic, context->hdr->seq);
+                context->aux = wh_Translate16(magic, context->hdr->aux);
 
                 /* Copy the data from the internal buffer if necessary */
                 if (    (data != NULL) &&
@@ -286,6 +405,10 @@ int wh_CommServer_RecvRequest(whCommServer* context,
                         (data != context->data) ) {
                     memcpy(data, context->data, data_size);
                 }
+                WH_TRACE(WH_TRACE_TRANSPORT_RECV, kind,
+                        WH_TRACE_SEQ_SIZE(seq, data_size));
+                WH_CAPTURE_REQUEST(context->server_id, context->client_id,
+                        size, context->hdr);
                 if (out_magic != NULL) *out_magic = magic;
                 if (out_kind != NULL) *out_kind = kind;
                 if (out_seq != NULL) *out_seq = seq;
@@ -305,27 +428,46 @@ int wh_CommServer_SendResponse(whCommServer* context,
 {
     int rc = WH_ERROR_NOTREADY;
 
-    if (context == NULL) {
+    if (    (context == NULL) ||
+            (data_size > context->max_data_len)) {
         return WH_ERROR_BADARGS;
     }
 
     if ((context->initialized != 0) &&
         (context->transport_cb != NULL) &&
         (context->transport_cb->Send != NULL)) {
+        whCommHeader* hdr = context->hdr;
+        uint8_t* hdr_data = wh_CommServer_GetSendDataPtr(context);
 
-        context->hdr->magic = magic;
-        context->hdr->kind = wh_Translate16(magic, kind);
-        context->hdr->seq = wh_Translate16(magic, seq);
+        if (hdr_data == NULL) {
+            /* Transport send buffer is not free yet */
+            return WH_ERROR_NOTREADY;
+        }
+        if (context->send_hdr != NULL) {
+            /* Build the response directly in the transport's buffer */
+            hdr = context->send_hdr;
+        }
 
-        /* Copy the data into the internal buffer if necessary */
+        hdr->magic = magic;
+        hdr->kind = wh_Translate16(magic, kind);
+        hdr->seq = wh_Translate16(magic, seq);
+
+        /* Copy the data into the send buffer if necessary */
         if (    (data != NULL) &&
                 (data_size != 0) &&
-                (data != context->data) ) {
-            memcpy(context->data, data, data_size);
+                (data != hdr_data) ) {
+            memcpy(hdr_data, data, data_size);
         }
         rc = context->transport_cb->Send(context->transport_context,
-                sizeof(*(context->hdr)) + data_size,
-                context->packet);
+                sizeof(*hdr) + data_size,
+                hdr);
+        if (rc == 0) {
+            WH_TRACE(WH_TRACE_TRANSPORT_SEND, kind,
+                    WH_TRACE_SEQ_SIZE(seq, data_size));
+            /* Lent buffers are only valid for a single response */
+            context->send_hdr = NULL;
+            context->send_data = NULL;
+        }
     }
     return rc;
 }
@@ -338,6 +480,37 @@ uint8_t* wh_CommServer_GetDataPtr(whCommServer* context)
     return context->data;
 }
 
+uint8_t* wh_CommServer_GetSendDataPtr(whCommServer* context)
+{
+    uint16_t lent_size = 0;
+    void* lent = NULL;
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    if (    (context->transport_cb == NULL) ||
+            (context->transport_cb->AcquireSend == NULL)) {
+        /* Responses are built in place in the internal buffer */
+        return context->data;
+    }
+
+    if (context->send_data == NULL) {
+        int rc = context->transport_cb->AcquireSend(context->transport_context,
+                    &lent_size, &lent);
+        if (rc == WH_ERROR_NOTREADY) {
+            return NULL;
+        }
+        if ((rc != 0) || (lent == NULL) || (lent_size < WH_COMM_MTU)) {
+            /* Not usable for a full packet, so use the internal buffer */
+            return context->data;
+        }
+        context->send_hdr = (whCommHeader*)lent;
+        context->send_data = (uint8_t*)lent + sizeof(*context->send_hdr);
+    }
+    return context->send_data;
+}
+
 
 int wh_CommServer_Cleanup(whCommServer* context)
 {
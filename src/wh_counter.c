@@ -0,0 +1,442 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_counter.c
+ *
+ * Non-volatile counters kept as a log of single unit records on a generic
+ * flash layer
+ *
+ */
+
+#include <stddef.h>     /* For NULL */
+#include <string.h>     /* For memset */
+
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_flash.h"
+#include "wolfhsm/wh_flash_unit.h"
+#include "wolfhsm/wh_counter.h"
+
+/* MSW of the half header.  The LSW holds the epoch */
+static const whFlashUnit BASE_HEADER = 0x434E545200000000ull;  /* "CNTR" */
+#define WH_COUNTER_BASE_MASK 0xFFFFFFFF00000000ull
+
+/* Records are one unit:
+ *   bits 63-56: WH_COUNTER_TAG | kind
+ *   bits 55-48: check byte over the other 7 bytes
+ *   bits 47-32: counter id
+ *   bits 31-0:  value
+ * The tag keeps a record from looking erased, and the check byte lets a mount
+ * skip a record whose programming was interrupted. */
+#define WH_COUNTER_TAG 0xC0
+enum {
+    WH_COUNTER_KIND_SET     = 1,    /* Counter created or changed */
+    WH_COUNTER_KIND_DESTROY = 2,    /* Counter removed */
+};
+
+/** Local declarations */
+static uint8_t whCounter_Check(whFlashUnit record);
+static whFlashUnit whCounter_Record(int kind, whCounterId id, uint32_t value);
+static uint32_t whCounter_HalfOffset(whCounterContext* context, int half);
+static int whCounter_ReadHeader(whCounterContext* context, int half,
+        uint32_t* out_epoch);
+static void whCounter_Apply(whCounterContext* context, whFlashUnit record);
+static int whCounter_Mount(whCounterContext* context);
+static int whCounter_Compact(whCounterContext* context);
+static int whCounter_Append(whCounterContext* context, int kind,
+        whCounterId id, uint32_t value);
+static whCounterEntry* whCounter_Find(whCounterContext* context,
+        whCounterId id);
+
+
+static uint8_t whCounter_Check(whFlashUnit record)
+{
+    uint8_t sum = 0;
+    int i = 0;
+
+    for (i = 0; i < 8; i++) {
+        if (i != 6) {
+            sum += (uint8_t)(record >> (8 * i));
+        }
+    }
+    return (uint8_t)~sum;
+}
+
+static whFlashUnit whCounter_Record(int kind, whCounterId id, uint32_t value)
+{
+    whFlashUnit record = ((whFlashUnit)(WH_COUNTER_TAG | kind) << 56) |
+                         ((whFlashUnit)id << 32) |
+                         value;
+
+    return record | ((whFlashUnit)whCounter_Check(record) << 48);
+}
+
+static uint32_t whCounter_HalfOffset(whCounterContext* context, int half)
+{
+    return context->offset + (half ? context->half_units : 0);
+}
+
+/* Returns 0 and the epoch of a committed half, otherwise WH_ERROR_NOTFOUND */
+static int whCounter_ReadHeader(whCounterContext* context, int half,
+        uint32_t* out_epoch)
+{
+    whFlashUnit header = 0;
+    int ret = 0;
+
+    ret = wh_FlashUnit_BlankCheck(context->cb, context->flash,
+            whCounter_HalfOffset(context, half), 1);
+    if (ret == 0) {
+        return WH_ERROR_NOTFOUND;
+    }
+    if (ret != WH_ERROR_NOTBLANK) {
+        return ret;
+    }
+
+    ret = wh_FlashUnit_Read(context->cb, context->flash,
+            whCounter_HalfOffset(context, half), 1, &header);
+    if (ret != 0) {
+        return ret;
+    }
+    if ((header & WH_COUNTER_BASE_MASK) != BASE_HEADER) {
+        return WH_ERROR_NOTFOUND;
+    }
+    *out_epoch = (uint32_t)header;
+    return 0;
+}
+
+static whCounterEntry* whCounter_Find(whCounterContext* context,
+        whCounterId id)
+{
+    int i = 0;
+
+    for (i = 0; i < WH_COUNTER_COUNT; i++) {
+        if ((context->counters[i].used != 0) &&
+                (context->counters[i].id == id)) {
+            return &context->counters[i];
+        }
+    }
+    return NULL;
+}
+
+/* Update the in-memory counters with a record read back from flash */
+static void whCounter_Apply(whCounterContext* context, whFlashUnit record)
+{
+    whCounterEntry* entry = NULL;
+    whCounterId id = (whCounterId)(record >> 32);
+    int kind = (int)(record >> 56) & ~WH_COUNTER_TAG;
+    int i = 0;
+
+    if (    (((record >> 56) & WH_COUNTER_TAG) != WH_COUNTER_TAG) ||
+            ((uint8_t)(record >> 48) != whCounter_Check(record))) {
+        /* Interrupted or foreign record */
+        return;
+    }
+
+    entry = whCounter_Find(context, id);
+    if (kind == WH_COUNTER_KIND_DESTROY) {
+        if (entry != NULL) {
+            entry->used = 0;
+        }
+        return;
+    }
+    if (kind != WH_COUNTER_KIND_SET) {
+        return;
+    }
+    for (i = 0; (entry == NULL) && (i < WH_COUNTER_COUNT); i++) {
+        if (context->counters[i].used == 0) {
+            entry = &context->counters[i];
+            entry->id = id;
+            entry->used = 1;
+        }
+    }
+    if (entry != NULL) {
+        entry->value = (uint32_t)record;
+    }
+}
+
+/* Find the active half and replay its records */
+static int whCounter_Mount(whCounterContext* context)
+{
+    uint32_t epochs[2] = {0};
+    int found[2] = {0};
+    whFlashUnit record = 0;
+    uint32_t offset = 0;
+    int half = 0;
+    int ret = 0;
+
+    for (half = 0; half < 2; half++) {
+        ret = whCounter_ReadHeader(context, half, &epochs[half]);
+        if (ret == 0) {
+            found[half] = 1;
+        } else if (ret != WH_ERROR_NOTFOUND) {
+            return ret;
+        }
+    }
+
+    if ((found[0] == 0) && (found[1] == 0)) {
+        /* New store.  Start an empty half 0 */
+        context->active = 1;
+        context->epoch = 0;
+        return whCounter_Compact(context);
+    }
+
+    /* A compaction interrupted before erasing the old half leaves both */
+    context->active = (found[1] != 0) &&
+                      ((found[0] == 0) || (epochs[1] > epochs[0]));
+    context->epoch = epochs[context->active];
+
+    offset = whCounter_HalfOffset(context, context->active);
+    for (   context->next_unit = 1;
+            context->next_unit < context->half_units;
+            context->next_unit++) {
+        ret = wh_FlashUnit_BlankCheck(context->cb, context->flash,
+                offset + context->next_unit, 1);
+        if (ret == 0) {
+            /* Records are appended in order, so this is the end */
+            break;
+        }
+        if (ret == WH_ERROR_NOTBLANK) {
+            ret = wh_FlashUnit_Read(context->cb, context->flash,
+                    offset + context->next_unit, 1, &record);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        whCounter_Apply(context, record);
+    }
+    return 0;
+}
+
+/* Write every counter to the inactive half, commit it with its header and
+ * erase the old half */
+static int whCounter_Compact(whCounterContext* context)
+{
+    int dest = !context->active;
+    uint32_t offset = whCounter_HalfOffset(context, dest);
+    uint32_t unit = 1;
+    whFlashUnit record = 0;
+    int ret = 0;
+    int i = 0;
+
+    ret = wh_FlashUnit_BlankCheck(context->cb, context->flash,
+            offset, context->half_units);
+    if (ret == WH_ERROR_NOTBLANK) {
+        ret = wh_FlashUnit_Erase(context->cb, context->flash,
+                offset, context->half_units);
+    }
+
+    for (i = 0; (ret == 0) && (i < WH_COUNTER_COUNT); i++) {
+        if (context->counters[i].used != 0) {
+            record = whCounter_Record(WH_COUNTER_KIND_SET,
+                    context->counters[i].id, context->counters[i].value);
+            ret = wh_FlashUnit_Program(context->cb, context->flash,
+                    offset + unit, 1, &record);
+            unit++;
+        }
+    }
+    if (ret == 0) {
+        record = BASE_HEADER | (context->epoch + 1);
+        ret = wh_FlashUnit_Program(context->cb, context->flash,
+                offset, 1, &record);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    context->active = dest;
+    context->epoch++;
+    context->next_unit = unit;
+
+    /* Erasing the old half is optional, as the next compaction erases it */
+    (void)wh_FlashUnit_Erase(context->cb, context->flash,
+            whCounter_HalfOffset(context, !dest), context->half_units);
+    return 0;
+}
+
+static int whCounter_Append(whCounterContext* context, int kind,
+        whCounterId id, uint32_t value)
+{
+    whFlashUnit record = whCounter_Record(kind, id, value);
+    int ret = 0;
+
+    if (context->next_unit >= context->half_units) {
+        /* The record is applied after the compaction, which must leave room
+         * for it */
+        ret = whCounter_Compact(context);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    ret = wh_FlashUnit_Program(context->cb, context->flash,
+            whCounter_HalfOffset(context, context->active) + context->next_unit,
+            1, &record);
+    /* An interrupted program still consumes the unit */
+    context->next_unit++;
+    return ret;
+}
+
+int wh_Counter_Init(whCounterContext* context, const whCounterConfig* config)
+{
+    uint32_t half_units = 0;
+    int ret = 0;
+
+    if (    (context == NULL) ||
+            (config == NULL) ||
+            (config->cb == NULL) ||
+            ((config->offset % WHFU_BYTES_PER_UNIT) != 0) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Each half must hold its header, every counter and one more record */
+    half_units = config->size / 2 / WHFU_BYTES_PER_UNIT;
+    if (half_units < 1 + WH_COUNTER_COUNT + 1) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if ((config->config != NULL) && (config->cb->Init != NULL)) {
+        ret = config->cb->Init(config->context, config->config);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    memset(context, 0, sizeof(*context));
+    context->cb = config->cb;
+    context->flash = config->context;
+    context->offset = config->offset / WHFU_BYTES_PER_UNIT;
+    context->half_units = half_units;
+
+    (void)wh_FlashUnit_WriteUnlock(context->cb, context->flash,
+            context->offset, 2 * context->half_units);
+
+    ret = whCounter_Mount(context);
+    if (ret == 0) {
+        context->initialized = 1;
+    }
+    return ret;
+}
+
+int wh_Counter_Cleanup(whCounterContext* context)
+{
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    /* The flash is left for its owner to clean up */
+    context->initialized = 0;
+    return 0;
+}
+
+int wh_Counter_Set(whCounterContext* context, whCounterId id, uint32_t value)
+{
+    whCounterEntry* entry = NULL;
+    int ret = 0;
+    int i = 0;
+
+    if ((context == NULL) || (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    entry = whCounter_Find(context, id);
+    for (i = 0; (entry == NULL) && (i < WH_COUNTER_COUNT); i++) {
+        if (context->counters[i].used == 0) {
+            entry = &context->counters[i];
+        }
+    }
+    if (entry == NULL) {
+        return WH_ERROR_NOSPACE;
+    }
+
+    ret = whCounter_Append(context, WH_COUNTER_KIND_SET, id, value);
+    if (ret == 0) {
+        entry->id = id;
+        entry->used = 1;
+        entry->value = value;
+    }
+    return ret;
+}
+
+int wh_Counter_Increment(whCounterContext* context, whCounterId id,
+        uint32_t* out_value)
+{
+    whCounterEntry* entry = NULL;
+    int ret = 0;
+
+    if ((context == NULL) || (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    entry = whCounter_Find(context, id);
+    if (entry == NULL) {
+        return WH_ERROR_NOTFOUND;
+    }
+
+    if (entry->value != UINT32_MAX) {
+        ret = whCounter_Append(context, WH_COUNTER_KIND_SET, id,
+                entry->value + 1);
+        if (ret == 0) {
+            entry->value++;
+        }
+    }
+    if ((ret == 0) && (out_value != NULL)) {
+        *out_value = entry->value;
+    }
+    return ret;
+}
+
+int wh_Counter_Read(whCounterContext* context, whCounterId id,
+        uint32_t* out_value)
+{
+    whCounterEntry* entry = NULL;
+
+    if ((context == NULL) || (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    entry = whCounter_Find(context, id);
+    if (entry == NULL) {
+        return WH_ERROR_NOTFOUND;
+    }
+    if (out_value != NULL) {
+        *out_value = entry->value;
+    }
+    return 0;
+}
+
+int wh_Counter_Destroy(whCounterContext* context, whCounterId id)
+{
+    whCounterEntry* entry = NULL;
+    int ret = 0;
+
+    if ((context == NULL) || (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    entry = whCounter_Find(context, id);
+    if (entry == NULL) {
+        /* Not present */
+        return 0;
+    }
+
+    ret = whCounter_Append(context, WH_COUNTER_KIND_DESTROY, id, 0);
+    if (ret == 0) {
+        entry->used = 0;
+    }
+    return ret;
+}
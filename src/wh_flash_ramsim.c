@@ -27,6 +27,7 @@
 
 static bool isMemoryErased(whFlashRamsimCtx* context, uint32_t offset,
                            uint32_t size);
+static void countRead(whFlashRamsimCtx* context, uint32_t size);
 
 
 static bool isMemoryErased(whFlashRamsimCtx* context, uint32_t offset,
@@ -41,6 +42,22 @@ static bool isMemoryErased(whFlashRamsimCtx* context, uint32_t offset,
     return true;
 }
 
+static void countRead(whFlashRamsimCtx* context, uint32_t size)
+{
+    uint32_t words =
+        (size + WH_FLASH_RAMSIM_WORD_SIZE - 1) / WH_FLASH_RAMSIM_WORD_SIZE;
+
+    context->stats.reads++;
+    context->stats.bytesRead += size;
+    context->stats.elapsed += (uint64_t)words * context->wordReadTime;
+}
+
+/* Operation started by EraseStart or ProgramStart */
+enum {
+    RAMSIM_OP_NONE    = 0,
+    RAMSIM_OP_ERASE   = 1,
+    RAMSIM_OP_PROGRAM = 2,
+};
 
 /* Simulator functions */
 int whFlashRamsim_Init(void* context, const void* config)
@@ -59,8 +76,23 @@ int whFlashRamsim_Init(void* context, const void* config)
     ctx->memory      = (uint8_t*)malloc(ctx->size);
     ctx->erasedByte  = cfg->erasedByte;
     ctx->writeLocked = 0;
-
-    if (!ctx->memory) {
+    ctx->busyPolls   = cfg->busyPolls;
+    ctx->pendingOp   = RAMSIM_OP_NONE;
+
+    ctx->pageProgramTime   = cfg->pageProgramTime;
+    ctx->sectorEraseTime   = cfg->sectorEraseTime;
+    ctx->wordReadTime      = cfg->wordReadTime;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->stats.sectorCount =
+        (ctx->size + ctx->sectorSize - 1) / ctx->sectorSize;
+    ctx->sectorErases      = (uint32_t*)calloc(
+        ctx->stats.sectorCount, sizeof(*ctx->sectorErases));
+
+    if (!ctx->memory || !ctx->sectorErases) {
+        free(ctx->memory);
+        free(ctx->sectorErases);
+        ctx->memory       = NULL;
+        ctx->sectorErases = NULL;
         return WH_ERROR_BADARGS;
     }
 
@@ -82,6 +114,10 @@ int whFlashRamsim_Cleanup(void* context)
         free(ctx->memory);
         ctx->memory = NULL;
     }
+    if (ctx->sectorErases != NULL) {
+        free(ctx->sectorErases);
+        ctx->sectorErases = NULL;
+    }
 
     return WH_ERROR_OK;
 }
@@ -115,6 +151,49 @@ int whFlashRamsim_Program(void* context, uint32_t offset, uint32_t size,
     /* Perform the programming operation */
     memcpy(ctx->memory + offset, data, size);
 
+    if (size > 0) {
+        ctx->stats.programs++;
+        ctx->stats.bytesWritten += size;
+        ctx->stats.elapsed +=
+            (uint64_t)(size / ctx->pageSize) * ctx->pageProgramTime;
+    }
+
+    return WH_ERROR_OK;
+}
+
+int whFlashRamsim_Copy(void* context, uint32_t src_offset, uint32_t dst_offset,
+                       uint32_t size)
+{
+    whFlashRamsimCtx* ctx = (whFlashRamsimCtx*)context;
+
+    if ((ctx == NULL) || (ctx->memory == NULL) || (ctx->pageSize == 0) ||
+        ((src_offset + size) > ctx->size)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Same rules as programming the destination */
+    if (dst_offset + size > ctx->size || size % ctx->pageSize != 0) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (!isMemoryErased(ctx, dst_offset, size)) {
+        return WH_ERROR_NOTBLANK;
+    }
+
+    if (size > 0 && ctx->writeLocked) {
+        return WH_ERROR_LOCKED;
+    }
+
+    memmove(ctx->memory + dst_offset, ctx->memory + src_offset, size);
+
+    if (size > 0) {
+        countRead(ctx, size);
+        ctx->stats.programs++;
+        ctx->stats.bytesWritten += size;
+        ctx->stats.elapsed +=
+            (uint64_t)(size / ctx->pageSize) * ctx->pageProgramTime;
+    }
+
     return WH_ERROR_OK;
 }
 
@@ -129,6 +208,7 @@ int whFlashRamsim_Read(void* context, uint32_t offset, uint32_t size,
     }
 
     memcpy(data, ctx->memory + offset, size);
+    countRead(ctx, size);
     return WH_ERROR_OK;
 }
 
@@ -153,6 +233,18 @@ int whFlashRamsim_Erase(void* context, uint32_t offset, uint32_t size)
     /* Perform the erase */
     memset(ctx->memory + offset, ctx->erasedByte, size);
 
+    if (size > 0) {
+        uint32_t sector = 0;
+        for (sector = offset / ctx->sectorSize;
+             sector < (offset + size) / ctx->sectorSize; sector++) {
+            ctx->sectorErases[sector]++;
+        }
+        ctx->stats.erases++;
+        ctx->stats.bytesErased += size;
+        ctx->stats.elapsed +=
+            (uint64_t)(size / ctx->sectorSize) * ctx->sectorEraseTime;
+    }
+
     return WH_ERROR_OK;
 }
 
@@ -166,6 +258,8 @@ int whFlashRamsim_Verify(void* context, uint32_t offset, uint32_t size,
         return WH_ERROR_BADARGS;
     }
 
+    countRead(ctx, size);
+
     /* Check stored data equals input data */
     for (i = 0; i < size; ++i) {
         if (ctx->memory[offset + i] != data[i]) {
@@ -186,6 +280,8 @@ int whFlashRamsim_BlankCheck(void* context, uint32_t offset, uint32_t size)
         return WH_ERROR_BADARGS;
     }
 
+    countRead(ctx, size);
+
     if (!isMemoryErased(ctx, offset, size)) {
         return WH_ERROR_NOTBLANK;
     }
@@ -238,3 +334,199 @@ int whFlashRamsim_WriteUnlock(void* context, uint32_t offset, uint32_t size)
 
     return WH_ERROR_OK;
 }
+
+
+int whFlashRamsim_EraseStart(void* context, uint32_t offset, uint32_t size)
+{
+    whFlashRamsimCtx* ctx = (whFlashRamsimCtx*)context;
+
+    if ((ctx == NULL) || (ctx->memory == NULL) ||
+        ((offset + size) > ctx->size) || (offset % ctx->sectorSize != 0) ||
+        (size % ctx->sectorSize != 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* One operation at a time */
+    if (ctx->pendingOp != RAMSIM_OP_NONE) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    if (size > 0 && ctx->writeLocked) {
+        return WH_ERROR_LOCKED;
+    }
+
+    ctx->pendingOp     = RAMSIM_OP_ERASE;
+    ctx->pendingOffset = offset;
+    ctx->pendingSize   = size;
+    ctx->pendingData   = NULL;
+    ctx->pendingPolls  = ctx->busyPolls;
+    return WH_ERROR_OK;
+}
+
+
+int whFlashRamsim_ProgramStart(void* context, uint32_t offset, uint32_t size,
+                               const uint8_t* data)
+{
+    whFlashRamsimCtx* ctx = (whFlashRamsimCtx*)context;
+
+    if ((ctx == NULL) || (ctx->memory == NULL) || (ctx->pageSize == 0) ||
+        (data == NULL) || (offset + size > ctx->size) ||
+        (size % ctx->pageSize != 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* One operation at a time */
+    if (ctx->pendingOp != RAMSIM_OP_NONE) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    if (!isMemoryErased(ctx, offset, size)) {
+        return WH_ERROR_NOTBLANK;
+    }
+
+    if (size > 0 && ctx->writeLocked) {
+        return WH_ERROR_LOCKED;
+    }
+
+    ctx->pendingOp     = RAMSIM_OP_PROGRAM;
+    ctx->pendingOffset = offset;
+    ctx->pendingSize   = size;
+    ctx->pendingData   = data;
+    ctx->pendingPolls  = ctx->busyPolls;
+    return WH_ERROR_OK;
+}
+
+
+int whFlashRamsim_Poll(void* context)
+{
+    whFlashRamsimCtx* ctx = (whFlashRamsimCtx*)context;
+    int               op  = 0;
+
+    if (ctx == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (ctx->pendingOp == RAMSIM_OP_NONE) {
+        return WH_ERROR_OK;
+    }
+
+    if (ctx->pendingPolls > 0) {
+        ctx->pendingPolls--;
+        return WH_ERROR_NOTREADY;
+    }
+
+    /* Complete the operation */
+    op             = ctx->pendingOp;
+    ctx->pendingOp = RAMSIM_OP_NONE;
+    if (op == RAMSIM_OP_ERASE) {
+        return whFlashRamsim_Erase(ctx, ctx->pendingOffset, ctx->pendingSize);
+    }
+    return whFlashRamsim_Program(ctx, ctx->pendingOffset, ctx->pendingSize,
+                                 ctx->pendingData);
+}
+
+
+int whFlashRamsim_GetStats(void* context, whFlashRamsimStats* out_stats)
+{
+    whFlashRamsimCtx* ctx    = (whFlashRamsimCtx*)context;
+    uint32_t          sector = 0;
+
+    if ((ctx == NULL) || (ctx->sectorErases == NULL) || (out_stats == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    ctx->stats.minSectorErases = ctx->sectorErases[0];
+    ctx->stats.maxSectorErases = ctx->sectorErases[0];
+    for (sector = 1; sector < ctx->stats.sectorCount; sector++) {
+        if (ctx->sectorErases[sector] < ctx->stats.minSectorErases) {
+            ctx->stats.minSectorErases = ctx->sectorErases[sector];
+        }
+        if (ctx->sectorErases[sector] > ctx->stats.maxSectorErases) {
+            ctx->stats.maxSectorErases = ctx->sectorErases[sector];
+        }
+    }
+
+    *out_stats = ctx->stats;
+    return WH_ERROR_OK;
+}
+
+
+int whFlashRamsim_ResetStats(void* context)
+{
+    whFlashRamsimCtx* ctx         = (whFlashRamsimCtx*)context;
+    uint32_t          sectorCount = 0;
+
+    if ((ctx == NULL) || (ctx->sectorErases == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    sectorCount = ctx->stats.sectorCount;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->stats.sectorCount = sectorCount;
+    memset(ctx->sectorErases, 0, sectorCount * sizeof(*ctx->sectorErases));
+    return WH_ERROR_OK;
+}
+
+
+int whFlashRamsim_GetSectorErases(void* context, uint32_t sector,
+                                  uint32_t* out_count)
+{
+    whFlashRamsimCtx* ctx = (whFlashRamsimCtx*)context;
+
+    if ((ctx == NULL) || (ctx->sectorErases == NULL) || (out_count == NULL) ||
+        (sector >= ctx->stats.sectorCount)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    *out_count = ctx->sectorErases[sector];
+    return WH_ERROR_OK;
+}
+
+
+int whFlashRamsim_ProgramV(void* context, const whFlashSegment* segments,
+                           uint32_t count)
+{
+    whFlashRamsimCtx* ctx = (whFlashRamsimCtx*)context;
+    uint32_t          end     = 0;
+    uint32_t          i       = 0;
+    int               written = 0;
+
+    if ((ctx == NULL) || (ctx->memory == NULL) || (ctx->pageSize == 0) ||
+        ((segments == NULL) && (count > 0))) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Same rules as Program for every segment, before writing any */
+    for (i = 0; i < count; i++) {
+        if ((segments[i].data == NULL) ||
+            (segments[i].offset + segments[i].size > ctx->size) ||
+            (segments[i].size % ctx->pageSize != 0)) {
+            return WH_ERROR_BADARGS;
+        }
+        if (!isMemoryErased(ctx, segments[i].offset, segments[i].size)) {
+            return WH_ERROR_NOTBLANK;
+        }
+        if (segments[i].size > 0 && ctx->writeLocked) {
+            return WH_ERROR_LOCKED;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (segments[i].size == 0) {
+            continue;
+        }
+        memcpy(ctx->memory + segments[i].offset, segments[i].data,
+               segments[i].size);
+
+        if ((written == 0) || (segments[i].offset != end)) {
+            ctx->stats.programs++;
+        }
+        written = 1;
+        end     = segments[i].offset + segments[i].size;
+        ctx->stats.bytesWritten += segments[i].size;
+        ctx->stats.elapsed += (uint64_t)(segments[i].size / ctx->pageSize) *
+                              ctx->pageProgramTime;
+    }
+
+    return WH_ERROR_OK;
+}
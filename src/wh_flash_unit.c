@@ -30,6 +30,10 @@
 #include "wolfhsm/wh_error.h"
 #include "wolfhsm/wh_flash.h"
 #include "wolfhsm/wh_flash_unit.h"
+#include "wolfhsm/wh_trace.h"
+
+/* Units moved per Read and Program when the flash has no Copy callback */
+#define WHFU_COPY_BUFFER_UNITS 8
 
 /** Helper functions based on units rather than bytes */
 
@@ -61,10 +65,14 @@ int wh_FlashUnit_Read(const whFlashCb* cb, void* context,
 {
     uint32_t byte_offset = offset * WHFU_BYTES_PER_UNIT;
     uint32_t byte_count = count * WHFU_BYTES_PER_UNIT;
+    int ret = 0;
     if ((cb == NULL) || (cb->Read == NULL)) {
         return WH_ERROR_BADARGS;
     }
-    return cb->Read(context, byte_offset, byte_count,(uint8_t*) data);
+    WH_TRACE(WH_TRACE_FLASH_BEGIN, WH_TRACE_FLASH_READ, byte_count);
+    ret = cb->Read(context, byte_offset, byte_count,(uint8_t*) data);
+    WH_TRACE(WH_TRACE_FLASH_END, WH_TRACE_FLASH_READ, ret);
+    return ret;
 }
 
 /* Program from data count units starting at offset */
@@ -80,6 +88,7 @@ int wh_FlashUnit_Program(const whFlashCb* cb, void* context,
             (cb->Verify == NULL)) {
             return WH_ERROR_BADARGS;
     }
+    WH_TRACE(WH_TRACE_FLASH_BEGIN, WH_TRACE_FLASH_PROGRAM, byte_count);
     /* Blank check first */
     ret = cb->BlankCheck(context,
             byte_offset,
@@ -100,6 +109,62 @@ int wh_FlashUnit_Program(const whFlashCb* cb, void* context,
                     (uint8_t*) data);
         }
     }
+    WH_TRACE(WH_TRACE_FLASH_END, WH_TRACE_FLASH_PROGRAM, ret);
+    return ret;
+}
+
+int wh_FlashUnit_ProgramV(const whFlashCb* cb, void* context,
+        const whFlashUnitSegment* segments, uint32_t count)
+{
+    whFlashSegment byte_segments[WHFU_PROGRAMV_MAX_SEGMENTS];
+    uint32_t byte_count = 0;
+    uint32_t total = 0;
+    uint32_t i = 0;
+    int ret = 0;
+
+    if (    (cb == NULL) ||
+            (cb->BlankCheck == NULL) ||
+            (cb->Program == NULL) ||
+            (cb->Verify == NULL) ||
+            ((segments == NULL) && (count > 0)) ||
+            (count > WHFU_PROGRAMV_MAX_SEGMENTS)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (cb->ProgramV == NULL) {
+        /* One program per segment */
+        for (i = 0; (ret == 0) && (i < count); i++) {
+            ret = wh_FlashUnit_Program(cb, context, segments[i].offset,
+                    segments[i].count, segments[i].data);
+        }
+        return ret;
+    }
+
+    /* Blank check everything first, dropping empty segments */
+    for (i = 0; (ret == 0) && (i < count); i++) {
+        if (segments[i].count == 0) {
+            continue;
+        }
+        byte_segments[byte_count].data = (const uint8_t*)segments[i].data;
+        byte_segments[byte_count].offset =
+                segments[i].offset * WHFU_BYTES_PER_UNIT;
+        byte_segments[byte_count].size =
+                segments[i].count * WHFU_BYTES_PER_UNIT;
+        total += byte_segments[byte_count].size;
+        ret = cb->BlankCheck(context, byte_segments[byte_count].offset,
+                byte_segments[byte_count].size);
+        byte_count++;
+    }
+    if ((ret == 0) && (byte_count > 0)) {
+        WH_TRACE(WH_TRACE_FLASH_BEGIN, WH_TRACE_FLASH_PROGRAM, total);
+        ret = cb->ProgramV(context, byte_segments, byte_count);
+        /* Verify the programming was successful */
+        for (i = 0; (ret == 0) && (i < byte_count); i++) {
+            ret = cb->Verify(context, byte_segments[i].offset,
+                    byte_segments[i].size, byte_segments[i].data);
+        }
+        WH_TRACE(WH_TRACE_FLASH_END, WH_TRACE_FLASH_PROGRAM, ret);
+    }
     return ret;
 }
 
@@ -128,15 +193,104 @@ int wh_FlashUnit_Erase(const whFlashCb* cb, void* context,
 
     if (count == 0) return 0;
 
+    WH_TRACE(WH_TRACE_FLASH_BEGIN, WH_TRACE_FLASH_ERASE, byte_count);
     int ret = cb->Erase(context, byte_offset, byte_count);
 
     if (ret == 0) {
         ret = cb->BlankCheck(context, byte_offset, byte_count);
     }
+    WH_TRACE(WH_TRACE_FLASH_END, WH_TRACE_FLASH_ERASE, ret);
 
     return ret;
 }
 
+/* Program count units at dst_offset with the units at src_offset */
+int wh_FlashUnit_Copy(const whFlashCb* cb, void* context,
+        uint32_t src_offset, uint32_t dst_offset, uint32_t count)
+{
+    int ret = 0;
+
+    if ((cb == NULL) || (cb->BlankCheck == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (count == 0) return 0;
+
+    if (cb->Copy != NULL) {
+        WH_TRACE(WH_TRACE_FLASH_BEGIN, WH_TRACE_FLASH_COPY,
+                count * WHFU_BYTES_PER_UNIT);
+        /* Blank check first */
+        ret = cb->BlankCheck(context,
+                dst_offset * WHFU_BYTES_PER_UNIT,
+                count * WHFU_BYTES_PER_UNIT);
+        if (ret == 0) {
+            ret = cb->Copy(context,
+                    src_offset * WHFU_BYTES_PER_UNIT,
+                    dst_offset * WHFU_BYTES_PER_UNIT,
+                    count * WHFU_BYTES_PER_UNIT);
+        }
+        WH_TRACE(WH_TRACE_FLASH_END, WH_TRACE_FLASH_COPY, ret);
+        return ret;
+    }
+
+    /* Move the data through a small buffer */
+    while ((ret == 0) && (count > 0)) {
+        whFlashUnit buffer[WHFU_COPY_BUFFER_UNITS];
+        uint32_t this_count = WHFU_COPY_BUFFER_UNITS;
+
+        if (count < this_count) {
+            this_count = count;
+        }
+        ret = wh_FlashUnit_Read(cb, context, src_offset, this_count, buffer);
+        if (ret == 0) {
+            ret = wh_FlashUnit_Program(cb, context, dst_offset, this_count,
+                    buffer);
+        }
+        src_offset += this_count;
+        dst_offset += this_count;
+        count -= this_count;
+    }
+    return ret;
+}
+
+int wh_FlashUnit_EraseStart(const whFlashCb* cb, void* context,
+        uint32_t offset, uint32_t count)
+{
+    uint32_t byte_offset = offset * WHFU_BYTES_PER_UNIT;
+    uint32_t byte_count = count * WHFU_BYTES_PER_UNIT;
+    int ret = 0;
+
+    if (cb == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if ((cb->EraseStart == NULL) || (cb->Poll == NULL)) {
+        return wh_FlashUnit_Erase(cb, context, offset, count);
+    }
+
+    if (count == 0) return 0;
+
+    /* Only the start is traced, the erase completes in a later Poll */
+    WH_TRACE(WH_TRACE_FLASH_BEGIN, WH_TRACE_FLASH_ERASE, byte_count);
+    ret = cb->EraseStart(context, byte_offset, byte_count);
+    WH_TRACE(WH_TRACE_FLASH_END, WH_TRACE_FLASH_ERASE, ret);
+    if (ret == 0) {
+        ret = WH_ERROR_NOTREADY;
+    }
+    return ret;
+}
+
+int wh_FlashUnit_Poll(const whFlashCb* cb, void* context)
+{
+    if (cb == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    if (cb->Poll == NULL) {
+        return 0;
+    }
+    return cb->Poll(context);
+}
+
 /** Helper functions to use buffered reads and writes for bytes */
 
 uint32_t wh_FlashUnit_Bytes2Units(uint32_t bytes)
@@ -144,7 +298,6 @@ uint32_t wh_FlashUnit_Bytes2Units(uint32_t bytes)
     return WHFU_BYTES2UNITS(bytes);
 }
 
-
 int wh_FlashUnit_ReadBytes(const whFlashCb* cb, void* context,
         uint32_t byte_offset, uint32_t data_len, uint8_t* data)
 {
@@ -164,9 +317,9 @@ int wh_FlashUnit_ReadBytes(const whFlashCb* cb, void* context,
     if (offset_rem != 0) {
         ret = wh_FlashUnit_Read(cb, context, offset_units, 1, &buffer.unit);
         if (ret == 0) {
-            uint32_t this_size = offset_rem;
+            uint32_t this_size = WHFU_BYTES_PER_UNIT - offset_rem;
             if (data_len < this_size) this_size = data_len;
-            memcpy(data, &buffer.bytes[WHFU_BYTES_PER_UNIT - offset_rem], this_size);
+            memcpy(data, &buffer.bytes[offset_rem], this_size);
             data += this_size;
             data_len -= this_size;
             offset_units++;
@@ -197,31 +350,47 @@ int wh_FlashUnit_ReadBytes(const whFlashCb* cb, void* context,
 int wh_FlashUnit_ProgramBytes(const whFlashCb* cb, void* context,
         uint32_t byte_offset, uint32_t byte_count, const uint8_t* data)
 {
-    int ret = 0;
     whFlashUnitBuffer buffer = {0};
+    whFlashUnitSegment segments[2];
+    uint32_t count = 0;
+
+    if ((cb == NULL) || (cb->Program == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
 
-    uint32_t offset = byte_offset / WHFU_BYTES_PER_UNIT;
     /* Unaligned writes are skipped */
     data += byte_offset % WHFU_BYTES_PER_UNIT;
+    byte_offset -= byte_offset % WHFU_BYTES_PER_UNIT;
+
+    /* Aligned programming and the final partial unit in one request */
+    count = wh_FlashUnit_BytesSegments(byte_offset, byte_count, data, &buffer,
+            segments);
+    return wh_FlashUnit_ProgramV(cb, context, segments, count);
+}
 
+uint32_t wh_FlashUnit_BytesSegments(uint32_t byte_offset, uint32_t byte_count,
+        const uint8_t* data, whFlashUnitBuffer* tail,
+        whFlashUnitSegment* out_segments)
+{
+    uint32_t offset = byte_offset / WHFU_BYTES_PER_UNIT;
     uint32_t count = byte_count / WHFU_BYTES_PER_UNIT;
     uint32_t rem = byte_count % WHFU_BYTES_PER_UNIT;
+    uint32_t used = 0;
 
-    if ((cb == NULL) || (cb->Program == NULL)) {
-        return WH_ERROR_BADARGS;
+    if (count > 0) {
+        out_segments[used].data = (const whFlashUnit*)data;
+        out_segments[used].offset = offset;
+        out_segments[used].count = count;
+        used++;
     }
-
-    /* Aligned programming */
-    ret = wh_FlashUnit_Program(cb, context,
-            offset, count, (whFlashUnit*)data);
-
-    /* Final partial unit */
-    if ((ret == 0) && (rem != 0)) {
-        /* Short writes are filled with erased value */
-        data = data + count * WHFU_BYTES_PER_UNIT;
-        memcpy(buffer.bytes, data, rem);
-        ret = wh_FlashUnit_Program(cb, context,
-                offset + count, 1, &buffer.unit);
+    if (rem != 0) {
+        /* Short writes are filled with 0 */
+        memset(tail->bytes, 0, sizeof(tail->bytes));
+        memcpy(tail->bytes, data + count * WHFU_BYTES_PER_UNIT, rem);
+        out_segments[used].data = &tail->unit;
+        out_segments[used].offset = offset + count;
+        out_segments[used].count = 1;
+        used++;
     }
-    return ret;
+    return used;
 }
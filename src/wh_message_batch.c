@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_message_batch.c
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_error.h"
+
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_batch.h"
+
+static const whCommField _headerFields[] = {
+    WH_COMM_FIELD(whMessageBatch_Header, count),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _entryFields[] = {
+    WH_COMM_FIELD(whMessageBatch_Entry, kind),
+    WH_COMM_FIELD(whMessageBatch_Entry, size),
+    WH_COMM_FIELD(whMessageBatch_Entry, rc),
+    WH_COMM_FIELD_END
+};
+
+int wh_MessageBatch_TranslateHeader(uint16_t magic,
+        const whMessageBatch_Header* src,
+        whMessageBatch_Header* dest)
+{
+    return wh_CommTranslate(magic, _headerFields, sizeof(*dest), src, dest);
+}
+
+int wh_MessageBatch_TranslateEntry(uint16_t magic,
+        const whMessageBatch_Entry* src,
+        whMessageBatch_Entry* dest)
+{
+    return wh_CommTranslate(magic, _entryFields, sizeof(*dest), src, dest);
+}
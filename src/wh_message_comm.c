@@ -29,42 +29,82 @@
 #include "wolfhsm/wh_message.h"
 #include "wolfhsm/wh_message_comm.h"
 
+static const whCommField _initRequestFields[] = {
+    WH_COMM_FIELD(whMessageCommInitRequest, client_id),
+    WH_COMM_FIELD(whMessageCommInitRequest, max_data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _initResponseFields[] = {
+    WH_COMM_FIELD(whMessageCommInitResponse, client_id),
+    WH_COMM_FIELD(whMessageCommInitResponse, server_id),
+    WH_COMM_FIELD(whMessageCommInitResponse, max_data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _lenDataFields[] = {
+    WH_COMM_FIELD(whMessageCommLenData, len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _statsRequestFields[] = {
+    WH_COMM_FIELD(whMessageCommStatsRequest, index),
+    WH_COMM_FIELD(whMessageCommStatsRequest, flags),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _statsResponseFields[] = {
+    WH_COMM_FIELD(whMessageCommStatsResponse, rc),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry_count),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.total_time),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.bytes_in),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.bytes_out),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.count),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.errors),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.min_time),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.max_time),
+    WH_COMM_FIELD_ARRAY(whMessageCommStatsResponse, entry.hist,
+            WH_MESSAGE_COMM_STATS_BINS),
+    WH_COMM_FIELD(whMessageCommStatsResponse, entry.kind),
+    WH_COMM_FIELD_END
+};
+
 int wh_MessageComm_TranslateInitRequest(uint16_t magic,
         const whMessageCommInitRequest* src,
         whMessageCommInitRequest* dest)
 {
-    if (    (src == NULL) ||
-            (dest == NULL)  ) {
-        return WH_ERROR_BADARGS;
-    }
-    dest->client_id = wh_Translate32(magic, src->client_id);
-    return 0;
+    return wh_CommTranslate(magic, _initRequestFields, sizeof(*dest), src,
+            dest);
 }
 
 int wh_MessageComm_TranslateInitResponse(uint16_t magic,
         const whMessageCommInitResponse* src,
         whMessageCommInitResponse* dest)
 {
-    if (    (src == NULL) ||
-            (dest == NULL)  ) {
-        return WH_ERROR_BADARGS;
-    }
-    dest->client_id = wh_Translate32(magic, src->client_id);
-    dest->server_id = wh_Translate32(magic, src->server_id);
-    return 0;
+    return wh_CommTranslate(magic, _initResponseFields, sizeof(*dest), src,
+            dest);
 }
 
 int wh_MessageComm_TranslateLenData(uint16_t magic,
         const whMessageCommLenData* src,
         whMessageCommLenData* dest)
 {
-    if (    (src == NULL) ||
-            (dest == NULL)  ) {
-        return WH_ERROR_BADARGS;
-    }
-    dest->len = wh_Translate16(magic, src->len);
     /* III Note that we can't use src->len to minimize this copy */
-    memcpy(dest->data, src->data, sizeof(dest->data));
-    return 0;
+    return wh_CommTranslate(magic, _lenDataFields, sizeof(*dest), src, dest);
 }
 
+int wh_MessageComm_TranslateStatsRequest(uint16_t magic,
+        const whMessageCommStatsRequest* src,
+        whMessageCommStatsRequest* dest)
+{
+    return wh_CommTranslate(magic, _statsRequestFields, sizeof(*dest), src,
+            dest);
+}
+
+int wh_MessageComm_TranslateStatsResponse(uint16_t magic,
+        const whMessageCommStatsResponse* src,
+        whMessageCommStatsResponse* dest)
+{
+    return wh_CommTranslate(magic, _statsResponseFields, sizeof(*dest), src,
+            dest);
+}
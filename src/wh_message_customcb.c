@@ -24,6 +24,31 @@
 #include "wolfhsm/wh_comm.h"
 
 
+static const whCommField _dma32Fields[] = {
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma32.client_addr),
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma32.client_sz),
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma32.server_addr),
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma32.server_sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _dma64Fields[] = {
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma64.client_addr),
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma64.client_sz),
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma64.server_addr),
+    WH_COMM_FIELD(whMessageCustomCb_Data, dma64.server_sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _bulkHeaderFields[] = {
+    WH_COMM_FIELD(whMessageCustomCb_BulkHeader, id),
+    WH_COMM_FIELD(whMessageCustomCb_BulkHeader, type),
+    WH_COMM_FIELD(whMessageCustomCb_BulkHeader, rc),
+    WH_COMM_FIELD(whMessageCustomCb_BulkHeader, err),
+    WH_COMM_FIELD_END
+};
+
+
 static void _translateCustomData(uint16_t magic, uint32_t translatedType,
                                  const whMessageCustomCb_Data* src,
                                  whMessageCustomCb_Data*       dst)
@@ -34,24 +59,12 @@ static void _translateCustomData(uint16_t magic, uint32_t translatedType,
                 /* right now, no further translations required */
             } break;
             case WH_MESSAGE_CUSTOM_CB_TYPE_DMA32: {
-                dst->dma32.client_addr =
-                    wh_Translate32(magic, src->dma32.client_addr);
-                dst->dma32.client_sz =
-                    wh_Translate32(magic, src->dma32.client_sz);
-                dst->dma32.server_addr =
-                    wh_Translate32(magic, src->dma32.server_addr);
-                dst->dma32.server_sz =
-                    wh_Translate32(magic, src->dma32.server_sz);
+                (void)wh_CommTranslate(magic, _dma32Fields,
+                                       sizeof(dst->dma32), src, dst);
             } break;
             case WH_MESSAGE_CUSTOM_CB_TYPE_DMA64: {
-                dst->dma64.client_addr =
-                    wh_Translate64(magic, src->dma64.client_addr);
-                dst->dma64.client_sz =
-                    wh_Translate64(magic, src->dma64.client_sz);
-                dst->dma64.server_addr =
-                    wh_Translate64(magic, src->dma64.server_addr);
-                dst->dma64.server_sz =
-                    wh_Translate64(magic, src->dma64.server_sz);
+                (void)wh_CommTranslate(magic, _dma64Fields,
+                                       sizeof(dst->dma64), src, dst);
             } break;
             default: {
                 /* reserved message types - no translation for now */
@@ -99,4 +112,11 @@ int wh_MessageCustomCb_TranslateResponse(uint16_t magic,
     _translateCustomData(magic, dst->type, &src->data, &dst->data);
 
     return WH_ERROR_OK;
-}
\ No newline at end of file
+}
+
+int wh_MessageCustomCb_TranslateBulkHeader(
+    uint16_t magic, const whMessageCustomCb_BulkHeader* src,
+    whMessageCustomCb_BulkHeader* dst)
+{
+    return wh_CommTranslate(magic, _bulkHeaderFields, sizeof(*dst), src, dst);
+}
@@ -33,213 +33,342 @@
 
 #include "wolfhsm/wh_error.h"
 
+static const whCommField _simpleResponseFields[] = {
+    WH_COMM_FIELD(whMessageNvm_SimpleResponse, rc),
+    WH_COMM_FIELD(whMessageNvm_SimpleResponse, generation),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _initRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_InitRequest, clientnvm_id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _initResponseFields[] = {
+    WH_COMM_FIELD(whMessageNvm_InitResponse, rc),
+    WH_COMM_FIELD(whMessageNvm_InitResponse, clientnvm_id),
+    WH_COMM_FIELD(whMessageNvm_InitResponse, servernvm_id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _listRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ListRequest, access),
+    WH_COMM_FIELD(whMessageNvm_ListRequest, flags),
+    WH_COMM_FIELD(whMessageNvm_ListRequest, startId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _listResponseFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ListResponse, rc),
+    WH_COMM_FIELD(whMessageNvm_ListResponse, count),
+    WH_COMM_FIELD(whMessageNvm_ListResponse, id),
+    WH_COMM_FIELD(whMessageNvm_ListResponse, generation),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _listMetadataRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ListMetadataRequest, access),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataRequest, flags),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataRequest, startId),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataRequest, max_count),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _listMetadataResponseFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ListMetadataResponse, rc),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataResponse, count),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataResponse, returned),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataResponse, generation),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _listMetadataEntryFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ListMetadataEntry, id),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataEntry, access),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataEntry, flags),
+    WH_COMM_FIELD(whMessageNvm_ListMetadataEntry, len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _getAvailableResponseFields[] = {
+    WH_COMM_FIELD(whMessageNvm_GetAvailableResponse, rc),
+    WH_COMM_FIELD(whMessageNvm_GetAvailableResponse, avail_size),
+    WH_COMM_FIELD(whMessageNvm_GetAvailableResponse, reclaim_size),
+    WH_COMM_FIELD(whMessageNvm_GetAvailableResponse, avail_objects),
+    WH_COMM_FIELD(whMessageNvm_GetAvailableResponse, reclaim_objects),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _getMetadataRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_GetMetadataRequest, id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _getMetadataResponseFields[] = {
+    WH_COMM_FIELD(whMessageNvm_GetMetadataResponse, rc),
+    WH_COMM_FIELD(whMessageNvm_GetMetadataResponse, id),
+    WH_COMM_FIELD(whMessageNvm_GetMetadataResponse, access),
+    WH_COMM_FIELD(whMessageNvm_GetMetadataResponse, flags),
+    WH_COMM_FIELD(whMessageNvm_GetMetadataResponse, len),
+    WH_COMM_FIELD(whMessageNvm_GetMetadataResponse, generation),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _addObjectRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_AddObjectRequest, id),
+    WH_COMM_FIELD(whMessageNvm_AddObjectRequest, access),
+    WH_COMM_FIELD(whMessageNvm_AddObjectRequest, flags),
+    WH_COMM_FIELD(whMessageNvm_AddObjectRequest, len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _addObjectAppendRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_AddObjectAppendRequest, data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _destroyObjectsRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_DestroyObjectsRequest, list_count),
+    WH_COMM_FIELD_ARRAY(whMessageNvm_DestroyObjectsRequest, list,
+            WH_MESSAGE_NVM_MAX_DESTROY_OBJECTS_COUNT),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _readRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ReadRequest, id),
+    WH_COMM_FIELD(whMessageNvm_ReadRequest, offset),
+    WH_COMM_FIELD(whMessageNvm_ReadRequest, data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _readResponseFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ReadResponse, rc),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _addObjectDma32RequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_AddObjectDma32Request, metadata_hostaddr),
+    WH_COMM_FIELD(whMessageNvm_AddObjectDma32Request, data_hostaddr),
+    WH_COMM_FIELD(whMessageNvm_AddObjectDma32Request, data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _readDma32RequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ReadDma32Request, data_hostaddr),
+    WH_COMM_FIELD(whMessageNvm_ReadDma32Request, id),
+    WH_COMM_FIELD(whMessageNvm_ReadDma32Request, offset),
+    WH_COMM_FIELD(whMessageNvm_ReadDma32Request, data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _addObjectDma64RequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_AddObjectDma64Request, metadata_hostaddr),
+    WH_COMM_FIELD(whMessageNvm_AddObjectDma64Request, data_hostaddr),
+    WH_COMM_FIELD(whMessageNvm_AddObjectDma64Request, data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _readDma64RequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ReadDma64Request, data_hostaddr),
+    WH_COMM_FIELD(whMessageNvm_ReadDma64Request, id),
+    WH_COMM_FIELD(whMessageNvm_ReadDma64Request, offset),
+    WH_COMM_FIELD(whMessageNvm_ReadDma64Request, data_len),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _addObjectDmaSgRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_AddObjectDmaSgRequest, metadata_hostaddr),
+    WH_COMM_FIELD(whMessageNvm_AddObjectDmaSgRequest, seg_count),
+    WH_COMM_FIELD_STRUCTS(whMessageNvm_AddObjectDmaSgRequest, segs, addr,
+            WH_DMA_MAX_SEGMENTS),
+    WH_COMM_FIELD_STRUCTS(whMessageNvm_AddObjectDmaSgRequest, segs, len,
+            WH_DMA_MAX_SEGMENTS),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _readDmaSgRequestFields[] = {
+    WH_COMM_FIELD(whMessageNvm_ReadDmaSgRequest, id),
+    WH_COMM_FIELD(whMessageNvm_ReadDmaSgRequest, offset),
+    WH_COMM_FIELD(whMessageNvm_ReadDmaSgRequest, seg_count),
+    WH_COMM_FIELD_STRUCTS(whMessageNvm_ReadDmaSgRequest, segs, addr,
+            WH_DMA_MAX_SEGMENTS),
+    WH_COMM_FIELD_STRUCTS(whMessageNvm_ReadDmaSgRequest, segs, len,
+            WH_DMA_MAX_SEGMENTS),
+    WH_COMM_FIELD_END
+};
+
 int wh_MessageNvm_TranslateSimpleResponse(uint16_t magic,
         const whMessageNvm_SimpleResponse* src,
         whMessageNvm_SimpleResponse* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, rc);
-    return 0;
+    return wh_CommTranslate(magic, _simpleResponseFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateInitRequest(uint16_t magic,
         const whMessageNvm_InitRequest* src,
         whMessageNvm_InitRequest* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, clientnvm_id);
-    return 0;
+    return wh_CommTranslate(magic, _initRequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateInitResponse(uint16_t magic,
         const whMessageNvm_InitResponse* src,
         whMessageNvm_InitResponse* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, rc);
-    WH_T32(magic, dest, src, clientnvm_id);
-    WH_T32(magic, dest, src, servernvm_id);
-    return 0;
+    return wh_CommTranslate(magic, _initResponseFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateListRequest(uint16_t magic,
         const whMessageNvm_ListRequest* src,
         whMessageNvm_ListRequest* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T16(magic, dest, src, access);
-    WH_T16(magic, dest, src, flags);
-    WH_T16(magic, dest, src, startId);
-    return 0;
+    return wh_CommTranslate(magic, _listRequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateListResponse(uint16_t magic,
         const whMessageNvm_ListResponse* src,
         whMessageNvm_ListResponse* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, rc);
-    WH_T16(magic, dest, src, count);
-    WH_T16(magic, dest, src, id);
-    return 0;
+    return wh_CommTranslate(magic, _listResponseFields, sizeof(*dest),
+            src, dest);
+}
+
+int wh_MessageNvm_TranslateListMetadataRequest(uint16_t magic,
+        const whMessageNvm_ListMetadataRequest* src,
+        whMessageNvm_ListMetadataRequest* dest)
+{
+    return wh_CommTranslate(magic, _listMetadataRequestFields, sizeof(*dest),
+            src, dest);
+}
+
+int wh_MessageNvm_TranslateListMetadataResponse(uint16_t magic,
+        const whMessageNvm_ListMetadataResponse* src,
+        whMessageNvm_ListMetadataResponse* dest)
+{
+    return wh_CommTranslate(magic, _listMetadataResponseFields, sizeof(*dest),
+            src, dest);
+}
+
+int wh_MessageNvm_TranslateListMetadataEntry(uint16_t magic,
+        const whMessageNvm_ListMetadataEntry* src,
+        whMessageNvm_ListMetadataEntry* dest)
+{
+    return wh_CommTranslate(magic, _listMetadataEntryFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateGetAvailableResponse(uint16_t magic,
         const whMessageNvm_GetAvailableResponse* src,
         whMessageNvm_GetAvailableResponse* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, rc);
-    WH_T32(magic, dest, src, avail_size);
-    WH_T32(magic, dest, src, reclaim_size);
-    WH_T16(magic, dest, src, avail_objects);
-    WH_T16(magic, dest, src, reclaim_objects);
-    return 0;
+    return wh_CommTranslate(magic, _getAvailableResponseFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateGetMetadataRequest(uint16_t magic,
         const whMessageNvm_GetMetadataRequest* src,
         whMessageNvm_GetMetadataRequest* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T16(magic, dest, src, id);
-    return 0;
+    return wh_CommTranslate(magic, _getMetadataRequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateGetMetadataResponse(uint16_t magic,
         const whMessageNvm_GetMetadataResponse* src,
         whMessageNvm_GetMetadataResponse* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, rc);
-    WH_T16(magic, dest, src, id);
-    WH_T16(magic, dest, src, access);
-    WH_T16(magic, dest, src, flags);
-    WH_T16(magic, dest, src, len);
-    memcpy(dest->label, src->label, sizeof(dest->label));
-    return 0;
+    return wh_CommTranslate(magic, _getMetadataResponseFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateAddObjectRequest(uint16_t magic,
         const whMessageNvm_AddObjectRequest* src,
         whMessageNvm_AddObjectRequest* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T16(magic, dest, src, id);
-    WH_T16(magic, dest, src, access);
-    WH_T16(magic, dest, src, flags);
-    WH_T16(magic, dest, src, len);
-    memcpy(dest->label, src->label, sizeof(dest->label));
-    return 0;
+    return wh_CommTranslate(magic, _addObjectRequestFields, sizeof(*dest),
+            src, dest);
+}
+
+int wh_MessageNvm_TranslateAddObjectAppendRequest(uint16_t magic,
+        const whMessageNvm_AddObjectAppendRequest* src,
+        whMessageNvm_AddObjectAppendRequest* dest)
+{
+    return wh_CommTranslate(magic, _addObjectAppendRequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateDestroyObjectsRequest(uint16_t magic,
         const whMessageNvm_DestroyObjectsRequest* src,
         whMessageNvm_DestroyObjectsRequest* dest)
 {
-    int counter = 0;
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T16(magic, dest, src, list_count);
-    for (counter = 0; counter < WH_MESSAGE_NVM_MAX_DESTROY_OBJECTS_COUNT; counter++) {
-        WH_T16(magic, dest, src, list[counter]);
-    }
-    return 0;
+    return wh_CommTranslate(magic, _destroyObjectsRequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateReadRequest(uint16_t magic,
         const whMessageNvm_ReadRequest* src,
         whMessageNvm_ReadRequest* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T16(magic, dest, src, id);
-    WH_T16(magic, dest, src, offset);
-    WH_T16(magic, dest, src, data_len);
-    return 0;
+    return wh_CommTranslate(magic, _readRequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateReadResponse(uint16_t magic,
         const whMessageNvm_ReadResponse* src,
         whMessageNvm_ReadResponse* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, rc);
-    return 0;
+    return wh_CommTranslate(magic, _readResponseFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateAddObjectDma32Request(uint16_t magic,
         const whMessageNvm_AddObjectDma32Request* src,
         whMessageNvm_AddObjectDma32Request* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, metadata_hostaddr);
-    WH_T32(magic, dest, src, data_hostaddr);
-    WH_T16(magic, dest, src, data_len);
-    return 0;
+    return wh_CommTranslate(magic, _addObjectDma32RequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateReadDma32Request(uint16_t magic,
         const whMessageNvm_ReadDma32Request* src,
         whMessageNvm_ReadDma32Request* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T32(magic, dest, src, data_hostaddr);
-    WH_T16(magic, dest, src, id);
-    WH_T16(magic, dest, src, offset);
-    WH_T16(magic, dest, src, data_len);
-    return 0;
+    return wh_CommTranslate(magic, _readDma32RequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateAddObjectDma64Request(uint16_t magic,
         const whMessageNvm_AddObjectDma64Request* src,
         whMessageNvm_AddObjectDma64Request* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T64(magic, dest, src, metadata_hostaddr);
-    WH_T64(magic, dest, src, data_hostaddr);
-    WH_T16(magic, dest, src, data_len);
-    return 0;
+    return wh_CommTranslate(magic, _addObjectDma64RequestFields, sizeof(*dest),
+            src, dest);
 }
 
 int wh_MessageNvm_TranslateReadDma64Request(uint16_t magic,
         const whMessageNvm_ReadDma64Request* src,
         whMessageNvm_ReadDma64Request* dest)
 {
-    if ((src == NULL) || (dest == NULL)) {
-        return WH_ERROR_BADARGS;
-    }
-    WH_T64(magic, dest, src, data_hostaddr);
-    WH_T16(magic, dest, src, id);
-    WH_T16(magic, dest, src, offset);
-    WH_T16(magic, dest, src, data_len);
-    return 0;
+    return wh_CommTranslate(magic, _readDma64RequestFields, sizeof(*dest),
+            src, dest);
+}
+
+int wh_MessageNvm_TranslateAddObjectDmaSgRequest(uint16_t magic,
+        const whMessageNvm_AddObjectDmaSgRequest* src,
+        whMessageNvm_AddObjectDmaSgRequest* dest)
+{
+    return wh_CommTranslate(magic, _addObjectDmaSgRequestFields, sizeof(*dest),
+            src, dest);
+}
+
+int wh_MessageNvm_TranslateReadDmaSgRequest(uint16_t magic,
+        const whMessageNvm_ReadDmaSgRequest* src,
+        whMessageNvm_ReadDmaSgRequest* dest)
+{
+    return wh_CommTranslate(magic, _readDmaSgRequestFields, sizeof(*dest),
+            src, dest);
 }
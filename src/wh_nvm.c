@@ -30,6 +30,83 @@
 #include "wolfhsm/wh_error.h"
 
 #include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_trace.h"
+
+#if WH_NVM_CACHE_COUNT > 0
+static void _wh_Nvm_CacheClear(whNvmCacheEntry* entry);
+static void _wh_Nvm_CacheInvalidate(whNvmContext* context, whNvmId id);
+static int _wh_Nvm_CacheRead(whNvmContext* context, whNvmId id,
+        whNvmSize offset, whNvmSize data_len, uint8_t* data);
+
+/* Empty an entry, wiping the copy of the object along with it */
+static void _wh_Nvm_CacheClear(whNvmCacheEntry* entry)
+{
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void _wh_Nvm_CacheInvalidate(whNvmContext* context, whNvmId id)
+{
+    int i = 0;
+
+    for (i = 0; i < WH_NVM_CACHE_COUNT; i++) {
+        if (context->cache[i].id == id) {
+            _wh_Nvm_CacheClear(&context->cache[i]);
+        }
+    }
+}
+
+/* Serve a read from a cached copy of the whole object, filling the least
+ * recently used entry on a miss.  Returns WH_ERROR_NOTFOUND when the read
+ * should go to the backend instead */
+static int _wh_Nvm_CacheRead(whNvmContext* context, whNvmId id,
+        whNvmSize offset, whNvmSize data_len, uint8_t* data)
+{
+    whNvmCacheEntry* entry = NULL;
+    whNvmMetadata meta;
+    int i = 0;
+    int rc = 0;
+
+    for (i = 0; i < WH_NVM_CACHE_COUNT; i++) {
+        if (context->cache[i].id == id) {
+            entry = &context->cache[i];
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        if (context->cb->GetMetadata == NULL) {
+            return WH_ERROR_NOTFOUND;
+        }
+        rc = context->cb->GetMetadata(context->context, id, &meta);
+        if ((rc != 0) || (meta.len > WH_NVM_CACHE_SIZE)) {
+            return WH_ERROR_NOTFOUND;
+        }
+
+        entry = &context->cache[0];
+        for (i = 1; i < WH_NVM_CACHE_COUNT; i++) {
+            if (context->cache[i].age < entry->age) {
+                entry = &context->cache[i];
+            }
+        }
+        rc = context->cb->Read(context->context, id, 0, meta.len, entry->data);
+        if (rc != 0) {
+            _wh_Nvm_CacheClear(entry);
+            return WH_ERROR_NOTFOUND;
+        }
+        entry->id = id;
+        entry->len = meta.len;
+    }
+
+    if ((uint32_t)offset + data_len > entry->len) {
+        return WH_ERROR_NOTFOUND;
+    }
+    entry->age = ++context->cache_clock;
+    if (data_len > 0) {
+        memcpy(data, &entry->data[offset], data_len);
+    }
+    return 0;
+}
+#endif /* WH_NVM_CACHE_COUNT > 0 */
 
 
 int wh_Nvm_Init(whNvmContext* context, const whNvmConfig *config)
@@ -43,9 +120,18 @@ int wh_Nvm_Init(whNvmContext* context, const whNvmConfig *config)
 
     context->cb = config->cb;
     context->context = config->context;
+    context->generation = config->generation;
+    context->stream_owner = NULL;
+#if WH_NVM_CACHE_COUNT > 0
+    memset(context->cache, 0, sizeof(context->cache));
+    context->cache_clock = 0;
+    context->stream_id = WH_NVM_INVALID_ID;
+#endif
 
     if (context->cb->Init != NULL) {
+        WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_INIT, 0);
         rc = context->cb->Init(context->context, config->config);
+        WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_INIT, rc);
         if (rc != 0) {
             context->cb = NULL;
             context->context = NULL;
@@ -62,6 +148,10 @@ int wh_Nvm_Cleanup(whNvmContext* context)
         return WH_ERROR_BADARGS;
     }
 
+#if WH_NVM_CACHE_COUNT > 0
+    memset(context->cache, 0, sizeof(context->cache));
+#endif
+
     /* No callback? Return ABORTED */
     if (context->cb->Cleanup == NULL) {
         return WH_ERROR_ABORTED;
@@ -91,6 +181,8 @@ int wh_Nvm_GetAvailable(whNvmContext* context,
 int wh_Nvm_AddObject(whNvmContext* context, whNvmMetadata *meta,
         whNvmSize data_len, const uint8_t* data)
 {
+    int rc = 0;
+
     if (    (context == NULL) ||
             (context->cb == NULL) ) {
         return WH_ERROR_BADARGS;
@@ -100,13 +192,137 @@ int wh_Nvm_AddObject(whNvmContext* context, whNvmMetadata *meta,
     if (context->cb->AddObject == NULL) {
         return WH_ERROR_ABORTED;
     }
-    return context->cb->AddObject(context->context, meta, data_len, data);
+#if WH_NVM_CACHE_COUNT > 0
+    if (meta != NULL) {
+        _wh_Nvm_CacheInvalidate(context, meta->id);
+    }
+#endif
+    WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_ADD,
+            (meta != NULL) ? meta->id : 0);
+    rc = context->cb->AddObject(context->context, meta, data_len, data);
+    WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_ADD, rc);
+    context->generation++;
+    return rc;
+}
+
+int wh_Nvm_AddObjectBegin(whNvmContext* context, const void* owner,
+        whNvmMetadata *meta)
+{
+    int rc = 0;
+
+    if (    (context == NULL) ||
+            (context->cb == NULL) ||
+            (owner == NULL) ||
+            (meta == NULL) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* No callback? Return ABORTED */
+    if (context->cb->AddObjectBegin == NULL) {
+        return WH_ERROR_ABORTED;
+    }
+    if (    (context->stream_owner != NULL) &&
+            (context->stream_owner != owner) ) {
+        /* Someone else is streaming */
+        return WH_ERROR_NOTREADY;
+    }
+#if WH_NVM_CACHE_COUNT > 0
+    context->stream_id = meta->id;
+#endif
+    rc = context->cb->AddObjectBegin(context->context, meta);
+    context->stream_owner = (rc == 0) ? owner : NULL;
+    return rc;
+}
+
+int wh_Nvm_AddObjectAppend(whNvmContext* context, const void* owner,
+        whNvmSize data_len, const uint8_t* data)
+{
+    int rc = 0;
+
+    if (    (context == NULL) ||
+            (context->cb == NULL) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* No callback? Return ABORTED */
+    if (context->cb->AddObjectAppend == NULL) {
+        return WH_ERROR_ABORTED;
+    }
+    if (    (context->stream_owner != NULL) &&
+            (context->stream_owner != owner) ) {
+        return WH_ERROR_ACCESS;
+    }
+    rc = context->cb->AddObjectAppend(context->context, data_len, data);
+    if (rc == WH_ERROR_NOTFOUND) {
+        /* The backend dropped the stream, e.g. by compacting */
+        context->stream_owner = NULL;
+    }
+    return rc;
+}
+
+int wh_Nvm_AddObjectCommit(whNvmContext* context, const void* owner)
+{
+    int rc = 0;
+
+    if (    (context == NULL) ||
+            (context->cb == NULL) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* No callback? Return ABORTED */
+    if (context->cb->AddObjectCommit == NULL) {
+        return WH_ERROR_ABORTED;
+    }
+    if (    (context->stream_owner != NULL) &&
+            (context->stream_owner != owner) ) {
+        return WH_ERROR_ACCESS;
+    }
+    WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_ADD_COMMIT, 0);
+    rc = context->cb->AddObjectCommit(context->context);
+    WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_ADD_COMMIT, rc);
+    context->generation++;
+    if ((rc == 0) || (rc == WH_ERROR_NOTFOUND)) {
+        context->stream_owner = NULL;
+    }
+#if WH_NVM_CACHE_COUNT > 0
+    if (rc == 0) {
+        /* Reads during the stream may have cached the previous version */
+        _wh_Nvm_CacheInvalidate(context, context->stream_id);
+        context->stream_id = WH_NVM_INVALID_ID;
+    }
+#endif
+    return rc;
+}
+
+int wh_Nvm_AddObjectAbort(whNvmContext* context, const void* owner)
+{
+    int rc = 0;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    if (    (context->stream_owner == NULL) ||
+            (context->stream_owner != owner) ) {
+        /* Nothing of this owner to abort */
+        return 0;
+    }
+    if (    (context->cb != NULL) &&
+            (context->cb->AddObjectAbort != NULL) ) {
+        rc = context->cb->AddObjectAbort(context->context);
+    }
+    context->stream_owner = NULL;
+#if WH_NVM_CACHE_COUNT > 0
+    context->stream_id = WH_NVM_INVALID_ID;
+#endif
+    return rc;
 }
 
 int wh_Nvm_List(whNvmContext* context,
         whNvmAccess access, whNvmFlags flags, whNvmId start_id,
         whNvmId *out_count, whNvmId *out_id)
 {
+    int rc = 0;
+
     if (    (context == NULL) ||
             (context->cb == NULL) ) {
         return WH_ERROR_BADARGS;
@@ -116,13 +332,18 @@ int wh_Nvm_List(whNvmContext* context,
     if (context->cb->List == NULL) {
         return WH_ERROR_ABORTED;
     }
-    return context->cb->List(context->context, access, flags, start_id,
+    WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_LIST, start_id);
+    rc = context->cb->List(context->context, access, flags, start_id,
             out_count, out_id);
+    WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_LIST, rc);
+    return rc;
 }
 
 int wh_Nvm_GetMetadata(whNvmContext* context, whNvmId id,
         whNvmMetadata* meta)
 {
+    int rc = 0;
+
     if (    (context == NULL) ||
             (context->cb == NULL) ) {
         return WH_ERROR_BADARGS;
@@ -132,13 +353,63 @@ int wh_Nvm_GetMetadata(whNvmContext* context, whNvmId id,
     if (context->cb->GetMetadata == NULL) {
         return WH_ERROR_ABORTED;
     }
-    return context->cb->GetMetadata(context->context, id, meta);
+    WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_GETMETADATA, id);
+    rc = context->cb->GetMetadata(context->context, id, meta);
+    WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_GETMETADATA, rc);
+    return rc;
+}
+
+int wh_Nvm_ListMetadata(whNvmContext* context,
+        whNvmAccess access, whNvmFlags flags, whNvmId start_id,
+        whNvmId max_count, whNvmMetadata* out_meta,
+        whNvmId *out_returned, whNvmId *out_count)
+{
+    whNvmId returned = 0;
+    whNvmId count = 0;
+    whNvmId id = 0;
+    int rc = 0;
+
+    if (    (context == NULL) ||
+            (context->cb == NULL) ||
+            ((max_count > 0) && (out_meta == NULL)) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* No callback? Return ABORTED */
+    if (    (context->cb->List == NULL) ||
+            (context->cb->GetMetadata == NULL) ) {
+        return WH_ERROR_ABORTED;
+    }
+
+    do {
+        rc = context->cb->List(context->context, access, flags, start_id,
+                &count, &id);
+        if ((rc != 0) || (count == 0) || (returned == max_count)) {
+            break;
+        }
+        rc = context->cb->GetMetadata(context->context, id,
+                &out_meta[returned]);
+        if (rc != 0) {
+            break;
+        }
+        returned++;
+        start_id = id;
+        count--;
+    } while (returned < max_count);
+
+    if (rc == 0) {
+        if (out_returned != NULL) *out_returned = returned;
+        if (out_count != NULL) *out_count = count;
+    }
+    return rc;
 }
 
 
 int wh_Nvm_DestroyObjects(whNvmContext* context, whNvmId list_count,
         const whNvmId* id_list)
 {
+    int rc = 0;
+
     if (    (context == NULL) ||
             (context->cb == NULL) ) {
         return WH_ERROR_BADARGS;
@@ -148,13 +419,30 @@ int wh_Nvm_DestroyObjects(whNvmContext* context, whNvmId list_count,
     if (context->cb->DestroyObjects == NULL) {
         return WH_ERROR_ABORTED;
     }
-    return context->cb->DestroyObjects(context->context, list_count, id_list);
+#if WH_NVM_CACHE_COUNT > 0
+    if (id_list != NULL) {
+        whNvmId i = 0;
+        for (i = 0; i < list_count; i++) {
+            _wh_Nvm_CacheInvalidate(context, id_list[i]);
+        }
+    }
+#endif
+    WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_DESTROY, list_count);
+    rc = context->cb->DestroyObjects(context->context, list_count, id_list);
+    WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_DESTROY, rc);
+    /* Compaction alone changes no object */
+    if (list_count > 0) {
+        context->generation++;
+    }
+    return rc;
 }
 
 
 int wh_Nvm_Read(whNvmContext* context, whNvmId id, whNvmSize offset,
         whNvmSize data_len, uint8_t* data)
 {
+    int rc = 0;
+
     if (    (context == NULL) ||
             (context->cb == NULL) ) {
         return WH_ERROR_BADARGS;
@@ -164,6 +452,34 @@ int wh_Nvm_Read(whNvmContext* context, whNvmId id, whNvmSize offset,
     if (context->cb->Read == NULL) {
         return WH_ERROR_ABORTED;
     }
-    return context->cb->Read(context->context, id, offset, data_len, data);
+#if WH_NVM_CACHE_COUNT > 0
+    if (    (id != WH_NVM_INVALID_ID) &&
+            ((data != NULL) || (data_len == 0)) &&
+            (_wh_Nvm_CacheRead(context, id, offset, data_len, data) == 0)) {
+        return 0;
+    }
+#endif
+    WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_READ, id);
+    rc = context->cb->Read(context->context, id, offset, data_len, data);
+    WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_READ, rc);
+    return rc;
 }
 
+int wh_Nvm_Compact(whNvmContext* context, uint32_t max_bytes)
+{
+    int rc = 0;
+
+    if (    (context == NULL) ||
+            (context->cb == NULL) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* No callback? Replicate in a single step */
+    if (context->cb->Compact == NULL) {
+        return wh_Nvm_DestroyObjects(context, 0, NULL);
+    }
+    WH_TRACE(WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_COMPACT, max_bytes);
+    rc = context->cb->Compact(context->context, max_bytes);
+    WH_TRACE(WH_TRACE_NVM_END, WH_TRACE_NVM_COMPACT, rc);
+    return rc;
+}
@@ -33,8 +33,13 @@
 #include "wolfhsm/wh_nvm.h"
 #include "wolfhsm/wh_nvm_flash.h"
 
+/* Steps of wh_NvmFlash_Compact */
 enum {
-    NF_COPY_OBJECT_BUFFER_LEN = 8 * WHFU_BYTES_PER_UNIT,
+    NF_COMPACT_IDLE     = 0,    /* Nothing in progress */
+    NF_COMPACT_COPY     = 1,    /* Inactive partition started, copying */
+    NF_COMPACT_ERASE    = 2,    /* Switched, old partition left to erase */
+    NF_COMPACT_PREPARE  = 3,    /* Inactive partition erasing before start */
+    NF_COMPACT_ERASING  = 4,    /* Switched, old partition erasing */
 };
 
 /* MSW of state variables (nfState) must be set to this pattern when written
@@ -67,6 +72,12 @@ typedef struct {
 #define NF_OBJECT_STATE_OFFSET WHFU_BYTES2UNITS(offsetof(nfObject, state))
 #define NF_OBJECT_METADATA_OFFSET WHFU_BYTES2UNITS(offsetof(nfObject, u.metadata))
 
+/* A destroyed id is superseded by an entry with metadata claiming data but
+ * no data written, which no regular object can have */
+#define NF_TOMBSTONE_LEN WOLFHSM_NVM_MAX_OBJECT_SIZE
+#define NF_OBJECT_IS_TOMBSTONE(_o) \
+                    (((_o)->metadata.len != 0) && ((_o)->state.count == 0))
+
 /* On-flash layout of a Directory */
 typedef struct {
     nfObject objects[NF_OBJECT_COUNT];
@@ -85,6 +96,27 @@ typedef struct {
 #define NF_PARTITION_DIRECTORY_OFFSET WHFU_BYTES2UNITS(offsetof(nfPartition, directory))
 #define NF_PARTITION_DATA_OFFSET WHFU_BYTES2UNITS(sizeof(nfPartition))
 
+#if WH_NVM_FLASH_CHECKPOINT
+/* On-flash layout of the checkpoint header at the end of a partition, followed
+ * by the in-memory image of the first count objects of the directory */
+typedef struct {
+    uint32_t magic;
+    uint32_t epoch;     /* Epoch of the partition it belongs to */
+    uint32_t count;     /* Objects in the image */
+    uint32_t sum;       /* FNV-1a over the image */
+} nfCheckpoint;
+#define NF_CHECKPOINT_MAGIC 0x4E464350ul
+#define NF_UNITS_PER_CHECKPOINT_HEADER WHFU_BYTES2UNITS(sizeof(nfCheckpoint))
+#define NF_UNITS_PER_CHECKPOINT (NF_UNITS_PER_CHECKPOINT_HEADER + \
+                    WHFU_BYTES2UNITS(sizeof(nfMemObject) * NF_OBJECT_COUNT))
+#else
+#define NF_UNITS_PER_CHECKPOINT 0
+#endif
+
+/* Units of a partition available for object data */
+#define NF_PARTITION_DATA_UNITS(_c) ((_c)->partition_units - \
+                    NF_PARTITION_DATA_OFFSET - NF_UNITS_PER_CHECKPOINT)
+
 /** Local declarations */
 static int nfMemState_Read(whNvmFlashContext* context, uint32_t offset,
         nfMemState* state);
@@ -98,6 +130,9 @@ static int nfPartition_WriteLock(whNvmFlashContext* context, int partition);
 static int nfPartition_WriteUnlock(whNvmFlashContext* context, int partition);
 static int nfPartition_BlankCheck(whNvmFlashContext* context, int partition);
 static int nfPartition_Erase(whNvmFlashContext* context, int partition);
+static int nfPartition_EraseStart(whNvmFlashContext* context, int partition);
+static int nfPartition_ErasePoll(whNvmFlashContext* context, int partition);
+static int nfCompact_WaitErase(whNvmFlashContext* context);
 static int nfPartition_ReadMemState(whNvmFlashContext* context, int partition,
         nfMemState* state);
 static int nfPartition_ReadMemDirectory(whNvmFlashContext* context,
@@ -118,6 +153,9 @@ static int nfPartition_CheckDataRange(whNvmFlashContext* context,
 
 static uint32_t nfObject_Offset(whNvmFlashContext* context, int partition,
         int object_index);
+static int nfObject_ProgramHead(whNvmFlashContext* context, int partition,
+        int object_index, uint32_t epoch, uint32_t start, whNvmMetadata* meta,
+        uint32_t byte_count, const uint8_t* data);
 static int nfObject_ProgramBegin(whNvmFlashContext* context, int partition,
         int object_index, uint32_t epoch, uint32_t start, whNvmMetadata* meta);
 static int nfObject_ProgramDataBytes(whNvmFlashContext* context, int partition,
@@ -136,6 +174,21 @@ static int nfObject_Copy(whNvmFlashContext* context, int object_index,
 static int nfMemDirectory_Parse(nfMemDirectory* d);
 static int nfMemDirectory_FindObjectIndexById(nfMemDirectory* d, whNvmId id,
         int *out_object_index);
+static int nfMemDirectory_IndexSearch(const nfMemDirectory* d, whNvmId id,
+        int *out_pos);
+static void nfMemDirectory_IndexInsert(nfMemDirectory* d, int pos, whNvmId id,
+        int object_index);
+static void nfMemDirectory_IndexRemove(nfMemDirectory* d, int pos);
+#if WH_NVM_FLASH_TOMBSTONE
+static int nfMemDirectory_Tombstone(whNvmFlashContext* context,
+        whNvmId list_count, const whNvmId* id_list);
+#endif
+#if WH_NVM_FLASH_CHECKPOINT
+static int nfCheckpoint_Program(whNvmFlashContext* context, int partition,
+        uint32_t epoch, uint32_t count, uint32_t data_end);
+static int nfCheckpoint_Read(whNvmFlashContext* context, int partition,
+        nfMemDirectory* directory);
+#endif
 
 
 static int nfMemState_Read(whNvmFlashContext* context, uint32_t offset,
@@ -248,6 +301,11 @@ static int nfMemObject_Read(whNvmFlashContext* context,
             /* Copy the metadata out of the buffer */
             memcpy(&object->metadata, buffer, sizeof(object->metadata));
             clear_metadata = 0;
+            if (object->state.status == NF_STATUS_DATA_BAD) {
+                /* The count is only written after the data, so bound an
+                 * interrupted object by the length it reserved */
+                object->state.count = WHFU_BYTES2UNITS(object->metadata.len);
+            }
         }
     }
     if (clear_metadata != 0){
@@ -329,6 +387,37 @@ static int nfPartition_Erase(whNvmFlashContext* context, int partition)
             context->partition_units);
 }
 
+/* Start erasing a partition, returning WH_ERROR_NOTREADY until
+ * nfPartition_ErasePoll completes it.  Erases synchronously if the flash has
+ * no EraseStart. */
+static int nfPartition_EraseStart(whNvmFlashContext* context, int partition)
+{
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    return wh_FlashUnit_EraseStart(
+            context->cb,
+            context->flash,
+            nfPartition_Offset(context, partition),
+            context->partition_units);
+}
+
+static int nfPartition_ErasePoll(whNvmFlashContext* context, int partition)
+{
+    int ret = 0;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    ret = wh_FlashUnit_Poll(context->cb, context->flash);
+    if (ret == 0) {
+        ret = nfPartition_BlankCheck(context, partition);
+    }
+    return ret;
+}
+
 static int nfPartition_ReadMemState(whNvmFlashContext* context, int partition,
         nfMemState* state)
 {
@@ -380,6 +469,118 @@ static int nfPartition_ReadParseMemDirectory(whNvmFlashContext* context, int par
     return nfMemDirectory_Parse(directory);
 }
 
+#if WH_NVM_FLASH_CHECKPOINT
+static uint32_t nfCheckpoint_Sum(const uint8_t* data, uint32_t len)
+{
+    uint32_t sum = 2166136261ul;
+    uint32_t i = 0;
+
+    for (i = 0; i < len; i++) {
+        sum = (sum ^ data[i]) * 16777619ul;
+    }
+    return sum;
+}
+
+/* Write the image of the first count objects of the directory, which must have
+ * been read from the partition, into its checkpoint area */
+static int nfCheckpoint_Program(whNvmFlashContext* context, int partition,
+        uint32_t epoch, uint32_t count, uint32_t data_end)
+{
+    nfCheckpoint cp;
+    whFlashUnit buffer[NF_UNITS_PER_CHECKPOINT_HEADER] = {0};
+    uint32_t offset = 0;
+    uint32_t image_len = count * sizeof(nfMemObject);
+    int ret = 0;
+
+    if (count > NF_OBJECT_COUNT) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Object data may already reach into the checkpoint area */
+    if (data_end > NF_PARTITION_DATA_UNITS(context)) {
+        return WH_ERROR_NOSPACE;
+    }
+
+    offset = nfPartition_Offset(context, partition) +
+            context->partition_units - NF_UNITS_PER_CHECKPOINT;
+    cp.magic = NF_CHECKPOINT_MAGIC;
+    cp.epoch = epoch;
+    cp.count = count;
+    cp.sum = nfCheckpoint_Sum(
+            (const uint8_t*)context->directory.objects, image_len);
+    memcpy(buffer, &cp, sizeof(cp));
+
+    /* Header last, so an interrupted write is never mistaken for an image */
+    if (image_len > 0) {
+        ret = wh_FlashUnit_ProgramBytes(context->cb, context->flash,
+                (offset + NF_UNITS_PER_CHECKPOINT_HEADER) * WHFU_BYTES_PER_UNIT,
+                image_len, (const uint8_t*)context->directory.objects);
+    }
+    if (ret == 0) {
+        ret = wh_FlashUnit_Program(context->cb, context->flash,
+                offset, NF_UNITS_PER_CHECKPOINT_HEADER, buffer);
+    }
+    return ret;
+}
+
+/* Load the checkpoint of the partition and read the objects added after it.
+ * Returns WH_ERROR_NOTFOUND if there is no intact checkpoint */
+static int nfCheckpoint_Read(whNvmFlashContext* context, int partition,
+        nfMemDirectory* directory)
+{
+    nfCheckpoint cp;
+    whFlashUnit buffer[NF_UNITS_PER_CHECKPOINT_HEADER];
+    uint32_t offset = 0;
+    int index = 0;
+    int ret = 0;
+
+    offset = nfPartition_Offset(context, partition) +
+            context->partition_units - NF_UNITS_PER_CHECKPOINT;
+    memset(directory, 0, sizeof(*directory));
+
+    ret = wh_FlashUnit_Read(context->cb, context->flash, offset,
+            NF_UNITS_PER_CHECKPOINT_HEADER, buffer);
+    if (ret != 0) {
+        return ret;
+    }
+    memcpy(&cp, buffer, sizeof(cp));
+    if (    (cp.magic != NF_CHECKPOINT_MAGIC) ||
+            (cp.epoch != context->state.epoch) ||
+            (cp.count > NF_OBJECT_COUNT)) {
+        return WH_ERROR_NOTFOUND;
+    }
+
+    if (cp.count > 0) {
+        ret = wh_FlashUnit_ReadBytes(context->cb, context->flash,
+                (offset + NF_UNITS_PER_CHECKPOINT_HEADER) * WHFU_BYTES_PER_UNIT,
+                cp.count * sizeof(nfMemObject),
+                (uint8_t*)directory->objects);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    if (cp.sum != nfCheckpoint_Sum((const uint8_t*)directory->objects,
+            cp.count * sizeof(nfMemObject))) {
+        memset(directory, 0, sizeof(*directory));
+        return WH_ERROR_NOTFOUND;
+    }
+
+    /* Objects added since are read one by one up to the first free entry */
+    offset = nfPartition_Offset(context, partition) +
+                NF_PARTITION_DIRECTORY_OFFSET;
+    for (index = cp.count; (index < NF_OBJECT_COUNT) && (ret == 0); index++) {
+        ret = nfMemObject_Read(
+                context,
+                offset + NF_DIRECTORY_OBJECT_OFFSET(index),
+                &directory->objects[index]);
+        if (directory->objects[index].state.status == NF_STATUS_FREE) {
+            break;
+        }
+    }
+    return ret;
+}
+#endif
+
 static int nfPartition_ProgramEpoch(whNvmFlashContext* context,
         int partition, uint32_t epoch)
 {
@@ -518,12 +719,17 @@ static uint32_t nfObject_Offset(whNvmFlashContext* context, int partition,
             NF_DIRECTORY_OBJECT_OFFSET(object_index);
 }
 
-static int nfObject_ProgramBegin(whNvmFlashContext* context, int partition,
-        int object_index, uint32_t epoch, uint32_t start,
-                whNvmMetadata* meta)
+/* Program the object epoch, metadata and start, in that order, followed by
+ * byte_count bytes of data at start, as one vectored request */
+static int nfObject_ProgramHead(whNvmFlashContext* context, int partition,
+        int object_index, uint32_t epoch, uint32_t start, whNvmMetadata* meta,
+        uint32_t byte_count, const uint8_t* data)
 {
-    int rc = 0;
+    whFlashUnitSegment segments[5];
+    whFlashUnitBuffer tail;
+    uint32_t count = 0;
     uint32_t object_offset = 0;
+    uint32_t data_offset = 0;
     whFlashUnit state_epoch = BASE_STATE | epoch;
     whFlashUnit state_start = BASE_STATE | start;
 
@@ -535,34 +741,48 @@ static int nfObject_ProgramBegin(whNvmFlashContext* context, int partition,
 
     object_offset = nfObject_Offset(context, partition, object_index);
 
-    /* Program the object epoch */
-    rc = wh_FlashUnit_Program(
-            context->cb,
-            context->flash,
-            object_offset + NF_OBJECT_STATE_OFFSET + NF_STATE_EPOCH_OFFSET,
-            1,
-            &state_epoch);
-
-    if (rc == 0) {
-        /* Program the object metadata */
-        rc = wh_FlashUnit_Program(
-                context->cb,
-                context->flash,
-                object_offset + NF_OBJECT_METADATA_OFFSET,
-                NF_UNITS_PER_METADATA,
-                (whFlashUnit*)meta);
-
-        if (rc == 0) {
-            /* Program the object start */
-            rc = wh_FlashUnit_Program(
-                    context->cb,
-                    context->flash,
-                    object_offset + NF_OBJECT_STATE_OFFSET + NF_STATE_START_OFFSET,
-                    1,
-                    &state_start);
+    /* The object epoch */
+    segments[count].data = &state_epoch;
+    segments[count].offset =
+            object_offset + NF_OBJECT_STATE_OFFSET + NF_STATE_EPOCH_OFFSET;
+    segments[count].count = 1;
+    count++;
+
+    /* The object metadata */
+    segments[count].data = (whFlashUnit*)meta;
+    segments[count].offset = object_offset + NF_OBJECT_METADATA_OFFSET;
+    segments[count].count = NF_UNITS_PER_METADATA;
+    count++;
+
+    /* The object start */
+    segments[count].data = &state_start;
+    segments[count].offset =
+            object_offset + NF_OBJECT_STATE_OFFSET + NF_STATE_START_OFFSET;
+    segments[count].count = 1;
+    count++;
+
+    if (byte_count > 0) {
+        data_offset = nfPartition_DataOffset(context, partition) + start;
+
+        /* Ensure we don't program outside of the active partition */
+        if (WH_ERROR_OK != nfPartition_CheckDataRange(context, partition,
+                                        data_offset * WHFU_BYTES_PER_UNIT,
+                                        byte_count)) {
+            return WH_ERROR_BADARGS;
         }
+        count += wh_FlashUnit_BytesSegments(data_offset * WHFU_BYTES_PER_UNIT,
+                byte_count, data, &tail, &segments[count]);
     }
-    return rc;
+
+    return wh_FlashUnit_ProgramV(context->cb, context->flash, segments, count);
+}
+
+static int nfObject_ProgramBegin(whNvmFlashContext* context, int partition,
+        int object_index, uint32_t epoch, uint32_t start,
+                whNvmMetadata* meta)
+{
+    return nfObject_ProgramHead(context, partition, object_index, epoch, start,
+            meta, 0, NULL);
 }
 
 static int nfObject_ProgramDataBytes(whNvmFlashContext* context, int partition,
@@ -624,15 +844,12 @@ static int nfObject_Program(whNvmFlashContext* context, int partition,
         return WH_ERROR_BADARGS;
     }
 
-    rc = nfObject_ProgramBegin(context, partition, object_index,
-            epoch, start, meta);
+    /* Everything but the count in one request */
+    rc = nfObject_ProgramHead(context, partition, object_index,
+            epoch, start, meta, meta->len, data);
     if (rc == 0) {
-        rc = nfObject_ProgramDataBytes(context, partition,
-                start, meta->len, data);
-        if (rc == 0) {
-            rc = nfObject_ProgramFinish(context, partition, object_index,
-                    meta->len);
-        }
+        rc = nfObject_ProgramFinish(context, partition, object_index,
+                meta->len);
     }
     return rc;
 }
@@ -674,7 +891,9 @@ static int nfObject_Copy(whNvmFlashContext* context, int object_index,
     uint32_t dest_data = 0;
     nfMemDirectory* d = NULL;
     uint32_t data_len = 0;
-    uint32_t data_offset = 0;
+    uint32_t data_units = 0;
+    uint32_t src_offset = 0;
+    uint32_t dest_offset = 0;
 
     if (    (context == NULL) ||
             (inout_next_object == NULL) ||
@@ -694,37 +913,24 @@ static int nfObject_Copy(whNvmFlashContext* context, int object_index,
             dest_data, &d->objects[object_index].metadata);
     if (ret != 0) return ret;
 
-    /* Loop through reading the old data into buffer */
-    while (data_offset < data_len) {
-        uint8_t buffer[NF_COPY_OBJECT_BUFFER_LEN];
-        uint32_t this_len = sizeof(buffer);
-
-        if((data_len - data_offset) < this_len) {
-            this_len = data_len - data_offset;
-        }
-
-        /* Read the data from the old object. */
-        ret = nfObject_ReadDataBytes(
-                context,
-                context->active,
-                object_index,
-                data_offset,
-                this_len,
-                buffer);
-        if (ret != 0) return ret;
-
-        /* Write the data to the new object. */
-        ret = nfObject_ProgramDataBytes(
-                context,
-                partition,
-                dest_data,
-                this_len,
-                buffer);
-        if (ret != 0) return ret;
-
-        data_offset += this_len;
-        dest_data += WHFU_BYTES2UNITS(this_len);
+    /* Copy the data units to the new object */
+    src_offset = nfPartition_DataOffset(context, context->active) +
+            d->objects[object_index].state.start;
+    dest_offset = nfPartition_DataOffset(context, partition) + dest_data;
+    data_units = WHFU_BYTES2UNITS(data_len);
+    if (    (nfPartition_CheckDataRange(context, context->active,
+                src_offset * WHFU_BYTES_PER_UNIT,
+                data_units * WHFU_BYTES_PER_UNIT) != WH_ERROR_OK) ||
+            (nfPartition_CheckDataRange(context, partition,
+                dest_offset * WHFU_BYTES_PER_UNIT,
+                data_units * WHFU_BYTES_PER_UNIT) != WH_ERROR_OK)) {
+        return WH_ERROR_BADARGS;
     }
+    ret = wh_FlashUnit_Copy(context->cb, context->flash,
+            src_offset, dest_offset, data_units);
+    if (ret != 0) return ret;
+    dest_data += data_units;
+
     ret = nfObject_ProgramFinish(context, partition, dest_object, data_len);
     if (ret != 0) return ret;
     dest_object++;
@@ -741,7 +947,7 @@ static int nfMemDirectory_Parse(nfMemDirectory* d)
 {
     int done = 0;
     int this_entry = 0;
-    int that_entry = 0;
+    int pos = 0;
 
     if (d == NULL) {
         return WH_ERROR_BADARGS;
@@ -786,42 +992,105 @@ static int nfMemDirectory_Parse(nfMemDirectory* d)
         if (done) break;
     }
 
-    /* Now walk through backwards and reclaim any duplicate meta->id data counts */
-    for (this_entry = NF_OBJECT_COUNT - 1; this_entry >= 0; this_entry --) {
+    /* Now walk through backwards, indexing the most recent version of each id
+     * and reclaiming any older duplicates */
+    d->index_count = 0;
+    for (this_entry = d->next_free_object - 1; this_entry >= 0; this_entry --) {
         if (d->objects[this_entry].state.status == NF_STATUS_USED) {
             whNvmId this_id = d->objects[this_entry].metadata.id;
-            for (that_entry = this_entry - 1; that_entry >= 0; that_entry --) {
-                if (    (d->objects[that_entry].state.status == NF_STATUS_USED) &&
-                        (d->objects[that_entry].metadata.id == this_id)) {
-                    /* Found duplicate.  Mark it as reclaimable and break out of this loop */
+            if (nfMemDirectory_IndexSearch(d, this_id, &pos) == 0) {
+                /* Found newer duplicate.  Mark this one as reclaimable */
+                d->reclaimable_entries++;
+                d->reclaimable_data += d->objects[this_entry].state.count;
+                d->objects[this_entry].state.status = NF_STATUS_DATA_BAD;
+            } else {
+                nfMemDirectory_IndexInsert(d, pos, this_id, this_entry);
+                if (NF_OBJECT_IS_TOMBSTONE(&d->objects[this_entry])) {
+                    /* Destroyed id.  Stays indexed until the walk is done so
+                     * older versions are reclaimed too */
                     d->reclaimable_entries++;
-                    d->reclaimable_data += d->objects[that_entry].state.count;
-                    d->objects[that_entry].state.status = NF_STATUS_DATA_BAD;
+                    d->reclaimable_data += d->objects[this_entry].state.count;
+                    d->objects[this_entry].state.status = NF_STATUS_DATA_BAD;
                 }
             }
         }
     }
+
+    /* Drop the destroyed ids from the index */
+    for (pos = d->index_count - 1; pos >= 0; pos--) {
+        if (d->objects[d->index_object[pos]].state.status != NF_STATUS_USED) {
+            nfMemDirectory_IndexRemove(d, pos);
+        }
+    }
     return 0;
 }
 
+/* Binary search the id index.  Returns 0 and the position of id if present,
+ * otherwise WH_ERROR_NOTFOUND and the position it would be inserted at. */
+static int nfMemDirectory_IndexSearch(const nfMemDirectory* d, whNvmId id,
+        int *out_pos)
+{
+    int lo = 0;
+    int hi = d->index_count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (d->index_id[mid] < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (out_pos != NULL) *out_pos = lo;
+    if ((lo < d->index_count) && (d->index_id[lo] == id)) {
+        return 0;
+    }
+    return WH_ERROR_NOTFOUND;
+}
+
+static void nfMemDirectory_IndexInsert(nfMemDirectory* d, int pos, whNvmId id,
+        int object_index)
+{
+    int move = d->index_count - pos;
+
+    if (move > 0) {
+        memmove(&d->index_id[pos + 1], &d->index_id[pos],
+                move * sizeof(d->index_id[0]));
+        memmove(&d->index_object[pos + 1], &d->index_object[pos],
+                move * sizeof(d->index_object[0]));
+    }
+    d->index_id[pos] = id;
+    d->index_object[pos] = (uint16_t)object_index;
+    d->index_count++;
+}
+
+static void nfMemDirectory_IndexRemove(nfMemDirectory* d, int pos)
+{
+    int move = d->index_count - pos - 1;
+
+    if (move > 0) {
+        memmove(&d->index_id[pos], &d->index_id[pos + 1],
+                move * sizeof(d->index_id[0]));
+        memmove(&d->index_object[pos], &d->index_object[pos + 1],
+                move * sizeof(d->index_object[0]));
+    }
+    d->index_count--;
+}
+
 static int nfMemDirectory_FindObjectIndexById(nfMemDirectory* d, whNvmId id,
         int *out_object_index)
 {
-    int index = 0;
+    int pos = 0;
     int ret = WH_ERROR_NOTFOUND;
 
     if (d == NULL) {
         return WH_ERROR_BADARGS;
     }
 
-    /* Find first used index that matches the id. */
-    for (index = 0; index< d->next_free_object; index++) {
-        if ((d->objects[index].state.status == NF_STATUS_USED) &&
-                (d->objects[index].metadata.id == id)) {
-            if (out_object_index != NULL) *out_object_index = index;
-            ret = 0;
-            break;
-        }
+    /* Only the most recent USED version of each id is indexed */
+    ret = nfMemDirectory_IndexSearch(d, id, &pos);
+    if ((ret == 0) && (out_object_index != NULL)) {
+        *out_object_index = d->index_object[pos];
     }
     return ret;
 }
@@ -850,6 +1119,7 @@ int wh_NvmFlash_Init(void* c, const void* cf)
         memset(context, 0, sizeof(*context));
         context->cb = config->cb;
         context->flash = config->context;
+        context->stream_object = -1;
 
         /* Get partition size from flash device */
         if (context->cb->PartitionSize != NULL) {
@@ -889,12 +1159,25 @@ int wh_NvmFlash_Init(void* c, const void* cf)
             context->active = 0;
             nfPartition_ProgramInit(context,
                     context->active);
+#if WH_NVM_FLASH_CHECKPOINT
+            (void)nfCheckpoint_Program(context, context->active,
+                    context->state.epoch, 0, 0);
+#endif
         }
 
-        ret = nfPartition_ReadMemDirectory(
+        ret = WH_ERROR_NOTFOUND;
+#if WH_NVM_FLASH_CHECKPOINT
+        ret = nfCheckpoint_Read(
                 context,
                 context->active,
                 &context->directory);
+#endif
+        if (ret != 0) {
+            ret = nfPartition_ReadMemDirectory(
+                    context,
+                    context->active,
+                    &context->directory);
+        }
         ret = nfMemDirectory_Parse(&context->directory);
 
         context->initialized = 1;
@@ -917,6 +1200,7 @@ int wh_NvmFlash_Cleanup(void* c)
     }
 
     /* Ignore errors here */
+    (void)nfCompact_WaitErase(context);
     (void)nfPartition_WriteLock(context, 0);
     (void)nfPartition_WriteLock(context, 1);
 
@@ -946,10 +1230,16 @@ int wh_NvmFlash_List(void* c,
     d = &context->directory;
 
     /* Find the starting id */
-    for (this_entry = 0; this_entry < d->next_free_object; this_entry++) {
-        if (d->objects[this_entry].state.status == NF_STATUS_USED) {
-            this_id = d->objects[this_entry].metadata.id;
-            if ((start_id == 0) || (start_id == this_id)) {
+    if (start_id != 0) {
+        if (nfMemDirectory_FindObjectIndexById(d, start_id, &this_entry) == 0) {
+            this_id = start_id;
+        } else {
+            this_entry = d->next_free_object;
+        }
+    } else {
+        for (this_entry = 0; this_entry < d->next_free_object; this_entry++) {
+            if (d->objects[this_entry].state.status == NF_STATUS_USED) {
+                this_id = d->objects[this_entry].metadata.id;
                 break;
             }
         }
@@ -1001,9 +1291,8 @@ int wh_NvmFlash_GetAvailable(void* c,
     }
     nfMemDirectory *d = &context->directory;
     if (out_avail_size != NULL) {
-        *out_avail_size = (context->partition_units -
-                NF_PARTITION_DATA_OFFSET - d->next_free_data) *
-                WHFU_BYTES_PER_UNIT;
+        *out_avail_size = (NF_PARTITION_DATA_UNITS(context) -
+                d->next_free_data) * WHFU_BYTES_PER_UNIT;
     }
     if (out_avail_objects != NULL) {
         *out_avail_objects = NF_OBJECT_COUNT - d->next_free_object;
@@ -1038,6 +1327,84 @@ int wh_NvmFlash_GetMetadata(void* c, whNvmId id, whNvmMetadata* meta)
     return ret;
 }
 
+#if WH_NVM_FLASH_TOMBSTONE
+/* Check whether a tombstone for oldentry would pass a compaction threshold,
+ * as both the old entry and the tombstone become reclaimable */
+static int nfMemDirectory_TombstoneFull(nfMemDirectory* d, int oldentry)
+{
+    if (    (NF_OBJECT_COUNT - d->next_free_object <=
+                WH_NVM_FLASH_COMPACT_FREE_OBJECTS) ||
+            (d->reclaimable_entries + 2 >= WH_NVM_FLASH_COMPACT_ENTRIES)) {
+        return 1;
+    }
+#if WH_NVM_FLASH_COMPACT_BYTES > 0
+    if ((d->reclaimable_data + d->objects[oldentry].state.count) *
+            WHFU_BYTES_PER_UNIT >= WH_NVM_FLASH_COMPACT_BYTES) {
+        return 1;
+    }
+#else
+    (void)oldentry;
+#endif
+    return 0;
+}
+
+/* Supersede each listed id with a tombstone entry in the active partition.
+ * Returns WH_ERROR_NOSPACE, possibly after destroying some of the ids, when
+ * the remaining ids should be destroyed by compacting instead.
+ */
+static int nfMemDirectory_Tombstone(whNvmFlashContext* context,
+        whNvmId list_count, const whNvmId* id_list)
+{
+    nfMemDirectory* d = &context->directory;
+    whNvmMetadata meta;
+    int list_entry = 0;
+    int pos = 0;
+    int oldentry = 0;
+    int ret = 0;
+    uint32_t epoch = 0;
+
+    for (list_entry = 0; list_entry < list_count; list_entry++) {
+        if (nfMemDirectory_IndexSearch(d, id_list[list_entry], &pos) != 0) {
+            /* Not present */
+            continue;
+        }
+        oldentry = d->index_object[pos];
+
+        if (nfMemDirectory_TombstoneFull(d, oldentry) != 0) {
+            return WH_ERROR_NOSPACE;
+        }
+
+        memcpy(&meta, &d->objects[oldentry].metadata, sizeof(meta));
+        meta.len = NF_TOMBSTONE_LEN;
+        epoch = d->objects[oldentry].state.epoch + 1;
+
+        ret = nfObject_ProgramBegin(context, context->active,
+                d->next_free_object, epoch, d->next_free_data, &meta);
+        if (ret == 0) {
+            ret = nfObject_ProgramFinish(context, context->active,
+                    d->next_free_object, 0);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+
+        /* Update directory with the tombstone and reclaim the old entry */
+        d->objects[d->next_free_object].state.status = NF_STATUS_DATA_BAD;
+        d->objects[d->next_free_object].state.epoch = epoch;
+        d->objects[d->next_free_object].state.start = d->next_free_data;
+        d->objects[d->next_free_object].state.count = 0;
+        memcpy(&d->objects[d->next_free_object].metadata, &meta, sizeof(meta));
+        d->next_free_object++;
+
+        d->objects[oldentry].state.status = NF_STATUS_DATA_BAD;
+        d->reclaimable_entries += 2;
+        d->reclaimable_data += d->objects[oldentry].state.count;
+        nfMemDirectory_IndexRemove(d, pos);
+    }
+    return 0;
+}
+#endif
+
 /* Add a new object. Duplicate ids are allowed, but only the most recent
  * version will be accessible.
  */
@@ -1047,6 +1414,7 @@ int wh_NvmFlash_AddObject(void* c, whNvmMetadata *meta,
     whNvmFlashContext* context = c;
     nfMemDirectory* d = NULL;
     int oldentry = -1;
+    int pos = 0;
     int ret = 0;
     uint32_t epoch = 0;
     uint32_t count = 0;
@@ -1060,13 +1428,13 @@ int wh_NvmFlash_AddObject(void* c, whNvmMetadata *meta,
     d = &context->directory;
     if (    (d->next_free_object == NF_OBJECT_COUNT) ||
             (d->next_free_data * WHFU_BYTES_PER_UNIT + data_len >
-                context->partition_units * WHFU_BYTES_PER_UNIT) ) {
+                NF_PARTITION_DATA_UNITS(context) * WHFU_BYTES_PER_UNIT) ) {
         return WH_ERROR_NOSPACE;
     }
 
     /* Find existing object so we can increment the epoch */
-    ret = nfMemDirectory_FindObjectIndexById(d, meta->id, &oldentry);
-    if (oldentry >= 0) {
+    if (nfMemDirectory_IndexSearch(d, meta->id, &pos) == 0) {
+        oldentry = d->index_object[pos];
         epoch = d->objects[oldentry].state.epoch + 1;
     }
 
@@ -1090,93 +1458,333 @@ int wh_NvmFlash_AddObject(void* c, whNvmMetadata *meta,
         d->objects[d->next_free_object].state.count = count;
         memcpy(&d->objects[d->next_free_object].metadata, meta, sizeof(*meta));
         d->next_free_data += count;
-        d->next_free_object++;
 
-        /* Update directory to reclaim old entry */
+        /* Update directory to reclaim old entry and point the index at the
+         * new one */
         if (oldentry >= 0) {
             d->objects[oldentry].state.status = NF_STATUS_DATA_BAD;
             d->reclaimable_entries++;
             d->reclaimable_data += d->objects[oldentry].state.count;
+            d->index_object[pos] = (uint16_t)d->next_free_object;
+        } else {
+            nfMemDirectory_IndexInsert(d, pos, meta->id, d->next_free_object);
         }
+        d->next_free_object++;
     }
     return ret;
 }
 
-/* Destroy a list of objects by replicating the current state without the id's
- * in the provided list.  Id's in the list that are not present do not cause an
- * error.
+/* Leave the streamed object, if any, for the next compaction to drop */
+static void nfStream_Abandon(whNvmFlashContext* context)
+{
+    nfMemDirectory* d = &context->directory;
+
+    if (context->stream_object >= 0) {
+        d->reclaimable_entries++;
+        d->reclaimable_data += d->objects[context->stream_object].state.count;
+        context->stream_object = -1;
+    }
+}
+
+/* Start streaming an object into the active partition.  Its entry and data
+ * are reserved now, but the count is only written by the commit, so the
+ * object stays as incomplete as an interrupted AddObject until then.
  */
-int wh_NvmFlash_DestroyObjects(void* c, whNvmId list_count,
-        const whNvmId* id_list)
+int wh_NvmFlash_AddObjectBegin(void* c, whNvmMetadata* meta)
 {
-    int ret = 0;
     whNvmFlashContext* context = c;
     nfMemDirectory* d = NULL;
-    nfMemState new_state =  {0};
-    int list_entry = 0;
-    int entry = 0;
-    int src_part = 0;
-    int dest_part = 0;
-    uint32_t dest_object = 0;
-    uint32_t dest_data = 0;
+    nfMemObject* object = NULL;
+    int pos = 0;
+    int ret = 0;
+    uint32_t epoch = 0;
+    uint32_t count = 0;
 
     if (    (context == NULL) ||
-            ((list_count > 0) && (id_list == NULL)) ) {
+            (meta == NULL) ) {
         return WH_ERROR_BADARGS;
     }
 
-    /* Context is valid.  Generate helper values */
     d = &context->directory;
-    src_part = context->active;
-    dest_part = !context->active;
-    new_state =  (nfMemState)   {
-                                    .status = NF_STATUS_FREE,
-                                    .epoch = context->state.epoch + 1,
-                                    .start = context->state.start,
-                                    .count = context->state.count,
-                                };
+    nfStream_Abandon(context);
 
-    /* Go through the current directory and mark the listed id's as bad */
-    for (list_entry = 0; list_entry < list_count; list_entry++) {
-        /* Mark all matching entries as bad.  Should only be 1. */
-        do {
-            entry = -1;
-            ret = nfMemDirectory_FindObjectIndexById(d, id_list[list_entry],
-                    &entry);
-            if ((ret == 0) && (entry >= 0)) {
-                d->objects[entry].state.status = NF_STATUS_DATA_BAD;
+    if (    (d->next_free_object == NF_OBJECT_COUNT) ||
+            (d->next_free_data * WHFU_BYTES_PER_UNIT + meta->len >
+                NF_PARTITION_DATA_UNITS(context) * WHFU_BYTES_PER_UNIT) ) {
+        return WH_ERROR_NOSPACE;
+    }
+
+    /* Find existing object so we can increment the epoch */
+    if (nfMemDirectory_IndexSearch(d, meta->id, &pos) == 0) {
+        epoch = d->objects[d->index_object[pos]].state.epoch + 1;
+    }
+    count = WHFU_BYTES2UNITS(meta->len);
+
+    ret = nfObject_ProgramBegin(context, context->active,
+            d->next_free_object, epoch, d->next_free_data, meta);
+    if (ret == 0) {
+        /* Reserve the entry and data, but leave it out of the index */
+        object = &d->objects[d->next_free_object];
+        object->state.status = NF_STATUS_DATA_BAD;
+        object->state.epoch = epoch;
+        object->state.start = d->next_free_data;
+        object->state.count = count;
+        memcpy(&object->metadata, meta, sizeof(*meta));
+        context->stream_object = d->next_free_object;
+        context->stream_offset = 0;
+        d->next_free_object++;
+        d->next_free_data += count;
+    }
+    return ret;
+}
+
+/* Program the next bytes of the streamed object.  Whole units are programmed
+ * directly and a trailing partial unit is held until it is completed by the
+ * next append or padded by the commit. */
+int wh_NvmFlash_AddObjectAppend(void* c, whNvmSize data_len,
+        const uint8_t* data)
+{
+    whNvmFlashContext* context = c;
+    nfMemObject* object = NULL;
+    uint32_t tail = 0;
+    uint32_t unit = 0;
+    uint32_t chunk = 0;
+    int ret = 0;
+
+    if (    (context == NULL) ||
+            ((data_len > 0) && (data == NULL)) ) {
+        return WH_ERROR_BADARGS;
+    }
+    if (context->stream_object < 0) {
+        return WH_ERROR_NOTFOUND;
+    }
+
+    object = &context->directory.objects[context->stream_object];
+    if (data_len > object->metadata.len - context->stream_offset) {
+        /* More than was reserved */
+        return WH_ERROR_BADARGS;
+    }
+
+    while (data_len > 0) {
+        tail = context->stream_offset % WHFU_BYTES_PER_UNIT;
+        unit = object->state.start +
+                context->stream_offset / WHFU_BYTES_PER_UNIT;
+        if ((tail == 0) && (data_len >= WHFU_BYTES_PER_UNIT)) {
+            chunk = data_len - (data_len % WHFU_BYTES_PER_UNIT);
+            ret = nfObject_ProgramDataBytes(context, context->active,
+                    unit, chunk, data);
+        } else {
+            chunk = WHFU_BYTES_PER_UNIT - tail;
+            if (chunk > data_len) {
+                chunk = data_len;
+            }
+            memcpy(&context->stream_tail[tail], data, chunk);
+            if (tail + chunk == WHFU_BYTES_PER_UNIT) {
+                ret = nfObject_ProgramDataBytes(context, context->active,
+                        unit, WHFU_BYTES_PER_UNIT, context->stream_tail);
             }
-        } while (entry >= 0);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        context->stream_offset += chunk;
+        data += chunk;
+        data_len -= chunk;
     }
+    return 0;
+}
 
-    /* Blank check the inactive partition and erase if not blank */
-    ret = nfPartition_BlankCheck(context, dest_part);
-    if (ret == WH_ERROR_NOTBLANK) {
-        ret = nfPartition_Erase(context, dest_part);
+/* Finish the streamed object once all of its data has been appended and make
+ * it the current version of its id. */
+int wh_NvmFlash_AddObjectCommit(void* c)
+{
+    whNvmFlashContext* context = c;
+    nfMemDirectory* d = NULL;
+    nfMemObject* object = NULL;
+    int entry = 0;
+    int later = 0;
+    int pos = 0;
+    int ret = 0;
+    uint32_t tail = 0;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    if (context->stream_object < 0) {
+        return WH_ERROR_NOTFOUND;
+    }
+
+    d = &context->directory;
+    entry = context->stream_object;
+    object = &d->objects[entry];
+    if (context->stream_offset != object->metadata.len) {
+        /* Data still missing */
+        return WH_ERROR_BADARGS;
+    }
+
+    tail = context->stream_offset % WHFU_BYTES_PER_UNIT;
+    if (tail > 0) {
+        ret = nfObject_ProgramDataBytes(context, context->active,
+                object->state.start +
+                    context->stream_offset / WHFU_BYTES_PER_UNIT,
+                tail, context->stream_tail);
+    }
+    if (ret == 0) {
+        ret = nfObject_ProgramFinish(context, context->active, entry,
+                object->metadata.len);
     }
     if (ret != 0) {
         return ret;
     }
+    context->stream_object = -1;
+
+    /* An add or tombstone of the id since the begin supersedes this entry,
+     * just as it will when the directory is parsed */
+    for (later = entry + 1; later < d->next_free_object; later++) {
+        if (    (d->objects[later].metadata.id == object->metadata.id) &&
+                ((d->objects[later].state.status == NF_STATUS_USED) ||
+                 NF_OBJECT_IS_TOMBSTONE(&d->objects[later]))) {
+            d->reclaimable_entries++;
+            d->reclaimable_data += object->state.count;
+            return 0;
+        }
+    }
+
+    /* Update directory to reclaim old entry and point the index at the new
+     * one */
+    object->state.status = NF_STATUS_USED;
+    if (nfMemDirectory_IndexSearch(d, object->metadata.id, &pos) == 0) {
+        d->objects[d->index_object[pos]].state.status = NF_STATUS_DATA_BAD;
+        d->reclaimable_entries++;
+        d->reclaimable_data += d->objects[d->index_object[pos]].state.count;
+        d->index_object[pos] = (uint16_t)entry;
+    } else {
+        nfMemDirectory_IndexInsert(d, pos, object->metadata.id, entry);
+    }
+    return 0;
+}
+
+/* Drop the streamed object so that compaction can copy again */
+int wh_NvmFlash_AddObjectAbort(void* c)
+{
+    whNvmFlashContext* context = c;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    nfStream_Abandon(context);
+    return 0;
+}
 
-    ret = nfPartition_ProgramEpoch(context, dest_part, new_state.epoch);
+/* Write the next epoch and start to the blank inactive partition */
+static int nfCompact_Start(whNvmFlashContext* context)
+{
+    int ret = 0;
+    int dest_part = !context->active;
+
+    ret = nfPartition_ProgramEpoch(context, dest_part,
+            context->state.epoch + 1);
     if (ret != 0) {
         return ret;
     }
 
     /* Write partition start */
-    ret = nfPartition_ProgramStart(context, dest_part, new_state.start);
+    ret = nfPartition_ProgramStart(context, dest_part, context->state.start);
+    if (ret != 0) {
+        return ret;
+    }
+
+    context->compact_entry = 0;
+    context->compact_object = 0;
+    context->compact_data = 0;
+    context->compact_step = NF_COMPACT_COPY;
+    return 0;
+}
+
+/* Wait for an erase started by a previous wh_NvmFlash_Compact step */
+static int nfCompact_WaitErase(whNvmFlashContext* context)
+{
+    int ret = 0;
+
+    if (    (context->compact_step == NF_COMPACT_PREPARE) ||
+            (context->compact_step == NF_COMPACT_ERASING)) {
+        do {
+            ret = nfPartition_ErasePoll(context, !context->active);
+        } while (ret == WH_ERROR_NOTREADY);
+        context->compact_step = NF_COMPACT_IDLE;
+    }
+    return ret;
+}
+
+/* Erase the inactive partition if not blank and start it.  Without wait,
+ * returns WH_ERROR_NOTREADY once the erase is started so that the
+ * NF_COMPACT_PREPARE step can poll it. */
+static int nfCompact_Begin(whNvmFlashContext* context, int wait)
+{
+    int ret = 0;
+    int dest_part = !context->active;
+
+    /* Blank check the inactive partition and erase if not blank */
+    ret = nfPartition_BlankCheck(context, dest_part);
+    if (ret == WH_ERROR_NOTBLANK) {
+        ret = nfPartition_EraseStart(context, dest_part);
+        if (ret == WH_ERROR_NOTREADY) {
+            context->compact_step = NF_COMPACT_PREPARE;
+            if (wait == 0) {
+                return ret;
+            }
+            ret = nfCompact_WaitErase(context);
+        }
+    }
     if (ret != 0) {
         return ret;
     }
 
-    /* Write each used object to new partition */
-    for (entry = 0; entry < NF_OBJECT_COUNT; entry++) {
-        if (d->objects[entry].state.status == NF_STATUS_USED) {
-            /* TODO: Handle errors here better. Break out of loop? */
-            ret = nfObject_Copy(context, entry,
-                    dest_part, &dest_object, &dest_data);
+    return nfCompact_Start(context);
+}
+
+/* Copy used objects to the new partition until about max_bytes of data have
+ * been copied, or all of them if max_bytes is 0.  Returns WH_ERROR_NOTREADY
+ * while objects remain.  Objects added meanwhile land after the current entry
+ * and are copied in turn. */
+static int nfCompact_Copy(whNvmFlashContext* context, uint32_t max_bytes)
+{
+    nfMemDirectory* d = &context->directory;
+    uint32_t copied = 0;
+    int ret = 0;
+
+    while (context->compact_entry < NF_OBJECT_COUNT) {
+        if ((max_bytes > 0) && (copied >= max_bytes)) {
+            return WH_ERROR_NOTREADY;
+        }
+        if (d->objects[context->compact_entry].state.status == NF_STATUS_USED) {
+            ret = nfObject_Copy(context, context->compact_entry,
+                    !context->active,
+                    &context->compact_object, &context->compact_data);
+            if (ret != 0) {
+                return ret;
+            }
+            copied += d->objects[context->compact_entry].metadata.len;
         }
+        context->compact_entry++;
     }
+    return 0;
+}
+
+/* Commit the new partition and switch to it */
+static int nfCompact_Finish(whNvmFlashContext* context)
+{
+    int ret = 0;
+    int src_part = context->active;
+    int dest_part = !context->active;
+    nfMemState new_state =  {0};
+
+    new_state =  (nfMemState)   {
+                                    .status = NF_STATUS_USED,
+                                    .epoch = context->state.epoch + 1,
+                                    .start = context->state.start,
+                                    .count = context->state.count,
+                                };
 
     /* Write partition count */
     ret = nfPartition_ProgramCount(context, dest_part, new_state.count);
@@ -1185,8 +1793,18 @@ int wh_NvmFlash_DestroyObjects(void* c, whNvmId list_count,
     }
 
     /* Read and parse the new directory */
-    ret = nfPartition_ReadParseMemDirectory(context,
+    ret = nfPartition_ReadMemDirectory(context,
             dest_part, &context->directory);
+#if WH_NVM_FLASH_CHECKPOINT
+    if (ret == 0) {
+        /* Optional.  Init reads every object without it */
+        (void)nfCheckpoint_Program(context, dest_part, new_state.epoch,
+                context->compact_object, context->compact_data);
+    }
+#endif
+    if (ret == 0) {
+        ret = nfMemDirectory_Parse(&context->directory);
+    }
     if (ret != 0) {
         /* Failed to reread the directory.  Read the previous one instead */
         (void)nfPartition_ReadParseMemDirectory(context,
@@ -1196,12 +1814,151 @@ int wh_NvmFlash_DestroyObjects(void* c, whNvmId list_count,
 
     /* Update to use new partition */
     context->active = dest_part;
-    new_state.status = NF_STATUS_USED;
     context->state = new_state;
+    context->compact_step = NF_COMPACT_ERASE;
+    return 0;
+}
 
-    /* Erase the old directory */
-    ret = nfPartition_Erase(context, src_part);
+/* Erase the old directory.  Without wait, returns WH_ERROR_NOTREADY once the
+ * erase is started so that the NF_COMPACT_ERASING step can poll it. */
+static int nfCompact_EraseOld(whNvmFlashContext* context, int wait)
+{
+    int ret = 0;
 
+    context->compact_step = NF_COMPACT_IDLE;
+    ret = nfPartition_EraseStart(context, !context->active);
+    if (ret == WH_ERROR_NOTREADY) {
+        context->compact_step = NF_COMPACT_ERASING;
+        if (wait == 0) {
+            return ret;
+        }
+        ret = nfCompact_WaitErase(context);
+    }
+    return ret;
+}
+
+/* Destroy a list of objects by replicating the current state without the id's
+ * in the provided list.  Id's in the list that are not present do not cause an
+ * error.  With WH_NVM_FLASH_TOMBSTONE, the ids are superseded in place until
+ * a compaction threshold is reached.
+ */
+int wh_NvmFlash_DestroyObjects(void* c, whNvmId list_count,
+        const whNvmId* id_list)
+{
+    int ret = 0;
+    whNvmFlashContext* context = c;
+    nfMemDirectory* d = NULL;
+    int list_entry = 0;
+    int pos = 0;
+
+    if (    (context == NULL) ||
+            ((list_count > 0) && (id_list == NULL)) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Removed objects may already be in a partially copied partition, so
+     * any compaction in progress starts over.  An object being streamed is
+     * left behind by the replication below and is abandoned then */
+    if (context->compact_step == NF_COMPACT_COPY) {
+        context->compact_step = NF_COMPACT_IDLE;
+    }
+
+#if WH_NVM_FLASH_TOMBSTONE
+    /* An empty list always compacts */
+    if (list_count > 0) {
+        ret = nfMemDirectory_Tombstone(context, list_count, id_list);
+        if (ret != WH_ERROR_NOSPACE) {
+            return ret;
+        }
+    }
+#endif
+
+    /* Context is valid.  Generate helper values */
+    d = &context->directory;
+    ret = nfCompact_WaitErase(context);
+    if (ret != 0) {
+        return ret;
+    }
+    context->compact_step = NF_COMPACT_IDLE;
+
+    /* Go through the current directory and mark the listed id's as bad */
+    for (list_entry = 0; list_entry < list_count; list_entry++) {
+        /* Older duplicates are already marked, so only the indexed entry is
+         * left to mark */
+        if (nfMemDirectory_IndexSearch(d, id_list[list_entry], &pos) == 0) {
+            d->objects[d->index_object[pos]].state.status = NF_STATUS_DATA_BAD;
+            nfMemDirectory_IndexRemove(d, pos);
+        }
+    }
+
+    context->stream_object = -1;
+    ret = nfCompact_Begin(context, 1);
+    if (ret == 0) {
+        ret = nfCompact_Copy(context, 0);
+    }
+    if (ret == 0) {
+        ret = nfCompact_Finish(context);
+    }
+    if (ret != 0) {
+        context->compact_step = NF_COMPACT_IDLE;
+        return ret;
+    }
+    return nfCompact_EraseOld(context, 1);
+}
+
+/* Replicate the current state a bounded amount at a time.  Reads and writes
+ * use the active partition until the switch in the final copy step. */
+int wh_NvmFlash_Compact(void* c, uint32_t max_bytes)
+{
+    int ret = 0;
+    whNvmFlashContext* context = c;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (    (context->stream_object >= 0) &&
+            ((context->compact_step == NF_COMPACT_IDLE) ||
+             (context->compact_step == NF_COMPACT_COPY))) {
+        /* The streamed entry would be left behind by the switch */
+        return WH_ERROR_LOCKED;
+    }
+
+    switch (context->compact_step) {
+    case NF_COMPACT_IDLE:
+        ret = nfCompact_Begin(context, 0);
+        break;
+    case NF_COMPACT_PREPARE:
+        ret = nfPartition_ErasePoll(context, !context->active);
+        if (ret == 0) {
+            ret = nfCompact_Start(context);
+        }
+        break;
+    case NF_COMPACT_COPY:
+        ret = nfCompact_Copy(context, max_bytes);
+        if (ret == 0) {
+            ret = nfCompact_Finish(context);
+        }
+        break;
+    case NF_COMPACT_ERASE:
+        return nfCompact_EraseOld(context, 0);
+    case NF_COMPACT_ERASING:
+        ret = nfPartition_ErasePoll(context, !context->active);
+        if (ret != WH_ERROR_NOTREADY) {
+            context->compact_step = NF_COMPACT_IDLE;
+        }
+        return ret;
+    default:
+        ret = WH_ERROR_ABORTED;
+        break;
+    }
+
+    if (ret == 0) {
+        /* More steps follow */
+        ret = WH_ERROR_NOTREADY;
+    } else if (ret != WH_ERROR_NOTREADY) {
+        context->compact_step = NF_COMPACT_IDLE;
+    }
     return ret;
 }
 
@@ -0,0 +1,949 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_nvm_flash_log.c
+ *
+ * NVM object management as a log across the erase blocks of a generic flash
+ * layer
+ *
+ */
+
+#include <stddef.h>     /* For NULL */
+#include <string.h>     /* For memset, memcpy, memmove */
+
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_flash.h"
+#include "wolfhsm/wh_flash_unit.h"
+#include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_nvm_flash_log.h"
+
+/* MSW of the block header and record delimiters must be set to this pattern
+ * to prevent hardware on certain chipsets from confusing zero values with
+ * erased flash */
+static const whFlashUnit BASE_STATE = 0x1234567800000000ull;
+#define NFL_BASE_MASK 0xFFFFFFFF00000000ull
+
+/* Kind of record, written in its commit unit */
+enum {
+    NFL_KIND_OBJECT     = 1,    /* Metadata and data of an id */
+    NFL_KIND_TOMBSTONE  = 2,    /* Metadata of a destroyed id */
+};
+
+/* On-flash layout of a block:
+ *   BASE_STATE | erase count
+ *   records, until the first blank unit
+ * and of a record:
+ *   BASE_STATE | sequence number
+ *   whNvmMetadata
+ *   data
+ *   BASE_STATE | kind, programmed last
+ */
+#define NFL_UNITS_PER_HEADER 1
+#define NFL_UNITS_PER_METADATA WHFU_BYTES2UNITS(sizeof(whNvmMetadata))
+#define NFL_RECORD_DATA_OFFSET (1 + NFL_UNITS_PER_METADATA)
+#define NFL_RECORD_UNITS(_len) \
+    (NFL_RECORD_DATA_OFFSET + WHFU_BYTES2UNITS(_len) + 1)
+
+#define NFL_SEQ_NONE 0xFFFFFFFFul
+
+/** Local declarations */
+static uint32_t nflBlock_Offset(whNvmFlashLogContext* context, int block);
+static int nflBlock_Format(whNvmFlashLogContext* context, int block,
+        uint32_t erase_count);
+static int nflBlock_Mount(whNvmFlashLogContext* context, int block,
+        uint32_t* inout_max_seq);
+static void nflBlock_Append(whNvmFlashLogContext* context, int block,
+        uint32_t units, uint32_t seq);
+static int nflBlock_SelectVictim(whNvmFlashLogContext* context, int wear);
+static int nflBlock_Collect(whNvmFlashLogContext* context, int block);
+
+static int nflRecord_Read(whNvmFlashLogContext* context, int block,
+        uint32_t offset, uint32_t* out_seq, int* out_kind, whNvmMetadata* meta);
+static int nflRecord_Program(whNvmFlashLogContext* context, int kind,
+        uint32_t seq, const whNvmMetadata* meta, const uint8_t* data);
+static int nflRecord_Copy(whNvmFlashLogContext* context, int block,
+        uint32_t offset, uint32_t units, uint32_t seq);
+
+static int nflHead_Open(whNvmFlashLogContext* context, uint32_t units,
+        int compacting);
+static int nflHead_Reserve(whNvmFlashLogContext* context, uint32_t units);
+
+static int nflIndex_Search(const whNvmFlashLogContext* context, whNvmId id,
+        int* out_pos);
+static int nflIndex_Update(whNvmFlashLogContext* context, int kind,
+        uint32_t seq, const whNvmMetadata* meta, int block, uint32_t offset);
+static void nflIndex_Remove(whNvmFlashLogContext* context, int pos);
+static int nflIndex_TombstoneExpired(whNvmFlashLogContext* context,
+        int block, uint32_t seq);
+static int nflIndex_Find(whNvmFlashLogContext* context, whNvmId id,
+        nflEntry** out_entry);
+
+
+static uint32_t nflBlock_Offset(whNvmFlashLogContext* context, int block)
+{
+    return (uint32_t)block * context->block_units;
+}
+
+/* Erase a block and write its header */
+static int nflBlock_Format(whNvmFlashLogContext* context, int block,
+        uint32_t erase_count)
+{
+    nflBlock* b = &context->blocks[block];
+    whFlashUnit header = BASE_STATE | erase_count;
+    uint32_t offset = nflBlock_Offset(context, block);
+    int ret = 0;
+
+    ret = wh_FlashUnit_Erase(context->cb, context->flash, offset,
+            context->block_units);
+    if (ret == 0) {
+        ret = wh_FlashUnit_Program(context->cb, context->flash, offset,
+                NFL_UNITS_PER_HEADER, &header);
+    }
+
+    memset(b, 0, sizeof(*b));
+    b->erase_count = erase_count;
+    b->min_seq = NFL_SEQ_NONE;
+    /* Nothing may be appended to a block that failed to format */
+    b->used = (ret == 0) ? NFL_UNITS_PER_HEADER : context->block_units;
+    return ret;
+}
+
+/* Scan the records of a block into the index, formatting it if it has no
+ * header */
+static int nflBlock_Mount(whNvmFlashLogContext* context, int block,
+        uint32_t* inout_max_seq)
+{
+    nflBlock* b = &context->blocks[block];
+    whFlashUnit header = 0;
+    whNvmMetadata meta;
+    uint32_t offset = nflBlock_Offset(context, block);
+    uint32_t units = 0;
+    uint32_t seq = 0;
+    int kind = 0;
+    int ret = 0;
+
+    ret = wh_FlashUnit_BlankCheck(context->cb, context->flash, offset,
+            NFL_UNITS_PER_HEADER);
+    if (ret == 0) {
+        /* Never formatted, or the erase before formatting was interrupted */
+        return nflBlock_Format(context, block, 0);
+    }
+
+    ret = wh_FlashUnit_Read(context->cb, context->flash, offset,
+            NFL_UNITS_PER_HEADER, &header);
+    if (ret != 0) {
+        return ret;
+    }
+    if ((header & NFL_BASE_MASK) != BASE_STATE) {
+        return nflBlock_Format(context, block, 0);
+    }
+
+    memset(b, 0, sizeof(*b));
+    b->erase_count = (uint32_t)header;
+    b->min_seq = NFL_SEQ_NONE;
+    b->used = NFL_UNITS_PER_HEADER;
+
+    while (b->used < context->block_units) {
+        ret = nflRecord_Read(context, block, b->used, &seq, &kind, &meta);
+        if (ret == WH_ERROR_NOTFOUND) {
+            ret = 0;
+            break;
+        }
+        if (ret == WH_ERROR_ABORTED) {
+            /* Interrupted append.  Leave the rest of the block to compaction */
+            b->used = context->block_units;
+            ret = 0;
+            break;
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        offset = b->used;
+        units = NFL_RECORD_UNITS(meta.len);
+        nflBlock_Append(context, block, units, seq);
+        ret = nflIndex_Update(context, kind, seq, &meta, block, offset);
+        if (ret != 0) {
+            break;
+        }
+        if ((seq >= *inout_max_seq) || (*inout_max_seq == NFL_SEQ_NONE)) {
+            *inout_max_seq = seq;
+            context->head = block;
+        }
+    }
+    return ret;
+}
+
+/* Account for a record written at the end of a block */
+static void nflBlock_Append(whNvmFlashLogContext* context, int block,
+        uint32_t units, uint32_t seq)
+{
+    nflBlock* b = &context->blocks[block];
+
+    b->used += units;
+    b->records++;
+    if (seq < b->min_seq) {
+        b->min_seq = seq;
+    }
+}
+
+/* Choose the block to compact, or -1 when there is none.  Prefers the fewest
+ * live units, so the most space is freed, then the fewest erases.  With wear
+ * set, the least erased block is chosen once it lags too far behind. */
+static int nflBlock_SelectVictim(whNvmFlashLogContext* context, int wear)
+{
+    int victim = -1;
+    int coldest = -1;
+    uint32_t max_erase = 0;
+    uint32_t block = 0;
+    const nflBlock* b = NULL;
+
+    for (block = 0; block < context->block_count; block++) {
+        b = &context->blocks[block];
+        if (b->erase_count > max_erase) {
+            max_erase = b->erase_count;
+        }
+        if (    ((int)block == context->head) ||
+                (b->used <= NFL_UNITS_PER_HEADER)) {
+            continue;
+        }
+        if (    (coldest < 0) ||
+                (b->erase_count < context->blocks[coldest].erase_count)) {
+            coldest = block;
+        }
+        if (b->used == NFL_UNITS_PER_HEADER + b->live) {
+            /* Nothing to reclaim */
+            continue;
+        }
+        if (    (victim < 0) ||
+                (b->live < context->blocks[victim].live) ||
+                ((b->live == context->blocks[victim].live) &&
+                 (b->erase_count < context->blocks[victim].erase_count))) {
+            victim = block;
+        }
+    }
+
+    if (    (wear != 0) &&
+            (coldest >= 0) &&
+            (max_erase - context->blocks[coldest].erase_count >
+                WH_NVM_FLASH_LOG_WEAR_LIMIT)) {
+        return coldest;
+    }
+    return victim;
+}
+
+/* Copy the current records of a block to the head, then erase it */
+static int nflBlock_Collect(whNvmFlashLogContext* context, int block)
+{
+    nflBlock* b = &context->blocks[block];
+    nflEntry* e = NULL;
+    whNvmMetadata meta;
+    uint32_t offset = NFL_UNITS_PER_HEADER;
+    uint32_t units = 0;
+    uint32_t seq = 0;
+    int kind = 0;
+    int pos = 0;
+    int ret = 0;
+
+    if (context->head == block) {
+        context->head = -1;
+    }
+
+    while ((offset < b->used) && (b->live_records > 0)) {
+        ret = nflRecord_Read(context, block, offset, &seq, &kind, &meta);
+        if ((ret == WH_ERROR_NOTFOUND) || (ret == WH_ERROR_ABORTED)) {
+            break;
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        units = NFL_RECORD_UNITS(meta.len);
+
+        if (    (nflIndex_Search(context, meta.id, &pos) == 0) &&
+                (context->entries[pos].block == block) &&
+                (context->entries[pos].offset == offset)) {
+            e = &context->entries[pos];
+            if (    (e->tombstone != 0) &&
+                    (nflIndex_TombstoneExpired(context, block, seq) != 0)) {
+                /* No older record of the id is left to hide */
+                nflIndex_Remove(context, pos);
+            } else {
+                ret = nflHead_Open(context, units, 1);
+                if (ret == 0) {
+                    e->offset = context->blocks[context->head].used;
+                    ret = nflRecord_Copy(context, block, offset, units, seq);
+                }
+                if (ret != 0) {
+                    return ret;
+                }
+                e->block = context->head;
+                context->blocks[context->head].live += units;
+                context->blocks[context->head].live_records++;
+            }
+            b->live -= units;
+            b->live_records--;
+        }
+        offset += units;
+    }
+
+    return nflBlock_Format(context, block, b->erase_count + 1);
+}
+
+/* Read the delimiters and metadata of the record at offset within a block.
+ * Returns WH_ERROR_NOTFOUND at the end of the log and WH_ERROR_ABORTED for a
+ * record that was never committed or is damaged */
+static int nflRecord_Read(whNvmFlashLogContext* context, int block,
+        uint32_t offset, uint32_t* out_seq, int* out_kind, whNvmMetadata* meta)
+{
+    whFlashUnit unit = 0;
+    uint32_t start = nflBlock_Offset(context, block) + offset;
+    uint32_t units = 0;
+    int ret = 0;
+
+    if (offset + NFL_RECORD_UNITS(0) > context->block_units) {
+        return WH_ERROR_NOTFOUND;
+    }
+    ret = wh_FlashUnit_BlankCheck(context->cb, context->flash, start, 1);
+    if (ret == 0) {
+        return WH_ERROR_NOTFOUND;
+    }
+
+    ret = wh_FlashUnit_Read(context->cb, context->flash, start, 1, &unit);
+    if (ret != 0) {
+        return ret;
+    }
+    if ((unit & NFL_BASE_MASK) != BASE_STATE) {
+        return WH_ERROR_ABORTED;
+    }
+    *out_seq = (uint32_t)unit;
+
+    ret = wh_FlashUnit_ReadBytes(context->cb, context->flash,
+            (start + 1) * WHFU_BYTES_PER_UNIT, sizeof(*meta),
+            (uint8_t*)meta);
+    if (ret != 0) {
+        return ret;
+    }
+    units = NFL_RECORD_UNITS(meta->len);
+    if (offset + units > context->block_units) {
+        return WH_ERROR_ABORTED;
+    }
+
+    ret = wh_FlashUnit_BlankCheck(context->cb, context->flash,
+            start + units - 1, 1);
+    if (ret == 0) {
+        return WH_ERROR_ABORTED;
+    }
+    ret = wh_FlashUnit_Read(context->cb, context->flash, start + units - 1, 1,
+            &unit);
+    if (ret != 0) {
+        return ret;
+    }
+    if (    ((unit & NFL_BASE_MASK) != BASE_STATE) ||
+            (((uint32_t)unit != NFL_KIND_OBJECT) &&
+             ((uint32_t)unit != NFL_KIND_TOMBSTONE))) {
+        return WH_ERROR_ABORTED;
+    }
+    *out_kind = (int)(uint32_t)unit;
+    return 0;
+}
+
+/* Append a record at the head, which must have room for it */
+static int nflRecord_Program(whNvmFlashLogContext* context, int kind,
+        uint32_t seq, const whNvmMetadata* meta, const uint8_t* data)
+{
+    nflBlock* b = &context->blocks[context->head];
+    uint32_t start = nflBlock_Offset(context, context->head) + b->used;
+    uint32_t units = NFL_RECORD_UNITS(meta->len);
+    whFlashUnit unit = BASE_STATE | seq;
+    whFlashUnitSegment segments[5];
+    whFlashUnitBuffer tails[2];
+    uint32_t count = 0;
+    int ret = 0;
+
+    /* Sequence, metadata and data are adjacent, so go in one request */
+    segments[count].data = &unit;
+    segments[count].offset = start;
+    segments[count].count = 1;
+    count++;
+    count += wh_FlashUnit_BytesSegments((start + 1) * WHFU_BYTES_PER_UNIT,
+            sizeof(*meta), (const uint8_t*)meta, &tails[0], &segments[count]);
+    if (meta->len > 0) {
+        count += wh_FlashUnit_BytesSegments(
+                (start + NFL_RECORD_DATA_OFFSET) * WHFU_BYTES_PER_UNIT,
+                meta->len, data, &tails[1], &segments[count]);
+    }
+    ret = wh_FlashUnit_ProgramV(context->cb, context->flash, segments, count);
+    if (ret == 0) {
+        unit = BASE_STATE | (uint32_t)kind;
+        ret = wh_FlashUnit_Program(context->cb, context->flash,
+                start + units - 1, 1, &unit);
+    }
+
+    if (ret != 0) {
+        /* Don't append over a partial record */
+        b->used = context->block_units;
+        return ret;
+    }
+    nflBlock_Append(context, context->head, units, seq);
+    return 0;
+}
+
+/* Copy a record to the head, which must have room for it, committing last */
+static int nflRecord_Copy(whNvmFlashLogContext* context, int block,
+        uint32_t offset, uint32_t units, uint32_t seq)
+{
+    nflBlock* b = &context->blocks[context->head];
+    uint32_t src = nflBlock_Offset(context, block) + offset;
+    uint32_t dst = nflBlock_Offset(context, context->head) + b->used;
+    int ret = 0;
+
+    ret = wh_FlashUnit_Copy(context->cb, context->flash, src, dst, units - 1);
+    if (ret == 0) {
+        ret = wh_FlashUnit_Copy(context->cb, context->flash, src + units - 1,
+                dst + units - 1, 1);
+    }
+
+    if (ret != 0) {
+        b->used = context->block_units;
+        return ret;
+    }
+    nflBlock_Append(context, context->head, units, seq);
+    return 0;
+}
+
+/* Make sure the head has room for a record, moving it to the least erased
+ * free block if necessary.  Only compaction may use the reserved blocks. */
+static int nflHead_Open(whNvmFlashLogContext* context, uint32_t units,
+        int compacting)
+{
+    int free_count = 0;
+    int best = -1;
+    uint32_t block = 0;
+
+    if (units > context->block_units - NFL_UNITS_PER_HEADER) {
+        return WH_ERROR_NOSPACE;
+    }
+    if (    (context->head >= 0) &&
+            (context->blocks[context->head].used + units <=
+                context->block_units)) {
+        return 0;
+    }
+
+    for (block = 0; block < context->block_count; block++) {
+        if (    ((int)block == context->head) ||
+                (context->blocks[block].used != NFL_UNITS_PER_HEADER)) {
+            continue;
+        }
+        free_count++;
+        if (    (best < 0) ||
+                (context->blocks[block].erase_count <
+                    context->blocks[best].erase_count)) {
+            best = block;
+        }
+    }
+    if (    (best < 0) ||
+            ((compacting == 0) &&
+             (free_count <= WH_NVM_FLASH_LOG_RESERVE_BLOCKS))) {
+        return WH_ERROR_NOSPACE;
+    }
+    context->head = best;
+    return 0;
+}
+
+/* Open the head for a new record, compacting blocks as necessary */
+static int nflHead_Reserve(whNvmFlashLogContext* context, uint32_t units)
+{
+    uint32_t tries = 0;
+    int victim = 0;
+    int ret = 0;
+
+    if (units > context->block_units - NFL_UNITS_PER_HEADER) {
+        return WH_ERROR_NOSPACE;
+    }
+
+    ret = nflHead_Open(context, units, 0);
+    for (tries = 0;
+            (ret == WH_ERROR_NOSPACE) && (tries < context->block_count);
+            tries++) {
+        /* The full head may be compacted like any other block */
+        context->head = -1;
+        victim = nflBlock_SelectVictim(context, 1);
+        if (victim < 0) {
+            break;
+        }
+        ret = nflBlock_Collect(context, victim);
+        if (ret == 0) {
+            ret = nflHead_Open(context, units, 0);
+        }
+    }
+    return ret;
+}
+
+static int nflIndex_Search(const whNvmFlashLogContext* context, whNvmId id,
+        int* out_pos)
+{
+    int lo = 0;
+    int hi = context->entry_count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (context->entries[mid].metadata.id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (out_pos != NULL) *out_pos = lo;
+    if (    (lo < context->entry_count) &&
+            (context->entries[lo].metadata.id == id)) {
+        return 0;
+    }
+    return WH_ERROR_NOTFOUND;
+}
+
+/* Point the index at a newer record of an id.  Records older than the current
+ * one, such as copies left by an interrupted compaction, are ignored. */
+static int nflIndex_Update(whNvmFlashLogContext* context, int kind,
+        uint32_t seq, const whNvmMetadata* meta, int block, uint32_t offset)
+{
+    nflEntry* e = NULL;
+    nflBlock* old = NULL;
+    int pos = 0;
+    int move = 0;
+
+    if (nflIndex_Search(context, meta->id, &pos) == 0) {
+        e = &context->entries[pos];
+        if (e->seq >= seq) {
+            return 0;
+        }
+        old = &context->blocks[e->block];
+        old->live -= NFL_RECORD_UNITS(e->metadata.len);
+        old->live_records--;
+        if (e->tombstone == 0) {
+            context->object_count--;
+        }
+    } else {
+        if (context->entry_count >= WH_NVM_FLASH_LOG_ENTRY_COUNT) {
+            return WH_ERROR_NOSPACE;
+        }
+        move = context->entry_count - pos;
+        if (move > 0) {
+            memmove(&context->entries[pos + 1], &context->entries[pos],
+                    move * sizeof(context->entries[0]));
+        }
+        context->entry_count++;
+        e = &context->entries[pos];
+    }
+
+    memcpy(&e->metadata, meta, sizeof(e->metadata));
+    e->seq = seq;
+    e->offset = offset;
+    e->block = (uint16_t)block;
+    e->tombstone = (kind == NFL_KIND_TOMBSTONE);
+    if (e->tombstone == 0) {
+        context->object_count++;
+    }
+    context->blocks[block].live += NFL_RECORD_UNITS(meta->len);
+    context->blocks[block].live_records++;
+    return 0;
+}
+
+static void nflIndex_Remove(whNvmFlashLogContext* context, int pos)
+{
+    int move = context->entry_count - pos - 1;
+
+    if (move > 0) {
+        memmove(&context->entries[pos], &context->entries[pos + 1],
+                move * sizeof(context->entries[0]));
+    }
+    context->entry_count--;
+}
+
+/* A tombstone may be dropped once no block other than its own can hold an
+ * older record */
+static int nflIndex_TombstoneExpired(whNvmFlashLogContext* context,
+        int block, uint32_t seq)
+{
+    uint32_t other = 0;
+
+    for (other = 0; other < context->block_count; other++) {
+        if (    ((int)other != block) &&
+                (context->blocks[other].min_seq < seq)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int nflIndex_Find(whNvmFlashLogContext* context, whNvmId id,
+        nflEntry** out_entry)
+{
+    int pos = 0;
+
+    if (    (nflIndex_Search(context, id, &pos) != 0) ||
+            (context->entries[pos].tombstone != 0)) {
+        return WH_ERROR_NOTFOUND;
+    }
+    *out_entry = &context->entries[pos];
+    return 0;
+}
+
+int wh_NvmFlashLog_Init(void* c, const void* cf)
+{
+    whNvmFlashLogContext* context = c;
+    const whNvmFlashLogConfig* config = cf;
+    uint32_t total_size = 0;
+    uint32_t max_seq = NFL_SEQ_NONE;
+    uint32_t block = 0;
+    int ret = 0;
+
+    if (    (context == NULL) ||
+            (config == NULL) ||
+            (config->cb == NULL) ||
+            (config->block_size < WHFU_BYTES_PER_UNIT *
+                (NFL_UNITS_PER_HEADER + NFL_RECORD_UNITS(0))) ||
+            (config->block_size % WHFU_BYTES_PER_UNIT != 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (config->cb->Init != NULL) {
+        ret = config->cb->Init(config->context, config->config);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Initialize and setup context */
+    memset(context, 0, sizeof(*context));
+    context->cb = config->cb;
+    context->flash = config->context;
+    context->block_units = config->block_size / WHFU_BYTES_PER_UNIT;
+    context->head = -1;
+
+    /* By default, blocks cover both partitions of the flash device */
+    context->block_count = config->block_count;
+    if (context->block_count == 0) {
+        if (context->cb->PartitionSize != NULL) {
+            total_size = 2 * context->cb->PartitionSize(context->flash);
+        }
+        context->block_count = total_size / config->block_size;
+        if (context->block_count > WH_NVM_FLASH_LOG_MAX_BLOCKS) {
+            context->block_count = WH_NVM_FLASH_LOG_MAX_BLOCKS;
+        }
+    }
+    if (    (context->block_count <= WH_NVM_FLASH_LOG_RESERVE_BLOCKS) ||
+            (context->block_count > WH_NVM_FLASH_LOG_MAX_BLOCKS)) {
+        if (context->cb->Cleanup != NULL) {
+            (void)context->cb->Cleanup(context->flash);
+        }
+        return WH_ERROR_BADARGS;
+    }
+
+    (void)wh_FlashUnit_WriteUnlock(context->cb, context->flash, 0,
+            context->block_count * context->block_units);
+    context->initialized = 1;
+
+    for (block = 0; (ret == 0) && (block < context->block_count); block++) {
+        ret = nflBlock_Mount(context, block, &max_seq);
+    }
+    if (ret != 0) {
+        (void)wh_NvmFlashLog_Cleanup(context);
+        return ret;
+    }
+    context->next_seq = (max_seq == NFL_SEQ_NONE) ? 0 : max_seq + 1;
+    return 0;
+}
+
+int wh_NvmFlashLog_Cleanup(void* c)
+{
+    whNvmFlashLogContext* context = c;
+    int rc = 0;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (context->initialized == 0) {
+        /* Already cleaned up*/
+        return 0;
+    }
+
+    /* Ignore errors here */
+    (void)wh_FlashUnit_WriteLock(context->cb, context->flash, 0,
+            context->block_count * context->block_units);
+
+    if (context->cb->Cleanup != NULL) {
+        rc = context->cb->Cleanup(context->flash);
+    }
+    context->initialized = 0;
+    return rc;
+}
+
+int wh_NvmFlashLog_List(void* c,
+        whNvmAccess access, whNvmFlags flags, whNvmId start_id,
+        whNvmId *out_count, whNvmId *out_id)
+{
+    /* TODO: Implement access and flag matching */
+    (void)access; (void)flags;
+
+    whNvmFlashLogContext* context = c;
+    int pos = 0;
+    whNvmId this_count = 0;
+    whNvmId this_id = 0;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Start after start_id, or at the beginning */
+    if (start_id != 0) {
+        if (nflIndex_Search(context, start_id, &pos) == 0) {
+            pos++;
+        } else {
+            pos = context->entry_count;
+        }
+    }
+
+    for (; pos < context->entry_count; pos++) {
+        if (context->entries[pos].tombstone == 0) {
+            if (this_count == 0) {
+                this_id = context->entries[pos].metadata.id;
+            }
+            this_count++;
+        }
+    }
+
+    if (out_count != NULL) *out_count = this_count;
+    if (out_id != NULL) *out_id = this_id;
+    return 0;
+}
+
+int wh_NvmFlashLog_GetAvailable(void* c,
+        uint32_t *out_avail_size, whNvmId *out_avail_objects,
+        uint32_t *out_reclaim_size, whNvmId *out_reclaim_objects)
+{
+    whNvmFlashLogContext* context = c;
+    uint32_t avail = 0;
+    uint32_t reclaim = 0;
+    uint32_t free_count = 0;
+    whNvmId reclaim_objects = 0;
+    uint32_t block = 0;
+    const nflBlock* b = NULL;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    for (block = 0; block < context->block_count; block++) {
+        b = &context->blocks[block];
+        if ((int)block == context->head) {
+            avail += context->block_units - b->used;
+        } else if (b->used == NFL_UNITS_PER_HEADER) {
+            free_count++;
+        }
+        reclaim += b->used - NFL_UNITS_PER_HEADER - b->live;
+        reclaim_objects += b->records - b->live_records;
+    }
+    if (free_count > WH_NVM_FLASH_LOG_RESERVE_BLOCKS) {
+        avail += (free_count - WH_NVM_FLASH_LOG_RESERVE_BLOCKS) *
+                (context->block_units - NFL_UNITS_PER_HEADER);
+    }
+
+    if (out_avail_size != NULL) {
+        *out_avail_size = avail * WHFU_BYTES_PER_UNIT;
+    }
+    if (out_avail_objects != NULL) {
+        *out_avail_objects = NFL_OBJECT_COUNT - context->object_count;
+    }
+    if (out_reclaim_size != NULL) {
+        *out_reclaim_size = reclaim * WHFU_BYTES_PER_UNIT;
+    }
+    if (out_reclaim_objects != NULL) {
+        *out_reclaim_objects = reclaim_objects;
+    }
+    return 0;
+}
+
+int wh_NvmFlashLog_GetMetadata(void* c, whNvmId id, whNvmMetadata* meta)
+{
+    whNvmFlashLogContext* context = c;
+    nflEntry* e = NULL;
+    int ret = 0;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    ret = nflIndex_Find(context, id, &e);
+    if ((ret == 0) && (meta != NULL)) {
+        memcpy(meta, &e->metadata, sizeof(*meta));
+    }
+    return ret;
+}
+
+int wh_NvmFlashLog_AddObject(void* c, whNvmMetadata *meta,
+        whNvmSize data_len, const uint8_t* data)
+{
+    whNvmFlashLogContext* context = c;
+    nflEntry* e = NULL;
+    int victim = 0;
+    int ret = 0;
+
+    if (    (context == NULL) ||
+            (meta == NULL) ||
+            ((data_len > 0) && (data == NULL)) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (nflIndex_Find(context, meta->id, &e) != 0) {
+        if (context->object_count >= NFL_OBJECT_COUNT) {
+            return WH_ERROR_NOSPACE;
+        }
+        /* Drop expired tombstones to make room for a new id */
+        while (     (nflIndex_Search(context, meta->id, NULL) != 0) &&
+                    (context->entry_count >= WH_NVM_FLASH_LOG_ENTRY_COUNT)) {
+            victim = nflBlock_SelectVictim(context, 0);
+            if (victim < 0) {
+                return WH_ERROR_NOSPACE;
+            }
+            ret = nflBlock_Collect(context, victim);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+
+    /* Update meta with data size */
+    meta->len = data_len;
+
+    ret = nflHead_Reserve(context, NFL_RECORD_UNITS(meta->len));
+    if (ret == 0) {
+        ret = nflRecord_Program(context, NFL_KIND_OBJECT, context->next_seq,
+                meta, data);
+    }
+    if (ret == 0) {
+        ret = nflIndex_Update(context, NFL_KIND_OBJECT, context->next_seq,
+                meta, context->head,
+                context->blocks[context->head].used -
+                    NFL_RECORD_UNITS(meta->len));
+        context->next_seq++;
+    }
+    return ret;
+}
+
+int wh_NvmFlashLog_DestroyObjects(void* c, whNvmId list_count,
+        const whNvmId* id_list)
+{
+    whNvmFlashLogContext* context = c;
+    whNvmMetadata meta;
+    nflEntry* e = NULL;
+    whNvmId list_entry = 0;
+    int victim = 0;
+    int ret = 0;
+
+    if (    (context == NULL) ||
+            ((list_count > 0) && (id_list == NULL))) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (list_count == 0) {
+        /* Reclaim everything possible */
+        while ((ret == 0) &&
+                ((victim = nflBlock_SelectVictim(context, 0)) >= 0)) {
+            ret = nflBlock_Collect(context, victim);
+        }
+        return ret;
+    }
+
+    for (list_entry = 0; list_entry < list_count; list_entry++) {
+        if (nflIndex_Find(context, id_list[list_entry], &e) != 0) {
+            /* Not present */
+            continue;
+        }
+        memcpy(&meta, &e->metadata, sizeof(meta));
+        meta.len = 0;
+
+        ret = nflHead_Reserve(context, NFL_RECORD_UNITS(0));
+        if (ret == 0) {
+            ret = nflRecord_Program(context, NFL_KIND_TOMBSTONE,
+                    context->next_seq, &meta, NULL);
+        }
+        if (ret == 0) {
+            ret = nflIndex_Update(context, NFL_KIND_TOMBSTONE,
+                    context->next_seq, &meta, context->head,
+                    context->blocks[context->head].used -
+                        NFL_RECORD_UNITS(0));
+            context->next_seq++;
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    return ret;
+}
+
+int wh_NvmFlashLog_Read(void* c, whNvmId id, whNvmSize offset,
+        whNvmSize data_len, uint8_t* data)
+{
+    whNvmFlashLogContext* context = c;
+    nflEntry* e = NULL;
+    uint32_t start = 0;
+    int ret = 0;
+
+    if (    (context == NULL) ||
+            ((data_len > 0) && (data == NULL)) ){
+        return WH_ERROR_BADARGS;
+    }
+
+    ret = nflIndex_Find(context, id, &e);
+    if (ret != 0) {
+        return ret;
+    }
+    if ((uint32_t)offset + data_len > e->metadata.len) {
+        return WH_ERROR_BADARGS;
+    }
+
+    start = nflBlock_Offset(context, e->block) + e->offset +
+            NFL_RECORD_DATA_OFFSET;
+    return wh_FlashUnit_ReadBytes(context->cb, context->flash,
+            start * WHFU_BYTES_PER_UNIT + offset, data_len, data);
+}
+
+int wh_NvmFlashLog_Compact(void* c, uint32_t max_bytes)
+{
+    whNvmFlashLogContext* context = c;
+    int victim = 0;
+    int ret = 0;
+
+    (void)max_bytes;
+
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    victim = nflBlock_SelectVictim(context, 0);
+    if (victim >= 0) {
+        ret = nflBlock_Collect(context, victim);
+        if ((ret == 0) && (nflBlock_SelectVictim(context, 0) >= 0)) {
+            ret = WH_ERROR_NOTREADY;
+        }
+    }
+    return ret;
+}
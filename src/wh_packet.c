@@ -0,0 +1,686 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_packet.c
+ *
+ * Field tables for the whPacket messages of the key, crypto and SHE groups
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef WOLFHSM_NO_CRYPTO
+
+#include "wolfssl/wolfcrypt/settings.h"
+#include "wolfssl/wolfcrypt/types.h"
+
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_packet.h"
+
+#define WH_PACKET_FIELD(_f) WH_COMM_FIELD(whPacket, _f)
+
+static const whCommField _stubFields[] = {
+    WH_PACKET_FIELD(rc),
+    WH_PACKET_FIELD(flags),
+    WH_COMM_FIELD_END
+};
+
+/* Responses that are only the stub */
+static const whCommField _noFields[] = {
+    WH_COMM_FIELD_END
+};
+
+/* Key requests and responses */
+static const whCommField _keyCacheReqFields[] = {
+    WH_PACKET_FIELD(keyCacheReq.flags),
+    WH_PACKET_FIELD(keyCacheReq.sz),
+    WH_PACKET_FIELD(keyCacheReq.labelSz),
+    WH_PACKET_FIELD(keyCacheReq.id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyCacheResFields[] = {
+    WH_PACKET_FIELD(keyCacheRes.id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyCacheDmaReqFields[] = {
+    WH_PACKET_FIELD(keyCacheDmaReq.keyAddr),
+    WH_PACKET_FIELD(keyCacheDmaReq.flags),
+    WH_PACKET_FIELD(keyCacheDmaReq.sz),
+    WH_PACKET_FIELD(keyCacheDmaReq.labelSz),
+    WH_PACKET_FIELD(keyCacheDmaReq.id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyExportDmaReqFields[] = {
+    WH_PACKET_FIELD(keyExportDmaReq.keyAddr),
+    WH_PACKET_FIELD(keyExportDmaReq.sz),
+    WH_PACKET_FIELD(keyExportDmaReq.id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyExportPublicReqFields[] = {
+    WH_PACKET_FIELD(keyExportPublicReq.id),
+    WH_PACKET_FIELD(keyExportPublicReq.type),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyExportResFields[] = {
+    WH_PACKET_FIELD(keyExportRes.len),
+    WH_COMM_FIELD_END
+};
+
+/* Evict, commit, export and erase requests are a single id, and their
+ * responses a single word, at the start of the body */
+static const whCommField _keyIdReqFields[] = {
+    WH_PACKET_FIELD(keyEvictReq.id),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyGenerationResFields[] = {
+    WH_PACKET_FIELD(keyGenerationRes.generation),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyOkResFields[] = {
+    WH_PACKET_FIELD(keyEvictRes.ok),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyRsakgStartReqFields[] = {
+    WH_PACKET_FIELD(keyRsakgStartReq.size),
+    WH_PACKET_FIELD(keyRsakgStartReq.e),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyJobStartResFields[] = {
+    WH_PACKET_FIELD(keyJobStartRes.jobId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyJobStatusReqFields[] = {
+    WH_PACKET_FIELD(keyJobStatusReq.jobId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _keyJobStatusResFields[] = {
+    WH_PACKET_FIELD(keyJobStatusRes.done),
+    WH_PACKET_FIELD(keyJobStatusRes.keyId),
+    WH_COMM_FIELD_END
+};
+
+/* Cipher requests and responses */
+static const whCommField _aesCbcReqFields[] = {
+    WH_PACKET_FIELD(cipherAesCbcReq.type),
+    WH_PACKET_FIELD(cipherAesCbcReq.enc),
+    WH_PACKET_FIELD(cipherAesCbcReq.keyLen),
+    WH_PACKET_FIELD(cipherAesCbcReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _aesCbcResFields[] = {
+    WH_PACKET_FIELD(cipherAesCbcRes.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _aesGcmReqFields[] = {
+    WH_PACKET_FIELD(cipherAesGcmReq.type),
+    WH_PACKET_FIELD(cipherAesGcmReq.enc),
+    WH_PACKET_FIELD(cipherAesGcmReq.keyLen),
+    WH_PACKET_FIELD(cipherAesGcmReq.sz),
+    WH_PACKET_FIELD(cipherAesGcmReq.ivSz),
+    WH_PACKET_FIELD(cipherAesGcmReq.authInSz),
+    WH_PACKET_FIELD(cipherAesGcmReq.authTagSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _aesGcmResFields[] = {
+    WH_PACKET_FIELD(cipherAesGcmRes.sz),
+    WH_PACKET_FIELD(cipherAesGcmRes.authTagSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _streamInitReqFields[] = {
+    WH_PACKET_FIELD(cipherStreamInitReq.type),
+    WH_PACKET_FIELD(cipherStreamInitReq.enc),
+    WH_PACKET_FIELD(cipherStreamInitReq.keyLen),
+    WH_PACKET_FIELD(cipherStreamInitReq.ivSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _streamInitResFields[] = {
+    WH_PACKET_FIELD(cipherStreamInitRes.handle),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _streamUpdateReqFields[] = {
+    WH_PACKET_FIELD(cipherStreamUpdateReq.handle),
+    WH_PACKET_FIELD(cipherStreamUpdateReq.sz),
+    WH_PACKET_FIELD(cipherStreamUpdateReq.authInSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _streamUpdateResFields[] = {
+    WH_PACKET_FIELD(cipherStreamUpdateRes.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _streamFinalReqFields[] = {
+    WH_PACKET_FIELD(cipherStreamFinalReq.handle),
+    WH_PACKET_FIELD(cipherStreamFinalReq.authTagSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _streamFinalResFields[] = {
+    WH_PACKET_FIELD(cipherStreamFinalRes.authTagSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _cipherDmaReqFields[] = {
+    WH_PACKET_FIELD(cipherDmaReq.inAddr),
+    WH_PACKET_FIELD(cipherDmaReq.outAddr),
+    WH_PACKET_FIELD(cipherDmaReq.authInAddr),
+    WH_PACKET_FIELD(cipherDmaReq.type),
+    WH_PACKET_FIELD(cipherDmaReq.enc),
+    WH_PACKET_FIELD(cipherDmaReq.keyLen),
+    WH_PACKET_FIELD(cipherDmaReq.sz),
+    WH_PACKET_FIELD(cipherDmaReq.ivSz),
+    WH_PACKET_FIELD(cipherDmaReq.authInSz),
+    WH_PACKET_FIELD(cipherDmaReq.authTagSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _cipherDmaResFields[] = {
+    WH_PACKET_FIELD(cipherDmaRes.sz),
+    WH_PACKET_FIELD(cipherDmaRes.authTagSz),
+    WH_COMM_FIELD_END
+};
+
+/* Hash, HMAC and CMAC requests and responses */
+static const whCommField _hashReqFields[] = {
+    WH_PACKET_FIELD(hashReq.type),
+    WH_PACKET_FIELD(hashReq.handle),
+    WH_PACKET_FIELD(hashReq.keyId),
+    WH_PACKET_FIELD(hashReq.sz),
+    WH_PACKET_FIELD(hashReq.final),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _hashResFields[] = {
+    WH_PACKET_FIELD(hashRes.handle),
+    WH_PACKET_FIELD(hashRes.digestSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _hashDmaReqFields[] = {
+    WH_PACKET_FIELD(hashDmaReq.inAddr),
+    WH_PACKET_FIELD(hashDmaReq.type),
+    WH_PACKET_FIELD(hashDmaReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _hashDmaResFields[] = {
+    WH_PACKET_FIELD(hashDmaRes.digestSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _cmacReqFields[] = {
+    WH_PACKET_FIELD(cmacReq.handle),
+    WH_PACKET_FIELD(cmacReq.type),
+    WH_PACKET_FIELD(cmacReq.inSz),
+    WH_PACKET_FIELD(cmacReq.keySz),
+    WH_PACKET_FIELD(cmacReq.outSz),
+    WH_PACKET_FIELD(cmacReq.keyId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _cmacResFields[] = {
+    WH_PACKET_FIELD(cmacRes.handle),
+    WH_PACKET_FIELD(cmacRes.outSz),
+    WH_COMM_FIELD_END
+};
+
+/* RNG requests and responses */
+static const whCommField _rngReqFields[] = {
+    WH_PACKET_FIELD(rngReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _rngResFields[] = {
+    WH_PACKET_FIELD(rngRes.sz),
+    WH_COMM_FIELD_END
+};
+
+/* Public key requests and responses */
+static const whCommField _rsakgReqFields[] = {
+    WH_PACKET_FIELD(pkRsakgReq.type),
+    WH_PACKET_FIELD(pkRsakgReq.size),
+    WH_PACKET_FIELD(pkRsakgReq.e),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _rsaReqFields[] = {
+    WH_PACKET_FIELD(pkRsaReq.type),
+    WH_PACKET_FIELD(pkRsaReq.opType),
+    WH_PACKET_FIELD(pkRsaReq.keyId),
+    WH_PACKET_FIELD(pkRsaReq.inLen),
+    WH_PACKET_FIELD(pkRsaReq.outLen),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _rsaGetSizeReqFields[] = {
+    WH_PACKET_FIELD(pkRsaGetSizeReq.type),
+    WH_PACKET_FIELD(pkRsaGetSizeReq.keyId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _eckgReqFields[] = {
+    WH_PACKET_FIELD(pkEckgReq.type),
+    WH_PACKET_FIELD(pkEckgReq.sz),
+    WH_PACKET_FIELD(pkEckgReq.curveId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _ecdhReqFields[] = {
+    WH_PACKET_FIELD(pkEcdhReq.type),
+    WH_PACKET_FIELD(pkEcdhReq.privateKeyId),
+    WH_PACKET_FIELD(pkEcdhReq.publicKeyId),
+    WH_PACKET_FIELD(pkEcdhReq.curveId),
+    WH_PACKET_FIELD(pkEcdhReq.options),
+    WH_PACKET_FIELD(pkEcdhReq.keyId),
+    WH_PACKET_FIELD(pkEcdhReq.flags),
+    WH_COMM_FIELD_END
+};
+
+/* Also used for Curve25519, which has the same layout */
+static const whCommField _ecdhResFields[] = {
+    WH_PACKET_FIELD(pkEcdhRes.sz),
+    WH_PACKET_FIELD(pkEcdhRes.keyId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _eccSignReqFields[] = {
+    WH_PACKET_FIELD(pkEccSignReq.type),
+    WH_PACKET_FIELD(pkEccSignReq.keyId),
+    WH_PACKET_FIELD(pkEccSignReq.curveId),
+    WH_PACKET_FIELD(pkEccSignReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _eccVerifyReqFields[] = {
+    WH_PACKET_FIELD(pkEccVerifyReq.type),
+    WH_PACKET_FIELD(pkEccVerifyReq.keyId),
+    WH_PACKET_FIELD(pkEccVerifyReq.curveId),
+    WH_PACKET_FIELD(pkEccVerifyReq.sigSz),
+    WH_PACKET_FIELD(pkEccVerifyReq.hashSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _eccVerifyBatchReqFields[] = {
+    WH_PACKET_FIELD(pkEccVerifyBatchReq.curveId),
+    WH_PACKET_FIELD(pkEccVerifyBatchReq.count),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _eccVerifyItemFields[] = {
+    WH_COMM_FIELD(wh_Packet_pk_ecc_verify_item, keyId),
+    WH_COMM_FIELD(wh_Packet_pk_ecc_verify_item, sigSz),
+    WH_COMM_FIELD(wh_Packet_pk_ecc_verify_item, hashSz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _eccVerifyBatchResFields[] = {
+    WH_PACKET_FIELD(pkEccVerifyBatchRes.count),
+    WH_PACKET_FIELD(pkEccVerifyBatchRes.valid),
+    WH_PACKET_FIELD(pkEccVerifyBatchRes.failed),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _eccCheckReqFields[] = {
+    WH_PACKET_FIELD(pkEccCheckReq.type),
+    WH_PACKET_FIELD(pkEccCheckReq.keyId),
+    WH_PACKET_FIELD(pkEccCheckReq.curveId),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _curve25519kgReqFields[] = {
+    WH_PACKET_FIELD(pkCurve25519kgReq.type),
+    WH_PACKET_FIELD(pkCurve25519kgReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _curve25519ReqFields[] = {
+    WH_PACKET_FIELD(pkCurve25519Req.type),
+    WH_PACKET_FIELD(pkCurve25519Req.privateKeyId),
+    WH_PACKET_FIELD(pkCurve25519Req.publicKeyId),
+    WH_PACKET_FIELD(pkCurve25519Req.endian),
+    WH_PACKET_FIELD(pkCurve25519Req.options),
+    WH_PACKET_FIELD(pkCurve25519Req.keyId),
+    WH_PACKET_FIELD(pkCurve25519Req.flags),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _ed25519kgReqFields[] = {
+    WH_PACKET_FIELD(pkEd25519kgReq.type),
+    WH_PACKET_FIELD(pkEd25519kgReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _ed25519SignReqFields[] = {
+    WH_PACKET_FIELD(pkEd25519SignReq.type),
+    WH_PACKET_FIELD(pkEd25519SignReq.keyId),
+    WH_PACKET_FIELD(pkEd25519SignReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _ed25519VerifyReqFields[] = {
+    WH_PACKET_FIELD(pkEd25519VerifyReq.type),
+    WH_PACKET_FIELD(pkEd25519VerifyReq.keyId),
+    WH_PACKET_FIELD(pkEd25519VerifyReq.sigSz),
+    WH_PACKET_FIELD(pkEd25519VerifyReq.sz),
+    WH_COMM_FIELD_END
+};
+
+/* Other than shared secrets, every public key response is a single word at
+ * the start of the body, be it a key id, a size or a result */
+static const whCommField _pkWordResFields[] = {
+    WH_PACKET_FIELD(pkRsaRes.outLen),
+    WH_COMM_FIELD_END
+};
+
+#ifdef WOLFHSM_SHE_EXTENSION
+/* SHE requests and responses. Messages that are only byte strings are not
+ * listed */
+static const whCommField _sheSzReqFields[] = {
+    WH_PACKET_FIELD(sheSecureBootInitReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheStatusResFields[] = {
+    WH_PACKET_FIELD(sheSecureBootInitRes.status),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheSecureBootDmaReqFields[] = {
+    WH_PACKET_FIELD(sheSecureBootDmaReq.addr),
+    WH_PACKET_FIELD(sheSecureBootDmaReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheEcbReqFields[] = {
+    WH_PACKET_FIELD(sheEncEcbReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheCbcReqFields[] = {
+    WH_PACKET_FIELD(sheEncCbcReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheCipherResFields[] = {
+    WH_PACKET_FIELD(sheEncEcbRes.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheCipherDmaReqFields[] = {
+    WH_PACKET_FIELD(sheCipherDmaReq.inAddr),
+    WH_PACKET_FIELD(sheCipherDmaReq.outAddr),
+    WH_PACKET_FIELD(sheCipherDmaReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheCipherDmaResFields[] = {
+    WH_PACKET_FIELD(sheCipherDmaRes.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheGenMacReqFields[] = {
+    WH_PACKET_FIELD(sheGenMacReq.keyId),
+    WH_PACKET_FIELD(sheGenMacReq.sz),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheVerifyMacReqFields[] = {
+    WH_PACKET_FIELD(sheVerifyMacReq.keyId),
+    WH_PACKET_FIELD(sheVerifyMacReq.messageLen),
+    WH_PACKET_FIELD(sheVerifyMacReq.macLen),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheLoadKeyBatchReqFields[] = {
+    WH_PACKET_FIELD(sheLoadKeyBatchReq.count),
+    WH_COMM_FIELD_END
+};
+
+static const whCommField _sheLoadKeyBatchResFields[] = {
+    WH_PACKET_FIELD(sheLoadKeyBatchRes.count),
+    WH_PACKET_FIELD(sheLoadKeyBatchRes.status),
+    WH_COMM_FIELD_END
+};
+#endif /* WOLFHSM_SHE_EXTENSION */
+
+/* Find the tables for the request and response of an action */
+static void _getKeyFields(uint16_t action, const whCommField** req,
+        const whCommField** res)
+{
+    switch (action) {
+    case WH_KEY_CACHE:
+        *req = _keyCacheReqFields;  *res = _keyCacheResFields;  break;
+    case WH_KEY_CACHE_DMA:
+        *req = _keyCacheDmaReqFields;  *res = _keyCacheResFields;  break;
+    case WH_KEY_EXPORT:
+        *req = _keyIdReqFields;  *res = _keyExportResFields;  break;
+    case WH_KEY_EXPORT_DMA:
+        *req = _keyExportDmaReqFields;  *res = _keyExportResFields;  break;
+    case WH_KEY_EXPORT_PUBLIC:
+        *req = _keyExportPublicReqFields;  *res = _keyExportResFields;  break;
+    case WH_KEY_EVICT:
+    case WH_KEY_COMMIT:
+    case WH_KEY_ERASE:
+        *req = _keyIdReqFields;  *res = _keyOkResFields;  break;
+    case WH_KEY_GENERATION:
+        *res = _keyGenerationResFields;  break;
+    case WH_KEY_RSA_KEYGEN_START:
+        *req = _keyRsakgStartReqFields;  *res = _keyJobStartResFields;  break;
+    case WH_KEY_JOB_STATUS:
+        *req = _keyJobStatusReqFields;  *res = _keyJobStatusResFields;  break;
+    default:
+        break;
+    }
+}
+
+static void _getPkFields(uint32_t type, const whCommField** req,
+        const whCommField** res)
+{
+    *res = _pkWordResFields;
+    switch (type) {
+    case WC_PK_TYPE_RSA_KEYGEN:         *req = _rsakgReqFields;  break;
+    case WC_PK_TYPE_RSA:                *req = _rsaReqFields;  break;
+    case WC_PK_TYPE_RSA_GET_SIZE:       *req = _rsaGetSizeReqFields;  break;
+    case WC_PK_TYPE_EC_KEYGEN:          *req = _eckgReqFields;  break;
+    case WC_PK_TYPE_ECDH:
+        *req = _ecdhReqFields;  *res = _ecdhResFields;  break;
+    case WC_PK_TYPE_ECDSA_SIGN:         *req = _eccSignReqFields;  break;
+    case WC_PK_TYPE_ECDSA_VERIFY:       *req = _eccVerifyReqFields;  break;
+    case WC_PK_TYPE_EC_CHECK_PRIV_KEY:  *req = _eccCheckReqFields;  break;
+    case WC_PK_TYPE_CURVE25519_KEYGEN:  *req = _curve25519kgReqFields;  break;
+    case WC_PK_TYPE_CURVE25519:
+        *req = _curve25519ReqFields;  *res = _ecdhResFields;  break;
+    case WC_PK_TYPE_ED25519_KEYGEN:     *req = _ed25519kgReqFields;  break;
+    case WC_PK_TYPE_ED25519_SIGN:       *req = _ed25519SignReqFields;  break;
+    case WC_PK_TYPE_ED25519_VERIFY:     *req = _ed25519VerifyReqFields;  break;
+    default:
+        break;
+    }
+}
+
+static void _getCryptoFields(uint16_t action, uint32_t type,
+        const whCommField** req, const whCommField** res)
+{
+    switch (action) {
+    case WC_ALGO_TYPE_CIPHER:
+        if (type == WC_CIPHER_AES_CBC) {
+            *req = _aesCbcReqFields;  *res = _aesCbcResFields;
+        }
+        else if (type == WC_CIPHER_AES_GCM) {
+            *req = _aesGcmReqFields;  *res = _aesGcmResFields;
+        }
+        break;
+    case WC_ALGO_TYPE_PK:
+        _getPkFields(type, req, res);
+        break;
+    case WC_ALGO_TYPE_RNG:
+        *req = _rngReqFields;  *res = _rngResFields;  break;
+    case WC_ALGO_TYPE_HASH:
+    case WC_ALGO_TYPE_HMAC:
+    case WH_CRYPTO_HASH_STREAM_COPY:
+        *req = _hashReqFields;  *res = _hashResFields;  break;
+    case WC_ALGO_TYPE_CMAC:
+        *req = _cmacReqFields;  *res = _cmacResFields;  break;
+    case WH_CRYPTO_CIPHER_STREAM_INIT:
+        *req = _streamInitReqFields;  *res = _streamInitResFields;  break;
+    case WH_CRYPTO_CIPHER_STREAM_UPDATE:
+        *req = _streamUpdateReqFields;  *res = _streamUpdateResFields;  break;
+    case WH_CRYPTO_CIPHER_STREAM_FINAL:
+        *req = _streamFinalReqFields;  *res = _streamFinalResFields;  break;
+    case WH_CRYPTO_CIPHER_DMA:
+        *req = _cipherDmaReqFields;  *res = _cipherDmaResFields;  break;
+    case WH_CRYPTO_HASH_DMA:
+        *req = _hashDmaReqFields;  *res = _hashDmaResFields;  break;
+    case WH_CRYPTO_ECDSA_VERIFY_BATCH:
+        *req = _eccVerifyBatchReqFields;  *res = _eccVerifyBatchResFields;
+        break;
+    default:
+        break;
+    }
+}
+
+#ifdef WOLFHSM_SHE_EXTENSION
+static void _getSheFields(uint16_t action, const whCommField** req,
+        const whCommField** res)
+{
+    switch (action) {
+    case WH_SHE_SECURE_BOOT_INIT:
+    case WH_SHE_SECURE_BOOT_UPDATE:
+        *req = _sheSzReqFields;  *res = _sheStatusResFields;  break;
+    case WH_SHE_SECURE_BOOT_FINISH:
+    case WH_SHE_INIT_RND:
+    case WH_SHE_EXTEND_SEED:
+        *res = _sheStatusResFields;  break;
+    case WH_SHE_SECURE_BOOT_DMA:
+        *req = _sheSecureBootDmaReqFields;  *res = _sheStatusResFields;  break;
+    case WH_SHE_ENC_ECB:
+    case WH_SHE_DEC_ECB:
+        *req = _sheEcbReqFields;  *res = _sheCipherResFields;  break;
+    case WH_SHE_ENC_CBC:
+    case WH_SHE_DEC_CBC:
+        *req = _sheCbcReqFields;  *res = _sheCipherResFields;  break;
+    case WH_SHE_ENC_ECB_DMA:
+    case WH_SHE_ENC_CBC_DMA:
+    case WH_SHE_DEC_ECB_DMA:
+    case WH_SHE_DEC_CBC_DMA:
+        *req = _sheCipherDmaReqFields;  *res = _sheCipherDmaResFields;  break;
+    case WH_SHE_GEN_MAC:
+        *req = _sheGenMacReqFields;  break;
+    case WH_SHE_VERIFY_MAC:
+        *req = _sheVerifyMacReqFields;  break;
+    case WH_SHE_LOAD_KEY_BATCH:
+        *req = _sheLoadKeyBatchReqFields;  *res = _sheLoadKeyBatchResFields;
+        break;
+    default:
+        break;
+    }
+}
+#endif /* WOLFHSM_SHE_EXTENSION */
+
+/* Swaps the item headers that follow a batch verify request */
+static void _swapEccVerifyItems(uint16_t magic, uint8_t* packet,
+        uint16_t size)
+{
+    whPacket* p = (whPacket*)packet;
+    wh_Packet_pk_ecc_verify_item item;
+    uint32_t off = WOLFHSM_PACKET_STUB_SIZE + sizeof(p->pkEccVerifyBatchReq);
+    uint32_t count = 0;
+    uint32_t i = 0;
+
+    memcpy(&count, &p->pkEccVerifyBatchReq.count, sizeof(count));
+    for (i = 0; (i < count) && (off + sizeof(item) <= size); i++) {
+        wh_CommSwapFields(magic, _eccVerifyItemFields, packet + off,
+                size - off);
+        memcpy(&item, packet + off, sizeof(item));
+        off += sizeof(item) + item.sigSz + item.hashSz;
+    }
+}
+
+const whCommField* wh_Packet_TranslateRequest(uint16_t magic, uint16_t kind,
+        uint8_t* packet, uint16_t size)
+{
+    const whCommField* req = _noFields;
+    const whCommField* res = _noFields;
+    uint32_t type = 0;
+
+    if (    (WH_COMM_FLAGS_SWAPTEST(magic)) ||
+            (packet == NULL) ) {
+        /* Native packets are handled as they are */
+        return NULL;
+    }
+
+    wh_CommSwapFields(magic, _stubFields, packet, size);
+    switch (WH_MESSAGE_GROUP(kind)) {
+    case WH_MESSAGE_GROUP_KEY:
+        _getKeyFields(WH_MESSAGE_ACTION(kind), &req, &res);
+        break;
+    case WH_MESSAGE_GROUP_CRYPTO:
+        /* Cipher and public key requests start with their type */
+        if (size >= WOLFHSM_PACKET_STUB_SIZE + sizeof(type)) {
+            memcpy(&type, packet + WOLFHSM_PACKET_STUB_SIZE, sizeof(type));
+            type = wh_Translate32(magic, type);
+        }
+        _getCryptoFields(WH_MESSAGE_ACTION(kind), type, &req, &res);
+        break;
+#ifdef WOLFHSM_SHE_EXTENSION
+    case WH_MESSAGE_GROUP_SHE:
+        _getSheFields(WH_MESSAGE_ACTION(kind), &req, &res);
+        break;
+#endif
+    default:
+        break;
+    }
+    wh_CommSwapFields(magic, req, packet, size);
+
+    if (req == _eccVerifyBatchReqFields) {
+        _swapEccVerifyItems(magic, packet, size);
+    }
+    return res;
+}
+
+void wh_Packet_TranslateResponse(uint16_t magic, const whCommField* fields,
+        uint8_t* packet, uint16_t size)
+{
+    if (fields == NULL) {
+        return;
+    }
+    wh_CommSwapFields(magic, _stubFields, packet, size);
+    wh_CommSwapFields(magic, fields, packet, size);
+}
+
+#endif /* !WOLFHSM_NO_CRYPTO */
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_replay.c
+ *
+ * Replay driver for captured request streams
+ */
+
+#include <stdint.h>
+#include <stddef.h>     /* For NULL */
+#include <string.h>     /* For memset */
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_nvm.h"
+#include "wolfhsm/wh_message_batch.h"
+#include "wolfhsm/wh_message_customcb.h"
+#include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_capture.h"
+#include "wolfhsm/wh_replay.h"
+
+static void _wh_Replay_Add(whReplayTiming* t, uint64_t elapsed)
+{
+    if ((t->count == 0) || (elapsed < t->min)) {
+        t->min = elapsed;
+    }
+    if (elapsed > t->max) {
+        t->max = elapsed;
+    }
+    t->total += elapsed;
+    t->count++;
+}
+
+/* Whether a request of kind with data of size bytes refers to client memory */
+static int _wh_Replay_IsDma(uint16_t magic, uint16_t kind, uint16_t size,
+        const uint8_t* data)
+{
+    uint16_t action = WH_MESSAGE_ACTION(kind);
+    uint32_t type = 0;
+
+    switch (WH_MESSAGE_GROUP(kind)) {
+    case WH_MESSAGE_GROUP_NVM:
+        return  (action == WH_MESSAGE_NVM_ACTION_ADDOBJECTDMA32) ||
+                (action == WH_MESSAGE_NVM_ACTION_READDMA32) ||
+                (action == WH_MESSAGE_NVM_ACTION_ADDOBJECTDMA64) ||
+                (action == WH_MESSAGE_NVM_ACTION_READDMA64) ||
+                (action == WH_MESSAGE_NVM_ACTION_ADDOBJECTDMASG) ||
+                (action == WH_MESSAGE_NVM_ACTION_READDMASG);
+    case WH_MESSAGE_GROUP_KEY:
+        return  (action == WH_KEY_CACHE_DMA) ||
+                (action == WH_KEY_EXPORT_DMA);
+    case WH_MESSAGE_GROUP_CRYPTO:
+        return  (action == WH_CRYPTO_CIPHER_DMA) ||
+                (action == WH_CRYPTO_HASH_DMA);
+    case WH_MESSAGE_GROUP_SHE:
+        return  (action == WH_SHE_SECURE_BOOT_DMA) ||
+                (action == WH_SHE_ENC_ECB_DMA) ||
+                (action == WH_SHE_ENC_CBC_DMA) ||
+                (action == WH_SHE_DEC_ECB_DMA) ||
+                (action == WH_SHE_DEC_CBC_DMA);
+    case WH_MESSAGE_GROUP_CUSTOM:
+        if (size < offsetof(whMessageCustomCb_Request, data)) {
+            return 0;
+        }
+        memcpy(&type, data + offsetof(whMessageCustomCb_Request, type),
+                sizeof(type));
+        type = wh_Translate32(magic, type);
+        return  (type == WH_MESSAGE_CUSTOM_CB_TYPE_DMA32) ||
+                (type == WH_MESSAGE_CUSTOM_CB_TYPE_DMA64);
+    default:
+        return 0;
+    }
+}
+
+/* Whether a batch holds a DMA sub-request */
+static int _wh_Replay_IsDmaBatch(uint16_t magic, uint16_t size,
+        const uint8_t* data)
+{
+    whMessageBatch_Header hdr = {0};
+    whMessageBatch_Entry entry = {0};
+    uint32_t off = sizeof(hdr);
+    uint16_t i = 0;
+
+    if (size < sizeof(hdr)) {
+        return 0;
+    }
+    /* The packet buffer and each entry are 8 byte aligned */
+    (void)wh_MessageBatch_TranslateHeader(magic,
+            (const whMessageBatch_Header*)data, &hdr);
+    for (i = 0; (i < hdr.count) && (off + sizeof(entry) <= size); i++) {
+        (void)wh_MessageBatch_TranslateEntry(magic,
+                (const whMessageBatch_Entry*)(data + off), &entry);
+        off += sizeof(entry);
+        if (off + entry.size > size) {
+            break;
+        }
+        if (_wh_Replay_IsDma(magic, entry.kind, entry.size, data + off)) {
+            return 1;
+        }
+        off += WH_MESSAGE_BATCH_PADDED(entry.size);
+    }
+    return 0;
+}
+
+static uint64_t _wh_Replay_Now(const whReplayConfig* config)
+{
+    return (config->time_cb != NULL) ?
+            config->time_cb(config->time_context) : 0;
+}
+
+int wh_Replay_Run(const whReplayConfig* config, whReplayStats* out_stats)
+{
+    uint64_t packet[WH_COMM_MTU_U64_COUNT];
+    uint64_t response[WH_COMM_MTU_U64_COUNT];
+    const whCommHeader* hdr = (const whCommHeader*)packet;
+    whCaptureRecord record = {0};
+    whReplayStats stats;
+    uint64_t first = 0;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    uint16_t size = 0;
+    uint16_t kind = 0;
+    uint16_t group = 0;
+    const uint8_t* data = (const uint8_t*)packet + sizeof(*hdr);
+    uint32_t poll = 0;
+    int rc = 0;
+
+    if (    (config == NULL) ||
+            (config->read_cb == NULL) ||
+            (config->server == NULL) ||
+            (config->transport == NULL) ){
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    while (rc == 0) {
+        rc = config->read_cb(config->read_context, &record, sizeof(packet),
+                packet);
+        if (rc != 0) {
+            break;
+        }
+        if (record.size < sizeof(*hdr)) {
+            rc = WH_ERROR_ABORTED;
+            break;
+        }
+        if ((stats.all.count == 0) && (stats.skipped == 0)) {
+            first = record.time;
+        }
+        stats.captured = record.time - first;
+        kind = wh_Translate16(hdr->magic, hdr->kind);
+        group = WH_MESSAGE_GROUP(kind) >> 8;
+        size = record.size - sizeof(*hdr);
+
+        if (    _wh_Replay_IsDma(hdr->magic, kind, size, data) ||
+                ((WH_MESSAGE_GROUP(kind) == WH_MESSAGE_GROUP_BATCH) &&
+                 _wh_Replay_IsDmaBatch(hdr->magic, size, data))) {
+            stats.skipped++;
+            continue;
+        }
+
+        /* A captured CommClose must not end the replay */
+        (void)wh_Server_SetConnected(config->server, WH_COMM_CONNECTED);
+
+        start = _wh_Replay_Now(config);
+        rc = wh_TransportMem_SendRequest(config->transport, record.size,
+                packet);
+        for (poll = 0; (rc == 0) && (poll < WH_REPLAY_POLL_COUNT); poll++) {
+            (void)wh_Server_HandleRequestMessage(config->server);
+            size = sizeof(response);
+            rc = wh_TransportMem_RecvResponse(config->transport, &size,
+                    response);
+            if (rc == 0) {
+                break;
+            }
+            if (rc == WH_ERROR_NOTREADY) {
+                rc = 0;
+            }
+        }
+        if ((rc == 0) && (poll == WH_REPLAY_POLL_COUNT)) {
+            /* Never answered */
+            rc = WH_ERROR_ABORTED;
+        }
+        if (rc == 0) {
+            elapsed = _wh_Replay_Now(config) - start;
+            _wh_Replay_Add(&stats.all, elapsed);
+            if (group < WH_REPLAY_GROUP_COUNT) {
+                _wh_Replay_Add(&stats.group[group], elapsed);
+            }
+        }
+    }
+    if (rc == WH_ERROR_NOTFOUND) {
+        rc = 0;
+    }
+    if (out_stats != NULL) {
+        *out_stats = stats;
+    }
+    return rc;
+}
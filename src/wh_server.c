@@ -27,11 +27,13 @@
 /* Server Components */
 #include "wolfhsm/wh_comm.h"
 #include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_trace.h"
 
 /* Message definitions */
 #include "wolfhsm/wh_message.h"
 #include "wolfhsm/wh_message_comm.h"
 #include "wolfhsm/wh_message_nvm.h"
+#include "wolfhsm/wh_message_batch.h"
 #include "wolfhsm/wh_packet.h"
 
 /* Server API's */
@@ -39,6 +41,7 @@
 #include "wolfhsm/wh_server_nvm.h"
 #include "wolfhsm/wh_server_crypto.h"
 #include "wolfhsm/wh_server_keystore.h"
+#include "wolfhsm/wh_server_counter.h"
 #if defined(WOLFHSM_SHE_EXTENSION)
 #include "wolfhsm/wh_server_she.h"
 #endif
@@ -49,10 +52,78 @@ static int _wh_Server_HandlePkcs11Request(whServerContext* server,
         uint16_t magic, uint16_t action, uint16_t seq,
         uint16_t req_size, const void* req_packet,
         uint16_t *out_resp_size, void* resp_packet);
+static int _wh_Server_DispatchRequest(whServerContext* server,
+        uint16_t magic, uint16_t kind, uint16_t seq,
+        uint16_t req_size, uint8_t* req_packet,
+        uint16_t *out_resp_size, uint8_t* resp_packet);
+#ifndef WOLFHSM_NO_BATCH
+static int _wh_Server_HandleBatchRequest(whServerContext* server,
+        uint16_t magic, uint16_t action, uint16_t seq,
+        uint16_t req_size, const void* req_packet,
+        uint16_t *out_resp_size, void* resp_packet);
+#endif
+static int _wh_Server_InitComm(whServerContext* server, uint16_t index,
+        whCommServerConfig* config, uint8_t priority);
+static int _wh_Server_SetCommConnectedCb(void* c, whCommConnected connected);
+static int _wh_Server_ServiceComm(whServerContext* server, uint16_t index);
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+static int _wh_Server_SubmitWork(whServerContext* server, uint16_t index,
+        uint16_t magic, uint16_t kind, uint16_t seq,
+        uint16_t req_size, const uint8_t* req_packet, uint16_t job);
+static int _wh_Server_PostWork(whServerContext* server);
+#endif
+static int _wh_Server_ServiceComms(whServerContext* server);
+#ifdef WH_SERVER_KEYGEN_JOBS
+static int _wh_Server_RunJob(whServerContext* server, int idle);
+#endif
+#ifdef WOLFHSM_SERVER_STATS
+static uint64_t _wh_Server_StatsTime(whServerContext* server);
+static void _wh_Server_RecordStats(whServerContext* server, uint16_t kind,
+        uint16_t req_size, uint16_t resp_size, int rc, const uint8_t* resp,
+        uint64_t start);
+#endif
+
+static int _wh_Server_InitComm(whServerContext* server, uint16_t index,
+        whCommServerConfig* config, uint8_t priority)
+{
+    whServerComm* c = &server->comms[index];
+
+    memset(c, 0, sizeof(*c));
+    c->server = server;
+    c->priority = priority;
+    return wh_CommServer_Init(c->comm, config,
+            _wh_Server_SetCommConnectedCb, (void*)c);
+}
+
+/* Order of the request classes, which is not that of their values */
+static int _wh_Server_ClassRank(uint8_t cls)
+{
+    if (cls == WH_COMM_CLASS_REALTIME) {
+        return 2;
+    }
+    if (cls == WH_COMM_CLASS_BULK) {
+        return 0;
+    }
+    return 1;
+}
+
+static int _wh_Server_SetCommConnectedCb(void* c, whCommConnected connected)
+{
+    whServerComm* comm = (whServerComm*)c;
+
+    if (comm == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+    comm->connected = connected;
+    return WH_ERROR_OK;
+}
 
 int wh_Server_Init(whServerContext* server, whServerConfig* config)
 {
     int rc = 0;
+#ifndef WOLFHSM_NO_CRYPTO
+    uint32_t seed = 0;
+#endif
 
     if ((server == NULL) || (config == NULL)) {
         return WH_ERROR_BADARGS;
@@ -60,8 +131,10 @@ int wh_Server_Init(whServerContext* server, whServerConfig* config)
 
     memset(server, 0, sizeof(*server));
     server->nvm = config->nvm;
+    server->counter = config->counter;
 
 #ifndef WOLFHSM_NO_CRYPTO
+    hsmCacheInit(server);
     server->crypto = config->crypto;
     if (server->crypto != NULL) {
 #if defined(WOLF_CRYPTO_CB)
@@ -70,25 +143,78 @@ int wh_Server_Init(whServerContext* server, whServerConfig* config)
         server->crypto->devId = INVALID_DEVID;
 #endif
     }
+    /* Start the NVM generation somewhere new each boot, so clients can't
+     * take metadata cached before a restart for current */
+    if (    (server->nvm != NULL) &&
+            (server->crypto != NULL) &&
+            (wc_RNG_GenerateBlock(server->crypto->rng, (byte*)&seed,
+                    sizeof(seed)) == 0) ) {
+        server->nvm->generation ^= seed;
+    }
 #ifdef WOLFHSM_SHE_EXTENSION
     server->she = config->she;
 #endif
+#if WH_SERVER_WORKER_COUNT > 0
+    if (config->worker_config != NULL) {
+        whServerWorkerConfig* wc = config->worker_config;
+        int i = 0;
+
+        server->worker_start_cb   = wc->start_cb;
+        server->lock_cb           = wc->lock_cb;
+        server->unlock_cb         = wc->unlock_cb;
+        server->worker_cb_context = wc->cb_context;
+        for (i = 0; i < WH_SERVER_WORKER_COUNT; i++) {
+            if ((wc->crypto[i] == NULL) || (wc->start_cb == NULL)) {
+                continue;
+            }
+            server->worker[i].crypto = wc->crypto[i];
+#if defined(WOLF_CRYPTO_CB)
+            server->worker[i].crypto->devId = config->devId;
+#else
+            server->worker[i].crypto->devId = INVALID_DEVID;
+#endif
+            server->worker[i].state = WH_SERVER_WORKER_IDLE;
+        }
+    }
+#endif
 #endif
 
-    rc = wh_CommServer_Init(server->comm, config->comm_config,
-            wh_Server_SetConnectedCb, (void*)server);
+    /* The configured comm channel is channel 0 */
+    server->comm = server->comms[0].comm;
+    server->comm_count = 1;
+    rc = _wh_Server_InitComm(server, 0, config->comm_config, 0);
     if (rc != 0) {
         (void)wh_Server_Cleanup(server);
         return WH_ERROR_ABORTED;
     }
+    if (config->comm_max_class < WH_COMM_CLASS_COUNT) {
+        server->comms[0].max_cls = config->comm_max_class;
+    }
+
+#ifdef WOLFHSM_SERVER_STATS
+    server->stats_time_cb = config->stats_time_cb;
+    server->stats_time_context = config->stats_time_context;
+#endif
+
+    if (config->run_config != NULL) {
+        server->run = *config->run_config;
+    }
 
     /* Initialize DMA configuration and callbacks, if provided */
     if (NULL != config->dmaConfig) {
-        server->dma.dmaAddrAllowList = config->dmaConfig->dmaAddrAllowList;
+        if (config->dmaConfig->dmaAddrAllowList != NULL) {
+            (void)wh_Server_DmaRegisterAllowList(server,
+                    config->dmaConfig->dmaAddrAllowList);
+        }
         server->dma.cb32             = config->dmaConfig->cb32;
         server->dma.cb64             = config->dmaConfig->cb64;
     }
 
+#ifndef WOLFHSM_NO_CRYPTO
+    /* Warm the key cache before the first request */
+    hsmCachePrefetch(server, config->prefetch_ids, config->prefetch_count);
+#endif
+
     return rc;
 }
 
@@ -98,20 +224,52 @@ int wh_Server_Cleanup(whServerContext* server)
         return WH_ERROR_BADARGS;
     }
 
-    (void)wh_CommServer_Cleanup(server->comm);
+    while (server->comm_count > 0) {
+        server->comm_count--;
+        (void)wh_CommServer_Cleanup(server->comms[server->comm_count].comm);
+    }
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_DECODED_KEY_COUNT > 0)
+    hsmFreeDecodedKeys(server);
+#endif
+#ifdef WH_SERVER_STREAMS
+    hsmFreeStreams(server, NULL);
+#endif
 
     memset(server, 0, sizeof(*server));
 
     return WH_ERROR_OK;
 }
 
+void wh_Server_Lock(whServerContext* server)
+{
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+    if ((server != NULL) && (server->lock_cb != NULL)) {
+        server->lock_cb(server->worker_cb_context);
+    }
+#else
+    (void)server;
+#endif
+}
+
+void wh_Server_Unlock(whServerContext* server)
+{
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+    if ((server != NULL) && (server->unlock_cb != NULL)) {
+        server->unlock_cb(server->worker_cb_context);
+    }
+#else
+    (void)server;
+#endif
+}
+
 int wh_Server_SetConnected(whServerContext *server, whCommConnected connected)
 {
     if (server == NULL) {
         return WH_ERROR_BADARGS;
     }
 
-    server->connected = connected;
+    server->comms[server->comm_current].connected = connected;
     return WH_ERROR_OK;
 }
 
@@ -120,6 +278,71 @@ int wh_Server_SetConnectedCb(void* s, whCommConnected connected)
     return wh_Server_SetConnected((whServerContext*)s, connected);
 }
 
+int wh_Server_AddComm(whServerContext* server, whCommServerConfig* config,
+        uint8_t priority, uint16_t* out_index)
+{
+    int rc = 0;
+    uint16_t index = 0;
+
+    if (    (server == NULL) ||
+            (server->comm_count == 0) ||
+            (config == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+    if (server->comm_count >= WH_SERVER_COMM_COUNT) {
+        return WH_ERROR_NOSPACE;
+    }
+
+    index = server->comm_count;
+    rc = _wh_Server_InitComm(server, index, config, priority);
+    if (rc != 0) {
+        (void)wh_CommServer_Cleanup(server->comms[index].comm);
+        memset(&server->comms[index], 0, sizeof(server->comms[index]));
+        return WH_ERROR_ABORTED;
+    }
+    server->comm_count++;
+
+    if (out_index != NULL) {
+        *out_index = index;
+    }
+    return WH_ERROR_OK;
+}
+
+int wh_Server_SetCommPriority(whServerContext* server, uint16_t index,
+        uint8_t priority)
+{
+    if ((server == NULL) || (index >= server->comm_count)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    server->comms[index].priority = priority;
+    return WH_ERROR_OK;
+}
+
+int wh_Server_SetCommMaxClass(whServerContext* server, uint16_t index,
+        uint8_t max_cls)
+{
+    if (    (server == NULL) ||
+            (index >= server->comm_count) ||
+            (max_cls >= WH_COMM_CLASS_COUNT) ) {
+        return WH_ERROR_BADARGS;
+    }
+
+    server->comms[index].max_cls = max_cls;
+    return WH_ERROR_OK;
+}
+
+int wh_Server_SetCommConnected(whServerContext* server, uint16_t index,
+        whCommConnected connected)
+{
+    if ((server == NULL) || (index >= server->comm_count)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    server->comms[index].connected = connected;
+    return WH_ERROR_OK;
+}
+
 int wh_Server_GetConnected(whServerContext *server,
                             whCommConnected *out_connected)
 {
@@ -128,7 +351,7 @@ int wh_Server_GetConnected(whServerContext *server,
     }
 
     if (out_connected != NULL) {
-        *out_connected = server->connected;
+        *out_connected = server->comms[server->comm_current].connected;
     }
     return WH_ERROR_OK;
 }
@@ -152,8 +375,18 @@ static int _wh_Server_HandleCommRequest(whServerContext* server,
 
         /* Process the init action */
         server->comm->client_id = req.client_id;
+
+        /* Use the smaller of the client and server data sizes */
+        server->comm->max_data_len = WH_COMM_DATA_LEN;
+        if (req.max_data_len < server->comm->max_data_len) {
+            server->comm->max_data_len = (req.max_data_len >
+                        WH_COMM_DATA_LEN_MIN) ?
+                    (uint16_t)req.max_data_len : WH_COMM_DATA_LEN_MIN;
+        }
+
         resp.client_id = server->comm->client_id;
         resp.server_id = server->comm->server_id;
+        resp.max_data_len = server->comm->max_data_len;
 
         /* Convert the response struct */
         wh_MessageComm_TranslateInitResponse(magic,
@@ -165,6 +398,13 @@ static int _wh_Server_HandleCommRequest(whServerContext* server,
     {
         /* No message */
         /* Process the close action */
+#ifdef WH_SERVER_STREAMS
+        hsmFreeStreams(server, server->comm);
+#endif
+        if (server->nvm != NULL) {
+            /* An unfinished NVM object would hold off compaction */
+            (void)wh_Nvm_AddObjectAbort(server->nvm, server->comm);
+        }
         wh_Server_SetConnected(server, WH_COMM_DISCONNECTED);
         *out_resp_size = 0;
     }; break;
@@ -189,6 +429,37 @@ static int _wh_Server_HandleCommRequest(whServerContext* server,
         *out_resp_size = sizeof(resp);
     }; break;
 
+    case WH_MESSAGE_COMM_ACTION_STATS:
+    {
+        whMessageCommStatsRequest req = {0};
+        whMessageCommStatsResponse resp = {0};
+
+        /* Convert request struct */
+        wh_MessageComm_TranslateStatsRequest(magic,
+                (whMessageCommStatsRequest*)req_packet, &req);
+
+#ifdef WOLFHSM_SERVER_STATS
+        /* Process the stats action */
+        resp.entry_count = server->stats_count;
+        if (req.index < server->stats_count) {
+            resp.entry = server->stats[req.index];
+        } else {
+            resp.rc = WH_ERROR_NOTFOUND;
+        }
+        if ((req.flags & WH_MESSAGE_COMM_STATS_RESET) != 0) {
+            memset(server->stats, 0, sizeof(server->stats));
+            server->stats_count = 0;
+        }
+#else
+        resp.rc = WH_ERROR_NOTFOUND;
+#endif
+
+        /* Convert the response struct */
+        wh_MessageComm_TranslateStatsResponse(magic,
+                &resp, (whMessageCommStatsResponse*)resp_packet);
+        *out_resp_size = sizeof(resp);
+    }; break;
+
     default:
         /* Unknown request. Respond with empty packet */
         *out_resp_size = 0;
@@ -211,90 +482,801 @@ static int _wh_Server_HandlePkcs11Request(whServerContext* server,
     return rc;
 }
 
-int wh_Server_HandleRequestMessage(whServerContext* server)
+/* Route a single request to its group handler.  Handlers that process their
+ * packet in place receive a copy of the request in resp_packet. */
+static int _wh_Server_DispatchRequest(whServerContext* server,
+        uint16_t magic, uint16_t kind, uint16_t seq,
+        uint16_t req_size, uint8_t* req_packet,
+        uint16_t *out_resp_size, uint8_t* resp_packet)
 {
-    uint16_t magic = 0;
-    uint16_t kind = 0;
-    uint16_t group = 0;
-    uint16_t action = 0;
-    uint16_t seq = 0;
-    uint16_t size = 0;
-    uint8_t* data = NULL;
+    int rc = 0;
+    uint16_t group = WH_MESSAGE_GROUP(kind);
+    uint16_t action = WH_MESSAGE_ACTION(kind);
+    uint16_t size = req_size;
+    uint8_t* data = req_packet;
+    uint8_t* resp = resp_packet;
+#ifndef WOLFHSM_NO_CRYPTO
+    const whCommField* fields = NULL;
+#endif
 
-    if (server == NULL) {
-        return WH_ERROR_BADARGS;
+    WH_TRACE(WH_TRACE_SERVER_BEGIN, kind, seq);
+
+    /* Crypto handlers lock around the shared key cache themselves, and batch
+     * entries are each dispatched here again */
+    if (    (group != WH_MESSAGE_GROUP_CRYPTO) &&
+            (group != WH_MESSAGE_GROUP_BATCH)) {
+        wh_Server_Lock(server);
     }
 
-    /* Use the CommServer internal buffer to avoid copies */
-    data = wh_CommServer_GetDataPtr(server->comm);
+    switch (group) {
+
+    case WH_MESSAGE_GROUP_COMM:
+        rc = _wh_Server_HandleCommRequest(server, magic, action, seq,
+                size, data, &size, resp);
+    break;
+
+    case WH_MESSAGE_GROUP_NVM:
+        rc = wh_Server_HandleNvmRequest(server, magic, action, seq,
+                size, data, &size, resp);
+    break;
 
+#ifndef WOLFHSM_NO_CRYPTO
+    case WH_MESSAGE_GROUP_KEY:
+        /* Processed in place */
+        if (resp != data) memcpy(resp, data, size);
+        fields = wh_Packet_TranslateRequest(magic, kind, resp, size);
+        rc = wh_Server_HandleKeyRequest(server, magic, action, seq,
+                resp, &size);
+        wh_Packet_TranslateResponse(magic, fields, resp, size);
+    break;
+
+    case WH_MESSAGE_GROUP_CRYPTO:
+        /* Processed in place */
+        if (resp != data) memcpy(resp, data, size);
+        fields = wh_Packet_TranslateRequest(magic, kind, resp, size);
+        rc = wh_Server_HandleCryptoRequest(server, action, resp,
+            &size);
+        wh_Packet_TranslateResponse(magic, fields, resp, size);
+    break;
+#endif  /* WOLFHSM_NO_CRYPTO */
+
+    case WH_MESSAGE_GROUP_COUNTER:
+        rc = wh_Server_HandleCounterRequest(server, magic, action, seq,
+                size, data, &size, resp);
+    break;
+
+    case WH_MESSAGE_GROUP_PKCS11:
+        rc = _wh_Server_HandlePkcs11Request(server, magic, action, seq,
+                size, data, &size, resp);
+    break;
+
+#ifdef WOLFHSM_SHE_EXTENSION
+    case WH_MESSAGE_GROUP_SHE:
+        /* Processed in place */
+        if (resp != data) memcpy(resp, data, size);
+        fields = wh_Packet_TranslateRequest(magic, kind, resp, size);
+        rc = wh_Server_HandleSheRequest(server, action, resp,
+            &size);
+        wh_Packet_TranslateResponse(magic, fields, resp, size);
+    break;
+#endif
+
+    case WH_MESSAGE_GROUP_CUSTOM:
+        rc = wh_Server_HandleCustomCbRequest(server, magic, action, seq,
+                size, data, &size, resp);
+    break;
+
+#ifndef WOLFHSM_NO_BATCH
+    case WH_MESSAGE_GROUP_BATCH:
+        rc = _wh_Server_HandleBatchRequest(server, magic, action, seq,
+                size, data, &size, resp);
+    break;
+#endif
+
+    default:
+        /* Unknown group. Return empty packet*/
+        /* TODO: Respond with aux error flag */
+        size = 0;
+    }
+
+    if (    (group != WH_MESSAGE_GROUP_CRYPTO) &&
+            (group != WH_MESSAGE_GROUP_BATCH)) {
+        wh_Server_Unlock(server);
+    }
+    WH_TRACE(WH_TRACE_SERVER_END, kind, rc);
+    *out_resp_size = size;
+    return rc;
+}
+
+#ifndef WOLFHSM_NO_BATCH
+static int _wh_Server_HandleBatchRequest(whServerContext* server,
+        uint16_t magic, uint16_t action, uint16_t seq,
+        uint16_t req_size, const void* req_packet,
+        uint16_t *out_resp_size, void* resp_packet)
+{
+    uint8_t* req = (uint8_t*)server->batch_req;
+    uint8_t* work = (uint8_t*)server->batch_work;
+    uint8_t* resp = (uint8_t*)resp_packet;
+    whMessageBatch_Header hdr = {0};
+    whMessageBatch_Entry entry = {0};
+    uint32_t req_off = sizeof(hdr);
+    uint32_t resp_off = sizeof(hdr);
+    uint32_t pad = 0;
+    uint16_t count = 0;
+    uint16_t sub_size = 0;
+
+    if (    (action != WH_MESSAGE_BATCH_ACTION_REQUEST) ||
+            (req_size < sizeof(hdr)) ||
+            (req_size > sizeof(server->batch_req))) {
+        /* Unknown or malformed request. Respond with empty packet */
+        *out_resp_size = 0;
+        return 0;
+    }
+
+    /* The response may share the request buffer, so work from a copy */
+    memcpy(req, req_packet, req_size);
+    wh_MessageBatch_TranslateHeader(magic, (whMessageBatch_Header*)req, &hdr);
+
+    while (count < hdr.count) {
+        if (    (req_off + sizeof(entry) > req_size) ||
+                (resp_off + sizeof(entry) > server->comm->max_data_len)) {
+            /* No more requests, or no room to respond to them */
+            break;
+        }
+        wh_MessageBatch_TranslateEntry(magic,
+                (whMessageBatch_Entry*)(req + req_off), &entry);
+        req_off += sizeof(entry);
+        if (req_off + entry.size > req_size) {
+            /* Truncated entry */
+            break;
+        }
+
+        /* Each sub-request gets a full size working buffer for its response */
+        sub_size = 0;
+        if (WH_MESSAGE_GROUP(entry.kind) == WH_MESSAGE_GROUP_BATCH) {
+            entry.rc = WH_ERROR_BADARGS; /* No nesting */
+        } else {
+            entry.rc = _wh_Server_DispatchRequest(server, magic, entry.kind,
+                    seq, entry.size, req + req_off, &sub_size, work);
+        }
+        req_off += WH_MESSAGE_BATCH_PADDED(entry.size);
+
+        if (    (entry.rc == 0) &&
+                (resp_off + sizeof(entry) + sub_size >
+                    server->comm->max_data_len)) {
+            /* Processed, but the response does not fit in this packet */
+            entry.rc = WH_ERROR_NOSPACE;
+            hdr.count = count + 1; /* Leave the rest for another batch */
+        }
+        if (entry.rc != 0) {
+            sub_size = 0;
+        }
+
+        entry.size = sub_size;
+        wh_MessageBatch_TranslateEntry(magic, &entry,
+                (whMessageBatch_Entry*)(resp + resp_off));
+        resp_off += sizeof(entry);
+        memcpy(resp + resp_off, work, sub_size);
+        resp_off += sub_size;
+
+        /* Zero the alignment padding, which the final entry may omit */
+        pad = WH_MESSAGE_BATCH_PADDED(sub_size) - sub_size;
+        if (resp_off + pad > server->comm->max_data_len) {
+            pad = server->comm->max_data_len - resp_off;
+        }
+        memset(resp + resp_off, 0, pad);
+        resp_off += pad;
+        count++;
+    }
+
+    hdr.count = count;
+    wh_MessageBatch_TranslateHeader(magic, &hdr, (whMessageBatch_Header*)resp);
+    *out_resp_size = (uint16_t)resp_off;
+    return 0;
+}
+#endif /* WOLFHSM_NO_BATCH */
+
+/* Receive the next request of a channel, leaving it in place until it is
+ * handled in priority order */
+static int _wh_Server_PollComm(whServerContext* server, uint16_t index)
+{
+    whServerComm* c = &server->comms[index];
+    int rc = WH_ERROR_NOTREADY;
+
+    if (c->held != 0) {
+        return WH_ERROR_OK;
+    }
     /* Are we connected with a valid data pointer? */
-    if (    (server->connected == WH_COMM_DISCONNECTED) ||
-            (data == NULL) ) {
+    if (    (c->connected == WH_COMM_DISCONNECTED) ||
+            (c->busy != 0) ||
+            (wh_CommServer_GetDataPtr(c->comm) == NULL) ) {
         return WH_ERROR_NOTREADY;
     }
 
-    int rc = wh_CommServer_RecvRequest(server->comm, &magic, &kind, &seq,
-            &size, data);
-    /* Got a packet? */
+    /* Leave the request in the internal buffer until it is handled */
+    rc = wh_CommServer_RecvRequest(c->comm, &c->magic, &c->kind, &c->seq,
+            &c->size, NULL);
     if (rc == 0) {
-        group = WH_MESSAGE_GROUP(kind);
-        action = WH_MESSAGE_ACTION(kind);
-        switch (group) {
+        c->held = 1;
+        c->cls = WH_COMM_AUX_CLASS(c->comm->aux);
+        /* The client picks the class, the channel caps it */
+        if (_wh_Server_ClassRank(c->cls) > _wh_Server_ClassRank(c->max_cls)) {
+            c->cls = c->max_cls;
+        }
+    }
+    return rc;
+}
 
-        case WH_MESSAGE_GROUP_COMM:
-            rc = _wh_Server_HandleCommRequest(server, magic, action, seq,
-                    size, data, &size, data);
-        break;
+/* Handle the waiting request of a channel.  Returns WH_ERROR_NOTREADY if it
+ * has to keep waiting */
+static int _wh_Server_ServiceComm(whServerContext* server, uint16_t index)
+{
+    whServerComm* c = &server->comms[index];
+    uint16_t magic = c->magic;
+    uint16_t kind = c->kind;
+    uint16_t seq = c->seq;
+    uint16_t size = c->size;
+    uint8_t* data = NULL;
+    uint8_t* resp = NULL;
+    whCommServer* comm = c->comm;
+    int rc = 0;
+#ifdef WOLFHSM_SERVER_STATS
+    uint16_t req_size = 0;
+    uint64_t start = 0;
+#endif
 
-        case WH_MESSAGE_GROUP_NVM:
-            rc = wh_Server_HandleNvmRequest(server, magic, action, seq,
-                    size, data, &size, data);
-        break;
+    /* Use the CommServer internal buffer to avoid copies */
+    data = wh_CommServer_GetDataPtr(comm);
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+    if (WH_MESSAGE_GROUP(kind) == WH_MESSAGE_GROUP_CRYPTO) {
+        rc = _wh_Server_SubmitWork(server, index, magic, kind, seq,
+                size, data, 0);
+        if ((rc == WH_ERROR_NOTREADY) &&
+                (c->cls == WH_COMM_CLASS_BULK)) {
+            /* Bulk work waits for a worker rather than the server */
+            return rc;
+        }
+        if ((rc != WH_ERROR_NOSPACE) && (rc != WH_ERROR_NOTREADY)) {
+            c->held = 0;
+            return rc;
+        }
+        /* No idle worker. Handle it here */
+    }
+#endif
+    c->held = 0;
 
-#ifndef WOLFHSM_NO_CRYPTO
-        case WH_MESSAGE_GROUP_KEY:
-            rc = wh_Server_HandleKeyRequest(server, magic, action, seq,
-                    data, &size);
-        break;
+    /* Handlers act for the client on this channel */
+    wh_Server_Lock(server);
+    server->comm = comm;
+    server->comm_current = index;
+    wh_Server_Unlock(server);
 
-        case WH_MESSAGE_GROUP_CRYPTO:
-            rc = wh_Server_HandleCryptoRequest(server, action, data,
-                &size);
-        break;
-#endif  /* WOLFHSM_NO_CRYPTO */
+    /* Serialize the response directly into the send buffer */
+    do {
+        resp = wh_CommServer_GetSendDataPtr(comm);
+    } while (resp == NULL);
 
-        case WH_MESSAGE_GROUP_PKCS11:
-            rc = _wh_Server_HandlePkcs11Request(server, magic, action, seq,
-                    size, data, &size, data);
-        break;
+#ifdef WOLFHSM_SERVER_STATS
+    req_size = size;
+    start = _wh_Server_StatsTime(server);
+#endif
+    rc = _wh_Server_DispatchRequest(server, magic, kind, seq,
+            size, data, &size, resp);
+#ifdef WOLFHSM_SERVER_STATS
+    _wh_Server_RecordStats(server, kind, req_size, size, rc, resp, start);
+#endif
 
-#ifdef WOLFHSM_SHE_EXTENSION
-        case WH_MESSAGE_GROUP_SHE:
-            rc = wh_Server_HandleSheRequest(server, action, data,
-                &size);
-        break;
+    /* Send a response */
+    /* TODO: Respond with ErrorResponse if handler returns an error */
+    if (rc == 0) {
+        do {
+            rc = wh_CommServer_SendResponse(comm, magic, kind, seq,
+                size, resp);
+        } while (rc == WH_ERROR_NOTREADY);
+    }
+    return rc;
+}
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+/* Hand a crypto request, or keygen job 1 + job, to an idle worker.  Returns
+ * WH_ERROR_NOTREADY if every worker is busy or WH_ERROR_NOSPACE if no worker
+ * can take it, and the caller must handle it instead */
+static int _wh_Server_SubmitWork(whServerContext* server, uint16_t index,
+        uint16_t magic, uint16_t kind, uint16_t seq,
+        uint16_t req_size, const uint8_t* req_packet, uint16_t job)
+{
+    whServerWorker* w = NULL;
+    int i = 0;
+
+    if (req_size > sizeof(w->packet)) {
+        return WH_ERROR_NOSPACE;
+    }
+
+    wh_Server_Lock(server);
+    for (i = 0; i < WH_SERVER_WORKER_COUNT; i++) {
+        if (server->worker[i].state == WH_SERVER_WORKER_IDLE) {
+            w = &server->worker[i];
+            break;
+        }
+    }
+    if (w != NULL) {
+        w->comm_index = index;
+        w->magic = magic;
+        w->kind = kind;
+        w->seq = seq;
+        w->size = req_size;
+        w->job = job;
+        w->req_size = req_size;
+        w->rc = 0;
+#ifdef WOLFHSM_SERVER_STATS
+        w->start_time = _wh_Server_StatsTime(server);
 #endif
+        memcpy(w->packet, req_packet, req_size);
+        w->state = WH_SERVER_WORKER_BUSY;
+        if (job == 0) {
+            server->comms[index].busy = 1;
+        }
+    }
+    wh_Server_Unlock(server);
 
-        case WH_MESSAGE_GROUP_CUSTOM:
-            rc = wh_Server_HandleCustomCbRequest(server, magic, action, seq,
-                    size, data, &size, data);
-        break;
+    if (w == NULL) {
+        return WH_ERROR_NOTREADY;
+    }
 
-        default:
-            /* Unknown group. Return empty packet*/
-            /* TODO: Respond with aux error flag */
-            size = 0;
+    if (server->worker_start_cb(server->worker_cb_context, server,
+            (uint16_t)i) != 0) {
+        /* Take the request back and handle it inline */
+        wh_Server_Lock(server);
+        w->state = WH_SERVER_WORKER_IDLE;
+        if (job == 0) {
+            server->comms[index].busy = 0;
         }
+        wh_Server_Unlock(server);
+        return WH_ERROR_NOSPACE;
+    }
+    return WH_ERROR_OK;
+}
+
+/* Send the responses of finished workers on their originating channels.
+ * Returns the number of workers released */
+static int _wh_Server_PostWork(whServerContext* server)
+{
+    whServerWorker* w = NULL;
+    whCommServer* comm = NULL;
+    uint8_t* resp = NULL;
+    int posted = 0;
+    int done = 0;
+    int rc = 0;
+    int i = 0;
+
+    for (i = 0; i < WH_SERVER_WORKER_COUNT; i++) {
+        w = &server->worker[i];
+
+        wh_Server_Lock(server);
+        done = (w->state == WH_SERVER_WORKER_DONE);
+        wh_Server_Unlock(server);
+        if (done == 0) {
+            continue;
+        }
+
+#ifdef WH_SERVER_KEYGEN_JOBS
+        if (w->job != 0) {
+            whServerJob* job = &server->job[w->job - 1];
+            whPacket* packet = (whPacket*)w->packet;
 
-        /* Send a response */
-        /* TODO: Respond with ErrorResponse if handler returns an error */
+            job->rc = (w->rc != 0) ? w->rc : packet->rc;
+            /* keep the full id, the channel's client may change later */
+            job->keyId = packet->pkRsakgRes.keyId |
+                (server->comms[job->comm_index].comm->client_id << 8);
+            job->state = WH_SERVER_JOB_DONE;
+
+            wh_Server_Lock(server);
+            w->state = WH_SERVER_WORKER_IDLE;
+            wh_Server_Unlock(server);
+            posted++;
+            continue;
+        }
+#endif
+        comm = server->comms[w->comm_index].comm;
+        rc = w->rc;
         if (rc == 0) {
-            do {
-                rc = wh_CommServer_SendResponse(server->comm, magic, kind, seq,
-                    size, data);
-            } while (rc == WH_ERROR_NOTREADY);
+            resp = wh_CommServer_GetSendDataPtr(comm);
+            if (resp == NULL) {
+                /* Try again on the next call */
+                continue;
+            }
+            memcpy(resp, w->packet, w->size);
+            rc = wh_CommServer_SendResponse(comm, w->magic, w->kind, w->seq,
+                    w->size, resp);
+            if (rc == WH_ERROR_NOTREADY) {
+                continue;
+            }
+        }
+
+#ifdef WOLFHSM_SERVER_STATS
+        /* Includes the time spent waiting for the worker */
+        _wh_Server_RecordStats(server, w->kind, w->req_size, w->size, w->rc,
+                (const uint8_t*)w->packet, w->start_time);
+#endif
+        wh_Server_Lock(server);
+        w->state = WH_SERVER_WORKER_IDLE;
+        server->comms[w->comm_index].busy = 0;
+        wh_Server_Unlock(server);
+        posted++;
+    }
+    return posted;
+}
+#endif /* !WOLFHSM_NO_CRYPTO && WH_SERVER_WORKER_COUNT > 0 */
+
+#ifdef WOLFHSM_SERVER_STATS
+static uint64_t _wh_Server_StatsTime(whServerContext* server)
+{
+    if (server->stats_time_cb == NULL) {
+        return 0;
+    }
+    return server->stats_time_cb(server->stats_time_context);
+}
+
+static void _wh_Server_RecordStats(whServerContext* server, uint16_t kind,
+        uint16_t req_size, uint16_t resp_size, int rc, const uint8_t* resp,
+        uint64_t start)
+{
+    whMessageCommStatsEntry* e = NULL;
+    uint16_t group = WH_MESSAGE_GROUP(kind);
+    uint64_t elapsed = _wh_Server_StatsTime(server) - start;
+    uint32_t t = 0;
+    int32_t resp_rc = 0;
+    int bin = 0;
+    int i = 0;
+
+    for (i = 0; i < server->stats_count; i++) {
+        if (server->stats[i].kind == kind) {
+            e = &server->stats[i];
+            break;
+        }
+    }
+    if (e == NULL) {
+        if (server->stats_count < WH_SERVER_STATS_COUNT - 1) {
+            e = &server->stats[server->stats_count++];
+        } else {
+            /* The last entry collects everything else */
+            e = &server->stats[WH_SERVER_STATS_COUNT - 1];
+            kind = WH_MESSAGE_KIND_NONE;
+            server->stats_count = WH_SERVER_STATS_COUNT;
         }
+        e->kind = kind;
+    }
+
+    /* Responses of these groups start with a return code */
+    switch (group) {
+    case WH_MESSAGE_GROUP_NVM:
+    case WH_MESSAGE_GROUP_KEY:
+    case WH_MESSAGE_GROUP_CRYPTO:
+    case WH_MESSAGE_GROUP_SHE:
+    case WH_MESSAGE_GROUP_COUNTER:
+        if ((rc == 0) && (resp_size >= sizeof(resp_rc))) {
+            memcpy(&resp_rc, resp, sizeof(resp_rc));
+        }
+        break;
+    default:
+        break;
+    }
+    if ((rc != 0) || (resp_rc != 0)) {
+        e->errors++;
+    }
+
+    t = (elapsed > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed;
+    if ((e->count == 0) || (t < e->min_time)) {
+        e->min_time = t;
+    }
+    if (t > e->max_time) {
+        e->max_time = t;
     }
+    e->count++;
+    e->total_time += elapsed;
+    e->bytes_in += req_size;
+    e->bytes_out += resp_size;
+
+    /* Bin i holds times below 4^(i+1) */
+    for (t >>= 2; (t != 0) && (bin < WH_MESSAGE_COMM_STATS_BINS - 1); t >>= 2) {
+        bin++;
+    }
+    e->hist[bin]++;
+}
+#endif /* WOLFHSM_SERVER_STATS */
+
+/* Scheduling rank of a waiting request: its class, then its channel */
+static int _wh_Server_CommRank(const whServerComm* c)
+{
+    return (_wh_Server_ClassRank(c->cls) << 8) | c->priority;
+}
+
+/* Answer a request that could not be received, e.g. a frame shorter than the
+ * comm header, so the transport lets it go and the channel can be used again */
+static void _wh_Server_DropRequest(whServerContext* server, uint16_t index,
+        int rc)
+{
+    whServerComm* c = &server->comms[index];
+
+#ifdef WOLFHSM_SERVER_STATS
+    /* Counted as an error of kind none */
+    _wh_Server_RecordStats(server, WH_MESSAGE_KIND_NONE, 0, 0, rc, NULL,
+            _wh_Server_StatsTime(server));
+#else
+    (void)rc;
+#endif
+    c->held = 0;
+    (void)wh_CommServer_SendResponse(c->comm, WH_COMM_MAGIC_NATIVE,
+            WH_MESSAGE_KIND_NONE, 0, 0, NULL);
+}
+
+/* Service at most one request, taking the waiting requests by rank */
+static int _wh_Server_ServiceComms(whServerContext* server)
+{
+    int rc = WH_ERROR_NOTREADY;
+    int level = 0x10000;
+    int next_level = 0;
+    int rank = 0;
+    uint16_t n = 0;
+    uint16_t index = 0;
+    whServerComm* c = NULL;
+
+    /* Collect the requests waiting on each channel */
+    for (index = 0; index < server->comm_count; index++) {
+        c = &server->comms[index];
+        if (c->connected == WH_COMM_DISCONNECTED) {
+            c->held = 0;
+        }
+        rc = _wh_Server_PollComm(server, index);
+        if ((rc != WH_ERROR_OK) && (rc != WH_ERROR_NOTREADY)) {
+            /* One bad request must not hold up the other channels */
+            _wh_Server_DropRequest(server, index, rc);
+        }
+    }
+    rc = WH_ERROR_NOTREADY;
+
+    while (1) {
+        /* Find the next lower rank waiting */
+        next_level = -1;
+        for (index = 0; index < server->comm_count; index++) {
+            c = &server->comms[index];
+            rank = _wh_Server_CommRank(c);
+            if (    (c->held != 0) &&
+                    (rank < level) &&
+                    (rank > next_level)) {
+                next_level = rank;
+            }
+        }
+        if (next_level < 0) {
+            break;
+        }
+        level = next_level;
+
+        /* Round-robin between the channels at this rank */
+        for (n = 0; n < server->comm_count; n++) {
+            index = (server->comm_next + n) % server->comm_count;
+            c = &server->comms[index];
+            if ((c->held == 0) || (_wh_Server_CommRank(c) != level)) {
+                continue;
+            }
+            rc = _wh_Server_ServiceComm(server, index);
+            if (rc != WH_ERROR_NOTREADY) {
+                server->comm_next = (index + 1) % server->comm_count;
+                return rc;
+            }
+        }
+    }
+    return rc;
+}
+
+#ifdef WH_SERVER_KEYGEN_JOBS
+/* Start the oldest queued keygen job on an idle worker, or run it here if the
+ * server is otherwise idle.  Returns 1 if a job was started */
+static int _wh_Server_RunJob(whServerContext* server, int idle)
+{
+    whServerJob* job = NULL;
+    whPacket packet[1] = {0};
+    uint16_t size = 0;
+    int ret = 0;
+    int i = 0;
+
+    for (i = 0; i < WH_SERVER_JOB_COUNT; i++) {
+        if (server->job[i].state == WH_SERVER_JOB_QUEUED) {
+            job = &server->job[i];
+            break;
+        }
+    }
+    if (job == NULL) {
+        return 0;
+    }
+
+    packet->pkRsakgReq.type = WC_PK_TYPE_RSA_KEYGEN;
+    packet->pkRsakgReq.size = job->size;
+    packet->pkRsakgReq.e = job->e;
+    size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkRsakgReq);
+
+#if WH_SERVER_WORKER_COUNT > 0
+    if (_wh_Server_SubmitWork(server, job->comm_index, WH_COMM_MAGIC_NATIVE,
+            WH_MESSAGE_KIND(WH_MESSAGE_GROUP_CRYPTO, WC_ALGO_TYPE_PK), 0,
+            size, (uint8_t*)packet, (uint16_t)(i + 1)) == WH_ERROR_OK) {
+        job->state = WH_SERVER_JOB_RUNNING;
+        return 1;
+    }
+#endif
+    if (idle == 0) {
+        return 0;
+    }
+
+    /* wolfCrypt keygen cannot be split up, so run it in one go */
+    job->state = WH_SERVER_JOB_RUNNING;
+    ret = wh_Server_HandleCryptoRequestEx(server, server->crypto,
+            server->comms[job->comm_index].comm, WC_ALGO_TYPE_PK,
+            (uint8_t*)packet, &size);
+    job->rc = (ret != 0) ? ret : packet->rc;
+    job->keyId = packet->pkRsakgRes.keyId |
+        (server->comms[job->comm_index].comm->client_id << 8);
+    job->state = WH_SERVER_JOB_DONE;
+    return 1;
+}
+#endif /* WH_SERVER_KEYGEN_JOBS */
+
+int wh_Server_HandleRequestMessage(whServerContext* server)
+{
+    int rc = WH_ERROR_NOTREADY;
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+    int posted = 0;
+#endif
+
+    if (server == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+    posted = _wh_Server_PostWork(server);
+#endif
+
+    rc = _wh_Server_ServiceComms(server);
+
+#ifdef WH_SERVER_KEYGEN_JOBS
+    /* Jobs only take the server's own time when no request is waiting */
+    if (    (_wh_Server_RunJob(server, rc == WH_ERROR_NOTREADY) != 0) &&
+            (rc == WH_ERROR_NOTREADY)) {
+        rc = WH_ERROR_OK;
+    }
+#endif
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+    if ((rc == WH_ERROR_NOTREADY) && (posted > 0)) {
+        rc = WH_ERROR_OK;
+    }
+#endif
     return rc;
 }
+
+int wh_Server_RunIdle(whServerContext* server)
+{
+    int rc = 0;
+    uint32_t reclaim_size = 0;
+    whNvmId reclaim_objects = 0;
+
+    if (server == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Compact NVM before it fills up rather than in the middle of a write.
+     * Without incremental compaction a single step could take too long */
+    if (    (server->nvm != NULL) &&
+            (server->nvm->cb != NULL) &&
+            (server->nvm->cb->GetAvailable != NULL) &&
+            (server->nvm->cb->Compact != NULL) &&
+            (server->run.nvm_reclaim_size > 0) ) {
+        uint16_t index = 0;
+
+        wh_Server_Lock(server);
+        /* A client that went away mid-stream would hold off compaction */
+        for (index = 0; index < server->comm_count; index++) {
+            if (server->comms[index].connected == WH_COMM_DISCONNECTED) {
+                (void)wh_Nvm_AddObjectAbort(server->nvm,
+                        server->comms[index].comm);
+            }
+        }
+        if (server->nvm_compacting == 0) {
+            rc = wh_Nvm_GetAvailable(server->nvm, NULL, NULL, &reclaim_size,
+                    &reclaim_objects);
+            server->nvm_compacting = (rc == 0) &&
+                    (reclaim_objects > 0) &&
+                    (reclaim_size >= server->run.nvm_reclaim_size);
+        }
+        if (server->nvm_compacting != 0) {
+            rc = wh_Nvm_Compact(server->nvm, server->run.nvm_compact_size);
+            server->nvm_compacting = (rc == WH_ERROR_NOTREADY) ||
+                    (rc == WH_ERROR_LOCKED);
+            if ((rc == 0) || (rc == WH_ERROR_NOTREADY)) {
+                rc = 1;
+            } else if (rc == WH_ERROR_LOCKED) {
+                /* An open stream holds it off, so there is nothing to do
+                 * until the stream ends */
+                rc = 0;
+            }
+        }
+        wh_Server_Unlock(server);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_RNG_POOL_SIZE > 0)
+    /* Generate RNG output before it is asked for */
+    rc = hsmRefillRngPool(server);
+    if (rc != 0) {
+        return rc;
+    }
+#endif
+#if !defined(WOLFHSM_NO_CRYPTO) && \
+    ((WH_SERVER_EPHEMERAL_ECC_COUNT > 0) || \
+    (WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0))
+    /* and ephemeral keys before a handshake needs them */
+    rc = hsmRefillEphemeralKeys(server);
+    if (rc != 0) {
+        return rc;
+    }
+#endif
+#if defined(WOLFHSM_SHE_EXTENSION) && (WH_SHE_RND_POOL_COUNT > 0)
+    rc = hsmSheRefillRnd(server);
+    if (rc != 0) {
+        return rc;
+    }
+#endif
+
+    if (server->run.idle_cb != NULL) {
+        rc = server->run.idle_cb(server->run.context, server);
+    }
+    return rc;
+}
+
+int wh_Server_Run(whServerContext* server)
+{
+    int rc = 0;
+    uint16_t index = 0;
+
+    if (server == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    while (1) {
+        rc = wh_Server_HandleRequestMessage(server);
+        if (rc == WH_ERROR_OK) {
+            continue;
+        }
+        if (rc != WH_ERROR_NOTREADY) {
+            return rc;
+        }
+
+        for (index = 0; index < server->comm_count; index++) {
+            if (server->comms[index].connected == WH_COMM_CONNECTED) {
+                break;
+            }
+        }
+        if ((index == server->comm_count) &&
+                (server->run.exit_disconnected != 0)) {
+            return WH_ERROR_OK;
+        }
+
+        /* Check for requests again after each maintenance step. A failed
+         * step is retried after sleeping rather than stopping the server */
+        rc = wh_Server_RunIdle(server);
+        if (rc > 0) {
+            continue;
+        }
+        if (rc < 0) {
+            server->idle_error = rc;
+        }
+
+        if (server->run.wait_cb != NULL) {
+            rc = server->run.wait_cb(server->run.context,
+                    server->run.timeout_ms);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    }
+}
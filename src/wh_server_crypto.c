@@ -26,20 +26,73 @@
 #include "wolfssl/wolfcrypt/settings.h"
 #include "wolfssl/wolfcrypt/types.h"
 #include "wolfssl/wolfcrypt/error-crypt.h"
+#include "wolfssl/wolfcrypt/sha256.h"
 
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_message.h"
 #include "wolfhsm/wh_server.h"
 #include "wolfhsm/wh_server_keystore.h"
 #include "wolfhsm/wh_packet.h"
 #include "wolfhsm/wh_server_crypto.h"
 
+/* The key cache and NVM are shared with the server and the other workers.
+ * Hold the server lock while using them, acting for the client on comm */
+static whCommServer* _wh_Server_CryptoLock(whServerContext* server,
+    whCommServer* comm)
+{
+    whCommServer* prev;
+    wh_Server_Lock(server);
+    prev = server->comm;
+    server->comm = comm;
+    return prev;
+}
+
+static void _wh_Server_CryptoUnlock(whServerContext* server,
+    whCommServer* prev)
+{
+    server->comm = prev;
+    wh_Server_Unlock(server);
+}
+
+#if defined(HAVE_ECC) || defined(HAVE_CURVE25519)
+/* Keep a shared secret in the key cache under keyId, or a new id when
+ * WOLFHSM_KEYID_ERASED, and wipe it from the packet */
+static int hsmCacheSharedSecret(whServerContext* server, whCommServer* comm,
+    uint32_t keyId, uint32_t flags, uint8_t* secret, uint32_t secretSz,
+    whKeyId* outId)
+{
+    int ret = 0;
+    whNvmMetadata meta[1] = {0};
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO,
+        server->comm->client_id, keyId);
+    meta->flags = flags;
+    meta->len = secretSz;
+    if ((keyId & WOLFHSM_KEYID_MASK) == WOLFHSM_KEYID_ERASED)
+        ret = hsmGetUniqueId(server, &meta->id);
+    if (ret == 0)
+        ret = hsmCacheKey(server, meta, secret);
+    if (ret == 0) {
+        /* remove the client_id like a key cache response */
+        *outId = (meta->id & WOLFHSM_KEYID_MASK);
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    XMEMSET(secret, 0, secretSz);
+    return ret;
+}
+#endif /* HAVE_ECC || HAVE_CURVE25519 */
+
 #ifndef NO_RSA
-static int hsmCacheKeyRsa(whServerContext* server, RsaKey* key, whKeyId* outId)
+static int hsmCacheKeyRsa(whServerContext* server, whCommServer* comm,
+    RsaKey* key, whKeyId* outId)
 {
     int ret = 0;
     int slotIdx = 0;
     whKeyId keyId = WOLFHSM_KEYTYPE_CRYPTO;
+    whNvmMetadata meta[1] = {0};
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
     /* get a free slot */
-    ret = slotIdx = hsmCacheFindSlot(server);
+    ret = slotIdx = hsmCacheFindSlot(server, WOLFHSM_KEYCACHE_BUFSIZE);
     if (ret >= 0) {
         ret = hsmGetUniqueId(server, &keyId);
     }
@@ -47,150 +100,1729 @@ static int hsmCacheKeyRsa(whServerContext* server, RsaKey* key, whKeyId* outId)
         /* export key */
         /* TODO: Fix wolfCrypto to allow KeyToDer when KEY_GEN is NOT set */
         ret = wc_RsaKeyToDer(key, server->cache[slotIdx].buffer,
-            WOLFHSM_KEYCACHE_BUFSIZE);
+            server->cache[slotIdx].size);
     }
     if (ret > 0) {
         /* set meta */
-        XMEMSET((uint8_t*)server->cache[slotIdx].meta, 0,
-            sizeof(server->cache[slotIdx].meta));
-        server->cache[slotIdx].meta->id = keyId;
-        server->cache[slotIdx].meta->len = ret;
+        meta->id = keyId;
+        meta->len = ret;
+        hsmCacheSetMeta(server, slotIdx, meta);
         /* export keyId */
         *outId = keyId;
         ret = 0;
     }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+
+static int hsmLoadKeyRsa(whServerContext* server, whCommServer* comm,
+    RsaKey* key, whKeyId keyId)
+{
+    int ret = 0;
+    int slotIdx = 0;
+    uint32_t idx = 0;
+    uint32_t size;
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    keyId |= (WOLFHSM_KEYTYPE_CRYPTO | (server->comm->client_id << 8));
+    /* freshen the key */
+    ret = slotIdx = hsmFreshenKey(server, keyId);
+    /* decode the key */
+    if (ret >= 0) {
+        size = server->cache[slotIdx].meta->len;
+        ret = wc_RsaPrivateKeyDecode(server->cache[slotIdx].buffer, (word32*)&idx, key,
+            size);
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+#endif /* !NO_RSA */
+
+#ifdef HAVE_CURVE25519
+static int hsmCacheKeyCurve25519(whServerContext* server, whCommServer* comm,
+    curve25519_key* key, whKeyId* outId)
+{
+    int ret;
+    int slotIdx = 0;
+    word32 privSz = CURVE25519_KEYSIZE;
+    word32 pubSz = CURVE25519_KEYSIZE;
+    whKeyId keyId = WOLFHSM_KEYTYPE_CRYPTO;
+    whNvmMetadata meta[1] = {0};
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    /* get a free slot */
+    ret = slotIdx = hsmCacheFindSlot(server, CURVE25519_KEYSIZE * 2);
+    if (ret >= 0) {
+        ret = hsmGetUniqueId(server, &keyId);
+    }
+    if (ret == 0) {
+        /* export key */
+        ret = wc_curve25519_export_key_raw(key,
+            server->cache[slotIdx].buffer + CURVE25519_KEYSIZE, &privSz,
+            server->cache[slotIdx].buffer, &pubSz);
+    }
+    if (ret == 0) {
+        /* set meta */
+        meta->id = keyId;
+        meta->len = CURVE25519_KEYSIZE * 2;
+        hsmCacheSetMeta(server, slotIdx, meta);
+        /* export keyId */
+        *outId = keyId;
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+
+static int hsmLoadKeyCurve25519(whServerContext* server, whCommServer* comm,
+    curve25519_key* key, whKeyId keyId)
+{
+    int ret = 0;
+    int slotIdx = 0;
+    uint32_t privSz = CURVE25519_KEYSIZE;
+    uint32_t pubSz = CURVE25519_KEYSIZE;
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    keyId |= WOLFHSM_KEYTYPE_CRYPTO;
+    /* freshen the key */
+    ret = slotIdx = hsmFreshenKey(server, keyId);
+    /* decode the key */
+    if (ret >= 0) {
+        ret = wc_curve25519_import_public(server->cache[slotIdx].buffer, pubSz,
+            key);
+    }
+    /* only import private if what we got back holds 2 keys */
+    if (ret == 0 && server->cache[slotIdx].meta->len == CURVE25519_KEYSIZE * 2) {
+        ret = wc_curve25519_import_private(
+            server->cache[slotIdx].buffer + pubSz, privSz, key);
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+#endif /* HAVE_CURVE25519 */
+
+#ifdef HAVE_ED25519
+/* Cached as pub | priv, or pub alone for a public key */
+static int hsmCacheKeyEd25519(whServerContext* server, whCommServer* comm,
+    ed25519_key* key, whKeyId* outId)
+{
+    int ret;
+    int slotIdx = 0;
+    word32 privSz = ED25519_KEY_SIZE;
+    word32 pubSz = ED25519_PUB_KEY_SIZE;
+    whKeyId keyId = WOLFHSM_KEYTYPE_CRYPTO;
+    whNvmMetadata meta[1] = {0};
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    /* get a free slot */
+    ret = slotIdx = hsmCacheFindSlot(server,
+        ED25519_PUB_KEY_SIZE + ED25519_KEY_SIZE);
+    if (ret >= 0) {
+        ret = hsmGetUniqueId(server, &keyId);
+    }
+    /* export key */
+    if (ret == 0) {
+        ret = wc_ed25519_export_public(key, server->cache[slotIdx].buffer,
+            &pubSz);
+    }
+    if (ret == 0) {
+        ret = wc_ed25519_export_private_only(key,
+            server->cache[slotIdx].buffer + ED25519_PUB_KEY_SIZE, &privSz);
+    }
+    if (ret == 0) {
+        /* set meta */
+        meta->id = keyId;
+        meta->len = ED25519_PUB_KEY_SIZE + ED25519_KEY_SIZE;
+        hsmCacheSetMeta(server, slotIdx, meta);
+        /* export keyId */
+        *outId = keyId;
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+
+static int hsmLoadKeyEd25519(whServerContext* server, whCommServer* comm,
+    ed25519_key* key, whKeyId keyId)
+{
+    int ret = 0;
+    int slotIdx = 0;
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    keyId |= WOLFHSM_KEYTYPE_CRYPTO;
+    /* freshen the key */
+    ret = slotIdx = hsmFreshenKey(server, keyId);
+    /* decode the key, with the private part if what we got holds it */
+    if (ret >= 0) {
+        if (server->cache[slotIdx].meta->len ==
+                ED25519_PUB_KEY_SIZE + ED25519_KEY_SIZE) {
+            ret = wc_ed25519_import_private_key(
+                server->cache[slotIdx].buffer + ED25519_PUB_KEY_SIZE,
+                ED25519_KEY_SIZE, server->cache[slotIdx].buffer,
+                ED25519_PUB_KEY_SIZE, key);
+        }
+        else {
+            ret = wc_ed25519_import_public(server->cache[slotIdx].buffer,
+                server->cache[slotIdx].meta->len, key);
+        }
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+#endif /* HAVE_ED25519 */
+
+#ifdef HAVE_ECC
+static int hsmCacheKeyEcc(whServerContext* server, whCommServer* comm,
+    ecc_key* key, whKeyId* outId)
+{
+    int ret;
+    int slotIdx = 0;
+    uint32_t qxLen;
+    uint32_t qyLen;
+    uint32_t qdLen;
+    whKeyId keyId = WOLFHSM_KEYTYPE_CRYPTO;
+    whNvmMetadata meta[1] = {0};
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    /* get a free slot */
+    ret = slotIdx = hsmCacheFindSlot(server, key->dp->size * 3);
+    if (ret >= 0) {
+        ret = hsmGetUniqueId(server, &keyId);
+    }
+    /* export key */
+    if (ret == 0) {
+        qxLen = qyLen = qdLen = key->dp->size;
+        ret = wc_ecc_export_private_raw(key, server->cache[slotIdx].buffer,
+            &qxLen, server->cache[slotIdx].buffer + qxLen,
+            &qyLen, server->cache[slotIdx].buffer + qxLen + qyLen, &qdLen);
+    }
+    if (ret == 0) {
+        /* set meta */
+        meta->id = keyId;
+        meta->len = qxLen + qyLen + qdLen;
+        hsmCacheSetMeta(server, slotIdx, meta);
+        /* export keyId */
+        *outId = keyId;
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+
+static int hsmLoadKeyEcc(whServerContext* server, whCommServer* comm,
+    ecc_key* key, uint16_t keyId, int curveId)
+{
+    int ret;
+    int slotIdx = 0;
+    uint32_t keySz;
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    keyId |= WOLFHSM_KEYTYPE_CRYPTO;
+    /* freshen the key */
+    ret = slotIdx = hsmFreshenKey(server, keyId);
+    /* decode the key */
+    if (ret >= 0) {
+        keySz = server->cache[slotIdx].meta->len / 3;
+        ret = wc_ecc_import_unsigned(key, server->cache[slotIdx].buffer,
+            server->cache[slotIdx].buffer + keySz,
+            server->cache[slotIdx].buffer + keySz * 2, curveId);
+    }
+    _wh_Server_CryptoUnlock(server, prev);
+    return ret;
+}
+#endif /* HAVE_ECC */
+
+/* Kinds of decoded key, AES ones by the mode the key is set up for */
+enum {
+    WH_DECODED_NONE        = 0,
+    WH_DECODED_RSA         = 1,
+    WH_DECODED_ECC         = 2,
+    WH_DECODED_CURVE25519  = 3,
+    WH_DECODED_AES_CBC_ENC = 4,
+    WH_DECODED_AES_CBC_DEC = 5,
+    WH_DECODED_AES_GCM     = 6,
+    WH_DECODED_CMAC        = 7,
+    WH_DECODED_ED25519     = 8,
+};
+
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+
+static void _wh_Server_DecodedFree(whServerDecodedKey* d)
+{
+    switch (d->type) {
+#ifndef NO_RSA
+    case WH_DECODED_RSA:
+        wc_FreeRsaKey(d->key.rsa);
+        break;
+#endif
+#ifdef HAVE_ECC
+    case WH_DECODED_ECC:
+        wc_ecc_free(d->key.ecc);
+        break;
+#endif
+#ifdef HAVE_CURVE25519
+    case WH_DECODED_CURVE25519:
+        wc_curve25519_free(d->key.curve25519);
+        break;
+#endif
+#ifdef HAVE_ED25519
+    case WH_DECODED_ED25519:
+        wc_ed25519_free(d->key.ed25519);
+        break;
+#endif
+#ifndef NO_AES
+    case WH_DECODED_AES_CBC_ENC:
+    case WH_DECODED_AES_CBC_DEC:
+    case WH_DECODED_AES_GCM:
+        wc_AesFree(d->key.aes);
+        break;
+#endif
+#ifdef WOLFSSL_CMAC
+    case WH_DECODED_CMAC:
+        wc_CmacFree(d->key.cmac);
+        break;
+#endif
+    default:
+        break;
+    }
+    XMEMSET((uint8_t*)d, 0, sizeof(*d));
+}
+
+/* Find the decoded copy of the key or claim the least recently used entry to
+ * decode it into, setting *outHit on a match. Returns NULL if the key or all
+ * entries are held by other requests, in which case the key is decoded into
+ * the caller's own crypto context */
+static whServerDecodedKey* _wh_Server_DecodedGet(whServerContext* server,
+    whKeyId keyId, uint8_t type, int devId, int curveId, int* outHit)
+{
+    whServerDecodedKey* d;
+    whServerDecodedKey* found = NULL;
+    int i;
+    uint8_t pin = 0;
+#if WH_SERVER_ECC_PINNED_COUNT > 0
+    int pinnedUsed = 0;
+#endif
+    *outHit = 0;
+    wh_Server_Lock(server);
+#if WH_SERVER_ECC_PINNED_COUNT > 0
+    /* keyId is the full id the key is cached under, client bits included */
+    if (type == WH_DECODED_ECC)
+        pin = (uint8_t)hsmKeyIsPinned(server, keyId);
+    for (i = 0; i < WH_SERVER_DECODED_KEY_COUNT; i++)
+        pinnedUsed += server->decoded[i].pinned;
+    /* a pinned key over budget replaces another pinned key, anything else
+     * replaces an unpinned one */
+    pin = (pin && pinnedUsed >= WH_SERVER_ECC_PINNED_COUNT) ? 2 : pin;
+#endif
+    for (i = 0; i < WH_SERVER_DECODED_KEY_COUNT; i++) {
+        d = &server->decoded[i];
+        if (d->id == keyId && d->type == type && d->devId == devId &&
+                d->curveId == curveId && d->stale == 0) {
+            found = (d->busy == 0) ? d : NULL;
+            *outHit = (found != NULL);
+            break;
+        }
+        if (d->pinned != (pin == 2))
+            continue;
+        if (d->busy == 0 && (found == NULL ||
+                (found->id != WOLFHSM_KEYID_ERASED &&
+                (d->id == WOLFHSM_KEYID_ERASED ||
+                server->cacheTick - d->lastUse >
+                server->cacheTick - found->lastUse)))) {
+            found = d;
+        }
+    }
+    if (found != NULL) {
+        if (*outHit == 0) {
+            _wh_Server_DecodedFree(found);
+            found->id = keyId;
+            found->type = type;
+            found->devId = devId;
+            found->curveId = curveId;
+            found->pinned = (pin != 0);
+        }
+        found->busy = 1;
+        found->lastUse = ++server->cacheTick;
+    }
+    wh_Server_Unlock(server);
+    return found;
+}
+
+/* Give back a decoded key, freeing it if it failed to decode (keep == 0) or
+ * went stale while in use */
+static void _wh_Server_DecodedPut(whServerContext* server,
+    whServerDecodedKey* d, int keep)
+{
+    wh_Server_Lock(server);
+    d->busy = 0;
+    if (keep == 0 || d->stale != 0)
+        _wh_Server_DecodedFree(d);
+    wh_Server_Unlock(server);
+}
+
+static whServerDecodedKey* _wh_Server_DecodedFind(whServerContext* server,
+    const void* key)
+{
+    int i;
+    for (i = 0; i < WH_SERVER_DECODED_KEY_COUNT; i++) {
+        if ((const void*)&server->decoded[i].key == key)
+            return &server->decoded[i];
+    }
+    return NULL;
+}
+
+void hsmInvalidateDecodedKey(whServerContext* server, whKeyId keyId)
+{
+    int i;
+    for (i = 0; i < WH_SERVER_DECODED_KEY_COUNT; i++) {
+        if (server->decoded[i].id != keyId)
+            continue;
+        if (server->decoded[i].busy != 0)
+            server->decoded[i].stale = 1;
+        else
+            _wh_Server_DecodedFree(&server->decoded[i]);
+    }
+}
+
+void hsmFreeDecodedKeys(whServerContext* server)
+{
+    int i;
+    for (i = 0; i < WH_SERVER_DECODED_KEY_COUNT; i++)
+        _wh_Server_DecodedFree(&server->decoded[i]);
+}
+#endif /* WH_SERVER_DECODED_KEY_COUNT > 0 */
+
+/* Get the key for an operation, decoded into own unless a decoded copy can be
+ * used. Must be given back with the matching put, even on failure */
+#ifndef NO_RSA
+static int hsmGetKeyRsa(whServerContext* server, whCommServer* comm,
+    RsaKey* own, int devId, whKeyId keyId, RsaKey** outKey)
+{
+    int ret;
+    RsaKey* key = own;
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    int hit = 0;
+    whServerDecodedKey* d = _wh_Server_DecodedGet(server,
+        keyId | WOLFHSM_KEYTYPE_CRYPTO | (comm->client_id << 8),
+        WH_DECODED_RSA, devId, 0, &hit);
+    if (d != NULL) {
+        *outKey = d->key.rsa;
+        if (hit)
+            return 0;
+        key = d->key.rsa;
+    }
+#endif
+    if (key == own)
+        *outKey = own;
+    ret = wc_InitRsaKey_ex(key, NULL, devId);
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    if (ret != 0 && d != NULL)
+        d->type = WH_DECODED_NONE;
+#endif
+    if (ret == 0)
+        ret = hsmLoadKeyRsa(server, comm, key, keyId);
+    return ret;
+}
+
+static void hsmPutKeyRsa(whServerContext* server, RsaKey* key, int ret)
+{
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    whServerDecodedKey* d = _wh_Server_DecodedFind(server, key);
+    if (d != NULL) {
+        _wh_Server_DecodedPut(server, d, ret == 0);
+        return;
+    }
+#endif
+    (void)server;
+    (void)ret;
+    wc_FreeRsaKey(key);
+}
+#endif /* !NO_RSA */
+
+#ifdef HAVE_CURVE25519
+static int hsmGetKeyCurve25519(whServerContext* server, whCommServer* comm,
+    curve25519_key* own, int devId, whKeyId keyId, curve25519_key** outKey)
+{
+    int ret;
+    curve25519_key* key = own;
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    int hit = 0;
+    whServerDecodedKey* d = _wh_Server_DecodedGet(server,
+        keyId | WOLFHSM_KEYTYPE_CRYPTO | (comm->client_id << 8),
+        WH_DECODED_CURVE25519, devId, 0, &hit);
+    if (d != NULL) {
+        *outKey = d->key.curve25519;
+        if (hit)
+            return 0;
+        key = d->key.curve25519;
+    }
+#endif
+    if (key == own)
+        *outKey = own;
+    ret = wc_curve25519_init_ex(key, NULL, devId);
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    if (ret != 0 && d != NULL)
+        d->type = WH_DECODED_NONE;
+#endif
+    if (ret == 0)
+        ret = hsmLoadKeyCurve25519(server, comm, key, keyId);
+    return ret;
+}
+
+static void hsmPutKeyCurve25519(whServerContext* server, curve25519_key* key,
+    int ret)
+{
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    whServerDecodedKey* d = _wh_Server_DecodedFind(server, key);
+    if (d != NULL) {
+        _wh_Server_DecodedPut(server, d, ret == 0);
+        return;
+    }
+#endif
+    (void)server;
+    (void)ret;
+    wc_curve25519_free(key);
+}
+#endif /* HAVE_CURVE25519 */
+
+#ifdef HAVE_ED25519
+static int hsmGetKeyEd25519(whServerContext* server, whCommServer* comm,
+    ed25519_key* own, int devId, whKeyId keyId, ed25519_key** outKey)
+{
+    int ret;
+    ed25519_key* key = own;
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    int hit = 0;
+    whServerDecodedKey* d = _wh_Server_DecodedGet(server,
+        keyId | WOLFHSM_KEYTYPE_CRYPTO | (comm->client_id << 8),
+        WH_DECODED_ED25519, devId, 0, &hit);
+    if (d != NULL) {
+        *outKey = d->key.ed25519;
+        if (hit)
+            return 0;
+        key = d->key.ed25519;
+    }
+#endif
+    if (key == own)
+        *outKey = own;
+    ret = wc_ed25519_init_ex(key, NULL, devId);
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    if (ret != 0 && d != NULL)
+        d->type = WH_DECODED_NONE;
+#endif
+    if (ret == 0)
+        ret = hsmLoadKeyEd25519(server, comm, key, keyId);
+    return ret;
+}
+
+static void hsmPutKeyEd25519(whServerContext* server, ed25519_key* key,
+    int ret)
+{
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    whServerDecodedKey* d = _wh_Server_DecodedFind(server, key);
+    if (d != NULL) {
+        _wh_Server_DecodedPut(server, d, ret == 0);
+        return;
+    }
+#endif
+    (void)server;
+    (void)ret;
+    wc_ed25519_free(key);
+}
+#endif /* HAVE_ED25519 */
+
+#ifdef HAVE_ECC
+static int hsmGetKeyEcc(whServerContext* server, whCommServer* comm,
+    ecc_key* own, int devId, whKeyId keyId, int curveId, ecc_key** outKey)
+{
+    int ret;
+    ecc_key* key = own;
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    int hit = 0;
+    whServerDecodedKey* d = _wh_Server_DecodedGet(server,
+        keyId | WOLFHSM_KEYTYPE_CRYPTO | (comm->client_id << 8),
+        WH_DECODED_ECC, devId, curveId, &hit);
+    if (d != NULL) {
+        *outKey = d->key.ecc;
+        if (hit)
+            return 0;
+        key = d->key.ecc;
+    }
+#endif
+    if (key == own)
+        *outKey = own;
+    ret = wc_ecc_init_ex(key, NULL, devId);
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    if (ret != 0 && d != NULL)
+        d->type = WH_DECODED_NONE;
+#endif
+    if (ret == 0)
+        ret = hsmLoadKeyEcc(server, comm, key, keyId, curveId);
+    return ret;
+}
+
+static void hsmPutKeyEcc(whServerContext* server, ecc_key* key, int ret)
+{
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    whServerDecodedKey* d = _wh_Server_DecodedFind(server, key);
+    if (d != NULL) {
+        _wh_Server_DecodedPut(server, d, ret == 0);
+        return;
+    }
+#endif
+    (void)server;
+    (void)ret;
+    wc_ecc_free(key);
+}
+#endif /* HAVE_ECC */
+
+#if !defined(NO_AES) && defined(WOLFHSM_SYMMETRIC_INTERNAL) && \
+    (defined(HAVE_AES_CBC) || defined(HAVE_AESGCM))
+/* Get an AES context with the key schedule, and for GCM the GHASH table, of a
+ * cached key already set up for mode */
+static int hsmGetKeyAes(whServerContext* server, whCommServer* comm,
+    Aes* own, int devId, whKeyId keyId, uint8_t mode, Aes** outKey)
+{
+    int ret;
+    uint32_t keySz = AES_MAX_KEY_SIZE + AES_IV_SIZE;
+    uint8_t tmpKey[AES_MAX_KEY_SIZE + AES_IV_SIZE];
+    whCommServer* prev;
+    Aes* key = own;
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    int hit = 0;
+    whServerDecodedKey* d = _wh_Server_DecodedGet(server,
+        keyId | WOLFHSM_KEYTYPE_CRYPTO | (comm->client_id << 8), mode, devId,
+        0, &hit);
+    if (d != NULL) {
+        *outKey = d->key.aes;
+        if (hit)
+            return 0;
+        key = d->key.aes;
+    }
+#endif
+    if (key == own)
+        *outKey = own;
+    /* init key with possible hardware */
+    ret = wc_AesInit(key, NULL, devId);
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    if (ret != 0 && d != NULL)
+        d->type = WH_DECODED_NONE;
+#endif
+    /* load the key from keystore */
+    if (ret == 0) {
+        prev = _wh_Server_CryptoLock(server, comm);
+        ret = hsmReadKey(server, keyId | WOLFHSM_KEYTYPE_CRYPTO, NULL, tmpKey,
+            &keySz);
+        _wh_Server_CryptoUnlock(server, prev);
+    }
+    if (ret == 0) {
+#ifdef HAVE_AESGCM
+        if (mode == WH_DECODED_AES_GCM)
+            ret = wc_AesGcmSetKey(key, tmpKey, keySz);
+#endif
+#ifdef HAVE_AES_CBC
+        if (mode != WH_DECODED_AES_GCM) {
+            ret = wc_AesSetKey(key, tmpKey, keySz, NULL,
+                mode == WH_DECODED_AES_CBC_ENC ?
+                AES_ENCRYPTION : AES_DECRYPTION);
+        }
+#endif
+    }
+    return ret;
+}
+
+static void hsmPutKeyAes(whServerContext* server, Aes* key, int ret)
+{
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    whServerDecodedKey* d = _wh_Server_DecodedFind(server, key);
+    if (d != NULL) {
+        _wh_Server_DecodedPut(server, d, ret == 0);
+        return;
+    }
+#endif
+    (void)server;
+    (void)ret;
+    wc_AesFree(key);
+}
+#endif /* !NO_AES && WOLFHSM_SYMMETRIC_INTERNAL */
+
+#ifdef WH_SERVER_STREAMS
+/* Take the stream of algo for a request, or a free one to open when handle is
+ * 0 */
+static whServerStream* _wh_Server_StreamGet(whServerContext* server,
+    whCommServer* comm, uint32_t algo, uint32_t handle)
+{
+    whServerStream* s = NULL;
+    int i;
+    wh_Server_Lock(server);
+    for (i = 0; i < WH_SERVER_STREAM_COUNT; i++) {
+        if (handle == 0 && server->stream[i].comm == NULL) {
+            s = &server->stream[i];
+            s->comm = comm;
+            s->algo = algo;
+            /* skip 0, which is never a valid handle, and keep handles in 16
+             * bits so one fits a wolfCrypt devCtx with a key id */
+            if (++server->stream_next_handle > 0xFFFF)
+                server->stream_next_handle = 1;
+            s->handle = server->stream_next_handle;
+            break;
+        }
+        /* only the client that opened a stream may use it */
+        if (handle != 0 && server->stream[i].handle == handle &&
+                server->stream[i].comm == comm &&
+                server->stream[i].algo == algo &&
+                server->stream[i].busy == 0) {
+            s = &server->stream[i];
+            break;
+        }
+    }
+    if (s != NULL)
+        s->busy = 1;
+    wh_Server_Unlock(server);
+    return s;
+}
+
+static void _wh_Server_StreamFree(whServerStream* s)
+{
+    switch (s->algo) {
+#ifndef NO_AES
+    case WC_ALGO_TYPE_CIPHER:
+        wc_AesFree(s->state.aes);
+        break;
+#endif
+    case WC_ALGO_TYPE_HASH:
+#ifndef NO_SHA256
+        if (s->type == WC_HASH_TYPE_SHA256)
+            wc_Sha256Free(s->state.sha256);
+#endif
+#ifdef WOLFSSL_SHA384
+        if (s->type == WC_HASH_TYPE_SHA384)
+            wc_Sha384Free(s->state.sha384);
+#endif
+#ifdef WOLFSSL_SHA512
+        if (s->type == WC_HASH_TYPE_SHA512)
+            wc_Sha512Free(s->state.sha512);
+#endif
+        break;
+#ifndef NO_HMAC
+    case WC_ALGO_TYPE_HMAC:
+        wc_HmacFree(s->state.hmac);
+        break;
+#endif
+#ifdef WOLFSSL_CMAC
+    case WC_ALGO_TYPE_CMAC:
+        wc_CmacFree(s->state.cmac);
+        break;
+#endif
+    default:
+        break;
+    }
+    XMEMSET((uint8_t*)s, 0, sizeof(*s));
+}
+
+/* Give back a stream, closing it if done */
+static void _wh_Server_StreamPut(whServerContext* server, whServerStream* s,
+    int done)
+{
+    wh_Server_Lock(server);
+    if (done)
+        _wh_Server_StreamFree(s);
+    s->busy = 0;
+    wh_Server_Unlock(server);
+}
+
+void hsmFreeStreams(whServerContext* server, whCommServer* comm)
+{
+    int i;
+    for (i = 0; i < WH_SERVER_STREAM_COUNT; i++) {
+        /* one still held by a request is closed by it */
+        if (server->stream[i].comm == NULL || server->stream[i].busy != 0 ||
+                (comm != NULL && server->stream[i].comm != comm))
+            continue;
+        _wh_Server_StreamFree(&server->stream[i]);
+    }
+}
+
+#ifndef NO_AES
+static int _wh_Server_HandleCipherStream(whServerContext* server,
+    crypto_context* crypto, whCommServer* comm, uint16_t action,
+    whPacket* packet, uint16_t* size)
+{
+    int ret = 0;
+    uint32_t field;
+    uint8_t* in;
+    uint8_t* out;
+    uint8_t* key;
+    uint8_t* iv;
+    uint8_t* authIn;
+    whServerStream* s;
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    uint8_t tmpKey[AES_MAX_KEY_SIZE + AES_IV_SIZE];
+    whCommServer* prev;
+#endif
+
+    switch (action)
+    {
+    case WH_CRYPTO_CIPHER_STREAM_INIT:
+        /* key and iv are after the fixed size fields */
+        key = (uint8_t*)(&packet->cipherStreamInitReq + 1);
+        iv = key + packet->cipherStreamInitReq.keyLen;
+        if (*size < WOLFHSM_PACKET_STUB_SIZE +
+                sizeof(packet->cipherStreamInitReq) +
+                packet->cipherStreamInitReq.keyLen +
+                packet->cipherStreamInitReq.ivSz)
+            return WH_ERROR_BADARGS;
+#ifdef HAVE_AES_CBC
+        if (packet->cipherStreamInitReq.type == WC_CIPHER_AES_CBC &&
+                packet->cipherStreamInitReq.ivSz != AES_IV_SIZE)
+            return WH_ERROR_BADARGS;
+#endif
+        switch (packet->cipherStreamInitReq.type) {
+#ifdef HAVE_AES_CBC
+        case WC_CIPHER_AES_CBC:
+#endif
+#if defined(HAVE_AESGCM) && defined(WOLFSSL_AESGCM_STREAM)
+        case WC_CIPHER_AES_GCM:
+#endif
+            break;
+        default:
+            return NOT_COMPILED_IN;
+        }
+        s = _wh_Server_StreamGet(server, comm, WC_ALGO_TYPE_CIPHER, 0);
+        if (s == NULL)
+            return WH_ERROR_NOSPACE;
+        s->type = packet->cipherStreamInitReq.type;
+        s->enc = (packet->cipherStreamInitReq.enc == 1);
+        field = packet->cipherStreamInitReq.keyLen;
+        /* init key with possible hardware */
+        ret = wc_AesInit(s->state.aes, NULL, crypto->devId);
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+        /* load the key from keystore */
+        if (ret == 0) {
+            field = sizeof(tmpKey);
+            prev = _wh_Server_CryptoLock(server, comm);
+            ret = hsmReadKey(server, *(uint32_t*)key | WOLFHSM_KEYTYPE_CRYPTO,
+                NULL, tmpKey, &field);
+            _wh_Server_CryptoUnlock(server, prev);
+            key = tmpKey;
+        }
+#endif
+        if (ret == 0) {
+#ifdef HAVE_AES_CBC
+            if (s->type == WC_CIPHER_AES_CBC) {
+                ret = wc_AesSetKey(s->state.aes, key, field, iv,
+                    s->enc ? AES_ENCRYPTION : AES_DECRYPTION);
+            }
+#endif
+#if defined(HAVE_AESGCM) && defined(WOLFSSL_AESGCM_STREAM)
+            if (s->type == WC_CIPHER_AES_GCM) {
+                ret = wc_AesGcmInit(s->state.aes, key, field, iv,
+                    packet->cipherStreamInitReq.ivSz);
+            }
+#endif
+        }
+        if (ret == 0) {
+            packet->cipherStreamInitRes.handle = s->handle;
+            *size = WOLFHSM_PACKET_STUB_SIZE +
+                sizeof(packet->cipherStreamInitRes);
+        }
+        _wh_Server_StreamPut(server, s, ret != 0);
+        break;
+    case WH_CRYPTO_CIPHER_STREAM_UPDATE:
+        /* in and authIn are after the fixed size fields */
+        in = (uint8_t*)(&packet->cipherStreamUpdateReq + 1);
+        authIn = in + packet->cipherStreamUpdateReq.sz;
+        out = (uint8_t*)(&packet->cipherStreamUpdateRes + 1);
+        if (*size < WOLFHSM_PACKET_STUB_SIZE +
+                sizeof(packet->cipherStreamUpdateReq) +
+                packet->cipherStreamUpdateReq.sz +
+                packet->cipherStreamUpdateReq.authInSz)
+            return WH_ERROR_BADARGS;
+        s = _wh_Server_StreamGet(server, comm, WC_ALGO_TYPE_CIPHER,
+            packet->cipherStreamUpdateReq.handle);
+        if (s == NULL)
+            return WH_ERROR_NOTFOUND;
+        /* store this since it will be overwritten */
+        field = packet->cipherStreamUpdateReq.sz;
+#ifdef HAVE_AES_CBC
+        if (s->type == WC_CIPHER_AES_CBC) {
+            /* CBC chains on whole blocks */
+            if ((field % AES_BLOCK_SIZE) != 0 ||
+                    packet->cipherStreamUpdateReq.authInSz != 0)
+                ret = WH_ERROR_BADARGS;
+            else if (s->enc)
+                ret = wc_AesCbcEncrypt(s->state.aes, out, in, field);
+            else
+                ret = wc_AesCbcDecrypt(s->state.aes, out, in, field);
+        }
+#endif
+#if defined(HAVE_AESGCM) && defined(WOLFSSL_AESGCM_STREAM)
+        if (s->type == WC_CIPHER_AES_GCM) {
+            if (s->enc) {
+                ret = wc_AesGcmEncryptUpdate(s->state.aes, out, in, field, authIn,
+                    packet->cipherStreamUpdateReq.authInSz);
+            }
+            else {
+                ret = wc_AesGcmDecryptUpdate(s->state.aes, out, in, field, authIn,
+                    packet->cipherStreamUpdateReq.authInSz);
+            }
+        }
+#endif
+        if (ret == 0) {
+            packet->cipherStreamUpdateRes.sz = field;
+            *size = WOLFHSM_PACKET_STUB_SIZE +
+                sizeof(packet->cipherStreamUpdateRes) + field;
+        }
+        /* a failed update leaves the stream unusable */
+        _wh_Server_StreamPut(server, s, ret != 0);
+        break;
+    case WH_CRYPTO_CIPHER_STREAM_FINAL:
+        /* authTag is after the fixed size fields */
+        in = (uint8_t*)(&packet->cipherStreamFinalReq + 1);
+        out = (uint8_t*)(&packet->cipherStreamFinalRes + 1);
+        s = _wh_Server_StreamGet(server, comm, WC_ALGO_TYPE_CIPHER,
+            packet->cipherStreamFinalReq.handle);
+        if (s == NULL)
+            return WH_ERROR_NOTFOUND;
+        field = 0;
+#if defined(HAVE_AESGCM) && defined(WOLFSSL_AESGCM_STREAM)
+        if (s->type == WC_CIPHER_AES_GCM) {
+            if (*size < WOLFHSM_PACKET_STUB_SIZE +
+                    sizeof(packet->cipherStreamFinalReq) +
+                    packet->cipherStreamFinalReq.authTagSz)
+                ret = WH_ERROR_BADARGS;
+            else if (s->enc) {
+                field = packet->cipherStreamFinalReq.authTagSz;
+                ret = wc_AesGcmEncryptFinal(s->state.aes, out, field);
+            }
+            else {
+                ret = wc_AesGcmDecryptFinal(s->state.aes, in,
+                    packet->cipherStreamFinalReq.authTagSz);
+            }
+        }
+#endif
+        if (ret == 0) {
+            packet->cipherStreamFinalRes.authTagSz = field;
+            *size = WOLFHSM_PACKET_STUB_SIZE +
+                sizeof(packet->cipherStreamFinalRes) + field;
+        }
+        _wh_Server_StreamPut(server, s, 1);
+        break;
+    default:
+        ret = NOT_COMPILED_IN;
+        break;
+    }
+    return ret;
+}
+#endif /* !NO_AES */
+
+/* SHA-2 and HMAC with the state kept in a stream, for the wolfCrypt hash
+ * callbacks. Handle 0 opens a stream, final closes it */
+static int _wh_Server_HandleHash(whServerContext* server,
+    crypto_context* crypto, whCommServer* comm, uint16_t action,
+    whPacket* packet, uint16_t* size)
+{
+    int ret = 0;
+    uint32_t digestSz = 0;
+    uint8_t* in = (uint8_t*)(&packet->hashReq + 1);
+    uint8_t* out = (uint8_t*)(&packet->hashRes + 1);
+    whServerStream* s;
+#ifndef NO_HMAC
+    int slotIdx;
+    whCommServer* prev;
+#endif
+    /* store these since they will be overwritten */
+    wh_Packet_hash_req req = packet->hashReq;
+
+    if (*size < WOLFHSM_PACKET_STUB_SIZE + sizeof(req) + req.sz)
+        return WH_ERROR_BADARGS;
+    switch (req.type) {
+#ifndef NO_SHA256
+    case WC_HASH_TYPE_SHA256:
+        digestSz = WC_SHA256_DIGEST_SIZE;
+        break;
+#endif
+#ifdef WOLFSSL_SHA384
+    case WC_HASH_TYPE_SHA384:
+        digestSz = WC_SHA384_DIGEST_SIZE;
+        break;
+#endif
+#ifdef WOLFSSL_SHA512
+    case WC_HASH_TYPE_SHA512:
+        digestSz = WC_SHA512_DIGEST_SIZE;
+        break;
+#endif
+    default:
+        return NOT_COMPILED_IN;
+    }
+#ifdef NO_HMAC
+    if (action == WC_ALGO_TYPE_HMAC)
+        return NOT_COMPILED_IN;
+#endif
+
+    s = _wh_Server_StreamGet(server, comm, action, req.handle);
+    if (s == NULL)
+        return (req.handle == 0) ? WH_ERROR_NOSPACE : WH_ERROR_NOTFOUND;
+    if (req.handle == 0) {
+        s->type = req.type;
+#ifndef NO_HMAC
+        if (action == WC_ALGO_TYPE_HMAC) {
+            /* init with possible hardware, keyed by the cached key. SetKey
+             * hashes a key longer than the block size, so give it the key in
+             * the cache rather than a block sized copy */
+            ret = wc_HmacInit(s->state.hmac, NULL, crypto->devId);
+            if (ret == 0) {
+                prev = _wh_Server_CryptoLock(server, comm);
+                ret = slotIdx = hsmFreshenKey(server,
+                    (whKeyId)req.keyId | WOLFHSM_KEYTYPE_CRYPTO);
+                if (ret >= 0) {
+                    ret = wc_HmacSetKey(s->state.hmac, req.type,
+                        server->cache[slotIdx].buffer,
+                        server->cache[slotIdx].meta->len);
+                }
+                _wh_Server_CryptoUnlock(server, prev);
+            }
+        }
+#endif
+        if (action == WC_ALGO_TYPE_HASH) {
+            /* init with possible hardware */
+#ifndef NO_SHA256
+            if (req.type == WC_HASH_TYPE_SHA256)
+                ret = wc_InitSha256_ex(s->state.sha256, NULL, crypto->devId);
+#endif
+#ifdef WOLFSSL_SHA384
+            if (req.type == WC_HASH_TYPE_SHA384)
+                ret = wc_InitSha384_ex(s->state.sha384, NULL, crypto->devId);
+#endif
+#ifdef WOLFSSL_SHA512
+            if (req.type == WC_HASH_TYPE_SHA512)
+                ret = wc_InitSha512_ex(s->state.sha512, NULL, crypto->devId);
+#endif
+        }
+    }
+    else if (s->type != req.type)
+        ret = WH_ERROR_BADARGS;
+
+    if (ret == 0 && req.sz > 0) {
+#ifndef NO_HMAC
+        if (action == WC_ALGO_TYPE_HMAC)
+            ret = wc_HmacUpdate(s->state.hmac, in, req.sz);
+#endif
+#ifndef NO_SHA256
+        if (action == WC_ALGO_TYPE_HASH && req.type == WC_HASH_TYPE_SHA256)
+            ret = wc_Sha256Update(s->state.sha256, in, req.sz);
+#endif
+#ifdef WOLFSSL_SHA384
+        if (action == WC_ALGO_TYPE_HASH && req.type == WC_HASH_TYPE_SHA384)
+            ret = wc_Sha384Update(s->state.sha384, in, req.sz);
+#endif
+#ifdef WOLFSSL_SHA512
+        if (action == WC_ALGO_TYPE_HASH && req.type == WC_HASH_TYPE_SHA512)
+            ret = wc_Sha512Update(s->state.sha512, in, req.sz);
+#endif
+    }
+
+    if (ret == 0 && req.final != 0) {
+#ifndef NO_HMAC
+        if (action == WC_ALGO_TYPE_HMAC)
+            ret = wc_HmacFinal(s->state.hmac, out);
+#endif
+#ifndef NO_SHA256
+        if (action == WC_ALGO_TYPE_HASH && req.type == WC_HASH_TYPE_SHA256)
+            ret = wc_Sha256Final(s->state.sha256, out);
+#endif
+#ifdef WOLFSSL_SHA384
+        if (action == WC_ALGO_TYPE_HASH && req.type == WC_HASH_TYPE_SHA384)
+            ret = wc_Sha384Final(s->state.sha384, out);
+#endif
+#ifdef WOLFSSL_SHA512
+        if (action == WC_ALGO_TYPE_HASH && req.type == WC_HASH_TYPE_SHA512)
+            ret = wc_Sha512Final(s->state.sha512, out);
+#endif
+    }
+    else
+        digestSz = 0;
+
+    if (ret == 0) {
+        packet->hashRes.handle = (req.final != 0) ? 0 : s->handle;
+        packet->hashRes.digestSz = digestSz;
+        *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->hashRes) + digestSz;
+    }
+    /* a failed request leaves the stream unusable */
+    _wh_Server_StreamPut(server, s, ret != 0 || req.final != 0);
+    return ret;
+}
+
+/* Open a stream holding a copy of the state of a hash stream, so a copied
+ * wolfCrypt hash, such as the one wc_Sha256GetHash finalizes, does not close
+ * the stream of the original */
+static int _wh_Server_HandleHashCopy(whServerContext* server,
+    whCommServer* comm, whPacket* packet, uint16_t* size)
+{
+    int ret = NOT_COMPILED_IN;
+    whServerStream* src;
+    whServerStream* dst;
+    wh_Packet_hash_req req = packet->hashReq;
+
+    if (*size < WOLFHSM_PACKET_STUB_SIZE + sizeof(req) || req.handle == 0)
+        return WH_ERROR_BADARGS;
+    src = _wh_Server_StreamGet(server, comm, WC_ALGO_TYPE_HASH, req.handle);
+    if (src == NULL)
+        return WH_ERROR_NOTFOUND;
+    dst = _wh_Server_StreamGet(server, comm, WC_ALGO_TYPE_HASH, 0);
+    if (dst == NULL) {
+        _wh_Server_StreamPut(server, src, 0);
+        return WH_ERROR_NOSPACE;
+    }
+    dst->type = src->type;
+#ifndef NO_SHA256
+    if (src->type == WC_HASH_TYPE_SHA256)
+        ret = wc_Sha256Copy(src->state.sha256, dst->state.sha256);
+#endif
+#ifdef WOLFSSL_SHA384
+    if (src->type == WC_HASH_TYPE_SHA384)
+        ret = wc_Sha384Copy(src->state.sha384, dst->state.sha384);
+#endif
+#ifdef WOLFSSL_SHA512
+    if (src->type == WC_HASH_TYPE_SHA512)
+        ret = wc_Sha512Copy(src->state.sha512, dst->state.sha512);
+#endif
+    if (ret == 0) {
+        packet->hashRes.handle = dst->handle;
+        packet->hashRes.digestSz = 0;
+        *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->hashRes);
+    }
+    _wh_Server_StreamPut(server, dst, ret != 0);
+    _wh_Server_StreamPut(server, src, 0);
+    return ret;
+}
+
+#ifdef WOLFSSL_CMAC
+/* Set up cmac with a cached key. The key schedule and K1/K2 subkeys are
+ * copied from the decoded key cache when the key was used before */
+static int hsmInitKeyCmac(whServerContext* server, whCommServer* comm,
+    int devId, whKeyId keyId, Cmac* cmac)
+{
+    int ret;
+    uint32_t keySz = AES_MAX_KEY_SIZE;
+    uint8_t tmpKey[AES_MAX_KEY_SIZE];
+    whCommServer* prev;
+    Cmac* key = cmac;
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    int hit = 0;
+    whServerDecodedKey* d = _wh_Server_DecodedGet(server,
+        keyId | WOLFHSM_KEYTYPE_CRYPTO | (comm->client_id << 8),
+        WH_DECODED_CMAC, devId, 0, &hit);
+    if (d != NULL && hit) {
+        XMEMCPY((uint8_t*)cmac, (uint8_t*)d->key.cmac, sizeof(*cmac));
+        _wh_Server_DecodedPut(server, d, 1);
+        return 0;
+    }
+    if (d != NULL)
+        key = d->key.cmac;
+#endif
+    /* load the key from keystore */
+    prev = _wh_Server_CryptoLock(server, comm);
+    ret = hsmReadKey(server, keyId | WOLFHSM_KEYTYPE_CRYPTO, NULL, tmpKey,
+        &keySz);
+    _wh_Server_CryptoUnlock(server, prev);
+    /* init with possible hardware, which derives the subkeys */
+    if (ret == 0) {
+        ret = wc_InitCmac_ex(key, tmpKey, keySz, WC_CMAC_AES, NULL, NULL,
+            devId);
+    }
+    XMEMSET(tmpKey, 0, sizeof(tmpKey));
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    if (d != NULL) {
+        if (ret == 0)
+            XMEMCPY((uint8_t*)cmac, (uint8_t*)d->key.cmac, sizeof(*cmac));
+        _wh_Server_DecodedPut(server, d, ret == 0);
+    }
+#endif
+    return ret;
+}
+
+/* AES CMAC with the state kept in a stream, for the wolfCrypt CMAC callback.
+ * Handle 0 opens a stream with the key in the request or a cached key, final
+ * closes it */
+static int _wh_Server_HandleCmac(whServerContext* server,
+    crypto_context* crypto, whCommServer* comm, whPacket* packet,
+    uint16_t* size)
+{
+    int ret = 0;
+    word32 outSz = 0;
+    uint8_t* in = (uint8_t*)(&packet->cmacReq + 1);
+    uint8_t* key;
+    uint8_t* out = (uint8_t*)(&packet->cmacRes + 1);
+    whServerStream* s;
+    /* store these since they will be overwritten */
+    wh_Packet_cmac_req req = packet->cmacReq;
+
+    key = in + req.inSz;
+    if (*size < WOLFHSM_PACKET_STUB_SIZE + sizeof(req) + req.inSz +
+            req.keySz || req.outSz > AES_BLOCK_SIZE)
+        return WH_ERROR_BADARGS;
+    if (req.type != WC_CMAC_AES)
+        return NOT_COMPILED_IN;
+    /* a new stream needs a key */
+    if (req.handle == 0 && req.keySz == 0 && req.keyId == WOLFHSM_KEYID_ERASED)
+        return WH_ERROR_BADARGS;
+
+    s = _wh_Server_StreamGet(server, comm, WC_ALGO_TYPE_CMAC, req.handle);
+    if (s == NULL)
+        return (req.handle == 0) ? WH_ERROR_NOSPACE : WH_ERROR_NOTFOUND;
+    if (req.handle == 0) {
+        s->type = req.type;
+        if (req.keySz > 0) {
+            ret = wc_InitCmac_ex(s->state.cmac, key, req.keySz, WC_CMAC_AES,
+                NULL, NULL, crypto->devId);
+        }
+        else {
+            ret = hsmInitKeyCmac(server, comm, crypto->devId, req.keyId,
+                s->state.cmac);
+        }
+    }
+    if (ret == 0 && req.inSz > 0)
+        ret = wc_CmacUpdate(s->state.cmac, in, req.inSz);
+    if (ret == 0 && req.final != 0) {
+        outSz = req.outSz;
+        ret = wc_CmacFinal(s->state.cmac, out, &outSz);
+    }
+    if (ret == 0) {
+        packet->cmacRes.handle = (req.final != 0) ? 0 : s->handle;
+        packet->cmacRes.outSz = outSz;
+        *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cmacRes) + outSz;
+    }
+    /* a failed request leaves the stream unusable */
+    _wh_Server_StreamPut(server, s, ret != 0 || req.final != 0);
+    return ret;
+}
+#endif /* WOLFSSL_CMAC */
+#endif /* WH_SERVER_STREAMS */
+
+#if !defined(NO_AES) && (defined(HAVE_AES_CBC) || defined(HAVE_AESGCM))
+static int _wh_Server_HandleCipherDma(whServerContext* server,
+    crypto_context* crypto, whCommServer* comm, whPacket* packet,
+    uint16_t* size)
+{
+    int ret;
+    int ret2;
+    uint32_t field;
+    uint8_t* key;
+    uint8_t* iv;
+    uint8_t* authTag;
+    void* in = NULL;
+    void* out = NULL;
+    void* authIn = NULL;
+    Aes* aes = NULL;
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    int loaded;
+    uint8_t mode;
+#endif
+    /* store these since they will be overwritten */
+    wh_Packet_cipher_dma_req req = packet->cipherDmaReq;
+
+    /* key, iv and authTag are after the fixed size fields. check each length
+     * against what is left, a sum of them could wrap */
+    if (*size < WOLFHSM_PACKET_STUB_SIZE + sizeof(req) ||
+            req.authTagSz > AES_BLOCK_SIZE)
+        return WH_ERROR_BADARGS;
+    field = *size - WOLFHSM_PACKET_STUB_SIZE - sizeof(req);
+    if (req.keyLen > field)
+        return WH_ERROR_BADARGS;
+    field -= req.keyLen;
+    if (req.ivSz > field)
+        return WH_ERROR_BADARGS;
+    field -= req.ivSz;
+    if (req.enc != 1 && req.authTagSz > field)
+        return WH_ERROR_BADARGS;
+    key = (uint8_t*)(&packet->cipherDmaReq + 1);
+    iv = key + req.keyLen;
+    authTag = iv + req.ivSz;
+    switch (req.type) {
+#ifdef HAVE_AES_CBC
+    case WC_CIPHER_AES_CBC:
+        if (req.ivSz != AES_IV_SIZE || req.sz == 0 ||
+                (req.sz % AES_BLOCK_SIZE) != 0 || req.authInSz != 0)
+            return WH_ERROR_BADARGS;
+        break;
+#endif
+#ifdef HAVE_AESGCM
+    case WC_CIPHER_AES_GCM:
+        break;
+#endif
+    default:
+        return NOT_COMPILED_IN;
+    }
+
+    /* map the client buffers, nothing is copied through the packet */
+    ret = 0;
+    if (req.sz > 0) {
+        ret = wh_Server_DmaProcessClientAddress(server, req.inAddr, &in, req.sz,
+            WH_DMA_OPER_CLIENT_READ_PRE, (whServerDmaFlags){0});
+        if (ret == 0) {
+            ret = wh_Server_DmaProcessClientAddress(server, req.outAddr, &out,
+                req.sz, WH_DMA_OPER_CLIENT_WRITE_PRE, (whServerDmaFlags){0});
+        }
+    }
+    if (ret == 0 && req.authInSz > 0) {
+        ret = wh_Server_DmaProcessClientAddress(server, req.authInAddr, &authIn,
+            req.authInSz, WH_DMA_OPER_CLIENT_READ_PRE, (whServerDmaFlags){0});
+    }
+
+    if (ret == 0) {
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+        /* get the key from the keystore, set up for the mode */
+        if (req.type == WC_CIPHER_AES_GCM)
+            mode = WH_DECODED_AES_GCM;
+        else if (req.enc == 1)
+            mode = WH_DECODED_AES_CBC_ENC;
+        else
+            mode = WH_DECODED_AES_CBC_DEC;
+        ret = loaded = hsmGetKeyAes(server, comm, crypto->aes, crypto->devId,
+            (whKeyId)*(uint32_t*)key, mode, &aes);
+#else
+        (void)comm;
+        aes = crypto->aes;
+        /* init key with possible hardware */
+        ret = wc_AesInit(aes, NULL, crypto->devId);
+        if (ret == 0) {
+#ifdef HAVE_AES_CBC
+            if (req.type == WC_CIPHER_AES_CBC) {
+                ret = wc_AesSetKey(aes, key, req.keyLen, NULL,
+                    req.enc == 1 ? AES_ENCRYPTION : AES_DECRYPTION);
+            }
+#endif
+#ifdef HAVE_AESGCM
+            if (req.type == WC_CIPHER_AES_GCM)
+                ret = wc_AesGcmSetKey(aes, key, req.keyLen);
+#endif
+        }
+#endif
+        field = 0;
+#ifdef HAVE_AES_CBC
+        if (ret == 0 && req.type == WC_CIPHER_AES_CBC) {
+            ret = wc_AesSetIV(aes, iv);
+            if (ret == 0 && req.enc == 1)
+                ret = wc_AesCbcEncrypt(aes, out, in, req.sz);
+            else if (ret == 0)
+                ret = wc_AesCbcDecrypt(aes, out, in, req.sz);
+        }
+#endif
+#ifdef HAVE_AESGCM
+        if (ret == 0 && req.type == WC_CIPHER_AES_GCM) {
+            if (req.enc == 1) {
+                /* the tag is returned in the packet */
+                field = req.authTagSz;
+                ret = wc_AesGcmEncrypt(aes, out, in, req.sz, iv, req.ivSz,
+                    (uint8_t*)(&packet->cipherDmaRes + 1), field, authIn,
+                    req.authInSz);
+            }
+            else {
+                ret = wc_AesGcmDecrypt(aes, out, in, req.sz, iv, req.ivSz,
+                    authTag, req.authTagSz, authIn, req.authInSz);
+            }
+        }
+#endif
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+        hsmPutKeyAes(server, aes, loaded);
+#else
+        wc_AesFree(aes);
+#endif
+        if (ret == 0) {
+            packet->cipherDmaRes.sz = req.sz;
+            packet->cipherDmaRes.authTagSz = field;
+            *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->cipherDmaRes) +
+                field;
+        }
+    }
+
+    /* finish every buffer that was mapped, keeping the first error */
+    if (in != NULL) {
+        ret2 = wh_Server_DmaProcessClientAddress(server, req.inAddr, &in,
+            req.sz, WH_DMA_OPER_CLIENT_READ_POST, (whServerDmaFlags){0});
+        if (ret == 0)
+            ret = ret2;
+    }
+    if (out != NULL) {
+        ret2 = wh_Server_DmaProcessClientAddress(server, req.outAddr, &out,
+            req.sz, WH_DMA_OPER_CLIENT_WRITE_POST, (whServerDmaFlags){0});
+        if (ret == 0)
+            ret = ret2;
+    }
+    if (authIn != NULL) {
+        ret2 = wh_Server_DmaProcessClientAddress(server, req.authInAddr,
+            &authIn, req.authInSz, WH_DMA_OPER_CLIENT_READ_POST,
+            (whServerDmaFlags){0});
+        if (ret == 0)
+            ret = ret2;
+    }
+    return ret;
+}
+#endif /* !NO_AES && (HAVE_AES_CBC || HAVE_AESGCM) */
+
+#ifndef NO_SHA256
+static int _wh_Server_HandleHashDma(whServerContext* server,
+    crypto_context* crypto, whPacket* packet, uint16_t* size)
+{
+    int ret;
+    int ret2;
+    void* in = NULL;
+    wc_Sha256 sha[1];
+    /* store these since they will be overwritten */
+    wh_Packet_hash_dma_req req = packet->hashDmaReq;
+
+    if (*size < WOLFHSM_PACKET_STUB_SIZE + sizeof(req))
+        return WH_ERROR_BADARGS;
+    if (req.type != WC_HASH_TYPE_SHA256)
+        return NOT_COMPILED_IN;
+    ret = 0;
+    if (req.sz > 0) {
+        ret = wh_Server_DmaProcessClientAddress(server, req.inAddr, &in, req.sz,
+            WH_DMA_OPER_CLIENT_READ_PRE, (whServerDmaFlags){0});
+    }
+    if (ret == 0) {
+        /* init with possible hardware */
+        ret = wc_InitSha256_ex(sha, NULL, crypto->devId);
+        if (ret == 0) {
+            ret = wc_Sha256Update(sha, in, req.sz);
+            if (ret == 0) {
+                ret = wc_Sha256Final(sha,
+                    (uint8_t*)(&packet->hashDmaRes + 1));
+            }
+            wc_Sha256Free(sha);
+        }
+        if (ret == 0) {
+            packet->hashDmaRes.digestSz = WC_SHA256_DIGEST_SIZE;
+            *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->hashDmaRes) +
+                WC_SHA256_DIGEST_SIZE;
+        }
+    }
+    if (in != NULL) {
+        ret2 = wh_Server_DmaProcessClientAddress(server, req.inAddr, &in,
+            req.sz, WH_DMA_OPER_CLIENT_READ_POST, (whServerDmaFlags){0});
+        if (ret == 0)
+            ret = ret2;
+    }
+    return ret;
+}
+#endif /* !NO_SHA256 */
+
+#ifdef HAVE_ECC
+/* Verify several signatures in one message. The public key is only loaded
+ * again when the key id changes from the previous item, so items should be
+ * grouped by key */
+static int _wh_Server_HandleEccVerifyBatch(whServerContext* server,
+    crypto_context* crypto, whCommServer* comm, whPacket* packet,
+    uint16_t* size)
+{
+    int ret = 0;
+    int loaded = -1;
+    int res;
+    uint32_t i;
+    uint32_t off;
+    uint32_t valid = 0;
+    uint32_t failed = 0;
+    uint16_t keyId = 0;
+    ecc_key* eccPublic = NULL;
+    wh_Packet_pk_ecc_verify_item item;
+    /* store these since they will be overwritten */
+    wh_Packet_pk_ecc_verify_batch_req req = packet->pkEccVerifyBatchReq;
+
+    if (*size < WOLFHSM_PACKET_STUB_SIZE + sizeof(req) ||
+            req.count > WH_PACKET_ECC_VERIFY_BATCH_MAX) {
+        return WH_ERROR_BADARGS;
+    }
+    off = WOLFHSM_PACKET_STUB_SIZE + sizeof(req);
+    for (i = 0; i < req.count && ret == 0; i++) {
+        if (off + sizeof(item) > *size) {
+            ret = WH_ERROR_BADARGS;
+            break;
+        }
+        XMEMCPY(&item, (uint8_t*)packet + off, sizeof(item));
+        off += sizeof(item);
+        if (off + item.sigSz + item.hashSz > *size) {
+            ret = WH_ERROR_BADARGS;
+            break;
+        }
+        /* reuse the key of the previous item */
+        if (loaded != 0 || item.keyId != keyId) {
+            if (eccPublic != NULL)
+                hsmPutKeyEcc(server, eccPublic, loaded);
+            keyId = item.keyId;
+            loaded = hsmGetKeyEcc(server, comm, crypto->eccPublic,
+                crypto->devId, keyId, req.curveId, &eccPublic);
+        }
+        res = 0;
+        if (loaded == 0) {
+            if (wc_ecc_verify_hash((uint8_t*)packet + off, item.sigSz,
+                    (uint8_t*)packet + off + item.sigSz, item.hashSz, &res,
+                    eccPublic) != 0) {
+                failed |= 1U << i;
+            }
+            else if (res == 1)
+                valid |= 1U << i;
+        }
+        else
+            failed |= 1U << i;
+        off += item.sigSz + item.hashSz;
+    }
+    if (eccPublic != NULL)
+        hsmPutKeyEcc(server, eccPublic, loaded);
+    if (ret == 0) {
+        packet->pkEccVerifyBatchRes.count = req.count;
+        packet->pkEccVerifyBatchRes.valid = valid;
+        packet->pkEccVerifyBatchRes.failed = failed;
+        *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEccVerifyBatchRes);
+    }
+    return ret;
+}
+#endif /* HAVE_ECC */
+
+int hsmExportPublicKey(whServerContext* server, whKeyId keyId, uint32_t type,
+    whNvmMetadata* outMeta, uint8_t* out, uint32_t* outSz)
+{
+    int ret;
+    uint32_t len;
+#ifdef HAVE_ECC
+    int curveIdx;
+    int curveId = ECC_CURVE_INVALID;
+#endif
+#ifndef NO_RSA
+    word32 idx = 0;
+#endif
+    if (server == NULL || out == NULL || outSz == NULL)
+        return WH_ERROR_BADARGS;
+    /* read the whole key, then keep the public part */
+    len = *outSz;
+    ret = hsmReadKey(server, keyId, outMeta, out, &len);
+    if (ret != 0)
+        return ret;
+    switch (type) {
+#ifdef HAVE_ECC
+    case WOLFHSM_KEYFLAG_ECC:
+        /* cached as qx | qy | d. The type is the client's claim, so only
+         * release the public part of what really is a valid ECC key */
+        if (server->crypto == NULL) {
+            ret = WH_ERROR_BADARGS;
+            break;
+        }
+        for (curveIdx = 0; wc_ecc_is_valid_idx(curveIdx); curveIdx++) {
+            if (wc_ecc_get_curve_size_from_id(wc_ecc_get_curve_id(curveIdx))
+                    * 3 == (int)len) {
+                curveId = wc_ecc_get_curve_id(curveIdx);
+                break;
+            }
+        }
+        if (curveId == ECC_CURVE_INVALID) {
+            ret = WH_ERROR_ABORTED;
+            break;
+        }
+        ret = wc_ecc_init_ex(server->crypto->eccPrivate, NULL, INVALID_DEVID);
+        if (ret == 0) {
+            ret = wc_ecc_import_unsigned(server->crypto->eccPrivate, out,
+                out + len / 3, out + len / 3 * 2, curveId);
+            if (ret == 0)
+                ret = wc_ecc_check_key(server->crypto->eccPrivate);
+            wc_ecc_free(server->crypto->eccPrivate);
+        }
+        if (ret != 0)
+            ret = WH_ERROR_ABORTED;
+        else
+            *outSz = len / 3 * 2;
+        break;
+#endif
+#ifndef NO_RSA
+    case WOLFHSM_KEYFLAG_RSA:
+        if (server->crypto == NULL) {
+            ret = WH_ERROR_BADARGS;
+            break;
+        }
+        ret = wc_InitRsaKey_ex(server->crypto->rsa, NULL, INVALID_DEVID);
+        if (ret == 0) {
+            ret = wc_RsaPrivateKeyDecode(out, &idx, server->crypto->rsa, len);
+            if (ret == 0) {
+                XMEMSET(out, 0, len);
+                ret = wc_RsaKeyToPublicDer(server->crypto->rsa, out, *outSz);
+            }
+            wc_FreeRsaKey(server->crypto->rsa);
+        }
+        if (ret > 0) {
+            *outSz = ret;
+            ret = 0;
+        }
+        break;
+#endif
+    default:
+        ret = WH_ERROR_BADARGS;
+        break;
+    }
+    if (ret != 0)
+        XMEMSET(out, 0, len);
+    else if (len > *outSz)
+        XMEMSET(out + *outSz, 0, len - *outSz);
     return ret;
 }
 
-static int hsmLoadKeyRsa(whServerContext* server, RsaKey* key, whKeyId keyId)
+#if WH_SERVER_RNG_POOL_SIZE > 0
+int hsmRefillRngPool(whServerContext* server)
 {
     int ret = 0;
-    int slotIdx = 0;
-    uint32_t idx = 0;
-    uint32_t size;
-    keyId |= (WOLFHSM_KEYTYPE_CRYPTO | (server->comm->client_id << 8));
-    /* freshen the key */
-    ret = slotIdx = hsmFreshenKey(server, keyId);
-    /* decode the key */
-    if (ret >= 0) {
-        size = WOLFHSM_KEYCACHE_BUFSIZE;
-        ret = wc_RsaPrivateKeyDecode(server->cache[slotIdx].buffer, (word32*)&idx, key,
-            size);
+    if (server->crypto == NULL)
+        return 0;
+    wh_Server_Lock(server);
+    if (server->rngPoolCount < WH_SERVER_RNG_POOL_SIZE) {
+        ret = wc_RNG_GenerateBlock(server->crypto->rng,
+            server->rngPool + server->rngPoolCount,
+            WH_SERVER_RNG_POOL_SIZE - server->rngPoolCount);
+        if (ret == 0) {
+            server->rngPoolCount = WH_SERVER_RNG_POOL_SIZE;
+            ret = 1;
+        }
     }
+    wh_Server_Unlock(server);
     return ret;
 }
-#endif /* !NO_RSA */
+#endif
 
-#ifdef HAVE_CURVE25519
-static int hsmCacheKeyCurve25519(whServerContext* server, curve25519_key* key,
-    whKeyId* outId)
+#if (WH_SERVER_EPHEMERAL_ECC_COUNT > 0) || \
+    (WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0)
+/* Return the first full entry of the pool, or the first empty one */
+static whServerEphemeralKey* _hsmFindEphemeralKey(whServerEphemeralKey* pool,
+    int count, int full)
 {
-    int ret;
-    int slotIdx = 0;
-    word32 privSz = CURVE25519_KEYSIZE;
-    word32 pubSz = CURVE25519_KEYSIZE;
-    whKeyId keyId = WOLFHSM_KEYTYPE_CRYPTO;
-    /* get a free slot */
-    ret = slotIdx = hsmCacheFindSlot(server);
-    if (ret >= 0) {
-        ret = hsmGetUniqueId(server, &keyId);
-    }
-    if (ret == 0) {
-        /* export key */
-        ret = wc_curve25519_export_key_raw(key,
-            server->cache[slotIdx].buffer + CURVE25519_KEYSIZE, &privSz,
-            server->cache[slotIdx].buffer, &pubSz);
-    }
-    if (ret == 0) {
-        /* set meta */
-        XMEMSET((uint8_t*)server->cache[slotIdx].meta, 0,
-            sizeof(server->cache[slotIdx].meta));
-        server->cache[slotIdx].meta->id = keyId;
-        server->cache[slotIdx].meta->len = CURVE25519_KEYSIZE * 2;
-        /* export keyId */
-        *outId = keyId;
+    int i;
+    for (i = 0; i < count; i++) {
+        if ((pool[i].len != 0) == (full != 0))
+            return &pool[i];
     }
-    return ret;
+    return NULL;
 }
 
-static int hsmLoadKeyCurve25519(whServerContext* server, curve25519_key* key,
-    whKeyId keyId)
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+/* The curve wc_ecc_make_key_ex settles on for a size and curve id, where
+ * ECC_CURVE_DEF is the first curve of at least size bytes */
+static int _hsmEccResolveCurve(int size, int curveId)
 {
-    int ret = 0;
-    int slotIdx = 0;
-    uint32_t privSz = CURVE25519_KEYSIZE;
-    uint32_t pubSz = CURVE25519_KEYSIZE;
-    keyId |= WOLFHSM_KEYTYPE_CRYPTO;
-    /* freshen the key */
-    ret = slotIdx = hsmFreshenKey(server, keyId);
-    /* decode the key */
-    if (ret >= 0) {
-        ret = wc_curve25519_import_public(server->cache[slotIdx].buffer, pubSz,
-            key);
-    }
-    /* only import private if what we got back holds 2 keys */
-    if (ret == 0 && server->cache[slotIdx].meta->len == CURVE25519_KEYSIZE * 2) {
-        ret = wc_curve25519_import_private(
-            server->cache[slotIdx].buffer + pubSz, privSz, key);
+    int i;
+    const ecc_set_type* dp;
+    if (curveId != ECC_CURVE_DEF)
+        return curveId;
+    for (i = 0; (dp = wc_ecc_get_curve_params(i)) != NULL && dp->size != 0;
+            i++) {
+        if (size <= dp->size)
+            return dp->id;
     }
-    return ret;
+    return ECC_CURVE_INVALID;
 }
-#endif /* HAVE_CURVE25519 */
 
-#ifdef HAVE_ECC
-static int hsmCacheKeyEcc(whServerContext* server, ecc_key* key, whKeyId* outId)
+/* Whether a keygen request asks for the curve the ECC pool is filled with,
+ * however the curve is named */
+static int _hsmEphemeralEccMatch(uint32_t size, uint32_t curveId)
 {
-    int ret;
-    int slotIdx = 0;
-    uint32_t qxLen;
-    uint32_t qyLen;
-    uint32_t qdLen;
-    whKeyId keyId = WOLFHSM_KEYTYPE_CRYPTO;
-    /* get a free slot */
-    ret = slotIdx = hsmCacheFindSlot(server);
-    if (ret >= 0) {
-        ret = hsmGetUniqueId(server, &keyId);
-    }
-    /* export key */
-    if (ret == 0) {
-        qxLen = qyLen = qdLen = key->dp->size;
-        ret = wc_ecc_export_private_raw(key, server->cache[slotIdx].buffer,
-            &qxLen, server->cache[slotIdx].buffer + qxLen,
-            &qyLen, server->cache[slotIdx].buffer + qxLen + qyLen, &qdLen);
-    }
-    if (ret == 0) {
-        /* set meta */
-        XMEMSET((uint8_t*)server->cache[slotIdx].meta, 0,
-            sizeof(server->cache[slotIdx].meta));
-        server->cache[slotIdx].meta->id = keyId;
-        server->cache[slotIdx].meta->len = qxLen + qyLen + qdLen;
-        /* export keyId */
-        *outId = keyId;
+    return size == WH_SERVER_EPHEMERAL_ECC_SIZE &&
+        _hsmEccResolveCurve((int)size, (int)curveId) ==
+        _hsmEccResolveCurve(WH_SERVER_EPHEMERAL_ECC_SIZE,
+            WH_SERVER_EPHEMERAL_ECC_CURVE);
+}
+#endif
+
+/* Move a pooled key into the cache under a new id. Returns WH_ERROR_NOTFOUND
+ * if the pool is empty. Only the server thread fills the pools, and only
+ * entries that are empty, so it generates keys without the lock */
+static int hsmTakeEphemeralKey(whServerContext* server, whCommServer* comm,
+    whServerEphemeralKey* pool, int count, whKeyId* outId)
+{
+    int ret = WH_ERROR_NOTFOUND;
+    whServerEphemeralKey* e;
+    whNvmMetadata meta[1] = {0};
+    whCommServer* prev = _wh_Server_CryptoLock(server, comm);
+    e = _hsmFindEphemeralKey(pool, count, 1);
+    if (e != NULL) {
+        meta->id = WOLFHSM_KEYTYPE_CRYPTO;
+        meta->len = e->len;
+        ret = hsmGetUniqueId(server, &meta->id);
+        if (ret == 0)
+            ret = hsmCacheKey(server, meta, e->key);
+        if (ret == 0) {
+            *outId = meta->id;
+            XMEMSET(e->key, 0, e->len);
+            e->len = 0;
+        }
     }
+    _wh_Server_CryptoUnlock(server, prev);
     return ret;
 }
 
-static int hsmLoadKeyEcc(whServerContext* server, ecc_key* key, uint16_t keyId,
-    int curveId)
+int hsmRefillEphemeralKeys(whServerContext* server)
 {
-    int ret;
-    int slotIdx = 0;
-    uint32_t keySz;
-    keyId |= WOLFHSM_KEYTYPE_CRYPTO;
-    /* freshen the key */
-    ret = slotIdx = hsmFreshenKey(server, keyId);
-    /* decode the key */
-    if (ret >= 0) {
-        keySz = server->cache[slotIdx].meta->len / 3;
-        ret = wc_ecc_import_unsigned(key, server->cache[slotIdx].buffer,
-            server->cache[slotIdx].buffer + keySz,
-            server->cache[slotIdx].buffer + keySz * 2, curveId);
+    int ret = 0;
+    uint32_t len = 0;
+    whServerEphemeralKey* e = NULL;
+    crypto_context* crypto = server->crypto;
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+    word32 qxLen;
+    word32 qyLen;
+    word32 qdLen;
+#endif
+#if WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0
+    word32 privSz = CURVE25519_KEYSIZE;
+    word32 pubSz = CURVE25519_KEYSIZE;
+#endif
+    if (crypto == NULL)
+        return 0;
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+    wh_Server_Lock(server);
+    e = _hsmFindEphemeralKey(server->ephemeralEcc,
+        WH_SERVER_EPHEMERAL_ECC_COUNT, 0);
+    wh_Server_Unlock(server);
+    if (e != NULL) {
+        ret = wc_ecc_init_ex(crypto->eccPrivate, NULL, crypto->devId);
+        if (ret == 0) {
+            ret = wc_ecc_make_key_ex(crypto->rng, WH_SERVER_EPHEMERAL_ECC_SIZE,
+                crypto->eccPrivate, WH_SERVER_EPHEMERAL_ECC_CURVE);
+        }
+        if (ret == 0 && crypto->eccPrivate->dp->size * 3 > sizeof(e->key))
+            ret = BUFFER_E;
+        /* stored as hsmCacheKeyEcc does */
+        if (ret == 0) {
+            qxLen = qyLen = qdLen = crypto->eccPrivate->dp->size;
+            ret = wc_ecc_export_private_raw(crypto->eccPrivate, e->key,
+                &qxLen, e->key + qxLen, &qyLen, e->key + qxLen + qyLen,
+                &qdLen);
+            len = qxLen + qyLen + qdLen;
+        }
+        wc_ecc_free(crypto->eccPrivate);
     }
-    return ret;
+#endif
+#if WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0
+    if (e == NULL) {
+        wh_Server_Lock(server);
+        e = _hsmFindEphemeralKey(server->ephemeralCurve25519,
+            WH_SERVER_EPHEMERAL_CURVE25519_COUNT, 0);
+        wh_Server_Unlock(server);
+        if (e != NULL) {
+            ret = wc_curve25519_init_ex(crypto->curve25519Private, NULL,
+                crypto->devId);
+            if (ret == 0) {
+                ret = wc_curve25519_make_key(crypto->rng, CURVE25519_KEYSIZE,
+                    crypto->curve25519Private);
+            }
+            /* stored as hsmCacheKeyCurve25519 does */
+            if (ret == 0) {
+                ret = wc_curve25519_export_key_raw(crypto->curve25519Private,
+                    e->key + CURVE25519_KEYSIZE, &privSz, e->key, &pubSz);
+                len = CURVE25519_KEYSIZE * 2;
+            }
+            wc_curve25519_free(crypto->curve25519Private);
+        }
+    }
+#endif
+    if (e == NULL)
+        return 0;
+    if (ret != 0) {
+        XMEMSET(e->key, 0, sizeof(e->key));
+        return ret;
+    }
+    wh_Server_Lock(server);
+    e->len = (uint16_t)len;
+    wh_Server_Unlock(server);
+    return 1;
 }
-#endif /* HAVE_ECC */
+#endif
 
-int wh_Server_HandleCryptoRequest(whServerContext* server,
+int wh_Server_HandleCryptoRequestEx(whServerContext* server,
+    crypto_context* crypto, whCommServer* comm,
     uint16_t action, uint8_t* data, uint16_t* size)
 {
     int ret = 0;
@@ -198,6 +1830,11 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
     uint32_t field;
     uint8_t* in;
     whKeyId keyId = WOLFHSM_KEYID_ERASED;
+#if defined(HAVE_ECC) || defined(HAVE_CURVE25519)
+    uint32_t options;
+    uint32_t cacheId;
+    uint32_t cacheFlags;
+#endif
     uint8_t* out;
     uint8_t* key;
     uint8_t* iv;
@@ -206,11 +1843,32 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
     uint8_t* sig;
     uint8_t* hash;
     whPacket* packet = (whPacket*)data;
-#ifdef WOLFHSM_SYMMETRIC_INTERNAL
-    uint8_t tmpKey[AES_MAX_KEY_SIZE + AES_IV_SIZE];
+#if !defined(NO_RSA) || defined(HAVE_ECC) || defined(HAVE_CURVE25519) || \
+    defined(HAVE_ED25519) || defined(WOLFHSM_SYMMETRIC_INTERNAL)
+    int loaded;
+#endif
+#if !defined(NO_AES) && (defined(HAVE_AES_CBC) || defined(HAVE_AESGCM))
+    Aes* aes;
+#endif
+#ifndef NO_RSA
+    RsaKey* rsa;
+#endif
+#ifdef HAVE_ECC
+    ecc_key* eccPrivate;
+    ecc_key* eccPublic;
+#endif
+#ifdef HAVE_CURVE25519
+    curve25519_key* curve25519Private;
+    curve25519_key* curve25519Public;
+#endif
+#ifdef HAVE_ED25519
+    ed25519_key* ed25519;
+    uint8_t* context;
+    uint8_t ed25519Sig[ED25519_SIG_SIZE];
 #endif
 
-    if (server == NULL || server->crypto == NULL || data == NULL || size == NULL)
+    if (server == NULL || crypto == NULL || comm == NULL || data == NULL ||
+            size == NULL)
         return BAD_FUNC_ARG;
 
     switch (action)
@@ -227,39 +1885,40 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
             in = iv + AES_IV_SIZE;
             out = (uint8_t*)(&packet->cipherAesCbcRes + 1);
 #ifdef WOLFHSM_SYMMETRIC_INTERNAL
-            /* load the key from keystore */
-            field = sizeof(tmpKey);
-            ret = hsmReadKey(server, *(uint32_t*)key | WOLFHSM_KEYTYPE_CRYPTO,
-                NULL, tmpKey, &field);
-            if (ret == 0) {
-                /* set key to use tmpKey data */
-                key = tmpKey;
-                /* overwrite keyLen with internal length */
-                packet->cipherAesCbcReq.keyLen = field;
-            }
-#endif
+            /* get the key from the keystore, set up for the direction */
+            ret = loaded = hsmGetKeyAes(server, comm, crypto->aes,
+                crypto->devId, (whKeyId)*(uint32_t*)key,
+                packet->cipherAesCbcReq.enc == 1 ?
+                WH_DECODED_AES_CBC_ENC : WH_DECODED_AES_CBC_DEC, &aes);
+            if (ret == 0)
+                ret = wc_AesSetIV(aes, iv);
+#else
+            aes = crypto->aes;
             /* init key with possible hardware */
-            if (ret == 0) {
-                ret = wc_AesInit(server->crypto->aes, NULL,
-                    server->crypto->devId);
-            }
+            ret = wc_AesInit(aes, NULL,
+                crypto->devId);
             /* load the key */
             if (ret == 0) {
-                ret = wc_AesSetKey(server->crypto->aes, key,
+                ret = wc_AesSetKey(aes, key,
                     packet->cipherAesCbcReq.keyLen, iv,
                     packet->cipherAesCbcReq.enc == 1 ?
                     AES_ENCRYPTION : AES_DECRYPTION);
             }
+#endif
             /* do the crypto operation */
             if (ret == 0) {
                 /* store this since it will be overwritten */
                 field = packet->cipherAesCbcReq.sz;
                 if (packet->cipherAesCbcReq.enc == 1)
-                    ret = wc_AesCbcEncrypt(server->crypto->aes, out, in, field);
+                    ret = wc_AesCbcEncrypt(aes, out, in, field);
                 else
-                    ret = wc_AesCbcDecrypt(server->crypto->aes, out, in, field);
+                    ret = wc_AesCbcDecrypt(aes, out, in, field);
             }
-            wc_AesFree(server->crypto->aes);
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+            hsmPutKeyAes(server, aes, loaded);
+#else
+            wc_AesFree(aes);
+#endif
             /* encode the return sz */
             if (ret == 0) {
                 /* set sz */
@@ -278,27 +1937,21 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
             authIn = in + packet->cipherAesGcmReq.sz;
             out = (uint8_t*)(&packet->cipherAesGcmRes + 1);
 #ifdef WOLFHSM_SYMMETRIC_INTERNAL
-            /* load the key from keystore */
-            field = sizeof(tmpKey);
-            ret = hsmReadKey(server, *(uint32_t*)key | WOLFHSM_KEYTYPE_CRYPTO,
-                NULL, tmpKey, &field);
-            if (ret == 0) {
-                /* set key to use tmpKey data */
-                key = tmpKey;
-                /* overwrite keyLen with internal length */
-                packet->cipherAesGcmReq.keyLen = field;
-            }
-#endif
+            /* get the key from the keystore with its GHASH table */
+            ret = loaded = hsmGetKeyAes(server, comm, crypto->aes,
+                crypto->devId, (whKeyId)*(uint32_t*)key, WH_DECODED_AES_GCM,
+                &aes);
+#else
+            aes = crypto->aes;
             /* init key with possible hardware */
-            if (ret == 0) {
-                ret = wc_AesInit(server->crypto->aes, NULL,
-                    server->crypto->devId);
-            }
+            ret = wc_AesInit(aes, NULL,
+                crypto->devId);
             /* load the key */
             if (ret == 0) {
-                ret = wc_AesGcmSetKey(server->crypto->aes, key,
+                ret = wc_AesGcmSetKey(aes, key,
                     packet->cipherAesGcmReq.keyLen);
             }
+#endif
             /* do the crypto operation */
             if (ret == 0) {
                 /* store this since it will be overwritten */
@@ -311,7 +1964,7 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
                     /* copy authTagSz since it will be overwritten */
                     packet->cipherAesGcmRes.authTagSz =
                         packet->cipherAesGcmReq.authTagSz;
-                    ret = wc_AesGcmEncrypt(server->crypto->aes, out, in, field,
+                    ret = wc_AesGcmEncrypt(aes, out, in, field,
                         iv, packet->cipherAesGcmReq.ivSz, authTag,
                         packet->cipherAesGcmReq.authTagSz, authIn,
                         packet->cipherAesGcmReq.authInSz);
@@ -319,13 +1972,17 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
                 else {
                     /* set authTag as a packet input */
                     authTag = authIn + packet->cipherAesGcmReq.authInSz;
-                    ret = wc_AesGcmDecrypt(server->crypto->aes, out, in, field,
+                    ret = wc_AesGcmDecrypt(aes, out, in, field,
                         iv, packet->cipherAesGcmReq.ivSz, authTag,
                         packet->cipherAesGcmReq.authTagSz, authIn,
                         packet->cipherAesGcmReq.authInSz);
                 }
             }
-            wc_AesFree(server->crypto->aes);
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+            hsmPutKeyAes(server, aes, loaded);
+#else
+            wc_AesFree(aes);
+#endif
             /* encode the return sz */
             if (ret == 0) {
                 /* set sz */
@@ -348,19 +2005,19 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
 #ifdef WOLFSSL_KEY_GEN
         case WC_PK_TYPE_RSA_KEYGEN:
             /* init the rsa key */
-            ret = wc_InitRsaKey_ex(server->crypto->rsa, NULL, INVALID_DEVID);
+            ret = wc_InitRsaKey_ex(crypto->rsa, NULL, INVALID_DEVID);
             /* make the rsa key with the given params */
             if (ret == 0) {
-                ret = wc_MakeRsaKey(server->crypto->rsa,
+                ret = wc_MakeRsaKey(crypto->rsa,
                     packet->pkRsakgReq.size,
                     packet->pkRsakgReq.e,
-                    server->crypto->rng);
+                    crypto->rng);
             }
             /* cache the generated key, data will be blown away */
             if (ret == 0) {
-                ret = hsmCacheKeyRsa(server, server->crypto->rsa, &keyId);
+                ret = hsmCacheKeyRsa(server, comm, crypto->rsa, &keyId);
             }
-            wc_FreeRsaKey(server->crypto->rsa);
+            wc_FreeRsaKey(crypto->rsa);
             if (ret == 0) {
                 /* set the assigned id */
                 packet->pkRsakgRes.keyId =
@@ -381,23 +2038,18 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
                     /* in and out are after the fixed size fields */
                     in = (uint8_t*)(&packet->pkRsaReq + 1);
                     out = (uint8_t*)(&packet->pkRsaRes + 1);
-                    /* init rsa key */
-                    ret = wc_InitRsaKey_ex(server->crypto->rsa, NULL,
-                        INVALID_DEVID);
-                    /* load the key from the keystore */
-                    if (ret == 0) {
-                        ret = hsmLoadKeyRsa(server, server->crypto->rsa,
-                            packet->pkRsaReq.keyId);
-                    }
+                    /* get the key from the keystore */
+                    ret = loaded = hsmGetKeyRsa(server, comm, crypto->rsa,
+                        INVALID_DEVID, packet->pkRsaReq.keyId, &rsa);
                     /* do the rsa operation */
                     if (ret == 0) {
                         field = packet->pkRsaReq.outLen;
                         ret = wc_RsaFunction( in, packet->pkRsaReq.inLen,
                             out, (word32*)&field, packet->pkRsaReq.opType,
-                            server->crypto->rsa, server->crypto->rng);
+                            rsa, crypto->rng);
                     }
-                    /* free the key */
-                    wc_FreeRsaKey(server->crypto->rsa);
+                    /* release the key */
+                    hsmPutKeyRsa(server, rsa, loaded);
                     if (ret == 0) {
                         /*set outLen */
                         packet->pkRsaRes.outLen = field;
@@ -408,18 +2060,13 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
             }
             break;
         case WC_PK_TYPE_RSA_GET_SIZE:
-            /* init rsa key */
-            ret = wc_InitRsaKey_ex(server->crypto->rsa, NULL,
-                server->crypto->devId);
-            /* load the key from the keystore */
-            if (ret == 0) {
-                ret = hsmLoadKeyRsa(server, server->crypto->rsa,
-                    packet->pkRsaGetSizeReq.keyId);
-            }
+            /* get the key from the keystore */
+            ret = loaded = hsmGetKeyRsa(server, comm, crypto->rsa,
+                crypto->devId, packet->pkRsaGetSizeReq.keyId, &rsa);
             /* get the size */
             if (ret == 0)
-                ret = wc_RsaEncryptSize(server->crypto->rsa);
-            wc_FreeRsaKey(server->crypto->rsa);
+                ret = wc_RsaEncryptSize(rsa);
+            hsmPutKeyRsa(server, rsa, loaded);
             if (ret > 0) {
                 /*set keySize */
                 packet->pkRsaGetSizeRes.keySize = ret;
@@ -431,59 +2078,74 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
 #endif /* !NO_RSA */
 #ifdef HAVE_ECC
         case WC_PK_TYPE_EC_KEYGEN:
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+            /* hand out a key generated ahead of time when one matches */
+            if (_hsmEphemeralEccMatch(packet->pkEckgReq.sz,
+                    packet->pkEckgReq.curveId) &&
+                    hsmTakeEphemeralKey(server, comm, server->ephemeralEcc,
+                    WH_SERVER_EPHEMERAL_ECC_COUNT, &keyId) == 0) {
+                packet->pkEckgRes.keyId = keyId;
+                *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEckgRes);
+                break;
+            }
+#endif
             /* init ecc key */
-            ret = wc_ecc_init_ex(server->crypto->eccPrivate, NULL,
-                server->crypto->devId);
+            ret = wc_ecc_init_ex(crypto->eccPrivate, NULL,
+                crypto->devId);
             /* generate the key the key */
             if (ret == 0) {
-                ret = wc_ecc_make_key_ex(server->crypto->rng,
-                    packet->pkEckgReq.sz, server->crypto->eccPrivate,
+                ret = wc_ecc_make_key_ex(crypto->rng,
+                    packet->pkEckgReq.sz, crypto->eccPrivate,
                     packet->pkEckgReq.curveId);
             }
             /* cache the generated key */
             if (ret == 0)
-                ret = hsmCacheKeyEcc(server, server->crypto->eccPrivate,&keyId);
+                ret = hsmCacheKeyEcc(server, comm, crypto->eccPrivate,&keyId);
             /* set the assigned id */
-            wc_ecc_free(server->crypto->eccPrivate);
+            wc_ecc_free(crypto->eccPrivate);
             if (ret == 0) {
                 packet->pkEckgRes.keyId = keyId;
                 *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEckgRes);
             }
             break;
         case WC_PK_TYPE_ECDH:
-            /* out is after the fixed size fields */
+            /* out is after the fixed size fields, over the request */
             out = (uint8_t*)(&packet->pkEcdhRes + 1);
-            /* init ecc key */
-            ret = wc_ecc_init_ex(server->crypto->eccPrivate, NULL,
-                server->crypto->devId);
-            if (ret == 0)
-                ret = wc_ecc_init_ex(server->crypto->eccPrivate, NULL,
-                    server->crypto->devId);
-            /* load the private key */
-            if (ret == 0) {
-                ret = hsmLoadKeyEcc(server, server->crypto->eccPrivate,
-                    packet->pkEcdhReq.privateKeyId, packet->pkEcdhReq.curveId);
-            }
+            options = packet->pkEcdhReq.options;
+            cacheId = packet->pkEcdhReq.keyId;
+            cacheFlags = packet->pkEcdhReq.flags;
+            /* get the private key */
+            ret = loaded = hsmGetKeyEcc(server, comm, crypto->eccPrivate,
+                crypto->devId, packet->pkEcdhReq.privateKeyId,
+                packet->pkEcdhReq.curveId, &eccPrivate);
             /* set rng */
             if (ret == 0) {
-                ret = wc_ecc_set_rng(server->crypto->eccPrivate,
-                    server->crypto->rng);
+                ret = wc_ecc_set_rng(eccPrivate,
+                    crypto->rng);
             }
-            /* load the public key */
+            /* get the public key */
             if (ret == 0) {
-                ret = hsmLoadKeyEcc(server, server->crypto->eccPublic,
-                    packet->pkEcdhReq.publicKeyId, packet->pkEcdhReq.curveId);
+                ret = res = hsmGetKeyEcc(server, comm, crypto->eccPublic,
+                    crypto->devId, packet->pkEcdhReq.publicKeyId,
+                    packet->pkEcdhReq.curveId, &eccPublic);
+                /* make shared secret */
+                if (ret == 0) {
+                    field = eccPrivate->dp->size;
+                    ret = wc_ecc_shared_secret(eccPrivate,
+                        eccPublic, out, &field);
+                }
+                hsmPutKeyEcc(server, eccPublic, res);
             }
-            /* make shared secret */
-            if (ret == 0) {
-                field = server->crypto->eccPrivate->dp->size;
-                ret = wc_ecc_shared_secret(server->crypto->eccPrivate,
-                    server->crypto->eccPublic, out, &field);
+            hsmPutKeyEcc(server, eccPrivate, loaded);
+            /* keep the secret on the server instead */
+            if (ret == 0 && (options & WH_PACKET_PK_SECRET_CACHE) != 0) {
+                ret = hsmCacheSharedSecret(server, comm, cacheId, cacheFlags,
+                    out, field, &keyId);
+                field = 0;
             }
-            wc_ecc_free(server->crypto->eccPrivate);
-            wc_ecc_free(server->crypto->eccPublic);
             if (ret == 0) {
                 packet->pkEcdhRes.sz = field;
+                packet->pkEcdhRes.keyId = keyId;
                 *size = WOLFHSM_PACKET_STUB_SIZE +
                     sizeof(packet->pkEcdhRes) + field;
             }
@@ -492,21 +2154,17 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
             /* in and out are after the fixed size fields */
             in = (uint8_t*)(&packet->pkEccSignReq + 1);
             out = (uint8_t*)(&packet->pkEccSignRes + 1);
-            /* init pivate key */
-            ret = wc_ecc_init_ex(server->crypto->eccPrivate, NULL,
-                server->crypto->devId);
-            /* load the private key */
-            if (ret == 0) {
-                ret = hsmLoadKeyEcc(server, server->crypto->eccPrivate,
-                    packet->pkEccSignReq.keyId, packet->pkEccSignReq.curveId);
-            }
+            /* get the private key */
+            ret = loaded = hsmGetKeyEcc(server, comm, crypto->eccPrivate,
+                crypto->devId, packet->pkEccSignReq.keyId,
+                packet->pkEccSignReq.curveId, &eccPrivate);
             /* sign the input */
             if (ret == 0) {
                 field = WH_COMM_MTU - sizeof(packet->pkEccSignRes);
                 ret = wc_ecc_sign_hash(in, packet->pkEccSignReq.sz, out,
-                    &field, server->crypto->rng, server->crypto->eccPrivate);
+                    &field, crypto->rng, eccPrivate);
             }
-            wc_ecc_free(server->crypto->eccPrivate);
+            hsmPutKeyEcc(server, eccPrivate, loaded);
             if (ret == 0) {
                 packet->pkEccSignRes.sz = field;
                 *size = WOLFHSM_PACKET_STUB_SIZE +
@@ -518,22 +2176,17 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
             sig = (uint8_t*)(&packet->pkEccVerifyReq + 1);
             hash = (uint8_t*)(&packet->pkEccVerifyReq + 1) +
                 packet->pkEccVerifyReq.sigSz;
-            /* init public key */
-            ret = wc_ecc_init_ex(server->crypto->eccPublic, NULL,
-                server->crypto->devId);
-            /* load the public key */
-            if (ret == 0) {
-                ret = hsmLoadKeyEcc(server, server->crypto->eccPublic,
-                    packet->pkEccVerifyReq.keyId,
-                    packet->pkEccVerifyReq.curveId);
-            }
+            /* get the public key */
+            ret = loaded = hsmGetKeyEcc(server, comm, crypto->eccPublic,
+                crypto->devId, packet->pkEccVerifyReq.keyId,
+                packet->pkEccVerifyReq.curveId, &eccPublic);
             /* verify the signature */
             if (ret == 0) {
                 ret = wc_ecc_verify_hash(sig, packet->pkEccVerifyReq.sigSz,
                     hash, packet->pkEccVerifyReq.hashSz, &res,
-                    server->crypto->eccPublic);
+                    eccPublic);
             }
-            wc_ecc_free(server->crypto->eccPublic);
+            hsmPutKeyEcc(server, eccPublic, loaded);
             if (ret == 0) {
                 packet->pkEccVerifyRes.res = res;
                 *size = WOLFHSM_PACKET_STUB_SIZE +
@@ -541,19 +2194,15 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
             }
             break;
         case WC_PK_TYPE_EC_CHECK_PRIV_KEY:
-            /* init pivate key */
-            ret = wc_ecc_init_ex(server->crypto->eccPrivate, NULL,
-                server->crypto->devId);
-            /* load the private key */
-            if (ret == 0) {
-                ret = hsmLoadKeyEcc(server, server->crypto->eccPrivate,
-                    packet->pkEccCheckReq.keyId, packet->pkEccCheckReq.curveId);
-            }
+            /* get the private key */
+            ret = loaded = hsmGetKeyEcc(server, comm, crypto->eccPrivate,
+                crypto->devId, packet->pkEccCheckReq.keyId,
+                packet->pkEccCheckReq.curveId, &eccPrivate);
             /* check the key */
             if (ret == 0) {
-                ret = wc_ecc_check_key(server->crypto->eccPrivate);
+                ret = wc_ecc_check_key(eccPrivate);
             }
-            wc_ecc_free(server->crypto->eccPrivate);
+            hsmPutKeyEcc(server, eccPrivate, loaded);
             if (ret == 0) {
                 packet->pkEccCheckRes.ok = 1;
                 *size = WOLFHSM_PACKET_STUB_SIZE +
@@ -563,22 +2212,36 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
 #endif /* HAVE_ECC */
 #ifdef HAVE_CURVE25519
         case WC_PK_TYPE_CURVE25519_KEYGEN:
+#if WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0
+            /* hand out a key generated ahead of time */
+            if (packet->pkCurve25519kgReq.sz == CURVE25519_KEYSIZE &&
+                    hsmTakeEphemeralKey(server, comm,
+                    server->ephemeralCurve25519,
+                    WH_SERVER_EPHEMERAL_CURVE25519_COUNT, &keyId) == 0) {
+                /* strip client_id */
+                packet->pkCurve25519kgRes.keyId =
+                    (keyId & ~WOLFHSM_KEYUSER_MASK);
+                *size = WOLFHSM_PACKET_STUB_SIZE +
+                    sizeof(packet->pkCurve25519kgRes);
+                break;
+            }
+#endif
             /* init private key */
-            ret = wc_curve25519_init_ex(server->crypto->curve25519Private, NULL,
-                server->crypto->devId);
+            ret = wc_curve25519_init_ex(crypto->curve25519Private, NULL,
+                crypto->devId);
             /* make the key */
             if (ret == 0) {
-                ret = wc_curve25519_make_key(server->crypto->rng,
+                ret = wc_curve25519_make_key(crypto->rng,
                     packet->pkCurve25519kgReq.sz,
-                    server->crypto->curve25519Private);
+                    crypto->curve25519Private);
             }
             /* cache the generated key */
             if (ret == 0) {
-                ret = hsmCacheKeyCurve25519(server,
-                    server->crypto->curve25519Private, &keyId);
+                ret = hsmCacheKeyCurve25519(server, comm,
+                    crypto->curve25519Private, &keyId);
             }
             /* set the assigned id */
-            wc_curve25519_free(server->crypto->curve25519Private);
+            wc_curve25519_free(crypto->curve25519Private);
             if (ret == 0) {
                 /* strip client_id */
                 packet->pkCurve25519kgRes.keyId =
@@ -590,48 +2253,137 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
                 ret = BAD_FUNC_ARG;
             break;
         case WC_PK_TYPE_CURVE25519:
-            /* out is after the fixed size fields */
+            /* out is after the fixed size fields, over the request */
             out = (uint8_t*)(&packet->pkCurve25519Res + 1);
-            /* init ecc key */
-            ret = wc_curve25519_init_ex(server->crypto->curve25519Private, NULL,
-                server->crypto->devId);
+            options = packet->pkCurve25519Req.options;
+            cacheId = packet->pkCurve25519Req.keyId;
+            cacheFlags = packet->pkCurve25519Req.flags;
+            /* get the private key */
+            ret = loaded = hsmGetKeyCurve25519(server, comm,
+                crypto->curve25519Private, crypto->devId,
+                MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO,
+                comm->client_id,
+                packet->pkCurve25519Req.privateKeyId), &curve25519Private);
+            /* get the public key */
+            if (ret == 0) {
+                ret = res = hsmGetKeyCurve25519(server, comm,
+                    crypto->curve25519Public, crypto->devId,
+                    MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO,
+                    comm->client_id,
+                    packet->pkCurve25519Req.publicKeyId), &curve25519Public);
+                /* make shared secret */
+                if (ret == 0) {
+                    field = CURVE25519_KEYSIZE;
+                    ret = wc_curve25519_shared_secret_ex(
+                        curve25519Private,
+                        curve25519Public, out, (word32*)&field,
+                        packet->pkCurve25519Req.endian);
+                }
+                hsmPutKeyCurve25519(server, curve25519Public, res);
+            }
+            hsmPutKeyCurve25519(server, curve25519Private, loaded);
+            /* keep the secret on the server instead */
+            if (ret == 0 && (options & WH_PACKET_PK_SECRET_CACHE) != 0) {
+                ret = hsmCacheSharedSecret(server, comm, cacheId, cacheFlags,
+                    out, field, &keyId);
+                field = 0;
+            }
+            if (ret == 0) {
+                *size = WOLFHSM_PACKET_STUB_SIZE +
+                    sizeof(packet->pkCurve25519Res) + field;
+                packet->pkCurve25519Res.sz = field;
+                packet->pkCurve25519Res.keyId = keyId;
+            }
+            break;
+#endif /* HAVE_CURVE25519 */
+#ifdef HAVE_ED25519
+        case WC_PK_TYPE_ED25519_KEYGEN:
+            /* init key */
+            ret = wc_ed25519_init_ex(crypto->ed25519, NULL, crypto->devId);
+            /* make the key */
             if (ret == 0) {
-                ret = wc_curve25519_init_ex(server->crypto->curve25519Public,
-                    NULL, server->crypto->devId);
+                ret = wc_ed25519_make_key(crypto->rng,
+                    packet->pkEd25519kgReq.sz, crypto->ed25519);
             }
-            /* load the private key */
+            /* cache the generated key */
             if (ret == 0) {
-                ret = hsmLoadKeyCurve25519(server,
-                    server->crypto->curve25519Private,
-                    MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO,
-                    server->comm->client_id,
-                    packet->pkCurve25519Req.privateKeyId));
+                ret = hsmCacheKeyEd25519(server, comm, crypto->ed25519,
+                    &keyId);
             }
-            /* load the public key */
+            wc_ed25519_free(crypto->ed25519);
             if (ret == 0) {
-                ret = hsmLoadKeyCurve25519(server,
-                    server->crypto->curve25519Public,
-                    MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO,
-                    server->comm->client_id,
-                    packet->pkCurve25519Req.publicKeyId));
+                /* strip client_id */
+                packet->pkEd25519kgRes.keyId =
+                    (keyId & ~WOLFHSM_KEYUSER_MASK);
+                *size = WOLFHSM_PACKET_STUB_SIZE +
+                    sizeof(packet->pkEd25519kgRes);
+            }
+            break;
+        case WC_PK_TYPE_ED25519_SIGN:
+            /* in and context are after the fixed size fields */
+            in = (uint8_t*)(&packet->pkEd25519SignReq + 1);
+            context = in + packet->pkEd25519SignReq.sz;
+            out = (uint8_t*)(&packet->pkEd25519SignRes + 1);
+            if (*size < WOLFHSM_PACKET_STUB_SIZE +
+                    sizeof(packet->pkEd25519SignReq) +
+                    packet->pkEd25519SignReq.sz +
+                    packet->pkEd25519SignReq.contextSz) {
+                ret = BAD_FUNC_ARG;
+                break;
             }
-            /* make shared secret */
+            /* get the private key */
+            ret = loaded = hsmGetKeyEd25519(server, comm, crypto->ed25519,
+                crypto->devId, packet->pkEd25519SignReq.keyId, &ed25519);
+            /* sign the input, out overlaps it so sign to the side */
             if (ret == 0) {
-                field = CURVE25519_KEYSIZE;
-                ret = wc_curve25519_shared_secret_ex(
-                    server->crypto->curve25519Private,
-                    server->crypto->curve25519Public, out, (word32*)&field,
-                    packet->pkCurve25519Req.endian);
+                field = sizeof(ed25519Sig);
+                ret = wc_ed25519_sign_msg_ex(in, packet->pkEd25519SignReq.sz,
+                    ed25519Sig, (word32*)&field, ed25519,
+                    packet->pkEd25519SignReq.signType,
+                    (packet->pkEd25519SignReq.contextSz > 0) ? context : NULL,
+                    packet->pkEd25519SignReq.contextSz);
             }
-            wc_curve25519_free(server->crypto->curve25519Private);
-            wc_curve25519_free(server->crypto->curve25519Public);
+            hsmPutKeyEd25519(server, ed25519, loaded);
             if (ret == 0) {
+                XMEMCPY(out, ed25519Sig, field);
+                packet->pkEd25519SignRes.sz = field;
                 *size = WOLFHSM_PACKET_STUB_SIZE +
-                    sizeof(packet->pkCurve25519Res) + field;
-                packet->pkCurve25519Res.sz = field;
+                    sizeof(packet->pkEd25519SignRes) + field;
             }
             break;
-#endif /* HAVE_CURVE25519 */
+        case WC_PK_TYPE_ED25519_VERIFY:
+            /* sig, msg and context are after the fixed size fields */
+            sig = (uint8_t*)(&packet->pkEd25519VerifyReq + 1);
+            in = sig + packet->pkEd25519VerifyReq.sigSz;
+            context = in + packet->pkEd25519VerifyReq.sz;
+            if (*size < WOLFHSM_PACKET_STUB_SIZE +
+                    sizeof(packet->pkEd25519VerifyReq) +
+                    packet->pkEd25519VerifyReq.sigSz +
+                    packet->pkEd25519VerifyReq.sz +
+                    packet->pkEd25519VerifyReq.contextSz) {
+                ret = BAD_FUNC_ARG;
+                break;
+            }
+            /* get the public key */
+            ret = loaded = hsmGetKeyEd25519(server, comm, crypto->ed25519,
+                crypto->devId, packet->pkEd25519VerifyReq.keyId, &ed25519);
+            /* verify the signature */
+            if (ret == 0) {
+                ret = wc_ed25519_verify_msg_ex(sig,
+                    packet->pkEd25519VerifyReq.sigSz, in,
+                    packet->pkEd25519VerifyReq.sz, &res, ed25519,
+                    packet->pkEd25519VerifyReq.signType,
+                    (packet->pkEd25519VerifyReq.contextSz > 0) ?
+                    context : NULL, packet->pkEd25519VerifyReq.contextSz);
+            }
+            hsmPutKeyEd25519(server, ed25519, loaded);
+            if (ret == 0) {
+                packet->pkEd25519VerifyRes.res = res;
+                *size = WOLFHSM_PACKET_STUB_SIZE +
+                    sizeof(packet->pkEd25519VerifyRes);
+            }
+            break;
+#endif /* HAVE_ED25519 */
         default:
             ret = NOT_COMPILED_IN;
             break;
@@ -641,14 +2393,68 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
     case WC_ALGO_TYPE_RNG:
         /* out is after the fixed size fields */
         out = (uint8_t*)(&packet->rngRes + 1);
-        /* generate the bytes */
-        ret = wc_RNG_GenerateBlock(server->crypto->rng, out, packet->rngReq.sz);
+        field = 0;
+#if WH_SERVER_RNG_POOL_SIZE > 0
+        /* take what we can from the pool, from its end */
+        wh_Server_Lock(server);
+        field = server->rngPoolCount;
+        if (field > packet->rngReq.sz)
+            field = packet->rngReq.sz;
+        server->rngPoolCount -= field;
+        XMEMCPY(out, server->rngPool + server->rngPoolCount, field);
+        XMEMSET(server->rngPool + server->rngPoolCount, 0, field);
+        wh_Server_Unlock(server);
+#endif
+        /* generate the rest */
+        if (field < packet->rngReq.sz) {
+            ret = wc_RNG_GenerateBlock(crypto->rng, out + field,
+                packet->rngReq.sz - field);
+        }
         if (ret == 0) {
             *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->rngRes) +
                 packet->rngRes.sz;
         }
         break;
 #endif /* !WC_NO_RNG */
+#if defined(WH_SERVER_STREAMS) && !defined(NO_AES)
+    case WH_CRYPTO_CIPHER_STREAM_INIT:
+    case WH_CRYPTO_CIPHER_STREAM_UPDATE:
+    case WH_CRYPTO_CIPHER_STREAM_FINAL:
+        ret = _wh_Server_HandleCipherStream(server, crypto, comm, action,
+            packet, size);
+        break;
+#endif
+#ifdef WH_SERVER_STREAMS
+    case WC_ALGO_TYPE_HASH:
+    case WC_ALGO_TYPE_HMAC:
+        ret = _wh_Server_HandleHash(server, crypto, comm, action, packet,
+            size);
+        break;
+    case WH_CRYPTO_HASH_STREAM_COPY:
+        ret = _wh_Server_HandleHashCopy(server, comm, packet, size);
+        break;
+#endif
+#if defined(WH_SERVER_STREAMS) && defined(WOLFSSL_CMAC)
+    case WC_ALGO_TYPE_CMAC:
+        ret = _wh_Server_HandleCmac(server, crypto, comm, packet, size);
+        break;
+#endif
+#if !defined(NO_AES) && (defined(HAVE_AES_CBC) || defined(HAVE_AESGCM))
+    case WH_CRYPTO_CIPHER_DMA:
+        ret = _wh_Server_HandleCipherDma(server, crypto, comm, packet, size);
+        break;
+#endif
+#ifdef HAVE_ECC
+    case WH_CRYPTO_ECDSA_VERIFY_BATCH:
+        ret = _wh_Server_HandleEccVerifyBatch(server, crypto, comm, packet,
+            size);
+        break;
+#endif
+#ifndef NO_SHA256
+    case WH_CRYPTO_HASH_DMA:
+        ret = _wh_Server_HandleHashDma(server, crypto, packet, size);
+        break;
+#endif
     case WC_ALGO_TYPE_NONE:
     default:
         ret = NOT_COMPILED_IN;
@@ -660,4 +2466,50 @@ int wh_Server_HandleCryptoRequest(whServerContext* server,
     return 0;
 }
 
+int wh_Server_HandleCryptoRequest(whServerContext* server,
+    uint16_t action, uint8_t* data, uint16_t* size)
+{
+    if (server == NULL)
+        return BAD_FUNC_ARG;
+    /* server->comm may be borrowed by a worker, comm_current is not */
+    return wh_Server_HandleCryptoRequestEx(server, server->crypto,
+        server->comms[server->comm_current].comm, action, data, size);
+}
+
+#if WH_SERVER_WORKER_COUNT > 0
+int wh_Server_WorkerRun(whServerContext* server, uint16_t index)
+{
+    whServerWorker* w;
+    whCommServer* comm = NULL;
+    const whCommField* fields = NULL;
+    uint16_t size;
+    int ret;
+
+    if ((server == NULL) || (index >= WH_SERVER_WORKER_COUNT))
+        return WH_ERROR_BADARGS;
+    w = &server->worker[index];
+
+    wh_Server_Lock(server);
+    if (w->state == WH_SERVER_WORKER_BUSY)
+        comm = server->comms[w->comm_index].comm;
+    wh_Server_Unlock(server);
+    if (comm == NULL)
+        return WH_ERROR_NOTREADY;
+
+    size = w->size;
+    fields = wh_Packet_TranslateRequest(w->magic, w->kind,
+        (uint8_t*)w->packet, size);
+    ret = wh_Server_HandleCryptoRequestEx(server, w->crypto, comm,
+        WH_MESSAGE_ACTION(w->kind), (uint8_t*)w->packet, &size);
+    wh_Packet_TranslateResponse(w->magic, fields, (uint8_t*)w->packet, size);
+
+    wh_Server_Lock(server);
+    w->size = size;
+    w->rc = ret;
+    w->state = WH_SERVER_WORKER_DONE;
+    wh_Server_Unlock(server);
+    return WH_ERROR_OK;
+}
+#endif /* WH_SERVER_WORKER_COUNT > 0 */
+
 #endif  /* WOLFHSM_NO_CRYPTO */
@@ -16,6 +16,9 @@
  * You should have received a copy of the GNU General Public License
  * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <stddef.h>
+#include <stdint.h>
+
 #include "wolfhsm/wh_server.h"
 #include "wolfhsm/wh_common.h"
 #include "wolfhsm/wh_error.h"
@@ -37,6 +40,72 @@ int wh_Server_RegisterCustomCb(whServerContext* server, uint16_t action,
 }
 
 
+int wh_Server_RegisterCustomBulkCb(whServerContext* server, uint16_t action,
+                                   whServerCustomBulkCb handler)
+{
+    if (NULL == server || NULL == handler ||
+        action >= WH_CUSTOM_CB_NUM_CALLBACKS) {
+        return WH_ERROR_BADARGS;
+    }
+
+    server->customBulkHandlerTable[action] = handler;
+
+    return WH_ERROR_OK;
+}
+
+
+/* Invokes a bulk handler on the payload in place. The response may share the
+ * request buffer, so the request header is copied out before anything is
+ * written */
+static int _handleBulkRequest(whServerContext* server, uint16_t magic,
+                              uint16_t action, uint16_t req_size,
+                              const void* req_packet, uint16_t* out_resp_size,
+                              void* resp_packet)
+{
+    int                          rc       = 0;
+    whMessageCustomCb_BulkHeader hdr      = {0};
+    const uint8_t*               req_data = NULL;
+    uint8_t*                     resp_data = NULL;
+    uint16_t                     resp_len  = 0;
+
+    if ((rc = wh_MessageCustomCb_TranslateBulkHeader(magic, req_packet,
+                                                     &hdr)) != WH_ERROR_OK) {
+        return rc;
+    }
+
+    req_data  = (const uint8_t*)req_packet + sizeof(hdr);
+    resp_data = (uint8_t*)resp_packet + sizeof(hdr);
+    resp_len  = server->comm->max_data_len - sizeof(hdr);
+
+    hdr.rc  = 0;
+    hdr.err = WH_ERROR_OK;
+    if (server->customBulkHandlerTable[action] != NULL) {
+        hdr.rc = server->customBulkHandlerTable[action](
+            server, hdr.id, req_data, req_size - sizeof(hdr), resp_data,
+            &resp_len);
+        if (resp_len > server->comm->max_data_len - sizeof(hdr)) {
+            /* Handler claims to have written past the buffer */
+            hdr.err  = WH_ERROR_ABORTED;
+            resp_len = 0;
+        }
+    }
+    else {
+        hdr.err  = WH_ERROR_NOHANDLER;
+        resp_len = 0;
+    }
+
+    if ((rc = wh_MessageCustomCb_TranslateBulkHeader(magic, &hdr,
+                                                     resp_packet)) !=
+        WH_ERROR_OK) {
+        return rc;
+    }
+
+    *out_resp_size = sizeof(hdr) + resp_len;
+
+    return WH_ERROR_OK;
+}
+
+
 int wh_Server_HandleCustomCbRequest(whServerContext* server, uint16_t magic,
                                     uint16_t action, uint16_t seq,
                                     uint16_t req_size, const void* req_packet,
@@ -57,6 +126,15 @@ int wh_Server_HandleCustomCbRequest(whServerContext* server, uint16_t magic,
         return WH_ERROR_BADARGS;
     }
 
+    /* Bulk requests carry their header and a variable sized payload */
+    if ((req_size >= sizeof(whMessageCustomCb_BulkHeader)) &&
+        (wh_Translate32(magic,
+                        ((const whMessageCustomCb_BulkHeader*)req_packet)
+                            ->type) == WH_MESSAGE_CUSTOM_CB_TYPE_BULK)) {
+        return _handleBulkRequest(server, magic, action, req_size, req_packet,
+                                  out_resp_size, resp_packet);
+    }
+
     if (req_size != sizeof(whMessageCustomCb_Request)) {
         /* Request is malformed */
         return WH_ERROR_ABORTED;
@@ -68,7 +146,12 @@ int wh_Server_HandleCustomCbRequest(whServerContext* server, uint16_t magic,
         return rc;
     }
 
-    if (server->customHandlerTable[action] != NULL) {
+    if ((req.type == WH_MESSAGE_CUSTOM_CB_TYPE_QUERY) &&
+        (server->customBulkHandlerTable[action] != NULL)) {
+        /* A bulk handler alone is enough to answer a query */
+        resp.err = WH_ERROR_OK;
+    }
+    else if (server->customHandlerTable[action] != NULL) {
         /* If this isn't a query to check if the callback exists, invoke the
          * registered callback, storing the return value in the reponse  */
         if (req.type != WH_MESSAGE_CUSTOM_CB_TYPE_QUERY) {
@@ -27,10 +27,6 @@
 #include "wolfhsm/wh_error.h"
 #include "wolfhsm/wh_server.h"
 
-/* TODO: if the Address allowlist ever gets large, we should consider a more
- * efficient representation (requiring sorted array and binary search, or
- * building a binary tree, etc.) */
-
 static int _checkOperValid(whServerDmaOper oper)
 {
     if (oper < WH_DMA_OPER_CLIENT_READ_PRE ||
@@ -41,30 +37,88 @@ static int _checkOperValid(whServerDmaOper oper)
     return WH_ERROR_OK;
 }
 
-static int _checkAddrAgainstAllowList(const whServerDmaAddrList allowList, void* addr,
-                                      size_t size)
+/* Sort the non-empty entries of allowList by address and merge the ones that
+ * overlap or touch */
+static void _buildAddrIndex(whServerDmaAddrIndex*     index,
+                            const whServerDmaAddrList allowList)
+{
+    uintptr_t start = 0;
+    uintptr_t end   = 0;
+    int       i     = 0;
+    int       j     = 0;
+
+    index->count = 0;
+
+    for (i = 0; i < WH_DMA_ADDR_ALLOWLIST_COUNT; i++) {
+        if (0 == allowList[i].size) {
+            continue;
+        }
+        start = (uintptr_t)allowList[i].addr;
+        end   = start + allowList[i].size;
+        if (end < start) {
+            /* Clamp ranges that wrap */
+            end = UINTPTR_MAX;
+        }
+
+        /* Insertion sort by start address */
+        for (j = index->count; (j > 0) && (index->start[j - 1] > start); j--) {
+            index->start[j] = index->start[j - 1];
+            index->end[j]   = index->end[j - 1];
+        }
+        index->start[j] = start;
+        index->end[j]   = end;
+        index->count++;
+    }
+
+    /* Merge in place */
+    for (i = 0, j = 1; j < index->count; j++) {
+        if (index->start[j] <= index->end[i]) {
+            if (index->end[j] > index->end[i]) {
+                index->end[i] = index->end[j];
+            }
+        }
+        else {
+            i++;
+            index->start[i] = index->start[j];
+            index->end[i]   = index->end[j];
+        }
+    }
+    if (index->count > 0) {
+        index->count = i + 1;
+    }
+}
+
+/* Read only, so concurrent requests may check the same index */
+static int _checkAddrAgainstIndex(const whServerDmaAddrIndex* index,
+                                  void* addr, size_t size)
 {
     uintptr_t startAddr = (uintptr_t)addr;
     uintptr_t endAddr   = startAddr + size;
-    int i = 0;
+    int       lo        = 0;
+    int       hi        = index->count;
+    int       mid       = 0;
 
     if (0 == size) {
         return WH_ERROR_BADARGS;
     }
+    if (endAddr < startAddr) {
+        return WH_ERROR_ACCESS;
+    }
 
-    /* Check if the address range is fully within a allowlist entry */
-    for (i = 0; i < WH_DMA_ADDR_ALLOWLIST_COUNT; i++) {
-        uintptr_t allowListStartAddr = (uintptr_t)allowList[i].addr;
-        uintptr_t allowListEndAddr   = allowListStartAddr + allowList[i].size;
-
-        if (0 == allowList[i].size) {
-            continue;
+    /* Find the last range starting at or below the address. Ranges are
+     * disjoint, so only it can hold the whole operation */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index->start[mid] <= startAddr) {
+            lo = mid + 1;
         }
-
-        if (startAddr >= allowListStartAddr && endAddr <= allowListEndAddr) {
-            return WH_ERROR_OK;
+        else {
+            hi = mid;
         }
     }
+    if ((lo > 0) && (endAddr <= index->end[lo - 1])) {
+        return WH_ERROR_OK;
+    }
 
     return WH_ERROR_ACCESS;
 }
@@ -92,10 +146,10 @@ static int _checkMemOperAgainstAllowList(const whServerContext* server,
      * memory operations for some reason?
      */
     if (oper == WH_DMA_OPER_CLIENT_READ_PRE) {
-        rc = _checkAddrAgainstAllowList(server->dma.dmaAddrAllowList->readList, addr, size);
+        rc = _checkAddrAgainstIndex(&server->dma.readIndex, addr, size);
     }
     else if (oper == WH_DMA_OPER_CLIENT_WRITE_PRE) {
-        rc = _checkAddrAgainstAllowList(server->dma.dmaAddrAllowList->writeList, addr, size);
+        rc = _checkAddrAgainstIndex(&server->dma.writeIndex, addr, size);
     }
 
     return rc;
@@ -146,6 +200,8 @@ int wh_Server_DmaRegisterAllowList(whServerContext*                server,
     }
 
     server->dma.dmaAddrAllowList = allowlist;
+    _buildAddrIndex(&server->dma.readIndex, allowlist->readList);
+    _buildAddrIndex(&server->dma.writeIndex, allowlist->writeList);
 
     return WH_ERROR_OK;
 }
@@ -207,6 +263,30 @@ int wh_Server_DmaProcessClientAddress64(whServerContext* server,
     return _checkMemOperAgainstAllowList(server, oper, *xformedCliAddr, len);
 }
 
+int wh_Server_DmaProcessClientAddress(whServerContext* server,
+                                      uint64_t clientAddr,
+                                      void** xformedCliAddr, uint64_t len,
+                                      whServerDmaOper  oper,
+                                      whServerDmaFlags flags)
+{
+    if (NULL == server) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* A 32-bit platform may only register the 32-bit callback */
+    if ((NULL == server->dma.cb64) && (NULL != server->dma.cb32)) {
+        if ((clientAddr > UINT32_MAX) || (len > UINT32_MAX)) {
+            return WH_ERROR_BADARGS;
+        }
+        return wh_Server_DmaProcessClientAddress32(
+            server, (uint32_t)clientAddr, xformedCliAddr, (uint32_t)len, oper,
+            flags);
+    }
+    return wh_Server_DmaProcessClientAddress64(server, clientAddr,
+                                               xformedCliAddr, len, oper,
+                                               flags);
+}
+
 
 int whServerDma_CopyFromClient32(struct whServerContext_t* server,
                                  void* serverPtr, uint32_t clientAddr,
@@ -369,3 +449,151 @@ int whServerDma_CopyToClient64(struct whServerContext_t* server,
 
     return rc;
 }
+
+int wh_Server_DmaProcessClientSegment(struct whServerContext_t* server,
+                                      const whDmaSegment* seg, int addr64,
+                                      void** xformedCliAddr,
+                                      whServerDmaOper oper,
+                                      whServerDmaFlags flags)
+{
+    if (NULL == seg) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if (addr64) {
+        return wh_Server_DmaProcessClientAddress64(
+            server, seg->addr, xformedCliAddr, seg->len, oper, flags);
+    }
+
+    if (seg->addr > UINT32_MAX) {
+        return WH_ERROR_BADARGS;
+    }
+    return wh_Server_DmaProcessClientAddress32(server, (uint32_t)seg->addr,
+                                               xformedCliAddr, seg->len, oper,
+                                               flags);
+}
+
+/* Sum the segment lengths, checking the list against len */
+static int _checkSegments(const whDmaSegment* segs, uint16_t count, size_t len)
+{
+    size_t   total = 0;
+    uint16_t i;
+
+    if ((NULL == segs) || (0 == count) || (count > WH_DMA_MAX_SEGMENTS)) {
+        return WH_ERROR_BADARGS;
+    }
+    for (i = 0; i < count; i++) {
+        total += segs[i].len;
+    }
+    return (total == len) ? WH_ERROR_OK : WH_ERROR_BADARGS;
+}
+
+int whServerDma_CopyFromClientSg(struct whServerContext_t* server,
+                                 void* serverPtr, size_t len,
+                                 const whDmaSegment* segs, uint16_t count,
+                                 int addr64, whServerDmaFlags flags)
+{
+    int      rc  = WH_ERROR_OK;
+    uint8_t* dst = (uint8_t*)serverPtr;
+    uint16_t i;
+
+    void* transformedAddr = NULL;
+
+    if (NULL == server || NULL == serverPtr || 0 == len) {
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = _checkSegments(segs, count, len);
+    if (rc != WH_ERROR_OK) {
+        return rc;
+    }
+
+    /* Check the whole server buffer against the allow list once */
+    rc = _checkMemOperAgainstAllowList(server, WH_DMA_OPER_CLIENT_READ_PRE,
+                                       serverPtr, len);
+    if (rc != WH_ERROR_OK) {
+        return rc;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (0 == segs[i].len) {
+            continue;
+        }
+
+        rc = wh_Server_DmaProcessClientSegment(server, &segs[i], addr64,
+                                               &transformedAddr,
+                                               WH_DMA_OPER_CLIENT_READ_PRE,
+                                               flags);
+        if (rc != WH_ERROR_OK) {
+            return rc;
+        }
+
+        memcpy(dst, transformedAddr, segs[i].len);
+        dst += segs[i].len;
+
+        rc = wh_Server_DmaProcessClientSegment(server, &segs[i], addr64,
+                                               &transformedAddr,
+                                               WH_DMA_OPER_CLIENT_READ_POST,
+                                               flags);
+        if (rc != WH_ERROR_OK) {
+            return rc;
+        }
+    }
+
+    return rc;
+}
+
+int whServerDma_CopyToClientSg(struct whServerContext_t* server,
+                               const whDmaSegment* segs, uint16_t count,
+                               int addr64, void* serverPtr, size_t len,
+                               whServerDmaFlags flags)
+{
+    int      rc  = WH_ERROR_OK;
+    uint8_t* src = (uint8_t*)serverPtr;
+    uint16_t i;
+
+    void* transformedAddr = NULL;
+
+    if (NULL == server || NULL == serverPtr || 0 == len) {
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = _checkSegments(segs, count, len);
+    if (rc != WH_ERROR_OK) {
+        return rc;
+    }
+
+    /* Check the whole server buffer against the allow list once */
+    rc = _checkMemOperAgainstAllowList(server, WH_DMA_OPER_CLIENT_WRITE_PRE,
+                                       serverPtr, len);
+    if (rc != WH_ERROR_OK) {
+        return rc;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (0 == segs[i].len) {
+            continue;
+        }
+
+        rc = wh_Server_DmaProcessClientSegment(server, &segs[i], addr64,
+                                               &transformedAddr,
+                                               WH_DMA_OPER_CLIENT_WRITE_PRE,
+                                               flags);
+        if (rc != WH_ERROR_OK) {
+            return rc;
+        }
+
+        memcpy(transformedAddr, src, segs[i].len);
+        src += segs[i].len;
+
+        rc = wh_Server_DmaProcessClientSegment(server, &segs[i], addr64,
+                                               &transformedAddr,
+                                               WH_DMA_OPER_CLIENT_WRITE_POST,
+                                               flags);
+        if (rc != WH_ERROR_OK) {
+            return rc;
+        }
+    }
+
+    return rc;
+}
@@ -28,69 +28,338 @@
 
 #include "wolfhsm/wh_server.h"
 #include "wolfhsm/wh_server_keystore.h"
+#include "wolfhsm/wh_server_crypto.h"
 #include "wolfhsm/wh_message.h"
 #include "wolfhsm/wh_packet.h"
 #include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_trace.h"
 #ifdef WOLFHSM_SHE_EXTENSION
 #include "wolfhsm/wh_server_she.h"
 #endif
 
-int hsmGetUniqueId(whServerContext* server, whNvmId* outId)
+/* Key cache id index, using linear probing so entries can be removed without
+ * tombstones. Buckets hold 1 + the slot, 0 marks an empty bucket */
+static int _hsmCacheHash(whNvmId id)
+{
+    /* multiplicative hash, spreads the client_id and type bits */
+    return (int)((((uint32_t)id * 40503u) >> 8) % WOLFHSM_KEYCACHE_INDEX_SIZE);
+}
+
+/* return the bucket holding id or the empty bucket ending its probe */
+static int _hsmCacheIndexProbe(whServerContext* server, whNvmId id)
+{
+    int bucket = _hsmCacheHash(id);
+    uint16_t entry;
+    while ((entry = server->cacheIndex[bucket]) != 0) {
+        if (server->cache[entry - 1].meta->id == id)
+            break;
+        bucket = (bucket + 1) % WOLFHSM_KEYCACHE_INDEX_SIZE;
+    }
+    return bucket;
+}
+
+static void _hsmCacheIndexRemove(whServerContext* server, whNvmId id)
+{
+    int bucket = _hsmCacheIndexProbe(server, id);
+    int next = bucket;
+    int home;
+    uint16_t entry;
+    if (server->cacheIndex[bucket] == 0)
+        return;
+    server->cacheIndex[bucket] = 0;
+    /* shift back later entries of the cluster that can no longer be reached
+     * past the new hole */
+    while (1) {
+        next = (next + 1) % WOLFHSM_KEYCACHE_INDEX_SIZE;
+        entry = server->cacheIndex[next];
+        if (entry == 0)
+            break;
+        home = _hsmCacheHash(server->cache[entry - 1].meta->id);
+        if ((next > bucket && (home <= bucket || home > next)) ||
+            (next < bucket && (home <= bucket && home > next))) {
+            server->cacheIndex[bucket] = entry;
+            server->cacheIndex[next] = 0;
+            bucket = next;
+        }
+    }
+}
+
+/* Key id maps. Bits are set for every id known to be taken, so a clear bit
+ * is only a candidate that is checked against the cache and NVM before use */
+#define KEYID_MAP_TEST(_map, _id) \
+    (((_map)->bits[(_id) / 32] >> ((_id) % 32)) & 1)
+#define KEYID_MAP_SET(_map, _id) \
+    ((_map)->bits[(_id) / 32] |= (uint32_t)1 << ((_id) % 32))
+#define KEYID_MAP_CLEAR(_map, _id) \
+    ((_map)->bits[(_id) / 32] &= ~((uint32_t)1 << ((_id) % 32)))
+
+static whServerKeyIdMap* _hsmFindKeyIdMap(whServerContext* server, whNvmId id)
 {
     int i;
+    for (i = 0; i < WH_SERVER_KEYID_MAP_COUNT; i++) {
+        if (server->keyIdMap[i].used &&
+            server->keyIdMap[i].prefix == (id >> 8))
+            return &server->keyIdMap[i];
+    }
+    return NULL;
+}
+
+/* rebuild the map of the prefix of id from the cache and NVM directory */
+static void _hsmBuildKeyIdMap(whServerContext* server, whServerKeyIdMap* map,
+    whNvmId id)
+{
+    int i;
+    int ret;
+    whNvmId count = 0;
+    whNvmId nvmId = 0;
+    XMEMSET((uint8_t*)map, 0, sizeof(*map));
+    map->prefix = id >> 8;
+    map->used = 1;
+    /* WOLFHSM_KEYID_ERASED is never handed out */
+    KEYID_MAP_SET(map, 0);
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        if ((server->cache[i].meta->id >> 8) == map->prefix)
+            KEYID_MAP_SET(map, server->cache[i].meta->id & WOLFHSM_KEYID_MASK);
+    }
+    /* bounded in case the directory lists an id twice */
+    ret = wh_Nvm_List(server->nvm, WOLFHSM_NVM_ACCESS_ANY,
+        WOLFHSM_NVM_FLAGS_ANY, 0, &count, &nvmId);
+    for (i = 0; ret == 0 && count > 0 && i < WOLFHSM_NUM_NVMOBJECTS; i++) {
+        if ((nvmId >> 8) == map->prefix)
+            KEYID_MAP_SET(map, nvmId & WOLFHSM_KEYID_MASK);
+        ret = wh_Nvm_List(server->nvm, WOLFHSM_NVM_ACCESS_ANY,
+            WOLFHSM_NVM_FLAGS_ANY, nvmId, &count, &nvmId);
+    }
+}
+
+static whServerKeyIdMap* _hsmGetKeyIdMap(whServerContext* server, whNvmId id)
+{
+    int i;
+    whServerKeyIdMap* map = _hsmFindKeyIdMap(server, id);
+    if (map != NULL)
+        return map;
+    /* take an unused map, or replace the next one in turn */
+    for (i = 0; i < WH_SERVER_KEYID_MAP_COUNT; i++) {
+        if (!server->keyIdMap[i].used) {
+            map = &server->keyIdMap[i];
+            break;
+        }
+    }
+    if (map == NULL) {
+        map = &server->keyIdMap[server->keyIdMapNext];
+        server->keyIdMapNext = (server->keyIdMapNext + 1) %
+            WH_SERVER_KEYID_MAP_COUNT;
+    }
+    _hsmBuildKeyIdMap(server, map, id);
+    return map;
+}
+
+/* return the lowest id not known to be taken, or WOLFHSM_KEYID_ERASED */
+static whNvmId _hsmKeyIdMapFindFree(whServerKeyIdMap* map)
+{
+    int i;
+    int bit;
+    for (i = 0; i < (WOLFHSM_KEYID_MASK + 1) / 32; i++) {
+        if (map->bits[i] != ~(uint32_t)0) {
+            for (bit = 0; (map->bits[i] >> bit) & 1; bit++)
+                ;
+            return (whNvmId)(i * 32 + bit);
+        }
+    }
+    return WOLFHSM_KEYID_ERASED;
+}
+
+static void _hsmKeyIdMapMark(whServerContext* server, whNvmId id, int taken)
+{
+    whServerKeyIdMap* map = _hsmFindKeyIdMap(server, id);
+    if (map == NULL || (id & WOLFHSM_KEYID_MASK) == WOLFHSM_KEYID_ERASED)
+        return;
+    if (taken)
+        KEYID_MAP_SET(map, id & WOLFHSM_KEYID_MASK);
+    else
+        KEYID_MAP_CLEAR(map, id & WOLFHSM_KEYID_MASK);
+}
+
+/* record an access for eviction */
+static void _hsmCacheTouch(whServerContext* server, int slot)
+{
+    server->cache[slot].lastUse = ++server->cacheTick;
+    if (server->cache[slot].useCount < UINT32_MAX)
+        server->cache[slot].useCount++;
+}
+
+/* change the id of a cache slot, keeping the index and unique ids in sync */
+static void _hsmCacheSetId(whServerContext* server, int slot, whNvmId id)
+{
+    int other;
+    if (server->cache[slot].meta->id == id)
+        return;
+    if (server->cache[slot].meta->id != WOLFHSM_KEYID_ERASED) {
+        server->keyGeneration++;
+        _hsmCacheIndexRemove(server, server->cache[slot].meta->id);
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+        hsmInvalidateDecodedKey(server, server->cache[slot].meta->id);
+#endif
+        /* an uncommited key leaves nothing behind */
+        if (server->cache[slot].commited == 0)
+            _hsmKeyIdMapMark(server, server->cache[slot].meta->id, 0);
+    }
+    if (id != WOLFHSM_KEYID_ERASED) {
+        /* a stale copy of the same key in another slot is dropped */
+        other = hsmCacheFindKey(server, id);
+        if (other >= 0)
+            _hsmCacheSetId(server, other, WOLFHSM_KEYID_ERASED);
+    }
+    /* a new key starts out uncommited and unused */
+    server->cache[slot].commited = 0;
+    server->cache[slot].useCount = 0;
+    server->cache[slot].meta->id = id;
+    if (id != WOLFHSM_KEYID_ERASED) {
+        server->cacheIndex[_hsmCacheIndexProbe(server, id)] =
+            (uint16_t)(slot + 1);
+        _hsmKeyIdMapMark(server, id, 1);
+    }
+}
+
+/* return the slot caching the full keyId, including client_id */
+int hsmCacheFindKey(whServerContext* server, whNvmId keyId)
+{
+    uint16_t entry;
+    if (keyId == WOLFHSM_KEYID_ERASED)
+        return WH_ERROR_NOTFOUND;
+    entry = server->cacheIndex[_hsmCacheIndexProbe(server, keyId)];
+    if (entry == 0)
+        return WH_ERROR_NOTFOUND;
+    return entry - 1;
+}
+
+/* whether the full keyId is flagged pinned, in the cache or else in NVM */
+int hsmKeyIsPinned(whServerContext* server, whNvmId keyId)
+{
+    int slot;
+    whNvmMetadata meta[1] = {0};
+    slot = hsmCacheFindKey(server, keyId);
+    if (slot >= 0)
+        return (server->cache[slot].meta->flags &
+            WOLFHSM_NVM_FLAGS_PINNED) != 0;
+    if (keyId == WOLFHSM_KEYID_ERASED ||
+            wh_Nvm_GetMetadata(server->nvm, keyId, meta) != 0)
+        return 0;
+    return (meta->flags & WOLFHSM_NVM_FLAGS_PINNED) != 0;
+}
+
+/* set the metadata of a cache slot, only way the id of a slot may change */
+void hsmCacheSetMeta(whServerContext* server, int slot,
+    const whNvmMetadata* meta)
+{
+    whNvmMetadata copy[1];
+    /* meta may be the slot's own */
+    XMEMCPY((uint8_t*)copy, (const uint8_t*)meta, sizeof(copy));
+    _hsmCacheSetId(server, slot, copy->id);
+    /* the key may have been rewritten in place */
+    server->keyGeneration++;
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    hsmInvalidateDecodedKey(server, copy->id);
+#endif
+    XMEMCPY((uint8_t*)server->cache[slot].meta, (uint8_t*)copy,
+        sizeof(copy));
+    _hsmCacheTouch(server, slot);
+}
+
+uint32_t hsmKeyGeneration(whServerContext* server)
+{
+    /* keys also change in NVM without passing through the cache */
+    return server->keyGeneration +
+        ((server->nvm != NULL) ? server->nvm->generation : 0);
+}
+
+int hsmGetUniqueId(whServerContext* server, whNvmId* outId)
+{
     int ret = 0;
+    int rebuilt = 0;
     whNvmId id;
     /* apply client_id and type which should be set by caller on outId */
     whNvmId buildId = ((*outId | (server->comm->client_id << 8)) & (~WOLFHSM_KEYID_MASK));
-    whNvmId nvmId = 0;
-    whNvmId keyCount;
-    /* try every index until we find a unique one, don't worry about capacity */
-    for (id = 1; id < WOLFHSM_KEYID_MASK + 1; id++) {
-        buildId = ((buildId & ~WOLFHSM_KEYID_MASK) | id);
-        /* check against cache keys */
-        for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-            if (buildId == server->cache[i].meta->id)
+    whNvmMetadata meta[1];
+    whServerKeyIdMap* map = _hsmGetKeyIdMap(server, buildId);
+    while (1) {
+        id = _hsmKeyIdMapFindFree(map);
+        if (id == WOLFHSM_KEYID_ERASED) {
+            /* rebuild once to pick up ids freed through the NVM api */
+            if (rebuilt) {
+                ret = WH_ERROR_NOSPACE;
                 break;
-        }
-        /* try again if match */
-        if (i < WOLFHSM_NUM_RAMKEYS)
+            }
+            _hsmBuildKeyIdMap(server, map, buildId);
+            rebuilt = 1;
             continue;
-        /* if keyId exists */
-        ret = wh_Nvm_List(server->nvm, WOLFHSM_NVM_ACCESS_ANY,
-            WOLFHSM_NVM_FLAGS_ANY, buildId, &keyCount,
-            &nvmId);
-        /* break if we didn't find a match */
-        if (ret == WH_ERROR_NOTFOUND || nvmId != buildId)
+        }
+        KEYID_MAP_SET(map, id);
+        buildId = ((buildId & ~WOLFHSM_KEYID_MASK) | id);
+        /* objects added through the NVM api only show up on a rebuild */
+        if (hsmCacheFindKey(server, buildId) < 0 &&
+            wh_Nvm_GetMetadata(server->nvm, buildId, meta) ==
+            WH_ERROR_NOTFOUND) {
             break;
+        }
     }
-    /* unlikely but cover the case where we've run out of ids */
-    if (id > WOLFHSM_KEYID_MASK)
-        ret = WH_ERROR_NOSPACE;
     /* ultimately, return found id */
     if (ret == 0)
         *outId |= buildId;
     return ret;
 }
 
-/* return the index of a free slot */
-int hsmCacheFindSlot(whServerContext* server)
+/* carve the slot buffers out of the arena, large ones first */
+void hsmCacheInit(whServerContext* server)
+{
+    int i;
+    uint8_t* next = server->cacheArena;
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        if (i < WOLFHSM_KEYCACHE_BIG_COUNT)
+            server->cache[i].size = WOLFHSM_KEYCACHE_BIG_BUFSIZE;
+        else if (i < WOLFHSM_NUM_RAMKEYS - WOLFHSM_KEYCACHE_SMALL_COUNT)
+            server->cache[i].size = WOLFHSM_KEYCACHE_BUFSIZE;
+        else
+            server->cache[i].size = WOLFHSM_KEYCACHE_SMALL_BUFSIZE;
+        server->cache[i].buffer = next;
+        next += server->cache[i].size;
+    }
+}
+
+/* return the index of a free slot that holds size bytes */
+int hsmCacheFindSlot(whServerContext* server, uint32_t size)
 {
     int i;
     int foundIndex = -1;
+    int once;
+    int foundOnce = 0;
+    uint32_t age;
+    uint32_t foundAge = 0;
     for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-        /* check for empty slot or rewrite slot */
-        if (foundIndex == -1 && server->cache[i].meta->id ==
-            WOLFHSM_KEYID_ERASED) {
+        /* take the smallest empty slot that fits */
+        if (server->cache[i].size >= size &&
+            server->cache[i].meta->id == WOLFHSM_KEYID_ERASED &&
+            (foundIndex == -1 ||
+            server->cache[i].size < server->cache[foundIndex].size)) {
             foundIndex = i;
-            break;
         }
     }
-    /* if no empty slots, check for a commited key we can evict */
+    /* if no empty slots, evict the least recently used commited key that
+     * isn't pinned. keys used only once go first so a burst of one-off
+     * loads doesn't push out the hot keys */
     if (foundIndex == -1) {
         for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-            if (server->cache[i].commited == 1) {
+            if (server->cache[i].size < size ||
+                server->cache[i].commited != 1 ||
+                (server->cache[i].meta->flags & WOLFHSM_NVM_FLAGS_PINNED) != 0)
+                continue;
+            once = (server->cache[i].useCount <= 1);
+            age = server->cacheTick - server->cache[i].lastUse;
+            if (foundIndex == -1 || once > foundOnce ||
+                (once == foundOnce && age > foundAge)) {
                 foundIndex = i;
-                break;
+                foundOnce = once;
+                foundAge = age;
             }
         }
     }
@@ -102,8 +371,7 @@ int hsmCacheFindSlot(whServerContext* server)
 
 int hsmCacheKey(whServerContext* server, whNvmMetadata* meta, uint8_t* in)
 {
-    int i;
-    int foundIndex = -1;
+    int foundIndex;
     /* make sure id is valid */
     if (server == NULL || meta == NULL || in == NULL ||
         (meta->id & WOLFHSM_KEYID_MASK) == WOLFHSM_KEYID_ERASED ||
@@ -112,31 +380,20 @@ int hsmCacheKey(whServerContext* server, whNvmMetadata* meta, uint8_t* in)
     }
     /* apply client_id */
     meta->id |= (server->comm->client_id << 8);
-    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-        /* check for empty slot or rewrite slot */
-        if ((foundIndex == -1 &&
-            (server->cache[i].meta->id & WOLFHSM_KEYID_MASK) ==
-            WOLFHSM_KEYID_ERASED) ||
-            server->cache[i].meta->id == meta->id) {
-            foundIndex = i;
-        }
-    }
-    /* if no empty slots, check for a commited key we can evict */
-    if (foundIndex == -1) {
-        for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-            if (server->cache[i].commited == 1) {
-                foundIndex = i;
-                break;
-            }
-        }
+    /* rewrite the slot already holding the key, or take a free one */
+    foundIndex = hsmCacheFindKey(server, meta->id);
+    if (foundIndex >= 0 && server->cache[foundIndex].size < meta->len) {
+        /* outgrew its slot, the old copy goes once the new one is set */
+        foundIndex = -1;
     }
+    if (foundIndex < 0)
+        foundIndex = hsmCacheFindSlot(server, meta->len);
     /* return error if we are out of cache slots */
-    if (foundIndex == -1)
-        return WH_ERROR_NOSPACE;
+    if (foundIndex < 0)
+        return foundIndex;
     /* write key if slot found */
     XMEMCPY((uint8_t*)server->cache[foundIndex].buffer, in, meta->len);
-    XMEMCPY((uint8_t*)server->cache[foundIndex].meta, (uint8_t*)meta,
-        sizeof(whNvmMetadata));
+    hsmCacheSetMeta(server, foundIndex, meta);
     /* check if the key is already commited */
     if (wh_Nvm_GetMetadata(server->nvm, meta->id, meta) == WH_ERROR_NOTFOUND)
         server->cache[foundIndex].commited = 0;
@@ -146,53 +403,77 @@ int hsmCacheKey(whServerContext* server, whNvmMetadata* meta, uint8_t* in)
 }
 
 /* try to put the specified key into cache if it isn't already, return index */
-int hsmFreshenKey(whServerContext* server, whKeyId keyId)
+/* bring the full keyId into the cache from NVM if it isn't already there.
+ * without evict only an empty slot is used */
+static int _hsmCacheLoad(whServerContext* server, whNvmId keyId, int evict)
 {
     int ret = 0;
-    int i;
-    int foundIndex = -1;
-    uint32_t outSz = WOLFHSM_KEYCACHE_BUFSIZE;
+    int foundIndex;
     whNvmMetadata meta[1] = {0};
-    if (server == NULL || keyId == WOLFHSM_KEYID_ERASED)
-        return WH_ERROR_BADARGS;
-    /* apply client_id */
-    keyId |= (server->comm->client_id << 8);
-    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-        /* check for empty slot or rewrite slot */
-        if ((foundIndex == -1 &&
-            server->cache[i].meta->id == WOLFHSM_KEYID_ERASED) ||
-            server->cache[i].meta->id == keyId) {
-            foundIndex = i;
-            if (server->cache[i].meta->id == keyId)
-                return i;
-        }
-    }
-    /* if no empty slots, check for a commited key we can evict */
-    if (foundIndex == -1) {
-        for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-            if (server->cache[i].commited == 1) {
-                foundIndex = i;
-                break;
-            }
-        }
+    foundIndex = hsmCacheFindKey(server, keyId);
+    if (foundIndex >= 0) {
+        _hsmCacheTouch(server, foundIndex);
+        return foundIndex;
     }
-    /* return error if we are out of cache slots */
-    if (foundIndex == -1)
-        return WH_ERROR_NOSPACE;
     /* try to read the metadata */
     ret = wh_Nvm_GetMetadata(server->nvm, keyId, meta);
     if (ret == 0) {
+        foundIndex = hsmCacheFindSlot(server, meta->len);
+        /* return error if we are out of cache slots */
+        if (foundIndex < 0)
+            return foundIndex;
+        if (!evict &&
+            server->cache[foundIndex].meta->id != WOLFHSM_KEYID_ERASED)
+            return WH_ERROR_NOSPACE;
         /* set meta */
-        XMEMCPY((uint8_t*)server->cache[foundIndex].meta, (uint8_t*)meta,
-            sizeof(meta));
-        /* read the object */
-        ret = wh_Nvm_Read(server->nvm, keyId, 0, outSz,
+        hsmCacheSetMeta(server, foundIndex, meta);
+        /* read the object, which is commited by definition */
+        ret = wh_Nvm_Read(server->nvm, keyId, 0, meta->len,
             server->cache[foundIndex].buffer);
+        server->cache[foundIndex].commited = 1;
+        if (ret != 0)
+            _hsmCacheSetId(server, foundIndex, WOLFHSM_KEYID_ERASED);
     }
+    if (ret != 0)
+        return ret;
     /* return index */
     return foundIndex;
 }
 
+int hsmFreshenKey(whServerContext* server, whKeyId keyId)
+{
+    if (server == NULL || keyId == WOLFHSM_KEYID_ERASED)
+        return WH_ERROR_BADARGS;
+    /* apply client_id */
+    keyId |= (server->comm->client_id << 8);
+    return _hsmCacheLoad(server, keyId, 1);
+}
+
+void hsmCachePrefetch(whServerContext* server, const whNvmId* ids,
+    uint16_t count)
+{
+    int i;
+    int ret;
+    whNvmId listCount = 0;
+    whNvmId nvmId = 0;
+    whNvmMetadata meta[1];
+    /* keys that are missing or don't fit are loaded on first use instead */
+    for (i = 0; ids != NULL && i < count; i++) {
+        if (ids[i] != WOLFHSM_KEYID_ERASED)
+            (void)_hsmCacheLoad(server, ids[i], 0);
+    }
+    /* then whatever NVM flags for prefetch, bounded like the id map build */
+    ret = wh_Nvm_List(server->nvm, WOLFHSM_NVM_ACCESS_ANY,
+        WOLFHSM_NVM_FLAGS_ANY, 0, &listCount, &nvmId);
+    for (i = 0; ret == 0 && listCount > 0 && i < WOLFHSM_NUM_NVMOBJECTS; i++) {
+        if (wh_Nvm_GetMetadata(server->nvm, nvmId, meta) == 0 &&
+            (meta->flags & WOLFHSM_NVM_FLAGS_PREFETCH) != 0)
+            (void)_hsmCacheLoad(server, nvmId, 0);
+        ret = wh_Nvm_List(server->nvm, WOLFHSM_NVM_ACCESS_ANY,
+            WOLFHSM_NVM_FLAGS_ANY, nvmId, &listCount, &nvmId);
+    }
+}
+
 int hsmReadKey(whServerContext* server, whKeyId keyId, whNvmMetadata* outMeta,
     uint8_t* out, uint32_t* outSz)
 {
@@ -208,24 +489,26 @@ int hsmReadKey(whServerContext* server, whKeyId keyId, whNvmMetadata* outMeta,
     /* apply client_id */
     keyId |= (server->comm->client_id << 8);
     /* check the cache */
-    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+    i = hsmCacheFindKey(server, keyId);
+    if (i >= 0) {
+        WH_TRACE(WH_TRACE_KEY_HIT, keyId, 0);
         /* copy the meta and key before returning */
-        if (server->cache[i].meta->id == keyId) {
-            /* check outSz */
-            if (server->cache[i].meta->len > *outSz)
-                return WH_ERROR_NOSPACE;
-            if (outMeta != NULL) {
-                XMEMCPY((uint8_t*)outMeta, (uint8_t*)server->cache[i].meta,
-                    sizeof(whNvmMetadata));
-            }
-            if (out != NULL) {
-                XMEMCPY(out, server->cache[i].buffer,
-                    server->cache[i].meta->len);
-            }
-            *outSz = server->cache[i].meta->len;
-            return 0;
+        /* check outSz */
+        if (server->cache[i].meta->len > *outSz)
+            return WH_ERROR_NOSPACE;
+        if (outMeta != NULL) {
+            XMEMCPY((uint8_t*)outMeta, (uint8_t*)server->cache[i].meta,
+                sizeof(whNvmMetadata));
         }
+        if (out != NULL) {
+            XMEMCPY(out, server->cache[i].buffer,
+                server->cache[i].meta->len);
+        }
+        *outSz = server->cache[i].meta->len;
+        _hsmCacheTouch(server, i);
+        return 0;
     }
+    WH_TRACE(WH_TRACE_KEY_MISS, keyId, 0);
     /* try to read the metadata */
     ret = wh_Nvm_GetMetadata(server->nvm, keyId, meta);
     if (ret == 0) {
@@ -270,16 +553,12 @@ int hsmEvictKey(whServerContext* server, whNvmId keyId)
         return WH_ERROR_BADARGS;
     /* apply client_id */
     keyId |= (server->comm->client_id << 8);
-    /* find key */
-    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-        /* mark key as erased */
-        if (server->cache[i].meta->id == keyId) {
-            server->cache[i].meta->id = WOLFHSM_KEYID_ERASED;
-            break;
-        }
-    }
+    /* find key and mark it as erased */
+    i = hsmCacheFindKey(server, keyId);
+    if (i >= 0)
+        _hsmCacheSetId(server, i, WOLFHSM_KEYID_ERASED);
     /* if the key wasn't found return an error */
-    if (i >= WOLFHSM_NUM_RAMKEYS)
+    else
         ret = WH_ERROR_NOTFOUND;
     return ret;
 }
@@ -295,49 +574,129 @@ int hsmCommitKey(whServerContext* server, whNvmId keyId)
     /* apply client_id */
     keyId |= (server->comm->client_id << 8);
     /* find key in cache */
-    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-        if (server->cache[i].meta->id == keyId) {
-            cacheSlot = &server->cache[i];
-            break;
-        }
-    }
-    if (i >= WOLFHSM_NUM_RAMKEYS)
+    i = hsmCacheFindKey(server, keyId);
+    if (i < 0)
         return WH_ERROR_NOTFOUND;
+    cacheSlot = &server->cache[i];
     /* add object */
     ret = wh_Nvm_AddObject(server->nvm, cacheSlot->meta,
         cacheSlot->meta->len, cacheSlot->buffer);
-    if (ret == 0)
+    if (ret == 0) {
         cacheSlot->commited = 1;
+        _hsmKeyIdMapMark(server, keyId, 1);
+    }
     return ret;
 }
 
 int hsmEraseKey(whServerContext* server, whNvmId keyId)
 {
     int i;
+    int ret;
     if (server == NULL || keyId == WOLFHSM_KEYID_ERASED)
         return WH_ERROR_BADARGS;
     /* apply client_id */
     keyId |= (server->comm->client_id << 8);
     /* remove the key from the cache if present */
-    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
-        if (server->cache[i].meta->id == keyId) {
-            server->cache[i].meta->id = WOLFHSM_KEYID_ERASED;
+    i = hsmCacheFindKey(server, keyId);
+    if (i >= 0)
+        _hsmCacheSetId(server, i, WOLFHSM_KEYID_ERASED);
+    /* destroy the object */
+    ret = wh_Nvm_DestroyObjects(server->nvm, 1, &keyId);
+    if (ret == 0)
+        _hsmKeyIdMapMark(server, keyId, 0);
+    return ret;
+}
+
+#ifdef WH_SERVER_KEYGEN_JOBS
+int hsmStartKeygenJob(whServerContext* server, uint32_t size, uint32_t e,
+    uint32_t* outJobId)
+{
+    int i;
+    int slot;
+    whServerJob* job = NULL;
+    if (server == NULL || outJobId == NULL)
+        return WH_ERROR_BADARGS;
+    for (i = 0; i < WH_SERVER_JOB_COUNT; i++) {
+        if (server->job[i].state == WH_SERVER_JOB_FREE) {
+            job = &server->job[i];
             break;
         }
     }
-    /* destroy the object */
-    return wh_Nvm_DestroyObjects(server->nvm, 1, &keyId);
+    /* reclaim a finished job left behind on this channel */
+    for (i = 0; job == NULL && i < WH_SERVER_JOB_COUNT; i++) {
+        if (server->job[i].state == WH_SERVER_JOB_DONE &&
+                server->job[i].comm_index == server->comm_current) {
+            /* by the full id, as it was cached for the job's client */
+            if (server->job[i].rc == 0) {
+                slot = hsmCacheFindKey(server, server->job[i].keyId);
+                if (slot >= 0)
+                    _hsmCacheSetId(server, slot, WOLFHSM_KEYID_ERASED);
+            }
+            job = &server->job[i];
+        }
+    }
+    if (job == NULL)
+        return WH_ERROR_NOSPACE;
+    memset(job, 0, sizeof(*job));
+    /* skip 0, which is never a valid handle */
+    if (++server->job_next_id == 0)
+        server->job_next_id = 1;
+    job->id = server->job_next_id;
+    job->size = size;
+    job->e = e;
+    job->comm_index = server->comm_current;
+    job->state = WH_SERVER_JOB_QUEUED;
+    *outJobId = job->id;
+    return 0;
+}
+
+int hsmPollKeygenJob(whServerContext* server, uint32_t jobId,
+    uint32_t* outDone, uint32_t* outKeyId)
+{
+    int i;
+    int ret;
+    whServerJob* job = NULL;
+    if (server == NULL || outDone == NULL || outKeyId == NULL || jobId == 0)
+        return WH_ERROR_BADARGS;
+    /* only the client that started a job may poll it */
+    for (i = 0; i < WH_SERVER_JOB_COUNT; i++) {
+        if (server->job[i].state != WH_SERVER_JOB_FREE &&
+                server->job[i].id == jobId &&
+                server->job[i].comm_index == server->comm_current) {
+            job = &server->job[i];
+            break;
+        }
+    }
+    if (job == NULL)
+        return WH_ERROR_NOTFOUND;
+    *outKeyId = WOLFHSM_KEYID_ERASED;
+    if (job->state != WH_SERVER_JOB_DONE) {
+        *outDone = 0;
+        return 0;
+    }
+    /* the result is handed out once, then the job is released */
+    *outDone = 1;
+    *outKeyId = job->keyId & ~WOLFHSM_KEYUSER_MASK;
+    ret = job->rc;
+    memset(job, 0, sizeof(*job));
+    return ret;
 }
+#endif /* WH_SERVER_KEYGEN_JOBS */
 
 int wh_Server_HandleKeyRequest(whServerContext* server, uint16_t magic,
     uint16_t action, uint16_t seq, uint8_t* data, uint16_t* size)
 {
     int ret = 0;
+    int ret2;
     uint32_t field;
     uint8_t* in;
     uint8_t* out;
+    void* dmaPtr = NULL;
     whPacket* packet = (whPacket*)data;
     whNvmMetadata meta[1] = {0};
+#ifdef WH_SERVER_KEYGEN_JOBS
+    uint32_t done = 0;
+#endif
     /* validate args, even though these functions are only supposed to be
      * called by internal functions */
     if (server == NULL || data == NULL || size == NULL)
@@ -420,6 +779,115 @@ int wh_Server_HandleKeyRequest(whServerContext* server, uint16_t magic,
             *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyEraseRes);
         }
         break;
+    case WH_KEY_CACHE_DMA:
+    {
+        wh_Packet_key_cache_dma_req req = packet->keyCacheDmaReq;
+        meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO,
+            server->comm->client_id, req.id);
+        meta->flags = req.flags;
+        meta->len = req.sz;
+        /* validate key and label sz */
+        if (req.sz == 0 || req.sz > WOLFHSM_NVM_MAX_OBJECT_SIZE ||
+            req.labelSz > WOLFHSM_NVM_LABEL_LEN)
+            ret = WH_ERROR_BADARGS;
+        else
+            XMEMCPY(meta->label, req.label, req.labelSz);
+        /* get a new id if one wasn't provided */
+        if (ret == 0 && req.id == WOLFHSM_KEYID_ERASED)
+            ret = hsmGetUniqueId(server, &meta->id);
+        /* copy the key straight from client memory into its slot */
+        if (ret == 0) {
+            ret = wh_Server_DmaProcessClientAddress(server, req.keyAddr,
+                &dmaPtr, req.sz, WH_DMA_OPER_CLIENT_READ_PRE,
+                (whServerDmaFlags){0});
+            if (ret == 0) {
+                ret = hsmCacheKey(server, meta, (uint8_t*)dmaPtr);
+                ret2 = wh_Server_DmaProcessClientAddress(server, req.keyAddr,
+                    &dmaPtr, req.sz, WH_DMA_OPER_CLIENT_READ_POST,
+                    (whServerDmaFlags){0});
+                if (ret == 0)
+                    ret = ret2;
+            }
+        }
+        if (ret == 0) {
+            /* remove the client_id, client may set type */
+            packet->keyCacheRes.id = (meta->id & WOLFHSM_KEYID_MASK);
+            *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyCacheRes);
+        }
+    }; break;
+    case WH_KEY_EXPORT_DMA:
+    {
+        wh_Packet_key_export_dma_req req = packet->keyExportDmaReq;
+        whKeyId keyId = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO,
+            server->comm->client_id, req.id);
+        /* find the key size first, so only that much is mapped */
+        field = req.sz;
+        ret = hsmReadKey(server, keyId, NULL, NULL, &field);
+        if (ret == 0 && field > req.sz)
+            ret = WH_ERROR_NOSPACE;
+        if (ret == 0) {
+            ret = wh_Server_DmaProcessClientAddress(server, req.keyAddr,
+                &dmaPtr, field, WH_DMA_OPER_CLIENT_WRITE_PRE,
+                (whServerDmaFlags){0});
+            if (ret == 0) {
+                ret = hsmReadKey(server, keyId, meta, (uint8_t*)dmaPtr,
+                    &field);
+                ret2 = wh_Server_DmaProcessClientAddress(server, req.keyAddr,
+                    &dmaPtr, field, WH_DMA_OPER_CLIENT_WRITE_POST,
+                    (whServerDmaFlags){0});
+                if (ret == 0)
+                    ret = ret2;
+            }
+        }
+        if (ret == 0) {
+            packet->keyExportRes.len = field;
+            XMEMCPY(packet->keyExportRes.label, meta->label,
+                sizeof(meta->label));
+            *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyExportRes);
+        }
+    }; break;
+    case WH_KEY_EXPORT_PUBLIC:
+    {
+        wh_Packet_key_export_public_req req = packet->keyExportPublicReq;
+        /* out is after fixed size fields */
+        out = (uint8_t*)(&packet->keyExportRes + 1);
+        field = WH_COMM_DATA_LEN - (WOLFHSM_PACKET_STUB_SIZE +
+            sizeof(packet->keyExportRes));
+        ret = hsmExportPublicKey(server, MAKE_WOLFHSM_KEYID(
+            WOLFHSM_KEYTYPE_CRYPTO, server->comm->client_id, req.id),
+            req.type, meta, out, &field);
+        if (ret == 0) {
+            packet->keyExportRes.len = field;
+            XMEMCPY(packet->keyExportRes.label, meta->label,
+                sizeof(meta->label));
+            *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyExportRes) +
+                field;
+        }
+    }; break;
+    case WH_KEY_GENERATION:
+        packet->keyGenerationRes.generation = hsmKeyGeneration(server);
+        *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyGenerationRes);
+        break;
+#ifdef WH_SERVER_KEYGEN_JOBS
+    case WH_KEY_RSA_KEYGEN_START:
+        ret = hsmStartKeygenJob(server, packet->keyRsakgStartReq.size,
+            packet->keyRsakgStartReq.e, &field);
+        if (ret == 0) {
+            packet->keyJobStartRes.jobId = field;
+            *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyJobStartRes);
+        }
+        break;
+    case WH_KEY_JOB_STATUS:
+        ret = hsmPollKeygenJob(server, packet->keyJobStatusReq.jobId,
+            &done, &field);
+        if (ret == 0) {
+            packet->keyJobStatusRes.done = done;
+            /* remove the client_id */
+            packet->keyJobStatusRes.keyId = (field & WOLFHSM_KEYID_MASK);
+            *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->keyJobStatusRes);
+        }
+        break;
+#endif /* WH_SERVER_KEYGEN_JOBS */
     default:
         ret = WH_ERROR_BADARGS;
         break;
@@ -34,6 +34,13 @@
 
 #include "wolfhsm/wh_server_nvm.h"
 
+/* Returned with the responses so clients can tell when the metadata they
+ * cached is stale */
+static uint32_t _wh_Server_NvmGeneration(whServerContext* server)
+{
+    return (server->nvm != NULL) ? server->nvm->generation : 0;
+}
+
 int wh_Server_HandleNvmRequest(whServerContext* server,
         uint16_t magic, uint16_t action, uint16_t seq,
         uint16_t req_size, const void* req_packet,
@@ -91,6 +98,7 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
         }
 
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateSimpleResponse(magic,
                 &resp, (whMessageNvm_SimpleResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -116,6 +124,7 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
         }
 
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateListResponse(magic,
                 &resp, (whMessageNvm_ListResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -142,6 +151,53 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
         *out_resp_size = sizeof(resp);
     }; break;
 
+    case WH_MESSAGE_NVM_ACTION_LISTMETADATA:
+    {
+        whMessageNvm_ListMetadataRequest req = {0};
+        whMessageNvm_ListMetadataResponse resp = {0};
+        whMessageNvm_ListMetadataEntry* entries =
+                (whMessageNvm_ListMetadataEntry*)((uint8_t*)resp_packet +
+                        sizeof(resp));
+        whNvmMetadata meta[WH_MESSAGE_NVM_MAX_LIST_METADATA_COUNT];
+        whMessageNvm_ListMetadataEntry entry = {0};
+        int i = 0;
+
+        if (req_size == sizeof(req)) {
+            /* Convert request struct */
+            wh_MessageNvm_TranslateListMetadataRequest(magic,
+                    (whMessageNvm_ListMetadataRequest*)req_packet, &req);
+            if (req.max_count > WH_MESSAGE_NVM_MAX_LIST_METADATA_COUNT) {
+                req.max_count = WH_MESSAGE_NVM_MAX_LIST_METADATA_COUNT;
+            }
+
+            /* Process the listmetadata action */
+            resp.rc = wh_Nvm_ListMetadata(server->nvm,
+                    req.access, req.flags, req.startId, req.max_count,
+                    meta, &resp.returned, &resp.count);
+        } else {
+            /* Request is malformed */
+            resp.rc = WH_ERROR_ABORTED;
+        }
+        if (resp.rc != 0) {
+            resp.returned = 0;
+        }
+
+        /* Convert the entries and the response struct */
+        for (i = 0; i < resp.returned; i++) {
+            entry.id = meta[i].id;
+            entry.access = meta[i].access;
+            entry.flags = meta[i].flags;
+            entry.len = meta[i].len;
+            memcpy(entry.label, meta[i].label, sizeof(entry.label));
+            wh_MessageNvm_TranslateListMetadataEntry(magic,
+                    &entry, &entries[i]);
+        }
+        resp.generation = _wh_Server_NvmGeneration(server);
+        wh_MessageNvm_TranslateListMetadataResponse(magic,
+                &resp, (whMessageNvm_ListMetadataResponse*)resp_packet);
+        *out_resp_size = sizeof(resp) + resp.returned * sizeof(entry);
+    }; break;
+
     case WH_MESSAGE_NVM_ACTION_GETMETADATA:
     {
         whMessageNvm_GetMetadataRequest req = {0};
@@ -168,6 +224,7 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
             resp.rc = WH_ERROR_ABORTED;
         }
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateGetMetadataResponse(magic,
                 &resp, (whMessageNvm_GetMetadataResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -202,11 +259,91 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
             resp.rc = WH_ERROR_ABORTED;
         }
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateSimpleResponse(magic,
                 &resp, (whMessageNvm_SimpleResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
    }; break;
 
+    case WH_MESSAGE_NVM_ACTION_ADDOBJECTBEGIN:
+    {
+        whMessageNvm_AddObjectRequest req = {0};
+        whNvmMetadata meta = {0};
+        whMessageNvm_SimpleResponse resp = {0};
+
+        if (req_size == sizeof(req)) {
+            /* Convert request struct */
+            wh_MessageNvm_TranslateAddObjectRequest(magic,
+                    (whMessageNvm_AddObjectRequest*)req_packet, &req);
+
+            /* Process the AddObjectBegin action */
+            meta.id = req.id;
+            meta.access = req.access;
+            meta.flags = req.flags;
+            meta.len = req.len;
+            memcpy(meta.label, req.label, sizeof(meta.label));
+            resp.rc = wh_Nvm_AddObjectBegin(server->nvm, server->comm,
+                    &meta);
+        } else {
+            /* Request is malformed. */
+            resp.rc = WH_ERROR_ABORTED;
+        }
+        /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
+        wh_MessageNvm_TranslateSimpleResponse(magic,
+                &resp, (whMessageNvm_SimpleResponse*)resp_packet);
+        *out_resp_size = sizeof(resp);
+    }; break;
+
+    case WH_MESSAGE_NVM_ACTION_ADDOBJECTAPPEND:
+    {
+        whMessageNvm_AddObjectAppendRequest req = {0};
+        uint16_t hdr_len = sizeof(req);
+        const uint8_t* data = (const uint8_t*)req_packet + hdr_len;
+        whMessageNvm_SimpleResponse resp = {0};
+
+        if (req_size >= sizeof(req)) {
+            /* Convert request struct */
+            wh_MessageNvm_TranslateAddObjectAppendRequest(magic,
+                    (whMessageNvm_AddObjectAppendRequest*)req_packet, &req);
+            if (req_size == (hdr_len + req.data_len)) {
+                /* Process the AddObjectAppend action */
+                resp.rc = wh_Nvm_AddObjectAppend(server->nvm, server->comm,
+                        req.data_len, data);
+            } else {
+                /* Problem in the request or transport. */
+                resp.rc = WH_ERROR_ABORTED;
+            }
+        } else {
+            /* Request is malformed. */
+            resp.rc = WH_ERROR_ABORTED;
+        }
+        /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
+        wh_MessageNvm_TranslateSimpleResponse(magic,
+                &resp, (whMessageNvm_SimpleResponse*)resp_packet);
+        *out_resp_size = sizeof(resp);
+    }; break;
+
+    case WH_MESSAGE_NVM_ACTION_ADDOBJECTCOMMIT:
+    {
+        /* No request message */
+        whMessageNvm_SimpleResponse resp = {0};
+
+        if (req_size == 0) {
+            /* Process the AddObjectCommit action */
+            resp.rc = wh_Nvm_AddObjectCommit(server->nvm, server->comm);
+        } else {
+            /* Request is malformed */
+            resp.rc = WH_ERROR_ABORTED;
+        }
+        /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
+        wh_MessageNvm_TranslateSimpleResponse(magic,
+                &resp, (whMessageNvm_SimpleResponse*)resp_packet);
+        *out_resp_size = sizeof(resp);
+    }; break;
+
     case WH_MESSAGE_NVM_ACTION_DESTROYOBJECTS:
     {
         whMessageNvm_DestroyObjectsRequest req = {0};
@@ -230,6 +367,7 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
             resp.rc = WH_ERROR_ABORTED;
         }
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateSimpleResponse(magic,
                 &resp, (whMessageNvm_SimpleResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -321,6 +459,7 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
         }
     transRespAddObjDma32:
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateSimpleResponse(magic,
                 &resp, (whMessageNvm_SimpleResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -362,6 +501,7 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
         }
     transRespReadDma32:
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateSimpleResponse(magic,
                 &resp, (whMessageNvm_SimpleResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -420,6 +560,7 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
         }
     transRespAddObjectDma64:
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateSimpleResponse(magic,
                 &resp, (whMessageNvm_SimpleResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -461,6 +602,152 @@ int wh_Server_HandleNvmRequest(whServerContext* server,
         }
     transRespReadDma64:
         /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
+        wh_MessageNvm_TranslateSimpleResponse(magic,
+                &resp, (whMessageNvm_SimpleResponse*)resp_packet);
+        *out_resp_size = sizeof(resp);
+    }; break;
+
+    case WH_MESSAGE_NVM_ACTION_ADDOBJECTDMASG:
+    {
+        whMessageNvm_AddObjectDmaSgRequest req = {0};
+        whMessageNvm_SimpleResponse resp = {0};
+        whDmaSegment meta_seg = {0};
+        whNvmMetadata meta = {0};
+        void* metadata = NULL;
+        void* data = NULL;
+        uint32_t total = 0;
+        uint16_t i;
+        int begun = 0;
+
+        if (req_size == sizeof(req)) {
+            /* Convert request struct */
+            wh_MessageNvm_TranslateAddObjectDmaSgRequest(magic,
+                    (whMessageNvm_AddObjectDmaSgRequest*)req_packet, &req);
+
+            if (req.seg_count > WH_DMA_MAX_SEGMENTS) {
+                resp.rc = WH_ERROR_BADARGS;
+                goto transRespAddObjDmaSg;
+            }
+            for (i = 0; i < req.seg_count; i++) {
+                if (req.segs[i].len > WOLFHSM_NVM_MAX_OBJECT_SIZE - total) {
+                    resp.rc = WH_ERROR_BADARGS;
+                    goto transRespAddObjDmaSg;
+                }
+                total += req.segs[i].len;
+            }
+
+            /* Copy the metadata in, as its length is set from the list */
+            meta_seg.addr = req.metadata_hostaddr;
+            meta_seg.len = sizeof(meta);
+            resp.rc = wh_Server_DmaProcessClientSegment(server, &meta_seg,
+                    req.addr64, &metadata, WH_DMA_OPER_CLIENT_READ_PRE,
+                    (whServerDmaFlags){0});
+            if (resp.rc != WH_ERROR_OK) {
+                goto transRespAddObjDmaSg;
+            }
+            memcpy(&meta, metadata, sizeof(meta));
+            resp.rc = wh_Server_DmaProcessClientSegment(server, &meta_seg,
+                    req.addr64, &metadata, WH_DMA_OPER_CLIENT_READ_POST,
+                    (whServerDmaFlags){0});
+            if (resp.rc != WH_ERROR_OK) {
+                goto transRespAddObjDmaSg;
+            }
+
+            /* Stream each segment straight from client memory */
+            meta.len = (whNvmSize)total;
+            resp.rc = wh_Nvm_AddObjectBegin(server->nvm, server->comm,
+                    &meta);
+            begun = (resp.rc == WH_ERROR_OK);
+            for (i = 0; (i < req.seg_count) && (resp.rc == WH_ERROR_OK); i++) {
+                if (req.segs[i].len == 0) {
+                    continue;
+                }
+                resp.rc = wh_Server_DmaProcessClientSegment(server,
+                        &req.segs[i], req.addr64, &data,
+                        WH_DMA_OPER_CLIENT_READ_PRE, (whServerDmaFlags){0});
+                if (resp.rc == WH_ERROR_OK) {
+                    resp.rc = wh_Nvm_AddObjectAppend(server->nvm,
+                            server->comm, (whNvmSize)req.segs[i].len,
+                            (const uint8_t*)data);
+                }
+                if (resp.rc == WH_ERROR_OK) {
+                    resp.rc = wh_Server_DmaProcessClientSegment(server,
+                            &req.segs[i], req.addr64, &data,
+                            WH_DMA_OPER_CLIENT_READ_POST,
+                            (whServerDmaFlags){0});
+                }
+            }
+            if (resp.rc == WH_ERROR_OK) {
+                resp.rc = wh_Nvm_AddObjectCommit(server->nvm, server->comm);
+            }
+            if ((resp.rc != WH_ERROR_OK) && (begun != 0)) {
+                /* Don't leave the stream open, so a later add can begin */
+                (void)wh_Nvm_AddObjectAbort(server->nvm, server->comm);
+            }
+        } else {
+            /* Request is malformed */
+            resp.rc = WH_ERROR_ABORTED;
+        }
+    transRespAddObjDmaSg:
+        /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
+        wh_MessageNvm_TranslateSimpleResponse(magic,
+                &resp, (whMessageNvm_SimpleResponse*)resp_packet);
+        *out_resp_size = sizeof(resp);
+    }; break;
+
+    case WH_MESSAGE_NVM_ACTION_READDMASG:
+    {
+        whMessageNvm_ReadDmaSgRequest req = {0};
+        whMessageNvm_SimpleResponse resp = {0};
+        void* data = NULL;
+        uint32_t offset = 0;
+        uint16_t i;
+
+        if (req_size == sizeof(req)) {
+            /* Convert request struct */
+            wh_MessageNvm_TranslateReadDmaSgRequest(magic,
+                    (whMessageNvm_ReadDmaSgRequest*)req_packet, &req);
+
+            if (req.seg_count > WH_DMA_MAX_SEGMENTS) {
+                resp.rc = WH_ERROR_BADARGS;
+                goto transRespReadDmaSg;
+            }
+
+            /* Read each segment straight into client memory */
+            offset = req.offset;
+            for (i = 0; (i < req.seg_count) && (resp.rc == WH_ERROR_OK); i++) {
+                if (req.segs[i].len == 0) {
+                    continue;
+                }
+                if (req.segs[i].len > WOLFHSM_NVM_MAX_OBJECT_SIZE - offset) {
+                    resp.rc = WH_ERROR_BADARGS;
+                    break;
+                }
+                resp.rc = wh_Server_DmaProcessClientSegment(server,
+                        &req.segs[i], req.addr64, &data,
+                        WH_DMA_OPER_CLIENT_WRITE_PRE, (whServerDmaFlags){0});
+                if (resp.rc == WH_ERROR_OK) {
+                    resp.rc = wh_Nvm_Read(server->nvm, req.id,
+                            (whNvmSize)offset, (whNvmSize)req.segs[i].len,
+                            (uint8_t*)data);
+                }
+                if (resp.rc == WH_ERROR_OK) {
+                    resp.rc = wh_Server_DmaProcessClientSegment(server,
+                            &req.segs[i], req.addr64, &data,
+                            WH_DMA_OPER_CLIENT_WRITE_POST,
+                            (whServerDmaFlags){0});
+                }
+                offset += req.segs[i].len;
+            }
+        } else {
+            /* Request is malformed */
+            resp.rc = WH_ERROR_ABORTED;
+        }
+    transRespReadDmaSg:
+        /* Convert the response struct */
+        resp.generation = _wh_Server_NvmGeneration(server);
         wh_MessageNvm_TranslateSimpleResponse(magic,
                 &resp, (whMessageNvm_SimpleResponse*)resp_packet);
         *out_resp_size = sizeof(resp);
@@ -160,6 +160,62 @@ static uint32_t hsmShePopFlags(uint8_t* messageTwo)
     return (((messageTwo[3] & 0x0f) << 4) | ((messageTwo[4] & 0x80) >> 7));
 }
 
+enum {
+    WOLFHSM_SHE_KDF_ENC = 0,    /* AES-MP(key | KEY_UPDATE_ENC_C) */
+    WOLFHSM_SHE_KDF_MAC = 1,    /* AES-MP(key | KEY_UPDATE_MAC_C) */
+};
+
+/* Derive K1 or K2 from an auth key, keeping the result for the next key
+ * update with the same auth key */
+static int hsmSheKdf(whServerContext* server, const uint8_t* key,
+    uint32_t keySz, int which, uint8_t* out)
+{
+    int ret;
+    uint8_t kdfInput[WOLFHSM_SHE_KEY_SZ * 2];
+    const uint8_t* constant = (which == WOLFHSM_SHE_KDF_ENC) ?
+        WOLFHSM_SHE_KEY_UPDATE_ENC_C : WOLFHSM_SHE_KEY_UPDATE_MAC_C;
+#if WH_SHE_KDF_CACHE_COUNT > 0
+    int i;
+    whSheKdfCacheEntry* entry = NULL;
+#endif
+    if (keySz > WOLFHSM_SHE_KEY_SZ)
+        return WH_ERROR_BADARGS;
+#if WH_SHE_KDF_CACHE_COUNT > 0
+    if (keySz == WOLFHSM_SHE_KEY_SZ) {
+        for (i = 0; i < WH_SHE_KDF_CACHE_COUNT; i++) {
+            if (server->she->kdfCache[i].valid != 0 &&
+                XMEMCMP(server->she->kdfCache[i].key, key, keySz) == 0) {
+                entry = &server->she->kdfCache[i];
+                break;
+            }
+        }
+        if (entry != NULL && (entry->valid & (1 << which)) != 0) {
+            XMEMCPY(out, entry->derived[which], WOLFHSM_SHE_KEY_SZ);
+            return 0;
+        }
+    }
+#endif
+    XMEMCPY(kdfInput, key, keySz);
+    XMEMCPY(kdfInput + keySz, constant, sizeof(WOLFHSM_SHE_KEY_UPDATE_ENC_C));
+    ret = wh_AesMp16(server, kdfInput,
+        keySz + sizeof(WOLFHSM_SHE_KEY_UPDATE_ENC_C), out);
+#if WH_SHE_KDF_CACHE_COUNT > 0
+    if (ret == 0 && keySz == WOLFHSM_SHE_KEY_SZ) {
+        if (entry == NULL) {
+            entry = &server->she->kdfCache[server->she->kdfCacheNext];
+            server->she->kdfCacheNext =
+                (server->she->kdfCacheNext + 1) % WH_SHE_KDF_CACHE_COUNT;
+            XMEMCPY(entry->key, key, WOLFHSM_SHE_KEY_SZ);
+            entry->valid = 0;
+        }
+        XMEMCPY(entry->derived[which], out, WOLFHSM_SHE_KEY_SZ);
+        entry->valid |= (1 << which);
+    }
+#endif
+    XMEMSET(kdfInput, 0, sizeof(kdfInput));
+    return ret;
+}
+
 static int hsmSheSetUid(whServerContext* server, whPacket* packet)
 {
     int ret = 0;
@@ -261,6 +317,57 @@ static int hsmSheSecureBootUpdate(whServerContext* server, whPacket* packet,
     return ret;
 }
 
+static int hsmSheSecureBootDma(whServerContext* server, whPacket* packet,
+    uint16_t* size)
+{
+    int ret = 0;
+    int ret2;
+    uint64_t addr;
+    uint32_t sz;
+    uint32_t done = 0;
+    uint32_t blockSz;
+    void* in = NULL;
+    /* the image replaces the update sub commands */
+    if (server->she->sbState != WOLFHSM_SHE_SB_UPDATE)
+        ret = WH_SHE_ERC_SEQUENCE_ERROR;
+    if (ret == 0) {
+        addr = packet->sheSecureBootDmaReq.addr;
+        sz = packet->sheSecureBootDmaReq.sz;
+        /* check that we don't exceed the expected bootloader size */
+        if (sz > server->she->blSize - server->she->blSizeReceived ||
+            (sz > 0 && addr + (sz - 1) < addr))
+            ret = WH_SHE_ERC_SEQUENCE_ERROR;
+    }
+    /* map and cmac the image a block at a time */
+    while (ret == 0 && done < sz) {
+        blockSz = sz - done;
+        if (blockSz > WH_SHE_SECURE_BOOT_DMA_BLOCK)
+            blockSz = WH_SHE_SECURE_BOOT_DMA_BLOCK;
+        ret = wh_Server_DmaProcessClientAddress(server, addr + done, &in,
+            blockSz, WH_DMA_OPER_CLIENT_READ_PRE, (whServerDmaFlags){0});
+        if (ret == 0) {
+            ret = wc_CmacUpdate(sheCmac, in, blockSz);
+            ret2 = wh_Server_DmaProcessClientAddress(server, addr + done, &in,
+                blockSz, WH_DMA_OPER_CLIENT_READ_POST, (whServerDmaFlags){0});
+            if (ret == 0)
+                ret = ret2;
+        }
+        if (ret == 0)
+            done += blockSz;
+    }
+    if (ret == 0) {
+        server->she->blSizeReceived += sz;
+        /* advance to the next state if we've cmaced the entire image */
+        if (server->she->blSizeReceived == server->she->blSize)
+            server->she->sbState = WOLFHSM_SHE_SB_FINISH;
+        /* set ERC_NO_ERROR */
+        packet->sheSecureBootDmaRes.status = WOLFHSM_SHE_ERC_NO_ERROR;
+        *size = WOLFHSM_PACKET_STUB_SIZE +
+            sizeof(packet->sheSecureBootDmaRes);
+    }
+    return ret;
+}
+
 static int hsmSheSecureBootFinish(whServerContext* server, whPacket* packet,
     uint16_t* size)
 {
@@ -326,9 +433,11 @@ static int hsmSheGetStatus(whServerContext* server, whPacket* packet,
     return 0;
 }
 
-static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
-    uint16_t* size)
+/* Process one M1/M2/M3 tuple in place, leaving M4/M5 over it */
+static int hsmSheLoadKeyOne(whServerContext* server,
+    wh_Packet_she_load_key_req* req)
 {
+    wh_Packet_she_load_key_res* res = (wh_Packet_she_load_key_res*)req;
     int ret;
     int keyRet = 0;
     uint32_t keySz;
@@ -341,42 +450,28 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
     keySz = sizeof(kdfInput);
     ret = hsmReadKey(server, MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_SHE,
         server->comm->client_id,
-        hsmShePopAuthId(packet->sheLoadKeyReq.messageOne)), NULL, kdfInput,
+        hsmShePopAuthId(req->messageOne)), NULL, kdfInput,
         &keySz);
     /* make K2 using AES-MP(authKey | WOLFHSM_SHE_KEY_UPDATE_MAC_C) */
-    if (ret == 0) {
-        /* add WOLFHSM_SHE_KEY_UPDATE_MAC_C to the input */
-        XMEMCPY(kdfInput + keySz, WOLFHSM_SHE_KEY_UPDATE_MAC_C,
-            sizeof(WOLFHSM_SHE_KEY_UPDATE_MAC_C));
-        /* do kdf */
-        ret = wh_AesMp16(server, kdfInput,
-            keySz + sizeof(WOLFHSM_SHE_KEY_UPDATE_MAC_C), tmpKey);
-    }
+    if (ret == 0)
+        ret = hsmSheKdf(server, kdfInput, keySz, WOLFHSM_SHE_KDF_MAC, tmpKey);
     else
         ret = WH_SHE_ERC_KEY_NOT_AVAILABLE;
     /* cmac messageOne and messageTwo using K2 as the cmac key */
     if (ret == 0) {
         field = AES_BLOCK_SIZE;
         ret = wc_AesCmacGenerate_ex(sheCmac, cmacOutput, &field,
-            (uint8_t*)&packet->sheLoadKeyReq,
-            sizeof(packet->sheLoadKeyReq.messageOne) +
-            sizeof(packet->sheLoadKeyReq.messageTwo), tmpKey,
-            WOLFHSM_SHE_KEY_SZ, NULL, server->crypto->devId);
+            (uint8_t*)req, sizeof(req->messageOne) + sizeof(req->messageTwo),
+            tmpKey, WOLFHSM_SHE_KEY_SZ, NULL, server->crypto->devId);
     }
     /* compare digest to M3 */
-    if (ret == 0 && XMEMCMP(packet->sheLoadKeyReq.messageThree,
+    if (ret == 0 && XMEMCMP(req->messageThree,
         cmacOutput, field) != 0) {
         ret = WH_SHE_ERC_KEY_UPDATE_ERROR;
     }
     /* make K1 using AES-MP(authKey | WOLFHSM_SHE_KEY_UPDATE_ENC_C) */
-    if (ret == 0) {
-        /* add WOLFHSM_SHE_KEY_UPDATE_ENC_C to the input */
-        XMEMCPY(kdfInput + keySz, WOLFHSM_SHE_KEY_UPDATE_ENC_C,
-            sizeof(WOLFHSM_SHE_KEY_UPDATE_ENC_C));
-        /* do kdf */
-        ret = wh_AesMp16(server, kdfInput,
-            keySz + sizeof(WOLFHSM_SHE_KEY_UPDATE_ENC_C), tmpKey);
-    }
+    if (ret == 0)
+        ret = hsmSheKdf(server, kdfInput, keySz, WOLFHSM_SHE_KDF_ENC, tmpKey);
     /* decrypt messageTwo */
     if (ret == 0)
         ret = wc_AesInit(sheAes, NULL, server->crypto->devId);
@@ -386,9 +481,7 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
     }
     if (ret == 0) {
         ret = wc_AesCbcDecrypt(sheAes,
-            packet->sheLoadKeyReq.messageTwo,
-            packet->sheLoadKeyReq.messageTwo,
-            sizeof(packet->sheLoadKeyReq.messageTwo));
+            req->messageTwo, req->messageTwo, sizeof(req->messageTwo));
     }
     /* free aes for protection */
     wc_AesFree(sheAes);
@@ -396,7 +489,7 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
     if (ret == 0) {
         ret = hsmReadKey(server, MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_SHE,
             server->comm->client_id,
-            hsmShePopId(packet->sheLoadKeyReq.messageOne)), meta, kdfInput,
+            hsmShePopId(req->messageOne)), meta, kdfInput,
             &keySz);
         /* if the keyslot is empty or write protection is not on continue */
         if (ret == WH_ERROR_NOTFOUND ||
@@ -409,7 +502,7 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
             ret = WH_SHE_ERC_WRITE_PROTECTED;
     }
     /* check UID == 0 */
-    if (ret == 0 && XMEMEQZERO(packet->sheLoadKeyReq.messageOne,
+    if (ret == 0 && XMEMEQZERO(req->messageOne,
         WOLFHSM_SHE_UID_SZ) == 1) {
         /* check wildcard */
         if ((((whSheMetadata*)meta->label)->flags & WOLFHSM_SHE_FLAG_WILDCARD)
@@ -418,14 +511,14 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
         }
     }
     /* compare to UID */
-    else if (ret == 0 && XMEMCMP(packet->sheLoadKeyReq.messageOne,
+    else if (ret == 0 && XMEMCMP(req->messageOne,
         server->she->uid, sizeof(server->she->uid)) != 0) {
         ret = WH_SHE_ERC_KEY_UPDATE_ERROR;
     }
     /* verify counter is greater than stored value */
     if (ret == 0 &&
         keyRet != WH_ERROR_NOTFOUND &&
-        ntohl(*((uint32_t*)packet->sheLoadKeyReq.messageTwo) >> 4) <=
+        ntohl(*((uint32_t*)req->messageTwo) >> 4) <=
         ntohl(((whSheMetadata*)meta->label)->count)) {
         ret = WH_SHE_ERC_KEY_UPDATE_ERROR;
     }
@@ -433,25 +526,25 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
     if (ret == 0) {
         meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_SHE,
             server->comm->client_id,
-            hsmShePopId(packet->sheLoadKeyReq.messageOne));
+            hsmShePopId(req->messageOne));
         ((whSheMetadata*)meta->label)->flags =
-            hsmShePopFlags(packet->sheLoadKeyReq.messageTwo);
+            hsmShePopFlags(req->messageTwo);
         ((whSheMetadata*)meta->label)->count =
-            (*(uint32_t*)packet->sheLoadKeyReq.messageTwo >> 4);
+            (*(uint32_t*)req->messageTwo >> 4);
         meta->len = WOLFHSM_SHE_KEY_SZ;
         /* cache if ram key, overwrite otherwise */
         if ((meta->id & WOLFHSM_KEYID_MASK) == WOLFHSM_SHE_RAM_KEY_ID) {
-            ret = hsmCacheKey(server, meta, packet->sheLoadKeyReq.messageTwo
+            ret = hsmCacheKey(server, meta, req->messageTwo
                 + WOLFHSM_SHE_KEY_SZ);
         }
         else {
             ret = wh_Nvm_AddObject(server->nvm, meta, meta->len,
-                packet->sheLoadKeyReq.messageTwo + WOLFHSM_SHE_KEY_SZ);
+                req->messageTwo + WOLFHSM_SHE_KEY_SZ);
             /* read the evicted back from nvm */
             if (ret == 0) {
                 keySz = WOLFHSM_SHE_KEY_SZ;
                 ret = hsmReadKey(server, meta->id, meta,
-                    packet->sheLoadKeyReq.messageTwo + WOLFHSM_SHE_KEY_SZ,
+                    req->messageTwo + WOLFHSM_SHE_KEY_SZ,
                     &keySz);
             }
         }
@@ -461,7 +554,7 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
     /* generate K3 using the updated key */
     if (ret == 0) {
         /* copy new key to kdfInput */
-        XMEMCPY(kdfInput, packet->sheLoadKeyReq.messageTwo +
+        XMEMCPY(kdfInput, req->messageTwo +
             WOLFHSM_SHE_KEY_SZ, WOLFHSM_SHE_KEY_SZ);
         /* add WOLFHSM_SHE_KEY_UPDATE_ENC_C to the input */
         XMEMCPY(kdfInput + meta->len, WOLFHSM_SHE_KEY_UPDATE_ENC_C,
@@ -478,20 +571,20 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
     }
     if (ret == 0) {
         /* reset messageTwo with the nvm read counter, pad with a 1 bit */
-        *(uint32_t*)packet->sheLoadKeyReq.messageTwo =
+        *(uint32_t*)req->messageTwo =
             (((whSheMetadata*)meta->label)->count << 4);
-        packet->sheLoadKeyReq.messageTwo[3] |= 0x08;
+        req->messageTwo[3] |= 0x08;
         /* encrypt the new counter */
         ret = wc_AesEncryptDirect(sheAes,
-            packet->sheLoadKeyRes.messageFour + WOLFHSM_SHE_KEY_SZ,
-            packet->sheLoadKeyReq.messageTwo);
+            res->messageFour + WOLFHSM_SHE_KEY_SZ,
+            req->messageTwo);
     }
     /* free aes for protection */
     wc_AesFree(sheAes);
     /* generate K4 using the updated key */
     if (ret == 0) {
         /* set our UID, ID and AUTHID are already set from messageOne */
-        XMEMCPY(packet->sheLoadKeyRes.messageFour, server->she->uid,
+        XMEMCPY(res->messageFour, server->she->uid,
             sizeof(server->she->uid));
         /* add WOLFHSM_SHE_KEY_UPDATE_MAC_C to the input */
         XMEMCPY(kdfInput + meta->len, WOLFHSM_SHE_KEY_UPDATE_MAC_C,
@@ -503,20 +596,74 @@ static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
     /* cmac messageFour using K4 as the cmac key */
     if (ret == 0) {
         field = AES_BLOCK_SIZE;
-        ret = wc_AesCmacGenerate_ex(sheCmac, packet->sheLoadKeyRes.messageFive,
-            &field, packet->sheLoadKeyRes.messageFour,
-            sizeof(packet->sheLoadKeyRes.messageFour), tmpKey,
+        ret = wc_AesCmacGenerate_ex(sheCmac, res->messageFive, &field,
+            res->messageFour, sizeof(res->messageFour), tmpKey,
             WOLFHSM_SHE_KEY_SZ, NULL, server->crypto->devId);
     }
-    if (ret == 0) {
+    /* mark if the ram key was loaded */
+    if (ret == 0 && (meta->id & WOLFHSM_KEYID_MASK) == WOLFHSM_SHE_RAM_KEY_ID)
+        server->she->ramKeyPlain = 1;
+    return ret;
+}
+
+static int hsmSheLoadKey(whServerContext* server, whPacket* packet,
+    uint16_t* size)
+{
+    int ret = hsmSheLoadKeyOne(server, &packet->sheLoadKeyReq);
+    if (ret == 0)
         *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->sheLoadKeyRes);
-        /* mark if the ram key was loaded */
-        if ((meta->id & WOLFHSM_KEYID_MASK) == WOLFHSM_SHE_RAM_KEY_ID)
-            server->she->ramKeyPlain = 1;
+    return ret;
+}
+
+/* Translate an error into one of the SHE error codes */
+static int hsmSheErc(int ret)
+{
+    if (ret != 0 && ret != WH_SHE_ERC_SEQUENCE_ERROR &&
+        ret != WH_SHE_ERC_KEY_NOT_AVAILABLE && ret != WH_SHE_ERC_KEY_INVALID &&
+        ret != WH_SHE_ERC_KEY_EMPTY && ret != WH_SHE_ERC_NO_SECURE_BOOT &&
+        ret != WH_SHE_ERC_WRITE_PROTECTED && ret != WH_SHE_ERC_KEY_UPDATE_ERROR
+        && ret != WH_SHE_ERC_RNG_SEED && ret != WH_SHE_ERC_NO_DEBUGGING &&
+        ret != WH_SHE_ERC_BUSY && ret != WH_SHE_ERC_MEMORY_FAILURE) {
+        ret = WH_SHE_ERC_GENERAL_ERROR;
     }
     return ret;
 }
 
+static int hsmSheLoadKeyBatch(whServerContext* server, whPacket* packet,
+    uint16_t* size)
+{
+    int ret = 0;
+    uint32_t i;
+    uint32_t count;
+    wh_Packet_she_load_key_req tuple[1];
+    wh_Packet_she_load_key_req* in;
+    wh_Packet_she_load_key_res* out;
+    /* the tuples and results are after the fixed sized fields, each result
+     * ends before the next tuple starts so they can be processed in place */
+    in = (wh_Packet_she_load_key_req*)(&packet->sheLoadKeyBatchReq + 1);
+    out = (wh_Packet_she_load_key_res*)(&packet->sheLoadKeyBatchRes + 1);
+    count = packet->sheLoadKeyBatchReq.count;
+    if (*size < WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->sheLoadKeyBatchReq) ||
+        count > (*size - WOLFHSM_PACKET_STUB_SIZE -
+        sizeof(packet->sheLoadKeyBatchReq)) / sizeof(*in)) {
+        return WH_ERROR_BADARGS;
+    }
+    for (i = 0; i < count; i++) {
+        XMEMCPY(tuple, &in[i], sizeof(tuple));
+        ret = hsmSheLoadKeyOne(server, tuple);
+        if (ret != 0)
+            break;
+        XMEMCPY(&out[i], tuple, sizeof(out[i]));
+    }
+    XMEMSET(tuple, 0, sizeof(tuple));
+    packet->sheLoadKeyBatchRes.count = i;
+    packet->sheLoadKeyBatchRes.status = (ret == 0) ?
+        WOLFHSM_SHE_ERC_NO_ERROR : hsmSheErc(ret);
+    *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->sheLoadKeyBatchRes) +
+        i * sizeof(*out);
+    return 0;
+}
+
 static int hsmSheLoadPlainKey(whServerContext* server, whPacket* packet,
     uint16_t* size)
 {
@@ -562,12 +709,9 @@ static int hsmSheExportRamKey(whServerContext* server, whPacket* packet,
             sizeof(server->she->uid));
         packet->sheExportRamKeyRes.messageOne[15] =
             ((WOLFHSM_SHE_RAM_KEY_ID << 4) | (WOLFHSM_SHE_SECRET_KEY_ID));
-        /* add WOLFHSM_SHE_KEY_UPDATE_ENC_C to the input */
-        XMEMCPY(kdfInput + meta->len, WOLFHSM_SHE_KEY_UPDATE_ENC_C,
-            sizeof(WOLFHSM_SHE_KEY_UPDATE_ENC_C));
         /* generate K1 */
-        ret = wh_AesMp16(server, kdfInput,
-            meta->len + sizeof(WOLFHSM_SHE_KEY_UPDATE_ENC_C), tmpKey);
+        ret = hsmSheKdf(server, kdfInput, meta->len, WOLFHSM_SHE_KDF_ENC,
+            tmpKey);
     }
     /* build cleartext M2 */
     if (ret == 0) {
@@ -605,12 +749,9 @@ static int hsmSheExportRamKey(whServerContext* server, whPacket* packet,
     /* free aes for protection */
     wc_AesFree(sheAes);
     if (ret == 0) {
-        /* add WOLFHSM_SHE_KEY_UPDATE_MAC_C to the input */
-        XMEMCPY(kdfInput + meta->len, WOLFHSM_SHE_KEY_UPDATE_MAC_C,
-            sizeof(WOLFHSM_SHE_KEY_UPDATE_MAC_C));
         /* generate K2 */
-        ret = wh_AesMp16(server, kdfInput,
-            meta->len + sizeof(WOLFHSM_SHE_KEY_UPDATE_MAC_C), tmpKey);
+        ret = hsmSheKdf(server, kdfInput, meta->len, WOLFHSM_SHE_KDF_MAC,
+            tmpKey);
     }
     /* cmac messageOne and messageTwo using K2 as the cmac key */
     if (ret == 0) {
@@ -681,6 +822,44 @@ static int hsmSheExportRamKey(whServerContext* server, whPacket* packet,
     return ret;
 }
 
+#if WH_SHE_RND_POOL_COUNT > 0
+static void hsmSheClearRndPool(whServerContext* server)
+{
+    XMEMSET(server->she->rndPool, 0, sizeof(server->she->rndPool));
+    server->she->rndPoolCount = 0;
+}
+
+int hsmSheRefillRnd(whServerContext* server)
+{
+    int ret;
+    uint32_t count;
+    if (server->she == NULL || server->she->rndInited == 0 ||
+            server->she->rndPoolCount >= WH_SHE_RND_POOL_COUNT) {
+        return 0;
+    }
+    ret = wc_AesInit(sheAes, NULL, server->crypto->devId);
+    if (ret == 0) {
+        ret = wc_AesSetKey(sheAes, server->she->prngKey,
+            WOLFHSM_SHE_KEY_SZ, NULL, AES_ENCRYPTION);
+    }
+    /* encrypt each state to the next one, each with a zero iv */
+    while (ret == 0 && server->she->rndPoolCount < WH_SHE_RND_POOL_COUNT) {
+        count = server->she->rndPoolCount;
+        ret = wc_AesSetIV(sheAes, NULL);
+        if (ret == 0) {
+            ret = wc_AesCbcEncrypt(sheAes, server->she->rndPool[count],
+                (count == 0) ? server->she->prngState :
+                server->she->rndPool[count - 1], WOLFHSM_SHE_KEY_SZ);
+        }
+        if (ret == 0)
+            server->she->rndPoolCount++;
+    }
+    /* free aes for protection */
+    wc_AesFree(sheAes);
+    return (ret == 0) ? 1 : ret;
+}
+#endif
+
 static int hsmSheInitRnd(whServerContext* server, whPacket* packet,
     uint16_t* size)
 {
@@ -743,6 +922,9 @@ static int hsmSheInitRnd(whServerContext* server, whPacket* packet,
             ret = WH_SHE_ERC_KEY_UPDATE_ERROR;
     }
     if (ret == 0) {
+#if WH_SHE_RND_POOL_COUNT > 0
+        hsmSheClearRndPool(server);
+#endif
         /* set PRNG_STATE */
         XMEMCPY(server->she->prngState, cmacOutput, WOLFHSM_SHE_KEY_SZ);
         /* add PRNG_KEY_C to the kdf input */
@@ -769,6 +951,22 @@ static int hsmSheRnd(whServerContext* server, whPacket* packet, uint16_t* size)
     /* check that rng has been inited */
     if (server->she->rndInited == 0)
         ret = WH_SHE_ERC_RNG_SEED;
+#if WH_SHE_RND_POOL_COUNT > 0
+    /* use the next state computed ahead of time */
+    if (ret == 0 && server->she->rndPoolCount > 0) {
+        XMEMCPY(server->she->prngState, server->she->rndPool[0],
+            WOLFHSM_SHE_KEY_SZ);
+        server->she->rndPoolCount--;
+        XMEMMOVE(server->she->rndPool[0], server->she->rndPool[1],
+            server->she->rndPoolCount * WOLFHSM_SHE_KEY_SZ);
+        XMEMSET(server->she->rndPool[server->she->rndPoolCount], 0,
+            WOLFHSM_SHE_KEY_SZ);
+        XMEMCPY(packet->sheRndRes.rnd, server->she->prngState,
+            WOLFHSM_SHE_KEY_SZ);
+        *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->sheRndRes);
+        return 0;
+    }
+#endif
     /* set up aes */
     if (ret == 0)
         ret = wc_AesInit(sheAes, NULL, server->crypto->devId);
@@ -804,6 +1002,10 @@ static int hsmSheExtendSeed(whServerContext* server, whPacket* packet,
     if (server->she->rndInited == 0)
         ret = WH_SHE_ERC_RNG_SEED;
     if (ret == 0) {
+#if WH_SHE_RND_POOL_COUNT > 0
+        /* the pooled states follow the one being replaced */
+        hsmSheClearRndPool(server);
+#endif
         /* set kdfInput to PRNG_STATE */
         XMEMCPY(kdfInput, server->she->prngState, WOLFHSM_SHE_KEY_SZ);
         /* add the user supplied entropy to kdfInput */
@@ -999,6 +1201,108 @@ static int hsmSheDecCbc(whServerContext* server, whPacket* packet,
     return ret;
 }
 
+/* Init aes with a SHE key in the given direction, to be freed by the caller
+ * with wc_AesFree on success */
+static int _hsmSheDmaSetKey(whServerContext* server, Aes* aes, uint8_t keyId,
+    int dir)
+{
+    int ret;
+    uint32_t keySz;
+    uint8_t tmpKey[WOLFHSM_SHE_KEY_SZ];
+    keySz = WOLFHSM_SHE_KEY_SZ;
+    ret = hsmReadKey(server, MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_SHE,
+        server->comm->client_id, keyId), NULL, tmpKey, &keySz);
+    if (ret != 0 || keySz != WOLFHSM_SHE_KEY_SZ)
+        return WH_SHE_ERC_KEY_NOT_AVAILABLE;
+    ret = wc_AesInit(aes, NULL, server->crypto->devId);
+    if (ret == 0) {
+        ret = wc_AesSetKey(aes, tmpKey, keySz, NULL, dir);
+        if (ret != 0)
+            wc_AesFree(aes);
+    }
+    return ret;
+}
+
+/* Encrypt or decrypt a buffer in client memory with ECB or CBC, mapping
+ * WH_SHE_CIPHER_DMA_BLOCK bytes of it at a time */
+static int hsmSheCipherDma(whServerContext* server, whPacket* packet,
+    uint16_t* size, int enc, int cbc)
+{
+    int ret;
+    int ret2;
+    uint32_t sz;
+    uint32_t done = 0;
+    uint32_t blockSz;
+    uint64_t inAddr;
+    uint64_t outAddr;
+    void* in = NULL;
+    void* out = NULL;
+    uint8_t iv[WOLFHSM_SHE_KEY_SZ];
+    Aes aes[1];
+    inAddr = packet->sheCipherDmaReq.inAddr;
+    outAddr = packet->sheCipherDmaReq.outAddr;
+    /* only process a multiple of block size */
+    sz = packet->sheCipherDmaReq.sz;
+    sz -= (sz % AES_BLOCK_SIZE);
+    XMEMCPY(iv, packet->sheCipherDmaReq.iv, sizeof(iv));
+    ret = _hsmSheDmaSetKey(server, aes, packet->sheCipherDmaReq.keyId,
+        enc ? AES_ENCRYPTION : AES_DECRYPTION);
+    if (ret != 0)
+        return ret;
+    if (cbc)
+        ret = wc_AesSetIV(aes, iv);
+    while (ret == 0 && done < sz) {
+        blockSz = sz - done;
+        if (blockSz > WH_SHE_CIPHER_DMA_BLOCK)
+            blockSz = WH_SHE_CIPHER_DMA_BLOCK;
+        ret = wh_Server_DmaProcessClientAddress(server, inAddr + done, &in,
+            blockSz, WH_DMA_OPER_CLIENT_READ_PRE, (whServerDmaFlags){0});
+        if (ret == 0) {
+            ret = wh_Server_DmaProcessClientAddress(server, outAddr + done,
+                &out, blockSz, WH_DMA_OPER_CLIENT_WRITE_PRE,
+                (whServerDmaFlags){0});
+            if (ret == 0) {
+                /* the next iv is the last ciphertext block, which in place
+                 * decryption would overwrite */
+                if (cbc && !enc) {
+                    XMEMCPY(iv, (uint8_t*)in + blockSz - AES_BLOCK_SIZE,
+                        AES_BLOCK_SIZE);
+                }
+                if (cbc && enc)
+                    ret = wc_AesCbcEncrypt(aes, out, in, blockSz);
+                else if (cbc)
+                    ret = wc_AesCbcDecrypt(aes, out, in, blockSz);
+                else if (enc)
+                    ret = wc_AesEcbEncrypt(aes, out, in, blockSz);
+                else
+                    ret = wc_AesEcbDecrypt(aes, out, in, blockSz);
+                if (ret == 0 && cbc && enc) {
+                    XMEMCPY(iv, (uint8_t*)out + blockSz - AES_BLOCK_SIZE,
+                        AES_BLOCK_SIZE);
+                }
+                ret2 = wh_Server_DmaProcessClientAddress(server, outAddr + done,
+                    &out, blockSz, WH_DMA_OPER_CLIENT_WRITE_POST,
+                    (whServerDmaFlags){0});
+                if (ret == 0)
+                    ret = ret2;
+            }
+            ret2 = wh_Server_DmaProcessClientAddress(server, inAddr + done, &in,
+                blockSz, WH_DMA_OPER_CLIENT_READ_POST, (whServerDmaFlags){0});
+            if (ret == 0)
+                ret = ret2;
+        }
+        if (ret == 0)
+            done += blockSz;
+    }
+    wc_AesFree(aes);
+    if (ret == 0) {
+        packet->sheCipherDmaRes.sz = sz;
+        XMEMCPY(packet->sheCipherDmaRes.iv, iv, sizeof(iv));
+        *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->sheCipherDmaRes);
+    }
+    return ret;
+}
+
 static int hsmSheGenerateMac(whServerContext* server, whPacket* packet,
     uint16_t* size)
 {
@@ -1074,6 +1378,7 @@ int wh_Server_HandleSheRequest(whServerContext* server,
     if ((server->she->sbState != WOLFHSM_SHE_SB_SUCCESS &&
         (action != WH_SHE_SECURE_BOOT_INIT &&
         action != WH_SHE_SECURE_BOOT_UPDATE &&
+        action != WH_SHE_SECURE_BOOT_DMA &&
         action != WH_SHE_SECURE_BOOT_FINISH &&
         action != WH_SHE_GET_STATUS &&
         action != WH_SHE_SET_UID)) ||
@@ -1094,6 +1399,9 @@ int wh_Server_HandleSheRequest(whServerContext* server,
     case WH_SHE_SECURE_BOOT_UPDATE:
         ret = hsmSheSecureBootUpdate(server, packet, size);
         break;
+    case WH_SHE_SECURE_BOOT_DMA:
+        ret = hsmSheSecureBootDma(server, packet, size);
+        break;
     case WH_SHE_SECURE_BOOT_FINISH:
         ret = hsmSheSecureBootFinish(server, packet, size);
         break;
@@ -1103,6 +1411,9 @@ int wh_Server_HandleSheRequest(whServerContext* server,
     case WH_SHE_LOAD_KEY:
         ret = hsmSheLoadKey(server, packet, size);
         break;
+    case WH_SHE_LOAD_KEY_BATCH:
+        ret = hsmSheLoadKeyBatch(server, packet, size);
+        break;
     case WH_SHE_LOAD_PLAIN_KEY:
         ret = hsmSheLoadPlainKey(server, packet, size);
         break;
@@ -1130,6 +1441,18 @@ int wh_Server_HandleSheRequest(whServerContext* server,
     case WH_SHE_DEC_CBC:
         ret = hsmSheDecCbc(server, packet, size);
         break;
+    case WH_SHE_ENC_ECB_DMA:
+        ret = hsmSheCipherDma(server, packet, size, 1, 0);
+        break;
+    case WH_SHE_ENC_CBC_DMA:
+        ret = hsmSheCipherDma(server, packet, size, 1, 1);
+        break;
+    case WH_SHE_DEC_ECB_DMA:
+        ret = hsmSheCipherDma(server, packet, size, 0, 0);
+        break;
+    case WH_SHE_DEC_CBC_DMA:
+        ret = hsmSheCipherDma(server, packet, size, 0, 1);
+        break;
     case WH_SHE_GEN_MAC:
         ret = hsmSheGenerateMac(server, packet, size);
         break;
@@ -1142,14 +1465,7 @@ int wh_Server_HandleSheRequest(whServerContext* server,
     }
     /* if a handler didn't set a specific error, set general error */
     if (ret != 0) {
-        if (ret != WH_SHE_ERC_SEQUENCE_ERROR &&
-        ret != WH_SHE_ERC_KEY_NOT_AVAILABLE && ret != WH_SHE_ERC_KEY_INVALID &&
-        ret != WH_SHE_ERC_KEY_EMPTY && ret != WH_SHE_ERC_NO_SECURE_BOOT &&
-        ret != WH_SHE_ERC_WRITE_PROTECTED && ret != WH_SHE_ERC_KEY_UPDATE_ERROR
-        && ret != WH_SHE_ERC_RNG_SEED && ret != WH_SHE_ERC_NO_DEBUGGING &&
-        ret != WH_SHE_ERC_BUSY && ret != WH_SHE_ERC_MEMORY_FAILURE) {
-            ret = WH_SHE_ERC_GENERAL_ERROR;
-        }
+        ret = hsmSheErc(ret);
         packet->rc = ret;
         *size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->rc);
     }
@@ -1157,6 +1473,7 @@ int wh_Server_HandleSheRequest(whServerContext* server,
     /* TODO is it safe to call wc_InitCmac over and over or do we need to call final first? */
     if ((action == WH_SHE_SECURE_BOOT_INIT ||
         action == WH_SHE_SECURE_BOOT_UPDATE ||
+        action == WH_SHE_SECURE_BOOT_DMA ||
         action == WH_SHE_SECURE_BOOT_FINISH) && ret != 0 &&
         ret != WH_SHE_ERC_NO_SECURE_BOOT) {
         server->she->sbState = WOLFHSM_SHE_SB_INIT;
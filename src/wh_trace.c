@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_trace.c
+ *
+ * Ring buffer of trace probes
+ */
+
+#ifdef WOLFHSM_TRACE
+
+#include <stdint.h>
+#include <stddef.h>     /* For NULL */
+#include <string.h>     /* For memset */
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_trace.h"
+
+static struct {
+    whTraceEntry    entries[WH_TRACE_COUNT];
+    whTraceConfig   config;
+    uint32_t        head;   /* Entries recorded */
+    uint32_t        tail;   /* Entries read or overwritten */
+    uint32_t        lost;   /* Entries overwritten before they were read */
+    uint8_t         padding[4];
+} whTrace;
+
+int wh_Trace_Init(const whTraceConfig* config)
+{
+    memset(&whTrace, 0, sizeof(whTrace));
+    if (config != NULL) {
+        whTrace.config = *config;
+    }
+    return 0;
+}
+
+void wh_Trace_Record(uint16_t event, uint16_t arg16, uint32_t arg)
+{
+    whTraceEntry* entry = &whTrace.entries[whTrace.head % WH_TRACE_COUNT];
+
+#if defined(WH_TRACE_TIMESTAMP)
+    entry->time = WH_TRACE_TIMESTAMP();
+#else
+    entry->time = (whTrace.config.time_cb != NULL) ?
+            whTrace.config.time_cb(whTrace.config.context) : 0;
+#endif
+    entry->arg = arg;
+    entry->event = event;
+    entry->arg16 = arg16;
+
+    whTrace.head++;
+    if (whTrace.head - whTrace.tail > WH_TRACE_COUNT) {
+        whTrace.tail++;
+        whTrace.lost++;
+    }
+    if (whTrace.config.stream_cb != NULL) {
+        whTrace.config.stream_cb(whTrace.config.context, entry);
+    }
+}
+
+int wh_Trace_Read(whTraceEntry* out, uint32_t* inout_count,
+        uint32_t* out_lost)
+{
+    uint32_t count = 0;
+
+    if ((inout_count == NULL) || ((out == NULL) && (*inout_count > 0))) {
+        return WH_ERROR_BADARGS;
+    }
+
+    while ((count < *inout_count) && (whTrace.tail != whTrace.head)) {
+        out[count++] = whTrace.entries[whTrace.tail % WH_TRACE_COUNT];
+        whTrace.tail++;
+    }
+    *inout_count = count;
+    if (out_lost != NULL) {
+        *out_lost = whTrace.lost;
+    }
+    whTrace.lost = 0;
+    return 0;
+}
+
+#endif /* WOLFHSM_TRACE */
@@ -30,6 +30,65 @@
 #include "wolfhsm/wh_comm.h"
 #include "wolfhsm/wh_transport_mem.h"
 
+/** Local declarations */
+
+/* Advertise that this side is about to sleep, then call the wait hook unless
+ * the peer notify has changed from peer_notify in the meantime */
+static void _TransportMem_Sleep(whTransportMemContext* context,
+        volatile whTransportMemCsr* own, volatile whTransportMemCsr* peer,
+        uint16_t peer_notify);
+
+/* Wake the peer with the notify hook if it has advertised that it is
+ * sleeping since the last time it was woken */
+static void _TransportMem_Wake(whTransportMemContext* context,
+        volatile whTransportMemCsr* own, volatile whTransportMemCsr* peer);
+
+
+/** Local implementations */
+static void _TransportMem_Sleep(whTransportMemContext* context,
+        volatile whTransportMemCsr* own, volatile whTransportMemCsr* peer,
+        uint16_t peer_notify)
+{
+    whTransportMemCsr csr;
+
+    if (context->wait_cb == NULL) {
+        return;
+    }
+
+    csr.u64 = own->u64;
+    csr.s.wait++;
+    own->u64 = csr.u64;
+
+    /* Recheck to avoid missing a notify that raced with the wait update */
+    csr.u64 = peer->u64;
+    if (csr.s.notify == peer_notify) {
+        (void)context->wait_cb(context->cb_arg);
+    }
+}
+
+static void _TransportMem_Wake(whTransportMemContext* context,
+        volatile whTransportMemCsr* own, volatile whTransportMemCsr* peer)
+{
+    whTransportMemCsr own_csr;
+    whTransportMemCsr peer_csr;
+
+    if (context->notify_cb == NULL) {
+        return;
+    }
+
+    /* Notify was already written, so a peer that starts waiting after this
+     * read will see it during its recheck */
+    peer_csr.u64 = peer->u64;
+    own_csr.u64 = own->u64;
+    if (peer_csr.s.wait != own_csr.s.ack) {
+        own_csr.s.ack = peer_csr.s.wait;
+        own->u64 = own_csr.u64;
+        (void)context->notify_cb(context->cb_arg);
+    }
+}
+
+
+/** Callback implementations */
 int wh_TransportMem_Init(void* c, const void* cf,
         whCommSetConnectedCb connectcb, void* connectcb_arg)
 {
@@ -56,6 +115,10 @@ int wh_TransportMem_Init(void* c, const void* cf,
     context->resp_size  = config->resp_size;
     context->resp_data  = (void*)(context->resp + 1);
 
+    context->notify_cb  = config->notify_cb;
+    context->wait_cb    = config->wait_cb;
+    context->cb_arg     = config->cb_arg;
+
     context->initialized = 1;
     return WH_ERROR_OK;
 }
@@ -106,7 +169,7 @@ int wh_TransportMem_SendRequest(void* c, uint16_t len, const void* data)
         return WH_ERROR_NOTREADY;
     }
 
-    if ((data != NULL) && (len != 0)) {
+    if ((data != NULL) && (len != 0) && (data != context->req_data)) {
         memcpy((void*)context->req_data, data, len);
     }
     req.s.len = len;
@@ -115,6 +178,7 @@ int wh_TransportMem_SendRequest(void* c, uint16_t len, const void* data)
     /* Write the new CSR's */
     context->req->u64 = req.u64;
 
+    _TransportMem_Wake(context, context->req, context->resp);
     return 0;
 }
 
@@ -135,10 +199,12 @@ int wh_TransportMem_RecvRequest(void* c, uint16_t *out_len, void* data)
 
     /* Check to see if a new request has arrived */
     if(req.s.notify == resp.s.notify) {
+        _TransportMem_Sleep(context, context->resp, context->req,
+                req.s.notify);
         return WH_ERROR_NOTREADY;
     }
 
-    if ((data != NULL) && (req.s.len != 0)) {
+    if ((data != NULL) && (req.s.len != 0) && (data != context->req_data)) {
         memcpy(data, context->req_data, req.s.len);
     }
     if (out_len != NULL) {
@@ -163,7 +229,7 @@ int wh_TransportMem_SendResponse(void* c, uint16_t len, const void* data)
     req.u64 = context->req->u64;
     resp.u64 = context->resp->u64;
 
-    if ((data != NULL) && (len != 0)) {
+    if ((data != NULL) && (len != 0) && (data != context->resp_data)) {
         memcpy(context->resp_data, data, len);
     }
     resp.s.len = len;
@@ -172,6 +238,7 @@ int wh_TransportMem_SendResponse(void* c, uint16_t len, const void* data)
     /* Write the new CSR's */
     context->resp->u64 = resp.u64;
 
+    _TransportMem_Wake(context, context->resp, context->req);
     return 0;
 }
 
@@ -192,10 +259,12 @@ int wh_TransportMem_RecvResponse(void* c, uint16_t *out_len, void* data)
 
     /* Check to see if the current response is the different than the request */
     if(resp.s.notify != req.s.notify) {
+        _TransportMem_Sleep(context, context->req, context->resp,
+                resp.s.notify);
         return WH_ERROR_NOTREADY;
     }
 
-    if ((data != NULL) && (resp.s.len != 0)) {
+    if ((data != NULL) && (resp.s.len != 0) && (data != context->resp_data)) {
         memcpy(data, context->resp_data, resp.s.len);
     }
 
@@ -205,3 +274,119 @@ int wh_TransportMem_RecvResponse(void* c, uint16_t *out_len, void* data)
 
     return 0;
 }
+
+int wh_TransportMem_AcquireSendRequest(void* c, uint16_t *out_len,
+        void** out_buffer)
+{
+    whTransportMemContext* context = c;
+    whTransportMemCsr req;
+    whTransportMemCsr resp;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0) ||
+            (out_len == NULL) ||
+            (out_buffer == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Read both CSR's */
+    req.u64 = context->req->u64;
+    resp.u64 = context->resp->u64;
+
+    /* Request buffer is in use until the server has completed */
+    if (req.s.notify != resp.s.notify) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    *out_len = context->req_size - sizeof(*context->req);
+    *out_buffer = context->req_data;
+    return 0;
+}
+
+int wh_TransportMem_AcquireRecvRequest(void* c, uint16_t *out_len,
+        void** out_buffer)
+{
+    whTransportMemContext* context = c;
+    whTransportMemCsr req;
+    whTransportMemCsr resp;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0) ||
+            (out_len == NULL) ||
+            (out_buffer == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Read both CSR's */
+    req.u64 = context->req->u64;
+    resp.u64 = context->resp->u64;
+
+    /* Check to see if a new request has arrived */
+    if (req.s.notify == resp.s.notify) {
+        _TransportMem_Sleep(context, context->resp, context->req,
+                req.s.notify);
+        return WH_ERROR_NOTREADY;
+    }
+
+    *out_len = req.s.len;
+    *out_buffer = context->req_data;
+    return 0;
+}
+
+int wh_TransportMem_AcquireSendResponse(void* c, uint16_t *out_len,
+        void** out_buffer)
+{
+    whTransportMemContext* context = c;
+    whTransportMemCsr req;
+    whTransportMemCsr resp;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0) ||
+            (out_len == NULL) ||
+            (out_buffer == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Read both CSR's */
+    req.u64 = context->req->u64;
+    resp.u64 = context->resp->u64;
+
+    /* Client may still be reading the response buffer without a request */
+    if (req.s.notify == resp.s.notify) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    *out_len = context->resp_size - sizeof(*context->resp);
+    *out_buffer = context->resp_data;
+    return 0;
+}
+
+int wh_TransportMem_AcquireRecvResponse(void* c, uint16_t *out_len,
+        void** out_buffer)
+{
+    whTransportMemContext* context = c;
+    whTransportMemCsr req;
+    whTransportMemCsr resp;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0) ||
+            (out_len == NULL) ||
+            (out_buffer == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Read both CSR's */
+    req.u64 = context->req->u64;
+    resp.u64 = context->resp->u64;
+
+    /* Check to see if the current response is the different than the request */
+    if (resp.s.notify != req.s.notify) {
+        _TransportMem_Sleep(context, context->req, context->resp,
+                resp.s.notify);
+        return WH_ERROR_NOTREADY;
+    }
+
+    *out_len = resp.s.len;
+    *out_buffer = context->resp_data;
+    return 0;
+}
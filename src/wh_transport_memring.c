@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * src/wh_transport_memring.c
+ *
+ * Implementation of transport callbacks using 2 memory blocks split into
+ * multiple request/response slots
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_transport_memring.h"
+
+/** Local declarations */
+
+/* Return the CSR at the start of the slot used for packet number count */
+static volatile whTransportMemCsr* _GetSlot(whTransportMemRingContext* context,
+        uint8_t* base, uint16_t count);
+
+/* Return the maximum data length of each slot */
+static uint16_t _GetSlotDataSize(whTransportMemRingContext* context);
+
+/* Common helpers to write/read a packet to/from the next slot */
+static int _SendSlot(whTransportMemRingContext* context, uint8_t* base,
+        uint16_t len, const void* data);
+static int _RecvSlot(whTransportMemRingContext* context, uint8_t* base,
+        uint16_t *out_len, void* data);
+
+
+/** Local implementations */
+static volatile whTransportMemCsr* _GetSlot(whTransportMemRingContext* context,
+        uint8_t* base, uint16_t count)
+{
+    uint16_t index = count % context->slot_count;
+    return (volatile whTransportMemCsr*)(base +
+            (uint32_t)index * context->slot_size);
+}
+
+static uint16_t _GetSlotDataSize(whTransportMemRingContext* context)
+{
+    return context->slot_size - sizeof(whTransportMemCsr);
+}
+
+static int _SendSlot(whTransportMemRingContext* context, uint8_t* base,
+        uint16_t len, const void* data)
+{
+    volatile whTransportMemCsr* slot = _GetSlot(context, base, context->sent);
+    whTransportMemCsr csr;
+
+    if (len > _GetSlotDataSize(context)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    if ((data != NULL) && (len != 0)) {
+        memcpy((void*)(slot + 1), data, len);
+    }
+
+    csr.u64 = slot->u64;
+    csr.s.len = len;
+    csr.s.notify = context->sent + 1;
+
+    /* Write the new CSR to mark the slot as filled */
+    slot->u64 = csr.u64;
+    context->sent++;
+
+    return 0;
+}
+
+static int _RecvSlot(whTransportMemRingContext* context, uint8_t* base,
+        uint16_t *out_len, void* data)
+{
+    volatile whTransportMemCsr* slot = _GetSlot(context, base,
+            context->received);
+    whTransportMemCsr csr;
+
+    /* Read the current slot CSR */
+    csr.u64 = slot->u64;
+
+    /* Check to see if the next packet has arrived */
+    if (csr.s.notify != (uint16_t)(context->received + 1)) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    if (csr.s.len > _GetSlotDataSize(context)) {
+        return WH_ERROR_ABORTED;
+    }
+
+    if ((data != NULL) && (csr.s.len != 0)) {
+        memcpy(data, (void*)(slot + 1), csr.s.len);
+    }
+    if (out_len != NULL) {
+        *out_len = csr.s.len;
+    }
+    context->received++;
+
+    return 0;
+}
+
+
+/** Callback implementations */
+int wh_TransportMemRing_Init(void* c, const void* cf,
+        whCommSetConnectedCb connectcb, void* connectcb_arg)
+{
+    (void)connectcb; (void)connectcb_arg; /* Not used */
+
+    whTransportMemRingContext* context = c;
+    const whTransportMemRingConfig* config = cf;
+    uint16_t size = 0;
+    uint16_t slot_size = 0;
+
+    if (    (context == NULL) ||
+            (config == NULL) ||
+            (config->req == NULL) ||
+            (config->req_size == 0) ||
+            (config->resp == NULL) ||
+            (config->resp_size == 0) ||
+            (config->slot_count == 0) ||
+            ((config->slot_count & (config->slot_count - 1)) != 0)) {
+        /* The 16 bit packet counts wrap, so n % slot_count only keeps
+         * counting through the slots in order for a power of 2 */
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Slots are the same size in both buffers and aligned to the CSR size */
+    size = (config->req_size < config->resp_size) ?
+            config->req_size : config->resp_size;
+    slot_size = size / config->slot_count;
+    slot_size -= slot_size % sizeof(whTransportMemCsr);
+    if (slot_size <= sizeof(whTransportMemCsr)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    memset(context, 0, sizeof(*context));
+    context->req        = (uint8_t*)config->req;
+    context->resp       = (uint8_t*)config->resp;
+    context->slot_count = config->slot_count;
+    context->slot_size  = slot_size;
+
+    context->initialized = 1;
+    return WH_ERROR_OK;
+}
+
+int wh_TransportMemRing_InitClear(void* c, const void* cf,
+        whCommSetConnectedCb connectcb, void* connectcb_arg)
+{
+    whTransportMemRingContext* context = c;
+    uint32_t ring_size = 0;
+
+    int rc = wh_TransportMemRing_Init(c, cf, connectcb, connectcb_arg);
+    if (rc == WH_ERROR_OK) {
+        /* Zero the slots */
+        ring_size = (uint32_t)context->slot_count * context->slot_size;
+        memset(context->req, 0, ring_size);
+        memset(context->resp, 0, ring_size);
+    }
+    return rc;
+}
+
+int wh_TransportMemRing_Cleanup(void* c)
+{
+    whTransportMemRingContext* context = c;
+    if (context == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    context->initialized = 0;
+
+    return 0;
+}
+
+int wh_TransportMemRing_SendRequest(void* c, uint16_t len, const void* data)
+{
+    whTransportMemRingContext* context = c;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* All slots are in flight.  Wait for a response */
+    if ((uint16_t)(context->sent - context->received) >= context->slot_count) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    return _SendSlot(context, context->req, len, data);
+}
+
+int wh_TransportMemRing_RecvRequest(void* c, uint16_t *out_len, void* data)
+{
+    whTransportMemRingContext* context = c;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    return _RecvSlot(context, context->req, out_len, data);
+}
+
+int wh_TransportMemRing_SendResponse(void* c, uint16_t len, const void* data)
+{
+    whTransportMemRingContext* context = c;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* No outstanding request to respond to */
+    if (context->sent == context->received) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    return _SendSlot(context, context->resp, len, data);
+}
+
+int wh_TransportMemRing_RecvResponse(void* c, uint16_t *out_len, void* data)
+{
+    whTransportMemRingContext* context = c;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* No request in flight */
+    if (context->sent == context->received) {
+        return WH_ERROR_NOTREADY;
+    }
+
+    return _RecvSlot(context, context->resp, out_len, data);
+}
+
+int wh_TransportMemRing_GetPending(void* c, uint16_t *out_pending)
+{
+    whTransportMemRingContext* context = c;
+
+    if (    (context == NULL) ||
+            (context->initialized == 0) ||
+            (out_pending == NULL)) {
+        return WH_ERROR_BADARGS;
+    }
+
+    /* Exactly one of these differences is non-negative for either side */
+    if ((uint16_t)(context->sent - context->received) <= context->slot_count) {
+        *out_pending = context->sent - context->received;
+    } else {
+        *out_pending = context->received - context->sent;
+    }
+    return 0;
+}
@@ -88,6 +88,9 @@ extern "C" {
 /** Curve25519 Options */
 #define HAVE_CURVE25519
 
+/** Ed25519 Options */
+#define HAVE_ED25519
+
 /** DH and DHE Options */
 #define NO_DH
 #define HAVE_DH_DEFAULT_PARAMS
@@ -96,6 +99,7 @@ extern "C" {
 /** AES Options */
 #define HAVE_AES
 #define HAVE_AESGCM
+#define WOLFSSL_AESGCM_STREAM
 #define GCM_TABLE_4BIT
 #define WOLFSSL_AES_DIRECT
 #define HAVE_AES_ECB
@@ -105,7 +109,7 @@ extern "C" {
 #define NO_SHA
 /* #define NO_SHA256 */
 /* #define WOLFSSL_SHA384 */
-/* #define WOLFSSL_SHA512 */
+#define WOLFSSL_SHA512 /* Required by Ed25519 */
 
 /** Composite features */
 #define HAVE_HKDF
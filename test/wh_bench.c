@@ -0,0 +1,796 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * test/wh_bench.c
+ *
+ * Client/server benchmarks.  A server thread is run over each transport and a
+ * client thread times echo, NVM, key cache, wolfCrypt and SHE requests.
+ */
+
+#include <stdint.h>
+#include <stdio.h>  /* For printf */
+#include <stdlib.h> /* For qsort */
+#include <string.h> /* For memset, memcpy */
+
+#if defined(WH_CONFIG)
+#include "wh_config.h"
+#endif
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_nvm_flash.h"
+#include "wolfhsm/wh_flash_ramsim.h"
+#include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_comm.h"
+#include "wolfhsm/wh_message_nvm.h"
+#include "wolfhsm/wh_client.h"
+
+#ifndef WOLFHSM_NO_CRYPTO
+#include "wolfssl/wolfcrypt/settings.h"
+#include "wolfssl/wolfcrypt/random.h"
+#include "wolfssl/wolfcrypt/aes.h"
+#include "wolfssl/wolfcrypt/rsa.h"
+#include "wolfssl/wolfcrypt/ecc.h"
+#include "wolfssl/wolfcrypt/curve25519.h"
+#endif
+
+#ifdef WOLFHSM_SHE_EXTENSION
+#include "wolfhsm/wh_client_she.h"
+#endif
+
+#include "wh_bench.h"
+
+#if defined(WH_CFG_TEST_POSIX)
+#include <time.h>    /* For clock_gettime */
+#include <pthread.h> /* For pthread_create/cancel/join/_t */
+#include <sched.h>   /* For sched_yield */
+#include "port/posix/posix_transport_tcp.h"
+
+#define WH_BENCH_BUFFER_SIZE 4096
+#define WH_BENCH_FLASH_SIZE (1024 * 1024)
+#define WH_BENCH_TCP_PORT 23460
+
+/* Largest echo payload, filling a comm packet */
+#define WH_BENCH_ECHO_MAX (WH_COMM_DATA_LEN - sizeof(uint16_t))
+
+/* NVM object used by the NVM benchmarks */
+#define WH_BENCH_NVM_ID 0x42
+
+uint64_t whBench_NowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void whBench_Init(whBenchResult* r, const char* name, uint32_t size)
+{
+    memset(r, 0, sizeof(*r));
+    r->name = name;
+    r->size = size;
+}
+
+void whBench_Sample(whBenchResult* r, uint64_t start_ns)
+{
+    uint64_t elapsed = whBench_NowNs() - start_ns;
+    if (r->count < WH_BENCH_ITERATIONS) {
+        r->sample_ns[r->count++] = elapsed;
+        r->total_ns += elapsed;
+    }
+}
+
+static int _cmpU64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+void whBench_PrintHeader(const char* title)
+{
+    printf("\n== %s ==\n", title);
+    printf("%-32s %8s %12s %10s %10s\n", "benchmark", "bytes", "ops/s",
+            "p50 us", "p99 us");
+}
+
+void whBench_Print(const whBenchResult* r)
+{
+    uint64_t sorted[WH_BENCH_ITERATIONS];
+    double ops = 0;
+
+    if (r->count == 0) {
+        printf("%-32s %8u %12s\n", r->name, (unsigned)r->size, "-");
+        return;
+    }
+    memcpy(sorted, r->sample_ns, r->count * sizeof(sorted[0]));
+    qsort(sorted, r->count, sizeof(sorted[0]), _cmpU64);
+    if (r->total_ns > 0) {
+        ops = (double)r->count * 1e9 / (double)r->total_ns;
+    }
+    printf("%-32s %8u %12.1f %10.1f %10.1f\n", r->name, (unsigned)r->size, ops,
+            (double)sorted[(r->count - 1) * 50 / 100] / 1000.0,
+            (double)sorted[(r->count - 1) * 99 / 100] / 1000.0);
+}
+
+
+/** Client benchmarks */
+
+static uint8_t bench_in[WH_BENCH_BUFFER_SIZE];
+static uint8_t bench_out[WH_BENCH_BUFFER_SIZE];
+
+static int _benchEcho(whClientContext* client)
+{
+    static const uint16_t sizes[] = {16, 64, 256, 1024, WH_BENCH_ECHO_MAX};
+    whBenchResult r[1];
+    uint64_t start;
+    uint16_t rlen;
+    size_t s;
+    int i;
+    int rc = 0;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; s++) {
+        whBench_Init(r, "echo", sizes[s]);
+        for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+            start = whBench_NowNs();
+            rc = wh_Client_Echo(client, sizes[s], bench_in, &rlen, bench_out);
+            if (rc == 0 && rlen != sizes[s]) {
+                rc = WH_ERROR_ABORTED;
+            }
+            if (rc == 0) {
+                whBench_Sample(r, start);
+            }
+        }
+        whBench_Print(r);
+    }
+    return rc;
+}
+
+static int _benchNvm(whClientContext* client)
+{
+    static const whNvmSize sizes[] = {64, 1024};
+    static const whNvmId id = WH_BENCH_NVM_ID;
+    uint8_t label[] = "bench";
+    whBenchResult add[1];
+    whBenchResult read[1];
+    whBenchResult destroy[1];
+    uint64_t start;
+    int32_t server_rc = 0;
+    whNvmSize rlen;
+    size_t s;
+    int i;
+    int rc = 0;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; s++) {
+        whBench_Init(add, "nvm add", sizes[s]);
+        whBench_Init(read, "nvm read", sizes[s]);
+        whBench_Init(destroy, "nvm destroy", sizes[s]);
+        for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+            start = whBench_NowNs();
+            rc = wh_Client_NvmAddObject(client, id, WOLFHSM_NVM_ACCESS_ANY,
+                    WOLFHSM_NVM_FLAGS_NONE, sizeof(label), label, sizes[s],
+                    bench_in, &server_rc);
+            if (rc == 0 && (rc = server_rc) == 0) {
+                whBench_Sample(add, start);
+                start = whBench_NowNs();
+                rc = wh_Client_NvmRead(client, id, 0, sizes[s], &server_rc,
+                        &rlen, bench_out);
+            }
+            if (rc == 0 && (rc = server_rc) == 0) {
+                whBench_Sample(read, start);
+                start = whBench_NowNs();
+                rc = wh_Client_NvmDestroyObjects(client, 1, &id, 0, NULL,
+                        &server_rc);
+            }
+            if (rc == 0 && (rc = server_rc) == 0) {
+                whBench_Sample(destroy, start);
+            }
+        }
+        whBench_Print(add);
+        whBench_Print(read);
+        whBench_Print(destroy);
+    }
+    return rc;
+}
+
+#ifndef WOLFHSM_NO_CRYPTO
+static int _benchKeyCache(whClientContext* client)
+{
+    static const uint32_t sizes[] = {16, 256};
+    uint8_t label[] = "bench";
+    whBenchResult cache[1];
+    whBenchResult evict[1];
+    uint64_t start;
+    uint16_t keyId;
+    size_t s;
+    int i;
+    int rc = 0;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; s++) {
+        whBench_Init(cache, "key cache", sizes[s]);
+        whBench_Init(evict, "key evict", sizes[s]);
+        for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+            keyId = WOLFHSM_KEYID_ERASED;
+            start = whBench_NowNs();
+            rc = wh_Client_KeyCache(client, 0, label, sizeof(label), bench_in,
+                    sizes[s], &keyId);
+            if (rc == 0) {
+                whBench_Sample(cache, start);
+                start = whBench_NowNs();
+                rc = wh_Client_KeyEvict(client, keyId);
+            }
+            if (rc == 0) {
+                whBench_Sample(evict, start);
+            }
+        }
+        whBench_Print(cache);
+        whBench_Print(evict);
+    }
+    return rc;
+}
+
+static int _benchAes(whClientContext* client)
+{
+    static const uint32_t sizes[] = {16, 256, 1024};
+    uint8_t key[AES_BLOCK_SIZE] = {0};
+    uint8_t iv[AES_BLOCK_SIZE] = {0};
+    uint8_t authIn[16] = {0};
+    uint8_t authTag[16];
+    whBenchResult r[1];
+    Aes aes[1];
+    uint64_t start;
+    size_t s;
+    int i;
+    int rc;
+
+    (void)client;
+    rc = wc_AesInit(aes, NULL, WOLFHSM_DEV_ID);
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; s++) {
+        whBench_Init(r, "aes-cbc encrypt", sizes[s]);
+        rc = wc_AesSetKey(aes, key, sizeof(key), iv, AES_ENCRYPTION);
+        for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+            start = whBench_NowNs();
+            rc = wc_AesCbcEncrypt(aes, bench_out, bench_in, sizes[s]);
+            if (rc == 0) {
+                whBench_Sample(r, start);
+            }
+        }
+        whBench_Print(r);
+    }
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; s++) {
+        whBench_Init(r, "aes-gcm encrypt", sizes[s]);
+        rc = wc_AesSetKey(aes, key, sizeof(key), iv, AES_ENCRYPTION);
+        for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+            start = whBench_NowNs();
+            rc = wc_AesGcmEncrypt(aes, bench_out, bench_in, sizes[s], iv,
+                    sizeof(iv), authTag, sizeof(authTag), authIn,
+                    sizeof(authIn));
+            if (rc == 0) {
+                whBench_Sample(r, start);
+            }
+        }
+        whBench_Print(r);
+    }
+    wc_AesFree(aes);
+    return rc;
+}
+
+static int _benchEcc(whClientContext* client, WC_RNG* rng)
+{
+    uint8_t sig[ECC_MAX_SIG_SIZE];
+    word32 sigLen = 0;
+    int res = 0;
+    whBenchResult sign[1];
+    whBenchResult verify[1];
+    ecc_key key[1];
+    uint64_t start;
+    int i;
+    int rc;
+
+    (void)client;
+    whBench_Init(sign, "ecdsa p256 sign", 32);
+    whBench_Init(verify, "ecdsa p256 verify", 32);
+    rc = wc_ecc_init_ex(key, NULL, WOLFHSM_DEV_ID);
+    if (rc == 0) {
+        rc = wc_ecc_make_key(rng, 32, key);
+    }
+    for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+        sigLen = sizeof(sig);
+        start = whBench_NowNs();
+        rc = wc_ecc_sign_hash(bench_in, 32, sig, &sigLen, rng, key);
+        if (rc == 0) {
+            whBench_Sample(sign, start);
+            start = whBench_NowNs();
+            rc = wc_ecc_verify_hash(sig, sigLen, bench_in, 32, &res, key);
+        }
+        if (rc == 0 && res != 1) {
+            rc = WH_ERROR_ABORTED;
+        }
+        if (rc == 0) {
+            whBench_Sample(verify, start);
+        }
+    }
+    wc_ecc_free(key);
+    whBench_Print(sign);
+    whBench_Print(verify);
+    return rc;
+}
+
+static int _benchRsa(whClientContext* client, WC_RNG* rng)
+{
+    uint8_t cipher[256];
+    whBenchResult enc[1];
+    whBenchResult dec[1];
+    RsaKey key[1];
+    uint64_t start;
+    int i;
+    int rc;
+
+    (void)client;
+    whBench_Init(enc, "rsa 2048 public encrypt", 32);
+    whBench_Init(dec, "rsa 2048 private decrypt", 32);
+    rc = wc_InitRsaKey_ex(key, NULL, WOLFHSM_DEV_ID);
+    if (rc == 0) {
+        rc = wc_MakeRsaKey(key, 2048, 65537, rng);
+    }
+    for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+        start = whBench_NowNs();
+        rc = wc_RsaPublicEncrypt(bench_in, 32, cipher, sizeof(cipher), key,
+                rng);
+        if (rc >= 0) {
+            whBench_Sample(enc, start);
+            start = whBench_NowNs();
+            rc = wc_RsaPrivateDecrypt(cipher, rc, bench_out, sizeof(cipher),
+                    key);
+        }
+        if (rc >= 0) {
+            whBench_Sample(dec, start);
+            rc = 0;
+        }
+    }
+    wc_FreeRsaKey(key);
+    whBench_Print(enc);
+    whBench_Print(dec);
+    return rc;
+}
+
+static int _benchCurve25519(whClientContext* client, WC_RNG* rng)
+{
+    uint8_t shared[CURVE25519_KEYSIZE];
+    word32 sharedLen;
+    whBenchResult r[1];
+    curve25519_key priv[1];
+    curve25519_key pub[1];
+    uint64_t start;
+    int i;
+    int rc;
+
+    (void)client;
+    whBench_Init(r, "curve25519 shared secret", CURVE25519_KEYSIZE);
+    rc = wc_curve25519_init_ex(priv, NULL, WOLFHSM_DEV_ID);
+    if (rc == 0) {
+        rc = wc_curve25519_init_ex(pub, NULL, WOLFHSM_DEV_ID);
+    }
+    if (rc == 0) {
+        rc = wc_curve25519_make_key(rng, CURVE25519_KEYSIZE, priv);
+    }
+    if (rc == 0) {
+        rc = wc_curve25519_make_key(rng, CURVE25519_KEYSIZE, pub);
+    }
+    for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+        sharedLen = sizeof(shared);
+        start = whBench_NowNs();
+        rc = wc_curve25519_shared_secret(priv, pub, shared, &sharedLen);
+        if (rc == 0) {
+            whBench_Sample(r, start);
+        }
+    }
+    wc_curve25519_free(priv);
+    wc_curve25519_free(pub);
+    whBench_Print(r);
+    return rc;
+}
+#endif /* !WOLFHSM_NO_CRYPTO */
+
+#ifdef WOLFHSM_SHE_EXTENSION
+static int _benchShe(whClientContext* client)
+{
+    static const uint32_t sizes[] = {16, 256, 1024};
+    uint8_t uid[WOLFHSM_SHE_UID_SZ] = {0};
+    uint8_t key[WOLFHSM_SHE_KEY_SZ] = {0};
+    uint8_t iv[WOLFHSM_SHE_KEY_SZ] = {0};
+    uint8_t mac[WOLFHSM_SHE_KEY_SZ];
+    whBenchResult ecb[1];
+    whBenchResult cbc[1];
+    whBenchResult cmac[1];
+    whBenchResult dma[1];
+    uint64_t start;
+    size_t s;
+    int i;
+    int rc;
+
+    uid[WOLFHSM_SHE_UID_SZ - 1] = 1;
+    rc = wh_Client_SheSetUid(client, uid, sizeof(uid));
+    /* no boot MAC key is programmed, so secure boot is skipped */
+    if (rc == 0) {
+        rc = wh_Client_SheSecureBoot(client, bench_in, 16);
+        if (rc == WH_SHE_ERC_NO_SECURE_BOOT) {
+            rc = 0;
+        }
+    }
+    if (rc == 0) {
+        rc = wh_Client_SheLoadPlainKey(client, key, sizeof(key));
+    }
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; s++) {
+        whBench_Init(ecb, "she ecb encrypt", sizes[s]);
+        whBench_Init(cbc, "she cbc encrypt", sizes[s]);
+        whBench_Init(cmac, "she cmac generate", sizes[s]);
+        for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+            start = whBench_NowNs();
+            rc = wh_Client_SheEncEcb(client, WOLFHSM_SHE_RAM_KEY_ID, bench_in,
+                    bench_out, sizes[s]);
+            if (rc == 0) {
+                whBench_Sample(ecb, start);
+                start = whBench_NowNs();
+                rc = wh_Client_SheEncCbc(client, WOLFHSM_SHE_RAM_KEY_ID, iv,
+                        sizeof(iv), bench_in, bench_out, sizes[s]);
+            }
+            if (rc == 0) {
+                whBench_Sample(cbc, start);
+                start = whBench_NowNs();
+                rc = wh_Client_SheGenerateMac(client, WOLFHSM_SHE_RAM_KEY_ID,
+                        bench_in, sizes[s], mac, sizeof(mac));
+            }
+            if (rc == 0) {
+                whBench_Sample(cmac, start);
+            }
+        }
+        whBench_Print(ecb);
+        whBench_Print(cbc);
+        whBench_Print(cmac);
+    }
+    whBench_Init(dma, "she cbc encrypt dma", sizeof(bench_in));
+    for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+        memset(iv, 0, sizeof(iv));
+        start = whBench_NowNs();
+        rc = wh_Client_SheEncCbcDma(client, WOLFHSM_SHE_RAM_KEY_ID, iv,
+                sizeof(iv), bench_in, bench_out, sizeof(bench_in));
+        if (rc == 0) {
+            whBench_Sample(dma, start);
+        }
+    }
+    whBench_Print(dma);
+    return rc;
+}
+#endif /* WOLFHSM_SHE_EXTENSION */
+
+static int _whBench_ClientCfg(whClientConfig* config)
+{
+    whClientContext client[1] = {0};
+    uint32_t client_id = 0;
+    uint32_t server_id = 0;
+    int rc;
+#ifndef WOLFHSM_NO_CRYPTO
+    WC_RNG rng[1];
+    int rngInited = 0;
+#endif
+
+    rc = wh_Client_Init(client, config);
+    if (rc == 0) {
+        rc = wh_Client_CommInit(client, &client_id, &server_id);
+    }
+    if (rc == 0) {
+        memset(bench_in, 0xA5, sizeof(bench_in));
+        rc = _benchEcho(client);
+    }
+    if (rc == 0) {
+        rc = _benchNvm(client);
+    }
+#ifndef WOLFHSM_NO_CRYPTO
+    if (rc == 0) {
+        rc = wc_InitRng_ex(rng, NULL, WOLFHSM_DEV_ID);
+        rngInited = (rc == 0);
+    }
+    if (rc == 0) {
+        rc = _benchKeyCache(client);
+    }
+    if (rc == 0) {
+        rc = _benchAes(client);
+    }
+    if (rc == 0) {
+        rc = _benchEcc(client, rng);
+    }
+    if (rc == 0) {
+        rc = _benchRsa(client, rng);
+    }
+    if (rc == 0) {
+        rc = _benchCurve25519(client, rng);
+    }
+    if (rngInited) {
+        wc_FreeRng(rng);
+    }
+#endif
+#ifdef WOLFHSM_SHE_EXTENSION
+    if (rc == 0) {
+        rc = _benchShe(client);
+    }
+#endif
+    if (rc != 0) {
+        printf("Benchmark failed: %d\n", rc);
+    }
+    (void)wh_Client_CommClose(client);
+    (void)wh_Client_Cleanup(client);
+    return rc;
+}
+
+static int _whBench_ServerCfgLoop(whServerConfig* config)
+{
+    whServerContext server[1] = {0};
+    whCommConnected am_connected = WH_COMM_CONNECTED;
+    int rc;
+
+    rc = wh_Server_Init(server, config);
+    if (rc == 0) {
+        rc = wh_Server_SetConnected(server, am_connected);
+    }
+    while (rc == 0 && am_connected == WH_COMM_CONNECTED) {
+        rc = wh_Server_HandleRequestMessage(server);
+        if (rc == WH_ERROR_NOTREADY) {
+            rc = 0;
+        }
+        wh_Server_GetConnected(server, &am_connected);
+    }
+    (void)wh_Server_Cleanup(server);
+    return rc;
+}
+
+static void* _whBenchClientTask(void* cf)
+{
+    static int rc;
+    rc = _whBench_ClientCfg(cf);
+    return &rc;
+}
+
+static void* _whBenchServerTask(void* cf)
+{
+    (void)_whBench_ServerCfgLoop(cf);
+    return NULL;
+}
+
+/* Run the client benchmarks against a server on the given comm configs */
+static int _whBench_Run(const char* title, whCommClientConfig* cc_conf,
+        whCommServerConfig* cs_conf)
+{
+    pthread_t cthread;
+    pthread_t sthread;
+    void* retval = NULL;
+    int rc;
+
+    whClientConfig c_conf[1] = {{
+        .comm = cc_conf,
+    }};
+
+    /* RamSim Flash state and configuration */
+    whFlashRamsimCtx fc[1] = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = WH_BENCH_FLASH_SIZE,
+        .sectorSize = WH_BENCH_FLASH_SIZE / 2,
+        .pageSize   = 8,
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb fcb[1] = {WH_FLASH_RAMSIM_CB};
+
+    /* NVM Flash Configuration using RamSim HAL Flash */
+    whNvmFlashConfig nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1] = {0};
+    whNvmCb nfcb[1] = {WH_NVM_FLASH_CB};
+    whNvmConfig n_conf[1] = {{
+        .cb      = nfcb,
+        .context = nfc,
+        .config  = nf_conf,
+    }};
+    whNvmContext nvm[1] = {{0}};
+
+#ifndef WOLFHSM_NO_CRYPTO
+    crypto_context crypto[1] = {{
+        .devId = INVALID_DEVID,
+    }};
+#endif
+#ifdef WOLFHSM_SHE_EXTENSION
+    she_context she[1];
+#endif
+
+    whServerConfig s_conf[1] = {{
+        .comm_config = cs_conf,
+        .nvm         = nvm,
+#ifndef WOLFHSM_NO_CRYPTO
+        .crypto      = crypto,
+        .devId       = INVALID_DEVID,
+#endif
+#ifdef WOLFHSM_SHE_EXTENSION
+        .she         = she,
+#endif
+    }};
+
+#ifdef WOLFHSM_SHE_EXTENSION
+    memset(she, 0, sizeof(she));
+#endif
+
+    whBench_PrintHeader(title);
+
+    rc = wh_Nvm_Init(nvm, n_conf);
+#ifndef WOLFHSM_NO_CRYPTO
+    if (rc == 0) {
+        rc = wc_InitRng_ex(crypto->rng, NULL, crypto->devId);
+    }
+#endif
+    if (rc == 0) {
+        rc = pthread_create(&sthread, NULL, _whBenchServerTask, s_conf);
+        if (rc == 0) {
+            rc = pthread_create(&cthread, NULL, _whBenchClientTask, c_conf);
+            if (rc == 0) {
+                pthread_join(cthread, &retval);
+                rc = (retval != NULL) ? *(int*)retval : WH_ERROR_ABORTED;
+                if (rc != 0) {
+                    pthread_cancel(sthread);
+                }
+            }
+            else {
+                pthread_cancel(sthread);
+            }
+            pthread_join(sthread, NULL);
+        }
+    }
+
+#ifndef WOLFHSM_NO_CRYPTO
+    wc_FreeRng(crypto->rng);
+#endif
+    wh_Nvm_Cleanup(nvm);
+    return rc;
+}
+
+/* Give up the CPU while waiting on the peer so a spinning thread does not
+ * hold off the other side for a whole timeslice */
+static int _whBench_MemWait(void* arg)
+{
+    (void)arg;
+    (void)sched_yield();
+    return 0;
+}
+
+static int _whBench_Mem(void)
+{
+    uint8_t req[WH_BENCH_BUFFER_SIZE] = {0};
+    uint8_t resp[WH_BENCH_BUFFER_SIZE] = {0};
+
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+        .wait_cb   = _whBench_MemWait,
+    }};
+    whTransportClientCb         tccb[1]    = {WH_TRANSPORT_MEM_CLIENT_CB};
+    whTransportMemClientContext tmcc[1]    = {0};
+    whCommClientConfig          cc_conf[1] = {{
+        .transport_cb      = tccb,
+        .transport_context = (void*)tmcc,
+        .transport_config  = (void*)tmcf,
+        .client_id         = 1,
+    }};
+    whTransportServerCb         tscb[1]    = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]    = {0};
+    whCommServerConfig          cs_conf[1] = {{
+        .transport_cb      = tscb,
+        .transport_context = (void*)tmsc,
+        .transport_config  = (void*)tmcf,
+        .server_id         = 124,
+    }};
+
+    return _whBench_Run("client/server: (pthread) mem", cc_conf, cs_conf);
+}
+
+static int _whBench_Tcp(void)
+{
+    posixTransportTcpConfig tcpconfig[1] = {{
+        .server_ip_string = "127.0.0.1",
+        .server_port      = WH_BENCH_TCP_PORT,
+    }};
+
+    whTransportClientCb            pttccb[1]  = {PTT_CLIENT_CB};
+    posixTransportTcpClientContext tcc[1]     = {0};
+    whCommClientConfig             cc_conf[1] = {{
+        .transport_cb      = pttccb,
+        .transport_context = (void*)tcc,
+        .transport_config  = (void*)tcpconfig,
+        .client_id         = 1,
+    }};
+    whTransportServerCb            pttscb[1]  = {PTT_SERVER_CB};
+    posixTransportTcpServerContext tss[1]     = {0};
+    whCommServerConfig             cs_conf[1] = {{
+        .transport_cb      = pttscb,
+        .transport_context = (void*)tss,
+        .transport_config  = (void*)tcpconfig,
+        .server_id         = 124,
+    }};
+
+    return _whBench_Run("client/server: (pthread) tcp", cc_conf, cs_conf);
+}
+
+int whBench_ClientServer(void)
+{
+    int rc;
+
+#ifndef WOLFHSM_NO_CRYPTO
+    rc = wolfCrypt_Init();
+    if (rc != 0) {
+        return rc;
+    }
+#endif
+    rc = _whBench_Mem();
+    if (rc == 0) {
+        rc = _whBench_Tcp();
+    }
+#ifndef WOLFHSM_NO_CRYPTO
+    wolfCrypt_Cleanup();
+#endif
+    return rc;
+}
+
+#else /* !WH_CFG_TEST_POSIX */
+
+int whBench_ClientServer(void)
+{
+    printf("The client/server benchmarks require WH_CFG_TEST_POSIX\n");
+    return WH_ERROR_NOTIMPL;
+}
+
+#endif /* WH_CFG_TEST_POSIX */
+
+
+#if !defined(WH_CFG_BENCH_NO_MAIN)
+
+/* Runs the suite named by the first argument, "clientserver" or "nvm", or
+ * all of them.  "replay <log> [nvm image]" replays a capture log instead */
+int main(int argc, char** argv)
+{
+    const char* suite = (argc > 1) ? argv[1] : NULL;
+    int rc = 0;
+
+    if (suite != NULL && strcmp(suite, "replay") == 0) {
+        rc = whBench_Replay((argc > 2) ? argv[2] : NULL,
+                (argc > 3) ? argv[3] : NULL);
+        return (rc == 0) ? 0 : 1;
+    }
+    if (suite == NULL || strcmp(suite, "clientserver") == 0) {
+        rc = whBench_ClientServer();
+    }
+    if (rc == 0 && (suite == NULL || strcmp(suite, "nvm") == 0)) {
+        rc = whBench_Nvm();
+    }
+    return (rc == 0) ? 0 : 1;
+}
+
+#endif
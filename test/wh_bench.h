@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * test/wh_bench.h
+ *
+ * Benchmark harness.  Each benchmark times a number of operations one at a
+ * time and reports operations per second and the median and 99th percentile
+ * latency.  Built by the bench target of test/Makefile.
+ */
+#ifndef WH_BENCH_H
+#define WH_BENCH_H
+
+#include <stdint.h>
+
+/* Operations timed per benchmark */
+#ifndef WH_BENCH_ITERATIONS
+#define WH_BENCH_ITERATIONS 100
+#endif
+
+/* Latency samples of one benchmark */
+typedef struct {
+    const char* name;
+    uint32_t    size;       /* Bytes per operation, 0 if not applicable */
+    uint32_t    count;      /* Samples taken */
+    uint64_t    total_ns;
+    uint64_t    sample_ns[WH_BENCH_ITERATIONS];
+} whBenchResult;
+
+/* Monotonic time in nanoseconds */
+uint64_t whBench_NowNs(void);
+
+void whBench_Init(whBenchResult* r, const char* name, uint32_t size);
+
+/* Record one operation that started at start_ns and ended now */
+void whBench_Sample(whBenchResult* r, uint64_t start_ns);
+
+void whBench_PrintHeader(const char* title);
+void whBench_Print(const whBenchResult* r);
+
+/* Client/server benchmarks over the mem and TCP transports */
+int whBench_ClientServer(void);
+
+/* NVM engine workloads over the RAM and POSIX file flash simulators */
+int whBench_Nvm(void);
+
+/* Replay a capture log file into a server on the mem transport.  NVM starts
+ * from the posix_flash_file image nvm_file, or erased if it is NULL */
+int whBench_Replay(const char* log_file, const char* nvm_file);
+
+#endif /* WH_BENCH_H */
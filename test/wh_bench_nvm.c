@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * test/wh_bench_nvm.c
+ *
+ * NVM engine benchmarks.  Workloads are run through wh_Nvm_* on a freshly
+ * erased flash, which is wrapped to count the bytes programmed and erased.
+ */
+
+#include <stdint.h>
+#include <stdio.h>  /* For printf */
+#include <string.h> /* For memset */
+
+#if defined(WH_CONFIG)
+#include "wh_config.h"
+#endif
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_flash.h"
+#include "wolfhsm/wh_flash_ramsim.h"
+#include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_nvm_flash.h"
+
+#include "wh_bench.h"
+
+#if defined(WH_CFG_TEST_POSIX)
+#include <unistd.h> /* For unlink */
+#include "port/posix/posix_flash_file.h"
+
+/* Size of each of the two partitions */
+#ifndef WH_BENCH_NVM_PARTITION_SIZE
+#define WH_BENCH_NVM_PARTITION_SIZE (128 * 1024)
+#endif
+
+/* Key rotation: a few small objects replaced over and over */
+#ifndef WH_BENCH_NVM_KEY_SIZE
+#define WH_BENCH_NVM_KEY_SIZE 64
+#endif
+#ifndef WH_BENCH_NVM_KEY_COUNT
+#define WH_BENCH_NVM_KEY_COUNT 8
+#endif
+
+/* Many small objects added and then destroyed together */
+#ifndef WH_BENCH_NVM_SMALL_SIZE
+#define WH_BENCH_NVM_SMALL_SIZE 16
+#endif
+#ifndef WH_BENCH_NVM_SMALL_COUNT
+#define WH_BENCH_NVM_SMALL_COUNT (WOLFHSM_NUM_NVMOBJECTS / 2)
+#endif
+
+/* Large blobs added and then destroyed together */
+#ifndef WH_BENCH_NVM_LARGE_SIZE
+#define WH_BENCH_NVM_LARGE_SIZE 8192
+#endif
+#ifndef WH_BENCH_NVM_LARGE_COUNT
+#define WH_BENCH_NVM_LARGE_COUNT 4
+#endif
+
+/* Objects added until the NVM is full */
+#ifndef WH_BENCH_NVM_FILL_SIZE
+#define WH_BENCH_NVM_FILL_SIZE 4096
+#endif
+
+/* Remounts timed after each workload */
+#ifndef WH_BENCH_NVM_MOUNTS
+#define WH_BENCH_NVM_MOUNTS 10
+#endif
+
+#define WH_BENCH_NVM_FILE "whBenchNvm.bin"
+
+typedef struct {
+    const char* name;
+    whNvmSize   size;           /* Bytes per object */
+    whNvmId     count;          /* Distinct ids, 0 to add until full */
+    int         replace;        /* Replace ids rather than destroy them */
+} whBenchNvmWorkload;
+
+typedef struct {
+    const char*      name;
+    const whFlashCb* cb;
+    void*            context;
+    const void*      config;
+    const char*      filename;  /* Removed before each workload, or NULL */
+} whBenchNvmBackend;
+
+static const whBenchNvmWorkload workloads[] = {
+    {"key rotation", WH_BENCH_NVM_KEY_SIZE, WH_BENCH_NVM_KEY_COUNT, 1},
+    {"small objects", WH_BENCH_NVM_SMALL_SIZE, WH_BENCH_NVM_SMALL_COUNT, 0},
+    {"large blobs", WH_BENCH_NVM_LARGE_SIZE, WH_BENCH_NVM_LARGE_COUNT, 0},
+    {"fill to full", WH_BENCH_NVM_FILL_SIZE, 0, 0},
+};
+
+static uint8_t bench_data[WH_BENCH_NVM_LARGE_SIZE > WH_BENCH_NVM_FILL_SIZE ?
+        WH_BENCH_NVM_LARGE_SIZE : WH_BENCH_NVM_FILL_SIZE];
+
+
+/** Counting flash wrapper.  Cleanup is deferred so the flash contents survive
+ * a remount */
+
+static const whFlashCb* _inner = NULL;
+static int _innerInited = 0;
+static uint64_t _programmed = 0;
+static uint64_t _erased = 0;
+static uint32_t _erases = 0;
+
+static int _countingInit(void* c, const void* cf)
+{
+    int rc = 0;
+    if (_innerInited == 0) {
+        rc = _inner->Init(c, cf);
+        _innerInited = (rc == 0);
+    }
+    return rc;
+}
+
+static int _countingCleanup(void* c)
+{
+    (void)c;
+    return 0;
+}
+
+static int _countingProgram(void* c, uint32_t offset, uint32_t size,
+        const uint8_t* data)
+{
+    _programmed += size;
+    return _inner->Program(c, offset, size, data);
+}
+
+static int _countingProgramStart(void* c, uint32_t offset, uint32_t size,
+        const uint8_t* data)
+{
+    _programmed += size;
+    return _inner->ProgramStart(c, offset, size, data);
+}
+
+static int _countingProgramV(void* c, const whFlashSegment* segments,
+        uint32_t count)
+{
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        _programmed += segments[i].size;
+    }
+    return _inner->ProgramV(c, segments, count);
+}
+
+static int _countingCopy(void* c, uint32_t src_offset, uint32_t dst_offset,
+        uint32_t size)
+{
+    _programmed += size;
+    return _inner->Copy(c, src_offset, dst_offset, size);
+}
+
+static int _countingErase(void* c, uint32_t offset, uint32_t size)
+{
+    _erases++;
+    _erased += size;
+    return _inner->Erase(c, offset, size);
+}
+
+static int _countingEraseStart(void* c, uint32_t offset, uint32_t size)
+{
+    _erases++;
+    _erased += size;
+    return _inner->EraseStart(c, offset, size);
+}
+
+/* Wrap inner, keeping the optional callbacks it leaves NULL */
+static void _whBenchNvm_Wrap(whFlashCb* cb, const whFlashCb* inner)
+{
+    *cb         = *inner;
+    _inner      = inner;
+    cb->Init    = _countingInit;
+    cb->Cleanup = _countingCleanup;
+    cb->Program = _countingProgram;
+    cb->Erase   = _countingErase;
+    if (inner->ProgramStart != NULL) {
+        cb->ProgramStart = _countingProgramStart;
+    }
+    if (inner->ProgramV != NULL) {
+        cb->ProgramV = _countingProgramV;
+    }
+    if (inner->Copy != NULL) {
+        cb->Copy = _countingCopy;
+    }
+    if (inner->EraseStart != NULL) {
+        cb->EraseStart = _countingEraseStart;
+    }
+}
+
+
+/** Workloads */
+
+typedef struct {
+    whNvmContext*      nvm;
+    whNvmFlashContext* nfc;
+    uint64_t           user_bytes;   /* Object data successfully added */
+    uint64_t           compact_ns;
+    uint64_t           compact_max_ns;
+    uint32_t           compactions;
+    uint32_t           objects;      /* Objects added by fill to full */
+} whBenchNvm;
+
+/* Record an operation, and a compaction if it moved to the other partition */
+static void _whBenchNvm_Sample(whBenchNvm* b, whBenchResult* r,
+        uint64_t start, uint32_t epoch)
+{
+    uint64_t elapsed = whBench_NowNs() - start;
+
+    whBench_Sample(r, start);
+    if (b->nfc->state.epoch != epoch) {
+        b->compactions++;
+        b->compact_ns += elapsed;
+        if (elapsed > b->compact_max_ns) {
+            b->compact_max_ns = elapsed;
+        }
+    }
+}
+
+static int _whBenchNvm_Add(whBenchNvm* b, whBenchResult* r, whNvmId id,
+        whNvmSize size)
+{
+    whNvmMetadata meta = {0};
+    uint32_t epoch = b->nfc->state.epoch;
+    uint32_t reclaim_size = 0;
+    whNvmId reclaim_objects = 0;
+    uint64_t start;
+    int rc;
+
+    meta.id     = id;
+    meta.access = WOLFHSM_NVM_ACCESS_ANY;
+    meta.len    = size;
+    memcpy(meta.label, "bench", sizeof("bench"));
+
+    start = whBench_NowNs();
+    rc = wh_Nvm_AddObject(b->nvm, &meta, size, bench_data);
+    if (rc == WH_ERROR_NOSPACE) {
+        /* Reclaim superseded and destroyed objects in one step, as a server
+         * would have while idle, and retry once.  The add is timed
+         * including the compaction */
+        rc = wh_Nvm_GetAvailable(b->nvm, NULL, NULL, &reclaim_size,
+                &reclaim_objects);
+        if (rc == 0) {
+            rc = WH_ERROR_NOSPACE;
+            if (reclaim_objects > 0) {
+                rc = wh_Nvm_DestroyObjects(b->nvm, 0, NULL);
+            }
+        }
+        if (rc == 0) {
+            rc = wh_Nvm_AddObject(b->nvm, &meta, size, bench_data);
+        }
+    }
+    if (rc == 0) {
+        _whBenchNvm_Sample(b, r, start, epoch);
+        b->user_bytes += size;
+    }
+    return rc;
+}
+
+static int _whBenchNvm_Read(whBenchNvm* b, whBenchResult* r, whNvmId id,
+        whNvmSize size)
+{
+    static uint8_t out[sizeof(bench_data)];
+    uint32_t epoch = b->nfc->state.epoch;
+    uint64_t start = whBench_NowNs();
+    int rc;
+
+    rc = wh_Nvm_Read(b->nvm, id, 0, size, out);
+    if (rc == 0) {
+        _whBenchNvm_Sample(b, r, start, epoch);
+    }
+    return rc;
+}
+
+static int _whBenchNvm_Destroy(whBenchNvm* b, whBenchResult* r, whNvmId id)
+{
+    uint32_t epoch = b->nfc->state.epoch;
+    uint64_t start = whBench_NowNs();
+    int rc;
+
+    rc = wh_Nvm_DestroyObjects(b->nvm, 1, &id);
+    if (rc == 0) {
+        _whBenchNvm_Sample(b, r, start, epoch);
+    }
+    return rc;
+}
+
+static int _whBenchNvm_Workload(whBenchNvm* b, const whBenchNvmWorkload* w,
+        whBenchResult* add, whBenchResult* read, whBenchResult* destroy)
+{
+    whNvmId id;
+    int i;
+    int rc = 0;
+
+    if (w->count == 0) {
+        /* Add until the directory or the partition runs out */
+        for (id = 1; rc == 0; id++) {
+            rc = _whBenchNvm_Add(b, add, id, w->size);
+            if (rc == 0) {
+                b->objects++;
+                rc = _whBenchNvm_Read(b, read, id, w->size);
+            }
+        }
+        return (rc == WH_ERROR_NOSPACE) ? 0 : rc;
+    }
+
+    for (i = 0; i < WH_BENCH_ITERATIONS && rc == 0; i++) {
+        id = 1 + (i % w->count);
+        rc = _whBenchNvm_Add(b, add, id, w->size);
+        if (rc == 0) {
+            rc = _whBenchNvm_Read(b, read, id, w->size);
+        }
+        if (rc == 0 && w->replace == 0 && id == w->count) {
+            for (id = 1; id <= w->count && rc == 0; id++) {
+                rc = _whBenchNvm_Destroy(b, destroy, id);
+            }
+        }
+    }
+    return rc;
+}
+
+static int _whBenchNvm_Run(const whBenchNvmBackend* be,
+        const whBenchNvmWorkload* w)
+{
+    whFlashCb         cb[1];
+    whNvmFlashContext nfc[1] = {0};
+    whNvmFlashConfig  nf_conf[1] = {{0}};
+    whNvmCb           nfcb[1] = {WH_NVM_FLASH_CB};
+    whNvmConfig       n_conf[1] = {{
+        .cb      = nfcb,
+        .context = nfc,
+        .config  = nf_conf,
+    }};
+    whNvmContext      nvm[1] = {{0}};
+    whBenchNvm        b[1];
+    whBenchResult     add[1];
+    whBenchResult     read[1];
+    whBenchResult     destroy[1];
+    whBenchResult     mount[1];
+    uint64_t          start;
+    int               i;
+    int               rc;
+
+    _whBenchNvm_Wrap(cb, be->cb);
+    nf_conf->cb      = cb;
+    nf_conf->context = be->context;
+    nf_conf->config  = be->config;
+
+    memset(b, 0, sizeof(b));
+    b->nvm = nvm;
+    b->nfc = nfc;
+    whBench_Init(add, "add", w->size);
+    whBench_Init(read, "read", w->size);
+    whBench_Init(destroy, "destroy", w->size);
+    whBench_Init(mount, "mount", 0);
+
+    if (be->filename != NULL) {
+        (void)unlink(be->filename);
+    }
+    rc = wh_Nvm_Init(nvm, n_conf);
+    if (rc == 0) {
+        _programmed = 0;
+        _erased     = 0;
+        _erases     = 0;
+        rc = _whBenchNvm_Workload(b, w, add, read, destroy);
+    }
+
+    /* Remount what the workload left behind */
+    for (i = 0; i < WH_BENCH_NVM_MOUNTS && rc == 0; i++) {
+        rc = wh_Nvm_Cleanup(nvm);
+        if (rc == 0) {
+            start = whBench_NowNs();
+            rc = wh_Nvm_Init(nvm, n_conf);
+        }
+        if (rc == 0) {
+            whBench_Sample(mount, start);
+        }
+    }
+
+    (void)wh_Nvm_Cleanup(nvm);
+    if (_innerInited != 0) {
+        (void)_inner->Cleanup(be->context);
+        _innerInited = 0;
+    }
+    if (be->filename != NULL) {
+        (void)unlink(be->filename);
+    }
+
+    printf("-- %s\n", w->name);
+    whBench_Print(add);
+    whBench_Print(read);
+    whBench_Print(destroy);
+    whBench_Print(mount);
+    if (w->count == 0) {
+        printf("   full at %lu objects, %lu bytes, %.1f%% of a partition\n",
+                (unsigned long)b->objects, (unsigned long)b->user_bytes,
+                100.0 * (double)b->user_bytes / WH_BENCH_NVM_PARTITION_SIZE);
+    }
+    printf("   compactions %lu, %.1f us total, %.1f us max\n",
+            (unsigned long)b->compactions, (double)b->compact_ns / 1000.0,
+            (double)b->compact_max_ns / 1000.0);
+    printf("   programmed %lu bytes for %lu user bytes (%.2f per byte), "
+            "erased %lu bytes in %lu erases\n",
+            (unsigned long)_programmed, (unsigned long)b->user_bytes,
+            (b->user_bytes != 0) ?
+                    (double)_programmed / (double)b->user_bytes : 0.0,
+            (unsigned long)_erased, (unsigned long)_erases);
+    if (rc != 0) {
+        printf("NVM benchmark %s failed: %d\n", w->name, rc);
+    }
+    return rc;
+}
+
+static int _whBenchNvm_Backend(const whBenchNvmBackend* be)
+{
+    size_t i;
+    int rc = 0;
+
+    whBench_PrintHeader(be->name);
+    for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]) && rc == 0;
+            i++) {
+        rc = _whBenchNvm_Run(be, &workloads[i]);
+    }
+    return rc;
+}
+
+int whBench_Nvm(void)
+{
+    const whFlashCb  ramsimCb[1]  = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx ramsimCtx[1] = {0};
+    whFlashRamsimCfg ramsimCfg[1] = {{
+        .size       = 2 * WH_BENCH_NVM_PARTITION_SIZE,
+        .sectorSize = WH_BENCH_NVM_PARTITION_SIZE,
+        .pageSize   = 8,
+        .erasedByte = ~(uint8_t)0,
+    }};
+
+    const whFlashCb       fileCb[1]  = {POSIX_FLASH_FILE_CB};
+    posixFlashFileContext fileCtx[1] = {0};
+    posixFlashFileConfig  fileCfg[1] = {{
+        .filename       = WH_BENCH_NVM_FILE,
+        .partition_size = WH_BENCH_NVM_PARTITION_SIZE,
+        .erased_byte    = ~(uint8_t)0,
+    }};
+
+    const whBenchNvmBackend backends[] = {
+        {"nvm flash: ramsim", ramsimCb, ramsimCtx, ramsimCfg, NULL},
+        {"nvm flash: posix file", fileCb, fileCtx, fileCfg,
+                WH_BENCH_NVM_FILE},
+    };
+    size_t i;
+    int rc = 0;
+
+    memset(bench_data, 0xA5, sizeof(bench_data));
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]) && rc == 0; i++) {
+        rc = _whBenchNvm_Backend(&backends[i]);
+    }
+    return rc;
+}
+
+#else /* !WH_CFG_TEST_POSIX */
+
+int whBench_Nvm(void)
+{
+    printf("The NVM benchmarks require WH_CFG_TEST_POSIX\n");
+    return WH_ERROR_NOTIMPL;
+}
+
+#endif /* WH_CFG_TEST_POSIX */
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * test/wh_bench_replay.c
+ *
+ * Replay of a captured request log.  The log is fed into a server on the
+ * memory transport and the response times are reported for each message
+ * group, so a log recorded on a target can be compared across builds.
+ */
+
+#include <stdint.h>
+#include <stdio.h>  /* For printf */
+#include <string.h> /* For memset */
+
+#if defined(WH_CONFIG)
+#include "wh_config.h"
+#endif
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_flash.h"
+#include "wolfhsm/wh_flash_ramsim.h"
+#include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_nvm_flash.h"
+#include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_replay.h"
+
+#ifndef WOLFHSM_NO_CRYPTO
+#include "wolfssl/wolfcrypt/settings.h"
+#include "wolfssl/wolfcrypt/random.h"
+#endif
+
+#include "wh_bench.h"
+
+#if defined(WH_CFG_TEST_POSIX)
+#include "port/posix/posix_flash_file.h"
+#include "port/posix/posix_capture_file.h"
+
+/* Size of each of the two NVM partitions */
+#ifndef WH_BENCH_REPLAY_PARTITION_SIZE
+#define WH_BENCH_REPLAY_PARTITION_SIZE (128 * 1024)
+#endif
+
+static const char* const _whBenchReplay_Groups[WH_REPLAY_GROUP_COUNT] = {
+    [WH_MESSAGE_GROUP_COMM >> 8]    = "comm",
+    [WH_MESSAGE_GROUP_NVM >> 8]     = "nvm",
+    [WH_MESSAGE_GROUP_KEY >> 8]     = "key",
+    [WH_MESSAGE_GROUP_CRYPTO >> 8]  = "crypto",
+    [WH_MESSAGE_GROUP_IMAGE >> 8]   = "image",
+    [WH_MESSAGE_GROUP_PKCS11 >> 8]  = "pkcs11",
+    [WH_MESSAGE_GROUP_SHE >> 8]     = "she",
+    [WH_MESSAGE_GROUP_BATCH >> 8]   = "batch",
+    [WH_MESSAGE_GROUP_COUNTER >> 8] = "counter",
+    [WH_MESSAGE_GROUP_CUSTOM >> 8]  = "custom",
+};
+
+static uint64_t _whBenchReplay_Now(void* context)
+{
+    (void)context;
+    return whBench_NowNs();
+}
+
+static void _whBenchReplay_Print(const char* name, const whReplayTiming* t)
+{
+    if (t->count == 0) {
+        return;
+    }
+    printf("%-32s %8u %10.1f %10.1f %10.1f\n", name, (unsigned)t->count,
+            (double)t->total / (double)t->count / 1000.0,
+            (double)t->min / 1000.0, (double)t->max / 1000.0);
+}
+
+int whBench_Replay(const char* log_file, const char* nvm_file)
+{
+    static uint8_t req[WH_COMM_MTU + sizeof(whTransportMemCsr)];
+    static uint8_t resp[WH_COMM_MTU + sizeof(whTransportMemCsr)];
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    whTransportMemClientContext tmcc[1]    = {0};
+    whTransportServerCb         tscb[1]    = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]    = {0};
+    whCommServerConfig          cs_conf[1] = {{
+        .transport_cb      = tscb,
+        .transport_context = (void*)tmsc,
+        .transport_config  = (void*)tmcf,
+        .server_id         = 124,
+    }};
+
+    /* NVM starts from the image file if given, else erased */
+    const whFlashCb  ramsimCb[1]  = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx ramsimCtx[1] = {0};
+    whFlashRamsimCfg ramsimCfg[1] = {{
+        .size       = 2 * WH_BENCH_REPLAY_PARTITION_SIZE,
+        .sectorSize = WH_BENCH_REPLAY_PARTITION_SIZE,
+        .pageSize   = 8,
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb       fileCb[1]  = {POSIX_FLASH_FILE_CB};
+    posixFlashFileContext fileCtx[1] = {0};
+    posixFlashFileConfig  fileCfg[1] = {{
+        .filename       = nvm_file,
+        .partition_size = WH_BENCH_REPLAY_PARTITION_SIZE,
+        .erased_byte    = ~(uint8_t)0,
+    }};
+    whNvmFlashConfig nf_conf[1] = {{
+        .cb      = (nvm_file != NULL) ? fileCb : ramsimCb,
+        .context = (nvm_file != NULL) ? (void*)fileCtx : (void*)ramsimCtx,
+        .config  = (nvm_file != NULL) ? (void*)fileCfg : (void*)ramsimCfg,
+    }};
+    whNvmFlashContext nfc[1] = {0};
+    whNvmCb nfcb[1] = {WH_NVM_FLASH_CB};
+    whNvmConfig n_conf[1] = {{
+        .cb      = nfcb,
+        .context = nfc,
+        .config  = nf_conf,
+    }};
+    whNvmContext nvm[1] = {{0}};
+
+#ifndef WOLFHSM_NO_CRYPTO
+    crypto_context crypto[1] = {{
+        .devId = INVALID_DEVID,
+    }};
+#endif
+
+    whServerConfig s_conf[1] = {{
+        .comm_config = cs_conf,
+        .nvm         = nvm,
+#ifndef WOLFHSM_NO_CRYPTO
+        .crypto      = crypto,
+        .devId       = INVALID_DEVID,
+#endif
+    }};
+    whServerContext server[1] = {0};
+
+    posixCaptureFileConfig  pcf_conf[1] = {{
+        .filename = log_file,
+    }};
+    posixCaptureFileContext pcf[1] = {0};
+    whReplayConfig r_conf[1] = {{
+        .read_cb      = posixCaptureFile_Read,
+        .read_context = pcf,
+        .time_cb      = _whBenchReplay_Now,
+        .server       = server,
+        .transport    = tmcc,
+    }};
+    whReplayStats stats[1] = {0};
+    int i;
+    int rc;
+
+    if (log_file == NULL) {
+        printf("Usage: wh_bench.elf replay <log file> [nvm image file]\n");
+        return WH_ERROR_BADARGS;
+    }
+
+    rc = posixCaptureFile_Init(pcf, pcf_conf);
+    if (rc == 0) {
+        rc = wh_TransportMem_InitClear(tmcc, tmcf, NULL, NULL);
+    }
+#ifndef WOLFHSM_NO_CRYPTO
+    if (rc == 0) {
+        rc = wolfCrypt_Init();
+    }
+    if (rc == 0) {
+        rc = wc_InitRng_ex(crypto->rng, NULL, crypto->devId);
+    }
+#endif
+    if (rc == 0) {
+        rc = wh_Nvm_Init(nvm, n_conf);
+    }
+    if (rc == 0) {
+        rc = wh_Server_Init(server, s_conf);
+    }
+    if (rc == 0) {
+        rc = wh_Replay_Run(r_conf, stats);
+
+        printf("\n== replay: %s ==\n", log_file);
+        printf("%-32s %8s %10s %10s %10s\n", "group", "requests", "mean us",
+                "min us", "max us");
+        for (i = 0; i < WH_REPLAY_GROUP_COUNT; i++) {
+            _whBenchReplay_Print((_whBenchReplay_Groups[i] != NULL) ?
+                    _whBenchReplay_Groups[i] : "other", &stats->group[i]);
+        }
+        _whBenchReplay_Print("all", &stats->all);
+        printf("captured over %llu time units\n",
+                (unsigned long long)stats->captured);
+        if (stats->skipped > 0) {
+            printf("%u DMA requests skipped\n", (unsigned)stats->skipped);
+        }
+        if (rc != 0) {
+            printf("replay stopped after %u requests: %d\n",
+                    (unsigned)stats->all.count, rc);
+        }
+    } else {
+        printf("replay of %s could not start: %d\n", log_file, rc);
+    }
+
+    (void)wh_Server_Cleanup(server);
+    (void)wh_Nvm_Cleanup(nvm);
+#ifndef WOLFHSM_NO_CRYPTO
+    wc_FreeRng(crypto->rng);
+    wolfCrypt_Cleanup();
+#endif
+    (void)wh_TransportMem_Cleanup(tmcc);
+    (void)posixCaptureFile_Cleanup(pcf);
+    return rc;
+}
+
+#else /* !WH_CFG_TEST_POSIX */
+
+int whBench_Replay(const char* log_file, const char* nvm_file)
+{
+    (void)log_file;
+    (void)nvm_file;
+    printf("The replay benchmark requires WH_CFG_TEST_POSIX\n");
+    return WH_ERROR_NOTIMPL;
+}
+
+#endif /* WH_CFG_TEST_POSIX */
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * test/wh_sizes.c
+ *
+ * Static memory report.  Each context, and the largest members of the server
+ * context, is given a whSize_ symbol of the same size.  The object is only
+ * compiled, never linked, so the sizes can be read with nm -S for any target,
+ * as "make sizes" does.
+ */
+
+#include <stdint.h>
+
+#if defined(WH_CONFIG)
+#include "wh_config.h"
+#endif
+
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_counter.h"
+#include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_nvm_flash.h"
+#include "wolfhsm/wh_nvm_flash_log.h"
+#include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_client.h"
+
+#define WH_SIZE_TYPE(_name, _type) \
+    const uint8_t whSize_##_name[sizeof(_type)] = {0}
+#define WH_SIZE_MEMBER(_name, _type, _member) \
+    const uint8_t whSize_##_name[sizeof(((_type*)0)->_member)] = {0}
+
+/* Contexts */
+WH_SIZE_TYPE(whServerContext, whServerContext);
+WH_SIZE_TYPE(whClientContext, whClientContext);
+WH_SIZE_TYPE(whCommServer, whCommServer);
+WH_SIZE_TYPE(whCommClient, whCommClient);
+WH_SIZE_TYPE(whNvmContext, whNvmContext);
+WH_SIZE_TYPE(whNvmFlashContext, whNvmFlashContext);
+WH_SIZE_TYPE(whNvmFlashLogContext, whNvmFlashLogContext);
+WH_SIZE_TYPE(whCounterContext, whCounterContext);
+#ifndef WOLFHSM_NO_BATCH
+WH_SIZE_TYPE(whClientBatch, whClientBatch);
+#endif
+#ifndef WOLFHSM_NO_CRYPTO
+WH_SIZE_TYPE(crypto_context, crypto_context);
+#ifdef WOLFHSM_SHE_EXTENSION
+WH_SIZE_TYPE(she_context, she_context);
+#endif
+#endif
+
+/* Server context members */
+WH_SIZE_MEMBER(whServerContext_comms, whServerContext, comms);
+WH_SIZE_MEMBER(whServerContext_customHandlerTable, whServerContext,
+        customHandlerTable);
+WH_SIZE_MEMBER(whServerContext_dma, whServerContext, dma);
+#ifndef WOLFHSM_NO_BATCH
+WH_SIZE_MEMBER(whServerContext_batch_req, whServerContext, batch_req);
+WH_SIZE_MEMBER(whServerContext_batch_work, whServerContext, batch_work);
+#endif
+#ifdef WOLFHSM_SERVER_STATS
+WH_SIZE_MEMBER(whServerContext_stats, whServerContext, stats);
+#endif
+#ifndef WOLFHSM_NO_CRYPTO
+WH_SIZE_MEMBER(whServerContext_cache, whServerContext, cache);
+WH_SIZE_MEMBER(whServerContext_cacheArena, whServerContext, cacheArena);
+WH_SIZE_MEMBER(whServerContext_cacheIndex, whServerContext, cacheIndex);
+WH_SIZE_MEMBER(whServerContext_keyIdMap, whServerContext, keyIdMap);
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+WH_SIZE_MEMBER(whServerContext_decoded, whServerContext, decoded);
+#endif
+#ifdef WH_SERVER_KEYGEN_JOBS
+WH_SIZE_MEMBER(whServerContext_job, whServerContext, job);
+#endif
+#ifdef WH_SERVER_STREAMS
+WH_SIZE_MEMBER(whServerContext_stream, whServerContext, stream);
+#endif
+#if WH_SERVER_RNG_POOL_SIZE > 0
+WH_SIZE_MEMBER(whServerContext_rngPool, whServerContext, rngPool);
+#endif
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+WH_SIZE_MEMBER(whServerContext_ephemeralEcc, whServerContext, ephemeralEcc);
+#endif
+#if WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0
+WH_SIZE_MEMBER(whServerContext_ephemeralCurve25519, whServerContext,
+    ephemeralCurve25519);
+#endif
+#if WH_SERVER_WORKER_COUNT > 0
+WH_SIZE_MEMBER(whServerContext_worker, whServerContext, worker);
+#endif
+#endif /* !WOLFHSM_NO_CRYPTO */
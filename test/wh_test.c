@@ -27,7 +27,10 @@
 #include "wh_test_she.h"
 #include "wh_test_flash_ramsim.h"
 #include "wh_test_nvm_flash.h"
+#include "wh_test_counter.h"
 #include "wh_test_clientserver.h"
+#include "wh_test_trace.h"
+#include "wh_test_capture.h"
 
 
 /* Default test args */
@@ -45,6 +48,9 @@ int whTest_Unit(void)
 #endif
     WH_TEST_ASSERT(0 == whTest_Flash_RamSim());
     WH_TEST_ASSERT(0 == whTest_NvmFlash());
+    WH_TEST_ASSERT(0 == whTest_Counter());
+    WH_TEST_ASSERT(0 == whTest_Trace());
+    WH_TEST_ASSERT(0 == whTest_Capture());
     WH_TEST_ASSERT(0 == whTest_ClientServer());
 
     return 0;
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(WH_CONFIG)
+#include "wh_config.h"
+#endif
+
+#include "wh_test_common.h"
+#include "wh_test_capture.h"
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_capture.h"
+
+#ifdef WOLFHSM_CAPTURE
+
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_nvm.h"
+#include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_flash_ramsim.h"
+#include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_nvm_flash.h"
+#include "wolfhsm/wh_client.h"
+#include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_replay.h"
+
+#if defined(WH_CFG_TEST_POSIX)
+#include <unistd.h>  /* For unlink */
+#include "port/posix/posix_capture_file.h"
+#endif
+
+#define TEST_BUFFER_SIZE 4096
+#define TEST_FLASH_SIZE (64 * 1024)
+#define TEST_NVM_ID 5
+#define TEST_REQUEST_COUNT 4
+#define TEST_LOG_FILE "wh_test_capture.bin"
+
+static uint64_t _testClock = 0;
+
+/* In memory log of records and packets, without the log header */
+static uint8_t  _testLog[TEST_BUFFER_SIZE];
+static uint32_t _testLogLen = 0;
+static uint32_t _testLogPos = 0;
+
+static uint64_t _testTime(void* context)
+{
+    (void)context;
+    return ++_testClock;
+}
+
+static void _testSink(void* context, const whCaptureRecord* record,
+        const void* packet)
+{
+    (void)context;
+    if (_testLogLen + sizeof(*record) + record->size <= sizeof(_testLog)) {
+        memcpy(_testLog + _testLogLen, record, sizeof(*record));
+        memcpy(_testLog + _testLogLen + sizeof(*record), packet,
+                record->size);
+        _testLogLen += sizeof(*record) + record->size;
+    }
+}
+
+static int _testRead(void* context, whCaptureRecord* record, uint16_t size,
+        void* packet)
+{
+    (void)context;
+    if (_testLogPos >= _testLogLen) {
+        return WH_ERROR_NOTFOUND;
+    }
+    memcpy(record, _testLog + _testLogPos, sizeof(*record));
+    if (record->size > size) {
+        return WH_ERROR_NOSPACE;
+    }
+    memcpy(packet, _testLog + _testLogPos + sizeof(*record), record->size);
+    _testLogPos += sizeof(*record) + record->size;
+    return 0;
+}
+
+/* Replay the log from read_cb into a server with empty NVM */
+static int _testReplay(whReplayReadCb read_cb, void* read_context)
+{
+    uint8_t              req[TEST_BUFFER_SIZE]  = {0};
+    uint8_t              resp[TEST_BUFFER_SIZE] = {0};
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    whTransportMemClientContext tmcc[1]    = {0};
+    whTransportServerCb         tscb[1]    = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]    = {0};
+    whCommServerConfig          cs_conf[1] = {{
+        .transport_cb      = tscb,
+        .transport_context = (void*)tmsc,
+        .transport_config  = (void*)tmcf,
+        .server_id         = 125,
+    }};
+    const whFlashCb  fcb[1]     = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx fc[1]      = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = TEST_FLASH_SIZE,
+        .sectorSize = TEST_FLASH_SIZE / 2,
+        .pageSize   = 8,
+        .erasedByte = ~(uint8_t)0,
+    }};
+    whNvmFlashConfig  nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1]    = {0};
+    whNvmCb           nfcb[1]   = {WH_NVM_FLASH_CB};
+    whNvmConfig       n_conf[1] = {{
+        .cb      = nfcb,
+        .context = nfc,
+        .config  = nf_conf,
+    }};
+    whNvmContext    nvm[1]    = {{0}};
+    whServerConfig  s_conf[1] = {{
+        .comm_config = cs_conf,
+        .nvm         = nvm,
+    }};
+    whServerContext server[1] = {0};
+    whReplayConfig  r_conf[1] = {{
+        .read_cb      = read_cb,
+        .read_context = read_context,
+        .time_cb      = _testTime,
+        .server       = server,
+        .transport    = tmcc,
+    }};
+    whReplayStats   stats[1]  = {0};
+    whNvmMetadata   meta      = {0};
+    whReplayTiming* nvm_timing =
+            &stats->group[WH_MESSAGE_GROUP_NVM >> 8];
+
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_InitClear(tmcc, tmcf, NULL, NULL));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, s_conf));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Replay_Run(r_conf, stats));
+    WH_TEST_ASSERT_RETURN(stats->all.count == TEST_REQUEST_COUNT);
+    WH_TEST_ASSERT_RETURN(stats->skipped == 1);
+    WH_TEST_ASSERT_RETURN(stats->group[WH_MESSAGE_GROUP_COMM >> 8].count == 2);
+    WH_TEST_ASSERT_RETURN(nvm_timing->count == 2);
+    WH_TEST_ASSERT_RETURN(stats->all.min > 0);
+    WH_TEST_ASSERT_RETURN(stats->all.min <= stats->all.max);
+    WH_TEST_ASSERT_RETURN(stats->all.total >= nvm_timing->total);
+    WH_TEST_ASSERT_RETURN(stats->captured > 0);
+
+    /* The replayed requests wrote the object into this server's NVM */
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_GetMetadata(nvm, TEST_NVM_ID, &meta));
+    WH_TEST_ASSERT_RETURN(meta.len == 4);
+
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS == wh_Replay_Run(NULL, stats));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Cleanup(nvm));
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_Cleanup(tmcc));
+    return 0;
+}
+
+static int whTest_CaptureReplay(void)
+{
+    const whCaptureConfig config[1] = {{
+        .time_cb = _testTime,
+        .sink_cb = _testSink,
+    }};
+    const whCaptureConfig redact_config[1] = {{
+        .sink_cb = _testSink,
+        .redact  = 1,
+    }};
+    uint8_t              req[TEST_BUFFER_SIZE]  = {0};
+    uint8_t              resp[TEST_BUFFER_SIZE] = {0};
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    whTransportClientCb         tccb[1]    = {WH_TRANSPORT_MEM_CLIENT_CB};
+    whTransportMemClientContext tmcc[1]    = {0};
+    whCommClientConfig          cc_conf[1] = {{
+        .transport_cb      = tccb,
+        .transport_context = (void*)tmcc,
+        .transport_config  = (void*)tmcf,
+        .client_id         = 123,
+    }};
+    whClientConfig              c_conf[1]  = {{
+        .comm = cc_conf,
+    }};
+    whClientContext             client[1]  = {0};
+    whTransportServerCb         tscb[1]    = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]    = {0};
+    whCommServerConfig          cs_conf[1] = {{
+        .transport_cb      = tscb,
+        .transport_context = (void*)tmsc,
+        .transport_config  = (void*)tmcf,
+        .server_id         = 124,
+    }};
+    const whFlashCb  fcb[1]     = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx fc[1]      = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = TEST_FLASH_SIZE,
+        .sectorSize = TEST_FLASH_SIZE / 2,
+        .pageSize   = 8,
+        .erasedByte = ~(uint8_t)0,
+    }};
+    whNvmFlashConfig  nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1]    = {0};
+    whNvmCb           nfcb[1]   = {WH_NVM_FLASH_CB};
+    whNvmConfig       n_conf[1] = {{
+        .cb      = nfcb,
+        .context = nfc,
+        .config  = nf_conf,
+    }};
+    whNvmContext    nvm[1]    = {{0}};
+    whServerConfig  s_conf[1] = {{
+        .comm_config = cs_conf,
+        .nvm         = nvm,
+    }};
+    whServerContext server[1] = {0};
+    uint32_t client_id = 0;
+    uint32_t server_id = 0;
+    uint8_t  echo[8]   = "Capture";
+    uint16_t echo_len  = 0;
+    int32_t  server_rc = 0;
+    whNvmSize len      = 0;
+    whCaptureRecord record = {0};
+    uint32_t log_len   = 0;
+    uint64_t dma[2]    = {0};
+    whCommHeader* dma_hdr = (whCommHeader*)dma;
+#if defined(WH_CFG_TEST_POSIX)
+    posixCaptureFileConfig  pcf_conf[1] = {{
+        .filename = TEST_LOG_FILE,
+        .write    = 1,
+    }};
+    posixCaptureFileContext pcf[1] = {0};
+#endif
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, s_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_SetConnected(server, WH_COMM_CONNECTED));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_Init(client, c_conf));
+
+    _testLogLen = 0;
+    WH_TEST_RETURN_ON_FAIL(wh_Capture_Init(config));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CommInitRequest(client));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CommInitResponse(client, &client_id, &server_id));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client, sizeof(echo), echo));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoResponse(client, &echo_len, echo));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmAddObjectRequest(client, TEST_NVM_ID,
+        WOLFHSM_NVM_ACCESS_ANY, WOLFHSM_NVM_FLAGS_ANY, 0, NULL, 4,
+        (const uint8_t*)"Data"));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmAddObjectResponse(client, &server_rc));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_NvmGetMetadataRequest(client, TEST_NVM_ID));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetMetadataResponse(
+        client, &server_rc, NULL, NULL, NULL, &len, 0, NULL));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+
+    /* Redaction keeps the request but zeroes the object data */
+    log_len = _testLogLen;
+    WH_TEST_RETURN_ON_FAIL(wh_Capture_Init(redact_config));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmAddObjectRequest(client, TEST_NVM_ID,
+        WOLFHSM_NVM_ACCESS_ANY, WOLFHSM_NVM_FLAGS_ANY, 0, NULL, 4,
+        (const uint8_t*)"Data"));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmAddObjectResponse(client, &server_rc));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+    memcpy(&record, _testLog + log_len, sizeof(record));
+    WH_TEST_ASSERT_RETURN(record.size == sizeof(whCommHeader) +
+                                         sizeof(whMessageNvm_AddObjectRequest) +
+                                         4);
+    WH_TEST_ASSERT_RETURN(0 == memcmp(_testLog + log_len + sizeof(record) +
+                                          record.size - 4,
+                                      "\0\0\0\0", 4));
+    _testLogLen = log_len;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Capture_Init(NULL));
+
+    /* A DMA request would be resolved in the replay server's memory, so the
+     * replay skips it */
+    dma_hdr->magic = WH_COMM_MAGIC_NATIVE;
+    dma_hdr->kind  = WH_MESSAGE_KIND(WH_MESSAGE_GROUP_NVM,
+                                     WH_MESSAGE_NVM_ACTION_READDMA32);
+    record.time    = _testTime(NULL);
+    record.size    = sizeof(dma);
+    _testSink(NULL, &record, dma);
+
+    /* The first request was captured before the client had an id */
+    memcpy(&record, _testLog, sizeof(record));
+    WH_TEST_ASSERT_RETURN(record.server_id == 124);
+    WH_TEST_ASSERT_RETURN(record.client_id == 0);
+    WH_TEST_ASSERT_RETURN(record.size >= sizeof(whCommHeader));
+    WH_TEST_ASSERT_RETURN(record.time > 0);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_Cleanup(client));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Cleanup(nvm));
+
+    _testLogPos = 0;
+    WH_TEST_RETURN_ON_FAIL(_testReplay(_testRead, NULL));
+
+#if defined(WH_CFG_TEST_POSIX)
+    /* Write the log to a file and replay it from there */
+    WH_TEST_RETURN_ON_FAIL(posixCaptureFile_Init(pcf, pcf_conf));
+    _testLogPos = 0;
+    while (_testRead(NULL, &record, sizeof(req), req) == 0) {
+        posixCaptureFile_Sink(pcf, &record, req);
+    }
+    WH_TEST_RETURN_ON_FAIL(posixCaptureFile_Cleanup(pcf));
+
+    pcf_conf->write = 0;
+    WH_TEST_RETURN_ON_FAIL(posixCaptureFile_Init(pcf, pcf_conf));
+    WH_TEST_RETURN_ON_FAIL(_testReplay(posixCaptureFile_Read, pcf));
+    WH_TEST_RETURN_ON_FAIL(posixCaptureFile_Cleanup(pcf));
+    (void)unlink(TEST_LOG_FILE);
+#endif
+    return 0;
+}
+
+int whTest_Capture(void)
+{
+    printf("Testing capture and replay...\n");
+    WH_TEST_RETURN_ON_FAIL(whTest_CaptureReplay());
+    return 0;
+}
+
+#else
+
+int whTest_Capture(void)
+{
+    return 0;
+}
+
+#endif /* WOLFHSM_CAPTURE */
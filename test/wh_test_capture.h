@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef WH_TEST_CAPTURE_H
+#define WH_TEST_CAPTURE_H
+
+/*
+ * Tests capturing requests into a log and replaying the log into a fresh
+ * server.  Does nothing unless built with WOLFHSM_CAPTURE.
+ */
+int whTest_Capture(void);
+
+#endif /* WH_TEST_CAPTURE_H */
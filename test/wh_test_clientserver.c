@@ -29,18 +29,24 @@
 
 #include "wolfhsm/wh_comm.h"
 #include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_transport_memring.h"
 
 #include "wolfhsm/wh_nvm.h"
 #include "wolfhsm/wh_nvm_flash.h"
 #include "wolfhsm/wh_flash_ramsim.h"
 
 #include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_server_counter.h"
 #include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_message_comm.h"
+#include "wolfhsm/wh_message_nvm.h"
+#include "wolfhsm/wh_message_batch.h"
 #include "wolfhsm/wh_client.h"
 
 #if defined(WH_CFG_TEST_POSIX)
 #include <pthread.h> /* For pthread_create/cancel/join/_t */
 #include <unistd.h>  /* For sleep */
+#include <sched.h>   /* For sched_yield */
 #endif
 
 
@@ -51,6 +57,9 @@
 #define ONE_MS 1000
 #define FLASH_RAM_SIZE (1024 * 1024) /* 1MB */
 #define DMA_TEST_MEM_NWORDS 3
+#define PIPELINE_DEPTH 4
+/* Each ring slot must hold a full MTU packet */
+#define PIPELINE_BUFFER_SIZE (PIPELINE_DEPTH * 2 * WH_COMM_MTU)
 
 typedef struct {
     /* Simulated client memory region */
@@ -175,6 +184,98 @@ static int _testCallbacks(whServerContext* server, whClientContext* client)
     return WH_ERROR_OK;
 }
 
+/* Bulk callback that returns the payload inverted, processing it in place when
+ * the request and response share a buffer */
+static int _customServerBulkCb(whServerContext* server, uint32_t id,
+                               const uint8_t* req_data, uint16_t req_size,
+                               uint8_t* resp_data, uint16_t* inout_resp_size)
+{
+    uint16_t i = 0;
+
+    (void)server;
+    if (req_size > *inout_resp_size) {
+        return WH_ERROR_NOSPACE;
+    }
+    for (i = 0; i < req_size; i++) {
+        resp_data[i] = (uint8_t)~req_data[i];
+    }
+    *inout_resp_size = req_size;
+    return (int)id;
+}
+
+/* Sends payloads that use the whole comm buffer through a bulk callback.
+ * Client and server must be already initialized */
+static int _testBulkCallbacks(whServerContext* server, whClientContext* client)
+{
+    uint8_t  input[WH_MESSAGE_CUSTOM_CB_BULK_MAX_LEN];
+    uint8_t  output[WH_MESSAGE_CUSTOM_CB_BULK_MAX_LEN];
+    uint8_t* payload  = NULL;
+    uint16_t max_len  = 0;
+    uint16_t out_size = 0;
+    uint16_t i        = 0;
+    uint16_t id       = WH_CUSTOM_CB_NUM_CALLBACKS - 1;
+    int32_t  cb_rc    = 0;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetMaxDataLen(client, &max_len));
+    max_len -= sizeof(whMessageCustomCb_BulkHeader);
+    for (i = 0; i < max_len; i++) {
+        input[i] = (uint8_t)i;
+    }
+
+    /* No bulk handler yet */
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CustomCbBulkRequest(client, id, input, max_len));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    out_size = sizeof(output);
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOHANDLER ==
+            wh_Client_CustomCbBulkResponse(client, &cb_rc, output, &out_size));
+
+    /* Payloads past the comm buffer are rejected before sending */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+            wh_Client_CustomCbBulkRequest(client, id, input, max_len + 1));
+
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Server_RegisterCustomBulkCb(server, id, _customServerBulkCb));
+
+    /* Full size payload, copied in and out */
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CustomCbBulkRequest(client, id, input, max_len));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    out_size = sizeof(output);
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CustomCbBulkResponse(client, &cb_rc, output, &out_size));
+    WH_TEST_ASSERT_RETURN(cb_rc == id);
+    WH_TEST_ASSERT_RETURN(out_size == max_len);
+    for (i = 0; i < max_len; i++) {
+        WH_TEST_ASSERT_RETURN(output[i] == (uint8_t)~input[i]);
+    }
+
+    /* Zero-copy payload written straight into the comm buffer */
+    payload = wh_Client_CustomCbBulkGetDataPtr(client);
+    WH_TEST_ASSERT_RETURN(payload != NULL);
+    memcpy(payload, input, 16);
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CustomCbBulkRequest(client, id, payload, 16));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CustomCbBulkResponse(client, &cb_rc, NULL, &out_size));
+    WH_TEST_ASSERT_RETURN(out_size == 16);
+    for (i = 0; i < 16; i++) {
+        WH_TEST_ASSERT_RETURN(payload[i] == (uint8_t)~input[i]);
+    }
+
+    /* Empty payload */
+    out_size = sizeof(output);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CustomCbBulkRequest(client, id, NULL, 0));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CustomCbBulkResponse(client, &cb_rc, output, &out_size));
+    WH_TEST_ASSERT_RETURN(out_size == 0);
+    WH_TEST_ASSERT_RETURN(cb_rc == id);
+
+    return WH_ERROR_OK;
+}
+
 static int _customServerDmaCb(struct whServerContext_t* server,
                               void* clientAddr, void** serverPtr, uint32_t len,
                               whServerDmaOper oper, whServerDmaFlags flags)
@@ -235,6 +336,39 @@ static int _customServerDma64Cb(struct whServerContext_t* server,
                               len, oper, flags);
 }
 
+/* Client address the refusing DMA callbacks below fail on */
+static const void* _deniedDmaAddr = NULL;
+
+static int _denyServerDma32Cb(struct whServerContext_t* server,
+                              uint32_t clientAddr, void** serverPtr,
+                              uint32_t len, whServerDmaOper oper,
+                              whServerDmaFlags flags)
+{
+    (void)server;
+    (void)serverPtr;
+    (void)len;
+    (void)oper;
+    (void)flags;
+    return ((uintptr_t)clientAddr == (uintptr_t)_deniedDmaAddr)
+               ? WH_ERROR_ACCESS
+               : WH_ERROR_OK;
+}
+
+static int _denyServerDma64Cb(struct whServerContext_t* server,
+                              uint64_t clientAddr, void** serverPtr,
+                              uint64_t len, whServerDmaOper oper,
+                              whServerDmaFlags flags)
+{
+    (void)server;
+    (void)serverPtr;
+    (void)len;
+    (void)oper;
+    (void)flags;
+    return ((uintptr_t)clientAddr == (uintptr_t)_deniedDmaAddr)
+               ? WH_ERROR_ACCESS
+               : WH_ERROR_OK;
+}
+
 static int _testDma(whServerContext* server, whClientContext* client)
 {
     int        rc      = 0;
@@ -455,9 +589,204 @@ static int _testDma(whServerContext* server, whClientContext* client)
                                       testMem.srvRemapBufAllow,
                                       sizeof(testMem.srvBufAllow)));
 
+    /* Gather both halves of the remap buffer swapped, then scatter them back */
+    {
+        const size_t half    = sizeof(testMem.srvRemapBufAllow) / 2;
+        uint8_t*     remap   = (uint8_t*)testMem.srvRemapBufAllow;
+        uint8_t      orig[sizeof(testMem.srvRemapBufAllow)];
+        whDmaSegment segs[2] = {0};
+        int          addr64  = (sizeof(uintptr_t) == sizeof(uint64_t));
+        size_t       i;
+
+        for (i = 0; i < sizeof(orig); i++) {
+            orig[i] = (uint8_t)i;
+        }
+        memcpy(remap, orig, sizeof(orig));
+        segs[0].addr = (uint64_t)((uintptr_t)(remap + half));
+        segs[0].len  = sizeof(orig) - half;
+        segs[1].addr = (uint64_t)((uintptr_t)remap);
+        segs[1].len  = half;
+
+        WH_TEST_RETURN_ON_FAIL(whServerDma_CopyFromClientSg(
+            server, testMem.srvBufAllow, sizeof(testMem.srvBufAllow), segs, 2,
+            addr64, (whServerDmaFlags){0}));
+        WH_TEST_ASSERT_RETURN(0 == memcmp((uint8_t*)testMem.srvBufAllow,
+                                          orig + half, sizeof(orig) - half));
+        WH_TEST_ASSERT_RETURN(
+            0 == memcmp((uint8_t*)testMem.srvBufAllow + sizeof(orig) - half,
+                        orig, half));
+
+        memset(remap, 0, sizeof(orig));
+        WH_TEST_RETURN_ON_FAIL(whServerDma_CopyToClientSg(
+            server, segs, 2, addr64, testMem.srvBufAllow,
+            sizeof(testMem.srvBufAllow), (whServerDmaFlags){0}));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(remap, orig, sizeof(orig)));
+
+        /* Lengths must add up to the server buffer */
+        WH_TEST_ASSERT_RETURN(
+            WH_ERROR_BADARGS ==
+            whServerDma_CopyFromClientSg(server, testMem.srvBufAllow,
+                                         sizeof(testMem.srvBufAllow) - 1, segs,
+                                         2, addr64, (whServerDmaFlags){0}));
+
+        /* Every segment is checked against the allowlist */
+        segs[1].addr = (uint64_t)((uintptr_t)testMem.srvBufDeny);
+        WH_TEST_ASSERT_RETURN(
+            WH_ERROR_ACCESS ==
+            whServerDma_CopyToClientSg(server, segs, 2, addr64,
+                                       testMem.srvBufAllow,
+                                       sizeof(testMem.srvBufAllow),
+                                       (whServerDmaFlags){0}));
+    }
+
+    /* Unsorted, overlapping and adjacent entries act as one range */
+    {
+        uint8_t                        region[64] = {0};
+        const whServerDmaAddrAllowList merged     = {
+                .readList =
+                {
+                    {region + 32, 16},
+                    {region, 16},
+                    {region + 8, 16},
+                    {region + 24, 8},
+                },
+                .writeList =
+                {
+                    {region + 40, 8},
+                },
+        };
+
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Server_DmaRegisterAllowList(server, &merged));
+        WH_TEST_ASSERT_RETURN(server->dma.readIndex.count == 1);
+        WH_TEST_ASSERT_RETURN(server->dma.writeIndex.count == 1);
+
+        WH_TEST_ASSERT_RETURN(WH_ERROR_OK ==
+                              wh_Server_DmaCheckMemOperAllowed(
+                                  server, WH_DMA_OPER_CLIENT_READ_PRE, region,
+                                  48));
+        WH_TEST_ASSERT_RETURN(WH_ERROR_OK ==
+                              wh_Server_DmaCheckMemOperAllowed(
+                                  server, WH_DMA_OPER_CLIENT_READ_PRE,
+                                  region + 47, 1));
+        WH_TEST_ASSERT_RETURN(WH_ERROR_ACCESS ==
+                              wh_Server_DmaCheckMemOperAllowed(
+                                  server, WH_DMA_OPER_CLIENT_READ_PRE, region,
+                                  49));
+        WH_TEST_ASSERT_RETURN(WH_ERROR_ACCESS ==
+                              wh_Server_DmaCheckMemOperAllowed(
+                                  server, WH_DMA_OPER_CLIENT_READ_PRE,
+                                  region + 48, 1));
+        WH_TEST_ASSERT_RETURN(WH_ERROR_OK ==
+                              wh_Server_DmaCheckMemOperAllowed(
+                                  server, WH_DMA_OPER_CLIENT_WRITE_PRE,
+                                  region + 40, 8));
+        WH_TEST_ASSERT_RETURN(WH_ERROR_ACCESS ==
+                              wh_Server_DmaCheckMemOperAllowed(
+                                  server, WH_DMA_OPER_CLIENT_WRITE_PRE,
+                                  region + 39, 2));
+        WH_TEST_ASSERT_RETURN(WH_ERROR_ACCESS ==
+                              wh_Server_DmaCheckMemOperAllowed(
+                                  server, WH_DMA_OPER_CLIENT_WRITE_PRE,
+                                  region, 8));
+
+        /* Back to the list used above */
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Server_DmaRegisterAllowList(server, &allowList));
+    }
+
     return rc;
 }
 
+#ifndef WOLFHSM_NO_BATCH
+/* Helper function to test batched requests. Client and server must be already
+ * initialized */
+static int _testBatch(whServerContext* server, whClientContext* client)
+{
+    whClientBatch                   batch[1]  = {0};
+    whMessageNvm_GetMetadataRequest meta_req  = {0};
+    const whMessageNvm_GetAvailableResponse* avail = NULL;
+    const whMessageNvm_GetMetadataResponse*  meta  = NULL;
+    const void*                     data      = NULL;
+    uint16_t                        group     = 0;
+    uint16_t                        action    = 0;
+    uint16_t                        size      = 0;
+    int32_t                         rc        = 0;
+    int                             count     = 0;
+    int                             complete  = 0;
+
+    /* Available space, a missing object and a disallowed nested batch */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchInit(batch));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchAdd(client, batch,
+        WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_GETAVAILABLE, 0, NULL));
+    meta_req.id = 0x7FFF;
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchAdd(client, batch,
+        WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_GETMETADATA,
+        sizeof(meta_req), &meta_req));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                          wh_Client_BatchAdd(client, batch,
+                                             WH_MESSAGE_GROUP_BATCH,
+                                             WH_MESSAGE_BATCH_ACTION_REQUEST,
+                                             0, NULL));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchRequest(client, batch));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchResponse(client, batch));
+
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_BatchGetResult(batch, &group, &action, &rc, &size, &data));
+    WH_TEST_ASSERT_RETURN(group == WH_MESSAGE_GROUP_NVM);
+    WH_TEST_ASSERT_RETURN(action == WH_MESSAGE_NVM_ACTION_GETAVAILABLE);
+    WH_TEST_ASSERT_RETURN(rc == 0);
+    WH_TEST_ASSERT_RETURN(size == sizeof(*avail));
+    avail = (const whMessageNvm_GetAvailableResponse*)data;
+    WH_TEST_ASSERT_RETURN(avail->rc == WH_ERROR_OK);
+
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_BatchGetResult(batch, &group, &action, &rc, &size, &data));
+    WH_TEST_ASSERT_RETURN(action == WH_MESSAGE_NVM_ACTION_GETMETADATA);
+    WH_TEST_ASSERT_RETURN(rc == 0);
+    WH_TEST_ASSERT_RETURN(size == sizeof(*meta));
+    meta = (const whMessageNvm_GetMetadataResponse*)data;
+    WH_TEST_ASSERT_RETURN(meta->rc == WH_ERROR_NOTFOUND);
+
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Client_BatchGetResult(batch, NULL, NULL, NULL,
+                                                   NULL, NULL));
+
+    /* Fill a batch until it runs out of space. Responses are larger than the
+     * requests, so the entries that do not fit report NOSPACE */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchInit(batch));
+    while (0 == wh_Client_BatchAdd(client, batch, WH_MESSAGE_GROUP_NVM,
+                                   WH_MESSAGE_NVM_ACTION_GETMETADATA,
+                                   sizeof(meta_req), &meta_req)) {
+        count++;
+    }
+    WH_TEST_ASSERT_RETURN(count > 2);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchRequest(client, batch));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_BatchResponse(client, batch));
+    do {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_BatchGetResult(batch, NULL, NULL, &rc, &size, &data));
+        if (rc == 0) {
+            meta = (const whMessageNvm_GetMetadataResponse*)data;
+            WH_TEST_ASSERT_RETURN(meta->rc == WH_ERROR_NOTFOUND);
+            complete++;
+        }
+    } while (rc == 0);
+    /* The last result did not fit and the rest were left unprocessed */
+    WH_TEST_ASSERT_RETURN(rc == WH_ERROR_NOSPACE);
+    WH_TEST_ASSERT_RETURN(size == 0);
+    WH_TEST_ASSERT_RETURN((complete > 2) && (complete < count));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Client_BatchGetResult(batch, NULL, NULL, NULL,
+                                                   NULL, NULL));
+
+    return WH_ERROR_OK;
+}
+#endif /* WOLFHSM_NO_BATCH */
+
 int _clientServerSequentialTestConnectCb(void* context, whCommConnected connected)
 {
     if (clientServerSequentialTestServerCtx == NULL) {
@@ -472,6 +801,302 @@ int _clientServerSequentialTestConnectCb(void* context, whCommConnected connecte
                                   connected);
 }
 
+/* Helper function to test the counter service. Client and server must be
+ * already initialized */
+static int _testCounter(whServerContext* server, whClientContext* client)
+{
+    whCounterContext* counter   = server->counter;
+    int32_t           server_rc = 0;
+    uint32_t          value     = 0;
+    int               i         = 0;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterInitRequest(client, 5, 100));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterInitResponse(client, &server_rc, &value));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+    WH_TEST_ASSERT_RETURN(value == 100);
+
+    for (i = 0; i < 5; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Client_CounterIncrementRequest(client, 5));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_CounterIncrementResponse(client, &server_rc, &value));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(value == 100 + (uint32_t)i + 1);
+    }
+
+    /* Setting it back is refused, setting it forward is not */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterInitRequest(client, 5, 100));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterInitResponse(client, &server_rc, &value));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_ACCESS);
+    WH_TEST_ASSERT_RETURN(value == 105);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterInitRequest(client, 5, 105));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterInitResponse(client, &server_rc, &value));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+    WH_TEST_ASSERT_RETURN(value == 105);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterReadRequest(client, 5));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterReadResponse(client, &server_rc, &value));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+    WH_TEST_ASSERT_RETURN(value == 105);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterDestroyRequest(client, 5));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterDestroyResponse(client, &server_rc));
+#if WH_SERVER_COUNTER_DESTROY
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterIncrementRequest(client, 5));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterIncrementResponse(client, &server_rc, &value));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_NOTFOUND);
+#else
+    /* Destroy is refused, so the counter can't come back lower */
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_ACCESS);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterInitRequest(client, 5, 0));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterInitResponse(client, &server_rc, &value));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_ACCESS);
+    WH_TEST_ASSERT_RETURN(value == 105);
+#endif
+
+    /* A server without a counter store refuses the requests */
+    server->counter = NULL;
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CounterReadRequest(client, 5));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CounterReadResponse(client, &server_rc, &value));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_ABORTED);
+    server->counter = counter;
+
+    return 0;
+}
+
+#ifdef WOLFHSM_SERVER_STATS
+/* Fake clock advancing 5 units on every read */
+static uint64_t _testStatsTime(void* context)
+{
+    uint64_t* now = (uint64_t*)context;
+    *now += 5;
+    return *now;
+}
+
+/* Read the stats entry for kind through the client */
+static int _testStatsGet(whServerContext* server, whClientContext* client,
+                         uint16_t kind, whMessageCommStatsEntry* out_entry)
+{
+    uint16_t count = 0;
+    uint16_t index = 0;
+    int      rc    = 0;
+
+    do {
+        WH_TEST_RETURN_ON_FAIL(wh_Client_GetStatsRequest(client, index, 0));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        rc = wh_Client_GetStatsResponse(client, &count, out_entry);
+        if ((rc == 0) && (out_entry->kind == kind)) {
+            return 0;
+        }
+        index++;
+    } while (rc == 0);
+    return rc;
+}
+
+/* Helper function to test request statistics. Client and server must be
+ * already initialized */
+static int _testStats(whServerContext* server, whClientContext* client)
+{
+    whMessageCommStatsEntry entry = {0};
+    char                    buf[16] = "stats";
+    uint16_t                len   = 0;
+    uint16_t                count = 0;
+    int32_t                 server_rc = 0;
+    int                     i     = 0;
+
+    /* Start over. The reset request itself is counted afterwards */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetStatsRequest(
+        client, 0, WH_MESSAGE_COMM_STATS_RESET));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetStatsResponse(client, &count, NULL));
+    WH_TEST_ASSERT_RETURN(server->stats_count == 1);
+
+    for (i = 0; i < 3; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client, 5, buf));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(wh_Client_EchoResponse(client, &len, buf));
+    }
+
+    /* A failing NVM request counts as an error */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetMetadataRequest(client, 0x7F7F));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetMetadataResponse(
+        client, &server_rc, NULL, NULL, NULL, NULL, 0, NULL));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_NOTFOUND);
+
+    WH_TEST_RETURN_ON_FAIL(_testStatsGet(server, client,
+        WH_MESSAGE_KIND(WH_MESSAGE_GROUP_COMM, WH_MESSAGE_COMM_ACTION_ECHO),
+        &entry));
+    WH_TEST_ASSERT_RETURN(entry.count == 3);
+    WH_TEST_ASSERT_RETURN(entry.errors == 0);
+    WH_TEST_ASSERT_RETURN(entry.bytes_in == 3 * sizeof(whMessageCommLenData));
+    WH_TEST_ASSERT_RETURN(entry.bytes_out == 3 * sizeof(whMessageCommLenData));
+    WH_TEST_ASSERT_RETURN(entry.min_time == 5);
+    WH_TEST_ASSERT_RETURN(entry.max_time == 5);
+    WH_TEST_ASSERT_RETURN(entry.total_time == 15);
+    WH_TEST_ASSERT_RETURN(entry.hist[1] == 3);
+
+    WH_TEST_RETURN_ON_FAIL(_testStatsGet(server, client,
+        WH_MESSAGE_KIND(WH_MESSAGE_GROUP_NVM, WH_MESSAGE_NVM_ACTION_GETMETADATA),
+        &entry));
+    WH_TEST_ASSERT_RETURN(entry.count == 1);
+    WH_TEST_ASSERT_RETURN(entry.errors == 1);
+
+    /* Reading past the last entry reports the number in use */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetStatsRequest(client, 100, 0));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Client_GetStatsResponse(client, &count, &entry));
+    WH_TEST_ASSERT_RETURN(count == 3);
+
+    return 0;
+}
+#endif /* WOLFHSM_SERVER_STATS */
+
+/* State shared with the run loop callbacks, which act as the client */
+typedef struct {
+    whClientContext* client;
+    int              idle_calls;
+    int              wait_calls;
+    int              idle_before_wait;
+    int              padding;
+} _testRunContext;
+
+static int _testRunIdle(void* context, whServerContext* server)
+{
+    _testRunContext* ctx = (_testRunContext*)context;
+    (void)server;
+
+    /* Ask to be called again once, then fail once */
+    ctx->idle_calls++;
+    if (ctx->idle_calls == 1) {
+        return 1;
+    }
+    return (ctx->idle_calls == 2) ? WH_ERROR_ABORTED : 0;
+}
+
+static int _testRunWait(void* context, uint32_t timeout_ms)
+{
+    _testRunContext* ctx = (_testRunContext*)context;
+    char             buf[16] = {0};
+    uint16_t         len = 0;
+
+    WH_TEST_ASSERT_RETURN(timeout_ms == 10);
+    if (ctx->wait_calls == 0) {
+        ctx->idle_before_wait = ctx->idle_calls;
+    }
+    ctx->wait_calls++;
+
+    if (ctx->wait_calls == 1) {
+        /* The echo was handled before the server went to sleep */
+        WH_TEST_RETURN_ON_FAIL(wh_Client_EchoResponse(ctx->client, &len, buf));
+        WH_TEST_ASSERT_RETURN((len == 4) && (memcmp(buf, "idle", 4) == 0));
+        WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(ctx->client, 4, "wake"));
+        return 0;
+    }
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoResponse(ctx->client, &len, buf));
+    WH_TEST_ASSERT_RETURN((len == 4) && (memcmp(buf, "wake", 4) == 0));
+    /* Stop the run loop */
+    return 1;
+}
+
+static int _testRunStop(void* context, uint32_t timeout_ms)
+{
+    (void)context;
+    (void)timeout_ms;
+    return 1;
+}
+
+/* Helper function to test the server run loop. Client and server must be
+ * already initialized with the run configuration using ctx */
+static int _testRun(whServerContext* server, whClientContext* client,
+                    _testRunContext* ctx)
+{
+    whNvmMetadata meta = {0};
+    uint8_t       data[16] = {0};
+    uint32_t      reclaim_size = 0;
+    whNvmId       reclaim_objects = 0;
+
+    /* Leave an old version of an object behind for compaction */
+    meta.id  = 0x7E7E;
+    meta.len = sizeof(data);
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Nvm_AddObject(server->nvm, &meta, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Nvm_AddObject(server->nvm, &meta, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_GetAvailable(server->nvm, NULL, NULL,
+                                               &reclaim_size, &reclaim_objects));
+    WH_TEST_ASSERT_RETURN(reclaim_objects > 0);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client, 4, "idle"));
+    WH_TEST_ASSERT_RETURN(1 == wh_Server_Run(server));
+    WH_TEST_ASSERT_RETURN(ctx->wait_calls == 2);
+
+    /* Compaction, then the idle callback until it failed, which only put the
+     * server to sleep */
+    WH_TEST_ASSERT_RETURN(ctx->idle_before_wait == 2);
+    WH_TEST_ASSERT_RETURN(server->idle_error == WH_ERROR_ABORTED);
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_GetAvailable(server->nvm, NULL, NULL,
+                                               &reclaim_size, &reclaim_objects));
+    WH_TEST_ASSERT_RETURN(reclaim_objects == 0);
+    WH_TEST_ASSERT_RETURN(reclaim_size == 0);
+
+    /* An unfinished stream holds off compaction without keeping the server
+     * busy, until its client goes away */
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Nvm_AddObject(server->nvm, &meta, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Nvm_AddObjectBegin(server->nvm, server->comm, &meta));
+    WH_TEST_ASSERT_RETURN(0 == wh_Server_RunIdle(server));
+    WH_TEST_ASSERT_RETURN(0 == wh_Server_RunIdle(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Server_SetCommConnected(server, 0, WH_COMM_DISCONNECTED));
+    WH_TEST_ASSERT_RETURN(1 == wh_Server_RunIdle(server));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Nvm_AddObjectCommit(server->nvm, server->comm));
+    /* Without a connected client the server waits for one unless told to
+     * exit */
+    server->run.wait_cb = _testRunStop;
+    WH_TEST_ASSERT_RETURN(1 == wh_Server_Run(server));
+    server->run.exit_disconnected = 1;
+    WH_TEST_ASSERT_RETURN(0 == wh_Server_Run(server));
+    server->run.exit_disconnected = 0;
+    server->run.wait_cb = _testRunWait;
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Server_SetCommConnected(server, 0, WH_COMM_CONNECTED));
+    while (1 == wh_Server_RunIdle(server)) {
+    }
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_GetAvailable(server->nvm, NULL, NULL,
+                                               &reclaim_size, &reclaim_objects));
+    WH_TEST_ASSERT_RETURN(reclaim_objects == 0);
+
+    /* Nothing left to compact */
+    WH_TEST_ASSERT_RETURN(0 == wh_Server_RunIdle(server));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS == wh_Server_RunIdle(NULL));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS == wh_Server_Run(NULL));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_DestroyObjects(server->nvm, 1, &meta.id));
+    return 0;
+}
+
 int whTest_ClientServerSequential(void)
 {
     int ret = 0;
@@ -538,17 +1163,48 @@ int whTest_ClientServerSequential(void)
          .config  = nf_conf,
     }};
     whNvmContext nvm[1]    = {{0}};
+
+    /* Counters share the flash above the NVM partitions */
+    whCounterConfig  cn_conf[1] = {{
+         .cb      = fcb,
+         .context = fc,
+         .config  = NULL,
+         .offset  = 512 * 1024,
+         .size    = 256 * 1024,
+    }};
+    whCounterContext cn[1]     = {{0}};
 #ifndef WOLFHSM_NO_CRYPTO
     crypto_context crypto[1] = {{
         .devId = INVALID_DEVID,
     }};
 #endif
 
+#ifdef WOLFHSM_SERVER_STATS
+    uint64_t stats_now = 0;
+#endif
+    _testRunContext   run_ctx[1] = {{
+        .client = client,
+    }};
+    whServerRunConfig run_conf[1] = {{
+        .wait_cb          = _testRunWait,
+        .idle_cb          = _testRunIdle,
+        .context          = run_ctx,
+        .timeout_ms       = 10,
+        .nvm_reclaim_size = 1,
+        .nvm_compact_size = 16,
+    }};
+
     whServerConfig  s_conf[1] = {{
          .comm_config = cs_conf,
          .nvm         = nvm,
+         .counter     = cn,
 #ifndef WOLFHSM_NO_CRYPTO
          .crypto      = crypto,
+#endif
+         .run_config  = run_conf,
+#ifdef WOLFHSM_SERVER_STATS
+         .stats_time_cb      = _testStatsTime,
+         .stats_time_context = &stats_now,
 #endif
     }};
     whServerContext server[1] = {0};
@@ -563,6 +1219,7 @@ int whTest_ClientServerSequential(void)
     WH_TEST_RETURN_ON_FAIL(wc_InitRng_ex(crypto->rng, NULL, crypto->devId));
 #endif
     WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Init(cn, cn_conf));
 
     /* Server API should return NOTREADY until the server is connected */
     WH_TEST_RETURN_ON_FAIL(wh_Server_GetConnected(server, &server_connected));
@@ -600,6 +1257,23 @@ int whTest_ClientServerSequential(void)
     WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
                           wh_Server_HandleRequestMessage(server));
 
+    /* Comm init exchanges ids and negotiates the data size */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CommInitRequest(client));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_CommInitResponse(client, &client_id, &server_id));
+    WH_TEST_ASSERT_RETURN(client_id == client->comm->client_id);
+    WH_TEST_ASSERT_RETURN(server_id == server->comm->server_id);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetMaxDataLen(client, &send_len));
+    WH_TEST_ASSERT_RETURN(send_len == WH_COMM_DATA_LEN);
+    WH_TEST_ASSERT_RETURN(server->comm->max_data_len == WH_COMM_DATA_LEN);
+
+    /* Requests larger than the negotiated size are refused */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                          wh_Client_SendRequest(client, WH_MESSAGE_GROUP_COMM,
+                                                WH_MESSAGE_COMM_ACTION_ECHO,
+                                                send_len + 1, send_buffer));
+
     for (counter = 0; counter < REPEAT_COUNT; counter++) {
 
         /* Prepare echo test */
@@ -805,6 +1479,15 @@ int whTest_ClientServerSequential(void)
         }
     } while (list_count > 0);
 
+#if WH_NVM_FLASH_TOMBSTONE
+    /* Destroys left tombstones.  Compact before checking what is available */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmDestroyObjectsRequest(client, 0, NULL));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_NvmDestroyObjectsResponse(client, &server_rc));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+#endif
+
 
     WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetAvailableRequest(client));
     WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
@@ -903,6 +1586,142 @@ int whTest_ClientServerSequential(void)
         WH_TEST_ASSERT_RETURN(0 == memcmp(send_buffer, recv_buffer, len));
     }
 
+    /* Gather an object from fragments and scatter it back out of order */
+    {
+        const char    frag0[]  = "Gathered ";
+        const char    frag1[]  = "from three ";
+        const char    frag2[]  = "fragments";
+        const char    whole[]  = "Gathered from three fragments";
+        whNvmMetadata meta     = {.id = 50, .access = WOLFHSM_NVM_ACCESS_ANY};
+        whDmaSegment  gsegs[3] = {0};
+        whDmaSegment  ssegs[2] = {0};
+        whNvmSize     glen     = 0;
+
+        gsegs[0].addr = (uint64_t)((uintptr_t)frag0);
+        gsegs[0].len  = sizeof(frag0) - 1;
+        gsegs[1].addr = (uint64_t)((uintptr_t)frag1);
+        gsegs[1].len  = sizeof(frag1) - 1;
+        gsegs[2].addr = (uint64_t)((uintptr_t)frag2);
+        gsegs[2].len  = sizeof(frag2) - 1;
+
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmAddObjectDmaSgRequest(client, &meta, 3, gsegs));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmAddObjectDmaSgResponse(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmGetMetadataRequest(client, meta.id));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetMetadataResponse(
+            client, &server_rc, NULL, NULL, NULL, &glen, 0, NULL));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(glen == sizeof(whole) - 1);
+
+        /* First 10 bytes land after the rest */
+        memset(recv_buffer, 0, sizeof(recv_buffer));
+        ssegs[0].addr = (uint64_t)((uintptr_t)(recv_buffer + glen - 10));
+        ssegs[0].len  = 10;
+        ssegs[1].addr = (uint64_t)((uintptr_t)recv_buffer);
+        ssegs[1].len  = glen - 10;
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmReadDmaSgRequest(client, meta.id, 0, 2, ssegs));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmReadDmaSgResponse(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(0 == memcmp(recv_buffer + glen - 10, whole, 10));
+        WH_TEST_ASSERT_RETURN(
+            0 == memcmp(recv_buffer, whole + 10, glen - 10));
+
+        /* More segments than a request holds */
+        WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                              wh_Client_NvmReadDmaSgRequest(
+                                  client, meta.id, 0, WH_DMA_MAX_SEGMENTS + 1,
+                                  ssegs));
+
+        /* A segment the server refuses after the add began leaves no stream
+         * open and no object behind */
+        _deniedDmaAddr = frag2;
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Server_DmaRegisterCb32(server, _denyServerDma32Cb));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Server_DmaRegisterCb64(server, _denyServerDma64Cb));
+        meta.id = 51;
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmAddObjectDmaSgRequest(client, &meta, 3, gsegs));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmAddObjectDmaSgResponse(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_ACCESS);
+        WH_TEST_ASSERT_RETURN(server->nvm->stream_owner == NULL);
+        WH_TEST_RETURN_ON_FAIL(wh_Server_DmaRegisterCb32(server, NULL));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_DmaRegisterCb64(server, NULL));
+        _deniedDmaAddr = NULL;
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmGetMetadataRequest(client, meta.id));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetMetadataResponse(
+            client, &server_rc, NULL, NULL, NULL, NULL, 0, NULL));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_NOTFOUND);
+        meta.id = 50;
+
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmDestroyObjectsRequest(client, 1, &meta.id));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmDestroyObjectsResponse(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+    }
+
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+    /* Listed metadata is cached, so GetMetadata needs no server round trip */
+    {
+        whNvmMetadata listed   = {0};
+        whNvmId       returned = 0;
+        whNvmId       gid      = 0;
+        whNvmSize     glen     = 0;
+
+        WH_TEST_RETURN_ON_FAIL(wh_Client_NvmAddObjectRequest(client, 60,
+            WOLFHSM_NVM_ACCESS_ANY, WOLFHSM_NVM_FLAGS_ANY, 0, NULL, 4,
+            (const uint8_t*)"Data"));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmAddObjectResponse(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+
+        /* Objects list in the order written, so 60 follows 44 */
+        WH_TEST_RETURN_ON_FAIL(wh_Client_NvmListMetadataRequest(
+            client, WOLFHSM_NVM_ACCESS_ANY, WOLFHSM_NVM_FLAGS_ANY, 44, 1));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(wh_Client_NvmListMetadataResponse(
+            client, &server_rc, NULL, 1, &returned, &listed));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(returned == 1);
+        WH_TEST_ASSERT_RETURN(listed.id == 60);
+
+        WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetMetadata(client, listed.id,
+            &server_rc, &gid, NULL, NULL, &glen, 0, NULL));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(gid == listed.id);
+        WH_TEST_ASSERT_RETURN(glen == 4);
+
+        /* Sending a change drops every cached entry */
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmDestroyObjectsRequest(client, 1, &listed.id));
+        for (counter = 0; counter < WH_CLIENT_NVM_CACHE_COUNT; counter++) {
+            WH_TEST_ASSERT_RETURN(client->nvm_meta[counter].id ==
+                                  WH_NVM_INVALID_ID);
+        }
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_NvmDestroyObjectsResponse(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(client->nvm_generation != 0);
+    }
+#endif /* WH_CLIENT_NVM_CACHE_COUNT > 0 */
+
     do {
         WH_TEST_RETURN_ON_FAIL(
             wh_Client_NvmListRequest(client, list_access, list_flags, list_id));
@@ -945,6 +1764,15 @@ int whTest_ClientServerSequential(void)
         }
     } while (list_count > 0);
 
+#if WH_NVM_FLASH_TOMBSTONE
+    /* Destroys left tombstones.  Compact before checking what is available */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmDestroyObjectsRequest(client, 0, NULL));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_NvmDestroyObjectsResponse(client, &server_rc));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+#endif
+
 
     WH_TEST_RETURN_ON_FAIL(wh_Client_NvmCleanupRequest(client));
     WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
@@ -970,10 +1798,27 @@ int whTest_ClientServerSequential(void)
 
     /* Test custom registered callbacks */
     WH_TEST_RETURN_ON_FAIL(_testCallbacks(server, client));
+    WH_TEST_RETURN_ON_FAIL(_testBulkCallbacks(server, client));
 
     /* Test DMA callbacks and address allowlisting */
     WH_TEST_RETURN_ON_FAIL(_testDma(server, client));
 
+    /* Test the counter service */
+    WH_TEST_RETURN_ON_FAIL(_testCounter(server, client));
+
+#ifndef WOLFHSM_NO_BATCH
+    /* Test batched requests */
+    WH_TEST_RETURN_ON_FAIL(_testBatch(server, client));
+#endif
+
+#ifdef WOLFHSM_SERVER_STATS
+    /* Test request statistics */
+    WH_TEST_RETURN_ON_FAIL(_testStats(server, client));
+#endif
+
+    /* Test the run loop */
+    WH_TEST_RETURN_ON_FAIL(_testRun(server, client, run_ctx));
+
     /* Check that we are still connected */
     WH_TEST_RETURN_ON_FAIL(wh_Server_GetConnected(server, &server_connected));
     WH_TEST_ASSERT_RETURN(server_connected == WH_COMM_CONNECTED);
@@ -991,6 +1836,7 @@ int whTest_ClientServerSequential(void)
     WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
     WH_TEST_RETURN_ON_FAIL(wh_Client_Cleanup(client));
 
+    wh_Counter_Cleanup(cn);
     wh_Nvm_Cleanup(nvm);
 #ifndef WOLFHSM_NO_CRYPTO
     wc_FreeRng(crypto->rng);
@@ -1000,12 +1846,664 @@ int whTest_ClientServerSequential(void)
     return ret;
 }
 
-int whTest_ClientCfg(whClientConfig* clientCfg)
+int whTest_ClientServerPipelined(void)
 {
-    int ret = 0;
-    whClientContext client[1] = {0};
-
-    WH_TEST_RETURN_ON_FAIL(wh_Client_Init(client, clientCfg));
+    /* Transport memory configuration */
+    uint8_t                  req[PIPELINE_BUFFER_SIZE]  = {0};
+    uint8_t                  resp[PIPELINE_BUFFER_SIZE] = {0};
+    whTransportMemRingConfig tmcf[1]                    = {{
+                  .req        = req,
+                  .req_size   = sizeof(req),
+                  .resp       = resp,
+                  .resp_size  = sizeof(resp),
+                  .slot_count = PIPELINE_DEPTH,
+    }};
+
+    /* Client configuration/contexts */
+    whTransportClientCb tccb[1] = {WH_TRANSPORT_MEMRING_CLIENT_CB};
+    whTransportMemRingClientContext tmcc[1]    = {0};
+    whCommClientConfig              cc_conf[1] = {{
+                     .transport_cb      = tccb,
+                     .transport_context = (void*)tmcc,
+                     .transport_config  = (void*)tmcf,
+                     .client_id         = 123,
+                     .connect_cb        = _clientServerSequentialTestConnectCb,
+    }};
+
+    whClientContext client[1] = {0};
+
+    whClientConfig c_conf[1] = {{
+        .comm = cc_conf,
+    }};
+
+    /* Server configuration/contexts */
+    whTransportServerCb tscb[1] = {WH_TRANSPORT_MEMRING_SERVER_CB};
+    whTransportMemRingServerContext tmsc[1]    = {0};
+    whCommServerConfig              cs_conf[1] = {{
+                     .transport_cb      = tscb,
+                     .transport_context = (void*)tmsc,
+                     .transport_config  = (void*)tmcf,
+                     .server_id         = 124,
+    }};
+
+    /* RamSim Flash state and configuration */
+    whFlashRamsimCtx fc[1]      = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 128 * 1024,  /* 128KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb  fcb[1]     = {WH_FLASH_RAMSIM_CB};
+
+    /* NVM Flash Configuration using RamSim HAL Flash */
+    whNvmFlashConfig  nf_conf[1] = {{
+         .cb      = fcb,
+         .context = fc,
+         .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1]     = {0};
+    whNvmCb           nfcb[1]    = {WH_NVM_FLASH_CB};
+
+    whNvmConfig  n_conf[1] = {{
+         .cb      = nfcb,
+         .context = nfc,
+         .config  = nf_conf,
+    }};
+    whNvmContext nvm[1]    = {{0}};
+#ifndef WOLFHSM_NO_CRYPTO
+    crypto_context crypto[1] = {{
+        .devId = INVALID_DEVID,
+    }};
+#endif
+
+    whServerConfig  s_conf[1] = {{
+         .comm_config = cs_conf,
+         .nvm         = nvm,
+#ifndef WOLFHSM_NO_CRYPTO
+         .crypto      = crypto,
+#endif
+    }};
+    whServerContext server[1] = {0};
+
+    int      counter                       = 0;
+    char     recv_buffer[WH_COMM_DATA_LEN] = {0};
+    char     send_buffer[WH_COMM_DATA_LEN] = {0};
+    uint16_t send_len                      = 0;
+    uint16_t recv_len                      = 0;
+    uint16_t pending                       = 0;
+    uint16_t group                         = 0;
+    uint16_t action                        = 0;
+    uint16_t seq                           = 0;
+    uint16_t last_seq                      = 0;
+
+    int32_t  server_rc       = 0;
+    uint32_t avail_size      = 0;
+    uint32_t reclaim_size    = 0;
+    whNvmId  avail_objects   = 0;
+    whNvmId  reclaim_objects = 0;
+
+    /* Expose the server context to our client connect callback */
+    clientServerSequentialTestServerCtx = server;
+
+#ifndef WOLFHSM_NO_CRYPTO
+    WH_TEST_RETURN_ON_FAIL(wolfCrypt_Init());
+    WH_TEST_RETURN_ON_FAIL(wc_InitRng_ex(crypto->rng, NULL, crypto->devId));
+#endif
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, s_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_Init(client, c_conf));
+
+    /* Nothing outstanding yet */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetPendingCount(client, &pending));
+    WH_TEST_ASSERT_RETURN(pending == 0);
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Client_PeekPending(client, NULL, NULL, NULL));
+
+    /* Fill the pipeline with echo requests followed by an NVM query */
+    for (counter = 0; counter < PIPELINE_DEPTH - 1; counter++) {
+        send_len =
+            snprintf(send_buffer, sizeof(send_buffer), "Request:%u", counter);
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoRequest(client, send_len, send_buffer));
+    }
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetAvailableRequest(client));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetPendingCount(client, &pending));
+    WH_TEST_ASSERT_RETURN(pending == PIPELINE_DEPTH);
+
+    /* Transport is full, so further requests are refused and not tracked */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Client_EchoRequest(client, send_len, send_buffer));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetPendingCount(client, &pending));
+    WH_TEST_ASSERT_RETURN(pending == PIPELINE_DEPTH);
+
+    /* Server drains all queued requests */
+    for (counter = 0; counter < PIPELINE_DEPTH; counter++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    }
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Server_HandleRequestMessage(server));
+
+    /* Responses complete in request order with increasing sequence numbers */
+    for (counter = 0; counter < PIPELINE_DEPTH - 1; counter++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_PeekPending(client, &group, &action, &seq));
+        WH_TEST_ASSERT_RETURN(group == WH_MESSAGE_GROUP_COMM);
+        WH_TEST_ASSERT_RETURN(action == WH_MESSAGE_COMM_ACTION_ECHO);
+        WH_TEST_ASSERT_RETURN((counter == 0) || (seq == last_seq + 1));
+        last_seq = seq;
+
+        send_len =
+            snprintf(send_buffer, sizeof(send_buffer), "Request:%u", counter);
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoResponse(client, &recv_len, recv_buffer));
+        WH_TEST_ASSERT_RETURN(recv_len == send_len);
+        WH_TEST_ASSERT_RETURN(0 == memcmp(recv_buffer, send_buffer, recv_len));
+    }
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_PeekPending(client, &group, &action, &seq));
+    WH_TEST_ASSERT_RETURN(group == WH_MESSAGE_GROUP_NVM);
+    WH_TEST_ASSERT_RETURN(seq == last_seq + 1);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetAvailableResponse(
+        client, &server_rc, &avail_size, &avail_objects, &reclaim_size,
+        &reclaim_objects));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetPendingCount(client, &pending));
+    WH_TEST_ASSERT_RETURN(pending == 0);
+
+    /* Blocking calls still work once the pipeline is drained */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client, send_len, send_buffer));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(client, &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN(recv_len == send_len);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_Cleanup(client));
+
+    wh_Nvm_Cleanup(nvm);
+#ifndef WOLFHSM_NO_CRYPTO
+    wc_FreeRng(crypto->rng);
+    wolfCrypt_Cleanup();
+#endif
+
+    return 0;
+}
+
+int whTest_ClientServerMux(void)
+{
+    /* Transport memory configuration */
+    uint8_t                  req[PIPELINE_BUFFER_SIZE]  = {0};
+    uint8_t                  resp[PIPELINE_BUFFER_SIZE] = {0};
+    whTransportMemRingConfig tmcf[1]                    = {{
+                  .req        = req,
+                  .req_size   = sizeof(req),
+                  .resp       = resp,
+                  .resp_size  = sizeof(resp),
+                  .slot_count = PIPELINE_DEPTH,
+    }};
+
+    /* Multiplexed client configuration/contexts */
+    whTransportClientCb tccb[1] = {WH_TRANSPORT_MEMRING_CLIENT_CB};
+    whTransportMemRingClientContext tmcc[1]    = {0};
+    whCommClientConfig              cc_conf[1] = {{
+                     .transport_cb      = tccb,
+                     .transport_context = (void*)tmcc,
+                     .transport_config  = (void*)tmcf,
+                     .client_id         = 123,
+    }};
+    whClientMuxConfig m_conf[1] = {{
+        .comm         = cc_conf,
+        .max_inflight = PIPELINE_DEPTH,
+    }};
+    whClientMux mux[1] = {0};
+
+    /* Server configuration/contexts */
+    whTransportServerCb tscb[1] = {WH_TRANSPORT_MEMRING_SERVER_CB};
+    whTransportMemRingServerContext tmsc[1]    = {0};
+    whCommServerConfig              cs_conf[1] = {{
+                     .transport_cb      = tscb,
+                     .transport_context = (void*)tmsc,
+                     .transport_config  = (void*)tmcf,
+                     .server_id         = 124,
+    }};
+
+    /* RamSim Flash state and configuration */
+    whFlashRamsimCtx fc[1]      = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 128 * 1024,  /* 128KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb  fcb[1]     = {WH_FLASH_RAMSIM_CB};
+    whNvmFlashConfig  nf_conf[1] = {{
+         .cb      = fcb,
+         .context = fc,
+         .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1]     = {0};
+    whNvmCb           nfcb[1]    = {WH_NVM_FLASH_CB};
+    whNvmConfig  n_conf[1] = {{
+         .cb      = nfcb,
+         .context = nfc,
+         .config  = nf_conf,
+    }};
+    whNvmContext nvm[1]    = {{0}};
+#ifndef WOLFHSM_NO_CRYPTO
+    crypto_context crypto[1] = {{
+        .devId = INVALID_DEVID,
+    }};
+#endif
+
+    whServerConfig  s_conf[1] = {{
+         .comm_config = cs_conf,
+         .nvm         = nvm,
+#ifndef WOLFHSM_NO_CRYPTO
+         .crypto      = crypto,
+#endif
+    }};
+    whServerContext server[1] = {0};
+
+    whClientContext* client[WH_CLIENT_MUX_SLOT_COUNT] = {0};
+    whClientContext* extra = NULL;
+    char     recv_buffer[WH_COMM_DATA_LEN] = {0};
+    uint16_t recv_len = 0;
+    uint16_t pending = 0;
+    int      i;
+
+#ifndef WOLFHSM_NO_CRYPTO
+    WH_TEST_RETURN_ON_FAIL(wolfCrypt_Init());
+    WH_TEST_RETURN_ON_FAIL(wc_InitRng_ex(crypto->rng, NULL, crypto->devId));
+#endif
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, s_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_SetConnected(server, WH_COMM_CONNECTED));
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Init(mux, m_conf));
+
+    /* Every slot can be acquired once */
+    for (i = 0; i < WH_CLIENT_MUX_SLOT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Acquire(mux, &client[i]));
+    }
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY == wh_ClientMux_Acquire(mux, &extra));
+    for (i = 2; i < WH_CLIENT_MUX_SLOT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Release(mux, client[i]));
+    }
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                          wh_ClientMux_Release(mux, client[2]));
+
+    /* Each slot has one request outstanding */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client[0], 1, "A"));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Client_EchoRequest(client[0], 1, "A"));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client[1], 2, "BB"));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+
+    /* The second slot takes the first response off the transport and routes
+     * it to the first slot before receiving its own */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Client_EchoResponse(client[1], &recv_len,
+                                                 recv_buffer));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(client[1], &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN((recv_len == 2) &&
+                          (0 == memcmp(recv_buffer, "BB", 2)));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(client[0], &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN((recv_len == 1) &&
+                          (0 == memcmp(recv_buffer, "A", 1)));
+
+    /* The response to a request on a released slot is discarded */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client[1], 1, "C"));
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Release(mux, client[1]));
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Acquire(mux, &client[1]));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_GetPendingCount(client[1], &pending));
+    WH_TEST_ASSERT_RETURN(pending == 0);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client[1], 1, "D"));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Client_EchoResponse(client[1], &recv_len,
+                                                 recv_buffer));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(client[1], &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN((recv_len == 1) && (recv_buffer[0] == 'D'));
+
+    /* Blocking calls */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_EchoRequest(client[0], 1, "E"));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(client[0], &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN((recv_len == 1) && (recv_buffer[0] == 'E'));
+
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Release(mux, client[0]));
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Release(mux, client[1]));
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Cleanup(mux));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+
+    wh_Nvm_Cleanup(nvm);
+#ifndef WOLFHSM_NO_CRYPTO
+    wc_FreeRng(crypto->rng);
+    wolfCrypt_Cleanup();
+#endif
+
+    return 0;
+}
+
+#if WH_SERVER_COMM_COUNT > 1
+#define MULTICOMM_CLIENT_COUNT 2
+
+static int _clientServerMultiCommConnectCb0(void* context,
+                                            whCommConnected connected)
+{
+    (void)context;
+    return wh_Server_SetCommConnected(clientServerSequentialTestServerCtx, 0,
+                                      connected);
+}
+
+static int _clientServerMultiCommConnectCb1(void* context,
+                                            whCommConnected connected)
+{
+    (void)context;
+    return wh_Server_SetCommConnected(clientServerSequentialTestServerCtx, 1,
+                                      connected);
+}
+
+int whTest_ClientServerMultiComm(void)
+{
+    /* One memory transport per client */
+    uint8_t              req[MULTICOMM_CLIENT_COUNT][BUFFER_SIZE]  = {{0}};
+    uint8_t              resp[MULTICOMM_CLIENT_COUNT][BUFFER_SIZE] = {{0}};
+    whTransportMemConfig tmcf[MULTICOMM_CLIENT_COUNT]              = {{0}};
+
+    /* Client configuration/contexts */
+    whTransportClientCb         tccb[1] = {WH_TRANSPORT_MEM_CLIENT_CB};
+    whTransportMemClientContext tmcc[MULTICOMM_CLIENT_COUNT]    = {{0}};
+    whCommClientConfig          cc_conf[MULTICOMM_CLIENT_COUNT] = {{0}};
+    whClientConfig              c_conf[MULTICOMM_CLIENT_COUNT]  = {{0}};
+    whClientContext             client[MULTICOMM_CLIENT_COUNT]  = {0};
+
+    /* Server configuration/contexts */
+    whTransportServerCb         tscb[1] = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[MULTICOMM_CLIENT_COUNT]    = {{0}};
+    whCommServerConfig          cs_conf[MULTICOMM_CLIENT_COUNT] = {{0}};
+
+    /* RamSim Flash state and configuration */
+    whFlashRamsimCtx fc[1]      = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 128 * 1024,  /* 128KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb  fcb[1]     = {WH_FLASH_RAMSIM_CB};
+
+    /* NVM Flash Configuration using RamSim HAL Flash */
+    whNvmFlashConfig  nf_conf[1] = {{
+         .cb      = fcb,
+         .context = fc,
+         .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1]     = {0};
+    whNvmCb           nfcb[1]    = {WH_NVM_FLASH_CB};
+
+    whNvmConfig  n_conf[1] = {{
+         .cb      = nfcb,
+         .context = nfc,
+         .config  = nf_conf,
+    }};
+    whNvmContext nvm[1]    = {{0}};
+#ifndef WOLFHSM_NO_CRYPTO
+    crypto_context crypto[1] = {{
+        .devId = INVALID_DEVID,
+    }};
+#endif
+
+    /* Channel 0 comes from the server config */
+    whServerConfig  s_conf[1] = {{
+         .comm_config = &cs_conf[0],
+         .nvm         = nvm,
+#ifndef WOLFHSM_NO_CRYPTO
+         .crypto      = crypto,
+#endif
+    }};
+    whServerContext server[1] = {0};
+
+    int      i                             = 0;
+    int      n                             = 0;
+    char     recv_buffer[WH_COMM_DATA_LEN] = {0};
+    char     send_buffer[WH_COMM_DATA_LEN] = {0};
+    uint16_t send_len                      = 0;
+    uint16_t recv_len                      = 0;
+    uint16_t index                         = 0;
+    uint16_t first                         = 0;
+    uint32_t client_id                     = 0;
+    uint32_t server_id                     = 0;
+#ifndef WOLFHSM_NO_CRYPTO
+    uint8_t  key[16]                       = "0123456789abcdef";
+    uint8_t  out_key[sizeof(key)]          = {0};
+    uint32_t out_key_len                   = sizeof(out_key);
+    uint16_t key_id                        = 0;
+#endif
+
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        tmcf[i].req       = (whTransportMemCsr*)req[i];
+        tmcf[i].req_size  = sizeof(req[i]);
+        tmcf[i].resp      = (whTransportMemCsr*)resp[i];
+        tmcf[i].resp_size = sizeof(resp[i]);
+
+        cc_conf[i].transport_cb      = tccb;
+        cc_conf[i].transport_context = (void*)&tmcc[i];
+        cc_conf[i].transport_config  = (void*)&tmcf[i];
+        cc_conf[i].client_id         = 1 + i;
+        c_conf[i].comm               = &cc_conf[i];
+
+        cs_conf[i].transport_cb      = tscb;
+        cs_conf[i].transport_context = (void*)&tmsc[i];
+        cs_conf[i].transport_config  = (void*)&tmcf[i];
+        cs_conf[i].server_id         = 124;
+    }
+    cc_conf[0].connect_cb = _clientServerMultiCommConnectCb0;
+    cc_conf[1].connect_cb = _clientServerMultiCommConnectCb1;
+
+    /* Expose the server context to our client connect callbacks */
+    clientServerSequentialTestServerCtx = server;
+
+#ifndef WOLFHSM_NO_CRYPTO
+    WH_TEST_RETURN_ON_FAIL(wolfCrypt_Init());
+    WH_TEST_RETURN_ON_FAIL(wc_InitRng_ex(crypto->rng, NULL, crypto->devId));
+#endif
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, s_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_AddComm(server, &cs_conf[1], 0, &index));
+    WH_TEST_ASSERT_RETURN(index == 1);
+#if WH_SERVER_COMM_COUNT == MULTICOMM_CLIENT_COUNT
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOSPACE ==
+                          wh_Server_AddComm(server, &cs_conf[1], 0, NULL));
+#endif
+
+    /* Nothing to do until a client sends a request */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Server_HandleRequestMessage(server));
+
+    /* Each channel keeps the client_id of its own client */
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Client_Init(&client[i], &c_conf[i]));
+        WH_TEST_RETURN_ON_FAIL(wh_Client_CommInitRequest(&client[i]));
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_ASSERT_RETURN(server->comm_current == i);
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_CommInitResponse(&client[i], &client_id, &server_id));
+        WH_TEST_ASSERT_RETURN(client_id == 1 + i);
+        WH_TEST_ASSERT_RETURN(server->comms[i].comm->client_id == 1 + i);
+    }
+
+    /* Channels of equal priority take turns */
+    send_len = snprintf(send_buffer, sizeof(send_buffer), "Request");
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoRequest(&client[i], send_len, send_buffer));
+    }
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    first = server->comm_current;
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(server->comm_current != first);
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoResponse(&client[i], &recv_len, recv_buffer));
+        WH_TEST_ASSERT_RETURN(recv_len == send_len);
+        WH_TEST_ASSERT_RETURN(0 == memcmp(recv_buffer, send_buffer, recv_len));
+    }
+
+    /* A higher priority channel is serviced first */
+    WH_TEST_RETURN_ON_FAIL(wh_Server_SetCommPriority(server, 1, 1));
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoRequest(&client[i], send_len, send_buffer));
+    }
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(server->comm_current == 1);
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+            wh_Client_EchoResponse(&client[0], &recv_len, recv_buffer));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(server->comm_current == 0);
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoResponse(&client[i], &recv_len, recv_buffer));
+        WH_TEST_ASSERT_RETURN(recv_len == send_len);
+    }
+
+    /* A channel not allowed the realtime class has it downgraded, so the
+     * higher priority channel still goes first */
+    WH_TEST_RETURN_ON_FAIL(
+            wh_Client_SetRequestClass(&client[0], WH_COMM_CLASS_REALTIME));
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoRequest(&client[i], send_len, send_buffer));
+    }
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(server->comm_current == 1);
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(server->comm_current == 0);
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_EchoResponse(&client[i], &recv_len, recv_buffer));
+        WH_TEST_ASSERT_RETURN(recv_len == send_len);
+    }
+    WH_TEST_RETURN_ON_FAIL(
+            wh_Client_SetRequestClass(&client[0], WH_COMM_CLASS_INTERACTIVE));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+            wh_Server_SetCommMaxClass(server, 0, WH_COMM_CLASS_COUNT));
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Server_SetCommMaxClass(server, i, WH_COMM_CLASS_REALTIME));
+    }
+
+    /* A realtime request goes ahead of a higher priority channel, and a bulk
+     * request behind a lower priority one */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+            wh_Client_SetRequestClass(&client[0], WH_COMM_CLASS_COUNT));
+    for (n = 0; n < 2; n++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Client_SetRequestClass(&client[n],
+                    (n == 0) ? WH_COMM_CLASS_REALTIME : WH_COMM_CLASS_BULK));
+        for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+            WH_TEST_RETURN_ON_FAIL(
+                wh_Client_EchoRequest(&client[i], send_len, send_buffer));
+        }
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_ASSERT_RETURN(server->comm_current == 0);
+        WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+        WH_TEST_ASSERT_RETURN(server->comm_current == 1);
+        for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+            WH_TEST_RETURN_ON_FAIL(
+                wh_Client_EchoResponse(&client[i], &recv_len, recv_buffer));
+            WH_TEST_ASSERT_RETURN(recv_len == send_len);
+        }
+        WH_TEST_RETURN_ON_FAIL(
+            wh_Client_SetRequestClass(&client[n], WH_COMM_CLASS_INTERACTIVE));
+    }
+
+    /* A frame too short for a comm header is answered and dropped, and the
+     * other channel is still served */
+    memset(send_buffer, 0, sizeof(send_buffer));
+    WH_TEST_RETURN_ON_FAIL(tccb->Send(&tmcc[0], 2, send_buffer));
+    send_len = snprintf(send_buffer, sizeof(send_buffer), "Request");
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoRequest(&client[1], send_len, send_buffer));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(server->comm_current == 1);
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(&client[1], &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN(recv_len == send_len);
+    recv_len = sizeof(recv_buffer);
+    WH_TEST_RETURN_ON_FAIL(tccb->Recv(&tmcc[0], &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoRequest(&client[0], send_len, send_buffer));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(server->comm_current == 0);
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(&client[0], &recv_len, recv_buffer));
+    WH_TEST_ASSERT_RETURN(recv_len == send_len);
+
+#ifndef WOLFHSM_NO_CRYPTO
+    /* Keys cached by one client are not visible to the other */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_KeyCacheRequest(&client[0], 0, NULL, 0,
+                                                     key, sizeof(key)));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_KeyCacheResponse(&client[0], &key_id));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_KeyExportRequest(&client[1], key_id));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_ASSERT_RETURN(0 != wh_Client_KeyExportResponse(&client[1], NULL,
+                                                0, out_key, &out_key_len));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_KeyExportRequest(&client[0], key_id));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    out_key_len = sizeof(out_key);
+    WH_TEST_RETURN_ON_FAIL(wh_Client_KeyExportResponse(&client[0], NULL, 0,
+                                                       out_key, &out_key_len));
+    WH_TEST_ASSERT_RETURN(out_key_len == sizeof(key));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(out_key, key, sizeof(key)));
+#endif
+
+    /* Closing one channel leaves the other connected */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CommCloseRequest(&client[0]));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CommCloseResponse(&client[0]));
+    WH_TEST_ASSERT_RETURN(server->comms[0].connected == WH_COMM_DISCONNECTED);
+    WH_TEST_ASSERT_RETURN(server->comms[1].connected == WH_COMM_CONNECTED);
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoRequest(&client[1], send_len, send_buffer));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleRequestMessage(server));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_Client_EchoResponse(&client[1], &recv_len, recv_buffer));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+    for (i = 0; i < MULTICOMM_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Client_Cleanup(&client[i]));
+    }
+
+    wh_Nvm_Cleanup(nvm);
+#ifndef WOLFHSM_NO_CRYPTO
+    wc_FreeRng(crypto->rng);
+    wolfCrypt_Cleanup();
+#endif
+
+    return 0;
+}
+#endif /* WH_SERVER_COMM_COUNT > 1 */
+
+int whTest_ClientCfg(whClientConfig* clientCfg)
+{
+    int ret = 0;
+    whClientContext client[1] = {0};
+
+    WH_TEST_RETURN_ON_FAIL(wh_Client_Init(client, clientCfg));
 
     int counter = 1;
     char recv_buffer[WH_COMM_DATA_LEN] = {0};
@@ -1143,6 +2641,35 @@ int whTest_ClientCfg(whClientConfig* clientCfg)
     whNvmFlags  list_flags  = WOLFHSM_NVM_FLAGS_ANY;
     whNvmId     list_id     = 0;
     whNvmId     list_count  = 0;
+
+    {
+        /* Page through the metadata of all five objects */
+        whNvmMetadata list_meta[3]  = {0};
+        whNvmId       list_returned = 0;
+
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmListMetadata(
+            client, list_access, list_flags, 0, 3, &server_rc, &list_count,
+            &list_returned, list_meta));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(list_returned == 3);
+        WH_TEST_ASSERT_RETURN(list_count == 2);
+        for (counter = 0; counter < 3; counter++) {
+            WH_TEST_ASSERT_RETURN(list_meta[counter].id == 20 + counter);
+            WH_TEST_ASSERT_RETURN(0 < list_meta[counter].len);
+        }
+
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmListMetadata(
+            client, list_access, list_flags, list_meta[2].id, 3, &server_rc,
+            &list_count, &list_returned, list_meta));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(list_returned == 2);
+        WH_TEST_ASSERT_RETURN(list_count == 0);
+        WH_TEST_ASSERT_RETURN(list_meta[0].id == 23);
+        WH_TEST_ASSERT_RETURN(list_meta[1].id == 24);
+        WH_TEST_ASSERT_RETURN(0 == strncmp((char*)list_meta[1].label,
+                                           "Label:24", WOLFHSM_NVM_LABEL_LEN));
+    }
+
     do {
         WH_TEST_RETURN_ON_FAIL(
             ret = wh_Client_NvmList(client, list_access, list_flags, list_id,
@@ -1181,6 +2708,13 @@ int whTest_ClientCfg(whClientConfig* clientCfg)
         }
     } while (list_count > 0);
 
+#if WH_NVM_FLASH_TOMBSTONE
+    /* Destroys left tombstones.  Compact before checking what is available */
+    WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmDestroyObjects(client, 0, NULL, 0,
+                                                             NULL, &server_rc));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+#endif
+
 
     WH_TEST_RETURN_ON_FAIL(wh_Client_NvmGetAvailable(
         client, &server_rc, &avail_size, &avail_objects, &reclaim_size,
@@ -1293,6 +2827,91 @@ int whTest_ClientCfg(whClientConfig* clientCfg)
         }
     } while (list_count > 0);
 
+#if WH_NVM_FLASH_TOMBSTONE
+    /* Destroys left tombstones.  Compact before checking what is available */
+    WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmDestroyObjects(client, 0, NULL, 0,
+                                                             NULL, &server_rc));
+    WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+#endif
+
+    {
+        /* Stream an object larger than one message and read it back */
+        uint8_t   big[3 * WH_COMM_DATA_LEN] = {0};
+        whNvmId   id                        = 60;
+        whNvmSize glen                      = 0;
+        whNvmSize rlen                      = 0;
+        whNvmSize offset                    = 0;
+
+        for (counter = 0; counter < (int)sizeof(big); counter++) {
+            big[counter] = (uint8_t)(counter * 7);
+        }
+
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmAddObjectStream(
+            client, id, WOLFHSM_NVM_ACCESS_ANY, WOLFHSM_NVM_FLAGS_ANY, 0, NULL,
+            sizeof(big), big, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmGetMetadata(
+            client, id, &server_rc, NULL, NULL, NULL, &glen, 0, NULL));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_ASSERT_RETURN(glen == sizeof(big));
+
+        for (offset = 0; offset < glen; offset += rlen) {
+            rlen = glen - offset;
+            if (rlen > WH_MESSAGE_NVM_MAX_READ_LEN) {
+                rlen = WH_MESSAGE_NVM_MAX_READ_LEN;
+            }
+            WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmRead(
+                client, id, offset, rlen, &server_rc, &rlen,
+                (uint8_t*)recv_buffer));
+            WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+            WH_TEST_ASSERT_RETURN(0 == memcmp(big + offset, recv_buffer, rlen));
+        }
+
+        /* Commit needs all of the data and appends cannot pass the length */
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmAddObjectBegin(
+            client, id, WOLFHSM_NVM_ACCESS_ANY, WOLFHSM_NVM_FLAGS_ANY, 0, NULL,
+            16, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_RETURN_ON_FAIL(
+            ret = wh_Client_NvmAddObjectAppend(client, 8, big, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_RETURN_ON_FAIL(
+            ret = wh_Client_NvmAddObjectCommit(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_BADARGS);
+        WH_TEST_RETURN_ON_FAIL(
+            ret = wh_Client_NvmAddObjectAppend(client, 9, big, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_BADARGS);
+
+        /* The streamed version is still current */
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmGetMetadata(
+            client, id, &server_rc, NULL, NULL, NULL, &glen, 0, NULL));
+        WH_TEST_ASSERT_RETURN(glen == sizeof(big));
+
+        /* Compacting abandons the open stream.  The destroy of the id alone
+         * may only write a tombstone, so compact explicitly */
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmDestroyObjects(
+            client, 1, &id, 0, NULL, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmDestroyObjects(
+            client, 0, NULL, 0, NULL, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_OK);
+        WH_TEST_RETURN_ON_FAIL(
+            ret = wh_Client_NvmAddObjectCommit(client, &server_rc));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_NOTFOUND);
+
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+        /* A missing object is not cached, as another client may add it
+         * without this one seeing a new generation */
+        WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmGetMetadata(
+            client, id, &server_rc, NULL, NULL, NULL, NULL, 0, NULL));
+        WH_TEST_ASSERT_RETURN(server_rc == WH_ERROR_NOTFOUND);
+        for (counter = 0; counter < WH_CLIENT_NVM_CACHE_COUNT; counter++) {
+            WH_TEST_ASSERT_RETURN(client->nvm_meta[counter].id != id);
+        }
+#endif
+    }
+
 
     WH_TEST_RETURN_ON_FAIL(ret = wh_Client_NvmCleanup(client, &server_rc));
 #if defined(WH_CFG_TEST_VERBOSE)
@@ -1479,6 +3098,184 @@ static int wh_ClientServer_MemThreadTest(void)
 
     return WH_ERROR_OK;
 }
+
+#define MUX_THREAD_COUNT 3
+#define MUX_THREAD_ECHOES 10
+
+static pthread_mutex_t _muxTestMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void _muxTestLock(void* context)
+{
+    (void)context;
+    (void)pthread_mutex_lock(&_muxTestMutex);
+}
+
+static void _muxTestUnlock(void* context)
+{
+    (void)context;
+    (void)pthread_mutex_unlock(&_muxTestMutex);
+}
+
+static void _muxTestYield(void* context)
+{
+    (void)context;
+    (void)sched_yield();
+}
+
+typedef struct {
+    whClientMux* mux;
+    int          index;
+    int          rc;
+} MuxTestThread;
+
+/* Echo requests unique to the thread through its own slot */
+static void* _whMuxClientTask(void* arg)
+{
+    MuxTestThread*   t      = (MuxTestThread*)arg;
+    whClientContext* client = NULL;
+    char     send_buffer[32];
+    char     recv_buffer[WH_COMM_DATA_LEN];
+    uint16_t send_len = 0;
+    uint16_t recv_len = 0;
+    int      i;
+
+    while ((t->rc = wh_ClientMux_Acquire(t->mux, &client)) ==
+           WH_ERROR_NOTREADY) {
+        (void)sched_yield();
+    }
+    for (i = 0; (t->rc == 0) && (i < MUX_THREAD_ECHOES); i++) {
+        send_len = snprintf(send_buffer, sizeof(send_buffer), "Thread:%d:%d",
+                            t->index, i);
+        t->rc = wh_Client_Echo(client, send_len, send_buffer, &recv_len,
+                               recv_buffer);
+        if ((t->rc == 0) && ((recv_len != send_len) ||
+                             (0 != memcmp(recv_buffer, send_buffer,
+                                          send_len)))) {
+            t->rc = WH_ERROR_ABORTED;
+        }
+    }
+    if (client != NULL) {
+        (void)wh_ClientMux_Release(t->mux, client);
+    }
+    return NULL;
+}
+
+/* Threads share a multiplexed client over a transport that holds a single
+ * request, so sends wait on responses destined for other threads */
+static int wh_ClientServer_MuxThreadTest(void)
+{
+    uint8_t req[BUFFER_SIZE] = {0};
+    uint8_t resp[BUFFER_SIZE] = {0};
+
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    whTransportClientCb         tccb[1]    = {WH_TRANSPORT_MEM_CLIENT_CB};
+    whTransportMemClientContext tmcc[1]    = {0};
+    whCommClientConfig          cc_conf[1] = {{
+                 .transport_cb      = tccb,
+                 .transport_context = (void*)tmcc,
+                 .transport_config  = (void*)tmcf,
+                 .client_id         = 123,
+    }};
+    whClientMuxConfig m_conf[1] = {{
+        .comm       = cc_conf,
+        .lock_cb    = _muxTestLock,
+        .unlock_cb  = _muxTestUnlock,
+        .yield_cb   = _muxTestYield,
+    }};
+    whClientMux mux[1] = {0};
+    whTransportServerCb         tscb[1]    = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]    = {0};
+    whCommServerConfig          cs_conf[1] = {{
+                 .transport_cb      = tscb,
+                 .transport_context = (void*)tmsc,
+                 .transport_config  = (void*)tmcf,
+                 .server_id         = 124,
+    }};
+    whFlashRamsimCtx fc[1] = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = FLASH_RAM_SIZE,
+        .sectorSize = FLASH_RAM_SIZE/2,
+        .pageSize   = 8,
+        .erasedByte = (uint8_t)0,
+    }};
+    const whFlashCb  fcb[1] = {WH_FLASH_RAMSIM_CB};
+    whNvmFlashConfig nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1] = {0};
+    whNvmCb nfcb[1] = {WH_NVM_FLASH_CB};
+    whNvmConfig n_conf[1] = {{
+            .cb = nfcb,
+            .context = nfc,
+            .config = nf_conf,
+    }};
+    whNvmContext nvm[1] = {{0}};
+#ifndef WOLFHSM_NO_CRYPTO
+    crypto_context crypto[1] = {{
+            .devId = INVALID_DEVID,
+    }};
+#endif
+    whServerConfig s_conf[1] = {{
+       .comm_config = cs_conf,
+       .nvm = nvm,
+#ifndef WOLFHSM_NO_CRYPTO
+       .crypto = crypto,
+#endif
+    }};
+
+    pthread_t        sthread = {0};
+    pthread_t        cthread[MUX_THREAD_COUNT];
+    MuxTestThread    t[MUX_THREAD_COUNT];
+    whClientContext* client = NULL;
+    int              rc = 0;
+    int              i;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+#ifndef WOLFHSM_NO_CRYPTO
+    WH_TEST_RETURN_ON_FAIL(wolfCrypt_Init());
+    WH_TEST_RETURN_ON_FAIL(wc_InitRng_ex(crypto->rng, NULL, crypto->devId));
+#endif
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Init(mux, m_conf));
+    WH_TEST_ASSERT_RETURN(0 ==
+                          pthread_create(&sthread, NULL, _whServerTask, s_conf));
+
+    for (i = 0; i < MUX_THREAD_COUNT; i++) {
+        t[i].mux   = mux;
+        t[i].index = i;
+        t[i].rc    = 0;
+        WH_TEST_ASSERT_RETURN(0 == pthread_create(&cthread[i], NULL,
+                                                  _whMuxClientTask, &t[i]));
+    }
+    for (i = 0; i < MUX_THREAD_COUNT; i++) {
+        pthread_join(cthread[i], NULL);
+        if (t[i].rc != 0) {
+            WH_ERROR_PRINT("Mux client thread %d failed %d\n", i, t[i].rc);
+            rc = t[i].rc;
+        }
+    }
+
+    /* Closing disconnects the server, ending its thread */
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Acquire(mux, &client));
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CommClose(client));
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Release(mux, client));
+    pthread_join(sthread, NULL);
+    WH_TEST_RETURN_ON_FAIL(wh_ClientMux_Cleanup(mux));
+
+    wh_Nvm_Cleanup(nvm);
+#ifndef WOLFHSM_NO_CRYPTO
+    wc_FreeRng(crypto->rng);
+    wolfCrypt_Cleanup();
+#endif
+
+    return rc;
+}
 #endif /* WH_CFG_TEST_POSIX */
 
 
@@ -1488,10 +3285,24 @@ int whTest_ClientServer(void)
     printf("Testing client/server sequential: mem...\n");
     WH_TEST_ASSERT(0 == whTest_ClientServerSequential());
 
+    printf("Testing client/server pipelined: memring...\n");
+    WH_TEST_ASSERT(0 == whTest_ClientServerPipelined());
+
+    printf("Testing client/server multiplexed: memring...\n");
+    WH_TEST_ASSERT(0 == whTest_ClientServerMux());
+
+#if WH_SERVER_COMM_COUNT > 1
+    printf("Testing client/server multiple comm channels: mem...\n");
+    WH_TEST_ASSERT(0 == whTest_ClientServerMultiComm());
+#endif
+
 #if defined(WH_CFG_TEST_POSIX)
     printf("Testing client/server: (pthread) mem...\n");
     WH_TEST_ASSERT(0 == wh_ClientServer_MemThreadTest());
 
+    printf("Testing client/server multiplexed: (pthread) mem...\n");
+    WH_TEST_ASSERT(0 == wh_ClientServer_MuxThreadTest());
+
 
 #endif /* defined(WH_CFG_TEST_POSIX) */
 
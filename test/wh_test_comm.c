@@ -28,14 +28,22 @@
 
 #include "wolfhsm/wh_error.h"
 #include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message_comm.h"
+#include "wolfhsm/wh_message.h"
+#ifndef WOLFHSM_NO_CRYPTO
+#include "wolfhsm/wh_packet.h"
+#endif
 #include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_transport_memring.h"
 #include "wolfhsm/wh_server.h"
 #include "wolfhsm/wh_client.h"
 
 #if defined(WH_CFG_TEST_POSIX)
 #include <pthread.h> /* For pthread_create/cancel/join/_t */
 #include <unistd.h>  /* For sleep */
+#include <sys/socket.h> /* For shutdown */
 #include "port/posix/posix_transport_tcp.h"
+#include "port/posix/posix_transport_shm.h"
 #endif
 
 
@@ -44,6 +52,7 @@
 #define RESP_SIZE 64
 #define REPEAT_COUNT 10
 #define ONE_MS 1000
+#define RING_SLOT_COUNT 4
 
 int whTest_CommMem(void)
 {
@@ -148,6 +157,19 @@ int whTest_CommMem(void)
                ret, rx_req_flags, rx_req_type, rx_req_seq, rx_req_len, rx_req);
 #endif
 
+        /* The request is copied out of the shared request buffer, so the
+         * client can't change it once received, and the response is built in
+         * the shared response buffer */
+        WH_TEST_ASSERT_RETURN(
+            wh_CommServer_GetDataPtr(server) ==
+            (uint8_t*)server->packet + sizeof(whCommHeader));
+        req[sizeof(whTransportMemCsr) + sizeof(whCommHeader)] ^= 0xFF;
+        WH_TEST_ASSERT_RETURN(
+            0 == memcmp(wh_CommServer_GetDataPtr(server), tx_req, tx_req_len));
+        WH_TEST_ASSERT_RETURN(
+            wh_CommServer_GetSendDataPtr(server) ==
+            resp + sizeof(whTransportMemCsr) + sizeof(whCommHeader));
+
         snprintf((char*)tx_resp, sizeof(tx_resp), "Response:%s", rx_req);
         tx_resp_len = strlen((char*)tx_resp);
         ret = wh_CommServer_SendResponse(server, rx_req_flags, rx_req_type,
@@ -181,6 +203,253 @@ int whTest_CommMem(void)
     return ret;
 }
 
+typedef struct {
+    int notify_count;
+    int wait_count;
+} whTestMemHookCounts;
+
+static int _whTest_MemNotify(void* arg)
+{
+    ((whTestMemHookCounts*)arg)->notify_count++;
+    return 0;
+}
+
+static int _whTest_MemWait(void* arg)
+{
+    /* A real port would block on an interrupt or semaphore here */
+    ((whTestMemHookCounts*)arg)->wait_count++;
+    return 0;
+}
+
+int whTest_CommMemNotify(void)
+{
+    int ret = 0;
+
+    whTestMemHookCounts c_counts[1] = {{0}};
+    whTestMemHookCounts s_counts[1] = {{0}};
+
+    /* Transport memory configuration. Each side has its own hooks */
+    uint8_t              req[BUFFER_SIZE]  = {0};
+    uint8_t              resp[BUFFER_SIZE] = {0};
+    whTransportMemConfig c_tmcf[1]         = {{
+                .req       = (whTransportMemCsr*)req,
+                .req_size  = sizeof(req),
+                .resp      = (whTransportMemCsr*)resp,
+                .resp_size = sizeof(resp),
+                .notify_cb = _whTest_MemNotify,
+                .wait_cb   = _whTest_MemWait,
+                .cb_arg    = c_counts,
+    }};
+    whTransportMemConfig s_tmcf[1]         = {{
+                .req       = (whTransportMemCsr*)req,
+                .req_size  = sizeof(req),
+                .resp      = (whTransportMemCsr*)resp,
+                .resp_size = sizeof(resp),
+                .notify_cb = _whTest_MemNotify,
+                .wait_cb   = _whTest_MemWait,
+                .cb_arg    = s_counts,
+    }};
+
+    whTransportMemClientContext tmcc[1] = {0};
+    whTransportMemServerContext tmsc[1] = {0};
+
+    uint8_t  buffer[REQ_SIZE] = "Request";
+    uint16_t len              = 0;
+
+    WH_TEST_RETURN_ON_FAIL(
+        wh_TransportMem_InitClear(tmcc, c_tmcf, NULL, NULL));
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_Init(tmsc, s_tmcf, NULL, NULL));
+
+    /* Server finds no request and goes to sleep */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_TransportMem_RecvRequest(tmsc, &len, buffer));
+    WH_TEST_ASSERT_RETURN(s_counts->wait_count == 1);
+
+    /* Client request wakes the sleeping server */
+    WH_TEST_RETURN_ON_FAIL(
+        wh_TransportMem_SendRequest(tmcc, sizeof(buffer), buffer));
+    WH_TEST_ASSERT_RETURN(c_counts->notify_count == 1);
+
+    /* Client did not sleep, so the response does not notify */
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_RecvRequest(tmsc, &len, buffer));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_TransportMem_SendResponse(tmsc, sizeof(buffer), buffer));
+    WH_TEST_ASSERT_RETURN(s_counts->notify_count == 0);
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_RecvResponse(tmcc, &len, buffer));
+    WH_TEST_ASSERT_RETURN(c_counts->wait_count == 0);
+
+    /* Server was already woken for its last wait, so no notify */
+    WH_TEST_RETURN_ON_FAIL(
+        wh_TransportMem_SendRequest(tmcc, sizeof(buffer), buffer));
+    WH_TEST_ASSERT_RETURN(c_counts->notify_count == 1);
+
+    /* Client sleeps waiting for the response and is woken by the server */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_TransportMem_RecvResponse(tmcc, &len, buffer));
+    WH_TEST_ASSERT_RETURN(c_counts->wait_count == 1);
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_RecvRequest(tmsc, &len, buffer));
+    WH_TEST_RETURN_ON_FAIL(
+        wh_TransportMem_SendResponse(tmsc, sizeof(buffer), buffer));
+    WH_TEST_ASSERT_RETURN(s_counts->notify_count == 1);
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_RecvResponse(tmcc, &len, buffer));
+    WH_TEST_ASSERT_RETURN(len == sizeof(buffer));
+
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_Cleanup(tmsc));
+    WH_TEST_RETURN_ON_FAIL(wh_TransportMem_Cleanup(tmcc));
+
+    return ret;
+}
+
+int whTest_CommMemRing(void)
+{
+    int ret = 0;
+
+    /* Transport memory configuration */
+    uint8_t                  req[BUFFER_SIZE]  = {0};
+    uint8_t                  resp[BUFFER_SIZE] = {0};
+    whTransportMemRingConfig tmcf[1]           = {{
+                  .req        = req,
+                  .req_size   = sizeof(req),
+                  .resp       = resp,
+                  .resp_size  = sizeof(resp),
+                  .slot_count = RING_SLOT_COUNT,
+    }};
+
+    /* Client configuration/contexts */
+    whTransportClientCb tccb[1] = {WH_TRANSPORT_MEMRING_CLIENT_CB};
+    whTransportMemRingClientContext tmcc[1]   = {0};
+    whCommClientConfig              c_conf[1] = {{
+                     .transport_cb      = tccb,
+                     .transport_context = (void*)tmcc,
+                     .transport_config  = (void*)tmcf,
+                     .client_id         = 123,
+    }};
+    whCommClient                    client[1] = {0};
+
+    /* Server configuration/contexts */
+    whTransportServerCb tscb[1] = {WH_TRANSPORT_MEMRING_SERVER_CB};
+    whTransportMemRingServerContext tmsc[1]   = {0};
+    whCommServerConfig              s_conf[1] = {{
+                     .transport_cb      = tscb,
+                     .transport_context = (void*)tmsc,
+                     .transport_config  = (void*)tmcf,
+                     .server_id         = 124,
+    }};
+    whCommServer                    server[1] = {0};
+
+    int      counter = 0;
+    int      slot    = 0;
+    uint16_t pending = 0;
+
+    uint8_t  tx_req[REQ_SIZE] = {0};
+    uint16_t tx_req_len       = 0;
+    uint16_t tx_req_flags     = WH_COMM_MAGIC_NATIVE;
+    uint16_t tx_req_seq       = 0;
+
+    uint8_t  rx_req[REQ_SIZE] = {0};
+    uint16_t rx_req_len       = 0;
+    uint16_t rx_req_flags     = 0;
+    uint16_t rx_req_type      = 0;
+    uint16_t rx_req_seq       = 0;
+
+    uint8_t  tx_resp[RESP_SIZE] = {0};
+    uint16_t tx_resp_len        = 0;
+
+    uint8_t  rx_resp[RESP_SIZE] = {0};
+    uint16_t rx_resp_len        = 0;
+    uint16_t rx_resp_flags      = 0;
+    uint16_t rx_resp_type       = 0;
+    uint16_t rx_resp_seq        = 0;
+
+    /* Slot indices stay in order across the count wrap only for powers of
+     * 2 */
+    tmcf->slot_count = 3;
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                          wh_TransportMemRing_Init(tmcc, tmcf, NULL, NULL));
+    tmcf->slot_count = RING_SLOT_COUNT;
+
+    /* Init client and server */
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_Init(client, c_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_Init(server, s_conf, NULL, NULL));
+
+    /* Check that neither side is ready to recv */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_CommServer_RecvRequest(server, &rx_req_flags,
+                                                    &rx_req_type, &rx_req_seq,
+                                                    &rx_req_len, rx_req));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_CommClient_RecvResponse(
+                              client, &rx_resp_flags, &rx_resp_type,
+                              &rx_resp_seq, &rx_resp_len, rx_resp));
+
+    for (counter = 0; counter < REPEAT_COUNT; counter++) {
+        /* Queue a full ring of requests */
+        for (slot = 0; slot < RING_SLOT_COUNT; slot++) {
+            snprintf((char*)tx_req, sizeof(tx_req), "Request:%u:%u", counter,
+                     slot);
+            tx_req_len = strlen((char*)tx_req);
+            WH_TEST_RETURN_ON_FAIL(wh_CommClient_SendRequest(
+                client, tx_req_flags, slot, &tx_req_seq, tx_req_len, tx_req));
+        }
+        WH_TEST_RETURN_ON_FAIL(wh_TransportMemRing_GetPending(tmcc, &pending));
+        WH_TEST_ASSERT_RETURN(pending == RING_SLOT_COUNT);
+
+        /* Ring is full until the server responds */
+        WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                              wh_CommClient_SendRequest(client, tx_req_flags, 0,
+                                                        &tx_req_seq, tx_req_len,
+                                                        tx_req));
+
+        /* Drain all of the requests before responding to any */
+        for (slot = 0; slot < RING_SLOT_COUNT; slot++) {
+            memset(rx_req, 0, sizeof(rx_req));
+            WH_TEST_RETURN_ON_FAIL(
+                wh_CommServer_RecvRequest(server, &rx_req_flags, &rx_req_type,
+                                          &rx_req_seq, &rx_req_len, rx_req));
+            WH_TEST_ASSERT_RETURN(rx_req_type == slot);
+        }
+        WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                              wh_CommServer_RecvRequest(
+                                  server, &rx_req_flags, &rx_req_type,
+                                  &rx_req_seq, &rx_req_len, rx_req));
+        WH_TEST_RETURN_ON_FAIL(wh_TransportMemRing_GetPending(tmsc, &pending));
+        WH_TEST_ASSERT_RETURN(pending == RING_SLOT_COUNT);
+
+        for (slot = 0; slot < RING_SLOT_COUNT; slot++) {
+            snprintf((char*)tx_resp, sizeof(tx_resp), "Response:%u:%u",
+                     counter, slot);
+            tx_resp_len = strlen((char*)tx_resp);
+            WH_TEST_RETURN_ON_FAIL(wh_CommServer_SendResponse(
+                server, rx_req_flags, slot, rx_req_seq, tx_resp_len, tx_resp));
+        }
+        /* No request is outstanding, so nothing to respond to */
+        WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                              wh_CommServer_SendResponse(
+                                  server, rx_req_flags, 0, rx_req_seq,
+                                  tx_resp_len, tx_resp));
+
+        /* Responses arrive in request order */
+        for (slot = 0; slot < RING_SLOT_COUNT; slot++) {
+            memset(rx_resp, 0, sizeof(rx_resp));
+            WH_TEST_RETURN_ON_FAIL(wh_CommClient_RecvResponse(
+                client, &rx_resp_flags, &rx_resp_type, &rx_resp_seq,
+                &rx_resp_len, rx_resp));
+            snprintf((char*)tx_resp, sizeof(tx_resp), "Response:%u:%u",
+                     counter, slot);
+            WH_TEST_ASSERT_RETURN(rx_resp_type == slot);
+            WH_TEST_ASSERT_RETURN(rx_resp_len == strlen((char*)tx_resp));
+            WH_TEST_ASSERT_RETURN(0 == memcmp(rx_resp, tx_resp, rx_resp_len));
+        }
+        WH_TEST_RETURN_ON_FAIL(wh_TransportMemRing_GetPending(tmcc, &pending));
+        WH_TEST_ASSERT_RETURN(pending == 0);
+    }
+
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_Cleanup(server));
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_Cleanup(client));
+
+    return ret;
+}
+
 
 #if defined WH_CFG_TEST_POSIX
 
@@ -404,6 +673,42 @@ void wh_CommClientServer_MemThreadTest(void)
     _whCommClientServerThreadTest(c_conf, s_conf);
 }
 
+void wh_CommClientServer_MemRingThreadTest(void)
+{
+    /* Transport memory configuration */
+    uint8_t                  req[BUFFER_SIZE]  = {0};
+    uint8_t                  resp[BUFFER_SIZE] = {0};
+    whTransportMemRingConfig tmcf[1]           = {{
+                  .req        = req,
+                  .req_size   = sizeof(req),
+                  .resp       = resp,
+                  .resp_size  = sizeof(resp),
+                  .slot_count = RING_SLOT_COUNT,
+    }};
+
+    /* Client configuration/contexts */
+    whTransportClientCb tmccb[1] = {WH_TRANSPORT_MEMRING_CLIENT_CB};
+    whTransportMemRingClientContext csc[1]    = {};
+    whCommClientConfig              c_conf[1] = {{
+                     .transport_cb      = tmccb,
+                     .transport_context = (void*)csc,
+                     .transport_config  = (void*)tmcf,
+                     .client_id         = 123,
+    }};
+
+    /* Server configuration/contexts */
+    whTransportServerCb tmscb[1] = {WH_TRANSPORT_MEMRING_SERVER_CB};
+    whTransportMemRingServerContext css[1]    = {};
+    whCommServerConfig              s_conf[1] = {{
+                     .transport_cb      = tmscb,
+                     .transport_context = (void*)css,
+                     .transport_config  = (void*)tmcf,
+                     .server_id         = 124,
+    }};
+
+    _whCommClientServerThreadTest(c_conf, s_conf);
+}
+
 void wh_CommClientServer_TcpThreadTest(void)
 {
     posixTransportTcpConfig mytcpconfig[1] = {{
@@ -436,19 +741,599 @@ void wh_CommClientServer_TcpThreadTest(void)
     _whCommClientServerThreadTest(c_conf, s_conf);
 }
 
+#define SHM_TEST_NAME "/wolfhsm_test_shm"
+
+void wh_CommClientServer_ShmThreadTest(void)
+{
+    /* Sleep on the futex while waiting for the peer */
+    posixTransportShmConfig myshmconfig[1] = {{
+        .name            = SHM_TEST_NAME,
+        .wait_timeout_ms = 10,
+    }};
+
+    /* Client configuration/contexts */
+    whTransportClientCb            ptshmccb[1] = {PTSHM_CLIENT_CB};
+    posixTransportShmClientContext tsc[1]      = {0};
+    whCommClientConfig             c_conf[1]   = {{
+                    .transport_cb      = ptshmccb,
+                    .transport_context = (void*)tsc,
+                    .transport_config  = (void*)myshmconfig,
+                    .client_id         = 123,
+    }};
+
+    /* Server configuration/contexts */
+    whTransportServerCb            ptshmscb[1] = {PTSHM_SERVER_CB};
+    posixTransportShmServerContext tss[1]      = {0};
+    whCommServerConfig             s_conf[1]   = {{
+                    .transport_cb      = ptshmscb,
+                    .transport_context = (void*)tss,
+                    .transport_config  = (void*)myshmconfig,
+                    .server_id         = 124,
+    }};
+
+    _whCommClientServerThreadTest(c_conf, s_conf);
+}
+
+int whTest_CommShm(void)
+{
+    posixTransportShmConfig myshmconfig[1] = {{
+        .name      = SHM_TEST_NAME,
+        .req_size  = BUFFER_SIZE,
+        .resp_size = BUFFER_SIZE,
+    }};
+
+    /* Separate mappings of the same object, as in two processes */
+    posixTransportShmClientContext tsc[1] = {0};
+    posixTransportShmServerContext tss[1] = {0};
+
+    int      counter          = 0;
+    uint8_t  tx_req[REQ_SIZE] = {0};
+    uint8_t  rx_req[REQ_SIZE] = {0};
+    uint16_t rx_req_len       = 0;
+    uint16_t buffer_len       = 0;
+    void*    buffer           = NULL;
+
+    /* Client may start before the server creates the object */
+    WH_TEST_RETURN_ON_FAIL(
+        posixTransportShm_InitConnect(tsc, myshmconfig, NULL, NULL));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+            posixTransportShm_SendRequest(tsc, sizeof(tx_req), tx_req));
+
+    WH_TEST_RETURN_ON_FAIL(
+        posixTransportShm_InitListen(tss, myshmconfig, NULL, NULL));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+            posixTransportShm_RecvRequest(tss, &rx_req_len, rx_req));
+
+    for (counter = 0; counter < REPEAT_COUNT; counter++) {
+        snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", counter);
+        WH_TEST_RETURN_ON_FAIL(posixTransportShm_SendRequest(tsc,
+                strlen((char*)tx_req), tx_req));
+        WH_TEST_RETURN_ON_FAIL(
+            posixTransportShm_RecvRequest(tss, &rx_req_len, rx_req));
+        WH_TEST_ASSERT_RETURN(rx_req_len == strlen((char*)tx_req));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(rx_req, tx_req, rx_req_len));
+
+        /* Respond in place through the shared response buffer */
+        WH_TEST_RETURN_ON_FAIL(posixTransportShm_AcquireSendResponse(tss,
+                &buffer_len, &buffer));
+        WH_TEST_ASSERT_RETURN(buffer_len == BUFFER_SIZE -
+                sizeof(whTransportMemCsr));
+        memcpy(buffer, rx_req, rx_req_len);
+        WH_TEST_RETURN_ON_FAIL(
+            posixTransportShm_SendResponse(tss, rx_req_len, buffer));
+
+        memset(rx_req, 0, sizeof(rx_req));
+        WH_TEST_RETURN_ON_FAIL(
+            posixTransportShm_RecvResponse(tsc, &rx_req_len, rx_req));
+        WH_TEST_ASSERT_RETURN(rx_req_len == strlen((char*)tx_req));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(rx_req, tx_req, rx_req_len));
+    }
+
+    /* Client notices the server going away */
+    WH_TEST_RETURN_ON_FAIL(posixTransportShm_CleanupListen(tss));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+            posixTransportShm_SendRequest(tsc, sizeof(tx_req), tx_req));
+    WH_TEST_RETURN_ON_FAIL(posixTransportShm_CleanupConnect(tsc));
+
+    return 0;
+}
+
+int whTest_CommTcpPipelined(void)
+{
+    posixTransportTcpConfig mytcpconfig[1] = {{
+        .server_ip_string = "127.0.0.1",
+        .server_port      = 23457,
+    }};
+
+    /* Client configuration/contexts */
+    whTransportClientCb            pttccb[1] = {PTT_CLIENT_CB};
+    posixTransportTcpClientContext tcc[1]    = {};
+    whCommClientConfig             c_conf[1] = {{
+                    .transport_cb      = pttccb,
+                    .transport_context = (void*)tcc,
+                    .transport_config  = (void*)mytcpconfig,
+                    .client_id         = 123,
+    }};
+    whCommClient                   client[1] = {0};
+
+    /* Server configuration/contexts */
+    whTransportServerCb            pttscb[1] = {PTT_SERVER_CB};
+    posixTransportTcpServerContext tss[1]    = {};
+    whCommServerConfig             s_conf[1] = {{
+                    .transport_cb      = pttscb,
+                    .transport_context = (void*)tss,
+                    .transport_config  = (void*)mytcpconfig,
+                    .server_id         = 124,
+    }};
+    whCommServer                   server[1] = {0};
+
+    int      counter = 0;
+    int      rc     = 0;
+    int      retries = 0;
+    uint8_t  tx_req[REQ_SIZE] = {0};
+    uint16_t tx_req_seq       = 0;
+    uint8_t  rx_req[REQ_SIZE] = {0};
+    uint16_t rx_req_len       = 0;
+    uint16_t rx_req_flags     = 0;
+    uint16_t rx_req_type      = 0;
+    uint16_t rx_req_seq       = 0;
+    uint8_t  rx_resp[RESP_SIZE] = {0};
+    uint16_t rx_resp_len        = 0;
+    uint16_t rx_resp_flags      = 0;
+    uint16_t rx_resp_type       = 0;
+    uint16_t rx_resp_seq        = 0;
+
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_Init(server, s_conf, NULL, NULL));
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_Init(client, c_conf));
+
+    /* Queue several requests before the server reads any of them */
+    for (counter = 0; counter < REPEAT_COUNT; counter++) {
+        snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", counter);
+        retries = 0;
+        do {
+            rc = wh_CommClient_SendRequest(client, WH_COMM_MAGIC_NATIVE,
+                                            counter, &tx_req_seq,
+                                            strlen((char*)tx_req), tx_req);
+        } while ((rc == WH_ERROR_NOTREADY) && (retries++ < 1000) &&
+                 (usleep(ONE_MS) == 0));
+        WH_TEST_RETURN_ON_FAIL(rc);
+    }
+
+    /* Server drains the queued requests in order. Later requests come from
+     * the first reads without further system calls */
+    for (counter = 0; counter < REPEAT_COUNT; counter++) {
+        retries = 0;
+        do {
+            rc = wh_CommServer_RecvRequest(server, &rx_req_flags,
+                                            &rx_req_type, &rx_req_seq,
+                                            &rx_req_len, rx_req);
+        } while ((rc == WH_ERROR_NOTREADY) && (retries++ < 1000) &&
+                 (usleep(ONE_MS) == 0));
+        WH_TEST_RETURN_ON_FAIL(rc);
+        snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", counter);
+        WH_TEST_ASSERT_RETURN(rx_req_type == counter);
+        WH_TEST_ASSERT_RETURN(rx_req_len == strlen((char*)tx_req));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(rx_req, tx_req, rx_req_len));
+
+        do {
+            rc = wh_CommServer_SendResponse(server, rx_req_flags, rx_req_type,
+                                             rx_req_seq, rx_req_len, rx_req);
+        } while (rc == WH_ERROR_NOTREADY);
+        WH_TEST_RETURN_ON_FAIL(rc);
+    }
+
+    /* Client receives every response in order */
+    for (counter = 0; counter < REPEAT_COUNT; counter++) {
+        retries = 0;
+        do {
+            rc = wh_CommClient_RecvResponse(client, &rx_resp_flags,
+                                             &rx_resp_type, &rx_resp_seq,
+                                             &rx_resp_len, rx_resp);
+        } while ((rc == WH_ERROR_NOTREADY) && (retries++ < 1000) &&
+                 (usleep(ONE_MS) == 0));
+        WH_TEST_RETURN_ON_FAIL(rc);
+        snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", counter);
+        WH_TEST_ASSERT_RETURN(rx_resp_type == counter);
+        WH_TEST_ASSERT_RETURN(rx_resp_len == strlen((char*)tx_req));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(rx_resp, tx_req, rx_resp_len));
+    }
+
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_Cleanup(client));
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_Cleanup(server));
+
+    return 0;
+}
+
+#if defined(__linux__)
+#define MUX_CLIENT_COUNT 2
+
+int whTest_CommTcpMux(void)
+{
+    posixTransportTcpConfig mytcpconfig[1] = {{
+        .server_ip_string = "127.0.0.1",
+        .server_port      = 23458,
+    }};
+
+    /* Client configuration/contexts */
+    whTransportClientCb            pttccb[1] = {PTT_CLIENT_CB};
+    posixTransportTcpClientContext tcc[MUX_CLIENT_COUNT] = {0};
+    whCommClientConfig             c_conf[MUX_CLIENT_COUNT] = {0};
+    whCommClient                   client[MUX_CLIENT_COUNT] = {0};
+
+    /* Server configuration/contexts sharing one listening socket */
+    posixTransportTcpMuxContext       mux[1]      = {0};
+    posixTransportTcpMuxServerConfig  msc_conf[1] = {{
+                    .mux = mux,
+    }};
+    whTransportServerCb               pttmscb[1]  = {PTT_MUX_SERVER_CB};
+    posixTransportTcpMuxServerContext tms[MUX_CLIENT_COUNT] = {0};
+    whCommServerConfig                s_conf[MUX_CLIENT_COUNT] = {0};
+    whCommServer                      server[MUX_CLIENT_COUNT] = {0};
+
+    int      i       = 0;
+    int      slot    = 0;
+    int      rc      = 0;
+    int      retries = 0;
+    uint32_t ready   = 0;
+    uint32_t served  = 0;
+    uint8_t  tx_req[REQ_SIZE] = {0};
+    uint16_t tx_req_seq       = 0;
+    uint8_t  rx_req[REQ_SIZE] = {0};
+    uint16_t rx_req_len       = 0;
+    uint16_t rx_req_flags     = 0;
+    uint16_t rx_req_type      = 0;
+    uint16_t rx_req_seq       = 0;
+    uint8_t  rx_resp[RESP_SIZE] = {0};
+    uint16_t rx_resp_len        = 0;
+    uint16_t rx_resp_flags      = 0;
+    uint16_t rx_resp_type       = 0;
+    uint16_t rx_resp_seq        = 0;
+
+    WH_TEST_RETURN_ON_FAIL(posixTransportTcpMux_Init(mux, mytcpconfig));
+
+    for (i = 0; i < MUX_CLIENT_COUNT; i++) {
+        s_conf[i].transport_cb      = pttmscb;
+        s_conf[i].transport_context = (void*)&tms[i];
+        s_conf[i].transport_config  = (void*)msc_conf;
+        s_conf[i].server_id         = 124 + i;
+        WH_TEST_RETURN_ON_FAIL(
+                wh_CommServer_Init(&server[i], &s_conf[i], NULL, NULL));
+        WH_TEST_RETURN_ON_FAIL(posixTransportTcpMux_GetSlot(&tms[i], &slot));
+        WH_TEST_ASSERT_RETURN(slot == i);
+    }
+
+    /* Nothing is pending before any client connects */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+            posixTransportTcpMux_Wait(mux, 0, &ready));
+    WH_TEST_ASSERT_RETURN(ready == 0);
+
+    for (i = 0; i < MUX_CLIENT_COUNT; i++) {
+        c_conf[i].transport_cb      = pttccb;
+        c_conf[i].transport_context = (void*)&tcc[i];
+        c_conf[i].transport_config  = (void*)mytcpconfig;
+        c_conf[i].client_id         = 123 + i;
+        WH_TEST_RETURN_ON_FAIL(wh_CommClient_Init(&client[i], &c_conf[i]));
+
+        snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", i);
+        retries = 0;
+        do {
+            rc = wh_CommClient_SendRequest(&client[i], WH_COMM_MAGIC_NATIVE,
+                                            i, &tx_req_seq,
+                                            strlen((char*)tx_req), tx_req);
+        } while ((rc == WH_ERROR_NOTREADY) && (retries++ < 1000) &&
+                 (usleep(ONE_MS) == 0));
+        WH_TEST_RETURN_ON_FAIL(rc);
+    }
+
+    /* Serve each client once its slot is reported ready */
+    retries = 0;
+    while (served != ((1ul << MUX_CLIENT_COUNT) - 1)) {
+        rc = posixTransportTcpMux_Wait(mux, 10, &ready);
+        if (rc == WH_ERROR_NOTREADY) {
+            WH_TEST_ASSERT_RETURN(retries++ < 1000);
+            continue;
+        }
+        WH_TEST_RETURN_ON_FAIL(rc);
+
+        for (i = 0; i < MUX_CLIENT_COUNT; i++) {
+            if ((ready & (1ul << i)) == 0) {
+                continue;
+            }
+            rc = wh_CommServer_RecvRequest(&server[i], &rx_req_flags,
+                                            &rx_req_type, &rx_req_seq,
+                                            &rx_req_len, rx_req);
+            if (rc == WH_ERROR_NOTREADY) {
+                continue;
+            }
+            WH_TEST_RETURN_ON_FAIL(rc);
+            snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", i);
+            WH_TEST_ASSERT_RETURN(rx_req_type == i);
+            WH_TEST_ASSERT_RETURN(rx_req_len == strlen((char*)tx_req));
+            WH_TEST_ASSERT_RETURN(0 == memcmp(rx_req, tx_req, rx_req_len));
+
+            do {
+                rc = wh_CommServer_SendResponse(&server[i], rx_req_flags,
+                                                 rx_req_type, rx_req_seq,
+                                                 rx_req_len, rx_req);
+            } while (rc == WH_ERROR_NOTREADY);
+            WH_TEST_RETURN_ON_FAIL(rc);
+            served |= (1ul << i);
+        }
+    }
+
+    for (i = 0; i < MUX_CLIENT_COUNT; i++) {
+        retries = 0;
+        do {
+            rc = wh_CommClient_RecvResponse(&client[i], &rx_resp_flags,
+                                             &rx_resp_type, &rx_resp_seq,
+                                             &rx_resp_len, rx_resp);
+        } while ((rc == WH_ERROR_NOTREADY) && (retries++ < 1000) &&
+                 (usleep(ONE_MS) == 0));
+        WH_TEST_RETURN_ON_FAIL(rc);
+        snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", i);
+        WH_TEST_ASSERT_RETURN(rx_resp_type == i);
+        WH_TEST_ASSERT_RETURN(rx_resp_len == strlen((char*)tx_req));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(rx_resp, tx_req, rx_resp_len));
+    }
+
+    /* A request sent just before the client hangs up is still served, then
+     * the client is dropped */
+    snprintf((char*)tx_req, sizeof(tx_req), "Request:%u", 0);
+    retries = 0;
+    do {
+        rc = wh_CommClient_SendRequest(&client[0], WH_COMM_MAGIC_NATIVE,
+                                        0, &tx_req_seq,
+                                        strlen((char*)tx_req), tx_req);
+    } while ((rc == WH_ERROR_NOTREADY) && (retries++ < 1000) &&
+             (usleep(ONE_MS) == 0));
+    WH_TEST_RETURN_ON_FAIL(rc);
+    WH_TEST_ASSERT_RETURN(0 == shutdown(tcc[0].connect_fd_p1 - 1, SHUT_WR));
+
+    retries = 0;
+    do {
+        rc = posixTransportTcpMux_Wait(mux, 10, &ready);
+        if ((rc == 0) && ((ready & 1) != 0)) {
+            rc = wh_CommServer_RecvRequest(&server[0], &rx_req_flags,
+                                            &rx_req_type, &rx_req_seq,
+                                            &rx_req_len, rx_req);
+        }
+    } while ((rc != 0) && (retries++ < 1000));
+    WH_TEST_RETURN_ON_FAIL(rc);
+    WH_TEST_ASSERT_RETURN(rx_req_len == strlen((char*)tx_req));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(rx_req, tx_req, rx_req_len));
+    do {
+        rc = wh_CommServer_SendResponse(&server[0], rx_req_flags,
+                                         rx_req_type, rx_req_seq,
+                                         rx_req_len, rx_req);
+    } while (rc == WH_ERROR_NOTREADY);
+    WH_TEST_RETURN_ON_FAIL(rc);
+
+    retries = 0;
+    while (tms[0].accept_fd_p1 != 0) {
+        WH_TEST_ASSERT_RETURN(retries++ < 1000);
+        (void)posixTransportTcpMux_Wait(mux, 10, &ready);
+    }
+    WH_TEST_ASSERT_RETURN(tms[1].accept_fd_p1 != 0);
+
+    retries = 0;
+    do {
+        rc = wh_CommClient_RecvResponse(&client[0], &rx_resp_flags,
+                                         &rx_resp_type, &rx_resp_seq,
+                                         &rx_resp_len, rx_resp);
+    } while ((rc == WH_ERROR_NOTREADY) && (retries++ < 1000) &&
+             (usleep(ONE_MS) == 0));
+    WH_TEST_RETURN_ON_FAIL(rc);
+    WH_TEST_ASSERT_RETURN(0 == memcmp(rx_resp, tx_req, rx_resp_len));
+
+    for (i = 0; i < MUX_CLIENT_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_CommClient_Cleanup(&client[i]));
+        WH_TEST_RETURN_ON_FAIL(wh_CommServer_Cleanup(&server[i]));
+    }
+    WH_TEST_RETURN_ON_FAIL(posixTransportTcpMux_Cleanup(mux));
+
+    return 0;
+}
+#endif /* __linux__ */
+
 #endif /* defined(WH_CFG_TEST_POSIX) */
 
+#ifndef WOLFHSM_NO_CRYPTO
+/* Key, crypto and SHE packets from a foreign client are built here by hand,
+ * translated to native by the server side tables and back for the reply */
+static int _testPacketTranslate(void)
+{
+    static uint8_t buf[sizeof(whPacket)];
+    static uint8_t expect[sizeof(whPacket)];
+    whPacket* p = (whPacket*)buf;
+    wh_Packet_pk_ecc_verify_item item;
+    const whCommField* res = NULL;
+    uint32_t off = 0;
+    uint16_t size = 0;
+    int i = 0;
+
+    /* Key cache, whose label is a byte string */
+    memset(buf, 0, sizeof(buf));
+    p->rc = 1;
+    p->flags = 2;
+    p->keyCacheReq.flags = 0x01020304;
+    p->keyCacheReq.sz = 0x10;
+    p->keyCacheReq.labelSz = 0x20;
+    p->keyCacheReq.id = 0x0506;
+    memcpy(p->keyCacheReq.label, "label", 5);
+    memcpy(expect, buf, sizeof(buf));
+    p->rc = (int32_t)wh_Translate32(WH_COMM_MAGIC_SWAP, (uint32_t)p->rc);
+    p->flags = wh_Translate16(WH_COMM_MAGIC_SWAP, p->flags);
+    p->keyCacheReq.flags = 0x04030201;
+    p->keyCacheReq.sz = 0x10000000;
+    p->keyCacheReq.labelSz = 0x20000000;
+    p->keyCacheReq.id = 0x0605;
+    size = WOLFHSM_PACKET_STUB_SIZE + sizeof(p->keyCacheReq);
+    res = wh_Packet_TranslateRequest(WH_COMM_MAGIC_SWAP,
+            WH_MESSAGE_KIND(WH_MESSAGE_GROUP_KEY, WH_KEY_CACHE), buf, size);
+    WH_TEST_ASSERT_RETURN(res != NULL);
+    WH_TEST_ASSERT_RETURN(0 == memcmp(buf, expect, size));
+    /* The reply goes back out swapped */
+    p->keyCacheRes.id = 0x0708;
+    wh_Packet_TranslateResponse(WH_COMM_MAGIC_SWAP, res, buf,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(p->keyCacheRes));
+    WH_TEST_ASSERT_RETURN(p->keyCacheRes.id == 0x0807);
+    WH_TEST_ASSERT_RETURN(p->flags == wh_Translate16(WH_COMM_MAGIC_SWAP, 2));
+    /* A native client's packets are left as they are */
+    WH_TEST_ASSERT_RETURN(NULL == wh_Packet_TranslateRequest(
+            WH_COMM_MAGIC_NATIVE,
+            WH_MESSAGE_KIND(WH_MESSAGE_GROUP_KEY, WH_KEY_CACHE), buf, size));
+    WH_TEST_ASSERT_RETURN(p->keyCacheRes.id == 0x0807);
+
+    /* Batch verify, with the item headers between the signatures. expect
+     * gets the native form and buf the foreign one */
+    memset(buf, 0, sizeof(buf));
+    memset(expect, 0, sizeof(expect));
+    ((whPacket*)expect)->pkEccVerifyBatchReq.curveId = 7;
+    ((whPacket*)expect)->pkEccVerifyBatchReq.count = 2;
+    p->pkEccVerifyBatchReq.curveId = 0x07000000;
+    p->pkEccVerifyBatchReq.count = 0x02000000;
+    off = WOLFHSM_PACKET_STUB_SIZE + sizeof(p->pkEccVerifyBatchReq);
+    for (i = 0; i < 2; i++) {
+        memset(&item, 0, sizeof(item));
+        item.keyId = (uint16_t)(0x0100 + i);
+        item.sigSz = (uint16_t)(3 + i);
+        item.hashSz = 4;
+        memcpy(expect + off, &item, sizeof(item));
+        item.keyId = wh_Translate16(WH_COMM_MAGIC_SWAP, item.keyId);
+        item.sigSz = wh_Translate16(WH_COMM_MAGIC_SWAP, item.sigSz);
+        item.hashSz = wh_Translate16(WH_COMM_MAGIC_SWAP, item.hashSz);
+        memcpy(buf + off, &item, sizeof(item));
+        off += sizeof(item);
+        memset(expect + off, 0xA0 + i, 3 + i + 4);
+        memset(buf + off, 0xA0 + i, 3 + i + 4);
+        off += 3 + i + 4;
+    }
+    size = (uint16_t)off;
+    res = wh_Packet_TranslateRequest(WH_COMM_MAGIC_SWAP,
+            WH_MESSAGE_KIND(WH_MESSAGE_GROUP_CRYPTO,
+                WH_CRYPTO_ECDSA_VERIFY_BATCH), buf, size);
+    WH_TEST_ASSERT_RETURN(res != NULL);
+    WH_TEST_ASSERT_RETURN(0 == memcmp(buf, expect, size));
+    p->pkEccVerifyBatchRes.count = 2;
+    p->pkEccVerifyBatchRes.valid = 0x3;
+    p->pkEccVerifyBatchRes.failed = 0;
+    wh_Packet_TranslateResponse(WH_COMM_MAGIC_SWAP, res, buf,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(p->pkEccVerifyBatchRes));
+    WH_TEST_ASSERT_RETURN(p->pkEccVerifyBatchRes.count == 0x02000000);
+    WH_TEST_ASSERT_RETURN(p->pkEccVerifyBatchRes.valid == 0x03000000);
+
+#ifdef WOLFHSM_SHE_EXTENSION
+    /* SHE CBC, whose key id is a single byte */
+    memset(buf, 0, sizeof(buf));
+    p->sheEncCbcReq.keyId = 4;
+    p->sheEncCbcReq.sz = 0x20;
+    memset(p->sheEncCbcReq.iv, 0x5A, sizeof(p->sheEncCbcReq.iv));
+    memcpy(expect, buf, sizeof(buf));
+    p->sheEncCbcReq.sz = 0x20000000;
+    size = WOLFHSM_PACKET_STUB_SIZE + sizeof(p->sheEncCbcReq);
+    res = wh_Packet_TranslateRequest(WH_COMM_MAGIC_SWAP,
+            WH_MESSAGE_KIND(WH_MESSAGE_GROUP_SHE, WH_SHE_ENC_CBC), buf, size);
+    WH_TEST_ASSERT_RETURN(res != NULL);
+    WH_TEST_ASSERT_RETURN(0 == memcmp(buf, expect, size));
+    p->sheEncCbcRes.sz = 0x20;
+    wh_Packet_TranslateResponse(WH_COMM_MAGIC_SWAP, res, buf,
+            WOLFHSM_PACKET_STUB_SIZE + sizeof(p->sheEncCbcRes));
+    WH_TEST_ASSERT_RETURN(p->sheEncCbcRes.sz == 0x20000000);
+#endif
+    return 0;
+}
+#endif /* !WOLFHSM_NO_CRYPTO */
+
+/* Round trip a message through its field table with both magics */
+int whTest_CommTranslate(void)
+{
+    typedef struct {
+        uint16_t a;
+        uint8_t pad[2];
+        uint32_t b[3];
+        uint64_t c;
+    } testMsg;
+    static const whCommField fields[] = {
+        WH_COMM_FIELD(testMsg, a),
+        WH_COMM_FIELD_ARRAY(testMsg, b, 3),
+        WH_COMM_FIELD(testMsg, c),
+        WH_COMM_FIELD_END
+    };
+    testMsg in = {0x0102, {0xAA, 0xBB}, {0x01020304, 0x05060708, 0x090A0B0C},
+            0x0102030405060708ULL};
+    testMsg out;
+    whMessageCommInitRequest init = {0x11223344, 0x55667788};
+    whMessageCommInitRequest init_out;
+
+    memset(&out, 0, sizeof(out));
+    WH_TEST_RETURN_ON_FAIL(wh_CommTranslate(WH_COMM_MAGIC_NATIVE, fields,
+            sizeof(in), &in, &out));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(&in, &out, sizeof(in)));
+
+    WH_TEST_RETURN_ON_FAIL(wh_CommTranslate(WH_COMM_MAGIC_SWAP, fields,
+            sizeof(in), &in, &out));
+    WH_TEST_ASSERT_RETURN(out.a == 0x0201);
+    WH_TEST_ASSERT_RETURN((out.pad[0] == 0xAA) && (out.pad[1] == 0xBB));
+    WH_TEST_ASSERT_RETURN(out.b[0] == 0x04030201);
+    WH_TEST_ASSERT_RETURN(out.b[1] == 0x08070605);
+    WH_TEST_ASSERT_RETURN(out.b[2] == 0x0C0B0A09);
+    WH_TEST_ASSERT_RETURN(out.c == 0x0807060504030201ULL);
+
+    /* In place back to the original */
+    wh_CommSwapFields(WH_COMM_MAGIC_SWAP, fields, &out, sizeof(out));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(&in, &out, sizeof(in)));
+
+    /* Fields past size are left alone */
+    wh_CommSwapFields(WH_COMM_MAGIC_SWAP, fields, &out,
+            offsetof(testMsg, c));
+    WH_TEST_ASSERT_RETURN(out.b[2] == 0x0C0B0A09);
+    WH_TEST_ASSERT_RETURN(out.c == in.c);
+
+    WH_TEST_RETURN_ON_FAIL(wh_MessageComm_TranslateInitRequest(
+            WH_COMM_MAGIC_SWAP, &init, &init_out));
+    WH_TEST_ASSERT_RETURN(init_out.client_id == 0x44332211);
+    WH_TEST_ASSERT_RETURN(init_out.max_data_len == 0x88776655);
+#ifndef WOLFHSM_NO_CRYPTO
+    WH_TEST_RETURN_ON_FAIL(_testPacketTranslate());
+#endif
+    return 0;
+}
+
 int whTest_Comm(void)
 {
+    printf("Testing comms: translate...\n");
+    WH_TEST_ASSERT(0 == whTest_CommTranslate());
+
     printf("Testing comms: mem...\n");
     WH_TEST_ASSERT(0 == whTest_CommMem());
 
+    printf("Testing comms: mem notify/wait...\n");
+    WH_TEST_ASSERT(0 == whTest_CommMemNotify());
+
+    printf("Testing comms: memring...\n");
+    WH_TEST_ASSERT(0 == whTest_CommMemRing());
+
 #if defined(WH_CFG_TEST_POSIX)
     printf("Testing comms: (pthread) mem...\n");
     wh_CommClientServer_MemThreadTest();
 
+    printf("Testing comms: (pthread) memring...\n");
+    wh_CommClientServer_MemRingThreadTest();
+
     printf("Testing comms: (pthread) tcp...\n");
     wh_CommClientServer_TcpThreadTest();
+
+    printf("Testing comms: shm...\n");
+    WH_TEST_ASSERT(0 == whTest_CommShm());
+
+    printf("Testing comms: (pthread) shm...\n");
+    wh_CommClientServer_ShmThreadTest();
+
+    printf("Testing comms: tcp pipelined...\n");
+    WH_TEST_ASSERT(0 == whTest_CommTcpPipelined());
+#if defined(__linux__)
+    WH_TEST_ASSERT(0 == whTest_CommTcpMux());
+#endif
 #endif /* defined(WH_CFG_TEST_POSIX) */
 
     return 0;
@@ -19,12 +19,52 @@
 #ifndef WH_TEST_COMM_H_
 #define WH_TEST_COMM_H_
 
+/*
+ * Runs the table driven message translation tests.
+ * Returns 0 on success and a non-zero error code on failure
+ */
+int whTest_CommTranslate(void);
+
 /*
  * Runs the comms tests using a memory transport backend.
  * Returns 0 on success and a non-zero error code on failure
  */
 int whTest_CommMem(void);
 
+/*
+ * Runs the memory transport notify/wait hook tests.
+ * Returns 0 on success and a non-zero error code on failure
+ */
+int whTest_CommMemNotify(void);
+
+/*
+ * Runs the comms tests using the multi-slot memory ring transport backend.
+ * Returns 0 on success and a non-zero error code on failure
+ */
+int whTest_CommMemRing(void);
+
+/*
+ * Runs the POSIX shared memory transport test with the client and server
+ * mapping the same object separately.
+ * Only available if WH_CFG_TEST_POSIX is defined.
+ * Returns 0 on success and a non-zero error code on failure
+ */
+int whTest_CommShm(void);
+
+/*
+ * Runs the POSIX TCP transport test with several requests queued at once.
+ * Only available if WH_CFG_TEST_POSIX is defined.
+ * Returns 0 on success and a non-zero error code on failure
+ */
+int whTest_CommTcpPipelined(void);
+
+/*
+ * Serves two TCP clients from one listening socket using the epoll mux.
+ * Only available if WH_CFG_TEST_POSIX is defined on Linux.
+ * Returns 0 on success and a non-zero error code on failure
+ */
+int whTest_CommTcpMux(void);
+
 /* Runs all the comms tests using a memory transport as the backend, and
  * optionally using the POSIX TCP backend if WH_CFG_TEST_POSIX is defined.
  *
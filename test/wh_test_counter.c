@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wh_test_common.h"
+#include "wh_test_counter.h"
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_flash_ramsim.h"
+#include "wolfhsm/wh_flash_unit.h"
+#include "wolfhsm/wh_counter.h"
+
+#define TEST_FLASH_SIZE (8 * 1024)
+#define TEST_SECTOR_SIZE (1024)
+#define TEST_PAGE_SIZE (8)
+
+/* Records that fit in one half after its header */
+#define TEST_HALF_RECORDS (TEST_FLASH_SIZE / 2 / WHFU_BYTES_PER_UNIT - 1)
+
+int whTest_Counter(void)
+{
+    const whFlashCb  cb[1]      = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx fc[1]      = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = TEST_FLASH_SIZE,
+        .sectorSize = TEST_SECTOR_SIZE,
+        .pageSize   = TEST_PAGE_SIZE,
+        .erasedByte = ~(uint8_t)0,
+    }};
+    whCounterConfig  conf[1] = {{
+        .cb      = cb,
+        .context = fc,
+        .config  = fc_conf,
+        .offset  = 0,
+        .size    = TEST_FLASH_SIZE,
+    }};
+    whCounterContext ctx[1] = {{0}};
+    whCounterContext remount[1] = {{0}};
+    whFlashUnit      torn = 0;
+    uint32_t         value = 0;
+    uint32_t         epoch = 0;
+    int              rc = 0;
+    int              i = 0;
+
+    printf("Testing non-volatile counters...\n");
+
+    /* The area must hold two halves with room for every counter */
+    conf->size = 2 * (WH_COUNTER_COUNT + 1) * WHFU_BYTES_PER_UNIT;
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS == wh_Counter_Init(ctx, conf));
+    conf->size = TEST_FLASH_SIZE;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Init(ctx, conf));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND == wh_Counter_Read(ctx, 1, &value));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Counter_Increment(ctx, 1, &value));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Set(ctx, 1, 10));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Read(ctx, 1, &value));
+    WH_TEST_ASSERT_RETURN(value == 10);
+
+    /* Enough increments to fill and compact each half more than once */
+    epoch = ctx->epoch;
+    for (i = 0; i < 3 * TEST_HALF_RECORDS; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Counter_Increment(ctx, 1, &value));
+        WH_TEST_ASSERT_RETURN(value == 10 + (uint32_t)i + 1);
+    }
+    WH_TEST_ASSERT_RETURN(ctx->epoch >= epoch + 3);
+
+    /* Saturates instead of wrapping */
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Set(ctx, 2, UINT32_MAX - 1));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Increment(ctx, 2, &value));
+    WH_TEST_ASSERT_RETURN(value == UINT32_MAX);
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Increment(ctx, 2, &value));
+    WH_TEST_ASSERT_RETURN(value == UINT32_MAX);
+
+    /* Mounting the same flash again recovers every value.  The ramsim frees
+     * its memory on cleanup, so only the counter context is replaced */
+    conf->config = NULL;
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Init(remount, conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Read(remount, 1, &value));
+    WH_TEST_ASSERT_RETURN(value == 10 + 3 * TEST_HALF_RECORDS);
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Read(remount, 2, &value));
+    WH_TEST_ASSERT_RETURN(value == UINT32_MAX);
+    WH_TEST_ASSERT_RETURN(remount->epoch == ctx->epoch);
+    WH_TEST_ASSERT_RETURN(remount->next_unit == ctx->next_unit);
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Cleanup(ctx));
+
+    /* A torn record is skipped by a mount */
+    torn = ~(whFlashUnit)0 ^ 0x1;
+    WH_TEST_RETURN_ON_FAIL(wh_FlashUnit_Program(cb, fc,
+            remount->offset + (remount->active ? remount->half_units : 0) +
+            remount->next_unit, 1, &torn));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Init(ctx, conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Read(ctx, 1, &value));
+    WH_TEST_ASSERT_RETURN(value == 10 + 3 * TEST_HALF_RECORDS);
+    WH_TEST_ASSERT_RETURN(ctx->next_unit == remount->next_unit + 1);
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Cleanup(remount));
+
+    /* Destroyed counters stay destroyed across a mount */
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Destroy(ctx, 2));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND == wh_Counter_Read(ctx, 2, &value));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Destroy(ctx, 2));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Init(remount, conf));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Counter_Read(remount, 2, &value));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Cleanup(remount));
+
+    /* Fill the table */
+    for (i = 1; i < WH_COUNTER_COUNT; i++) {
+        WH_TEST_RETURN_ON_FAIL(wh_Counter_Set(ctx, (whCounterId)(100 + i),
+                (uint32_t)i));
+    }
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOSPACE == wh_Counter_Set(ctx, 99, 0));
+    /* Existing counters can still change */
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Set(ctx, 101, 1000));
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Read(ctx, 101, &value));
+    WH_TEST_ASSERT_RETURN(value == 1000);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Counter_Cleanup(ctx));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS == wh_Counter_Read(ctx, 1, &value));
+
+    rc = cb->Cleanup(fc);
+    return rc;
+}
@@ -28,6 +28,9 @@
 #ifndef WOLFHSM_NO_CRYPTO
 
 #include "wolfssl/wolfcrypt/settings.h"
+#include "wolfssl/wolfcrypt/sha256.h"
+#include "wolfssl/wolfcrypt/hmac.h"
+#include "wolfssl/wolfcrypt/cmac.h"
 
 #if defined(WH_CONFIG)
 #include "wh_config.h"
@@ -40,6 +43,9 @@
 #include "wolfhsm/wh_comm.h"
 #include "wolfhsm/wh_message.h"
 #include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_server_keystore.h"
+#include "wolfhsm/wh_server_crypto.h"
+#include "wolfhsm/wh_packet.h"
 #include "wolfhsm/wh_client.h"
 #include "wolfhsm/wh_transport_mem.h"
 
@@ -78,10 +84,17 @@ int whTest_CryptoClientConfig(whClientConfig* config)
     RsaKey rsa[1];
     ecc_key eccPrivate[1];
     ecc_key eccPublic[1];
+    whClientEccVerifyItem eccItems[4];
+    int eccResults[4];
     curve25519_key curve25519PrivateKey[1];
     curve25519_key curve25519PublicKey[1];
     uint32_t outLen;
+    uint32_t secretSz;
     uint16_t keyId;
+    uint16_t jobId;
+    uint32_t streamHandle;
+    uint16_t keyIds[WOLFHSM_NUM_RAMKEYS];
+    int i;
     uint8_t key[16];
     uint8_t keyEnd[16];
     uint8_t labelStart[WOLFHSM_NVM_LABEL_LEN];
@@ -92,8 +105,32 @@ int whTest_CryptoClientConfig(whClientConfig* config)
     char finalText[256];
     uint8_t authIn[16];
     uint8_t authTag[16];
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    uint8_t reuseTag[16];
+#endif
     uint8_t sharedOne[CURVE25519_KEYSIZE];
     uint8_t sharedTwo[CURVE25519_KEYSIZE];
+#ifndef NO_SHA256
+    wc_Sha256 sha[1];
+    uint8_t digest[WC_SHA256_DIGEST_SIZE];
+    uint8_t digestEnd[WC_SHA256_DIGEST_SIZE];
+    uint8_t hashIn[WH_COMM_DATA_LEN + 64];
+#ifdef WOLF_CRYPTO_CB_COPY
+    wc_Sha256 shaCopy[1];
+#endif
+#endif
+#ifndef NO_HMAC
+    Hmac hmac[1];
+#endif
+#ifdef HAVE_ED25519
+    ed25519_key ed25519[1];
+    uint8_t ed25519Sig[ED25519_SIG_SIZE];
+#endif
+#ifdef WOLFSSL_CMAC
+    Cmac cmac[1];
+    uint8_t cmacOut[AES_BLOCK_SIZE];
+    uint8_t cmacEnd[AES_BLOCK_SIZE];
+#endif
 
     XMEMCPY(plainText, PLAINTEXT, sizeof(plainText));
 
@@ -121,6 +158,20 @@ int whTest_CryptoClientConfig(whClientConfig* config)
         printf("Failed to wc_RNG_GenerateBlock %d\n", ret);
         goto exit;
     }
+    /* larger than the pool, so it is taken from it and the DRBG */
+    if ((ret = wc_RNG_GenerateBlock(rng, (byte*)cipherText, sizeof(cipherText))) != 0) {
+        WH_ERROR_PRINT("Failed to wc_RNG_GenerateBlock %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_RNG_GenerateBlock(rng, (byte*)finalText, sizeof(finalText))) != 0) {
+        WH_ERROR_PRINT("Failed to wc_RNG_GenerateBlock %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(cipherText, finalText, sizeof(cipherText)) == 0) {
+        WH_ERROR_PRINT("RNG REPEATED OUTPUT\n");
+        ret = -1;
+        goto exit;
+    }
     printf("RNG SUCCESS\n");
     /* test cache/export */
     keyId = 0;
@@ -235,6 +286,167 @@ int whTest_CryptoClientConfig(whClientConfig* config)
         goto exit;
     }
     printf("KEY ERASE SUCCESS\n");
+    /* fill the cache, then check lookups survive evicting every other key */
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        XMEMSET(key, i, sizeof(key));
+        keyIds[i] = 0;
+        if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+            goto exit;
+        }
+    }
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i += 2) {
+        if ((ret = wh_Client_KeyEvict(client, keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+            goto exit;
+        }
+    }
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        outLen = sizeof(keyEnd);
+        ret = wh_Client_KeyExport(client, keyIds[i], labelEnd, sizeof(labelEnd), keyEnd, &outLen);
+        if ((i % 2) == 0) {
+            if (ret != WH_ERROR_NOTFOUND) {
+                WH_ERROR_PRINT("Failed to wh_Client_KeyExport %d\n", ret);
+                goto exit;
+            }
+            continue;
+        }
+        XMEMSET(key, i, sizeof(key));
+        if (ret != 0 || outLen != sizeof(key) || XMEMCMP(key, keyEnd, outLen) != 0) {
+            WH_ERROR_PRINT("KEY CACHE INDEX FAILED TO MATCH %d\n", ret);
+            goto exit;
+        }
+        if ((ret = wh_Client_KeyEvict(client, keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+            goto exit;
+        }
+    }
+    printf("KEY CACHE INDEX SUCCESS\n");
+    /* commited keys make room for new ones, unless they are pinned */
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        keyIds[i] = 0;
+        if ((ret = wh_Client_KeyCache(client, WOLFHSM_NVM_FLAGS_PINNED, labelStart, sizeof(labelStart), key, sizeof(key), &keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+            goto exit;
+        }
+        if ((ret = wh_Client_KeyCommit(client, keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCommit %d\n", ret);
+            goto exit;
+        }
+    }
+    keyId = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyId)) != WH_ERROR_NOSPACE) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        if ((ret = wh_Client_KeyErase(client, keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyErase %d\n", ret);
+            goto exit;
+        }
+    }
+    printf("KEY CACHE PIN SUCCESS\n");
+    /* ids of keys only present in NVM are not handed out again */
+    keyIds[0] = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyIds[0])) != 0 ||
+        (ret = wh_Client_KeyCommit(client, keyIds[0])) != 0 ||
+        (ret = wh_Client_KeyEvict(client, keyIds[0])) != 0) {
+        WH_ERROR_PRINT("Failed to cache and commit key %d\n", ret);
+        goto exit;
+    }
+    keyIds[1] = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyIds[1])) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    if (keyIds[1] == keyIds[0]) {
+        WH_ERROR_PRINT("KEY ID REUSED\n");
+        ret = -1;
+        goto exit;
+    }
+    if ((ret = wh_Client_KeyErase(client, keyIds[0])) != 0 ||
+        (ret = wh_Client_KeyEvict(client, keyIds[1])) != 0) {
+        WH_ERROR_PRINT("Failed to remove keys %d\n", ret);
+        goto exit;
+    }
+    printf("KEY ID ALLOCATION SUCCESS\n");
+    /* keys too big for the small slots only fit in the large ones */
+    XMEMSET(cipherText, 0xa5, sizeof(cipherText));
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS - WOLFHSM_KEYCACHE_SMALL_COUNT; i++) {
+        keyIds[i] = 0;
+        if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), (uint8_t*)cipherText, sizeof(cipherText), &keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+            goto exit;
+        }
+    }
+    keyId = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), (uint8_t*)cipherText, sizeof(cipherText), &keyId)) != WH_ERROR_NOSPACE) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    keyId = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyId)) != 0 ||
+        (ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to cache small key %d\n", ret);
+        goto exit;
+    }
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS - WOLFHSM_KEYCACHE_SMALL_COUNT; i++) {
+        if ((ret = wh_Client_KeyEvict(client, keyIds[i])) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+            goto exit;
+        }
+    }
+    printf("KEY CACHE SIZE CLASS SUCCESS\n");
+    /* keys over the comm buffer size go through DMA into the big slots */
+    {
+        uint8_t bigKey[WOLFHSM_KEYCACHE_BIG_BUFSIZE];
+        uint8_t bigOut[WOLFHSM_KEYCACHE_BIG_BUFSIZE];
+        for (i = 0; i < (int)sizeof(bigKey); i++)
+            bigKey[i] = (uint8_t)(i * 7);
+        keyId = 0;
+        if ((ret = wh_Client_KeyCacheDma(client, 0, labelStart, sizeof(labelStart), bigKey, sizeof(bigKey), &keyId)) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCacheDma %d\n", ret);
+            goto exit;
+        }
+        outLen = sizeof(bigOut) - 1;
+        if ((ret = wh_Client_KeyExportDma(client, keyId, NULL, 0, bigOut, &outLen)) != WH_ERROR_NOSPACE) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyExportDma %d\n", ret);
+            goto exit;
+        }
+        /* export once from the cache and once from NVM */
+        if ((ret = wh_Client_KeyCommit(client, keyId)) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCommit %d\n", ret);
+            goto exit;
+        }
+        for (i = 0; i < 2; i++) {
+            XMEMSET(bigOut, 0, sizeof(bigOut));
+            XMEMSET(labelEnd, 0, sizeof(labelEnd));
+            outLen = sizeof(bigOut);
+            if ((ret = wh_Client_KeyExportDma(client, keyId, labelEnd, sizeof(labelEnd), bigOut, &outLen)) != 0) {
+                WH_ERROR_PRINT("Failed to wh_Client_KeyExportDma %d\n", ret);
+                goto exit;
+            }
+            if (outLen != sizeof(bigKey) || XMEMCMP(bigKey, bigOut, outLen) != 0 || XMEMCMP(labelStart, labelEnd, sizeof(labelStart)) != 0) {
+                WH_ERROR_PRINT("KEY DMA EXPORT FAILED TO MATCH\n");
+                ret = -1;
+                goto exit;
+            }
+            if (i == 0 && (ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+                WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+                goto exit;
+            }
+        }
+        if ((ret = wh_Client_KeyErase(client, keyId)) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyErase %d\n", ret);
+            goto exit;
+        }
+    }
+    printf("KEY DMA CACHE/EXPORT SUCCESS\n");
+    /* restore the key used by the tests below */
+    if ((ret = wc_RNG_GenerateBlock(rng, key, sizeof(key))) != 0) {
+        WH_ERROR_PRINT("Failed to wc_RNG_GenerateBlock %d\n", ret);
+        goto exit;
+    }
     /* test aes CBC */
     if((ret = wc_AesInit(aes, NULL, WOLFHSM_DEV_ID)) != 0) {
         printf("Failed to wc_AesInit %d\n", ret);
@@ -272,6 +484,41 @@ int whTest_CryptoClientConfig(whClientConfig* config)
         goto exit;
     }
 #ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    /* the server keeps the context set up for the key, with a fresh IV the
+     * same key must give the same output */
+    if ((ret = wc_AesSetIV(aes, iv)) != 0) {
+        printf("Failed to wc_AesSetIV %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_AesCbcEncrypt(aes, (byte*)cipherText + sizeof(plainText), (byte*)plainText, sizeof(plainText))) != 0) {
+        printf("Failed to wc_AesCbcEncrypt %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(cipherText, cipherText + sizeof(plainText), sizeof(plainText)) != 0) {
+        WH_ERROR_PRINT("AES CBC REUSED KEY FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    /* rewriting the key must drop the kept context */
+    key[0] ^= 0x01;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyId)) != 0) {
+        printf("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    key[0] ^= 0x01;
+    if ((ret = wc_AesSetIV(aes, iv)) != 0) {
+        printf("Failed to wc_AesSetIV %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_AesCbcEncrypt(aes, (byte*)cipherText + sizeof(plainText), (byte*)plainText, sizeof(plainText))) != 0) {
+        printf("Failed to wc_AesCbcEncrypt %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(cipherText, cipherText + sizeof(plainText), sizeof(plainText)) == 0) {
+        WH_ERROR_PRINT("AES CBC USED THE OLD KEY\n");
+        ret = -1;
+        goto exit;
+    }
     if((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
         printf("Failed to wh_Client_KeyEvict %d\n", ret);
         goto exit;
@@ -318,6 +565,32 @@ int whTest_CryptoClientConfig(whClientConfig* config)
         goto exit;
     }
 #ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    /* again on the kept context, then after rewriting the key */
+    if ((ret = wc_AesGcmEncrypt(aes, (byte*)cipherText + sizeof(plainText), (byte*)plainText, sizeof(plainText), iv, sizeof(iv), reuseTag, sizeof(reuseTag), authIn, sizeof(authIn))) != 0) {
+        printf("Failed to wc_AesGcmEncrypt %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(cipherText, cipherText + sizeof(plainText), sizeof(plainText)) != 0 ||
+        memcmp(authTag, reuseTag, sizeof(authTag)) != 0) {
+        WH_ERROR_PRINT("AES GCM REUSED KEY FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    key[0] ^= 0x01;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyId)) != 0) {
+        printf("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    key[0] ^= 0x01;
+    if ((ret = wc_AesGcmEncrypt(aes, (byte*)cipherText + sizeof(plainText), (byte*)plainText, sizeof(plainText), iv, sizeof(iv), reuseTag, sizeof(reuseTag), authIn, sizeof(authIn))) != 0) {
+        printf("Failed to wc_AesGcmEncrypt %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(authTag, reuseTag, sizeof(authTag)) == 0) {
+        WH_ERROR_PRINT("AES GCM USED THE OLD KEY\n");
+        ret = -1;
+        goto exit;
+    }
     if((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
         printf("Failed to wh_Client_KeyEvict %d\n", ret);
         goto exit;
@@ -327,180 +600,973 @@ int whTest_CryptoClientConfig(whClientConfig* config)
         printf("AES GCM SUCCESS\n");
     else
         printf("AES GCM FAILED TO MATCH\n");
-    /* test rsa */
-    if((ret = wc_InitRsaKey_ex(rsa, NULL, WOLFHSM_DEV_ID)) != 0) {
-        printf("Failed to wc_InitRsaKey_ex %d\n", ret);
+    /* test aes streams, two updates checked against the one shot api */
+    if((ret = wc_AesInit(aes, NULL, WOLFHSM_DEV_ID)) != 0) {
+        printf("Failed to wc_AesInit %d\n", ret);
         goto exit;
     }
-    if((ret = wc_MakeRsaKey(rsa, 2048, 65537, rng)) != 0) {
-        printf("Failed to wc_MakeRsaKey %d\n", ret);
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    keyId = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyId)) != 0) {
+        printf("Failed to wh_Client_KeyCache %d\n", ret);
         goto exit;
     }
-    if ((ret = wc_RsaPublicEncrypt((byte*)plainText, sizeof(plainText), (byte*)cipherText,
-        sizeof(cipherText), rsa, rng)) < 0) {
-        printf("Failed to wc_RsaPublicEncrypt %d\n", ret);
+    wh_Client_SetKeyAes(aes, keyId);
+#else
+    if ((ret = wc_AesSetKey(aes, key, AES_BLOCK_SIZE, iv, AES_ENCRYPTION)) != 0) {
+        printf("Failed to wc_AesSetKey %d\n", ret);
         goto exit;
     }
-    if ((ret = wc_RsaPrivateDecrypt((byte*)cipherText, ret, (byte*)finalText,
-        sizeof(finalText), rsa)) < 0) {
-        printf("Failed to wc_RsaPrivateDecrypt %d\n", ret);
+#endif
+    if ((ret = wh_Client_AesStreamInit(client, aes, WC_CIPHER_AES_CBC, 1, iv, sizeof(iv), &streamHandle)) != 0) {
+        printf("Failed to wh_Client_AesStreamInit %d\n", ret);
         goto exit;
     }
-    XMEMCPY((uint8_t*)&keyId, (uint8_t*)&rsa->devCtx, sizeof(keyId));
-    if ((ret = wh_Client_KeyEvictRequest(client, keyId)) != 0) {
-        WH_ERROR_PRINT("Failed to wh_Client_KeyEvictRequest %d\n", ret);
+    for (i = 0; i < 2; i++) {
+        if ((ret = wh_Client_AesStreamUpdate(client, streamHandle, (uint8_t*)plainText, sizeof(plainText), NULL, 0, (uint8_t*)cipherText + i * sizeof(plainText))) != 0) {
+            printf("Failed to wh_Client_AesStreamUpdate %d\n", ret);
+            goto exit;
+        }
+    }
+    if ((ret = wh_Client_AesStreamFinal(client, streamHandle, NULL, 0)) != 0) {
+        printf("Failed to wh_Client_AesStreamFinal %d\n", ret);
         goto exit;
     }
-    do {
-        ret = wh_Client_KeyEvictResponse(client);
-    } while (ret == WH_ERROR_NOTREADY);
-    if (ret != 0) {
-        WH_ERROR_PRINT("Failed to wh_Client_KeyEvictResponse %d\n", ret);
+    /* the stream is closed after final */
+    if ((ret = wh_Client_AesStreamUpdate(client, streamHandle, (uint8_t*)plainText, sizeof(plainText), NULL, 0, (uint8_t*)finalText)) != WH_ERROR_NOTFOUND) {
+        printf("Failed to reject a closed stream %d\n", ret);
+        ret = -1;
         goto exit;
     }
-    if((ret = wc_FreeRsaKey(rsa)) != 0) {
-        printf("Failed to wc_FreeRsaKey %d\n", ret);
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    if ((ret = wc_AesSetIV(aes, iv)) != 0) {
+        printf("Failed to wc_AesSetIV %d\n", ret);
         goto exit;
     }
-    printf("RSA KEYGEN SUCCESS\n");
-    if (memcmp(plainText, finalText, sizeof(plainText)) == 0)
-        printf("RSA SUCCESS\n");
-    else
-        printf("RSA FAILED TO MATCH\n");
-    /* test ecc */
-    if((ret = wc_ecc_init_ex(eccPrivate, NULL, WOLFHSM_DEV_ID)) != 0) {
-        printf("Failed to wc_ecc_init_ex %d\n", ret);
+#else
+    if ((ret = wc_AesSetKey(aes, key, AES_BLOCK_SIZE, iv, AES_DECRYPTION)) != 0) {
+        printf("Failed to wc_AesSetKey %d\n", ret);
         goto exit;
     }
-    if((ret = wc_ecc_init_ex(eccPublic, NULL, WOLFHSM_DEV_ID)) != 0) {
-        printf("Failed to wc_ecc_init_ex %d\n", ret);
+#endif
+    if ((ret = wc_AesCbcDecrypt(aes, (byte*)finalText, (byte*)cipherText, 2 * sizeof(plainText))) != 0) {
+        printf("Failed to wc_AesCbcDecrypt %d\n", ret);
         goto exit;
     }
-    if((ret = wc_ecc_make_key(rng, 32, eccPrivate)) != 0) {
-        printf("Failed to wc_ecc_make_key %d\n", ret);
+    if (memcmp(plainText, finalText, sizeof(plainText)) != 0 ||
+        memcmp(plainText, finalText + sizeof(plainText), sizeof(plainText)) != 0) {
+        printf("AES CBC STREAM FAILED TO MATCH\n");
+        ret = -1;
         goto exit;
     }
-    if((ret = wc_ecc_make_key(rng, 32, eccPublic)) != 0) {
-        printf("Failed to wc_ecc_make_key %d\n", ret);
+    printf("AES CBC STREAM SUCCESS\n");
+#ifdef WOLFSSL_AESGCM_STREAM
+    if ((ret = wh_Client_AesStreamInit(client, aes, WC_CIPHER_AES_GCM, 1, iv, sizeof(iv), &streamHandle)) != 0) {
+        printf("Failed to wh_Client_AesStreamInit %d\n", ret);
         goto exit;
     }
-    outLen = 32;
-    if((ret = wc_ecc_shared_secret(eccPrivate, eccPublic, (byte*)cipherText, &outLen)) != 0) {
-        printf("Failed to wc_ecc_shared_secret %d\n", ret);
+    if ((ret = wh_Client_AesStreamUpdate(client, streamHandle, NULL, 0, authIn, sizeof(authIn), NULL)) != 0) {
+        printf("Failed to wh_Client_AesStreamUpdate %d\n", ret);
         goto exit;
     }
-    if((ret = wc_ecc_shared_secret(eccPublic, eccPrivate, (byte*)finalText, &outLen)) != 0) {
-        printf("Failed to wc_ecc_shared_secret %d\n", ret);
+    for (i = 0; i < 2; i++) {
+        if ((ret = wh_Client_AesStreamUpdate(client, streamHandle, (uint8_t*)plainText, sizeof(plainText), NULL, 0, (uint8_t*)cipherText + i * sizeof(plainText))) != 0) {
+            printf("Failed to wh_Client_AesStreamUpdate %d\n", ret);
+            goto exit;
+        }
+    }
+    if ((ret = wh_Client_AesStreamFinal(client, streamHandle, authTag, sizeof(authTag))) != 0) {
+        printf("Failed to wh_Client_AesStreamFinal %d\n", ret);
         goto exit;
     }
-    if (memcmp(cipherText, finalText, outLen) == 0)
-        printf("ECDH SUCCESS\n");
-    else
-        printf("ECDH FAILED TO MATCH\n");
-    outLen = 32;
-    if((ret = wc_ecc_sign_hash((void*)cipherText, sizeof(cipherText), (void*)finalText, &outLen, rng, eccPrivate)) != 0) {
-        printf("Failed to wc_ecc_sign_hash %d\n", ret);
+    if ((ret = wc_AesGcmDecrypt(aes, (byte*)finalText, (byte*)cipherText, 2 * sizeof(plainText), iv, sizeof(iv), authTag, sizeof(authTag), authIn, sizeof(authIn))) != 0) {
+        printf("Failed to wc_AesGcmDecrypt %d\n", ret);
         goto exit;
     }
-    if((ret = wc_ecc_verify_hash((void*)finalText, outLen, (void*)cipherText, sizeof(cipherText), &res, eccPrivate)) != 0) {
-        printf("Failed to wc_ecc_verify_hash %d\n", ret);
+    if (memcmp(plainText, finalText, sizeof(plainText)) != 0 ||
+        memcmp(plainText, finalText + sizeof(plainText), sizeof(plainText)) != 0) {
+        printf("AES GCM STREAM FAILED TO MATCH\n");
+        ret = -1;
         goto exit;
     }
-    if (res == 1)
-        printf("ECC SIGN/VERIFY SUCCESS\n");
-    else
-        printf("ECC SIGN/VERIFY FAIL\n");
-    /* test curve25519 */
-    if ((ret = wc_curve25519_init_ex(curve25519PrivateKey, NULL, WOLFHSM_DEV_ID)) != 0) {
-        WH_ERROR_PRINT("Failed to wc_curve25519_init_ex %d\n", ret);
+    printf("AES GCM STREAM SUCCESS\n");
+#endif
+    /* test aes on client memory through dma */
+    for (i = 0; i < 4; i++)
+        XMEMCPY(cipherText + i * sizeof(plainText), plainText, sizeof(plainText));
+    if ((ret = wh_Client_AesCbcDma(client, aes, 1, iv, (uint8_t*)cipherText, 4 * sizeof(plainText), (uint8_t*)cipherText)) != 0) {
+        printf("Failed to wh_Client_AesCbcDma %d\n", ret);
         goto exit;
     }
-    if ((ret = wc_curve25519_init_ex(curve25519PublicKey, NULL, WOLFHSM_DEV_ID)) != 0) {
-        WH_ERROR_PRINT("Failed to wc_curve25519_init_ex %d\n", ret);
+    if ((ret = wh_Client_AesCbcDma(client, aes, 0, iv, (uint8_t*)cipherText, 4 * sizeof(plainText), (uint8_t*)finalText)) != 0) {
+        printf("Failed to wh_Client_AesCbcDma %d\n", ret);
         goto exit;
     }
-    if ((ret = wc_curve25519_make_key(rng, CURVE25519_KEYSIZE, curve25519PrivateKey)) != 0) {
-        WH_ERROR_PRINT("Failed to wc_curve25519_make_key %d\n", ret);
+    for (i = 0; i < 4; i++) {
+        if (memcmp(plainText, finalText + i * sizeof(plainText), sizeof(plainText)) != 0) {
+            printf("AES CBC DMA FAILED TO MATCH\n");
+            ret = -1;
+            goto exit;
+        }
+    }
+    printf("AES CBC DMA SUCCESS\n");
+    if ((ret = wh_Client_AesGcmDma(client, aes, 1, iv, sizeof(iv), (uint8_t*)plainText, sizeof(plainText), authIn, sizeof(authIn), authTag, sizeof(authTag), (uint8_t*)cipherText)) != 0) {
+        printf("Failed to wh_Client_AesGcmDma %d\n", ret);
         goto exit;
     }
-    if ((ret = wc_curve25519_make_key(rng, CURVE25519_KEYSIZE, curve25519PublicKey)) != 0) {
-        WH_ERROR_PRINT("Failed to wc_curve25519_make_key %d\n", ret);
+    if ((ret = wc_AesGcmDecrypt(aes, (byte*)finalText, (byte*)cipherText, sizeof(plainText), iv, sizeof(iv), authTag, sizeof(authTag), authIn, sizeof(authIn))) != 0) {
+        printf("Failed to wc_AesGcmDecrypt %d\n", ret);
         goto exit;
     }
-    outLen = sizeof(sharedOne);
-    if ((ret = wc_curve25519_shared_secret(curve25519PrivateKey, curve25519PublicKey, sharedOne, (word32*)&outLen)) != 0) {
-        WH_ERROR_PRINT("Failed to wc_curve25519_shared_secret %d\n", ret);
+    /* a changed tag is rejected */
+    authTag[0] ^= 1;
+    if (wh_Client_AesGcmDma(client, aes, 0, iv, sizeof(iv), (uint8_t*)cipherText, sizeof(plainText), authIn, sizeof(authIn), authTag, sizeof(authTag), (uint8_t*)finalText + sizeof(plainText)) == 0) {
+        printf("Failed to reject a bad AES GCM DMA tag\n");
+        ret = -1;
         goto exit;
     }
-    if ((ret = wc_curve25519_shared_secret(curve25519PublicKey, curve25519PrivateKey, sharedTwo, (word32*)&outLen)) != 0) {
-        WH_ERROR_PRINT("Failed to wc_curve25519_shared_secret %d\n", ret);
+    if (memcmp(plainText, finalText, sizeof(plainText)) != 0) {
+        printf("AES GCM DMA FAILED TO MATCH\n");
+        ret = -1;
         goto exit;
     }
-    if (XMEMCMP(sharedOne, sharedTwo, outLen) != 0) {
-        WH_ERROR_PRINT("CURVE25519 shared secrets don't match\n");
+    printf("AES GCM DMA SUCCESS\n");
+#ifdef WOLFHSM_SYMMETRIC_INTERNAL
+    if((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        printf("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
     }
-
-
-exit:
-    wc_curve25519_free(curve25519PrivateKey);
-    wc_curve25519_free(curve25519PublicKey);
-    wc_FreeRng(rng);
-
-    /* Tell server to close */
-    WH_TEST_RETURN_ON_FAIL(wh_Client_CommClose(client));
-
-    if (ret == 0) {
-        WH_TEST_RETURN_ON_FAIL(wh_Client_Cleanup(client));
+#endif
+#ifndef NO_SHA256
+    /* test sha256 of client memory through dma */
+    if ((ret = wh_Client_Sha256Dma(client, (uint8_t*)cipherText, sizeof(cipherText), digest)) != 0) {
+        printf("Failed to wh_Client_Sha256Dma %d\n", ret);
+        goto exit;
     }
-    else {
-        wh_Client_Cleanup(client);
+    if ((ret = wc_InitSha256_ex(sha, NULL, INVALID_DEVID)) == 0) {
+        ret = wc_Sha256Update(sha, (byte*)cipherText, sizeof(cipherText));
+        if (ret == 0)
+            ret = wc_Sha256Final(sha, digestEnd);
+        wc_Sha256Free(sha);
     }
-
-    return ret;
-}
-
-int whTest_CryptoServerConfig(whServerConfig* config)
-{
-    whServerContext server[1] = {0};
-    whCommConnected am_connected = WH_COMM_CONNECTED;
-    int ret = 0;
-#ifndef WH_CFG_TEST_NO_CUSTOM_SERVERS
-    int userChange = 0;
-#endif
-
-    if (config == NULL) {
-        return WH_ERROR_BADARGS;
+    if (ret != 0) {
+        printf("Failed to wc_Sha256 %d\n", ret);
+        goto exit;
     }
-
-    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, config));
-    WH_TEST_RETURN_ON_FAIL(wh_Server_SetConnected(server, am_connected));
-    server->comm->client_id = 1;
-
-    while(am_connected == WH_COMM_CONNECTED) {
-        ret = wh_Server_HandleRequestMessage(server);
-        if ((ret != WH_ERROR_NOTREADY) &&
-                (ret != WH_ERROR_OK)) {
-            WH_ERROR_PRINT("Failed to wh_Server_HandleRequestMessage: %d\n", ret);
-            break;
+    if (memcmp(digest, digestEnd, sizeof(digest)) != 0) {
+        printf("SHA256 DMA FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    printf("SHA256 DMA SUCCESS\n");
+    /* test sha256 kept on the server across updates, one larger than a
+     * packet, against the software result */
+    for (i = 0; i < (int)sizeof(hashIn); i++)
+        hashIn[i] = (uint8_t)i;
+    for (i = 0; i < 2; i++) {
+        if ((ret = wc_InitSha256_ex(sha, NULL, i == 0 ? WOLFHSM_DEV_ID : INVALID_DEVID)) == 0) {
+            ret = wc_Sha256Update(sha, (byte*)plainText, sizeof(plainText));
+            if (ret == 0)
+                ret = wc_Sha256Update(sha, hashIn, sizeof(hashIn));
+            if (ret == 0)
+                ret = wc_Sha256Final(sha, i == 0 ? digest : digestEnd);
+            wc_Sha256Free(sha);
         }
-        wh_Server_GetConnected(server, &am_connected);
-
-#ifndef WH_CFG_TEST_NO_CUSTOM_SERVERS
-        /* keep alive for 2 user changes */
-        if (am_connected != WH_COMM_CONNECTED && userChange < 2) {
-            if (userChange == 0)
-                server->comm->client_id = 2;
-            else if (userChange == 1)
-                server->comm->client_id = 1;
-            userChange++;
-            am_connected = WH_COMM_CONNECTED;
-            WH_TEST_RETURN_ON_FAIL(wh_Server_SetConnected(server, am_connected));
+        if (ret != 0) {
+            printf("Failed to wc_Sha256 %d\n", ret);
+            goto exit;
         }
-#endif /* !WH_CFG_TEST_NO_CUSTOM_SERVERS */
     }
-
-    if ((ret == 0) || (ret == WH_ERROR_NOTREADY)) {
-        WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+    if (memcmp(digest, digestEnd, sizeof(digest)) != 0) {
+        printf("SHA256 FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    printf("SHA256 SUCCESS\n");
+#ifdef WOLF_CRYPTO_CB_COPY
+    /* test a copy taken mid stream, as by wc_Sha256GetHash, gets its own
+     * stream so both can still finish */
+    if ((ret = wc_InitSha256_ex(sha, NULL, WOLFHSM_DEV_ID)) == 0) {
+        ret = wc_Sha256Update(sha, (byte*)plainText, sizeof(plainText));
+        if (ret == 0)
+            ret = wc_Sha256Copy(sha, shaCopy);
+        if (ret == 0) {
+            ret = wc_Sha256Final(shaCopy, digest);
+            wc_Sha256Free(shaCopy);
+        }
+        if (ret == 0)
+            ret = wc_Sha256Update(sha, hashIn, sizeof(hashIn));
+        if (ret == 0)
+            ret = wc_Sha256Final(sha, digest);
+        wc_Sha256Free(sha);
+    }
+    if (ret != 0) {
+        printf("Failed to wc_Sha256Copy %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(digest, digestEnd, sizeof(digest)) != 0) {
+        printf("SHA256 COPY FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    printf("SHA256 COPY SUCCESS\n");
+#endif /* WOLF_CRYPTO_CB_COPY */
+#ifdef WOLF_CRYPTO_CB_FREE
+    /* test hashes freed before their final give back their server stream */
+    for (i = 0; i < WH_SERVER_STREAM_COUNT + 2 && ret == 0; i++) {
+        if ((ret = wc_InitSha256_ex(sha, NULL, WOLFHSM_DEV_ID)) == 0) {
+            ret = wc_Sha256Update(sha, (byte*)plainText, sizeof(plainText));
+            wc_Sha256Free(sha);
+        }
+    }
+    if (ret == 0 && (ret = wc_InitSha256_ex(sha, NULL, WOLFHSM_DEV_ID)) == 0) {
+        ret = wc_Sha256Update(sha, (byte*)plainText, sizeof(plainText));
+        if (ret == 0)
+            ret = wc_Sha256Final(sha, digest);
+        wc_Sha256Free(sha);
+    }
+    if (ret != 0) {
+        printf("SHA256 STREAM FREE FAILED %d\n", ret);
+        goto exit;
+    }
+    printf("SHA256 STREAM FREE SUCCESS\n");
+#endif /* WOLF_CRYPTO_CB_FREE */
+#ifndef NO_HMAC
+    /* test hmac keyed by a cached key */
+    keyId = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyId)) != 0) {
+        printf("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_HmacInit(hmac, NULL, WOLFHSM_DEV_ID)) == 0) {
+        wh_Client_SetKeyHmac(hmac, keyId);
+        ret = wc_HmacSetKey(hmac, WC_SHA256, NULL, 0);
+        if (ret == 0)
+            ret = wc_HmacUpdate(hmac, hashIn, sizeof(hashIn));
+        if (ret == 0)
+            ret = wc_HmacFinal(hmac, digest);
+        wc_HmacFree(hmac);
+    }
+    if (ret == 0 && (ret = wc_HmacInit(hmac, NULL, INVALID_DEVID)) == 0) {
+        ret = wc_HmacSetKey(hmac, WC_SHA256, key, sizeof(key));
+        if (ret == 0)
+            ret = wc_HmacUpdate(hmac, hashIn, sizeof(hashIn));
+        if (ret == 0)
+            ret = wc_HmacFinal(hmac, digestEnd);
+        wc_HmacFree(hmac);
+    }
+    if (ret != 0) {
+        printf("Failed to wc_Hmac %d\n", ret);
+        goto exit;
+    }
+    if((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        printf("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(digest, digestEnd, sizeof(digest)) != 0) {
+        printf("HMAC FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    printf("HMAC SUCCESS\n");
+    /* test a cached key longer than the block, which has to be hashed first */
+    keyId = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), hashIn, WC_SHA256_BLOCK_SIZE + 36, &keyId)) != 0) {
+        printf("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    for (i = 0; i < 2 && ret == 0; i++) {
+        if ((ret = wc_HmacInit(hmac, NULL, i == 0 ? WOLFHSM_DEV_ID : INVALID_DEVID)) == 0) {
+            if (i == 0) {
+                wh_Client_SetKeyHmac(hmac, keyId);
+                ret = wc_HmacSetKey(hmac, WC_SHA256, NULL, 0);
+            }
+            else {
+                ret = wc_HmacSetKey(hmac, WC_SHA256, hashIn, WC_SHA256_BLOCK_SIZE + 36);
+            }
+            if (ret == 0)
+                ret = wc_HmacUpdate(hmac, (byte*)plainText, sizeof(plainText));
+            if (ret == 0)
+                ret = wc_HmacFinal(hmac, i == 0 ? digest : digestEnd);
+            wc_HmacFree(hmac);
+        }
+    }
+    if (ret != 0) {
+        printf("Failed to wc_Hmac %d\n", ret);
+        goto exit;
+    }
+    if((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        printf("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(digest, digestEnd, sizeof(digest)) != 0) {
+        printf("HMAC LONG KEY FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    printf("HMAC LONG KEY SUCCESS\n");
+#endif /* !NO_HMAC */
+#endif
+#ifdef WOLFSSL_CMAC
+    /* test cmac with a cached key, twice to use the cached subkeys, and with
+     * the key given directly, against the software result */
+    outLen = sizeof(cmacEnd);
+    if ((ret = wc_AesCmacGenerate_ex(cmac, cmacEnd, &outLen, (byte*)finalText, sizeof(finalText), key, sizeof(key), NULL, INVALID_DEVID)) != 0) {
+        printf("Failed to wc_AesCmacGenerate_ex %d\n", ret);
+        goto exit;
+    }
+    keyId = 0;
+    if ((ret = wh_Client_KeyCache(client, 0, labelStart, sizeof(labelStart), key, sizeof(key), &keyId)) != 0) {
+        printf("Failed to wh_Client_KeyCache %d\n", ret);
+        goto exit;
+    }
+    for (i = 0; i < 3; i++) {
+        XMEMSET(cmacOut, 0, sizeof(cmacOut));
+        outLen = sizeof(cmacOut);
+        if (i < 2) {
+            ret = wc_InitCmac_ex(cmac, NULL, 0, WC_CMAC_AES, NULL, NULL, WOLFHSM_DEV_ID);
+            if (ret == 0) {
+                wh_Client_SetKeyCmac(cmac, keyId);
+                ret = wc_CmacUpdate(cmac, (byte*)finalText, 100);
+            }
+            if (ret == 0)
+                ret = wc_CmacUpdate(cmac, (byte*)finalText + 100, sizeof(finalText) - 100);
+            if (ret == 0)
+                ret = wc_CmacFinal(cmac, cmacOut, &outLen);
+        }
+        else {
+            ret = wc_AesCmacGenerate_ex(cmac, cmacOut, &outLen, (byte*)finalText, sizeof(finalText), key, sizeof(key), NULL, WOLFHSM_DEV_ID);
+        }
+        if (ret != 0) {
+            printf("Failed to wc_Cmac %d\n", ret);
+            goto exit;
+        }
+        if (outLen != sizeof(cmacOut) || memcmp(cmacOut, cmacEnd, sizeof(cmacOut)) != 0) {
+            printf("CMAC FAILED TO MATCH\n");
+            ret = -1;
+            goto exit;
+        }
+    }
+#ifdef WOLF_CRYPTO_CB_FREE
+    /* test cmacs freed before their final give back their server stream */
+    for (i = 0; i < WH_SERVER_STREAM_COUNT + 2 && ret == 0; i++) {
+        ret = wc_InitCmac_ex(cmac, NULL, 0, WC_CMAC_AES, NULL, NULL, WOLFHSM_DEV_ID);
+        if (ret == 0) {
+            wh_Client_SetKeyCmac(cmac, keyId);
+            ret = wc_CmacUpdate(cmac, (byte*)finalText, 100);
+            wc_CmacFree(cmac);
+        }
+    }
+    if (ret == 0) {
+        outLen = sizeof(cmacOut);
+        ret = wc_AesCmacGenerate_ex(cmac, cmacOut, &outLen, (byte*)finalText, sizeof(finalText), key, sizeof(key), NULL, WOLFHSM_DEV_ID);
+    }
+    if (ret != 0) {
+        printf("CMAC STREAM FREE FAILED %d\n", ret);
+        goto exit;
+    }
+#endif /* WOLF_CRYPTO_CB_FREE */
+    if((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        printf("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
+    }
+    printf("CMAC SUCCESS\n");
+#endif /* WOLFSSL_CMAC */
+    /* test rsa */
+    if((ret = wc_InitRsaKey_ex(rsa, NULL, WOLFHSM_DEV_ID)) != 0) {
+        printf("Failed to wc_InitRsaKey_ex %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_MakeRsaKey(rsa, 2048, 65537, rng)) != 0) {
+        printf("Failed to wc_MakeRsaKey %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_RsaPublicEncrypt((byte*)plainText, sizeof(plainText), (byte*)cipherText,
+        sizeof(cipherText), rsa, rng)) < 0) {
+        printf("Failed to wc_RsaPublicEncrypt %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_RsaPrivateDecrypt((byte*)cipherText, ret, (byte*)finalText,
+        sizeof(finalText), rsa)) < 0) {
+        printf("Failed to wc_RsaPrivateDecrypt %d\n", ret);
+        goto exit;
+    }
+    XMEMCPY((uint8_t*)&keyId, (uint8_t*)&rsa->devCtx, sizeof(keyId));
+    if ((ret = wh_Client_KeyEvictRequest(client, keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyEvictRequest %d\n", ret);
+        goto exit;
+    }
+    do {
+        ret = wh_Client_KeyEvictResponse(client);
+    } while (ret == WH_ERROR_NOTREADY);
+    if (ret != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyEvictResponse %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_FreeRsaKey(rsa)) != 0) {
+        printf("Failed to wc_FreeRsaKey %d\n", ret);
+        goto exit;
+    }
+    printf("RSA KEYGEN SUCCESS\n");
+    if (memcmp(plainText, finalText, sizeof(plainText)) == 0)
+        printf("RSA SUCCESS\n");
+    else
+        printf("RSA FAILED TO MATCH\n");
+    /* test rsa keygen job, serving other requests while it is queued */
+    if ((ret = wh_Client_RsaKeyGenStart(client, 2048, 65537, &jobId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_RsaKeyGenStart %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_RNG_GenerateBlock(rng, key, sizeof(key))) != 0) {
+        WH_ERROR_PRINT("Failed to wc_RNG_GenerateBlock %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wh_Client_KeyJobWait(client, jobId, &keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyJobWait %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_InitRsaKey_ex(rsa, NULL, WOLFHSM_DEV_ID)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_InitRsaKey_ex %d\n", ret);
+        goto exit;
+    }
+    wh_Client_SetKeyRsa(rsa, keyId);
+    if ((ret = wc_RsaPublicEncrypt((byte*)plainText, sizeof(plainText),
+        (byte*)cipherText, sizeof(cipherText), rsa, rng)) < 0) {
+        WH_ERROR_PRINT("Failed to wc_RsaPublicEncrypt %d\n", ret);
+        goto exit;
+    }
+    memset(finalText, 0, sizeof(finalText));
+    if ((ret = wc_RsaPrivateDecrypt((byte*)cipherText, ret, (byte*)finalText,
+        sizeof(finalText), rsa)) < 0) {
+        WH_ERROR_PRINT("Failed to wc_RsaPrivateDecrypt %d\n", ret);
+        goto exit;
+    }
+    (void)wc_FreeRsaKey(rsa);
+    /* a finished job is released once its result was collected */
+    if ((ret = wh_Client_KeyJobWait(client, jobId, &keyId)) !=
+            WH_ERROR_NOTFOUND) {
+        WH_ERROR_PRINT("Failed to release keygen job %d\n", ret);
+        ret = -1;
+        goto exit;
+    }
+    if ((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(plainText, finalText, sizeof(plainText)) == 0)
+        printf("RSA KEYGEN JOB SUCCESS\n");
+    else {
+        WH_ERROR_PRINT("RSA KEYGEN JOB FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    /* test ecc */
+    if((ret = wc_ecc_init_ex(eccPrivate, NULL, WOLFHSM_DEV_ID)) != 0) {
+        printf("Failed to wc_ecc_init_ex %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_ecc_init_ex(eccPublic, NULL, WOLFHSM_DEV_ID)) != 0) {
+        printf("Failed to wc_ecc_init_ex %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_ecc_make_key(rng, 32, eccPrivate)) != 0) {
+        printf("Failed to wc_ecc_make_key %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_ecc_make_key(rng, 32, eccPublic)) != 0) {
+        printf("Failed to wc_ecc_make_key %d\n", ret);
+        goto exit;
+    }
+    outLen = 32;
+    if((ret = wc_ecc_shared_secret(eccPrivate, eccPublic, (byte*)cipherText, &outLen)) != 0) {
+        printf("Failed to wc_ecc_shared_secret %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_ecc_shared_secret(eccPublic, eccPrivate, (byte*)finalText, &outLen)) != 0) {
+        printf("Failed to wc_ecc_shared_secret %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(cipherText, finalText, outLen) == 0)
+        printf("ECDH SUCCESS\n");
+    else
+        printf("ECDH FAILED TO MATCH\n");
+    /* the same secret, kept in the cache */
+    keyId = WOLFHSM_KEYID_ERASED;
+    if ((ret = wh_Client_EccSharedSecretCache(client, ECC_SECP256R1,
+            (whKeyId)(intptr_t)eccPrivate->devCtx,
+            (whKeyId)(intptr_t)eccPublic->devCtx, WOLFHSM_NVM_FLAGS_NONE,
+            &keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_EccSharedSecretCache %d\n", ret);
+        goto exit;
+    }
+    secretSz = sizeof(finalText);
+    if ((ret = wh_Client_KeyExport(client, keyId, labelEnd, sizeof(labelEnd),
+            (uint8_t*)finalText, &secretSz)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyExport %d\n", ret);
+        goto exit;
+    }
+    if (secretSz != outLen || memcmp(cipherText, finalText, outLen) != 0) {
+        WH_ERROR_PRINT("CACHED ECDH SECRET FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    if ((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
+    }
+    printf("ECDH TO CACHE SUCCESS\n");
+    outLen = 32;
+    if((ret = wc_ecc_sign_hash((void*)cipherText, sizeof(cipherText), (void*)finalText, &outLen, rng, eccPrivate)) != 0) {
+        printf("Failed to wc_ecc_sign_hash %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_ecc_verify_hash((void*)finalText, outLen, (void*)cipherText, sizeof(cipherText), &res, eccPrivate)) != 0) {
+        printf("Failed to wc_ecc_verify_hash %d\n", ret);
+        goto exit;
+    }
+    if (res == 1)
+        printf("ECC SIGN/VERIFY SUCCESS\n");
+    else
+        printf("ECC SIGN/VERIFY FAIL\n");
+    /* sign again, served from the decoded key if the server keeps them */
+    outLen = sizeof(finalText);
+    if((ret = wc_ecc_sign_hash((void*)plainText, sizeof(plainText), (void*)finalText, &outLen, rng, eccPrivate)) != 0) {
+        printf("Failed to wc_ecc_sign_hash %d\n", ret);
+        goto exit;
+    }
+    if((ret = wc_ecc_verify_hash((void*)finalText, outLen, (void*)plainText, sizeof(plainText), &res, eccPrivate)) != 0) {
+        printf("Failed to wc_ecc_verify_hash %d\n", ret);
+        goto exit;
+    }
+    if (res != 1) {
+        WH_ERROR_PRINT("ECC SIGN/VERIFY WITH DECODED KEY FAILED\n");
+        ret = -1;
+        goto exit;
+    }
+    /* a decoded key belongs to its client and goes stale with the cached
+     * key it was decoded from */
+    {
+        uint8_t  rawA[3 * 32];
+        uint8_t  rawB[3 * 32];
+        uint32_t rawASz = sizeof(rawA);
+        uint32_t rawBSz = sizeof(rawB);
+        whKeyId  idA = (whKeyId)(intptr_t)eccPrivate->devCtx;
+
+        if ((ret = wh_Client_KeyExport(client, idA, NULL, 0, rawA,
+                &rawASz)) != 0 ||
+            (ret = wh_Client_KeyExport(client,
+                (whKeyId)(intptr_t)eccPublic->devCtx, NULL, 0, rawB,
+                &rawBSz)) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyExport %d\n", ret);
+            goto exit;
+        }
+#ifndef WH_CFG_TEST_NO_CUSTOM_SERVERS
+        /* another client signs with its own key under the same id */
+        WH_TEST_RETURN_ON_FAIL(wh_Client_CommClose(client));
+        client->comm->client_id = 2;
+        keyId = idA;
+        if ((ret = wh_Client_KeyCache(client, 0, NULL, 0, rawB, rawBSz,
+                &keyId)) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+            goto exit;
+        }
+        outLen = sizeof(finalText);
+        ret = wc_ecc_sign_hash((void*)plainText, sizeof(plainText),
+            (void*)finalText, &outLen, rng, eccPrivate);
+        (void)wh_Client_KeyEvict(client, idA);
+        WH_TEST_RETURN_ON_FAIL(wh_Client_CommClose(client));
+        client->comm->client_id = 1;
+        if (ret != 0) {
+            WH_ERROR_PRINT("Failed to wc_ecc_sign_hash %d\n", ret);
+            goto exit;
+        }
+        res = 0;
+        if ((ret = wc_ecc_verify_hash((void*)finalText, outLen,
+                (void*)plainText, sizeof(plainText), &res, eccPublic)) != 0 ||
+                res != 1) {
+            WH_ERROR_PRINT("ECC DECODED KEY SHARED BETWEEN CLIENTS\n");
+            ret = -1;
+            goto exit;
+        }
+#endif /* !WH_CFG_TEST_NO_CUSTOM_SERVERS */
+        /* replace the key behind the id */
+        keyId = idA;
+        if ((ret = wh_Client_KeyEvict(client, idA)) != 0 ||
+            (ret = wh_Client_KeyCache(client, 0, NULL, 0, rawB, rawBSz,
+                &keyId)) != 0) {
+            WH_ERROR_PRINT("Failed to re-cache ECC key %d\n", ret);
+            goto exit;
+        }
+        outLen = sizeof(finalText);
+        if ((ret = wc_ecc_sign_hash((void*)plainText, sizeof(plainText),
+                (void*)finalText, &outLen, rng, eccPrivate)) != 0) {
+            WH_ERROR_PRINT("Failed to wc_ecc_sign_hash %d\n", ret);
+            goto exit;
+        }
+        res = 0;
+        if ((ret = wc_ecc_verify_hash((void*)finalText, outLen,
+                (void*)plainText, sizeof(plainText), &res, eccPublic)) != 0 ||
+                res != 1) {
+            WH_ERROR_PRINT("STALE DECODED ECC KEY USED AFTER RE-CACHE\n");
+            ret = -1;
+            goto exit;
+        }
+        /* put the original key back for the tests below */
+        keyId = idA;
+        if ((ret = wh_Client_KeyEvict(client, idA)) != 0 ||
+            (ret = wh_Client_KeyCache(client, 0, NULL, 0, rawA, rawASz,
+                &keyId)) != 0) {
+            WH_ERROR_PRINT("Failed to re-cache ECC key %d\n", ret);
+            goto exit;
+        }
+        printf("ECC DECODED KEY INVALIDATION SUCCESS\n");
+    }
+#ifdef WH_CLIENT_ASYNC_CRYPTO
+    /* async sign is sent by the first call and completed by repeating it,
+     * while other operations wait their turn */
+    if ((ret = wh_Client_SetAsyncCrypto(client, 1)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_SetAsyncCrypto %d\n", ret);
+        goto exit;
+    }
+    outLen = sizeof(finalText);
+    ret = wc_ecc_sign_hash((void*)plainText, sizeof(plainText),
+        (void*)finalText, &outLen, rng, eccPrivate);
+    if (ret != WC_PENDING_E ||
+            wc_RNG_GenerateBlock(rng, key, sizeof(key)) != BAD_STATE_E ||
+            wh_Client_SetAsyncCrypto(client, 0) != WH_ERROR_NOTREADY) {
+        WH_ERROR_PRINT("ASYNC ECC SIGN NOT PENDING %d\n", ret);
+        ret = -1;
+        goto exit;
+    }
+    do {
+        ret = wc_ecc_sign_hash((void*)plainText, sizeof(plainText),
+            (void*)finalText, &outLen, rng, eccPrivate);
+    } while (ret == WC_PENDING_E);
+    if (ret == 0) {
+        do {
+            ret = wc_ecc_verify_hash((void*)finalText, outLen,
+                (void*)plainText, sizeof(plainText), &res, eccPrivate);
+        } while (ret == WC_PENDING_E);
+    }
+    /* a cancelled sign gives the connection back to other operations */
+    if (ret == 0) {
+        secretSz = sizeof(cipherText);
+        ret = wc_ecc_sign_hash((void*)plainText, sizeof(plainText),
+            (void*)cipherText, &secretSz, rng, eccPrivate);
+        if (ret == WC_PENDING_E)
+            ret = wh_Client_CancelAsyncCrypto(client);
+        else if (ret == 0)
+            ret = -1;
+    }
+    if (ret == 0)
+        ret = wc_RNG_GenerateBlock(rng, key, sizeof(key));
+    if (ret == 0)
+        ret = wh_Client_SetAsyncCrypto(client, 0);
+    if (ret != 0 || res != 1) {
+        WH_ERROR_PRINT("ASYNC ECC SIGN/VERIFY FAILED %d\n", ret);
+        ret = -1;
+        goto exit;
+    }
+#endif /* WH_CLIENT_ASYNC_CRYPTO */
+    /* batch verify: good, wrong hash, wrong key, malformed signature */
+    memset(authTag, 0, sizeof(authTag));
+    for (i = 0; i < 4; i++) {
+        eccItems[i].sig = (uint8_t*)finalText;
+        eccItems[i].sigSz = outLen;
+        eccItems[i].hash = (uint8_t*)plainText;
+        eccItems[i].hashSz = sizeof(plainText);
+        eccItems[i].keyId = (whNvmId)(intptr_t)eccPrivate->devCtx;
+        eccResults[i] = -1;
+    }
+    eccItems[1].hash = (uint8_t*)cipherText;
+    eccItems[2].keyId = (whNvmId)(intptr_t)eccPublic->devCtx;
+    eccItems[3].sig = authTag;
+    eccItems[3].sigSz = sizeof(authTag);
+    if ((ret = wh_Client_EccVerifyBatch(client, ECC_SECP256R1, eccItems, 4,
+            eccResults)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_EccVerifyBatch %d\n", ret);
+        goto exit;
+    }
+    if (eccResults[0] != 1 || eccResults[1] != 0 || eccResults[2] != 0 ||
+            eccResults[3] != WH_ERROR_ABORTED) {
+        WH_ERROR_PRINT("ECC BATCH VERIFY FAILED %d %d %d %d\n",
+            eccResults[0], eccResults[1], eccResults[2], eccResults[3]);
+        ret = -1;
+        goto exit;
+    }
+    printf("ECC BATCH VERIFY SUCCESS\n");
+    /* the public part is qx | qy, the first two thirds of the cached key */
+    outLen = sizeof(cipherText);
+    if ((ret = wh_Client_KeyExport(client,
+            (whKeyId)(intptr_t)eccPrivate->devCtx, NULL, 0,
+            (uint8_t*)cipherText, &outLen)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyExport %d\n", ret);
+        goto exit;
+    }
+    secretSz = sizeof(finalText);
+    if ((ret = wh_Client_KeyExportPublic(client,
+            (whKeyId)(intptr_t)eccPrivate->devCtx, WOLFHSM_KEYFLAG_ECC, NULL,
+            0, (uint8_t*)finalText, &secretSz)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyExportPublic %d\n", ret);
+        goto exit;
+    }
+    if (secretSz != outLen / 3 * 2 ||
+            memcmp(cipherText, finalText, secretSz) != 0) {
+        WH_ERROR_PRINT("ECC PUBLIC KEY EXPORT FAILED\n");
+        ret = -1;
+        goto exit;
+    }
+    /* a secret that merely has a multiple of three length is not ECC */
+    {
+        uint8_t  secret[48];
+        uint16_t secretId = WOLFHSM_KEYID_ERASED;
+        memset(secret, 0x5A, sizeof(secret));
+        if ((ret = wh_Client_KeyCache(client, WOLFHSM_NVM_FLAGS_NONEXPORTABLE,
+                NULL, 0, secret, sizeof(secret), &secretId)) != 0) {
+            WH_ERROR_PRINT("Failed to wh_Client_KeyCache %d\n", ret);
+            goto exit;
+        }
+        secretSz = sizeof(finalText);
+        ret = wh_Client_KeyExportPublic(client, secretId, WOLFHSM_KEYFLAG_ECC,
+            NULL, 0, (uint8_t*)finalText, &secretSz);
+        (void)wh_Client_KeyEvict(client, secretId);
+        if (ret == 0) {
+            WH_ERROR_PRINT("PUBLIC EXPORT OF A NON ECC KEY NOT REFUSED\n");
+            ret = -1;
+            goto exit;
+        }
+        ret = 0;
+    }
+    /* the key generation the client public key cache is checked against
+     * moves on with every key change */
+    {
+        uint32_t genBefore = 0;
+        uint32_t genAfter = 0;
+        uint16_t genId = WOLFHSM_KEYID_ERASED;
+        if ((ret = wh_Client_KeyGeneration(client, &genBefore)) != 0 ||
+            (ret = wh_Client_KeyCache(client, 0, NULL, 0, key, sizeof(key),
+                &genId)) != 0 ||
+            (ret = wh_Client_KeyEvict(client, genId)) != 0 ||
+            (ret = wh_Client_KeyGeneration(client, &genAfter)) != 0) {
+            WH_ERROR_PRINT("Failed to read the key generation %d\n", ret);
+            goto exit;
+        }
+        if (genAfter == genBefore) {
+            WH_ERROR_PRINT("KEY GENERATION UNCHANGED BY A KEY CHANGE\n");
+            ret = -1;
+            goto exit;
+        }
+    }
+    printf("ECC PUBLIC KEY EXPORT SUCCESS\n");
+    /* test curve25519 */
+    if ((ret = wc_curve25519_init_ex(curve25519PrivateKey, NULL, WOLFHSM_DEV_ID)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_curve25519_init_ex %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_curve25519_init_ex(curve25519PublicKey, NULL, WOLFHSM_DEV_ID)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_curve25519_init_ex %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_curve25519_make_key(rng, CURVE25519_KEYSIZE, curve25519PrivateKey)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_curve25519_make_key %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_curve25519_make_key(rng, CURVE25519_KEYSIZE, curve25519PublicKey)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_curve25519_make_key %d\n", ret);
+        goto exit;
+    }
+    outLen = sizeof(sharedOne);
+    if ((ret = wc_curve25519_shared_secret(curve25519PrivateKey, curve25519PublicKey, sharedOne, (word32*)&outLen)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_curve25519_shared_secret %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_curve25519_shared_secret(curve25519PublicKey, curve25519PrivateKey, sharedTwo, (word32*)&outLen)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_curve25519_shared_secret %d\n", ret);
+        goto exit;
+    }
+    if (XMEMCMP(sharedOne, sharedTwo, outLen) != 0) {
+        WH_ERROR_PRINT("CURVE25519 shared secrets don't match\n");
+    }
+    keyId = WOLFHSM_KEYID_ERASED;
+    if ((ret = wh_Client_Curve25519SharedSecretCache(client,
+            (whKeyId)(intptr_t)curve25519PrivateKey->devCtx,
+            (whKeyId)(intptr_t)curve25519PublicKey->devCtx,
+            EC25519_BIG_ENDIAN, WOLFHSM_NVM_FLAGS_NONE, &keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_Curve25519SharedSecretCache %d\n",
+            ret);
+        goto exit;
+    }
+    secretSz = sizeof(sharedTwo);
+    if ((ret = wh_Client_KeyExport(client, keyId, labelEnd, sizeof(labelEnd),
+            sharedTwo, &secretSz)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyExport %d\n", ret);
+        goto exit;
+    }
+    if (secretSz != outLen || XMEMCMP(sharedOne, sharedTwo, outLen) != 0) {
+        WH_ERROR_PRINT("CACHED CURVE25519 SECRET FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    if ((ret = wh_Client_KeyEvict(client, keyId)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
+    }
+#ifdef HAVE_ED25519
+    /* test ed25519, with a key generated and kept on the server */
+    if ((ret = wc_ed25519_init_ex(ed25519, NULL, WOLFHSM_DEV_ID)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_ed25519_init_ex %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_ed25519_make_key(rng, ED25519_KEY_SIZE, ed25519)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_ed25519_make_key %d\n", ret);
+        goto exit;
+    }
+    outLen = sizeof(ed25519Sig);
+    if ((ret = wc_ed25519_sign_msg((byte*)cipherText, sizeof(cipherText), ed25519Sig, (word32*)&outLen, ed25519)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_ed25519_sign_msg %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_ed25519_verify_msg(ed25519Sig, outLen, (byte*)cipherText, sizeof(cipherText), &res, ed25519)) != 0) {
+        WH_ERROR_PRINT("Failed to wc_ed25519_verify_msg %d\n", ret);
+        goto exit;
+    }
+    if (res != 1) {
+        WH_ERROR_PRINT("ED25519 SIGN/VERIFY FAILED\n");
+        ret = -1;
+        goto exit;
+    }
+    /* a changed message must not verify */
+    cipherText[0] ^= 1;
+    if ((ret = wc_ed25519_verify_msg(ed25519Sig, outLen, (byte*)cipherText, sizeof(cipherText), &res, ed25519)) != 0 && ret != SIG_VERIFY_E) {
+        WH_ERROR_PRINT("Failed to wc_ed25519_verify_msg %d\n", ret);
+        goto exit;
+    }
+    if (res != 0) {
+        WH_ERROR_PRINT("ED25519 VERIFIED A CHANGED MESSAGE\n");
+        ret = -1;
+        goto exit;
+    }
+    /* the ctx variant binds the context into the signature */
+    outLen = sizeof(ed25519Sig);
+    if ((ret = wc_ed25519ctx_sign_msg((byte*)plainText, sizeof(plainText), ed25519Sig, (word32*)&outLen, ed25519, authIn, sizeof(authIn))) != 0) {
+        WH_ERROR_PRINT("Failed to wc_ed25519ctx_sign_msg %d\n", ret);
+        goto exit;
+    }
+    if ((ret = wc_ed25519ctx_verify_msg(ed25519Sig, outLen, (byte*)plainText, sizeof(plainText), &res, ed25519, authIn, sizeof(authIn))) != 0 || res != 1) {
+        WH_ERROR_PRINT("Failed to wc_ed25519ctx_verify_msg %d %d\n", ret, res);
+        ret = (ret != 0) ? ret : -1;
+        goto exit;
+    }
+    /* re-cache a second key under the first id, signing must follow it */
+    {
+        ed25519_key ed25519B[1];
+        whKeyId     idA = (whKeyId)(intptr_t)ed25519->devCtx;
+
+        if ((ret = wc_ed25519_init_ex(ed25519B, NULL, WOLFHSM_DEV_ID)) != 0 ||
+            (ret = wc_ed25519_make_key(rng, ED25519_KEY_SIZE,
+                ed25519B)) != 0) {
+            WH_ERROR_PRINT("Failed to make second ed25519 key %d\n", ret);
+            goto exit;
+        }
+        outLen = sizeof(finalText);
+        keyId  = idA;
+        if ((ret = wh_Client_KeyExport(client,
+                (whKeyId)(intptr_t)ed25519B->devCtx, NULL, 0,
+                (uint8_t*)finalText, &outLen)) != 0 ||
+            (ret = wh_Client_KeyEvict(client, idA)) != 0 ||
+            (ret = wh_Client_KeyCache(client, 0, NULL, 0,
+                (uint8_t*)finalText, outLen, &keyId)) != 0) {
+            WH_ERROR_PRINT("Failed to re-cache ed25519 key %d\n", ret);
+            wc_ed25519_free(ed25519B);
+            goto exit;
+        }
+        outLen = sizeof(ed25519Sig);
+        res    = 0;
+        if ((ret = wc_ed25519_sign_msg((byte*)plainText, sizeof(plainText),
+                ed25519Sig, (word32*)&outLen, ed25519)) == 0) {
+            ret = wc_ed25519_verify_msg(ed25519Sig, outLen, (byte*)plainText,
+                sizeof(plainText), &res, ed25519B);
+        }
+        (void)wh_Client_KeyEvict(client, (whKeyId)(intptr_t)ed25519B->devCtx);
+        wc_ed25519_free(ed25519B);
+        if (ret != 0 || res != 1) {
+            WH_ERROR_PRINT("STALE DECODED ED25519 KEY USED AFTER RE-CACHE\n");
+            ret = (ret != 0) ? ret : -1;
+            goto exit;
+        }
+    }
+    if ((ret = wh_Client_KeyEvict(client, (whNvmId)(intptr_t)ed25519->devCtx)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_KeyEvict %d\n", ret);
+        goto exit;
+    }
+    printf("ED25519 SUCCESS\n");
+#endif /* HAVE_ED25519 */
+
+
+exit:
+#ifdef HAVE_ED25519
+    wc_ed25519_free(ed25519);
+#endif
+    wc_curve25519_free(curve25519PrivateKey);
+    wc_curve25519_free(curve25519PublicKey);
+    wc_FreeRng(rng);
+
+    /* Tell server to close */
+    WH_TEST_RETURN_ON_FAIL(wh_Client_CommClose(client));
+
+    if (ret == 0) {
+        WH_TEST_RETURN_ON_FAIL(wh_Client_Cleanup(client));
+    }
+    else {
+        wh_Client_Cleanup(client);
+    }
+
+    return ret;
+}
+
+int whTest_CryptoServerConfig(whServerConfig* config)
+{
+    whServerContext server[1] = {0};
+    whCommConnected am_connected = WH_COMM_CONNECTED;
+    int ret = 0;
+#ifndef WH_CFG_TEST_NO_CUSTOM_SERVERS
+    int userChange = 0;
+#endif
+
+    if (config == NULL) {
+        return WH_ERROR_BADARGS;
+    }
+
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, config));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_SetConnected(server, am_connected));
+    server->comm->client_id = 1;
+
+    while(am_connected == WH_COMM_CONNECTED) {
+        ret = wh_Server_HandleRequestMessage(server);
+        if ((ret != WH_ERROR_NOTREADY) &&
+                (ret != WH_ERROR_OK)) {
+            WH_ERROR_PRINT("Failed to wh_Server_HandleRequestMessage: %d\n", ret);
+            break;
+        }
+        if (ret == WH_ERROR_NOTREADY) {
+            /* refill the RNG pool between requests */
+            (void)wh_Server_RunIdle(server);
+        }
+        wh_Server_GetConnected(server, &am_connected);
+
+#ifndef WH_CFG_TEST_NO_CUSTOM_SERVERS
+        /* keep alive for 4 user changes, alternating clients 2 and 1 */
+        if (am_connected != WH_COMM_CONNECTED && userChange < 4) {
+            server->comm->client_id = (userChange % 2 == 0) ? 2 : 1;
+            userChange++;
+            am_connected = WH_COMM_CONNECTED;
+            WH_TEST_RETURN_ON_FAIL(wh_Server_SetConnected(server, am_connected));
+        }
+#endif /* !WH_CFG_TEST_NO_CUSTOM_SERVERS */
+    }
+
+    if ((ret == 0) || (ret == WH_ERROR_NOTREADY)) {
+        WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
     } else {
         ret = wh_Server_Cleanup(server);
     }
@@ -631,13 +1697,508 @@ static int wh_ClientServer_MemThreadTest(void)
 
     return WH_ERROR_OK;
 }
+
+#if WH_SERVER_WORKER_COUNT > 0
+/* Worker pool with one thread per server worker */
+typedef struct {
+    pthread_mutex_t  server_lock;
+    pthread_mutex_t  lock;
+    pthread_cond_t   cond;
+    whServerContext* server;
+    int              pending[WH_SERVER_WORKER_COUNT];
+    int              stop;
+    int              started;
+} whTestWorkerPool;
+
+typedef struct {
+    whTestWorkerPool* pool;
+    uint16_t          index;
+} whTestWorkerArg;
+
+static void _whTestWorkerLock(void* context)
+{
+    pthread_mutex_lock(&((whTestWorkerPool*)context)->server_lock);
+}
+
+static void _whTestWorkerUnlock(void* context)
+{
+    pthread_mutex_unlock(&((whTestWorkerPool*)context)->server_lock);
+}
+
+static int _whTestWorkerStart(void* context, whServerContext* server,
+                              uint16_t index)
+{
+    whTestWorkerPool* pool = (whTestWorkerPool*)context;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->server         = server;
+    pool->pending[index] = 1;
+    pool->started++;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+static void* _whTestWorkerTask(void* a)
+{
+    whTestWorkerArg*  arg  = (whTestWorkerArg*)a;
+    whTestWorkerPool* pool = arg->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->stop == 0) {
+        if (pool->pending[arg->index] == 0) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        pool->pending[arg->index] = 0;
+        pthread_mutex_unlock(&pool->lock);
+        WH_TEST_ASSERT(0 == wh_Server_WorkerRun(pool->server, arg->index));
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static int wh_ClientServer_MemWorkerThreadTest(void)
+{
+    uint8_t req[BUFFER_SIZE] = {0};
+    uint8_t resp[BUFFER_SIZE] = {0};
+
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    /* Client configuration/contexts */
+    whTransportClientCb         tccb[1]   = {WH_TRANSPORT_MEM_CLIENT_CB};
+    whTransportMemClientContext tmcc[1]   = {0};
+    whCommClientConfig          cc_conf[1] = {{
+                 .transport_cb      = tccb,
+                 .transport_context = (void*)tmcc,
+                 .transport_config  = (void*)tmcf,
+                 .client_id         = 1,
+    }};
+    whClientConfig c_conf[1] = {{
+       .comm = cc_conf,
+    }};
+    /* Server configuration/contexts */
+    whTransportServerCb         tscb[1]   = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]   = {0};
+    whCommServerConfig          cs_conf[1] = {{
+                 .transport_cb      = tscb,
+                 .transport_context = (void*)tmsc,
+                 .transport_config  = (void*)tmcf,
+                 .server_id         = 124,
+    }};
+
+    /* RamSim Flash state and configuration */
+    whFlashRamsimCtx fc[1] = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 128 * 1024,  /* 128KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb  fcb[1]          = {WH_FLASH_RAMSIM_CB};
+
+    /* NVM Flash Configuration using RamSim HAL Flash */
+    whNvmFlashConfig nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1] = {0};
+    whNvmCb nfcb[1] = {WH_NVM_FLASH_CB};
+
+    whNvmConfig n_conf[1] = {{
+            .cb = nfcb,
+            .context = nfc,
+            .config = nf_conf,
+    }};
+    whNvmContext nvm[1] = {{0}};
+
+    /* Crypto contexts for the server and each worker */
+    crypto_context crypto[1 + WH_SERVER_WORKER_COUNT] = {0};
+
+    whTestWorkerPool     pool[1] = {0};
+    whTestWorkerArg      arg[WH_SERVER_WORKER_COUNT] = {0};
+    pthread_t            thread[WH_SERVER_WORKER_COUNT] = {0};
+    whServerWorkerConfig w_conf[1] = {{
+       .start_cb   = _whTestWorkerStart,
+       .lock_cb    = _whTestWorkerLock,
+       .unlock_cb  = _whTestWorkerUnlock,
+       .cb_context = pool,
+    }};
+
+    whServerConfig                  s_conf[1] = {{
+       .comm_config = cs_conf,
+       .nvm = nvm,
+       .crypto = crypto,
+       .devId = INVALID_DEVID,
+       .worker_config = w_conf,
+    }};
+    void* retval;
+    int i;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+
+    WH_TEST_RETURN_ON_FAIL(wolfCrypt_Init());
+    for (i = 0; i < 1 + WH_SERVER_WORKER_COUNT; i++) {
+        crypto[i].devId = INVALID_DEVID;
+        WH_TEST_RETURN_ON_FAIL(
+            wc_InitRng_ex(crypto[i].rng, NULL, crypto[i].devId));
+        if (i > 0) {
+            w_conf->crypto[i - 1] = &crypto[i];
+        }
+    }
+
+    pthread_mutex_init(&pool->server_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (i = 0; i < WH_SERVER_WORKER_COUNT; i++) {
+        arg[i].pool  = pool;
+        arg[i].index = i;
+        WH_TEST_ASSERT_RETURN(
+            0 == pthread_create(&thread[i], NULL, _whTestWorkerTask, &arg[i]));
+    }
+
+    _whClientServerThreadTest(c_conf, s_conf);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < WH_SERVER_WORKER_COUNT; i++) {
+        pthread_join(thread[i], &retval);
+    }
+    /* The crypto requests went through the workers */
+    WH_TEST_ASSERT_RETURN(pool->started > 0);
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->server_lock);
+
+    wh_Nvm_Cleanup(nvm);
+    for (i = 0; i < 1 + WH_SERVER_WORKER_COUNT; i++) {
+        wc_FreeRng(crypto[i].rng);
+    }
+    wolfCrypt_Cleanup();
+
+    return WH_ERROR_OK;
+}
+#endif /* WH_SERVER_WORKER_COUNT > 0 */
 #endif /* WH_CFG_TEST_POSIX */
 
+/* A full cache makes room by evicting the least recently used commited key
+ * that isn't pinned */
+static int _whTestKeyEvictLru(whServerContext* server)
+{
+    uint8_t key[AES_128_KEY_SIZE] = {0};
+    uint8_t out[AES_128_KEY_SIZE];
+    uint32_t outSz;
+    whNvmMetadata meta[1] = {0};
+    int pass;
+    int i;
+
+    /* start from an empty cache */
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        if (server->cache[i].meta->id != WOLFHSM_KEYID_ERASED) {
+            WH_TEST_RETURN_ON_FAIL(hsmEvictKey(server,
+                server->cache[i].meta->id));
+        }
+    }
+    /* fill it with commited keys, the first is pinned and never used again */
+    for (i = 0; i < WOLFHSM_NUM_RAMKEYS; i++) {
+        memset(meta, 0, sizeof(meta));
+        meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 10 + i);
+        meta->flags = (i == 0) ? WOLFHSM_NVM_FLAGS_PINNED :
+            WOLFHSM_NVM_FLAGS_NONE;
+        meta->len = sizeof(key);
+        WH_TEST_RETURN_ON_FAIL(hsmCacheKey(server, meta, key));
+        WH_TEST_RETURN_ON_FAIL(hsmCommitKey(server,
+            MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 10 + i)));
+    }
+    /* use the rest, then all but the second again so it is the oldest */
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 1 + pass; i < WOLFHSM_NUM_RAMKEYS; i++) {
+            outSz = sizeof(out);
+            WH_TEST_RETURN_ON_FAIL(hsmReadKey(server,
+                MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 10 + i), NULL,
+                out, &outSz));
+        }
+    }
+    memset(meta, 0, sizeof(meta));
+    meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1,
+        10 + WOLFHSM_NUM_RAMKEYS);
+    meta->len = sizeof(key);
+    WH_TEST_RETURN_ON_FAIL(hsmCacheKey(server, meta, key));
+    for (i = 0; i <= WOLFHSM_NUM_RAMKEYS; i++) {
+        WH_TEST_ASSERT_RETURN((hsmCacheFindKey(server,
+            MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 10 + i)) >= 0) ==
+            (i != 1));
+    }
+    return 0;
+}
+
+/* Keys listed in the config or flagged for prefetch are cached by Init */
+static int wh_ClientServer_KeyPrefetchTest(void)
+{
+    uint8_t req[BUFFER_SIZE] = {0};
+    uint8_t resp[BUFFER_SIZE] = {0};
+    uint8_t key[AES_128_KEY_SIZE] = {0};
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    whTransportServerCb         tscb[1]   = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]   = {0};
+    whCommServerConfig          cs_conf[1] = {{
+                 .transport_cb      = tscb,
+                 .transport_context = (void*)tmsc,
+                 .transport_config  = (void*)tmcf,
+                 .server_id         = 124,
+    }};
+    whFlashRamsimCtx fc[1] = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 128 * 1024,  /* 128KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb  fcb[1]          = {WH_FLASH_RAMSIM_CB};
+    whNvmFlashConfig nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1] = {0};
+    whNvmCb nfcb[1] = {WH_NVM_FLASH_CB};
+    whNvmConfig n_conf[1] = {{
+            .cb = nfcb,
+            .context = nfc,
+            .config = nf_conf,
+    }};
+    whNvmContext nvm[1] = {{0}};
+    crypto_context crypto[1] = {{
+            .devId = INVALID_DEVID,
+    }};
+    const whNvmId prefetch[1] = {
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 1),
+    };
+    whServerConfig s_conf[1] = {{
+       .comm_config    = cs_conf,
+       .nvm            = nvm,
+       .crypto         = crypto,
+       .devId          = INVALID_DEVID,
+       .prefetch_ids   = prefetch,
+       .prefetch_count = 1,
+    }};
+    whServerContext server[1] = {0};
+    whNvmMetadata meta[1] = {0};
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    /* one listed, one flagged and one plain key */
+    meta->len = sizeof(key);
+    meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 1);
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObject(nvm, meta, sizeof(key), key));
+    meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 2);
+    meta->flags = WOLFHSM_NVM_FLAGS_PREFETCH;
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObject(nvm, meta, sizeof(key), key));
+    meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 3);
+    meta->flags = WOLFHSM_NVM_FLAGS_NONE;
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObject(nvm, meta, sizeof(key), key));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, s_conf));
+    WH_TEST_ASSERT_RETURN(hsmCacheFindKey(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 1)) >= 0);
+    WH_TEST_ASSERT_RETURN(hsmCacheFindKey(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 2)) >= 0);
+    WH_TEST_ASSERT_RETURN(hsmCacheFindKey(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 3)) ==
+        WH_ERROR_NOTFOUND);
+
+    /* pinning is looked up by the full id, in NVM or in the cache */
+    meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 4);
+    meta->flags = WOLFHSM_NVM_FLAGS_PINNED;
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObject(nvm, meta, sizeof(key), key));
+    meta->id = MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 5);
+    WH_TEST_RETURN_ON_FAIL(hsmCacheKey(server, meta, key));
+    WH_TEST_ASSERT_RETURN(hsmKeyIsPinned(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 4)) == 1);
+    WH_TEST_ASSERT_RETURN(hsmKeyIsPinned(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 5)) == 1);
+    WH_TEST_ASSERT_RETURN(hsmKeyIsPinned(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 1, 2)) == 0);
+    WH_TEST_ASSERT_RETURN(hsmKeyIsPinned(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 2, 5)) == 0);
+    WH_TEST_ASSERT_RETURN(hsmKeyIsPinned(server,
+        MAKE_WOLFHSM_KEYID(WOLFHSM_KEYTYPE_CRYPTO, 0, 5)) == 0);
+
+    WH_TEST_RETURN_ON_FAIL(_whTestKeyEvictLru(server));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+    wh_Nvm_Cleanup(nvm);
+
+    return WH_ERROR_OK;
+}
+
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+static int _whTestEphemeralEccCount(whServerContext* server)
+{
+    int i;
+    int count = 0;
+    for (i = 0; i < WH_SERVER_EPHEMERAL_ECC_COUNT; i++)
+        count += (server->ephemeralEcc[i].len != 0);
+    return count;
+}
+
+/* Fill the pool with wh_Server_RunIdle, bounded in case it never fills */
+static int _whTestEphemeralEccFill(whServerContext* server)
+{
+    int i;
+    for (i = 0; i < 64 &&
+            _whTestEphemeralEccCount(server) < WH_SERVER_EPHEMERAL_ECC_COUNT;
+            i++) {
+        WH_TEST_ASSERT_RETURN(wh_Server_RunIdle(server) >= 0);
+    }
+    WH_TEST_ASSERT_RETURN(
+        _whTestEphemeralEccCount(server) == WH_SERVER_EPHEMERAL_ECC_COUNT);
+    return 0;
+}
+
+static int _whTestEphemeralEccKeygen(whServerContext* server,
+    crypto_context* crypto, uint32_t sz, uint32_t curveId)
+{
+    whPacket packet[1] = {0};
+    uint16_t size = WOLFHSM_PACKET_STUB_SIZE + sizeof(packet->pkEckgReq);
+    packet->pkEckgReq.type = WC_PK_TYPE_EC_KEYGEN;
+    packet->pkEckgReq.sz = sz;
+    packet->pkEckgReq.curveId = curveId;
+    WH_TEST_RETURN_ON_FAIL(wh_Server_HandleCryptoRequestEx(server, crypto,
+        server->comm, WC_ALGO_TYPE_PK, (uint8_t*)packet, &size));
+    WH_TEST_RETURN_ON_FAIL(packet->rc);
+    WH_TEST_ASSERT_RETURN(packet->pkEckgRes.keyId != WOLFHSM_KEYID_ERASED);
+    return 0;
+}
+
+static int wh_ClientServer_EphemeralEccTest(void)
+{
+    uint8_t req[BUFFER_SIZE] = {0};
+    uint8_t resp[BUFFER_SIZE] = {0};
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    whTransportServerCb         tscb[1]   = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]   = {0};
+    whCommServerConfig          cs_conf[1] = {{
+                 .transport_cb      = tscb,
+                 .transport_context = (void*)tmsc,
+                 .transport_config  = (void*)tmcf,
+                 .server_id         = 124,
+    }};
+    whFlashRamsimCtx fc[1] = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 128 * 1024,  /* 128KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = ~(uint8_t)0,
+    }};
+    const whFlashCb  fcb[1]          = {WH_FLASH_RAMSIM_CB};
+    whNvmFlashConfig nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1] = {0};
+    whNvmCb nfcb[1] = {WH_NVM_FLASH_CB};
+    whNvmConfig n_conf[1] = {{
+            .cb = nfcb,
+            .context = nfc,
+            .config = nf_conf,
+    }};
+    whNvmContext nvm[1] = {{0}};
+    crypto_context crypto[1] = {{
+            .devId = INVALID_DEVID,
+    }};
+    whServerConfig s_conf[1] = {{
+       .comm_config = cs_conf,
+       .nvm         = nvm,
+       .crypto      = crypto,
+       .devId       = INVALID_DEVID,
+    }};
+    whServerContext server[1] = {0};
+    int ret = 0;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wolfCrypt_Init());
+    WH_TEST_RETURN_ON_FAIL(wc_InitRng_ex(crypto->rng, NULL, crypto->devId));
+    WH_TEST_RETURN_ON_FAIL(wh_Server_Init(server, s_conf));
+    server->comm->client_id = 1;
+
+    ret = _whTestEphemeralEccFill(server);
+    /* what wc_ecc_make_key asks for is served from the pool */
+    if (ret == 0) {
+        ret = _whTestEphemeralEccKeygen(server, crypto,
+            WH_SERVER_EPHEMERAL_ECC_SIZE, ECC_CURVE_DEF);
+    }
+    if (ret == 0 && _whTestEphemeralEccCount(server) !=
+            WH_SERVER_EPHEMERAL_ECC_COUNT - 1) {
+        WH_ERROR_PRINT("ECC keygen was not served from the pool\n");
+        ret = -1;
+    }
+#if !defined(NO_ECC256) && (WH_SERVER_EPHEMERAL_ECC_SIZE == 32) && \
+    (WH_SERVER_EPHEMERAL_ECC_COUNT > 1)
+    /* and so is the same curve asked for by name, as TLS does */
+    if (ret == 0 && (WH_SERVER_EPHEMERAL_ECC_CURVE == ECC_CURVE_DEF ||
+            WH_SERVER_EPHEMERAL_ECC_CURVE == ECC_SECP256R1)) {
+        ret = _whTestEphemeralEccKeygen(server, crypto, 32, ECC_SECP256R1);
+        if (ret == 0 && _whTestEphemeralEccCount(server) !=
+                WH_SERVER_EPHEMERAL_ECC_COUNT - 2) {
+            WH_ERROR_PRINT("ECC_SECP256R1 keygen was not served from the "
+                "pool\n");
+            ret = -1;
+        }
+    }
+#endif
+    /* then idle time refills it */
+    if (ret == 0) {
+        ret = _whTestEphemeralEccFill(server);
+    }
+
+    if (ret == 0) {
+        WH_TEST_RETURN_ON_FAIL(wh_Server_Cleanup(server));
+    }
+    else {
+        (void)wh_Server_Cleanup(server);
+    }
+    wh_Nvm_Cleanup(nvm);
+    wc_FreeRng(crypto->rng);
+    wolfCrypt_Cleanup();
+    return ret;
+}
+#endif /* WH_SERVER_EPHEMERAL_ECC_COUNT > 0 */
+
 int whTest_Crypto(void)
 {
+    printf("Testing crypto: key prefetch, pinning and eviction...\n");
+    WH_TEST_RETURN_ON_FAIL(wh_ClientServer_KeyPrefetchTest());
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+    printf("Testing crypto: ephemeral ECC pool...\n");
+    WH_TEST_RETURN_ON_FAIL(wh_ClientServer_EphemeralEccTest());
+#endif
 #if defined(WH_CFG_TEST_POSIX)
     printf("Testing crypto: (pthread) mem...\n");
     WH_TEST_RETURN_ON_FAIL(wh_ClientServer_MemThreadTest());
+#if WH_SERVER_WORKER_COUNT > 0
+    printf("Testing crypto: (pthread) mem with worker pool...\n");
+    WH_TEST_RETURN_ON_FAIL(wh_ClientServer_MemWorkerThreadTest());
+#endif
 #endif
     return 0;
 }
@@ -29,6 +29,7 @@
 #define TEST_PAGE_SIZE (256)
 
 static void fillTestData(uint8_t* buffer, uint32_t size, uint32_t baseValue);
+static int whTest_Flash_RamSimStats(void);
 #if defined(WH_TEST_FLASH_RAMSIM_DEBUG)
 static void printMemory(uint8_t* buffer, uint32_t size, uint32_t offset);
 #endif
@@ -54,6 +55,97 @@ static void printMemory(uint8_t* buffer, uint32_t size, uint32_t offset)
 #endif /* WH_TEST_FLASH_RAMSIM_DEBUG */
 
 
+/* Operation counters, wear and the simulated time model */
+static int whTest_Flash_RamSimStats(void)
+{
+    whFlashRamsimCtx   ctx   = {0};
+    whFlashRamsimCfg   cfg   = {.size            = 4 * TEST_SECTOR_SIZE,
+                                .sectorSize      = TEST_SECTOR_SIZE,
+                                .pageSize        = TEST_PAGE_SIZE,
+                                .pageProgramTime = 100,
+                                .sectorEraseTime = 10000,
+                                .wordReadTime    = 1,
+                                .erasedByte      = 0xFF};
+    whFlashRamsimStats stats = {0};
+    uint8_t            data[2 * TEST_PAGE_SIZE] = {0};
+    uint32_t           count = 0;
+
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Init(&ctx, &cfg));
+
+    /* Two pages, one copied page, a read and a two sector erase */
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Program(&ctx, 0, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(
+        whFlashRamsim_Copy(&ctx, 0, TEST_SECTOR_SIZE, TEST_PAGE_SIZE));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Read(&ctx, 0, 6, data));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Erase(&ctx, 0, 2 * TEST_SECTOR_SIZE));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Erase(&ctx, 0, TEST_SECTOR_SIZE));
+    /* Failed operations are not counted */
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                          whFlashRamsim_Erase(&ctx, 1, TEST_SECTOR_SIZE));
+
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_GetStats(&ctx, &stats));
+    WH_TEST_ASSERT_RETURN(stats.programs == 2);
+    WH_TEST_ASSERT_RETURN(stats.bytesWritten == 3 * TEST_PAGE_SIZE);
+    WH_TEST_ASSERT_RETURN(stats.erases == 2);
+    WH_TEST_ASSERT_RETURN(stats.bytesErased == 3 * TEST_SECTOR_SIZE);
+    WH_TEST_ASSERT_RETURN(stats.reads == 2);
+    WH_TEST_ASSERT_RETURN(stats.bytesRead == TEST_PAGE_SIZE + 6);
+    WH_TEST_ASSERT_RETURN(stats.sectorCount == 4);
+    WH_TEST_ASSERT_RETURN(stats.minSectorErases == 0);
+    WH_TEST_ASSERT_RETURN(stats.maxSectorErases == 2);
+    /* 3 pages, 3 sectors and the words of both reads */
+    WH_TEST_ASSERT_RETURN(stats.elapsed ==
+                          3 * 100 + 3 * 10000 + TEST_PAGE_SIZE / 4 + 2);
+
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_GetSectorErases(&ctx, 0, &count));
+    WH_TEST_ASSERT_RETURN(count == 2);
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_GetSectorErases(&ctx, 1, &count));
+    WH_TEST_ASSERT_RETURN(count == 1);
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                          whFlashRamsim_GetSectorErases(&ctx, 4, &count));
+
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_ResetStats(&ctx));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_GetStats(&ctx, &stats));
+    WH_TEST_ASSERT_RETURN((stats.programs == 0) && (stats.elapsed == 0));
+    WH_TEST_ASSERT_RETURN(stats.maxSectorErases == 0);
+    WH_TEST_ASSERT_RETURN(stats.sectorCount == 4);
+
+    /* Adjacent segments are written as one program */
+    {
+        whFlashSegment segs[3];
+        uint8_t        bytes[3 * TEST_PAGE_SIZE];
+
+        memset(bytes, 0xA5, sizeof(bytes));
+        segs[0].data   = bytes;
+        segs[0].offset = 0;
+        segs[0].size   = TEST_PAGE_SIZE;
+        segs[1].data   = bytes + TEST_PAGE_SIZE;
+        segs[1].offset = TEST_PAGE_SIZE;
+        segs[1].size   = 2 * TEST_PAGE_SIZE;
+        segs[2].data   = bytes;
+        segs[2].offset = 3 * TEST_SECTOR_SIZE;
+        segs[2].size   = TEST_PAGE_SIZE;
+        WH_TEST_RETURN_ON_FAIL(whFlashRamsim_ProgramV(&ctx, segs, 3));
+        WH_TEST_RETURN_ON_FAIL(
+            whFlashRamsim_Verify(&ctx, 0, sizeof(bytes), bytes));
+        WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Verify(
+            &ctx, 3 * TEST_SECTOR_SIZE, TEST_PAGE_SIZE, bytes));
+
+        /* Nothing is written when any segment fails */
+        segs[2].offset = 2 * TEST_SECTOR_SIZE;
+        WH_TEST_ASSERT_RETURN(WH_ERROR_NOTBLANK ==
+                              whFlashRamsim_ProgramV(&ctx, segs, 3));
+        WH_TEST_RETURN_ON_FAIL(whFlashRamsim_BlankCheck(
+            &ctx, 2 * TEST_SECTOR_SIZE, TEST_PAGE_SIZE));
+
+        WH_TEST_RETURN_ON_FAIL(whFlashRamsim_GetStats(&ctx, &stats));
+        WH_TEST_ASSERT_RETURN(stats.programs == 2);
+        WH_TEST_ASSERT_RETURN(stats.bytesWritten == 4 * TEST_PAGE_SIZE);
+    }
+
+    return whFlashRamsim_Cleanup(&ctx);
+}
+
 int whTest_Flash_RamSim(void)
 {
     int              ret;
@@ -192,7 +284,50 @@ int whTest_Flash_RamSim(void)
         }
     }
 
+    /* Copy a programmed page to a blank one */
+    fillTestData(testData, cfg.pageSize, 0x5A);
+    WH_TEST_RETURN_ON_FAIL(
+        whFlashRamsim_Program(&ctx, 0, cfg.pageSize, testData));
+    if ((ret = whFlashRamsim_Copy(&ctx, 0, cfg.sectorSize, cfg.pageSize)) !=
+        0) {
+        WH_ERROR_PRINT("whFlashRamsim_Copy failed: ret=%d\n", ret);
+        whFlashRamsim_Cleanup(&ctx);
+        return ret;
+    }
+    WH_TEST_RETURN_ON_FAIL(
+        whFlashRamsim_Verify(&ctx, cfg.sectorSize, cfg.pageSize, testData));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTBLANK ==
+                          whFlashRamsim_Copy(&ctx, 0, cfg.sectorSize,
+                                             cfg.pageSize));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_WriteLock(&ctx, 0, cfg.size));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_LOCKED ==
+                          whFlashRamsim_Copy(&ctx, 0, 2 * cfg.sectorSize,
+                                             cfg.pageSize));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_WriteUnlock(&ctx, 0, cfg.size));
+
+    /* Started operations complete after the configured number of polls */
+    ctx.busyPolls = 2;
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_EraseStart(&ctx, 0, cfg.sectorSize));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          whFlashRamsim_ProgramStart(&ctx, cfg.sectorSize,
+                                                     cfg.pageSize, testData));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY == whFlashRamsim_Poll(&ctx));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY == whFlashRamsim_Poll(&ctx));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTBLANK ==
+                          whFlashRamsim_BlankCheck(&ctx, 0, cfg.pageSize));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Poll(&ctx));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_BlankCheck(&ctx, 0, cfg.sectorSize));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Poll(&ctx));
+
+    WH_TEST_RETURN_ON_FAIL(
+        whFlashRamsim_ProgramStart(&ctx, 0, cfg.pageSize, testData));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY == whFlashRamsim_Poll(&ctx));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY == whFlashRamsim_Poll(&ctx));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Poll(&ctx));
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_Verify(&ctx, 0, cfg.pageSize,
+                                                testData));
+
     whFlashRamsim_Cleanup(&ctx);
 
-    return 0;
+    return whTest_Flash_RamSimStats();
 }
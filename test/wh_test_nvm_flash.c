@@ -30,6 +30,7 @@
 #include "wolfhsm/wh_error.h"
 #include "wolfhsm/wh_nvm.h"
 #include "wolfhsm/wh_nvm_flash.h"
+#include "wolfhsm/wh_nvm_flash_log.h"
 
 /* NVM simulator backends to use for testing NVM module */
 #include "wolfhsm/wh_flash_ramsim.h"
@@ -283,15 +284,75 @@ int whTest_NvmFlashCfg(whNvmFlashConfig* cfg)
                 goto cleanup;
             }
         }
+
+        /* Only the latest version of an overwritten object survives */
+        WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, id2, &metaBuf));
+        WH_TEST_ASSERT_RETURN(metaBuf.len == sizeof(update3));
+        WH_TEST_RETURN_ON_FAIL(cb->Read(context, id2, 0, metaBuf.len, dataBuf));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(update3, dataBuf, sizeof(update3)));
+    }
+
+    /* Compact a step at a time, overwriting an object partway through */
+    {
+        whNvmMetadata metaBuf = {0};
+        unsigned char dataBuf[256];
+        int           steps   = 0;
+        printf("--Incremental compaction\n");
+        ret = addObjectWithReadBackCheck(cb, context, &meta3, sizeof(update2),
+                                         update2);
+        if (ret != 0) {
+            goto cleanup;
+        }
+        WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY == cb->Compact(context, 1));
+        WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY == cb->Compact(context, 1));
+        ret = addObjectWithReadBackCheck(cb, context, &meta1, sizeof(data1),
+                                         data1);
+        if (ret != 0) {
+            goto cleanup;
+        }
+        do {
+            ret = cb->Compact(context, 1);
+            steps++;
+        } while ((ret == WH_ERROR_NOTREADY) && (steps < 2 * NF_OBJECT_COUNT));
+        if (ret != 0) {
+            WH_ERROR_PRINT("Compact returned %d\n", ret);
+            goto cleanup;
+        }
+
+        /* Latest versions survive, including the one added meanwhile */
+        WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, id1, &metaBuf));
+        WH_TEST_RETURN_ON_FAIL(cb->Read(context, id1, 0, metaBuf.len, dataBuf));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(data1, dataBuf, sizeof(data1)));
+        WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, id3, &metaBuf));
+        WH_TEST_RETURN_ON_FAIL(cb->Read(context, id3, 0, metaBuf.len, dataBuf));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(update2, dataBuf, sizeof(update2)));
+        WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, id2, &metaBuf));
+        WH_TEST_ASSERT_RETURN(metaBuf.len == sizeof(update3));
     }
 
     /* Destroy 1 object */
     printf("--Destroy 1 object\n");
 
+#if WH_NVM_FLASH_TOMBSTONE
+    whNvmId reclaimBefore = 0;
+    WH_TEST_RETURN_ON_FAIL(
+        cb->GetAvailable(context, NULL, NULL, NULL, &reclaimBefore));
+#endif
+
     if ((ret = destroyObjectWithReadBackCheck(cb, context, 1, ids)) != 0) {
         goto cleanup;
     }
 
+#if WH_NVM_FLASH_TOMBSTONE
+    /* Destroy left a tombstone rather than compacting */
+    {
+        whNvmId reclaimObjects = 0;
+        WH_TEST_RETURN_ON_FAIL(
+            cb->GetAvailable(context, NULL, NULL, NULL, &reclaimObjects));
+        WH_TEST_ASSERT_RETURN(reclaimObjects == reclaimBefore + 2);
+    }
+#endif
+
 #if defined(WH_CFG_TEST_VERBOSE)
     _ShowAvailable(cb, context);
     _ShowList(cb, context);
@@ -349,8 +410,373 @@ int whTest_NvmFlash_RamSim(void)
 }
 
 
+/* Erases started by compaction are polled from later steps, and objects stay
+ * readable meanwhile */
+static int whTest_NvmFlashAsyncErase(void)
+{
+    const whFlashCb  myCb[1]          = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx myHalFlashCtx[1] = {0};
+    whFlashRamsimCfg myHalFlashCfg[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 4096,        /* 4KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .busyPolls  = 4,           /* Each started operation polls 4 times */
+        .erasedByte = (uint8_t)0,
+    }};
+    whNvmFlashConfig myNvmCfg = {
+        .cb      = myCb,
+        .context = myHalFlashCtx,
+        .config  = myHalFlashCfg,
+    };
+    const whNvmCb      cb[1]       = {WH_NVM_FLASH_CB};
+    whNvmFlashContext  context[1]  = {0};
+    whNvmMetadata      meta        = {.id = 1, .label = "Async"};
+    uint8_t            data[16]    = {0};
+    uint8_t            dataBuf[16] = {0};
+    uint32_t           steps       = 0;
+    int                rc          = 0;
+
+    printf("--Compaction with started erases\n");
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, &myNvmCfg));
+    memset(data, 1, sizeof(data));
+    WH_TEST_RETURN_ON_FAIL(cb->AddObject(context, &meta, sizeof(data), data));
+
+    do {
+        rc = cb->Compact(context, 0);
+        steps++;
+        WH_TEST_RETURN_ON_FAIL(
+            cb->Read(context, meta.id, 0, sizeof(dataBuf), dataBuf));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+    } while ((rc == WH_ERROR_NOTREADY) && (steps < 100));
+    WH_TEST_ASSERT_RETURN(rc == 0);
+    WH_TEST_ASSERT_RETURN(steps >= 3 + myHalFlashCfg->busyPolls);
+
+    /* The old partition was erased by the last step */
+    WH_TEST_RETURN_ON_FAIL(whFlashRamsim_BlankCheck(
+        myHalFlashCtx, (!context->active) * myHalFlashCfg->sectorSize,
+        myHalFlashCfg->sectorSize));
+
+    return cb->Cleanup(context);
+}
+
+/* Objects streamed in chunks of any size read back whole, and an add of the
+ * same id meanwhile stays current */
+static int whTest_NvmFlashStream(void)
+{
+    const whFlashCb  myCb[1]          = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx myHalFlashCtx[1] = {0};
+    whFlashRamsimCfg myHalFlashCfg[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 4096,        /* 4KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = (uint8_t)0,
+    }};
+    whNvmFlashConfig myNvmCfg = {
+        .cb      = myCb,
+        .context = myHalFlashCtx,
+        .config  = myHalFlashCfg,
+    };
+    const whNvmCb      cb[1]         = {WH_NVM_FLASH_CB};
+    whNvmFlashContext  context[1]    = {0};
+    whNvmMetadata      meta          = {.id = 1, .label = "Stream"};
+    whNvmMetadata      gmeta         = {0};
+    uint8_t            data[100]     = {0};
+    uint8_t            dataBuf[100]  = {0};
+    const whNvmSize    chunks[]      = {3, 5, 13, 8, 16, 1, 54};
+    whNvmSize          offset        = 0;
+    int                i             = 0;
+
+    printf("--Streamed objects\n");
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, &myNvmCfg));
+    for (i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (uint8_t)i;
+    }
+
+    meta.len = sizeof(data);
+    WH_TEST_RETURN_ON_FAIL(cb->AddObjectBegin(context, &meta));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          cb->GetMetadata(context, meta.id, &gmeta));
+    for (i = 0; i < (int)(sizeof(chunks) / sizeof(chunks[0])); i++) {
+        WH_TEST_RETURN_ON_FAIL(
+            cb->AddObjectAppend(context, chunks[i], data + offset));
+        offset += chunks[i];
+
+        /* Compaction waits for the commit */
+        WH_TEST_ASSERT_RETURN(WH_ERROR_LOCKED == cb->Compact(context, 0));
+    }
+    WH_TEST_ASSERT_RETURN(offset == sizeof(data));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS ==
+                          cb->AddObjectAppend(context, 1, data));
+    WH_TEST_RETURN_ON_FAIL(cb->AddObjectCommit(context));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND == cb->AddObjectCommit(context));
+
+    WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, meta.id, &gmeta));
+    WH_TEST_ASSERT_RETURN(gmeta.len == sizeof(data));
+    WH_TEST_RETURN_ON_FAIL(
+        cb->Read(context, meta.id, 0, sizeof(dataBuf), dataBuf));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+
+    /* A whole add during the stream is newer than the streamed object */
+    meta.len = 8;
+    WH_TEST_RETURN_ON_FAIL(cb->AddObjectBegin(context, &meta));
+    WH_TEST_RETURN_ON_FAIL(cb->AddObject(context, &meta, 4, data + 50));
+    WH_TEST_RETURN_ON_FAIL(cb->AddObjectAppend(context, 8, data));
+    WH_TEST_RETURN_ON_FAIL(cb->AddObjectCommit(context));
+    WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, meta.id, &gmeta));
+    WH_TEST_ASSERT_RETURN(gmeta.len == 4);
+
+    /* Compaction keeps only the current version */
+    while (WH_ERROR_NOTREADY == (i = cb->Compact(context, 0))) {
+    }
+    WH_TEST_ASSERT_RETURN(i == 0);
+    WH_TEST_RETURN_ON_FAIL(cb->Read(context, meta.id, 0, 4, dataBuf));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data + 50, dataBuf, 4));
+
+    return cb->Cleanup(context);
+}
+
+/* Only the opener of a stream may continue it, and aborting it lets
+ * compaction go ahead */
+static int whTest_NvmStreamOwner(void)
+{
+    whFlashCb        myCb[1]          = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx myHalFlashCtx[1] = {0};
+    whFlashRamsimCfg myHalFlashCfg[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 4096,        /* 4KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = (uint8_t)0,
+    }};
+    whNvmFlashConfig  myNvmFlashCfg = {
+         .cb      = myCb,
+         .context = myHalFlashCtx,
+         .config  = myHalFlashCfg,
+    };
+    whNvmFlashContext nvmFlashCtx[1] = {0};
+    whNvmCb           nvmCb[1]       = {WH_NVM_FLASH_CB};
+    whNvmConfig       nvmCfg         = {
+                      .cb      = nvmCb,
+                      .context = nvmFlashCtx,
+                      .config  = &myNvmFlashCfg,
+                      .generation = 0x1000,
+    };
+    whNvmContext  nvm[1]   = {{0}};
+    whNvmMetadata meta     = {.id = 1, .label = "Owned", .len = 8};
+    whNvmMetadata gmeta    = {0};
+    uint8_t       data[8]  = {0};
+    int           ownerA   = 0;
+    int           ownerB   = 0;
+    int           ret      = 0;
+
+    printf("--Streamed object ownership\n");
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, &nvmCfg));
+    /* The generation starts where the platform seeded it */
+    WH_TEST_ASSERT_RETURN(nvm->generation == 0x1000);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObjectBegin(nvm, &ownerA, &meta));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTREADY ==
+                          wh_Nvm_AddObjectBegin(nvm, &ownerB, &meta));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_ACCESS ==
+                          wh_Nvm_AddObjectAppend(nvm, &ownerB, 8, data));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_ACCESS ==
+                          wh_Nvm_AddObjectCommit(nvm, &ownerB));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObjectAppend(nvm, &ownerA, 8, data));
+
+    /* Another owner's abort leaves the stream alone */
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObjectAbort(nvm, &ownerB));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_LOCKED == wh_Nvm_Compact(nvm, 0));
+
+    /* The owner's abort drops the object and frees compaction */
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObjectAbort(nvm, &ownerA));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Nvm_AddObjectCommit(nvm, &ownerA));
+    while (WH_ERROR_NOTREADY == (ret = wh_Nvm_Compact(nvm, 0))) {
+    }
+    WH_TEST_ASSERT_RETURN(ret == 0);
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Nvm_GetMetadata(nvm, meta.id, &gmeta));
+
+    /* And the next owner can stream */
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObjectBegin(nvm, &ownerB, &meta));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObjectAppend(nvm, &ownerB, 8, data));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObjectCommit(nvm, &ownerB));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_GetMetadata(nvm, meta.id, &gmeta));
+    WH_TEST_ASSERT_RETURN(gmeta.len == 8);
+
+    return wh_Nvm_Cleanup(nvm);
+}
+
+/* Rewrite one object until every block has been compacted, checking the cold
+ * objects survive and the erase counts stay level */
+static int whTest_NvmFlashLogCfg(whNvmFlashLogConfig* cfg)
+{
+    const whNvmCb        cb[1]      = {WH_NVM_FLASH_LOG_CB};
+    whNvmFlashLogContext context[1] = {0};
+    whNvmMetadata        meta       = {.label = "Log"};
+    whNvmMetadata        metaBuf    = {0};
+    uint8_t              data[200]  = {0};
+    uint8_t              dataBuf[200];
+    uint32_t             reclaimSize  = 0;
+    uint32_t             reclaimSize2 = 0;
+    uint32_t             minErase     = 0xFFFFFFFF;
+    uint32_t             maxErase     = 0;
+    uint32_t             i            = 0;
+    whNvmId              count        = 0;
+    whNvmId              id           = 0;
+    int                  rc           = 0;
+
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, cfg));
+
+    printf("--Add cold objects\n");
+    for (id = 1; id <= 4; id++) {
+        meta.id = id;
+        memset(data, id, sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(
+            cb->AddObject(context, &meta, sizeof(data), data));
+    }
+
+    printf("--Rewrite a hot object\n");
+    meta.id = 5;
+    for (i = 0; i < 4000; i++) {
+        memset(data, (uint8_t)i, sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(
+            cb->AddObject(context, &meta, sizeof(data), data));
+    }
+    for (id = 1; id <= 5; id++) {
+        memset(data, (id == 5) ? (uint8_t)(i - 1) : id, sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, id, &metaBuf));
+        WH_TEST_ASSERT_RETURN(metaBuf.len == sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(
+            cb->Read(context, id, 0, sizeof(dataBuf), dataBuf));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+    }
+
+    /* The block holding the cold objects was still rotated */
+    for (i = 0; i < context->block_count; i++) {
+        if (context->blocks[i].erase_count < minErase) {
+            minErase = context->blocks[i].erase_count;
+        }
+        if (context->blocks[i].erase_count > maxErase) {
+            maxErase = context->blocks[i].erase_count;
+        }
+    }
+    WH_TEST_ASSERT_RETURN(minErase > 0);
+    WH_TEST_ASSERT_RETURN(maxErase - minErase <=
+                          WH_NVM_FLASH_LOG_WEAR_LIMIT + 1);
+
+    printf("--Destroy and compact one block at a time\n");
+    id = 2;
+    WH_TEST_RETURN_ON_FAIL(cb->DestroyObjects(context, 1, &id));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          cb->GetMetadata(context, id, &metaBuf));
+    WH_TEST_RETURN_ON_FAIL(cb->List(context, WOLFHSM_NVM_ACCESS_ANY,
+                                    WOLFHSM_NVM_FLAGS_ANY, 0, &count, &id));
+    WH_TEST_ASSERT_RETURN((count == 4) && (id == 1));
+    WH_TEST_RETURN_ON_FAIL(cb->List(context, WOLFHSM_NVM_ACCESS_ANY,
+                                    WOLFHSM_NVM_FLAGS_ANY, 1, &count, &id));
+    WH_TEST_ASSERT_RETURN((count == 3) && (id == 3));
+
+    WH_TEST_RETURN_ON_FAIL(
+        cb->GetAvailable(context, NULL, NULL, &reclaimSize, NULL));
+    for (i = 0; (rc = cb->Compact(context, 0)) == WH_ERROR_NOTREADY; i++) {
+        WH_TEST_ASSERT_RETURN(i < context->block_count);
+    }
+    WH_TEST_ASSERT_RETURN(rc == 0);
+    WH_TEST_RETURN_ON_FAIL(
+        cb->GetAvailable(context, NULL, NULL, &reclaimSize2, NULL));
+    WH_TEST_ASSERT_RETURN(reclaimSize2 <= reclaimSize);
+
+    return cb->Cleanup(context);
+}
+
+int whTest_NvmFlashLog_RamSim(void)
+{
+    const whFlashCb  myCb[1]          = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx myHalFlashCtx[1] = {0};
+    whFlashRamsimCfg myHalFlashCfg[1] = {{
+        .size       = 32 * 1024, /* 32KB Flash */
+        .sectorSize = 4096,      /* 4KB  Sector Size */
+        .pageSize   = 8,         /* 8B   Page Size */
+        .erasedByte = (uint8_t)0,
+    }};
+
+    /* NVM Configuration of 8 blocks, one per sector */
+    whNvmFlashLogConfig myNvmCfg = {
+        .cb          = myCb,
+        .context     = myHalFlashCtx,
+        .config      = myHalFlashCfg,
+        .block_size  = 4096,
+        .block_count = 8,
+    };
+
+    return whTest_NvmFlashLogCfg(&myNvmCfg);
+}
+
 #if defined(WH_CFG_TEST_POSIX)
 
+static int _readCount = 0;
+
+static int _countingRead(void* c, uint32_t offset, uint32_t size, uint8_t* data)
+{
+    _readCount++;
+    return posixFlashFile_Read(c, offset, size, data);
+}
+
+/* Remount a compacted NVM with later additions and check nothing is lost */
+static int whTest_NvmFlashRemount(whNvmFlashConfig* cfg)
+{
+    const whNvmCb     cb[1]      = {WH_NVM_FLASH_CB};
+    whNvmFlashContext context[1] = {0};
+    whNvmMetadata     meta       = {.label = "Remount"};
+    whNvmMetadata     metaBuf    = {0};
+    uint8_t           data[24]   = {0};
+    uint8_t           dataBuf[24];
+    uint32_t          availSize  = 0;
+    uint32_t          availSize2 = 0;
+    whNvmId           availObjects  = 0;
+    whNvmId           availObjects2 = 0;
+    whNvmId           id = 0;
+
+    printf("--Remount after compaction\n");
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, cfg));
+    for (id = 1; id <= 4; id++) {
+        meta.id = id;
+        memset(data, id, sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(
+            cb->AddObject(context, &meta, sizeof(data), data));
+    }
+    WH_TEST_RETURN_ON_FAIL(cb->AddObject(context, &meta, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(cb->DestroyObjects(context, 0, NULL));
+
+    /* Added after the compaction */
+    meta.id = 5;
+    memset(data, 5, sizeof(data));
+    WH_TEST_RETURN_ON_FAIL(cb->AddObject(context, &meta, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(cb->GetAvailable(context, &availSize, &availObjects,
+                                            NULL, NULL));
+    WH_TEST_RETURN_ON_FAIL(cb->Cleanup(context));
+
+    _readCount = 0;
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, cfg));
+#if WH_NVM_FLASH_CHECKPOINT
+    /* Only the object added after the checkpoint is read on its own */
+    WH_TEST_ASSERT_RETURN(_readCount < NF_OBJECT_COUNT);
+#endif
+    WH_TEST_RETURN_ON_FAIL(cb->GetAvailable(context, &availSize2,
+                                            &availObjects2, NULL, NULL));
+    WH_TEST_ASSERT_RETURN(availSize == availSize2);
+    WH_TEST_ASSERT_RETURN(availObjects == availObjects2);
+    for (id = 1; id <= 5; id++) {
+        memset(data, id, sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(cb->GetMetadata(context, id, &metaBuf));
+        WH_TEST_ASSERT_RETURN(metaBuf.len == sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(
+            cb->Read(context, id, 0, sizeof(dataBuf), dataBuf));
+        WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+    }
+    return cb->Cleanup(context);
+}
+
 int whTest_NvmFlash_PosixFileSim(void)
 {
     /* HAL Flash state and configuration */
@@ -373,6 +799,141 @@ int whTest_NvmFlash_PosixFileSim(void)
 
     WH_TEST_ASSERT(0 == whTest_NvmFlashCfg(&myNvmCfg));
 
+    /* Remount the same file, counting the flash reads */
+    {
+        whFlashCb countingCb[1] = {POSIX_FLASH_FILE_CB};
+        countingCb->Read        = _countingRead;
+        myNvmCfg.cb             = countingCb;
+        WH_TEST_ASSERT(0 == whTest_NvmFlashRemount(&myNvmCfg));
+    }
+
+    /* Remove the configured file on success*/
+    unlink(myHalFlashConfig[0].filename);
+    return 0;
+}
+
+/* The same tests on a mapped file, then check the contents reached the file
+ * by mounting it again without the mapping */
+int whTest_NvmFlash_PosixFileMmap(void)
+{
+    const whFlashCb       myCb[1]              = {POSIX_FLASH_FILE_CB};
+    posixFlashFileContext myHalFlashContext[1] = {0};
+    posixFlashFileConfig  myHalFlashConfig[1]  = {{
+          .filename       = "myNvmMmap.bin",
+          .partition_size = 16384,
+          .erased_byte    = (~(uint8_t)0),
+          .use_mmap       = 1,
+          .sync_mode      = POSIX_FLASH_FILE_SYNC_ERASE,
+    }};
+
+    whNvmFlashConfig myNvmCfg = {
+        .cb      = myCb,
+        .context = myHalFlashContext,
+        .config  = myHalFlashConfig,
+    };
+
+    const whNvmCb     cb[1]      = {WH_NVM_FLASH_CB};
+    whNvmFlashContext context[1] = {0};
+    uint8_t           data[24]   = {0};
+    uint8_t           dataBuf[24];
+    int               rc         = 0;
+
+    WH_TEST_ASSERT(0 == whTest_NvmFlashCfg(&myNvmCfg));
+    WH_TEST_ASSERT(0 == whTest_NvmFlashRemount(&myNvmCfg));
+
+    /* An explicit flush works on a mapped file */
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, &myNvmCfg));
+    WH_TEST_ASSERT_RETURN(myHalFlashContext->map != NULL);
+    WH_TEST_RETURN_ON_FAIL(posixFlashFile_Sync(myHalFlashContext));
+    WH_TEST_RETURN_ON_FAIL(cb->Cleanup(context));
+    WH_TEST_ASSERT_RETURN(myHalFlashContext->map == NULL);
+
+    myHalFlashConfig->use_mmap = 0;
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, &myNvmCfg));
+    memset(data, 5, sizeof(data));
+    rc = cb->Read(context, 5, 0, sizeof(dataBuf), dataBuf);
+    (void)cb->Cleanup(context);
+    WH_TEST_RETURN_ON_FAIL(rc);
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+
+    /* Remove the configured file on success*/
+    unlink(myHalFlashConfig[0].filename);
+    return 0;
+}
+
+/* Remount a compacted log and check the newest records and a tombstone win */
+static int whTest_NvmFlashLogRemount(whNvmFlashLogConfig* cfg)
+{
+    const whNvmCb        cb[1]      = {WH_NVM_FLASH_LOG_CB};
+    whNvmFlashLogContext context[1] = {0};
+    whNvmMetadata        meta       = {.label = "LogRemount"};
+    whNvmMetadata        metaBuf    = {0};
+    uint8_t              data[24]   = {0};
+    uint8_t              dataBuf[24];
+    uint32_t             availSize  = 0;
+    uint32_t             availSize2 = 0;
+    whNvmId              availObjects  = 0;
+    whNvmId              availObjects2 = 0;
+    whNvmId              id = 0;
+    int                  i  = 0;
+
+    printf("--Remount log after compaction\n");
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, cfg));
+    for (id = 1; id <= 3; id++) {
+        meta.id = id;
+        memset(data, id, sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(
+            cb->AddObject(context, &meta, sizeof(data), data));
+    }
+    /* Enough rewrites to wrap around every block */
+    meta.id = 1;
+    for (i = 0; i < 500; i++) {
+        memset(data, (uint8_t)i, sizeof(data));
+        WH_TEST_RETURN_ON_FAIL(
+            cb->AddObject(context, &meta, sizeof(data), data));
+    }
+    id = 2;
+    WH_TEST_RETURN_ON_FAIL(cb->DestroyObjects(context, 1, &id));
+    WH_TEST_RETURN_ON_FAIL(cb->GetAvailable(context, &availSize, &availObjects,
+                                            NULL, NULL));
+    WH_TEST_RETURN_ON_FAIL(cb->Cleanup(context));
+
+    WH_TEST_RETURN_ON_FAIL(cb->Init(context, cfg));
+    WH_TEST_RETURN_ON_FAIL(cb->GetAvailable(context, &availSize2,
+                                            &availObjects2, NULL, NULL));
+    WH_TEST_ASSERT_RETURN(availSize == availSize2);
+    WH_TEST_ASSERT_RETURN(availObjects == availObjects2);
+
+    memset(data, (uint8_t)(i - 1), sizeof(data));
+    WH_TEST_RETURN_ON_FAIL(cb->Read(context, 1, 0, sizeof(dataBuf), dataBuf));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          cb->GetMetadata(context, 2, &metaBuf));
+    memset(data, 3, sizeof(data));
+    WH_TEST_RETURN_ON_FAIL(cb->Read(context, 3, 0, sizeof(dataBuf), dataBuf));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+    return cb->Cleanup(context);
+}
+
+int whTest_NvmFlashLog_PosixFileSim(void)
+{
+    const whFlashCb       myCb[1]              = {POSIX_FLASH_FILE_CB};
+    posixFlashFileContext myHalFlashContext[1] = {0};
+    posixFlashFileConfig  myHalFlashConfig[1]  = {{
+          .filename       = "myNvmLog.bin",
+          .partition_size = 16384,
+          .erased_byte    = (~(uint8_t)0),
+    }};
+
+    whNvmFlashLogConfig myNvmCfg = {
+        .cb         = myCb,
+        .context    = myHalFlashContext,
+        .config     = myHalFlashConfig,
+        .block_size = 4096,
+    };
+
+    WH_TEST_ASSERT(0 == whTest_NvmFlashLogRemount(&myNvmCfg));
+
     /* Remove the configured file on success*/
     unlink(myHalFlashConfig[0].filename);
     return 0;
@@ -381,14 +942,107 @@ int whTest_NvmFlash_PosixFileSim(void)
 #endif
 
 
+#if WH_NVM_CACHE_COUNT > 0
+static int _ramsimReadCount = 0;
+
+static int _countingRamsimRead(void* c, uint32_t offset, uint32_t size,
+                               uint8_t* data)
+{
+    _ramsimReadCount++;
+    return whFlashRamsim_Read(c, offset, size, data);
+}
+
+/* Repeated reads of a small object are served from RAM until it changes */
+static int whTest_NvmCache(void)
+{
+    whFlashCb        myCb[1]          = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx myHalFlashCtx[1] = {0};
+    whFlashRamsimCfg myHalFlashCfg[1] = {{
+        .size       = 1024 * 1024, /* 1MB  Flash */
+        .sectorSize = 4096,        /* 4KB  Sector Size */
+        .pageSize   = 8,           /* 8B   Page Size */
+        .erasedByte = (uint8_t)0,
+    }};
+    whNvmFlashConfig  myNvmFlashCfg = {
+         .cb      = myCb,
+         .context = myHalFlashCtx,
+         .config  = myHalFlashCfg,
+    };
+    whNvmFlashContext nvmFlashCtx[1] = {0};
+    whNvmCb           nvmCb[1]       = {WH_NVM_FLASH_CB};
+    whNvmConfig       nvmCfg         = {
+                      .cb      = nvmCb,
+                      .context = nvmFlashCtx,
+                      .config  = &myNvmFlashCfg,
+    };
+    whNvmContext  nvm[1]      = {{0}};
+    whNvmMetadata meta        = {.id = 1, .label = "Cached"};
+    uint8_t       data[16]    = {0};
+    uint8_t       dataBuf[16] = {0};
+    uint8_t       zeros[WH_NVM_CACHE_SIZE] = {0};
+    int           reads       = 0;
+    int           i           = 0;
+
+    printf("Testing NVM read cache...\n");
+    myCb->Read = _countingRamsimRead;
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, &nvmCfg));
+
+    memset(data, 1, sizeof(data));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObject(nvm, &meta, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Read(nvm, 1, 0, sizeof(dataBuf), dataBuf));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+
+    /* Served from RAM, including a partial read */
+    reads = _ramsimReadCount;
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Read(nvm, 1, 0, sizeof(dataBuf), dataBuf));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Read(nvm, 1, 4, 8, dataBuf));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data + 4, dataBuf, 8));
+    WH_TEST_ASSERT_RETURN(reads == _ramsimReadCount);
+
+    /* Rewriting the object drops the cached copy */
+    memset(data, 2, sizeof(data));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObject(nvm, &meta, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Read(nvm, 1, 0, sizeof(dataBuf), dataBuf));
+    WH_TEST_ASSERT_RETURN(0 == memcmp(data, dataBuf, sizeof(data)));
+    WH_TEST_ASSERT_RETURN(reads < _ramsimReadCount);
+
+    /* So does destroying it, wiping the copy */
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_DestroyObjects(nvm, 1, &meta.id));
+    for (i = 0; i < WH_NVM_CACHE_COUNT; i++) {
+        WH_TEST_ASSERT_RETURN(0 == memcmp(nvm->cache[i].data, zeros,
+                                          sizeof(zeros)));
+    }
+    WH_TEST_ASSERT_RETURN(WH_ERROR_NOTFOUND ==
+                          wh_Nvm_Read(nvm, 1, 0, sizeof(dataBuf), dataBuf));
+
+    return wh_Nvm_Cleanup(nvm);
+}
+#endif /* WH_NVM_CACHE_COUNT > 0 */
+
 int whTest_NvmFlash(void)
 {
     printf("Testing NVM flash with RAM sim...\n");
     WH_TEST_ASSERT(0 == whTest_NvmFlash_RamSim());
+    WH_TEST_ASSERT(0 == whTest_NvmFlashAsyncErase());
+    WH_TEST_ASSERT(0 == whTest_NvmFlashStream());
+    WH_TEST_ASSERT(0 == whTest_NvmStreamOwner());
 
 #if defined(WH_CFG_TEST_POSIX)
     printf("Testing NVM flash with POSIX file sim...\n");
     WH_TEST_ASSERT(0 == whTest_NvmFlash_PosixFileSim());
+    WH_TEST_ASSERT(0 == whTest_NvmFlash_PosixFileMmap());
+#endif
+
+    printf("Testing NVM flash log with RAM sim...\n");
+    WH_TEST_ASSERT(0 == whTest_NvmFlashLog_RamSim());
+
+#if defined(WH_CFG_TEST_POSIX)
+    printf("Testing NVM flash log with POSIX file sim...\n");
+    WH_TEST_ASSERT(0 == whTest_NvmFlashLog_PosixFileSim());
+#endif
+
+#if WH_NVM_CACHE_COUNT > 0
+    WH_TEST_ASSERT(0 == whTest_NvmCache());
 #endif
 
     return 0;
@@ -60,6 +60,60 @@ enum {
     };
 
 
+/* larger than a DMA block so the bulk ciphers map it in pieces */
+#define SHE_BULK_SZ (2 * WH_SHE_CIPHER_DMA_BLOCK + 64)
+static uint8_t bulkPlain[SHE_BULK_SZ];
+static uint8_t bulkData[SHE_BULK_SZ];
+
+#if WH_SHE_KDF_CACHE_COUNT > 0
+/* server SHE context, set when the server runs in this process so the client
+ * test can watch the KDF cache */
+static she_context* sheTestCtx = NULL;
+
+/* Load keyId under authKeyId with the given counter, and check whether the
+ * K1/K2 derivation of the auth key hit the KDF cache */
+static int _whTestSheKdfLoad(whClientContext* client, uint8_t keyId,
+    uint8_t authKeyId, uint32_t count, uint8_t* uid, uint8_t* key,
+    uint8_t* authKey, int expectHit)
+{
+    int ret;
+    uint8_t next;
+    uint8_t messageOne[WOLFHSM_SHE_M1_SZ];
+    uint8_t messageTwo[WOLFHSM_SHE_M2_SZ];
+    uint8_t messageThree[WOLFHSM_SHE_M3_SZ];
+    uint8_t messageFour[WOLFHSM_SHE_M4_SZ];
+    uint8_t messageFive[WOLFHSM_SHE_M5_SZ];
+    uint8_t outMessageFour[WOLFHSM_SHE_M4_SZ];
+    uint8_t outMessageFive[WOLFHSM_SHE_M5_SZ];
+
+    if ((ret = wh_SheGenerateLoadableKey(keyId, authKeyId, count, 0, uid, key,
+        authKey, messageOne, messageTwo, messageThree, messageFour,
+        messageFive)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_SheGenerateLoadableKey %d\n", ret);
+        return ret;
+    }
+    /* a miss stores a new entry and moves the replacement index, a hit
+     * leaves it where it was */
+    next = sheTestCtx->kdfCacheNext;
+    if ((ret = wh_Client_SheLoadKey(client, messageOne, messageTwo,
+        messageThree, outMessageFour, outMessageFive)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_SheLoadKey %d\n", ret);
+        return ret;
+    }
+    if (memcmp(outMessageFour, messageFour, sizeof(messageFour)) != 0 ||
+        memcmp(outMessageFive, messageFive, sizeof(messageFive)) != 0) {
+        WH_ERROR_PRINT("wh_Client_SheLoadKey FAILED TO MATCH\n");
+        return -1;
+    }
+    if ((sheTestCtx->kdfCacheNext == next) != (expectHit != 0)) {
+        WH_ERROR_PRINT("SHE KDF cache %s expected for key %u\n",
+            expectHit ? "hit" : "miss", (unsigned)keyId);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
 int whTest_SheClientConfig(whClientConfig* config)
 {
     int ret = 0;
@@ -113,6 +167,16 @@ int whTest_SheClientConfig(whClientConfig* config)
     uint8_t messageThree[WOLFHSM_SHE_M3_SZ];
     uint8_t messageFour[WOLFHSM_SHE_M4_SZ];
     uint8_t messageFive[WOLFHSM_SHE_M5_SZ];
+    uint8_t bulkIv[sizeof(iv)];
+    uint8_t batchM1[4 * WOLFHSM_SHE_M1_SZ];
+    uint8_t batchM2[4 * WOLFHSM_SHE_M2_SZ];
+    uint8_t batchM3[4 * WOLFHSM_SHE_M3_SZ];
+    uint8_t batchM4[4 * WOLFHSM_SHE_M4_SZ];
+    uint8_t batchM5[4 * WOLFHSM_SHE_M5_SZ];
+    uint8_t batchOutM4[4 * WOLFHSM_SHE_M4_SZ];
+    uint8_t batchOutM5[4 * WOLFHSM_SHE_M5_SZ];
+    uint32_t loaded = 0;
+    uint32_t i;
 
     if (config == NULL) {
         return WH_ERROR_BADARGS;
@@ -170,6 +234,14 @@ int whTest_SheClientConfig(whClientConfig* config)
         WH_ERROR_PRINT("Failed to wh_Client_SheSetUid %d\n", ret);
         goto exit;
     }
+    /* a tampered bootloader read over DMA must fail and reset secure boot */
+    bootloader[0] ^= 0xFF;
+    if ((ret = wh_Client_SheSecureBootDma(client, bootloader, bootloaderSz)) == 0) {
+        WH_ERROR_PRINT("wh_Client_SheSecureBootDma accepted a bad image\n");
+        ret = -1;
+        goto exit;
+    }
+    bootloader[0] ^= 0xFF;
     /* verify bootloader */
     if ((ret = wh_Client_SheSecureBoot(client, bootloader, bootloaderSz)) != 0) {
         WH_ERROR_PRINT("Failed to wh_Client_SheSecureBoot %d\n", ret);
@@ -233,6 +305,57 @@ int whTest_SheClientConfig(whClientConfig* config)
         goto exit;
     }
     printf("SHE LOAD KEY SUCCESS\n");
+    /* batch load three new keys, then a replay of key 4 that must stop it */
+    for (i = 0; i < 4; i++) {
+        memcpy(key, vectorRawKey, sizeof(key));
+        key[0] ^= (uint8_t)(i + 1);
+        if ((ret = wh_SheGenerateLoadableKey((i < 3) ? 5 + i : 4,
+            WOLFHSM_SHE_MASTER_ECU_KEY_ID, 1, 0, sheUid, key,
+            vectorMasterEcuKey, batchM1 + i * WOLFHSM_SHE_M1_SZ,
+            batchM2 + i * WOLFHSM_SHE_M2_SZ, batchM3 + i * WOLFHSM_SHE_M3_SZ,
+            batchM4 + i * WOLFHSM_SHE_M4_SZ,
+            batchM5 + i * WOLFHSM_SHE_M5_SZ)) != 0) {
+            WH_ERROR_PRINT("Failed to wh_SheGenerateLoadableKey %d\n", ret);
+            goto exit;
+        }
+    }
+    ret = wh_Client_SheLoadKeyBatch(client, 4, batchM1, batchM2, batchM3,
+        batchOutM4, batchOutM5, &loaded);
+    if (ret != WH_SHE_ERC_KEY_UPDATE_ERROR || loaded != 3 ||
+        memcmp(batchOutM4, batchM4, 3 * WOLFHSM_SHE_M4_SZ) != 0 ||
+        memcmp(batchOutM5, batchM5, 3 * WOLFHSM_SHE_M5_SZ) != 0) {
+        WH_ERROR_PRINT("wh_Client_SheLoadKeyBatch %d loaded %u\n", ret,
+            (unsigned)loaded);
+        ret = -1;
+        goto exit;
+    }
+    ret = 0;
+    printf("SHE LOAD KEY BATCH SUCCESS\n");
+#if WH_SHE_KDF_CACHE_COUNT > 0
+    if (sheTestCtx != NULL) {
+        uint8_t authKey[sizeof(key)];
+        memcpy(authKey, vectorRawKey, sizeof(authKey));
+        authKey[1] ^= 0x5a;
+        /* the master key was derived for the batch, key 5 is new */
+        if ((ret = _whTestSheKdfLoad(client, 5, WOLFHSM_SHE_MASTER_ECU_KEY_ID,
+                2, sheUid, authKey, vectorMasterEcuKey, 1)) != 0 ||
+            (ret = _whTestSheKdfLoad(client, 6, 5, 2, sheUid, vectorRawKey,
+                authKey, 0)) != 0 ||
+            (ret = _whTestSheKdfLoad(client, 7, 5, 2, sheUid, vectorRawKey,
+                authKey, 1)) != 0) {
+            goto exit;
+        }
+        /* once key 5 changes its old derivations must not be used */
+        authKey[2] ^= 0xa5;
+        if ((ret = _whTestSheKdfLoad(client, 5, WOLFHSM_SHE_MASTER_ECU_KEY_ID,
+                3, sheUid, authKey, vectorMasterEcuKey, 1)) != 0 ||
+            (ret = _whTestSheKdfLoad(client, 6, 5, 3, sheUid, vectorRawKey,
+                authKey, 0)) != 0) {
+            goto exit;
+        }
+        printf("SHE KDF CACHE SUCCESS\n");
+    }
+#endif
     if ((ret = wh_Client_SheInitRnd(client)) != 0) {
         WH_ERROR_PRINT("Failed to wh_Client_SheInitRnd %d\n", ret);
         goto exit;
@@ -241,10 +364,26 @@ int whTest_SheClientConfig(whClientConfig* config)
         WH_ERROR_PRINT("Failed to wh_Client_SheInitRnd %d\n", ret);
         goto exit;
     }
+    /* the next output, computed ahead of time if the server pools them */
+    keySz = sizeof(finalText);
+    if ((ret = wh_Client_SheRnd(client, finalText, &keySz)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_SheRnd %d\n", ret);
+        goto exit;
+    }
+    if (keySz != sizeof(key) || memcmp(key, finalText, sizeof(key)) == 0) {
+        WH_ERROR_PRINT("wh_Client_SheRnd REPEATED OUTPUT\n");
+        ret = -1;
+        goto exit;
+    }
     if ((ret = wh_Client_SheExtendSeed(client, entropy, sizeof(entropy))) != 0) {
         WH_ERROR_PRINT("Failed to wh_Client_SheExtendSeed %d\n", ret);
         goto exit;
     }
+    keySz = sizeof(key);
+    if ((ret = wh_Client_SheRnd(client, key, &keySz)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_SheRnd %d\n", ret);
+        goto exit;
+    }
     printf("SHE RND SUCCESS\n");
     if ((ret = wh_Client_SheLoadPlainKey(client, key, sizeof(key))) != 0) {
         WH_ERROR_PRINT("Failed to wh_Client_SheLoadPlainKey %d\n", ret);
@@ -284,6 +423,43 @@ int whTest_SheClientConfig(whClientConfig* config)
         goto exit;
     }
     printf("SHE CBC SUCCESS\n");
+    /* bulk CBC in two chained calls must match the single packet result */
+    for (i = 0; i < sizeof(bulkPlain); i++)
+        bulkPlain[i] = (uint8_t)i;
+    memcpy(bulkPlain, plainText, sizeof(plainText));
+    memcpy(bulkIv, iv, sizeof(iv));
+    if ((ret = wh_Client_SheEncCbcDma(client, WOLFHSM_SHE_RAM_KEY_ID, bulkIv, sizeof(bulkIv), bulkPlain, bulkData, WH_SHE_CIPHER_DMA_BLOCK + AES_BLOCK_SIZE)) != 0 ||
+        (ret = wh_Client_SheEncCbcDma(client, WOLFHSM_SHE_RAM_KEY_ID, bulkIv, sizeof(bulkIv), bulkPlain + WH_SHE_CIPHER_DMA_BLOCK + AES_BLOCK_SIZE, bulkData + WH_SHE_CIPHER_DMA_BLOCK + AES_BLOCK_SIZE, sizeof(bulkPlain) - WH_SHE_CIPHER_DMA_BLOCK - AES_BLOCK_SIZE)) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_SheEncCbcDma %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(bulkData, cipherText, sizeof(cipherText)) != 0) {
+        WH_ERROR_PRINT("SHE BULK CBC FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    /* decrypt the whole stream in place with one call */
+    memcpy(bulkIv, iv, sizeof(iv));
+    if ((ret = wh_Client_SheDecCbcDma(client, WOLFHSM_SHE_RAM_KEY_ID, bulkIv, sizeof(bulkIv), bulkData, bulkData, sizeof(bulkData))) != 0) {
+        WH_ERROR_PRINT("Failed to wh_Client_SheDecCbcDma %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(bulkData, bulkPlain, sizeof(bulkPlain)) != 0) {
+        WH_ERROR_PRINT("SHE BULK CBC FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    if ((ret = wh_Client_SheEncEcbDma(client, WOLFHSM_SHE_RAM_KEY_ID, bulkPlain, bulkData, sizeof(bulkPlain))) != 0 ||
+        (ret = wh_Client_SheDecEcbDma(client, WOLFHSM_SHE_RAM_KEY_ID, bulkData, bulkData, sizeof(bulkData))) != 0) {
+        WH_ERROR_PRINT("Failed to SHE bulk ECB %d\n", ret);
+        goto exit;
+    }
+    if (memcmp(bulkData, bulkPlain, sizeof(bulkPlain)) != 0) {
+        WH_ERROR_PRINT("SHE BULK ECB FAILED TO MATCH\n");
+        ret = -1;
+        goto exit;
+    }
+    printf("SHE BULK CIPHER SUCCESS\n");
     if ((ret = wh_Client_SheGenerateMac(client, WOLFHSM_SHE_RAM_KEY_ID, plainText, sizeof(plainText), cipherText, sizeof(cipherText))) != 0) {
         WH_ERROR_PRINT("Failed to wh_Client_SheGenerateMac %d\n", ret);
         goto exit;
@@ -332,6 +508,10 @@ int whTest_SheServerConfig(whServerConfig* config)
             WH_ERROR_PRINT("Failed to wh_Server_HandleRequestMessage: %d\n", ret);
             break;
         }
+        if (ret == WH_ERROR_NOTREADY) {
+            /* precompute between requests */
+            (void)wh_Server_RunIdle(server);
+        }
         wh_Server_GetConnected(server, &am_connected);
     }
     if ((ret == 0) || (ret == WH_ERROR_NOTREADY)){
@@ -462,7 +642,13 @@ static int wh_ClientServer_MemThreadTest(void)
     WH_TEST_RETURN_ON_FAIL(wolfCrypt_Init());
     WH_TEST_RETURN_ON_FAIL(wc_InitRng_ex(crypto->rng, NULL, crypto->devId));
 
+#if WH_SHE_KDF_CACHE_COUNT > 0
+    sheTestCtx = she;
+#endif
     _whClientServerThreadTest(c_conf, s_conf);
+#if WH_SHE_KDF_CACHE_COUNT > 0
+    sheTestCtx = NULL;
+#endif
 
     wh_Nvm_Cleanup(nvm);
     wc_FreeRng(crypto->rng);
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wh_test_common.h"
+#include "wh_test_trace.h"
+
+#include "wolfhsm/wh_error.h"
+#include "wolfhsm/wh_trace.h"
+
+#ifdef WOLFHSM_TRACE
+
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_transport_mem.h"
+#include "wolfhsm/wh_flash_ramsim.h"
+#include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_nvm_flash.h"
+
+#define TEST_BUFFER_SIZE 1024
+#define TEST_KIND 0x1234
+
+static uint64_t _testClock = 0;
+static uint32_t _testStreamed = 0;
+
+static uint64_t _testTime(void* context)
+{
+    (void)context;
+    return ++_testClock;
+}
+
+static void _testStream(void* context, const whTraceEntry* entry)
+{
+    (void)context;
+    (void)entry;
+    _testStreamed++;
+}
+
+static whTraceEntry entries[WH_TRACE_COUNT];
+
+/* Index of the next entry from start matching event and arg16, or -1 */
+static int _testFind(uint32_t count, uint32_t start, uint16_t event,
+        uint16_t arg16)
+{
+    uint32_t i;
+    for (i = start; i < count; i++) {
+        if ((entries[i].event == event) && (entries[i].arg16 == arg16)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static int whTest_TraceRing(void)
+{
+    const whTraceConfig config[1] = {{
+        .time_cb   = _testTime,
+        .stream_cb = _testStream,
+    }};
+    uint32_t count = 0;
+    uint32_t lost = 0;
+    uint32_t i;
+
+    _testStreamed = 0;
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Init(config));
+    for (i = 0; i < WH_TRACE_COUNT + 3; i++) {
+        wh_Trace_Record(WH_TRACE_NONE, 0, i);
+    }
+    WH_TEST_ASSERT_RETURN(_testStreamed == WH_TRACE_COUNT + 3);
+
+    /* The oldest entries were overwritten */
+    count = 1;
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Read(entries, &count, &lost));
+    WH_TEST_ASSERT_RETURN(count == 1);
+    WH_TEST_ASSERT_RETURN(lost == 3);
+    WH_TEST_ASSERT_RETURN(entries[0].arg == 3);
+
+    count = WH_TRACE_COUNT;
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Read(entries + 1, &count, &lost));
+    WH_TEST_ASSERT_RETURN(count == WH_TRACE_COUNT - 1);
+    WH_TEST_ASSERT_RETURN(lost == 0);
+    for (i = 1; i < WH_TRACE_COUNT; i++) {
+        WH_TEST_ASSERT_RETURN(entries[i].arg == i + 3);
+        WH_TEST_ASSERT_RETURN(entries[i].time > entries[i - 1].time);
+    }
+
+    count = WH_TRACE_COUNT;
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Read(entries, &count, NULL));
+    WH_TEST_ASSERT_RETURN(count == 0);
+    WH_TEST_ASSERT_RETURN(WH_ERROR_BADARGS == wh_Trace_Read(NULL, NULL, NULL));
+    return 0;
+}
+
+static int whTest_TraceComm(void)
+{
+    const whTraceConfig config[1] = {{
+        .time_cb = _testTime,
+    }};
+    uint8_t              req[TEST_BUFFER_SIZE] = {0};
+    uint8_t              resp[TEST_BUFFER_SIZE] = {0};
+    whTransportMemConfig tmcf[1] = {{
+        .req       = (whTransportMemCsr*)req,
+        .req_size  = sizeof(req),
+        .resp      = (whTransportMemCsr*)resp,
+        .resp_size = sizeof(resp),
+    }};
+    whTransportClientCb         tccb[1]   = {WH_TRANSPORT_MEM_CLIENT_CB};
+    whTransportMemClientContext tmcc[1]   = {0};
+    whCommClientConfig          c_conf[1] = {{
+        .transport_cb      = tccb,
+        .transport_context = (void*)tmcc,
+        .transport_config  = (void*)tmcf,
+        .client_id         = 123,
+    }};
+    whCommClient                client[1] = {0};
+    whTransportServerCb         tscb[1]   = {WH_TRANSPORT_MEM_SERVER_CB};
+    whTransportMemServerContext tmsc[1]   = {0};
+    whCommServerConfig          s_conf[1] = {{
+        .transport_cb      = tscb,
+        .transport_context = (void*)tmsc,
+        .transport_config  = (void*)tmcf,
+        .server_id         = 124,
+    }};
+    whCommServer                server[1] = {0};
+    uint8_t  data[16] = "Trace";
+    uint16_t magic = 0;
+    uint16_t kind = 0;
+    uint16_t seq = 0;
+    uint16_t len = 0;
+    uint32_t count = WH_TRACE_COUNT;
+    static const uint16_t expected[] = {
+        WH_TRACE_CLIENT_REQUEST,
+        WH_TRACE_TRANSPORT_SEND,
+        WH_TRACE_TRANSPORT_RECV,
+        WH_TRACE_TRANSPORT_SEND,
+        WH_TRACE_TRANSPORT_RECV,
+    };
+    uint32_t i;
+
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_Init(client, c_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_Init(server, s_conf, NULL, NULL));
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Init(config));
+
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_SendRequest(client,
+            WH_COMM_MAGIC_NATIVE, TEST_KIND, &seq, sizeof(data), data));
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_RecvRequest(server, &magic, &kind,
+            &seq, &len, data));
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_SendResponse(server, magic, kind,
+            seq, 4, data));
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_RecvResponse(client, &magic, &kind,
+            &seq, &len, data));
+
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Read(entries, &count, NULL));
+    WH_TEST_ASSERT_RETURN(count == sizeof(expected) / sizeof(expected[0]));
+    for (i = 0; i < count; i++) {
+        WH_TEST_ASSERT_RETURN(entries[i].event == expected[i]);
+        WH_TEST_ASSERT_RETURN(entries[i].arg16 == TEST_KIND);
+        WH_TEST_ASSERT_RETURN((entries[i].arg >> 16) == seq);
+    }
+    WH_TEST_ASSERT_RETURN((entries[0].arg & 0xFFFF) == sizeof(data));
+    WH_TEST_ASSERT_RETURN((entries[4].arg & 0xFFFF) == 4);
+
+    WH_TEST_RETURN_ON_FAIL(wh_CommServer_Cleanup(server));
+    WH_TEST_RETURN_ON_FAIL(wh_CommClient_Cleanup(client));
+    return 0;
+}
+
+static int whTest_TraceNvm(void)
+{
+    const whFlashCb  fcb[1]     = {WH_FLASH_RAMSIM_CB};
+    whFlashRamsimCtx fc[1]      = {0};
+    whFlashRamsimCfg fc_conf[1] = {{
+        .size       = 64 * 1024,
+        .sectorSize = 32 * 1024,
+        .pageSize   = 8,
+        .erasedByte = ~(uint8_t)0,
+    }};
+    whNvmFlashConfig  nf_conf[1] = {{
+        .cb      = fcb,
+        .context = fc,
+        .config  = fc_conf,
+    }};
+    whNvmFlashContext nfc[1]    = {0};
+    whNvmCb           nfcb[1]   = {WH_NVM_FLASH_CB};
+    whNvmConfig       n_conf[1] = {{
+        .cb      = nfcb,
+        .context = nfc,
+        .config  = nf_conf,
+    }};
+    whNvmContext  nvm[1] = {{0}};
+    whNvmMetadata meta = {.id = 7, .label = "Trace"};
+    uint8_t       data[24] = {0};
+    uint32_t      count = WH_TRACE_COUNT;
+    int           begin;
+    int           program;
+    int           end;
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Init(nvm, n_conf));
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Init(NULL));
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_AddObject(nvm, &meta, sizeof(data), data));
+
+    /* The flash programs are nested within the add */
+    WH_TEST_RETURN_ON_FAIL(wh_Trace_Read(entries, &count, NULL));
+    begin = _testFind(count, 0, WH_TRACE_NVM_BEGIN, WH_TRACE_NVM_ADD);
+    WH_TEST_ASSERT_RETURN(begin >= 0);
+    WH_TEST_ASSERT_RETURN(entries[begin].arg == meta.id);
+    program = _testFind(count, begin, WH_TRACE_FLASH_BEGIN,
+            WH_TRACE_FLASH_PROGRAM);
+    end = _testFind(count, begin, WH_TRACE_NVM_END, WH_TRACE_NVM_ADD);
+    WH_TEST_ASSERT_RETURN(program > begin);
+    WH_TEST_ASSERT_RETURN(end > program);
+    WH_TEST_ASSERT_RETURN(entries[end].arg == 0);
+    WH_TEST_ASSERT_RETURN(entries[begin].time == 0);
+
+    WH_TEST_RETURN_ON_FAIL(wh_Nvm_Cleanup(nvm));
+    return 0;
+}
+
+int whTest_Trace(void)
+{
+    printf("Testing trace...\n");
+    WH_TEST_RETURN_ON_FAIL(whTest_TraceRing());
+    WH_TEST_RETURN_ON_FAIL(whTest_TraceComm());
+    WH_TEST_RETURN_ON_FAIL(whTest_TraceNvm());
+    return wh_Trace_Init(NULL);
+}
+
+#else
+
+int whTest_Trace(void)
+{
+    return 0;
+}
+
+#endif /* WOLFHSM_TRACE */
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_capture.h
+ *
+ * Request stream capture.  Built with WOLFHSM_CAPTURE, every request packet a
+ * comm server receives is passed with a time stamp to a sink callback, which
+ * may write it to a file, flash or a UART.  The records form a log that
+ * wh_Replay_Run() can feed back into a server.  Without WOLFHSM_CAPTURE the
+ * probe compiles to nothing.
+ *
+ * The capture state is shared by every comm server in the image and is not
+ * locked.  A sink used by servers on several threads must serialize itself.
+ *
+ * WARNING: requests are captured as received, so a log holds the key
+ * material of key cache and SHE requests and the data written to NVM objects.
+ * Set redact in the config to zero those payloads before they reach the sink.
+ * A redacted log keeps every request kind and size, so replaying it still
+ * exercises the same handlers, but the replayed results differ.
+ */
+
+#ifndef WOLFHSM_WH_CAPTURE_H_
+#define WOLFHSM_WH_CAPTURE_H_
+
+#include <stdint.h>
+
+/* A log is a whCaptureLogHeader followed by records, each a whCaptureRecord
+ * and then size bytes of the packet as received, comm header included.  Both
+ * structures are in the byte order of the capturing device, which a reader
+ * can tell from the magic */
+#define WH_CAPTURE_LOG_MAGIC 0x50434857     /* "WHCP" when little endian */
+#define WH_CAPTURE_LOG_VERSION 1
+
+typedef struct {
+    uint32_t magic;         /* WH_CAPTURE_LOG_MAGIC */
+    uint16_t version;       /* WH_CAPTURE_LOG_VERSION */
+    uint16_t record_len;    /* sizeof(whCaptureRecord) */
+} whCaptureLogHeader;
+
+typedef struct {
+    uint64_t time;          /* From the time source, 0 without one */
+    uint16_t size;          /* Bytes of packet that follow */
+    uint8_t  server_id;
+    uint8_t  client_id;     /* 0 until the client has sent CommInit */
+    uint8_t  padding[4];
+} whCaptureRecord;
+
+/* Returns a free-running cycle count or time stamp */
+typedef uint64_t (*whCaptureTimeCb)(void* context);
+
+/* Called with each request as it is received */
+typedef void (*whCaptureSinkCb)(void* context, const whCaptureRecord* record,
+        const void* packet);
+
+typedef struct {
+    whCaptureTimeCb time_cb;    /* Optional. Times are 0 without it */
+    whCaptureSinkCb sink_cb;    /* Nothing is captured without it */
+    void*           context;    /* Passed to the callbacks */
+    int             redact;     /* Nonzero to zero key, SHE and NVM data */
+    uint8_t         padding[4];
+} whCaptureConfig;
+
+#ifdef WOLFHSM_CAPTURE
+
+/* Set the callbacks.  NULL config stops capturing */
+int wh_Capture_Init(const whCaptureConfig* config);
+
+void wh_Capture_Request(uint8_t server_id, uint8_t client_id, uint16_t size,
+        const void* packet);
+
+#define WH_CAPTURE_REQUEST(_server_id, _client_id, _size, _packet)         \
+    wh_Capture_Request((uint8_t)(_server_id), (uint8_t)(_client_id),       \
+            (uint16_t)(_size), (_packet))
+
+#else
+
+#define WH_CAPTURE_REQUEST(_server_id, _client_id, _size, _packet) \
+    do { } while (0)
+
+#endif /* WOLFHSM_CAPTURE */
+
+#endif /* WOLFHSM_WH_CAPTURE_H_ */
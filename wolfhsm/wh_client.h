@@ -44,7 +44,9 @@
 
 /* Component includes */
 #include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message_comm.h"
 #include "wolfhsm/wh_message_customcb.h"
+#include "wolfhsm/wh_message_batch.h"
 
 #ifndef WOLFHSM_NO_CRYPTO
 #include "wolfssl/wolfcrypt/settings.h"
@@ -52,16 +54,112 @@
 #include "wolfssl/wolfcrypt/wc_port.h"
 #include "wolfssl/wolfcrypt/cryptocb.h"
 #include "wolfssl/wolfcrypt/curve25519.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
 #include "wolfssl/wolfcrypt/rsa.h"
 #include "wolfssl/wolfcrypt/ecc.h"
+#include "wolfssl/wolfcrypt/hmac.h"
+#include "wolfssl/wolfcrypt/cmac.h"
+#endif
+
+/* Maximum number of requests that may be outstanding at once. Requests sent
+ * beyond this limit are refused with WH_ERROR_NOTREADY until the oldest
+ * response has been received. */
+#ifndef WH_CLIENT_MAX_PENDING
+#define WH_CLIENT_MAX_PENDING 8
+#endif
+
+/* Number of NVM object metadata kept by the client so repeated
+ * wh_Client_NvmGetMetadata calls are answered without a round trip. Every NVM
+ * response carries the server NVM generation, and the entries are dropped
+ * once it changes. 0 disables it */
+#ifndef WH_CLIENT_NVM_CACHE_COUNT
+#define WH_CLIENT_NVM_CACHE_COUNT 0
+#endif
+
+#ifndef WOLFHSM_NO_CRYPTO
+/* Bytes of server RNG output fetched at once and kept by the client to serve
+ * small wc_RNG_GenerateBlock calls without a round trip. 0 disables it */
+#ifndef WH_CLIENT_RNG_CACHE_SIZE
+#define WH_CLIENT_RNG_CACHE_SIZE 0
+#endif
+#ifdef WC_NO_RNG
+#undef WH_CLIENT_RNG_CACHE_SIZE
+#define WH_CLIENT_RNG_CACHE_SIZE 0
+#endif
+/* Number of HSM public keys kept by the client so RSA public operations and
+ * ECDSA verification run locally instead of on the server. 0 disables it */
+#ifndef WH_CLIENT_PUBKEY_CACHE_COUNT
+#define WH_CLIENT_PUBKEY_CACHE_COUNT 0
+#endif
+/* Largest public key kept: qx | qy for ECC or the public key DER for RSA */
+#ifndef WH_CLIENT_PUBKEY_CACHE_SIZE
+#define WH_CLIENT_PUBKEY_CACHE_SIZE 320
+#endif
+/* Define WH_CLIENT_ASYNC_CRYPTO to let the crypto callback return
+ * WC_PENDING_E instead of waiting for public key responses. See
+ * wh_Client_SetAsyncCrypto */
+#endif
+
+/* Outstanding request awaiting a response */
+typedef struct {
+    uint16_t seq;
+    uint16_t kind;
+    uint8_t  pad[4];
+} whClientPendingRequest;
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_CLIENT_PUBKEY_CACHE_COUNT > 0)
+/* Public part of an HSM key, len 0 if the server would not export it. Only
+ * used while the server key generation is unchanged */
+typedef struct {
+    uint16_t keyId;     /* WOLFHSM_KEYID_ERASED if unused */
+    uint16_t len;
+    uint32_t type;      /* WOLFHSM_KEYFLAG_ECC or WOLFHSM_KEYFLAG_RSA */
+    uint32_t generation; /* Server key generation read before the export */
+    uint8_t  key[WH_CLIENT_PUBKEY_CACHE_SIZE];
+} whClientPubKey;
+#endif
+
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+/* Metadata of an NVM object, or its absence, as last returned by the server */
+typedef struct {
+    int32_t       rc;       /* 0 or WH_ERROR_NOTFOUND */
+    whNvmId       id;       /* WH_NVM_INVALID_ID if unused */
+    uint8_t       padding[2];
+    whNvmMetadata meta;
+} whClientNvmMeta;
 #endif
 
 /* Client context */
 struct whClientContext_t {
     whCommClient comm[1];
+    whClientPendingRequest pending[WH_CLIENT_MAX_PENDING];
     uint16_t     last_req_id;
     uint16_t     last_req_kind;
-    uint8_t      pad[4];
+    uint16_t     pending_head;
+    uint16_t     pending_count;
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+    whClientNvmMeta nvm_meta[WH_CLIENT_NVM_CACHE_COUNT];
+    uint32_t     nvm_generation;    /* Of the last NVM response */
+    uint16_t     nvm_meta_next;     /* Entry replaced next */
+    uint8_t      nvm_padding[2];
+#endif
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_CLIENT_RNG_CACHE_SIZE > 0)
+    uint32_t     rng_count;     /* Unused bytes at the start of rng_cache */
+    uint8_t      rng_padding[4];
+    uint8_t      rng_cache[WH_CLIENT_RNG_CACHE_SIZE];
+#endif
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_CLIENT_PUBKEY_CACHE_COUNT > 0)
+    whClientPubKey pubkey[WH_CLIENT_PUBKEY_CACHE_COUNT];
+    uint32_t     pubkey_next;   /* Slot replaced next when all are in use */
+    uint8_t      pubkey_padding[4];
+#endif
+#if !defined(WOLFHSM_NO_CRYPTO) && defined(WH_CLIENT_ASYNC_CRYPTO)
+    const void*  async_key;     /* Key of the operation awaiting a response */
+    const void*  async_out;     /* Its output, to tell operations apart */
+    uint32_t     async_type;    /* Its wc_PkType, WC_PK_TYPE_NONE if none */
+    uint8_t      async_enabled;
+    uint8_t      async_padding[3];
+#endif
 };
 typedef struct whClientContext_t whClientContext;
 
@@ -70,6 +168,70 @@ struct whClientConfig_t {
 };
 typedef struct whClientConfig_t whClientConfig;
 
+/* Number of client contexts a multiplexed client hands out at once */
+#ifndef WH_CLIENT_MUX_SLOT_COUNT
+#define WH_CLIENT_MUX_SLOT_COUNT 4
+#endif
+
+/* Mutual exclusion, or a yield while waiting, for a multiplexed client */
+typedef void (*whClientLockCb)(void* context);
+
+typedef struct whClientMux_t whClientMux;
+
+/* Multiplexed client configuration */
+typedef struct {
+    whCommClientConfig* comm;       /* Transport shared by all slots */
+    whClientLockCb      lock_cb;    /* May be NULL with a single thread */
+    whClientLockCb      unlock_cb;
+    whClientLockCb      yield_cb;   /* Optional. Called while waiting */
+    void*               cb_context; /* Passed to the callbacks */
+    uint16_t            max_inflight; /* Requests the transport can hold at
+                                       * once, e.g. memring slot_count. 0 is
+                                       * taken as 1 */
+    uint8_t             padding[6];
+} whClientMuxConfig;
+
+/* Client context handed out by a multiplexed client, and the response routed
+ * to it while another slot was receiving */
+typedef struct {
+    whClientContext client[1];
+    uint64_t        rx[WH_COMM_MTU_U64_COUNT];
+    whClientMux*    mux;
+    uint16_t        rx_size;
+    uint16_t        wire_seq;   /* Sequence number on the shared transport */
+    uint16_t        seq;        /* Sequence number sent by the slot's comm */
+    uint8_t         inflight;   /* A request awaits its response */
+    uint8_t         ready;      /* rx holds the response */
+    uint8_t         busy;       /* Acquired */
+    uint8_t         padding[7];
+} whClientMuxSlot;
+
+struct whClientMux_t {
+    whClientMuxSlot            slot[WH_CLIENT_MUX_SLOT_COUNT];
+    const whTransportClientCb* transport_cb;
+    void*                      transport_context;
+    whClientLockCb             lock_cb;
+    whClientLockCb             unlock_cb;
+    whClientLockCb             yield_cb;
+    void*                      cb_context;
+    uint16_t                   seq;         /* Last sequence number sent */
+    uint16_t                   inflight;    /* Responses not yet received */
+    uint16_t                   max_inflight;
+    uint8_t                    padding[2];
+};
+
+#ifndef WOLFHSM_NO_BATCH
+/* Batch of sub-requests built by the client and, once the response has been
+ * received, the matching sub-responses */
+typedef struct {
+    uint64_t buffer[WH_MESSAGE_BATCH_U64_COUNT];
+    uint16_t size;      /* Bytes of buffer in use */
+    uint16_t count;     /* Number of entries in buffer */
+    uint16_t offset;    /* Position of the next result entry */
+    uint16_t index;     /* Index of the next result entry */
+} whClientBatch;
+#endif
+
 
 /** Context initialization and shutdown functions */
 
@@ -95,6 +257,19 @@ int wh_Client_Init(whClientContext* c, const whClientConfig* config);
  */
 int wh_Client_Cleanup(whClientContext* c);
 
+/**
+ * @brief Sets the priority class of the requests sent from now on
+ *
+ * The class is carried in the header of each request. The server handles
+ * waiting requests of class WH_COMM_CLASS_REALTIME first and those of class
+ * WH_COMM_CLASS_BULK last, whatever the priority of their comm channels.
+ *
+ * @param c A pointer to the client context.
+ * @param cls One of WH_COMM_CLASS_*. WH_COMM_CLASS_INTERACTIVE by default.
+ * @return Returns 0 on success, or WH_ERROR_BADARGS for an unknown class.
+ */
+int wh_Client_SetRequestClass(whClientContext* c, uint16_t cls);
+
 
 /** Generic request/response functions */
 /* TODO: Move these to internal API */
@@ -129,6 +304,102 @@ int wh_Client_RecvResponse(whClientContext* c, uint16_t* out_group,
                            uint16_t* out_action, uint16_t* out_size,
                            void* data);
 
+/** Pipelined request functions
+ *
+ * Every XxxRequest function may be called several times before the matching
+ * XxxResponse functions, up to WH_CLIENT_MAX_PENDING outstanding requests and
+ * as many as the transport can buffer.  The client records the sequence
+ * number and kind of each request sent and validates each response against
+ * the oldest outstanding request, so responses must be received in the same
+ * order the requests were sent.  All outstanding requests must be drained
+ * before calling any blocking function, including wolfCrypt functions that
+ * use the WolfHSM crypto callback.
+ */
+
+/**
+ * Gets the number of requests that have been sent but whose responses have
+ * not yet been received.
+ *
+ * @param c The client context.
+ * @param out_count Pointer to store the number of outstanding requests.
+ * @return 0 if successful, a negative value if an error occurred.
+ */
+int wh_Client_GetPendingCount(whClientContext* c, uint16_t* out_count);
+
+/**
+ * Gets the group, action and sequence number of the oldest outstanding
+ * request, which is the request the next received response will complete.
+ * Allows the caller to select the matching XxxResponse function.
+ *
+ * @param c The client context.
+ * @param out_group Pointer to store the request group. May be NULL.
+ * @param out_action Pointer to store the request action. May be NULL.
+ * @param out_seq Pointer to store the request sequence number. May be NULL.
+ * @return 0 if successful, WH_ERROR_NOTREADY if no request is outstanding, or
+ * a negative value if an error occurred.
+ */
+int wh_Client_PeekPending(whClientContext* c, uint16_t* out_group,
+                          uint16_t* out_action, uint16_t* out_seq);
+
+
+/** Multiplexed client functions
+ *
+ * A multiplexed client lets several threads issue requests concurrently over
+ * one transport.  It owns WH_CLIENT_MUX_SLOT_COUNT client contexts that are
+ * acquired for the duration of an operation and used with any of the client
+ * functions.  Each slot builds its requests in its own packet buffer and the
+ * shared transport is only locked to send a request or to receive a
+ * response.  Requests are given unique sequence numbers on the transport and
+ * each response is routed back to the slot that sent it, so responses may be
+ * received by the slots in any order.
+ *
+ * Each slot may have one request outstanding.  A request is only sent while
+ * fewer than max_inflight responses are outstanding on the shared transport,
+ * otherwise the sender receives responses on behalf of the other slots until
+ * one is, releasing the lock in between.  wolfCrypt functions using
+ * WOLFHSM_DEV_ID acquire a free slot for each call.  Slots start with the
+ * local WH_COMM_DATA_LEN, wh_Client_CommInit negotiates it for one slot.
+ */
+
+/**
+ * Initializes the shared transport and the client context of each slot, and
+ * registers the WOLFHSM_DEV_ID crypto callback to use the multiplexed client.
+ *
+ * @param mux The multiplexed client.
+ * @param config The shared transport and the optional lock callbacks.
+ * @return 0 if successful, a negative value if an error occurred.
+ */
+int wh_ClientMux_Init(whClientMux* mux, const whClientMuxConfig* config);
+
+/**
+ * Cleans up the client context of each slot and the shared transport.  No
+ * slot may be in use.
+ *
+ * @param mux The multiplexed client.
+ * @return 0 if successful, a negative value if an error occurred.
+ */
+int wh_ClientMux_Cleanup(whClientMux* mux);
+
+/**
+ * Acquires a free slot for the calling thread.
+ *
+ * @param mux The multiplexed client.
+ * @param out_client Pointer to store the client context of the slot.
+ * @return 0 if successful, WH_ERROR_NOTREADY if every slot is in use, or a
+ * negative value if an error occurred.
+ */
+int wh_ClientMux_Acquire(whClientMux* mux, whClientContext** out_client);
+
+/**
+ * Releases a slot acquired with wh_ClientMux_Acquire.  The response to a
+ * request still outstanding on the slot is discarded when it arrives.
+ *
+ * @param mux The multiplexed client.
+ * @param client The client context of the slot.
+ * @return 0 if successful, a negative value if an error occurred.
+ */
+int wh_ClientMux_Release(whClientMux* mux, whClientContext* client);
+
 
 /** Comm component functions */
 
@@ -165,7 +436,10 @@ int wh_Client_CommInitResponse(whClientContext* c, uint32_t* out_clientid,
  *
  * This function handles the complete process of initializing communication
  * with the server. It sends an initialization request and waits for a valid
- * response, extracting the client and server IDs from the response.
+ * response, extracting the client and server IDs from the response.  The
+ * maximum data size of each request is also negotiated to the smaller of the
+ * client and server WH_COMM_DATA_LEN and can be queried afterwards using
+ * wh_Client_GetMaxDataLen.
  *
  * @param[in] c Pointer to the client context.
  * @param[out] out_clientid Pointer to store the client ID from the response.
@@ -175,6 +449,19 @@ int wh_Client_CommInitResponse(whClientContext* c, uint32_t* out_clientid,
 int wh_Client_CommInit(whClientContext* c, uint32_t* out_clientid,
                        uint32_t* out_serverid);
 
+/**
+ * @brief Gets the maximum data size that may be sent in a single request.
+ *
+ * Before wh_Client_CommInit completes this is the local WH_COMM_DATA_LEN.
+ * Afterwards it is the size negotiated with the server, which callers should
+ * use to size chunks of bulk operations.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_len Pointer to store the maximum data size in bytes.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_GetMaxDataLen(whClientContext* c, uint16_t* out_len);
+
 /**
  * @brief Sends a communication close request to the server.
  *
@@ -259,6 +546,152 @@ int wh_Client_EchoResponse(whClientContext* c, uint16_t* out_size, void* data);
 int wh_Client_Echo(whClientContext* c, uint16_t snd_len, const void* snd_data,
                    uint16_t* out_rcv_len, void* rcv_data);
 
+/**
+ * @brief Sends a request for one entry of the server request statistics.
+ *
+ * A server built with WOLFHSM_SERVER_STATS counts the requests, errors,
+ * request and response bytes and handling times of every message kind
+ * (group and action). This function does not block; it returns immediately
+ * after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] index Index of the entry to read, starting at 0.
+ * @param[in] flags WH_MESSAGE_COMM_STATS_RESET to clear all entries after
+ * this one is read, or 0.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_GetStatsRequest(whClientContext* c, uint16_t index,
+                              uint16_t flags);
+
+/**
+ * @brief Receives one entry of the server request statistics.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response
+ * has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_count Optional pointer to store the number of entries in
+ * use, set even when index is past the last entry.
+ * @param[out] out_entry Optional pointer to store the entry.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, WH_ERROR_NOTFOUND if index is past the last entry or the server
+ * does not keep statistics, or a negative error code on failure.
+ */
+int wh_Client_GetStatsResponse(whClientContext* c, uint16_t* out_count,
+                               whMessageCommStatsEntry* out_entry);
+
+/**
+ * @brief Reads one entry of the server request statistics.
+ *
+ * This function blocks until the response is received. Read entries from
+ * index 0 until WH_ERROR_NOTFOUND to collect the whole table.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] index Index of the entry to read, starting at 0.
+ * @param[in] flags WH_MESSAGE_COMM_STATS_RESET or 0.
+ * @param[out] out_count Optional pointer to store the number of entries.
+ * @param[out] out_entry Optional pointer to store the entry.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_GetStats(whClientContext* c, uint16_t index, uint16_t flags,
+                       uint16_t* out_count, whMessageCommStatsEntry* out_entry);
+
+#ifndef WOLFHSM_NO_BATCH
+/** Batch functions
+ *
+ * A batch carries several small requests to the server in a single packet and
+ * returns all of their responses in a single packet.  Sub-requests are added
+ * with the same group, action and message data that would be passed to
+ * wh_Client_SendRequest and are processed by the server in order.  After the
+ * batch response is received, each sub-response is retrieved in order with
+ * wh_Client_BatchGetResult and decoded with the message structure of its
+ * group.  If a sub-response does not fit in the response packet, that
+ * sub-request is still processed but reports WH_ERROR_NOSPACE with no data,
+ * and the server stops there.  Sub-requests without a result were not
+ * processed and may be sent again in another batch.
+ */
+
+/**
+ * @brief Resets a batch so new sub-requests can be added.
+ *
+ * @param[in] batch Pointer to the batch.
+ * @return int Returns 0 on success, or WH_ERROR_BADARGS if batch is NULL.
+ */
+int wh_Client_BatchInit(whClientBatch* batch);
+
+/**
+ * @brief Appends a sub-request to a batch.
+ *
+ * @param[in] c Pointer to the client context, used for the negotiated size.
+ * @param[in] batch Pointer to the batch.
+ * @param[in] group The group identifier of the sub-request.
+ * @param[in] action The action identifier of the sub-request.
+ * @param[in] data_size The size of the sub-request message data.
+ * @param[in] data Pointer to the sub-request message data. May be NULL when
+ * data_size is zero.
+ * @return int Returns 0 on success, WH_ERROR_NOSPACE if the sub-request does
+ * not fit in the batch, or a negative error code on failure.
+ */
+int wh_Client_BatchAdd(whClientContext* c, whClientBatch* batch,
+                       uint16_t group, uint16_t action, uint16_t data_size,
+                       const void* data);
+
+/**
+ * @brief Sends a batch of sub-requests to the server.
+ *
+ * This function does not block; it returns immediately after sending the
+ * request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] batch Pointer to the batch.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_BatchRequest(whClientContext* c, whClientBatch* batch);
+
+/**
+ * @brief Receives the response to a batch into the batch.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response has
+ * not been received.  On success the sub-responses replace the sub-requests in
+ * the batch and can be read with wh_Client_BatchGetResult.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] batch Pointer to the batch.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_BatchResponse(whClientContext* c, whClientBatch* batch);
+
+/**
+ * @brief Sends a batch to the server and receives its response with a
+ * blocking call.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] batch Pointer to the batch.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_Batch(whClientContext* c, whClientBatch* batch);
+
+/**
+ * @brief Gets the next sub-response from a received batch.
+ *
+ * @param[in] batch Pointer to the batch.
+ * @param[out] out_group Pointer to store the sub-response group. May be NULL.
+ * @param[out] out_action Pointer to store the sub-response action. May be
+ * NULL.
+ * @param[out] out_rc Pointer to store the server handler result. May be NULL.
+ * @param[out] out_size Pointer to store the sub-response data size. May be
+ * NULL.
+ * @param[out] out_data Pointer to store the address of the sub-response data
+ * within the batch. May be NULL.
+ * @return int Returns 0 on success, WH_ERROR_NOTFOUND if all sub-responses
+ * have been read, or a negative error code on failure.
+ */
+int wh_Client_BatchGetResult(whClientBatch* batch, uint16_t* out_group,
+                             uint16_t* out_action, int32_t* out_rc,
+                             uint16_t* out_size, const void** out_data);
+#endif /* WOLFHSM_NO_BATCH */
+
 /** Key functions
  *
  * For client-side key data to be used, it must first be brought into the key
@@ -444,140 +877,878 @@ int wh_Client_KeyExport(whClientContext* c, uint16_t keyId, uint8_t* label,
                         uint32_t labelSz, uint8_t* out, uint32_t* outSz);
 
 /**
- * @brief Sends a key commit request to the server.
+ * @brief Sends a request to the server to cache a key read from client memory
+ * using DMA.
  *
- * This function prepares and sends a key commit request message to the server.
- * The message contains the specified key ID. This function does not block;
- * it returns immediately after sending the request.
+ * This function prepares and sends a request to the server to cache the key at
+ * the given client address. The server copies the key directly into a cache
+ * slot, so the key is not limited by the comm buffer size. Keys larger than
+ * WOLFHSM_KEYCACHE_BUFSIZE need one of the WOLFHSM_KEYCACHE_BIG_COUNT slots.
+ * This function does not block; it returns immediately after sending the
+ * request.
  *
  * @param[in] c Pointer to the client context.
- * @param[in] keyId Key ID to be committed. Committing a key means making it
- * persistent in non-volatile memory.
+ * @param[in] flags Flags for the key cache request.
+ * @param[in] label Pointer to the label associated with the key.
+ * @param[in] labelSz Size of the label.
+ * @param[in] in Pointer to the key data to be cached.
+ * @param[in] inSz Size of the key data.
+ * @param[in] keyId Key ID to use, or WOLFHSM_KEYID_ERASED to have the server
+ * assign one.
  * @return int Returns 0 on success, or a negative error code on failure.
  */
-int wh_Client_KeyCommitRequest(whClientContext* c, whNvmId keyId);
+int wh_Client_KeyCacheDmaRequest_ex(whClientContext* c, uint32_t flags,
+                                    uint8_t* label, uint32_t labelSz,
+                                    const uint8_t* in, uint32_t inSz,
+                                    uint16_t keyId);
 
 /**
- * @brief Receives a key commit response from the server.
+ * @brief Sends a request to the server to cache a key read from client memory
+ * using DMA, letting the server assign the key ID.
  *
- * This function attempts to process a key commit response message from the
- * server. It validates the response. This function does not block; it returns
- * WH_ERROR_NOTREADY if a response has not been received.
+ * @param[in] c Pointer to the client context.
+ * @param[in] flags Flags for the key cache request.
+ * @param[in] label Pointer to the label associated with the key.
+ * @param[in] labelSz Size of the label.
+ * @param[in] in Pointer to the key data to be cached.
+ * @param[in] inSz Size of the key data.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyCacheDmaRequest(whClientContext* c, uint32_t flags,
+                                 uint8_t* label, uint32_t labelSz,
+                                 const uint8_t* in, uint32_t inSz);
+
+/**
+ * @brief Receives a DMA key cache response from the server.
+ *
+ * This function attempts to process a DMA key cache response message from the
+ * server. It validates the response and extracts the key ID. This function
+ * does not block; it returns WH_ERROR_NOTREADY if a response has not been
+ * received.
  *
  * @param[in] c Pointer to the client context.
+ * @param[out] keyId Pointer to store the key ID assigned by the server.
  * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
  * available, or a negative error code on failure.
  */
-int wh_Client_KeyCommitResponse(whClientContext* c);
+int wh_Client_KeyCacheDmaResponse(whClientContext* c, uint16_t* keyId);
 
 /**
- * @brief Sends a key commit request to the server and receives the response.
+ * @brief Sends a DMA key cache request to the server and receives the
+ * response.
  *
- * This function handles the complete process of sending a key commit request to
- * the server and receiving the response. It sends the request and repeatedly
- * attempts to receive a valid response. This function blocks until the entire
- * operation is complete or an error occurs.
+ * This function handles the complete process of caching a key read from client
+ * memory using DMA. This function blocks until the entire operation is complete
+ * or an error occurs.
  *
  * @param[in] c Pointer to the client context.
- * @param[in] keyId Key ID to be committed. Committing a key means making it
- * persistent in non-volatile memory.
+ * @param[in] flags Flags for the key cache request.
+ * @param[in] label Pointer to the label associated with the key.
+ * @param[in] labelSz Size of the label.
+ * @param[in] in Pointer to the key data to be cached.
+ * @param[in] inSz Size of the key data.
+ * @param[in,out] keyId Key ID to use, or WOLFHSM_KEYID_ERASED to have the
+ * server assign one. Receives the key ID used.
  * @return int Returns 0 on success, or a negative error code on failure.
  */
-int wh_Client_KeyCommit(whClientContext* c, whNvmId keyId);
+int wh_Client_KeyCacheDma(whClientContext* c, uint32_t flags, uint8_t* label,
+                          uint32_t labelSz, const uint8_t* in, uint32_t inSz,
+                          uint16_t* keyId);
 
 /**
- * @brief Sends a key erase request to the server.
+ * @brief Sends a request to the server to export a key to client memory using
+ * DMA.
  *
- * This function prepares and sends a key erase request message to the server.
- * The message contains the specified key ID. This function does not block;
- * it returns immediately after sending the request.
+ * This function prepares and sends a request to the server to write the key
+ * with the given ID directly to the client buffer. This function does not
+ * block; it returns immediately after sending the request.
  *
  * @param[in] c Pointer to the client context.
- * @param[in] keyId Key ID to be erased.
+ * @param[in] keyId Key ID to be exported.
+ * @param[out] out Pointer to the buffer to receive the key data.
+ * @param[in] outSz Size of the buffer. The server fails with
+ * WH_ERROR_NOSPACE if the key does not fit.
  * @return int Returns 0 on success, or a negative error code on failure.
  */
-int wh_Client_KeyEraseRequest(whClientContext* c, whNvmId keyId);
+int wh_Client_KeyExportDmaRequest(whClientContext* c, uint16_t keyId,
+                                  uint8_t* out, uint32_t outSz);
 
 /**
- * @brief Receives a key erase response from the server.
+ * @brief Receives a DMA key export response from the server.
  *
- * This function attempts to process a key erase response message from the
- * server. It validates the response. This function does not block; it returns
+ * This function attempts to process a DMA key export response message from the
+ * server. It validates the response and extracts the label and the size of the
+ * key written to client memory. This function does not block; it returns
  * WH_ERROR_NOTREADY if a response has not been received.
  *
  * @param[in] c Pointer to the client context.
+ * @param[out] label Pointer to store the label associated with the key.
+ * @param[in] labelSz Size of the label buffer.
+ * @param[out] outSz Pointer to store the size of the exported key data.
  * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
  * available, or a negative error code on failure.
  */
-int wh_Client_KeyEraseResponse(whClientContext* c);
+int wh_Client_KeyExportDmaResponse(whClientContext* c, uint8_t* label,
+                                   uint32_t labelSz, uint32_t* outSz);
 
 /**
- * @brief Sends a key erase request to the server and receives the response.
+ * @brief Sends a DMA key export request to the server and receives the
+ * response.
  *
- * This function handles the complete process of sending a key erase request to
- * the server and receiving the response. It sends the request and repeatedly
- * attempts to receive a valid response. This function blocks until the entire
- * operation is complete or an error occurs.
+ * This function handles the complete process of exporting a key to client
+ * memory using DMA. This function blocks until the entire operation is
+ * complete or an error occurs.
  *
  * @param[in] c Pointer to the client context.
- * @param[in] keyId Key ID to be erased.
+ * @param[in] keyId Key ID to be exported.
+ * @param[out] label Pointer to store the label associated with the key.
+ * @param[in] labelSz Size of the label buffer.
+ * @param[out] out Pointer to the buffer to receive the key data.
+ * @param[in,out] outSz Size of the buffer. Receives the size of the key.
  * @return int Returns 0 on success, or a negative error code on failure.
  */
-int wh_Client_KeyErase(whClientContext* c, whNvmId keyId);
+int wh_Client_KeyExportDma(whClientContext* c, uint16_t keyId, uint8_t* label,
+                           uint32_t labelSz, uint8_t* out, uint32_t* outSz);
+
 /**
- * @brief Associates a Curve25519 key with a specific key ID.
+ * @brief Sends a request to the server to export the public part of a key.
  *
- * This function sets the device context of a Curve25519 key to the specified
- * key ID. On the server side, this key ID is used to reference the key stored
- * in the HSM
+ * This function prepares and sends a request for the public part of the
+ * specified key. The private part never leaves the server. This function does
+ * not block; it returns immediately after sending the request.
  *
- * @param[in] key Pointer to the Curve25519 key structure.
- * @param[in] keyId Key ID to be associated with the Curve25519 key.
+ * @param[in] c Pointer to the client context.
+ * @param[in] keyId Key ID to be exported.
+ * @param[in] type WOLFHSM_KEYFLAG_ECC or WOLFHSM_KEYFLAG_RSA.
+ * @return int Returns 0 on success, or a negative error code on failure.
  */
-void wh_Client_SetKeyCurve25519(curve25519_key* key, whNvmId keyId);
+int wh_Client_KeyExportPublicRequest(whClientContext* c, uint16_t keyId,
+                                     uint32_t type);
 
 /**
- * @brief Associates an RSA key with a specific key ID.
+ * @brief Receives a public key export response from the server.
  *
- * This function sets the device context of an RSA key to the specified key ID.
- * On the server side, this key ID is used to reference the key stored in the
- * HSM.
+ * The key is qx | qy for ECC keys and the public key DER for RSA keys. This
+ * function does not block; it returns WH_ERROR_NOTREADY if a response has not
+ * been received.
  *
- * @param[in] key Pointer to the RSA key structure.
- * @param[in] keyId Key ID to be associated with the RSA key.
+ * @param[in] c Pointer to the client context.
+ * @param[out] label Pointer to store the label associated with the key.
+ * @param[in] labelSz Size of the label buffer.
+ * @param[out] out Pointer to store the public key.
+ * @param[in,out] outSz Size of the buffer. Receives the size of the key.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
  */
-void wh_Client_SetKeyRsa(RsaKey* key, whNvmId keyId);
+int wh_Client_KeyExportPublicResponse(whClientContext* c, uint8_t* label,
+                                      uint32_t labelSz, uint8_t* out,
+                                      uint32_t* outSz);
 
 /**
- * @brief Associates an AES key with a specific key ID.
+ * @brief Exports the public part of a key from the server.
  *
- * This function sets the device context of an AES key to the specified key ID.
- * On the server side, this key ID is used to reference the key stored in the
- * HSM
+ * This function sends a public key export request and blocks until the
+ * response is received.
  *
- * @param[in] aes Pointer to the AES key structure.
- * @param[in] keyId Key ID to be associated with the AES key.
+ * @param[in] c Pointer to the client context.
+ * @param[in] keyId Key ID to be exported.
+ * @param[in] type WOLFHSM_KEYFLAG_ECC or WOLFHSM_KEYFLAG_RSA.
+ * @param[out] label Pointer to store the label associated with the key.
+ * @param[in] labelSz Size of the label buffer.
+ * @param[out] out Pointer to store the public key.
+ * @param[in,out] outSz Size of the buffer. Receives the size of the key.
+ * @return int Returns 0 on success, or a negative error code on failure.
  */
-void wh_Client_SetKeyAes(Aes* aes, whNvmId keyId);
-#endif
+int wh_Client_KeyExportPublic(whClientContext* c, uint16_t keyId,
+                              uint32_t type, uint8_t* label, uint32_t labelSz,
+                              uint8_t* out, uint32_t* outSz);
 
-/** NVM functions */
 /**
- * @brief Sends a non-volatile memory (NVM) initialization request to the
- * server.
+ * @brief Sends a request to the server for its key generation.
  *
- * This function prepares and sends an NVM initialization request message to the
- * server. The message contains the client NVM ID. This function does not block;
- * it returns immediately after sending the request.
+ * The generation changes whenever any key on the server may have changed,
+ * whether through this client, another client or NVM. This function does not
+ * block; it returns immediately after sending the request.
  *
  * @param[in] c Pointer to the client context.
  * @return int Returns 0 on success, or a negative error code on failure.
  */
-int wh_Client_NvmInitRequest(whClientContext* c);
+int wh_Client_KeyGenerationRequest(whClientContext* c);
 
 /**
- * @brief Receives a non-volatile memory (NVM) initialization response from the
- * server.
+ * @brief Receives a key generation response from the server.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response
+ * has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] outGeneration Pointer to store the key generation.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_KeyGenerationResponse(whClientContext* c,
+                                    uint32_t* outGeneration);
+
+/**
+ * @brief Reads the key generation of the server.
+ *
+ * This function sends a key generation request and blocks until the response
+ * is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] outGeneration Pointer to store the key generation.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyGeneration(whClientContext* c, uint32_t* outGeneration);
+
+#if WH_CLIENT_PUBKEY_CACHE_COUNT > 0
+/**
+ * @brief Drops a key from the client public key cache.
+ *
+ * Called by the key cache, evict and erase requests so the client never uses
+ * a stale public key. Call it after changing a key by other means.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] keyId Key ID to drop, WOLFHSM_KEYID_ERASED to drop all keys.
+ */
+void wh_Client_PubKeyCacheEvict(whClientContext* c, uint16_t keyId);
+#endif
+
+/**
+ * @brief Sends a key commit request to the server.
+ *
+ * This function prepares and sends a key commit request message to the server.
+ * The message contains the specified key ID. This function does not block;
+ * it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] keyId Key ID to be committed. Committing a key means making it
+ * persistent in non-volatile memory.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyCommitRequest(whClientContext* c, whNvmId keyId);
+
+/**
+ * @brief Receives a key commit response from the server.
+ *
+ * This function attempts to process a key commit response message from the
+ * server. It validates the response. This function does not block; it returns
+ * WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_KeyCommitResponse(whClientContext* c);
+
+/**
+ * @brief Sends a key commit request to the server and receives the response.
+ *
+ * This function handles the complete process of sending a key commit request to
+ * the server and receiving the response. It sends the request and repeatedly
+ * attempts to receive a valid response. This function blocks until the entire
+ * operation is complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] keyId Key ID to be committed. Committing a key means making it
+ * persistent in non-volatile memory.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyCommit(whClientContext* c, whNvmId keyId);
+
+/**
+ * @brief Sends a key erase request to the server.
+ *
+ * This function prepares and sends a key erase request message to the server.
+ * The message contains the specified key ID. This function does not block;
+ * it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] keyId Key ID to be erased.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyEraseRequest(whClientContext* c, whNvmId keyId);
+
+/**
+ * @brief Receives a key erase response from the server.
+ *
+ * This function attempts to process a key erase response message from the
+ * server. It validates the response. This function does not block; it returns
+ * WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_KeyEraseResponse(whClientContext* c);
+
+/**
+ * @brief Sends a key erase request to the server and receives the response.
+ *
+ * This function handles the complete process of sending a key erase request to
+ * the server and receiving the response. It sends the request and repeatedly
+ * attempts to receive a valid response. This function blocks until the entire
+ * operation is complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] keyId Key ID to be erased.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyErase(whClientContext* c, whNvmId keyId);
+
+#if !defined(NO_RSA) && defined(WOLFSSL_KEY_GEN)
+/**
+ * @brief Sends a request to start generating an RSA key on the server.
+ *
+ * The server queues the key generation as a job and answers immediately with
+ * a job handle. The job then runs on a crypto worker, or on the server while
+ * no other request is waiting, so other requests are not held up behind it.
+ * This function does not block; it returns immediately after sending the
+ * request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] size Size of the key in bits.
+ * @param[in] e Public exponent.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_RsaKeyGenStartRequest(whClientContext* c, uint32_t size,
+                                    uint32_t e);
+
+/**
+ * @brief Receives the response to an RSA key generation start request.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response
+ * has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] jobId Pointer to store the handle of the queued job.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, WH_ERROR_NOSPACE if the server has no free job slot, or a
+ * negative error code on failure.
+ */
+int wh_Client_RsaKeyGenStartResponse(whClientContext* c, uint16_t* jobId);
+
+/**
+ * @brief Starts generating an RSA key on the server and returns its job
+ * handle.
+ *
+ * This function blocks until the server has queued the job, not until the
+ * key is generated. Use wh_Client_KeyJobStatus or wh_Client_KeyJobWait to
+ * collect the key.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] size Size of the key in bits.
+ * @param[in] e Public exponent.
+ * @param[out] jobId Pointer to store the handle of the queued job.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_RsaKeyGenStart(whClientContext* c, uint32_t size, uint32_t e,
+                             uint16_t* jobId);
+
+/**
+ * @brief Sends a request for the state of a key generation job.
+ *
+ * This function does not block; it returns immediately after sending the
+ * request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] jobId Handle of the job.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyJobStatusRequest(whClientContext* c, uint16_t jobId);
+
+/**
+ * @brief Receives the state of a key generation job.
+ *
+ * Once a job is reported done the server releases it, and the generated key
+ * stays in the server key cache under keyId. A failed job returns its error
+ * instead.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] done Pointer to store whether the job has finished.
+ * @param[out] keyId Pointer to store the key ID of the generated key.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, WH_ERROR_NOTFOUND if the job does not exist, or a negative error
+ * code on failure.
+ */
+int wh_Client_KeyJobStatusResponse(whClientContext* c, int* done,
+                                   uint16_t* keyId);
+
+/**
+ * @brief Polls the state of a key generation job once.
+ *
+ * This function blocks until the status response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] jobId Handle of the job.
+ * @param[out] done Pointer to store whether the job has finished.
+ * @param[out] keyId Pointer to store the key ID of the generated key.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyJobStatus(whClientContext* c, uint16_t jobId, int* done,
+                           uint16_t* keyId);
+
+/**
+ * @brief Polls a key generation job until it has finished.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] jobId Handle of the job.
+ * @param[out] keyId Pointer to store the key ID of the generated key.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_KeyJobWait(whClientContext* c, uint16_t jobId, uint16_t* keyId);
+#endif /* !NO_RSA && WOLFSSL_KEY_GEN */
+/**
+ * @brief Associates a Curve25519 key with a specific key ID.
+ *
+ * This function sets the device context of a Curve25519 key to the specified
+ * key ID. On the server side, this key ID is used to reference the key stored
+ * in the HSM
+ *
+ * @param[in] key Pointer to the Curve25519 key structure.
+ * @param[in] keyId Key ID to be associated with the Curve25519 key.
+ */
+void wh_Client_SetKeyCurve25519(curve25519_key* key, whNvmId keyId);
+
+#ifdef HAVE_ED25519
+/**
+ * @brief Associates an Ed25519 key with a specific key ID.
+ *
+ * This function sets the device context of an Ed25519 key to the specified
+ * key ID. On the server side, this key ID is used to reference the key stored
+ * in the HSM, either a generated key pair or a cached 32 byte public key.
+ *
+ * @param[in] key Pointer to the Ed25519 key structure.
+ * @param[in] keyId Key ID to be associated with the Ed25519 key.
+ */
+void wh_Client_SetKeyEd25519(ed25519_key* key, whNvmId keyId);
+#endif
+
+/**
+ * @brief Associates an RSA key with a specific key ID.
+ *
+ * This function sets the device context of an RSA key to the specified key ID.
+ * On the server side, this key ID is used to reference the key stored in the
+ * HSM.
+ *
+ * @param[in] key Pointer to the RSA key structure.
+ * @param[in] keyId Key ID to be associated with the RSA key.
+ */
+void wh_Client_SetKeyRsa(RsaKey* key, whNvmId keyId);
+
+/**
+ * @brief Associates an AES key with a specific key ID.
+ *
+ * This function sets the device context of an AES key to the specified key ID.
+ * On the server side, this key ID is used to reference the key stored in the
+ * HSM
+ *
+ * @param[in] aes Pointer to the AES key structure.
+ * @param[in] keyId Key ID to be associated with the AES key.
+ */
+void wh_Client_SetKeyAes(Aes* aes, whNvmId keyId);
+
+#ifndef NO_HMAC
+/**
+ * @brief Associates an HMAC with a specific key ID.
+ *
+ * With the wolfHSM device ID, wc_HmacUpdate and wc_HmacFinal run on the
+ * server, keyed by the cached key with this ID. Call this after wc_HmacInit
+ * and before wc_HmacSetKey, which is then given no key. The server keeps the
+ * HMAC state until wc_HmacFinal, so an HMAC that is not finished holds one of
+ * the server streams until the client disconnects.
+ *
+ * @param[in] hmac Pointer to the HMAC structure.
+ * @param[in] keyId Key ID to be associated with the HMAC.
+ */
+void wh_Client_SetKeyHmac(Hmac* hmac, whNvmId keyId);
+#endif
+
+#ifdef WOLFSSL_CMAC
+/**
+ * @brief Associates an AES CMAC with a specific key ID.
+ *
+ * With the wolfHSM device ID, the CMAC runs on the server, keyed by the cached
+ * key with this ID, with its subkeys reused from earlier uses of the key. Call
+ * this after wc_InitCmac_ex is given no key, then use wc_CmacUpdate and
+ * wc_CmacFinal, or wc_AesCmacGenerate_ex and wc_AesCmacVerify_ex with no key.
+ * The server keeps the CMAC state until the final, so a CMAC that is not
+ * finished holds one of the server streams until the client disconnects.
+ *
+ * @param[in] cmac Pointer to the CMAC structure.
+ * @param[in] keyId Key ID to be associated with the CMAC.
+ */
+void wh_Client_SetKeyCmac(Cmac* cmac, whNvmId keyId);
+#endif
+
+#if !defined(NO_AES) && (defined(HAVE_AES_CBC) || defined(HAVE_AESGCM))
+/**
+ * @brief Sends a request to open an AES stream on the server.
+ *
+ * A stream keeps the cipher state on the server between requests, so input
+ * larger than one packet can be processed in a series of updates. The key is
+ * taken from aes the same way as by the crypto callback: the key ID set with
+ * wh_Client_SetKeyAes when WOLFHSM_SYMMETRIC_INTERNAL is defined, or else the
+ * key set with wc_AesSetKey. AES GCM streams need WOLFSSL_AESGCM_STREAM on the
+ * server. This function does not block; it returns immediately after sending
+ * the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] aes Pointer to the AES key structure holding the key.
+ * @param[in] type WC_CIPHER_AES_CBC or WC_CIPHER_AES_GCM.
+ * @param[in] enc 1 to encrypt, 0 to decrypt.
+ * @param[in] iv Pointer to the IV, AES_IV_SIZE bytes for CBC.
+ * @param[in] ivSz Size of the IV.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_AesStreamInitRequest(whClientContext* c, Aes* aes, int type,
+                                   int enc, const uint8_t* iv, uint32_t ivSz);
+
+/**
+ * @brief Receives the response to an AES stream open request.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response
+ * has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] handle Pointer to store the handle of the stream.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, WH_ERROR_NOSPACE if the server has no free stream, or a negative
+ * error code on failure.
+ */
+int wh_Client_AesStreamInitResponse(whClientContext* c, uint32_t* handle);
+
+/**
+ * @brief Opens an AES stream on the server.
+ *
+ * This function blocks until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] aes Pointer to the AES key structure holding the key.
+ * @param[in] type WC_CIPHER_AES_CBC or WC_CIPHER_AES_GCM.
+ * @param[in] enc 1 to encrypt, 0 to decrypt.
+ * @param[in] iv Pointer to the IV, AES_IV_SIZE bytes for CBC.
+ * @param[in] ivSz Size of the IV.
+ * @param[out] handle Pointer to store the handle of the stream.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_AesStreamInit(whClientContext* c, Aes* aes, int type, int enc,
+                            const uint8_t* iv, uint32_t ivSz,
+                            uint32_t* handle);
+
+/**
+ * @brief Sends the next chunk of an AES stream.
+ *
+ * The input and additional authentication data must fit one request together,
+ * see wh_Client_GetMaxDataLen. CBC input must be a multiple of AES_BLOCK_SIZE
+ * and takes no authIn. For GCM all of authIn must be sent before the first
+ * input. A failed update closes the stream. This function does not block; it
+ * returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] handle Handle of the stream.
+ * @param[in] in Pointer to the input.
+ * @param[in] sz Size of the input.
+ * @param[in] authIn Pointer to GCM additional authentication data, or NULL.
+ * @param[in] authInSz Size of authIn.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_AesStreamUpdateRequest(whClientContext* c, uint32_t handle,
+                                     const uint8_t* in, uint32_t sz,
+                                     const uint8_t* authIn,
+                                     uint32_t authInSz);
+
+/**
+ * @brief Receives the output of an AES stream update.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response
+ * has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out Pointer to store the output.
+ * @param[in,out] outSz Size of out on input, size of the output on return.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, WH_ERROR_NOTFOUND if the stream does not exist, or a negative
+ * error code on failure.
+ */
+int wh_Client_AesStreamUpdateResponse(whClientContext* c, uint8_t* out,
+                                      uint32_t* outSz);
+
+/**
+ * @brief Processes the next chunk of an AES stream.
+ *
+ * This function blocks until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] handle Handle of the stream.
+ * @param[in] in Pointer to the input.
+ * @param[in] sz Size of the input.
+ * @param[in] authIn Pointer to GCM additional authentication data, or NULL.
+ * @param[in] authInSz Size of authIn.
+ * @param[out] out Pointer to store the sz bytes of output.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_AesStreamUpdate(whClientContext* c, uint32_t handle,
+                              const uint8_t* in, uint32_t sz,
+                              const uint8_t* authIn, uint32_t authInSz,
+                              uint8_t* out);
+
+/**
+ * @brief Sends a request to finish and close an AES stream.
+ *
+ * For a GCM decrypt stream authTag is the tag to check. For a GCM encrypt
+ * stream pass NULL and the size of the tag to make. CBC streams take no tag.
+ * This function does not block; it returns immediately after sending the
+ * request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] handle Handle of the stream.
+ * @param[in] authTag Pointer to the tag to check, or NULL.
+ * @param[in] authTagSz Size of the tag.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_AesStreamFinalRequest(whClientContext* c, uint32_t handle,
+                                    const uint8_t* authTag,
+                                    uint32_t authTagSz);
+
+/**
+ * @brief Receives the response to an AES stream finish request.
+ *
+ * The stream is closed whether or not it succeeded. This function does not
+ * block; it returns WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] authTag Pointer to store the tag of a GCM encrypt stream, or
+ * NULL.
+ * @param[in] authTagSz Size of authTag.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure, including a GCM tag that
+ * does not match.
+ */
+int wh_Client_AesStreamFinalResponse(whClientContext* c, uint8_t* authTag,
+                                     uint32_t authTagSz);
+
+/**
+ * @brief Finishes and closes an AES stream.
+ *
+ * authTag receives the tag of a GCM encrypt stream, and holds the tag to
+ * check for a GCM decrypt stream. Pass NULL and 0 for CBC streams. This
+ * function blocks until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] handle Handle of the stream.
+ * @param[in,out] authTag Pointer to the tag, or NULL.
+ * @param[in] authTagSz Size of the tag.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_AesStreamFinal(whClientContext* c, uint32_t handle,
+                             uint8_t* authTag, uint32_t authTagSz);
+#endif /* !NO_AES && (HAVE_AES_CBC || HAVE_AESGCM) */
+
+#if !defined(NO_AES) && defined(HAVE_AES_CBC)
+/**
+ * @brief Runs AES CBC on client memory using DMA.
+ *
+ * The server reads the input from and writes the output to client memory
+ * directly, so sz is not limited by the comm buffer. The addresses are
+ * translated and checked by the server DMA callbacks and allowlist. The key is
+ * taken from aes as for wh_Client_AesStreamInitRequest. This function blocks
+ * until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] aes Pointer to the AES key structure holding the key.
+ * @param[in] enc 1 to encrypt, 0 to decrypt.
+ * @param[in] iv Pointer to the AES_IV_SIZE byte IV.
+ * @param[in] in Pointer to the input, a multiple of AES_BLOCK_SIZE.
+ * @param[in] sz Size of the input.
+ * @param[out] out Pointer to store sz bytes of output, may be in.
+ * @return int Returns 0 on success, WH_ERROR_ACCESS if the server may not
+ * access the buffers, or a negative error code on failure.
+ */
+int wh_Client_AesCbcDma(whClientContext* c, Aes* aes, int enc,
+                        const uint8_t* iv, const uint8_t* in, uint32_t sz,
+                        uint8_t* out);
+#endif /* !NO_AES && HAVE_AES_CBC */
+
+#if !defined(NO_AES) && defined(HAVE_AESGCM)
+/**
+ * @brief Runs AES GCM on client memory using DMA.
+ *
+ * The server reads the input and additional authentication data from and
+ * writes the output to client memory directly. Only the IV and tag go through
+ * the comm buffer. This function blocks until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] aes Pointer to the AES key structure holding the key.
+ * @param[in] enc 1 to encrypt, 0 to decrypt.
+ * @param[in] iv Pointer to the IV.
+ * @param[in] ivSz Size of the IV.
+ * @param[in] in Pointer to the input.
+ * @param[in] sz Size of the input.
+ * @param[in] authIn Pointer to additional authentication data, or NULL.
+ * @param[in] authInSz Size of authIn.
+ * @param[in,out] authTag Receives the tag when encrypting, holds the tag to
+ * check when decrypting.
+ * @param[in] authTagSz Size of the tag, at most AES_BLOCK_SIZE.
+ * @param[out] out Pointer to store sz bytes of output, may be in.
+ * @return int Returns 0 on success, WH_ERROR_ACCESS if the server may not
+ * access the buffers, or a negative error code on failure, including a tag
+ * that does not match.
+ */
+int wh_Client_AesGcmDma(whClientContext* c, Aes* aes, int enc,
+                        const uint8_t* iv, uint32_t ivSz, const uint8_t* in,
+                        uint32_t sz, const uint8_t* authIn, uint32_t authInSz,
+                        uint8_t* authTag, uint32_t authTagSz, uint8_t* out);
+#endif /* !NO_AES && HAVE_AESGCM */
+
+#ifndef NO_SHA256
+/**
+ * @brief Hashes client memory with SHA-256 using DMA.
+ *
+ * The server reads the input from client memory directly and returns the
+ * digest. This function blocks until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] in Pointer to the input.
+ * @param[in] sz Size of the input.
+ * @param[out] hash Pointer to store the WC_SHA256_DIGEST_SIZE byte digest.
+ * @return int Returns 0 on success, WH_ERROR_ACCESS if the server may not
+ * access the input, or a negative error code on failure.
+ */
+int wh_Client_Sha256Dma(whClientContext* c, const uint8_t* in, uint32_t sz,
+                        uint8_t* hash);
+#endif /* !NO_SHA256 */
+
+#ifdef HAVE_ECC
+/* One signature to check with wh_Client_EccVerifyBatch */
+typedef struct {
+    const uint8_t* sig;
+    const uint8_t* hash;
+    whNvmId        keyId;   /* Cached public key */
+    uint16_t       sigSz;
+    uint16_t       hashSz;
+    uint8_t        padding[2];
+} whClientEccVerifyItem;
+
+/**
+ * @brief Verifies several ECDSA signatures with as few messages as possible.
+ *
+ * Items are packed into messages of up to WH_PACKET_ECC_VERIFY_BATCH_MAX
+ * signatures. The server loads a public key once for each run of items with
+ * the same keyId, so items should be grouped by key. This function blocks
+ * until all responses are received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] curveId Curve of all of the keys, such as ECC_SECP256R1.
+ * @param[in] items Array of count items to verify.
+ * @param[in] count Number of items.
+ * @param[out] results Array of count results, 1 for a valid signature, 0 for
+ * an invalid one, or WH_ERROR_ABORTED when the item could not be checked,
+ * such as for a missing key or a malformed signature.
+ * @return int Returns 0 when all items were checked, or a negative error code
+ * if the batch could not be sent, WH_ERROR_BADARGS if one item does not fit
+ * in a message.
+ */
+int wh_Client_EccVerifyBatch(whClientContext* c, int curveId,
+                             const whClientEccVerifyItem* items,
+                             uint32_t count, int* results);
+
+/**
+ * @brief Computes an ECDH shared secret and keeps it in the server key cache.
+ *
+ * The secret is not returned, so it never leaves the server. Later requests
+ * such as HMAC or AES can use it through its key ID like any other cached key.
+ * This function blocks until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] curveId Curve of both keys, such as ECC_SECP256R1.
+ * @param[in] privateKeyId Key ID of the cached private key.
+ * @param[in] publicKeyId Key ID of the cached public key of the peer.
+ * @param[in] flags NVM flags of the cached secret.
+ * @param[in,out] keyId Key ID to use, or WOLFHSM_KEYID_ERASED to have the
+ * server assign one. Receives the key ID used.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_EccSharedSecretCache(whClientContext* c, int curveId,
+                                   whKeyId privateKeyId, whKeyId publicKeyId,
+                                   uint32_t flags, whKeyId* keyId);
+#endif /* HAVE_ECC */
+
+#ifdef HAVE_CURVE25519
+/**
+ * @brief Computes a Curve25519 shared secret and keeps it in the server key
+ * cache.
+ *
+ * As wh_Client_EccSharedSecretCache, for Curve25519 keys. This function blocks
+ * until the response is received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] privateKeyId Key ID of the cached private key.
+ * @param[in] publicKeyId Key ID of the cached public key of the peer.
+ * @param[in] endian EC25519_LITTLE_ENDIAN or EC25519_BIG_ENDIAN byte order of
+ * the secret.
+ * @param[in] flags NVM flags of the cached secret.
+ * @param[in,out] keyId Key ID to use, or WOLFHSM_KEYID_ERASED to have the
+ * server assign one. Receives the key ID used.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_Curve25519SharedSecretCache(whClientContext* c,
+                                          whKeyId privateKeyId,
+                                          whKeyId publicKeyId, int endian,
+                                          uint32_t flags, whKeyId* keyId);
+#endif /* HAVE_CURVE25519 */
+
+#ifdef WH_CLIENT_ASYNC_CRYPTO
+/**
+ * @brief Enables or disables asynchronous public key operations in the
+ * crypto callback.
+ *
+ * When enabled, RSA, ECC, Curve25519 and Ed25519 operations other than size
+ * and key checks send their request and return WC_PENDING_E, as wolfCrypt
+ * does with WOLFSSL_ASYNC_CRYPT. Repeating the call with the same key and
+ * output completes the operation once the response has arrived, or returns
+ * WC_PENDING_E again. Only one operation is outstanding at a time; until it
+ * completes or is cancelled with wh_Client_CancelAsyncCrypto, other public key
+ * operations return WC_PENDING_E and all other crypto fails with BAD_STATE_E.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] enable Nonzero to enable asynchronous operations.
+ * @return int Returns 0 on success, WH_ERROR_BADARGS if c is NULL, or
+ * WH_ERROR_NOTREADY if an operation is outstanding.
+ */
+int wh_Client_SetAsyncCrypto(whClientContext* c, int enable);
+
+/**
+ * @brief Abandons the outstanding asynchronous public key operation.
+ *
+ * Blocks until the response of the operation arrives and discards it, so the
+ * connection can be used again. Does nothing if no operation is outstanding.
+ *
+ * @param[in] c Pointer to the client context.
+ * @return int Returns 0 on success, WH_ERROR_BADARGS if c is NULL, or a
+ * negative error code if the response could not be received.
+ */
+int wh_Client_CancelAsyncCrypto(whClientContext* c);
+#endif /* WH_CLIENT_ASYNC_CRYPTO */
+#endif
+
+/** NVM functions */
+/**
+ * @brief Sends a non-volatile memory (NVM) initialization request to the
+ * server.
+ *
+ * This function prepares and sends an NVM initialization request message to the
+ * server. The message contains the client NVM ID. This function does not block;
+ * it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmInitRequest(whClientContext* c);
+
+/**
+ * @brief Receives a non-volatile memory (NVM) initialization response from the
+ * server.
  *
  * This function attempts to process an NVM initialization response message from
  * the server. It validates the response and extracts the client and server NVM
@@ -755,19 +1926,184 @@ int wh_Client_NvmAddObjectRequest(whClientContext* c, whNvmId id,
  *
  * @param[in] c Pointer to the client context.
  * @param[out] out_rc Pointer to store the return code from the server.
- * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
- * available, or a negative error code on failure.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectResponse(whClientContext* c, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server and receives a response to add an object
+ * to non-volatile memory (NVM).
+ *
+ * This function handles the complete process of sending a request to the server
+ * to add an object to the NVM and receiving the response. It sends the request
+ * and repeatedly attempts to receive a valid response. This function blocks
+ * until the entire operation is complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the NVM object to add.
+ * @param[in] access The access permissions for the NVM object.
+ * @param[in] flags Flags associated with the NVM object.
+ * @param[in] label_len The length of the label.
+ * @param[in] label Pointer to the label data.
+ * @param[in] len The length of the data.
+ * @param[in] data Pointer to the data to be added.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObject(whClientContext* c, whNvmId id, whNvmAccess access,
+                           whNvmFlags flags, whNvmSize label_len,
+                           uint8_t* label, whNvmSize len, const uint8_t* data,
+                           int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server to begin streaming an object into
+ * non-volatile memory (NVM).
+ *
+ * The server reserves len bytes for the object, which is then filled by
+ * wh_Client_NvmAddObjectAppend* requests and made visible by
+ * wh_Client_NvmAddObjectCommit*. Until the commit, reads of the id return the
+ * previous version, if any. Beginning another object abandons the current one.
+ * This function does not block; it returns immediately after sending the
+ * request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the NVM object to add.
+ * @param[in] access The access permissions for the NVM object.
+ * @param[in] flags Flags associated with the NVM object.
+ * @param[in] label_len The length of the label.
+ * @param[in] label Pointer to the label data.
+ * @param[in] len The total length of the data to be appended.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectBeginRequest(whClientContext* c, whNvmId id,
+                                       whNvmAccess access, whNvmFlags flags,
+                                       whNvmSize label_len, uint8_t* label,
+                                       whNvmSize len);
+
+/**
+ * @brief Receives a response from the server after attempting to begin
+ * streaming an object.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response has
+ * not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectBeginResponse(whClientContext* c, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server and receives a response to begin
+ * streaming an object. This function blocks until the operation is complete or
+ * an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the NVM object to add.
+ * @param[in] access The access permissions for the NVM object.
+ * @param[in] flags Flags associated with the NVM object.
+ * @param[in] label_len The length of the label.
+ * @param[in] label Pointer to the label data.
+ * @param[in] len The total length of the data to be appended.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectBegin(whClientContext* c, whNvmId id,
+                                whNvmAccess access, whNvmFlags flags,
+                                whNvmSize label_len, uint8_t* label,
+                                whNvmSize len, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server to append data to the object being
+ * streamed.
+ *
+ * Chunks may be of any size up to WH_MESSAGE_NVM_MAX_APPEND_LEN and are
+ * appended in the order sent. The server returns WH_ERROR_BADARGS for data
+ * past the length given at the beginning. This function does not block; it
+ * returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] len The length of the data.
+ * @param[in] data Pointer to the data to be appended.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectAppendRequest(whClientContext* c, whNvmSize len,
+                                        const uint8_t* data);
+
+/**
+ * @brief Receives a response from the server after attempting to append data
+ * to the object being streamed.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response has
+ * not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectAppendResponse(whClientContext* c, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server and receives a response to append data
+ * to the object being streamed. This function blocks until the operation is
+ * complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] len The length of the data.
+ * @param[in] data Pointer to the data to be appended.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectAppend(whClientContext* c, whNvmSize len,
+                                 const uint8_t* data, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server to commit the object being streamed.
+ *
+ * The server returns WH_ERROR_BADARGS if less data than the length given at
+ * the beginning has been appended, leaving the stream open. This function does
+ * not block; it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectCommitRequest(whClientContext* c);
+
+/**
+ * @brief Receives a response from the server after attempting to commit the
+ * object being streamed.
+ *
+ * This function does not block; it returns WH_ERROR_NOTREADY if a response has
+ * not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectCommitResponse(whClientContext* c, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server and receives a response to commit the
+ * object being streamed. This function blocks until the operation is complete
+ * or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, or a negative error code on failure.
  */
-int wh_Client_NvmAddObjectResponse(whClientContext* c, int32_t* out_rc);
+int wh_Client_NvmAddObjectCommit(whClientContext* c, int32_t* out_rc);
 
 /**
- * @brief Sends a request to the server and receives a response to add an object
- * to non-volatile memory (NVM).
+ * @brief Adds an object larger than one message to non-volatile memory (NVM)
+ * by streaming it in chunks of WH_MESSAGE_NVM_MAX_APPEND_LEN.
  *
- * This function handles the complete process of sending a request to the server
- * to add an object to the NVM and receiving the response. It sends the request
- * and repeatedly attempts to receive a valid response. This function blocks
- * until the entire operation is complete or an error occurs.
+ * This function begins the object, appends all of the data, and commits it,
+ * blocking on each step. It stops at the first step the server fails, whose
+ * return code is stored in out_rc.
  *
  * @param[in] c Pointer to the client context.
  * @param[in] id The ID of the NVM object to add.
@@ -780,10 +2116,11 @@ int wh_Client_NvmAddObjectResponse(whClientContext* c, int32_t* out_rc);
  * @param[out] out_rc Pointer to store the return code from the server.
  * @return int Returns 0 on success, or a negative error code on failure.
  */
-int wh_Client_NvmAddObject(whClientContext* c, whNvmId id, whNvmAccess access,
-                           whNvmFlags flags, whNvmSize label_len,
-                           uint8_t* label, whNvmSize len, const uint8_t* data,
-                           int32_t* out_rc);
+int wh_Client_NvmAddObjectStream(whClientContext* c, whNvmId id,
+                                 whNvmAccess access, whNvmFlags flags,
+                                 whNvmSize label_len, uint8_t* label,
+                                 whNvmSize len, const uint8_t* data,
+                                 int32_t* out_rc);
 
 /**
  * @brief Sends a request to the server to list non-volatile memory (NVM)
@@ -911,12 +2248,97 @@ int wh_Client_NvmGetMetadataResponse(whClientContext* c, int32_t* out_rc,
  * @param[in] label_len The length of the label buffer.
  * @param[out] label Pointer to store the label data.
  * @return int Returns 0 on success, or a negative error code on failure.
+ *
+ * With WH_CLIENT_NVM_CACHE_COUNT, the metadata or absence of recently seen
+ * objects is returned from the client cache. It reflects the server NVM as of
+ * the last NVM response received, so changes made since by other clients are
+ * only seen after the next one, or after wh_Client_NvmCacheFlush.
  */
 int wh_Client_NvmGetMetadata(whClientContext* c, whNvmId id, int32_t* out_rc,
                              whNvmId* out_id, whNvmAccess* out_access,
                              whNvmFlags* out_flags, whNvmSize* out_len,
                              whNvmSize label_len, uint8_t* label);
 
+#if WH_CLIENT_NVM_CACHE_COUNT > 0
+/**
+ * @brief Drops all NVM metadata cached by the client.
+ *
+ * The client flushes its cache itself when it changes NVM objects or keys.
+ * Call this after another client may have changed objects this client reads.
+ *
+ * @param[in] c Pointer to the client context.
+ */
+void wh_Client_NvmCacheFlush(whClientContext* c);
+#endif
+
+/**
+ * @brief Sends a request to the server to list the metadata of many
+ * non-volatile memory (NVM) objects at once.
+ *
+ * The server returns the metadata of up to max_count objects matching access
+ * and flags after start_id, in the same order as wh_Client_NvmList, limited to
+ * WH_MESSAGE_NVM_MAX_LIST_METADATA_COUNT per response. This function does not
+ * block; it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] access The access permissions to match.
+ * @param[in] flags The flags to match.
+ * @param[in] start_id The ID after which to start, or 0 for the first object.
+ * @param[in] max_count The maximum number of entries to return.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmListMetadataRequest(whClientContext* c, whNvmAccess access,
+                                     whNvmFlags flags, whNvmId start_id,
+                                     whNvmId max_count);
+
+/**
+ * @brief Receives a response from the server with the metadata of many
+ * non-volatile memory (NVM) objects.
+ *
+ * The ID of the last entry returned is the start_id of the next request. This
+ * function does not block; it returns WH_ERROR_NOTREADY if a response has not
+ * been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @param[out] out_count Pointer to store the number of matching objects left
+ * after the last entry returned.
+ * @param[in] max_count The number of entries out_meta can hold.
+ * @param[out] out_returned Pointer to store the number of entries returned.
+ * @param[out] out_meta Array of max_count entries to store the metadata.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_NvmListMetadataResponse(whClientContext* c, int32_t* out_rc,
+                                      whNvmId* out_count, whNvmId max_count,
+                                      whNvmId*       out_returned,
+                                      whNvmMetadata* out_meta);
+
+/**
+ * @brief Sends a request to the server and receives a response with the
+ * metadata of many non-volatile memory (NVM) objects.
+ *
+ * This function blocks until the entire operation is complete or an error
+ * occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] access The access permissions to match.
+ * @param[in] flags The flags to match.
+ * @param[in] start_id The ID after which to start, or 0 for the first object.
+ * @param[in] max_count The maximum number of entries to return.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @param[out] out_count Pointer to store the number of matching objects left
+ * after the last entry returned.
+ * @param[out] out_returned Pointer to store the number of entries returned.
+ * @param[out] out_meta Array of max_count entries to store the metadata.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmListMetadata(whClientContext* c, whNvmAccess access,
+                              whNvmFlags flags, whNvmId start_id,
+                              whNvmId max_count, int32_t* out_rc,
+                              whNvmId* out_count, whNvmId* out_returned,
+                              whNvmMetadata* out_meta);
+
 /**
  * @brief Sends a request to the server to destroy non-volatile memory (NVM)
  * objects.
@@ -1386,6 +2808,321 @@ int wh_Client_NvmReadDmaResponse(whClientContext* c, int32_t* out_rc);
 int wh_Client_NvmReadDma(whClientContext* c, whNvmId id, whNvmSize offset,
                          whNvmSize data_len, uint8_t* data, int32_t* out_rc);
 
+/**
+ * @brief Sends a request to the server to add an object to non-volatile memory
+ * (NVM) using DMA, gathering its data from a list of client memory segments.
+ *
+ * This function prepares and sends a request to the server to add an object to
+ * NVM whose data is the concatenation of the segments, in order. Each segment
+ * holds a client address (cast through uintptr_t) and a length. The object
+ * length in the stored metadata is the sum of the segment lengths. The server
+ * streams each segment into the object, so the NVM backend must support
+ * AddObjectBegin. This function does not block; it returns immediately after
+ * sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] metadata Pointer to the metadata.
+ * @param[in] seg_count The number of segments, at most WH_DMA_MAX_SEGMENTS.
+ * @param[in] segs The client memory segments holding the data.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectDmaSgRequest(whClientContext* c,
+                                       whNvmMetadata*   metadata,
+                                       uint16_t         seg_count,
+                                       const whDmaSegment* segs);
+
+/**
+ * @brief Receives a response from the server after attempting to add an object
+ * to non-volatile memory (NVM) from a list of client memory segments.
+ *
+ * This function attempts to process a response message from the server after
+ * attempting to add an object to NVM using scatter-gather DMA. It validates
+ * the response and extracts the return code. This function does not block; it
+ * returns WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectDmaSgResponse(whClientContext* c, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server and receives a response to add an object
+ * to non-volatile memory (NVM) from a list of client memory segments.
+ *
+ * This function handles the complete process of sending a request to the server
+ * to add an object to NVM using scatter-gather DMA and receiving the response.
+ * This function blocks until the entire operation is complete or an error
+ * occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] metadata Pointer to the metadata.
+ * @param[in] seg_count The number of segments, at most WH_DMA_MAX_SEGMENTS.
+ * @param[in] segs The client memory segments holding the data.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmAddObjectDmaSg(whClientContext* c, whNvmMetadata* metadata,
+                                uint16_t seg_count, const whDmaSegment* segs,
+                                int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server to read data from non-volatile memory
+ * (NVM) using DMA, scattering it to a list of client memory segments.
+ *
+ * This function prepares and sends a request to the server to read
+ * consecutive bytes of an object, starting at offset, into the segments in
+ * order. Each segment holds a client address (cast through uintptr_t) and a
+ * length. This function does not block; it returns immediately after sending
+ * the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The NVM ID of the object to read.
+ * @param[in] offset The offset within the object to start reading from.
+ * @param[in] seg_count The number of segments, at most WH_DMA_MAX_SEGMENTS.
+ * @param[in] segs The client memory segments to read into.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmReadDmaSgRequest(whClientContext* c, whNvmId id,
+                                  whNvmSize offset, uint16_t seg_count,
+                                  const whDmaSegment* segs);
+
+/**
+ * @brief Receives a response from the server after attempting to read data
+ * from non-volatile memory (NVM) into a list of client memory segments.
+ *
+ * This function attempts to process a response message from the server after
+ * attempting to read data from NVM using scatter-gather DMA. It validates the
+ * response and extracts the return code. This function does not block; it
+ * returns WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_NvmReadDmaSgResponse(whClientContext* c, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server and receives a response to read data
+ * from non-volatile memory (NVM) into a list of client memory segments.
+ *
+ * This function handles the complete process of sending a request to the server
+ * to read data from NVM using scatter-gather DMA and receiving the response.
+ * This function blocks until the entire operation is complete or an error
+ * occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The NVM ID of the object to read.
+ * @param[in] offset The offset within the object to start reading from.
+ * @param[in] seg_count The number of segments, at most WH_DMA_MAX_SEGMENTS.
+ * @param[in] segs The client memory segments to read into.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_NvmReadDmaSg(whClientContext* c, whNvmId id, whNvmSize offset,
+                           uint16_t seg_count, const whDmaSegment* segs,
+                           int32_t* out_rc);
+
+/* Client non-volatile counter support */
+
+/**
+ * @brief Sends a request to the server to create or set a counter.
+ *
+ * This function prepares and sends a request to the server to create the
+ * counter with the given ID if it does not exist and set its value. An
+ * existing counter may only be set to its current value or higher. This
+ * function does not block; it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @param[in] value The value to set.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterInitRequest(whClientContext* c, whCounterId id,
+                                 uint32_t value);
+
+/**
+ * @brief Receives a response from the server after setting a counter.
+ *
+ * This function attempts to process a response message from the server after
+ * setting a counter. It validates the response and extracts the return code
+ * and the counter value. This function does not block; it returns
+ * WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server. Set to
+ * WH_ERROR_NOSPACE if no more counters can be created, or WH_ERROR_ACCESS if
+ * the value is below the counter's current value.
+ * @param[out] out_value Pointer to store the counter value, the current one
+ * when the value was refused. May be NULL.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_CounterInitResponse(whClientContext* c, int32_t* out_rc,
+                                  uint32_t* out_value);
+
+/**
+ * @brief Sends a request to the server and receives a response to create or
+ * set a counter.
+ *
+ * This function handles the complete process of sending a request to the server
+ * to set a counter and receiving the response. This function blocks until the
+ * entire operation is complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @param[in] value The value to set.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @param[out] out_value Pointer to store the counter value. May be NULL.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterInit(whClientContext* c, whCounterId id, uint32_t value,
+                          int32_t* out_rc, uint32_t* out_value);
+
+/**
+ * @brief Sends a request to the server to increment a counter.
+ *
+ * This function prepares and sends a request to the server to add one to an
+ * existing counter. The value saturates at UINT32_MAX. This function does not
+ * block; it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterIncrementRequest(whClientContext* c, whCounterId id);
+
+/**
+ * @brief Receives a response from the server after incrementing a counter.
+ *
+ * This function attempts to process a response message from the server after
+ * incrementing a counter. It validates the response and extracts the return
+ * code and the new counter value. This function does not block; it returns
+ * WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server. Set to
+ * WH_ERROR_NOTFOUND if the counter does not exist.
+ * @param[out] out_value Pointer to store the new counter value. May be NULL.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_CounterIncrementResponse(whClientContext* c, int32_t* out_rc,
+                                       uint32_t* out_value);
+
+/**
+ * @brief Sends a request to the server and receives a response to increment a
+ * counter.
+ *
+ * This function handles the complete process of sending a request to the server
+ * to increment a counter and receiving the response. This function blocks until
+ * the entire operation is complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @param[out] out_value Pointer to store the new counter value. May be NULL.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterIncrement(whClientContext* c, whCounterId id,
+                               int32_t* out_rc, uint32_t* out_value);
+
+/**
+ * @brief Sends a request to the server to read a counter.
+ *
+ * This function prepares and sends a request to the server to read the value of
+ * a counter. This function does not block; it returns immediately after sending
+ * the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterReadRequest(whClientContext* c, whCounterId id);
+
+/**
+ * @brief Receives a response from the server after reading a counter.
+ *
+ * This function attempts to process a response message from the server after
+ * reading a counter. It validates the response and extracts the return code
+ * and the counter value. This function does not block; it returns
+ * WH_ERROR_NOTREADY if a response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server. Set to
+ * WH_ERROR_NOTFOUND if the counter does not exist.
+ * @param[out] out_value Pointer to store the counter value. May be NULL.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_CounterReadResponse(whClientContext* c, int32_t* out_rc,
+                                  uint32_t* out_value);
+
+/**
+ * @brief Sends a request to the server and receives a response to read a
+ * counter.
+ *
+ * This function handles the complete process of sending a request to the server
+ * to read a counter and receiving the response. This function blocks until the
+ * entire operation is complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @param[out] out_value Pointer to store the counter value. May be NULL.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterRead(whClientContext* c, whCounterId id, int32_t* out_rc,
+                          uint32_t* out_value);
+
+/**
+ * @brief Sends a request to the server to destroy a counter.
+ *
+ * This function prepares and sends a request to the server to destroy a
+ * counter. Destroying a counter that does not exist succeeds. Servers built
+ * without WH_SERVER_COUNTER_DESTROY refuse it with WH_ERROR_ACCESS, so a
+ * counter can't be destroyed and created again at a lower value. This
+ * function does not block; it returns immediately after sending the request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterDestroyRequest(whClientContext* c, whCounterId id);
+
+/**
+ * @brief Receives a response from the server after destroying a counter.
+ *
+ * This function attempts to process a response message from the server after
+ * destroying a counter. It validates the response and extracts the return
+ * code. This function does not block; it returns WH_ERROR_NOTREADY if a
+ * response has not been received.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response is
+ * available, or a negative error code on failure.
+ */
+int wh_Client_CounterDestroyResponse(whClientContext* c, int32_t* out_rc);
+
+/**
+ * @brief Sends a request to the server and receives a response to destroy a
+ * counter.
+ *
+ * This function handles the complete process of sending a request to the server
+ * to destroy a counter and receiving the response. This function blocks until
+ * the entire operation is complete or an error occurs.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the counter.
+ * @param[out] out_rc Pointer to store the return code from the server.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CounterDestroy(whClientContext* c, whCounterId id,
+                             int32_t* out_rc);
+
 /* Client custom-callback support */
 
 /**
@@ -1474,5 +3211,73 @@ int wh_Client_CustomCbCheckRegisteredResponse(whClientContext* c,
 int wh_Client_CustomCbCheckRegistered(whClientContext* c, uint16_t id,
                                       int* responseError);
 
+/**
+ * @brief Returns where a bulk custom callback payload is placed in the comm
+ * buffer.
+ *
+ * Writing the request payload here before calling
+ * wh_Client_CustomCbBulkRequest avoids copying it, and after
+ * wh_Client_CustomCbBulkResponse the response payload is found here. Up to
+ * wh_Client_GetMaxDataLen less sizeof(whMessageCustomCb_BulkHeader) bytes are
+ * available.
+ *
+ * @param[in] c Pointer to the client context.
+ * @return uint8_t* Pointer to the payload, or NULL if c is invalid.
+ */
+uint8_t* wh_Client_CustomCbBulkGetDataPtr(whClientContext* c);
+
+/**
+ * @brief Sends a bulk custom callback request to the server.
+ *
+ * The payload is passed to the server's bulk handler for the callback ID
+ * without translation. It is copied into the comm buffer unless data is the
+ * pointer returned by wh_Client_CustomCbBulkGetDataPtr.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the custom callback to invoke.
+ * @param[in] data The request payload. May be NULL if size is 0.
+ * @param[in] size Bytes in the request payload.
+ * @return int Returns 0 on success, WH_ERROR_BADARGS if the payload does not
+ * fit, or a negative error code on failure.
+ */
+int wh_Client_CustomCbBulkRequest(whClientContext* c, uint16_t id,
+                                  const uint8_t* data, uint16_t size);
+
+/**
+ * @brief Receives the response to a bulk custom callback request.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[out] out_rc Return code from the server's bulk handler.
+ * @param[out] data Buffer for the response payload. May be NULL or the pointer
+ * returned by wh_Client_CustomCbBulkGetDataPtr to leave it in place.
+ * @param[in,out] inout_size In: space in data, out: bytes in the response
+ * payload.
+ * @return int Returns 0 on success, WH_ERROR_NOTREADY if no response has
+ * arrived, WH_ERROR_NOHANDLER if no bulk handler is registered,
+ * WH_ERROR_NOSPACE if the payload does not fit in data, or a negative error
+ * code on failure.
+ */
+int wh_Client_CustomCbBulkResponse(whClientContext* c, int32_t* out_rc,
+                                   uint8_t* data, uint16_t* inout_size);
+
+/**
+ * @brief Invokes a bulk custom callback on the server and waits for its
+ * response.
+ *
+ * @param[in] c Pointer to the client context.
+ * @param[in] id The ID of the custom callback to invoke.
+ * @param[in] req_data The request payload.
+ * @param[in] req_size Bytes in the request payload.
+ * @param[out] out_rc Return code from the server's bulk handler.
+ * @param[out] resp_data Buffer for the response payload.
+ * @param[in,out] inout_resp_size In: space in resp_data, out: bytes in the
+ * response payload.
+ * @return int Returns 0 on success, or a negative error code on failure.
+ */
+int wh_Client_CustomCbBulk(whClientContext* c, uint16_t id,
+                           const uint8_t* req_data, uint16_t req_size,
+                           int32_t* out_rc, uint8_t* resp_data,
+                           uint16_t* inout_resp_size);
+
 
 #endif /* WOLFHSM_WH_CLIENT_H_ */
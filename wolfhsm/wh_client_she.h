@@ -38,6 +38,10 @@ int wh_Client_SheSetUidResponse(whClientContext* c);
 int wh_Client_SheSetUid(whClientContext* c, uint8_t* uid, uint32_t uidSz);
 int wh_Client_SheSecureBoot(whClientContext* c, uint8_t* bootloader,
     uint32_t bootloaderLen);
+/* Same as wh_Client_SheSecureBoot but the server reads the bootloader from
+ * client memory over DMA instead of having it copied through the comm buffer */
+int wh_Client_SheSecureBootDma(whClientContext* c, uint8_t* bootloader,
+    uint32_t bootloaderLen);
 int wh_Client_SheGetStatusRequest(whClientContext* c);
 int wh_Client_SheGetStatusResponse(whClientContext* c, uint8_t* sreg);
 int wh_Client_SheGetStatus(whClientContext* c, uint8_t* sreg);
@@ -48,6 +52,13 @@ int wh_Client_SheLoadKeyResponse(whClientContext* c, uint8_t* messageFour,
 int wh_Client_SheLoadKey(whClientContext* c, uint8_t* messageOne,
     uint8_t* messageTwo, uint8_t* messageThree, uint8_t* messageFour,
     uint8_t* messageFive);
+/* Load count keys, messageOne to messageFive hold count messages each back to
+ * back. As many keys are sent per request as fit in the comm buffer. Keys are
+ * loaded in order until one fails, loaded is set to the number whose M4/M5
+ * were returned */
+int wh_Client_SheLoadKeyBatch(whClientContext* c, uint32_t count,
+    uint8_t* messageOne, uint8_t* messageTwo, uint8_t* messageThree,
+    uint8_t* messageFour, uint8_t* messageFive, uint32_t* loaded);
 int wh_Client_SheLoadPlainKeyRequest(whClientContext* c, uint8_t* key,
     uint32_t keySz);
 int wh_Client_SheLoadPlainKeyResponse(whClientContext* c);
@@ -90,6 +101,18 @@ int wh_Client_SheDecCbcRequest(whClientContext* c, uint8_t keyId, uint8_t* iv,
 int wh_Client_SheDecCbcResponse(whClientContext* c, uint8_t* out, uint32_t sz);
 int wh_Client_SheDecCbc(whClientContext* c, uint8_t keyId, uint8_t* iv,
     uint32_t ivSz, uint8_t* in, uint8_t* out, uint32_t sz);
+/* Bulk versions of the ciphers above. The server reads in and writes out in
+ * client memory over DMA, so sz is not limited by the comm buffer but must be
+ * a multiple of the block size. The CBC versions update iv to continue the
+ * stream with a following call */
+int wh_Client_SheEncEcbDma(whClientContext* c, uint8_t keyId, uint8_t* in,
+    uint8_t* out, uint32_t sz);
+int wh_Client_SheEncCbcDma(whClientContext* c, uint8_t keyId, uint8_t* iv,
+    uint32_t ivSz, uint8_t* in, uint8_t* out, uint32_t sz);
+int wh_Client_SheDecEcbDma(whClientContext* c, uint8_t keyId, uint8_t* in,
+    uint8_t* out, uint32_t sz);
+int wh_Client_SheDecCbcDma(whClientContext* c, uint8_t keyId, uint8_t* iv,
+    uint32_t ivSz, uint8_t* in, uint8_t* out, uint32_t sz);
 int wh_Client_SheGenerateMacRequest(whClientContext* c, uint8_t keyId,
     uint8_t* in, uint32_t sz);
 int wh_Client_SheGenerateMacResponse(whClientContext* c, uint8_t* out,
@@ -40,16 +40,29 @@
 #define WOLFHSM_WH_COMM_H_
 
 #include <stdint.h>  /* For sized ints */
+#include <stddef.h>  /* For offsetof */
 
 /** Packet content types */
 
 /* Request/response packets are composed of a single fixed-length header
  * (whHeader) followed immediately by variable-length data between 0 and
  * DATA_LEN bytes.
+ *
+ * WH_COMM_DATA_LEN may be increased at build time for transports with large
+ * buffers.  The client and server each advertise their size during
+ * wh_Client_CommInit and both use the smaller of the two afterwards, which is
+ * never less than WH_COMM_DATA_LEN_MIN.  The MTU must fit in a uint16_t.
  */
+#define WH_COMM_DATA_LEN_MIN 1280
+#ifndef WH_COMM_DATA_LEN
+#define WH_COMM_DATA_LEN WH_COMM_DATA_LEN_MIN
+#endif
+#if (WH_COMM_DATA_LEN < WH_COMM_DATA_LEN_MIN) || (WH_COMM_DATA_LEN > 0xFFF0)
+#error "WH_COMM_DATA_LEN must be between WH_COMM_DATA_LEN_MIN and 0xFFF0"
+#endif
+
 enum {
     WH_COMM_HEADER_LEN = 8,    /* whCommHeader */
-    WH_COMM_DATA_LEN = 1280,
     WH_COMM_MTU = (WH_COMM_HEADER_LEN + WH_COMM_DATA_LEN),
     WH_COMM_MTU_U64_COUNT = (WH_COMM_MTU + 7) / 8,  /* internal U64 buffer */
 };
@@ -66,8 +79,8 @@ enum {
 #define WH_COMM_MAGIC_SWAP      (WH_COMM_ENDIAN | (WH_COMM_VERSION << 8))
 
 #define WH_COMM_FLAGS_SWAPTEST(_magic) \
-    (_magic                 & WH_COMM_MAGIC_ENDIAN_MASK) ==  \
-    (WH_COMM_MAGIC_NATIVE   & WH_COMM_MAGIC_ENDIAN_MASK)
+    (((_magic)              & WH_COMM_MAGIC_ENDIAN_MASK) ==  \
+    (WH_COMM_MAGIC_NATIVE   & WH_COMM_MAGIC_ENDIAN_MASK))
 
 /* Header for a packet, request or response. On-the-wire format */
 typedef struct {
@@ -75,15 +88,15 @@ typedef struct {
     uint16_t kind;      /* Kind of packet.  Enumerated in message.h */
     uint16_t seq;       /* Sequence number. Incremented on request, copied for
                          * response. */
-    uint16_t aux;       /* Session identifier for request or error indicator
-                         * for response. */
+    uint16_t aux;       /* Priority class and session identifier for request
+                         * or error indicator for response. */
 } whCommHeader;
 /* static_assert(sizeof_whHeader == WH_COMM_HEADER_LEN,
                  "Size of whCommHeader doesn't match WH_COMM_HEADER_LEN") */
 
 enum {
     WH_COMM_AUX_REQ_NORMAL      = 0x0000, /* Normal request. No session */
-    /* Request Aux values 1-0xFFFE are session ids */
+    /* Request Aux bits 0-13 are the session id, bits 14-15 the class */
     WH_COMM_AUX_REQ_NORESP      = 0xFFFF, /* Async request without response*/
 
     WH_COMM_AUX_RESP_OK         = 0x0000, /* Response is valid */
@@ -92,6 +105,26 @@ enum {
     WH_COMM_AUX_RESP_UNSUPP     = 0xFFFF, /* Request is not supported */
 };
 
+/* Request priority classes.  The server handles waiting requests of a higher
+ * class first, whatever the priority of their comm channels */
+enum {
+    WH_COMM_CLASS_INTERACTIVE   = 0,    /* Default */
+    WH_COMM_CLASS_BULK          = 1,    /* Background work, e.g. provisioning */
+    WH_COMM_CLASS_REALTIME      = 2,    /* Deadline bound, e.g. SecOC MACs */
+    WH_COMM_CLASS_COUNT         = 3,
+};
+
+#define WH_COMM_AUX_SESSION_MASK    0x3FFFu
+#define WH_COMM_AUX_CLASS_SHIFT     14
+#define WH_COMM_AUX_CLASS_MASK      0xC000u
+
+/* Class of a request aux.  Unknown classes and NORESP are interactive */
+#define WH_COMM_AUX_CLASS(_aux)                                         \
+    (((((_aux) & WH_COMM_AUX_CLASS_MASK) >> WH_COMM_AUX_CLASS_SHIFT) <  \
+        WH_COMM_CLASS_COUNT) ?                                          \
+    (((_aux) & WH_COMM_AUX_CLASS_MASK) >> WH_COMM_AUX_CLASS_SHIFT) :    \
+    WH_COMM_CLASS_INTERACTIVE)
+
 /** Data translations */
 uint8_t wh_Translate8(uint16_t magic, uint8_t val);
 uint16_t wh_Translate16(uint16_t magic, uint16_t val);
@@ -103,6 +136,42 @@ uint64_t wh_Translate64(uint16_t magic, uint64_t val);
 #define WH_T32(_m, _d, _s, _f) _d->_f = wh_Translate32(_m, _s->_f)
 #define WH_T64(_m, _d, _s, _f) _d->_f = wh_Translate64(_m, _s->_f)
 
+/* Table driven translations.  A message type is described once by a table of
+ * its multibyte fields, so a native message is translated with a single copy
+ * and only a foreign one is walked field by field. Members not in the table
+ * are bytes or byte strings and are copied unchanged */
+typedef struct {
+    uint16_t offset;    /* Offset of the first field in the message */
+    uint16_t count;     /* Number of fields, for arrays */
+    uint8_t  size;      /* Bytes in each field: 2, 4 or 8 */
+    uint8_t  stride;    /* Bytes from one field to the next */
+} whCommField;
+
+/* A scalar member, or an array of _n scalars */
+#define WH_COMM_FIELD(_t, _f) \
+    { offsetof(_t, _f), 1, sizeof(((_t*)0)->_f), sizeof(((_t*)0)->_f) }
+#define WH_COMM_FIELD_ARRAY(_t, _f, _n) \
+    { offsetof(_t, _f), _n, sizeof(((_t*)0)->_f[0]), \
+        sizeof(((_t*)0)->_f[0]) }
+/* Member _m of each of the _n structs in array _a */
+#define WH_COMM_FIELD_STRUCTS(_t, _a, _m, _n) \
+    { offsetof(_t, _a[0]._m), _n, sizeof(((_t*)0)->_a[0]._m), \
+        sizeof(((_t*)0)->_a[0]) }
+/* Terminates a table */
+#define WH_COMM_FIELD_END { 0, 0, 0, 0 }
+
+/* Swaps the fields of a message in place unless magic is native. Fields that
+ * do not fit in the first size bytes are left untouched, so a table may
+ * describe a message that is truncated or followed by a payload */
+void wh_CommSwapFields(uint16_t magic, const whCommField* fields, void* msg,
+        uint16_t size);
+
+/* Translates a message of size bytes from src to dest, which may be the same
+ * buffer.  A native message is copied, or left as is when translated in
+ * place */
+int wh_CommTranslate(uint16_t magic, const whCommField* fields,
+        uint16_t size, const void* src, void* dest);
+
 
 /** Common client/server functions */
 
@@ -151,6 +220,23 @@ typedef struct {
      *          WH_ERROR_BADARGS if NULL context
      */
     int (*Cleanup)(void* context);
+
+    /* Optional. Lend the transport's own send buffer so the next request can
+     * be built in place.  Passing the lent buffer to Send commits the request
+     * without a copy.
+     * Returns: 0 on success,
+     *          WH_ERROR_BADARGS if NULL context or output pointers
+     *          WH_ERROR_NOTREADY if send buffer is not free. Retry.
+     */
+    int (*AcquireSend)(void* context, uint16_t* out_size, void** out_buffer);
+
+    /* Optional. Provide the next response in place within the transport's own
+     * buffer instead of copying it.  The buffer is valid until the next Send.
+     * Returns: 0 on success,
+     *          WH_ERROR_BADARGS if NULL context or output pointers
+     *          WH_ERROR_NOTREADY if recv buffer is not filled. Retry.
+     */
+    int (*AcquireRecv)(void* context, uint16_t* out_size, void** out_buffer);
 } whTransportClientCb;
 
 typedef struct {
@@ -178,7 +264,8 @@ typedef struct {
     uint16_t size;
     uint8_t client_id;
     uint8_t server_id;
-    uint8_t pad[4];
+    uint16_t max_data_len;  /* Negotiated maximum request/response data size */
+    uint16_t aux;           /* Aux sent with each request */
 } whCommClient;
 
 
@@ -245,6 +332,25 @@ typedef struct {
      *          WH_ERROR_BADARGS if NULL context
      */
     int (*Cleanup)(void* context);
+
+    /* Optional. Provide the next request in place within the transport's own
+     * buffer instead of copying it.  The buffer is valid until the response
+     * has been sent.  The client may still write it, so the server copies the
+     * request out once before parsing it.
+     * Returns: 0 on success,
+     *          WH_ERROR_BADARGS if NULL context or output pointers
+     *          WH_ERROR_NOTREADY if recv buffer is not filled. Retry.
+     */
+    int (*AcquireRecv)(void* context, uint16_t* out_size, void** out_buffer);
+
+    /* Optional. Lend the transport's own send buffer so the response can be
+     * built in place.  Passing the lent buffer to Send commits the response
+     * without a copy.
+     * Returns: 0 on success,
+     *          WH_ERROR_BADARGS if NULL context or output pointers
+     *          WH_ERROR_NOTREADY if send buffer is not free. Retry.
+     */
+    int (*AcquireSend)(void* context, uint16_t* out_size, void** out_buffer);
 } whTransportServerCb;
 
 typedef struct {
@@ -264,10 +370,15 @@ typedef struct {
     const whTransportServerCb* transport_cb;
     whCommHeader* hdr;
     uint8_t* data;
+    whCommHeader* send_hdr;  /* Lent transport send buffer, if acquired */
+    uint8_t* send_data;
     int initialized;
     uint16_t reqid;
     uint8_t client_id;
     uint8_t server_id;
+    uint16_t max_data_len;  /* Negotiated maximum request/response data size */
+    uint16_t aux;           /* Aux of the last request received */
+    uint8_t pad[4];
 } whCommServer;
 
 /* Reset the state of the server context and begin the connection to a client
@@ -278,7 +389,8 @@ int wh_CommServer_Init(whCommServer* context, const whCommServerConfig* config,
                 whCommSetConnectedCb connectcb, void* connectcb_arg);
 
 /* If a request packet has been buffered, get the header and copy the data out
- * of the buffer.
+ * of the buffer.  If data is NULL, the request is left in place and can be
+ * accessed using wh_CommServer_GetDataPtr().
  */
 int wh_CommServer_RecvRequest(whCommServer* context,
         uint16_t* out_magic, uint16_t* out_kind, uint16_t* out_seq,
@@ -297,6 +409,14 @@ int wh_CommServer_SendResponse(whCommServer* context,
  */
 uint8_t* wh_CommServer_GetDataPtr(whCommServer* context);
 
+/* Get a pointer to the data portion of the buffer the next response should be
+ * built in.  If the transport lends its send buffer, this is the transport's
+ * own memory and passing it to SendResponse avoids a copy.  Otherwise this is
+ * the same internal buffer returned by wh_CommServer_GetDataPtr().  Returns
+ * NULL if the send buffer is not available.
+ */
+uint8_t* wh_CommServer_GetSendDataPtr(whCommServer* context);
+
 
 int wh_CommServer_Cleanup(whCommServer* context);
 
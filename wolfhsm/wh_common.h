@@ -32,14 +32,120 @@
 
 #define WOLFHSM_DIGEST_STUB 8
 
+/** Footprint profiles
+ *
+ * Define one of these to change the defaults of the resource allocations
+ * below and of the server and client tables sized from them. Any value may
+ * still be set on its own, which takes precedence over the profile.
+ *
+ * WOLFHSM_PROFILE_MINIMAL: A few small keys, one custom callback, no batches or
+ *   streams, for a single client on the smallest parts.
+ * WOLFHSM_PROFILE_SHE: Key cache sized for 16 byte SHE keys, no batches or
+ *   streams.
+ * WOLFHSM_PROFILE_FULL: The defaults, also used when no profile is defined.
+ *
+ * The key structs held by the server crypto context follow the algorithms
+ * enabled in wolfCrypt, so a SHE only image should also disable RSA, ECC,
+ * Curve25519 and Ed25519 in its user_settings.h. Changing
+ * WOLFHSM_NUM_NVMOBJECTS changes the NVM flash layout.
+ *
+ * The sizes of the resulting contexts are reported by "make sizes" in test.
+ */
+#if defined(WOLFHSM_PROFILE_MINIMAL)
+#ifndef WOLFHSM_NUM_RAMKEYS
+#define WOLFHSM_NUM_RAMKEYS 4
+#endif
+#ifndef WOLFHSM_NUM_NVMOBJECTS
+#define WOLFHSM_NUM_NVMOBJECTS 16
+#endif
+#ifndef WOLFHSM_KEYCACHE_BUFSIZE
+#define WOLFHSM_KEYCACHE_BUFSIZE 256
+#endif
+#ifndef WOLFHSM_KEYCACHE_SMALL_COUNT
+#define WOLFHSM_KEYCACHE_SMALL_COUNT 2
+#endif
+#ifndef WOLFHSM_KEYCACHE_BIG_COUNT
+#define WOLFHSM_KEYCACHE_BIG_COUNT 0
+#endif
+#ifndef WH_CUSTOM_CB_NUM_CALLBACKS
+#define WH_CUSTOM_CB_NUM_CALLBACKS 1
+#endif
+#ifndef WH_SERVER_KEYID_MAP_COUNT
+#define WH_SERVER_KEYID_MAP_COUNT 1
+#endif
+#ifndef WH_SERVER_STREAM_COUNT
+#define WH_SERVER_STREAM_COUNT 0
+#endif
+#ifndef WH_DMA_ADDR_ALLOWLIST_COUNT
+#define WH_DMA_ADDR_ALLOWLIST_COUNT 4
+#endif
+#ifndef WOLFHSM_NO_BATCH
+#define WOLFHSM_NO_BATCH
+#endif
+#elif defined(WOLFHSM_PROFILE_SHE)
+#ifndef WOLFHSM_NUM_RAMKEYS
+#define WOLFHSM_NUM_RAMKEYS 8
+#endif
+#ifndef WOLFHSM_KEYCACHE_BUFSIZE
+#define WOLFHSM_KEYCACHE_BUFSIZE 32
+#endif
+#ifndef WOLFHSM_KEYCACHE_SMALL_COUNT
+#define WOLFHSM_KEYCACHE_SMALL_COUNT 0
+#endif
+#ifndef WOLFHSM_KEYCACHE_BIG_COUNT
+#define WOLFHSM_KEYCACHE_BIG_COUNT 0
+#endif
+#ifndef WH_CUSTOM_CB_NUM_CALLBACKS
+#define WH_CUSTOM_CB_NUM_CALLBACKS 2
+#endif
+#ifndef WH_SERVER_KEYID_MAP_COUNT
+#define WH_SERVER_KEYID_MAP_COUNT 1
+#endif
+#ifndef WH_SERVER_STREAM_COUNT
+#define WH_SERVER_STREAM_COUNT 0
+#endif
+#ifndef WOLFHSM_NO_BATCH
+#define WOLFHSM_NO_BATCH
+#endif
+#endif /* WOLFHSM_PROFILE_* */
+
 /** Resource allocations */
-enum {
-    WOLFHSM_NUM_COUNTERS = 8,       /* Number of non-volatile 32-bit counters */
-    WOLFHSM_NUM_RAMKEYS = 16,        /* Number of RAM keys */
-    WOLFHSM_NUM_NVMOBJECTS = 32,    /* Number of NVM objects in the directory */
-    WOLFHSM_NUM_MANIFESTS = 8,      /* Number of compiletime manifests */
-    WOLFHSM_KEYCACHE_BUFSIZE = 1200, /* Size in bytes of key cache buffer  */
-};
+#ifndef WOLFHSM_NUM_COUNTERS
+#define WOLFHSM_NUM_COUNTERS 8          /* Number of non-volatile 32-bit
+                                         * counters */
+#endif
+#ifndef WOLFHSM_NUM_RAMKEYS
+#define WOLFHSM_NUM_RAMKEYS 16          /* Number of RAM keys */
+#endif
+#ifndef WOLFHSM_NUM_NVMOBJECTS
+#define WOLFHSM_NUM_NVMOBJECTS 32       /* Number of NVM objects in the
+                                         * directory */
+#endif
+#ifndef WOLFHSM_NUM_MANIFESTS
+#define WOLFHSM_NUM_MANIFESTS 8         /* Number of compiletime manifests */
+#endif
+#ifndef WOLFHSM_KEYCACHE_BUFSIZE
+#define WOLFHSM_KEYCACHE_BUFSIZE 1200   /* Size in bytes of key cache buffer */
+#endif
+#ifndef WOLFHSM_KEYCACHE_SMALL_COUNT
+#define WOLFHSM_KEYCACHE_SMALL_COUNT 8  /* RAM keys limited to the small size */
+#endif
+#ifndef WOLFHSM_KEYCACHE_SMALL_BUFSIZE
+#define WOLFHSM_KEYCACHE_SMALL_BUFSIZE 128 /* Size in bytes of small buffers */
+#endif
+#ifndef WOLFHSM_KEYCACHE_BIG_COUNT
+#define WOLFHSM_KEYCACHE_BIG_COUNT 1    /* RAM keys given the big size */
+#endif
+#ifndef WOLFHSM_KEYCACHE_BIG_BUFSIZE
+#define WOLFHSM_KEYCACHE_BIG_BUFSIZE 4096 /* Size in bytes of big buffers, for
+                                           * keys loaded over DMA */
+#endif
+#if (WOLFHSM_KEYCACHE_SMALL_COUNT + WOLFHSM_KEYCACHE_BIG_COUNT) > \
+    WOLFHSM_NUM_RAMKEYS
+#error "WOLFHSM_KEYCACHE_SMALL_COUNT + _BIG_COUNT exceeds WOLFHSM_NUM_RAMKEYS"
+#endif
+/* Buckets of the key cache id index, kept at least half empty */
+#define WOLFHSM_KEYCACHE_INDEX_SIZE (2 * WOLFHSM_NUM_RAMKEYS)
 
 
 /** Non-volatile counters */
@@ -104,6 +210,13 @@ enum {
 #define WOLFHSM_NVM_ACCESS_ANY (0xFFFF)
 #define WOLFHSM_NVM_FLAGS_ANY (0xFFFF)
 
+/* Object flags */
+#define WOLFHSM_NVM_FLAGS_NONE   (0x0000)
+#define WOLFHSM_NVM_FLAGS_PINNED (0x0001) /* Key is never evicted from the
+                                           * cache to make room */
+#define WOLFHSM_NVM_FLAGS_PREFETCH (0x0002) /* Key is loaded into the cache
+                                             * by wh_Server_Init */
+
 /* User-specified metadata for an NVM object, MUST be a multiple of
  * WHFU_BYTES_PER_UNIT */
 typedef struct {
@@ -116,8 +229,29 @@ typedef struct {
 /* static_assert(sizeof(whNvmMetadata) == WOLFHSM_NVM_METADATA_LEN) */
 
 
-/* Custom request shared defs */
+/** Scatter-gather DMA */
+
+/* Maximum number of client memory regions in one request */
+#ifndef WH_DMA_MAX_SEGMENTS
+#define WH_DMA_MAX_SEGMENTS 8
+#endif
+
+/* One client memory region of a scatter-gather DMA request */
+typedef struct {
+    uint64_t addr;          /* Client address of the region */
+    uint32_t len;           /* Bytes in the region */
+    uint8_t  padding[4];
+} whDmaSegment;
+
+
+/* Custom request shared defs. Callbacks are indexed by the message action, so
+ * at most 256 can be registered */
+#ifndef WH_CUSTOM_CB_NUM_CALLBACKS
 #define WH_CUSTOM_CB_NUM_CALLBACKS 8
+#endif
+#if (WH_CUSTOM_CB_NUM_CALLBACKS < 1) || (WH_CUSTOM_CB_NUM_CALLBACKS > 256)
+#error "WH_CUSTOM_CB_NUM_CALLBACKS must be between 1 and 256"
+#endif
 
 #ifdef WOLFHSM_SHE_EXTENSION
 #define WOLFHSM_SHE_SECRET_KEY_ID 0
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_counter.h
+ *
+ * Non-volatile 32-bit counters kept in a small log on a whFlash area, separate
+ * from NVM objects.  Every change to a counter programs a single unit holding
+ * its id and new value, so an increment never rewrites metadata or data.
+ *
+ * The area is split into two equal halves, each a whole number of erase
+ * sectors.  The active half starts with a header unit holding its epoch and is
+ * followed by the records in the order they were written.  When it fills, the
+ * current value of every counter is written to the other half, its header is
+ * programmed last to commit it, and the old half is erased.  A mount uses the
+ * committed half with the larger epoch and replays its records.
+ */
+
+#ifndef WOLFHSM_WH_COUNTER_H_
+#define WOLFHSM_WH_COUNTER_H_
+
+#include <stdint.h>
+
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_flash.h"
+
+/* Number of counters that can exist at once */
+#ifndef WH_COUNTER_COUNT
+#define WH_COUNTER_COUNT WOLFHSM_NUM_COUNTERS
+#endif
+
+/* In-memory value of a counter */
+typedef struct {
+    uint32_t    value;
+    whCounterId id;
+    uint16_t    used;       /* Nonzero when the entry holds a counter */
+} whCounterEntry;
+
+/* In memory configuration structure associated with a counter store */
+typedef struct whCounterConfig_t {
+    const whFlashCb* cb;    /* whFlash callback */
+    void* context;          /* whFlash context to be passed to cb */
+    const void* config;     /* Config for cb->Init. NULL if already initialized,
+                             * e.g. when sharing the flash with NVM */
+    uint32_t offset;        /* Byte offset of the area in the flash */
+    uint32_t size;          /* Bytes in the area. Two halves of whole sectors */
+} whCounterConfig;
+
+typedef struct whCounterContext_t {
+    const whFlashCb* cb;            /* Flash callbacks */
+    void* flash;                    /* Flash context to use */
+    whCounterEntry counters[WH_COUNTER_COUNT];
+    uint32_t offset;                /* Unit offset of the first half */
+    uint32_t half_units;            /* Size of each half in units */
+    uint32_t epoch;                 /* Epoch of the active half */
+    uint32_t next_unit;             /* Next free unit in the active half */
+    int active;                     /* Which half (0 or 1) is active */
+    int initialized;
+} whCounterContext;
+
+int wh_Counter_Init(whCounterContext* context, const whCounterConfig* config);
+int wh_Counter_Cleanup(whCounterContext* context);
+
+/* Create the counter if needed and set its value */
+int wh_Counter_Set(whCounterContext* context, whCounterId id, uint32_t value);
+
+/* Add one to the counter, saturating at UINT32_MAX, and return the new value */
+int wh_Counter_Increment(whCounterContext* context, whCounterId id,
+        uint32_t* out_value);
+
+int wh_Counter_Read(whCounterContext* context, whCounterId id,
+        uint32_t* out_value);
+
+int wh_Counter_Destroy(whCounterContext* context, whCounterId id);
+
+#endif /* WOLFHSM_WH_COUNTER_H_ */
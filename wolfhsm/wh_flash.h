@@ -28,6 +28,13 @@
 
 #include <stdint.h>
 
+/* One piece of a vectored program */
+typedef struct {
+    const uint8_t* data;
+    uint32_t offset;
+    uint32_t size;
+} whFlashSegment;
+
 typedef struct {
     int (*Init)(void* context,const void* config);
     int (*Cleanup)(void* context);
@@ -50,6 +57,30 @@ typedef struct {
             uint32_t offset, uint32_t size, const uint8_t* data);
     int (*BlankCheck)(void* context,
             uint32_t offset, uint32_t size);
+
+    /* Optional. Program size bytes at dst_offset with the data at src_offset,
+     * e.g. using a DMA engine, and verify them.  The destination is blank
+     * checked before.  NULL copies through Read and Program instead */
+    int (*Copy)(void* context,
+            uint32_t src_offset, uint32_t dst_offset, uint32_t size);
+
+    /* Optional. Start an Erase or Program with the same arguments and return
+     * without waiting for it to complete.  The data of a Program must stay
+     * valid until then.  Poll returns WH_ERROR_NOTREADY while the operation is
+     * in progress and then its result, or 0 when nothing was started.  Other
+     * callbacks may be used on the rest of the flash meanwhile.  NULL waits in
+     * Erase and Program instead */
+    int (*EraseStart)(void* context,
+            uint32_t offset, uint32_t size);
+    int (*ProgramStart)(void* context,
+            uint32_t offset, uint32_t size, const uint8_t* data);
+    int (*Poll)(void* context);
+
+    /* Optional. Program count segments in order, as Program would for each
+     * of them.  Segments that are adjacent may be merged into fewer, larger
+     * programs.  NULL programs each segment with Program instead */
+    int (*ProgramV)(void* context,
+            const whFlashSegment* segments, uint32_t count);
 } whFlashCb;
 
 #endif /* WOLFHSM_WH_FLASH_H_ */
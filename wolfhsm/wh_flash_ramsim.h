@@ -21,21 +21,57 @@
 
 #include <stdint.h>
 
+#include "wolfhsm/wh_flash.h"
+
+/* Bytes in a word for the read time model */
+#define WH_FLASH_RAMSIM_WORD_SIZE 4
+
 /* Configuration and context structures */
 typedef struct {
     uint32_t size;
     uint32_t sectorSize;
     uint32_t pageSize;
+    uint32_t busyPolls; /* Polls a started erase or program stays busy for */
+    /* Simulated operation times, in ns, added to the elapsed stat. 0 for none */
+    uint32_t pageProgramTime;
+    uint32_t sectorEraseTime;
+    uint32_t wordReadTime;
     uint8_t  erasedByte;
     uint8_t padding[3];
 } whFlashRamsimCfg;
 
+/* Operation counters.  Verify, BlankCheck and the source of a Copy count as
+ * reads */
+typedef struct {
+    uint64_t elapsed;       /* Simulated time in ns */
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t bytesErased;
+    uint32_t reads;
+    uint32_t programs;      /* Program and Copy calls that wrote */
+    uint32_t erases;        /* Erase calls that erased */
+    uint32_t sectorCount;
+    uint32_t minSectorErases;   /* Erases of the least erased sector */
+    uint32_t maxSectorErases;   /* Erases of the most erased sector */
+} whFlashRamsimStats;
+
 typedef struct {
     uint8_t* memory;
+    const uint8_t* pendingData;
+    uint32_t* sectorErases;     /* Erase count of each sector */
     uint32_t size;
     uint32_t sectorSize;
     uint32_t pageSize;
+    uint32_t busyPolls;
+    uint32_t pageProgramTime;
+    uint32_t sectorEraseTime;
+    uint32_t wordReadTime;
+    uint32_t pendingOffset;
+    uint32_t pendingSize;
+    uint32_t pendingPolls;
+    int      pendingOp;
     int      writeLocked;
+    whFlashRamsimStats stats;
     uint8_t  erasedByte;
     uint8_t padding[7];
 } whFlashRamsimCtx;
@@ -55,6 +91,22 @@ int whFlashRamsim_BlankCheck(void* context, uint32_t offset, uint32_t size);
 uint32_t whFlashRamsim_PartitionSize(void* context);
 int whFlashRamsim_WriteLock(void* context, uint32_t offset, uint32_t size);
 int whFlashRamsim_WriteUnlock(void* context, uint32_t offset, uint32_t size);
+int whFlashRamsim_Copy(void* context, uint32_t src_offset, uint32_t dst_offset,
+                       uint32_t size);
+int whFlashRamsim_EraseStart(void* context, uint32_t offset, uint32_t size);
+int whFlashRamsim_ProgramStart(void* context, uint32_t offset, uint32_t size,
+                               const uint8_t* data);
+int whFlashRamsim_Poll(void* context);
+/* Adjacent segments count as a single program */
+int whFlashRamsim_ProgramV(void* context, const whFlashSegment* segments,
+                           uint32_t count);
+
+/* Operation counters since Init or the last ResetStats */
+int whFlashRamsim_GetStats(void* context, whFlashRamsimStats* out_stats);
+/* Clear the counters, including the per-sector erase counts */
+int whFlashRamsim_ResetStats(void* context);
+int whFlashRamsim_GetSectorErases(void* context, uint32_t sector,
+                                  uint32_t* out_count);
 
 /* clang-format off */
 #define WH_FLASH_RAMSIM_CB                           \
@@ -69,6 +121,11 @@ int whFlashRamsim_WriteUnlock(void* context, uint32_t offset, uint32_t size);
         .Erase         = whFlashRamsim_Erase,         \
         .Verify        = whFlashRamsim_Verify,        \
         .BlankCheck    = whFlashRamsim_BlankCheck,    \
+        .Copy          = whFlashRamsim_Copy,          \
+        .EraseStart    = whFlashRamsim_EraseStart,    \
+        .ProgramStart  = whFlashRamsim_ProgramStart,  \
+        .Poll          = whFlashRamsim_Poll,          \
+        .ProgramV      = whFlashRamsim_ProgramV,      \
     }
 /* clang-format on */
 
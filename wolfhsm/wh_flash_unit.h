@@ -52,6 +52,18 @@ typedef union {
     uint8_t bytes[WHFU_BYTES_PER_UNIT];
 } whFlashUnitBuffer;
 
+/* One piece of a vectored program, in units */
+typedef struct {
+    const whFlashUnit* data;
+    uint32_t offset;
+    uint32_t count;
+} whFlashUnitSegment;
+
+/* Most segments accepted by wh_FlashUnit_ProgramV */
+#ifndef WHFU_PROGRAMV_MAX_SEGMENTS
+#define WHFU_PROGRAMV_MAX_SEGMENTS 8
+#endif
+
 /* Compute the number of units necessary to hold bytes, rounding up */
 uint32_t wh_FlashUnit_Bytes2Units(uint32_t bytes);
 
@@ -69,12 +81,32 @@ int wh_FlashUnit_Read(const whFlashCb* cb, void* context, uint32_t offset,
 int wh_FlashUnit_Program(const whFlashCb* cb, void* context, uint32_t offset,
         uint32_t count, const whFlashUnit* data);
 
+/* Program count segments in order.  Every segment is blank checked before
+ * and verified after, and the ProgramV callback is used when present */
+int wh_FlashUnit_ProgramV(const whFlashCb* cb, void* context,
+        const whFlashUnitSegment* segments, uint32_t count);
+
 int wh_FlashUnit_BlankCheck(const whFlashCb* cb, void* context, uint32_t offset,
         uint32_t count);
 
 int wh_FlashUnit_Erase(const whFlashCb* cb, void* context, uint32_t offset,
         uint32_t count);
 
+/* Program count units at dst_offset with the units at src_offset, using the
+ * Copy callback when present */
+int wh_FlashUnit_Copy(const whFlashCb* cb, void* context, uint32_t src_offset,
+        uint32_t dst_offset, uint32_t count);
+
+/* Start erasing count units at offset with the EraseStart callback.  Returns
+ * WH_ERROR_NOTREADY until wh_FlashUnit_Poll returns the result of the erase,
+ * or erases synchronously if EraseStart or Poll is NULL */
+int wh_FlashUnit_EraseStart(const whFlashCb* cb, void* context,
+        uint32_t offset, uint32_t count);
+
+/* Returns WH_ERROR_NOTREADY while a started operation is in progress, then its
+ * result.  Does not blank check after an erase. */
+int wh_FlashUnit_Poll(const whFlashCb* cb, void* context);
+
 /** Helper functions to use buffered reads and writes for bytes */
 
 int wh_FlashUnit_ReadBytes(const whFlashCb* cb, void* context, uint32_t byte_offset,
@@ -83,4 +115,11 @@ int wh_FlashUnit_ReadBytes(const whFlashCb* cb, void* context, uint32_t byte_off
 int wh_FlashUnit_ProgramBytes(const whFlashCb* cb, void* context, uint32_t byte_offset,
         uint32_t byte_count, const uint8_t* data);
 
+/* Fill out_segments with up to 2 segments programming byte_count bytes of data
+ * at the aligned byte_offset.  A partial final unit is copied to tail, filled
+ * with 0.  Returns the number of segments used */
+uint32_t wh_FlashUnit_BytesSegments(uint32_t byte_offset, uint32_t byte_count,
+        const uint8_t* data, whFlashUnitBuffer* tail,
+        whFlashUnitSegment* out_segments);
+
 #endif /* WOLFHSM_WH_FLASH_UNIT_H_ */
@@ -39,6 +39,8 @@ enum {
     WH_MESSAGE_GROUP_IMAGE          = 0x0500, /* Image/boot management */
     WH_MESSAGE_GROUP_PKCS11         = 0x0600, /* PKCS11 protocol */
     WH_MESSAGE_GROUP_SHE            = 0x0700, /* SHE protocol */
+    WH_MESSAGE_GROUP_BATCH          = 0x0800, /* Batched sub-requests */
+    WH_MESSAGE_GROUP_COUNTER        = 0x0900, /* Non-volatile counters */
     WH_MESSAGE_GROUP_CUSTOM         = 0x1000, /* User-specified features */
 
     WH_MESSAGE_ACTION_MASK         = 0x00FF,  /* 255 subtypes per group*/
@@ -52,6 +54,23 @@ enum {
     WH_KEY_EXPORT,
     WH_KEY_COMMIT,
     WH_KEY_ERASE,
+    WH_KEY_RSA_KEYGEN_START,    /* Queue an RSA keygen job */
+    WH_KEY_JOB_STATUS,          /* Poll a keygen job */
+    WH_KEY_CACHE_DMA,           /* Cache a key read from client memory */
+    WH_KEY_EXPORT_DMA,          /* Export a key to client memory */
+    WH_KEY_EXPORT_PUBLIC,       /* Export the public part of a key */
+    WH_KEY_GENERATION,          /* Read the key generation */
+};
+
+/* crypto actions, other than the wolfCrypt algo types */
+enum {
+    WH_CRYPTO_CIPHER_STREAM_INIT   = 0xF0, /* Open a server side AES stream */
+    WH_CRYPTO_CIPHER_STREAM_UPDATE = 0xF1, /* Process the next chunk */
+    WH_CRYPTO_CIPHER_STREAM_FINAL  = 0xF2, /* Finish and close the stream */
+    WH_CRYPTO_CIPHER_DMA           = 0xF3, /* AES on client memory */
+    WH_CRYPTO_HASH_DMA             = 0xF4, /* Hash of client memory */
+    WH_CRYPTO_ECDSA_VERIFY_BATCH   = 0xF5, /* Several ECDSA verifies */
+    WH_CRYPTO_HASH_STREAM_COPY     = 0xF6, /* Open a copy of a hash stream */
 };
 
 /* SHE actions */
@@ -73,6 +92,12 @@ enum {
     WH_SHE_DEC_CBC,
     WH_SHE_GEN_MAC,
     WH_SHE_VERIFY_MAC,
+    WH_SHE_SECURE_BOOT_DMA,
+    WH_SHE_ENC_ECB_DMA,
+    WH_SHE_ENC_CBC_DMA,
+    WH_SHE_DEC_ECB_DMA,
+    WH_SHE_DEC_CBC_DMA,
+    WH_SHE_LOAD_KEY_BATCH,
 };
 
 /* Construct the message kind based on group and action */
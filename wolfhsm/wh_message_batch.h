@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_message_batch.h
+ *
+ * Batch messages carry several sub-requests in a single packet and return the
+ * matching sub-responses in a single packet, saving a transport round trip
+ * per small request.
+ *
+ * The data of a batch request or response is a whMessageBatch_Header followed
+ * by count entries.  Each entry is a whMessageBatch_Entry followed by size
+ * bytes of sub-message data, padded to the next WH_MESSAGE_BATCH_ALIGN
+ * boundary so every sub-message keeps the alignment of a full packet.
+ */
+
+#ifndef WOLFHSM_WH_MESSAGE_BATCH_H_
+#define WOLFHSM_WH_MESSAGE_BATCH_H_
+
+#include <stdint.h>
+#include "wolfhsm/wh_comm.h"
+
+enum {
+    WH_MESSAGE_BATCH_ACTION_REQUEST = 0x1,
+};
+
+enum {
+    WH_MESSAGE_BATCH_ALIGN = 8,
+    WH_MESSAGE_BATCH_U64_COUNT = (WH_COMM_DATA_LEN + 7) / 8,
+};
+
+/* Round a sub-message size up to the entry alignment */
+#define WH_MESSAGE_BATCH_PADDED(_size)                                         \
+    (((_size) + (WH_MESSAGE_BATCH_ALIGN - 1)) &                                \
+     ~(uint32_t)(WH_MESSAGE_BATCH_ALIGN - 1))
+
+typedef struct {
+    uint16_t count;     /* Number of entries that follow */
+    uint8_t  pad[6];
+} whMessageBatch_Header;
+
+typedef struct {
+    uint16_t kind;      /* Sub-message group and action */
+    uint16_t size;      /* Size of the sub-message data */
+    int32_t  rc;        /* Sub-request handler result. Zero in requests */
+} whMessageBatch_Entry;
+
+int wh_MessageBatch_TranslateHeader(uint16_t magic,
+        const whMessageBatch_Header* src,
+        whMessageBatch_Header* dest);
+
+int wh_MessageBatch_TranslateEntry(uint16_t magic,
+        const whMessageBatch_Entry* src,
+        whMessageBatch_Entry* dest);
+
+#endif /* WOLFHSM_WH_MESSAGE_BATCH_H_ */
@@ -36,6 +36,7 @@ enum {
     WH_MESSAGE_COMM_ACTION_CLOSE     = 0x03,
     WH_MESSAGE_COMM_ACTION_INFO      = 0x04,
     WH_MESSAGE_COMM_ACTION_ECHO      = 0x05,
+    WH_MESSAGE_COMM_ACTION_STATS     = 0x06,
 };
 
 
@@ -61,6 +62,7 @@ int wh_MessageComm_TranslateLenData(uint16_t magic,
 
 typedef struct {
     uint32_t client_id;
+    uint32_t max_data_len;  /* Largest data size the client can handle */
 } whMessageCommInitRequest;
 
 int wh_MessageComm_TranslateInitRequest(uint16_t magic,
@@ -71,6 +73,7 @@ int wh_MessageComm_TranslateInitRequest(uint16_t magic,
 typedef struct {
     uint32_t client_id;
     uint32_t server_id;
+    uint32_t max_data_len;  /* Negotiated data size used by both sides */
 } whMessageCommInitResponse;
 
 int wh_MessageComm_TranslateInitResponse(uint16_t magic,
@@ -94,4 +97,47 @@ typedef struct {
     uint8_t nvm_state;
 } whMessageCommInfo;
 
+/* Server request statistics */
+enum {
+    WH_MESSAGE_COMM_STATS_BINS  = 8,    /* Handling time histogram bins */
+    WH_MESSAGE_COMM_STATS_RESET = 0x1,  /* Clear all entries after reading */
+};
+
+typedef struct {
+    uint16_t index;         /* Entry to read */
+    uint16_t flags;
+} whMessageCommStatsRequest;
+
+int wh_MessageComm_TranslateStatsRequest(uint16_t magic,
+        const whMessageCommStatsRequest* src,
+        whMessageCommStatsRequest* dest);
+
+/* Counters of one message kind.  Times are in the units of the server's time
+ * callback, usually microseconds.  Bin i of hist counts handling times below
+ * 4^(i+1) and the last bin counts the rest.  Kind WH_MESSAGE_KIND_NONE
+ * collects the kinds that did not fit in the table */
+typedef struct {
+    uint64_t total_time;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint32_t count;
+    uint32_t errors;
+    uint32_t min_time;
+    uint32_t max_time;
+    uint32_t hist[WH_MESSAGE_COMM_STATS_BINS];
+    uint16_t kind;
+    uint8_t  padding[6];
+} whMessageCommStatsEntry;
+
+typedef struct {
+    int32_t  rc;            /* WH_ERROR_NOTFOUND past the last entry */
+    uint16_t entry_count;   /* Number of entries in use */
+    uint8_t  padding[2];
+    whMessageCommStatsEntry entry;
+} whMessageCommStatsResponse;
+
+int wh_MessageComm_TranslateStatsResponse(uint16_t magic,
+        const whMessageCommStatsResponse* src,
+        whMessageCommStatsResponse* dest);
+
 #endif /* WOLFHSM_WH_MESSAGE_COMM_H_ */
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_message_counter.h
+ *
+ * Messages of the non-volatile counter group.  Every action uses the same
+ * request and response.
+ */
+
+#ifndef WOLFHSM_WH_MESSAGE_COUNTER_H_
+#define WOLFHSM_WH_MESSAGE_COUNTER_H_
+
+#include <stdint.h>
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message.h"
+
+enum {
+    WH_MESSAGE_COUNTER_ACTION_INIT          = 0x1,
+    WH_MESSAGE_COUNTER_ACTION_INCREMENT     = 0x2,
+    WH_MESSAGE_COUNTER_ACTION_READ          = 0x3,
+    WH_MESSAGE_COUNTER_ACTION_DESTROY       = 0x4,
+};
+
+/** Counter Request */
+typedef struct {
+    uint32_t value;     /* Initial value for INIT, otherwise zero */
+    uint16_t id;
+    uint8_t  padding[2];
+} whMessageCounter_Request;
+
+int wh_MessageCounter_TranslateRequest(uint16_t magic,
+        const whMessageCounter_Request* src,
+        whMessageCounter_Request* dest);
+
+/** Counter Response */
+typedef struct {
+    int32_t  rc;
+    uint32_t value;     /* Value after the action, zero after DESTROY */
+} whMessageCounter_Response;
+
+int wh_MessageCounter_TranslateResponse(uint16_t magic,
+        const whMessageCounter_Response* src,
+        whMessageCounter_Response* dest);
+
+#endif /* WOLFHSM_WH_MESSAGE_COUNTER_H_ */
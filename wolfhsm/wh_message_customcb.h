@@ -21,6 +21,8 @@
 
 #include <stdint.h>
 
+#include "wolfhsm/wh_comm.h"
+
 #define WH_MESSAGE_CUSTOM_CB_BUF_SIZE (256)
 
 /* Type indicator for custom request/response messages. Indicates how
@@ -30,7 +32,7 @@ typedef enum {
     WH_MESSAGE_CUSTOM_CB_TYPE_QUERY      = 0,
     WH_MESSAGE_CUSTOM_CB_TYPE_DMA32      = 1,
     WH_MESSAGE_CUSTOM_CB_TYPE_DMA64      = 2,
-    WH_MESSAGE_CUSTOM_CB_TYPE_RESERVED_3 = 3,
+    WH_MESSAGE_CUSTOM_CB_TYPE_BULK       = 3,
     WH_MESSAGE_CUSTOM_CB_TYPE_RESERVED_4 = 4,
     WH_MESSAGE_CUSTOM_CB_TYPE_RESERVED_5 = 5,
     WH_MESSAGE_CUSTOM_CB_TYPE_RESERVED_6 = 6,
@@ -80,6 +82,23 @@ typedef struct {
 } whMessageCustomCb_Response;
 
 
+/* Header of a bulk custom request or response. The untranslated payload
+ * follows it and fills the rest of the comm data buffer, so unlike the fixed
+ * messages above the message size varies with the payload. The response uses
+ * the same layout, so a handler may process the payload in place. rc and err
+ * are unused in requests */
+typedef struct {
+    uint32_t id;   /* indentifier of registered callback  */
+    uint32_t type; /* WH_MESSAGE_CUSTOM_CB_TYPE_BULK */
+    int32_t  rc;   /* Return code from custom callback. Invalid if err != 0 */
+    int32_t  err;  /* wolfHSM-specific error. If err != 0, rc is invalid */
+} whMessageCustomCb_BulkHeader;
+
+/* Largest bulk payload in either direction */
+#define WH_MESSAGE_CUSTOM_CB_BULK_MAX_LEN \
+    (WH_COMM_DATA_LEN - sizeof(whMessageCustomCb_BulkHeader))
+
+
 /* Translates a custom request message. The whMessageCustomCb_Request.data field
  * will not be translated for whMessageCustomCb_Request.type values greater than
  * WH_MESSAGE_CUSTOM_CB_TYPE_USER_DEFINED_START */
@@ -94,4 +113,10 @@ int wh_MessageCustomCb_TranslateResponse(uint16_t magic,
                                          const whMessageCustomCb_Response* src,
                                          whMessageCustomCb_Response*       dst);
 
+/* Translates the header of a bulk custom request or response. The payload is
+ * never translated */
+int wh_MessageCustomCb_TranslateBulkHeader(
+    uint16_t magic, const whMessageCustomCb_BulkHeader* src,
+    whMessageCustomCb_BulkHeader* dst);
+
 #endif /* WH_MESSAGE_CUSTOM_CB_H_*/
\ No newline at end of file
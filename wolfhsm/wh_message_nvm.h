@@ -39,10 +39,16 @@ enum {
     WH_MESSAGE_NVM_ACTION_GETMETADATA       = 0x6,
     WH_MESSAGE_NVM_ACTION_DESTROYOBJECTS    = 0x7,
     WH_MESSAGE_NVM_ACTION_READ              = 0x8,
+    WH_MESSAGE_NVM_ACTION_ADDOBJECTBEGIN    = 0x9,
+    WH_MESSAGE_NVM_ACTION_ADDOBJECTAPPEND   = 0xA,
+    WH_MESSAGE_NVM_ACTION_ADDOBJECTCOMMIT   = 0xB,
+    WH_MESSAGE_NVM_ACTION_LISTMETADATA      = 0xC,
     WH_MESSAGE_NVM_ACTION_ADDOBJECTDMA32    = 0x14,
     WH_MESSAGE_NVM_ACTION_READDMA32         = 0x18,
     WH_MESSAGE_NVM_ACTION_ADDOBJECTDMA64    = 0x24,
     WH_MESSAGE_NVM_ACTION_READDMA64         = 0x28,
+    WH_MESSAGE_NVM_ACTION_ADDOBJECTDMASG    = 0x34,
+    WH_MESSAGE_NVM_ACTION_READDMASG         = 0x38,
 };
 
 enum {
@@ -51,11 +57,13 @@ enum {
     WH_MESSAGE_NVM_MAX_ADD_OBJECT_LEN =
             WH_COMM_DATA_LEN - WOLFHSM_NVM_METADATA_LEN,
     WH_MESSAGE_NVM_MAX_READ_LEN = WH_COMM_DATA_LEN - sizeof(int32_t),
+    WH_MESSAGE_NVM_MAX_APPEND_LEN = WH_COMM_DATA_LEN - sizeof(uint16_t),
 };
 
 /* Simple reusable response message */
 typedef struct {
     int32_t rc;
+    uint32_t generation;    /* NVM generation after the request */
 } whMessageNvm_SimpleResponse;
 
 int wh_MessageNvm_TranslateSimpleResponse(uint16_t magic,
@@ -121,6 +129,31 @@ int wh_MessageNvm_TranslateAddObjectRequest(uint16_t magic,
 /** NVM AddObject Response */
 /* Use SimpleResponse */
 
+/** NVM AddObjectBegin Request */
+/* Use AddObjectRequest with len set to the total length and no data */
+
+/** NVM AddObjectBegin Response */
+/* Use SimpleResponse */
+
+/** NVM AddObjectAppend Request */
+typedef struct {
+    uint16_t data_len;
+    /* Data up to WH_MESSAGE_NVM_MAX_APPEND_LEN follows */
+} whMessageNvm_AddObjectAppendRequest;
+
+int wh_MessageNvm_TranslateAddObjectAppendRequest(uint16_t magic,
+        const whMessageNvm_AddObjectAppendRequest* src,
+        whMessageNvm_AddObjectAppendRequest* dest);
+
+/** NVM AddObjectAppend Response */
+/* Use SimpleResponse */
+
+/** NVM AddObjectCommit Request */
+/* Empty message */
+
+/** NVM AddObjectCommit Response */
+/* Use SimpleResponse */
+
 /** NVM List Request */
 typedef struct {
     uint16_t access;
@@ -137,12 +170,56 @@ typedef struct {
     int32_t rc;
     uint16_t count;
     uint16_t id;
+    uint32_t generation;
 } whMessageNvm_ListResponse;
 
 int wh_MessageNvm_TranslateListResponse(uint16_t magic,
         const whMessageNvm_ListResponse* src,
         whMessageNvm_ListResponse* dest);
 
+/** NVM ListMetadata Request */
+typedef struct {
+    uint16_t access;
+    uint16_t flags;
+    uint16_t startId;
+    uint16_t max_count;
+} whMessageNvm_ListMetadataRequest;
+
+int wh_MessageNvm_TranslateListMetadataRequest(uint16_t magic,
+        const whMessageNvm_ListMetadataRequest* src,
+        whMessageNvm_ListMetadataRequest* dest);
+
+/** NVM ListMetadata Response */
+typedef struct {
+    int32_t rc;
+    uint16_t count;     /* Matches left after the last entry */
+    uint16_t returned;  /* Entries that follow */
+    uint32_t generation;
+    /* Entries up to WH_MESSAGE_NVM_MAX_LIST_METADATA_COUNT follow */
+} whMessageNvm_ListMetadataResponse;
+
+typedef struct {
+    uint16_t id;
+    uint16_t access;
+    uint16_t flags;
+    uint16_t len;
+    uint8_t label[WOLFHSM_NVM_LABEL_LEN];
+} whMessageNvm_ListMetadataEntry;
+
+enum {
+    WH_MESSAGE_NVM_MAX_LIST_METADATA_COUNT =
+            (WH_COMM_DATA_LEN - sizeof(whMessageNvm_ListMetadataResponse)) /
+            sizeof(whMessageNvm_ListMetadataEntry),
+};
+
+int wh_MessageNvm_TranslateListMetadataResponse(uint16_t magic,
+        const whMessageNvm_ListMetadataResponse* src,
+        whMessageNvm_ListMetadataResponse* dest);
+
+int wh_MessageNvm_TranslateListMetadataEntry(uint16_t magic,
+        const whMessageNvm_ListMetadataEntry* src,
+        whMessageNvm_ListMetadataEntry* dest);
+
 /** NVM GetMetadata Request */
 typedef struct {
     uint16_t id;
@@ -160,6 +237,7 @@ typedef struct {
     uint16_t flags;
     uint16_t len;
     uint8_t label[WOLFHSM_NVM_LABEL_LEN];
+    uint32_t generation;
 } whMessageNvm_GetMetadataResponse;
 
 int wh_MessageNvm_TranslateGetMetadataResponse(uint16_t magic,
@@ -262,4 +340,37 @@ int wh_MessageNvm_TranslateReadDma64Request(uint16_t magic,
 /** NVM ReadDma64 Response */
 /* Use SimpleResponse */
 
+/** NVM AddObjectDmaSg Request */
+typedef struct {
+    uint64_t metadata_hostaddr;
+    uint16_t seg_count;
+    uint8_t addr64;     /* Nonzero when client addresses are 64-bit */
+    uint8_t padding[5];
+    whDmaSegment segs[WH_DMA_MAX_SEGMENTS]; /* Gathered in order */
+} whMessageNvm_AddObjectDmaSgRequest;
+
+int wh_MessageNvm_TranslateAddObjectDmaSgRequest(uint16_t magic,
+        const whMessageNvm_AddObjectDmaSgRequest* src,
+        whMessageNvm_AddObjectDmaSgRequest* dest);
+
+/** NVM AddObjectDmaSg Response */
+/* Use SimpleResponse */
+
+/** NVM ReadDmaSg Request */
+typedef struct {
+    uint16_t id;
+    uint16_t offset;
+    uint16_t seg_count;
+    uint8_t addr64;     /* Nonzero when client addresses are 64-bit */
+    uint8_t padding[1];
+    whDmaSegment segs[WH_DMA_MAX_SEGMENTS]; /* Scattered in order */
+} whMessageNvm_ReadDmaSgRequest;
+
+int wh_MessageNvm_TranslateReadDmaSgRequest(uint16_t magic,
+        const whMessageNvm_ReadDmaSgRequest* src,
+        whMessageNvm_ReadDmaSgRequest* dest);
+
+/** NVM ReadDmaSg Response */
+/* Use SimpleResponse */
+
 #endif /* WOLFHSM_WH_MESSAGE_NVM_H_ */
@@ -46,6 +46,17 @@ enum {
     WH_NVM_INVALID_ID = 0,
 };
 
+/* Number of objects whose data wh_Nvm_Read keeps in RAM. 0 to disable */
+#ifndef WH_NVM_CACHE_COUNT
+#define WH_NVM_CACHE_COUNT 0
+#endif
+
+/* Largest object cached, in bytes. Larger objects are always read from the
+ * backend */
+#ifndef WH_NVM_CACHE_SIZE
+#define WH_NVM_CACHE_SIZE 256
+#endif
+
 
 typedef struct {
     int (*Init)(void* context, const void *config);
@@ -87,14 +98,55 @@ typedef struct {
     /* Read the data of the object starting at the byte offset */
     int (*Read)(void* context, whNvmId id, whNvmSize offset,
             whNvmSize data_len, uint8_t* data);
+
+    /* Optional. Do one step of the replication done by
+     *  wh_Nvm_DestroyObjects(c, 0, NULL);
+     * copying about max_bytes of object data, or everything if 0.  All other
+     * functions keep working on the current state between steps.  Returns
+     * WH_ERROR_NOTREADY until the last step, which returns 0, or
+     * WH_ERROR_LOCKED without progress while something holds it off. */
+    int (*Compact)(void* context, uint32_t max_bytes);
+
+    /* Optional. Add an object whose data arrives in pieces.  AddObjectBegin
+     * reserves meta->len bytes of data, AddObjectAppend programs the next
+     * data_len bytes, and AddObjectCommit makes the object visible once all
+     * meta->len bytes have been appended.  Until then the previous version of
+     * the id, if any, remains current.  Only one object is streamed at a time
+     * and a new AddObjectBegin abandons the previous one, as does
+     * AddObjectAbort. */
+    int (*AddObjectBegin)(void* context, whNvmMetadata *meta);
+    int (*AddObjectAppend)(void* context, whNvmSize data_len,
+            const uint8_t* data);
+    int (*AddObjectCommit)(void* context);
+    int (*AddObjectAbort)(void* context);
 } whNvmCb;
 
 
 /** NVM Context helper structs and functions */
+#if WH_NVM_CACHE_COUNT > 0
+/* Copy of the data of a whole object, dropped by AddObject and DestroyObjects
+ * of its id */
+typedef struct {
+    whNvmId id;         /* WH_NVM_INVALID_ID when empty */
+    whNvmSize len;
+    uint32_t age;       /* Value of cache_clock at last use */
+    uint8_t data[WH_NVM_CACHE_SIZE];
+} whNvmCacheEntry;
+#endif
+
 /* Simple helper context structure associated with an NVM instance */
 typedef struct whNvmContext_t {
     whNvmCb *cb;
     void* context;
+    uint32_t generation;    /* Bumped by every AddObject and DestroyObjects */
+    uint8_t generation_padding[4];
+    const void* stream_owner;   /* Opener of the streamed object, or NULL */
+#if WH_NVM_CACHE_COUNT > 0
+    whNvmCacheEntry cache[WH_NVM_CACHE_COUNT];
+    uint32_t cache_clock;
+    whNvmId stream_id;  /* Id added by AddObjectBegin, dropped at commit */
+    uint8_t padding[2];
+#endif
 } whNvmContext;
 
 /* Simple helper configuration structure associated with an NVM instance */
@@ -102,6 +154,11 @@ typedef struct whNvmConfig_t {
     whNvmCb *cb;
     void* context;
     void* config;
+    /* First generation. Clients cache metadata against the generation, so a
+     * platform without a server RNG should start each boot at a different
+     * one, e.g. from a boot counter */
+    uint32_t generation;
+    uint8_t padding[4];
 } whNvmConfig;
 
 
@@ -115,6 +172,18 @@ int wh_Nvm_GetAvailable(whNvmContext* context,
 int wh_Nvm_AddObject(whNvmContext* context, whNvmMetadata *meta,
         whNvmSize data_len, const uint8_t* data);
 
+/* Stream an object through the optional backend callbacks. Return
+ * WH_ERROR_ABORTED without them.  The stream belongs to the owner that began
+ * it: other owners get WH_ERROR_NOTREADY from AddObjectBegin and
+ * WH_ERROR_ACCESS from the rest until it is committed or aborted */
+int wh_Nvm_AddObjectBegin(whNvmContext* context, const void* owner,
+        whNvmMetadata *meta);
+int wh_Nvm_AddObjectAppend(whNvmContext* context, const void* owner,
+        whNvmSize data_len, const uint8_t* data);
+int wh_Nvm_AddObjectCommit(whNvmContext* context, const void* owner);
+/* Abandon the stream of owner, if any, so compaction can go ahead */
+int wh_Nvm_AddObjectAbort(whNvmContext* context, const void* owner);
+
 int wh_Nvm_List(whNvmContext* context,
         whNvmAccess access, whNvmFlags flags, whNvmId start_id,
         whNvmId *out_count, whNvmId *out_id);
@@ -122,10 +191,24 @@ int wh_Nvm_List(whNvmContext* context,
 int wh_Nvm_GetMetadata(whNvmContext* context, whNvmId id,
         whNvmMetadata* meta);
 
+/* Retrieve the metadata of up to max_count matching objects after start_id,
+ * in List order.  Sets out_count to the number of matches left after the
+ * last one returned, which is the start_id of the next call. */
+int wh_Nvm_ListMetadata(whNvmContext* context,
+        whNvmAccess access, whNvmFlags flags, whNvmId start_id,
+        whNvmId max_count, whNvmMetadata* out_meta,
+        whNvmId *out_returned, whNvmId *out_count);
+
 int wh_Nvm_DestroyObjects(whNvmContext* context, whNvmId list_count,
         const whNvmId* id_list);
 
+/* Serves objects of up to WH_NVM_CACHE_SIZE bytes from RAM after the first
+ * read when WH_NVM_CACHE_COUNT is nonzero */
 int wh_Nvm_Read(whNvmContext* context, whNvmId id, whNvmSize offset,
         whNvmSize data_len, uint8_t* data);
 
+/* Falls back to wh_Nvm_DestroyObjects(context, 0, NULL) without a Compact
+ * callback */
+int wh_Nvm_Compact(whNvmContext* context, uint32_t max_bytes);
+
 #endif /* WOLFHSM_WH_NVM_H_ */
@@ -35,6 +35,37 @@
 /* Number of objects in a directory */
 #define NF_OBJECT_COUNT (WOLFHSM_NUM_NVMOBJECTS)
 
+/* When nonzero, DestroyObjects supersedes each id with a tombstone entry in
+ * the active directory instead of rewriting the partition.  The partition is
+ * only compacted once one of the thresholds below is reached, or when
+ * DestroyObjects is called with an empty list. */
+#ifndef WH_NVM_FLASH_TOMBSTONE
+#define WH_NVM_FLASH_TOMBSTONE 0
+#endif
+
+/* When nonzero, compaction leaves a checksummed image of the new directory
+ * at the end of the partition, and Init loads it in one read and only reads
+ * the objects added after it individually.  Reserves the space of the image
+ * in each partition. */
+#ifndef WH_NVM_FLASH_CHECKPOINT
+#define WH_NVM_FLASH_CHECKPOINT 0
+#endif
+
+/* Compact once this many directory entries are reclaimable */
+#ifndef WH_NVM_FLASH_COMPACT_ENTRIES
+#define WH_NVM_FLASH_COMPACT_ENTRIES (NF_OBJECT_COUNT / 2)
+#endif
+
+/* Compact once this many bytes of data are reclaimable. 0 to disable */
+#ifndef WH_NVM_FLASH_COMPACT_BYTES
+#define WH_NVM_FLASH_COMPACT_BYTES 0
+#endif
+
+/* Compact rather than leave fewer than this many free directory entries */
+#ifndef WH_NVM_FLASH_COMPACT_FREE_OBJECTS
+#define WH_NVM_FLASH_COMPACT_FREE_OBJECTS 2
+#endif
+
 /* In-memory computed status of an Object or Directory */
 typedef enum {
     NF_STATUS_UNKNOWN    = 0,    /* State is unknown/not read yet */
@@ -65,6 +96,12 @@ typedef struct {
     uint32_t next_free_data;
     int reclaimable_entries;
     uint32_t reclaimable_data;
+    /* Ids of the USED objects in ascending order with their object index.
+     * Rebuilt on every parse and kept current by add and destroy. */
+    int index_count;
+    uint8_t padding[4];
+    whNvmId index_id[NF_OBJECT_COUNT];
+    uint16_t index_object[NF_OBJECT_COUNT];
 } nfMemDirectory;
 
 /** whNvm config and context structure definitions */
@@ -83,6 +120,13 @@ typedef struct whNvmFlashContext_t {
     uint32_t partition_units;       /* Size of partition in units */
     int active;                     /* Which partition (0 or 1) is active */
     int initialized;
+    int compact_step;               /* Progress of wh_NvmFlash_Compact */
+    int compact_entry;              /* Next object to copy */
+    uint32_t compact_object;        /* Next free object in new partition */
+    uint32_t compact_data;          /* Next free data unit in new partition */
+    int stream_object;              /* Entry being streamed, -1 for none */
+    uint32_t stream_offset;         /* Bytes of stream data received */
+    uint8_t stream_tail[WHFU_BYTES_PER_UNIT]; /* Partial unit of the stream */
     uint8_t padding[4];
 } whNvmFlashContext;
 
@@ -102,6 +146,13 @@ int wh_NvmFlash_DestroyObjects(void* c, whNvmId list_count,
         const whNvmId* id_list);
 int wh_NvmFlash_Read(void* c, whNvmId id, whNvmSize offset,
         whNvmSize data_len, uint8_t* data);
+/* Holds off copying with WH_ERROR_LOCKED while an object is streamed */
+int wh_NvmFlash_Compact(void* c, uint32_t max_bytes);
+int wh_NvmFlash_AddObjectBegin(void* c, whNvmMetadata* meta);
+int wh_NvmFlash_AddObjectAppend(void* c, whNvmSize data_len,
+        const uint8_t* data);
+int wh_NvmFlash_AddObjectCommit(void* c);
+int wh_NvmFlash_AddObjectAbort(void* c);
 
 #define WH_NVM_FLASH_CB                             \
 {                                                   \
@@ -113,6 +164,11 @@ int wh_NvmFlash_Read(void* c, whNvmId id, whNvmSize offset,
     .AddObject = wh_NvmFlash_AddObject,             \
     .DestroyObjects = wh_NvmFlash_DestroyObjects,   \
     .Read = wh_NvmFlash_Read,                       \
+    .Compact = wh_NvmFlash_Compact,                 \
+    .AddObjectBegin = wh_NvmFlash_AddObjectBegin,   \
+    .AddObjectAppend = wh_NvmFlash_AddObjectAppend, \
+    .AddObjectCommit = wh_NvmFlash_AddObjectCommit, \
+    .AddObjectAbort = wh_NvmFlash_AddObjectAbort,   \
 }
 
 #endif /* WOLFHSM_WH_NVMFLASH_H_ */
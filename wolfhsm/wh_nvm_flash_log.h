@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_nvm_flash_log.h
+ *
+ * Concrete library to implement an NVM data store using a whFlash bottom end,
+ * as an alternative to wh_nvm_flash.h.  Objects are appended as records to a
+ * log spread across N equally sized erase blocks covering both flash
+ * partitions.  Superseded and destroyed records are reclaimed one block at a
+ * time, so each compaction erases a single block instead of a partition.
+ *
+ * Each block starts with a header unit holding its erase count.  Records are
+ * ordered by a sequence number that survives compaction, so a mount rebuilds
+ * the index by scanning every block and keeping the newest record of each id.
+ *
+ * Compaction picks the block that frees the most space, preferring the less
+ * erased block on ties, unless the least erased block lags the most erased one
+ * by more than WH_NVM_FLASH_LOG_WEAR_LIMIT, in which case its (cold) records
+ * are moved so the block rejoins the rotation.
+ */
+
+#ifndef WOLFHSM_WH_NVM_FLASH_LOG_H_
+#define WOLFHSM_WH_NVM_FLASH_LOG_H_
+
+#include <stdint.h>
+
+#include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_flash.h"
+#include "wolfhsm/wh_flash_unit.h"
+
+/* Number of live objects */
+#define NFL_OBJECT_COUNT (WOLFHSM_NUM_NVMOBJECTS)
+
+/* Maximum number of erase blocks managed */
+#ifndef WH_NVM_FLASH_LOG_MAX_BLOCKS
+#define WH_NVM_FLASH_LOG_MAX_BLOCKS 16
+#endif
+
+/* Index entries, shared by live objects and the tombstones of destroyed ones
+ * that must outlive older records in other blocks */
+#ifndef WH_NVM_FLASH_LOG_ENTRY_COUNT
+#define WH_NVM_FLASH_LOG_ENTRY_COUNT (NFL_OBJECT_COUNT * 2)
+#endif
+
+/* Erased blocks kept back from new objects so compaction always has room to
+ * copy the live records of a victim */
+#ifndef WH_NVM_FLASH_LOG_RESERVE_BLOCKS
+#define WH_NVM_FLASH_LOG_RESERVE_BLOCKS 1
+#endif
+
+/* Erase count spread between blocks before cold records are moved */
+#ifndef WH_NVM_FLASH_LOG_WEAR_LIMIT
+#define WH_NVM_FLASH_LOG_WEAR_LIMIT 16
+#endif
+
+/* In-memory state of an erase block */
+typedef struct {
+    uint32_t erase_count;   /* Erases recorded in the block header */
+    uint32_t used;          /* Units written, including the header */
+    uint32_t live;          /* Units of records that are still current */
+    uint32_t min_seq;       /* Oldest record sequence number in the block */
+    uint16_t records;       /* Records written */
+    uint16_t live_records;  /* Records that are still current */
+} nflBlock;
+
+/* In-memory index entry for the newest record of an id */
+typedef struct {
+    whNvmMetadata metadata;
+    uint32_t seq;           /* Sequence number of the record */
+    uint32_t offset;        /* Unit offset of the record within its block */
+    uint16_t block;         /* Block holding the record */
+    uint16_t tombstone;     /* Nonzero when the record destroyed the id */
+} nflEntry;
+
+/** whNvm config and context structure definitions */
+/* In memory configuration structure associated with an NVM instance */
+typedef struct whNvmFlashLogConfig_t {
+    const whFlashCb* cb;    /* whFlash callback */
+    void* context;          /* whFlash context to be passed to cb */
+    const void* config;     /* Config to be passed to cb->Init */
+    uint32_t block_size;    /* Bytes per block. Multiple of the erase sector */
+    uint32_t block_count;   /* Blocks to use. 0 to fill both partitions */
+} whNvmFlashLogConfig;
+
+typedef struct whNvmFlashLogContext_t {
+    const whFlashCb* cb;            /* Flash callbacks */
+    void* flash;                    /* Flash context to use */
+    nflBlock blocks[WH_NVM_FLASH_LOG_MAX_BLOCKS];
+    nflEntry entries[WH_NVM_FLASH_LOG_ENTRY_COUNT]; /* Ascending by id */
+    uint32_t block_units;           /* Size of a block in units */
+    uint32_t block_count;           /* Blocks in use */
+    uint32_t next_seq;              /* Sequence number of the next record */
+    int entry_count;
+    int object_count;               /* Entries that are not tombstones */
+    int head;                       /* Block receiving appends, -1 for none */
+    int initialized;
+    uint8_t padding[4];
+} whNvmFlashLogContext;
+
+/** whNvm Interface */
+int wh_NvmFlashLog_Init(void* c, const void* cf);
+int wh_NvmFlashLog_Cleanup(void* c);
+int wh_NvmFlashLog_List(void* c,
+        whNvmAccess access, whNvmFlags flags, whNvmId start_id,
+        whNvmId *out_avail_objects, whNvmId *out_id);
+int wh_NvmFlashLog_GetAvailable(void* c,
+        uint32_t *out_avail_size, whNvmId *out_avail_objects,
+        uint32_t *out_reclaim_size, whNvmId *out_reclaim_objects);
+int wh_NvmFlashLog_GetMetadata(void* c, whNvmId id, whNvmMetadata* meta);
+int wh_NvmFlashLog_AddObject(void* c, whNvmMetadata* meta,
+        whNvmSize data_len, const uint8_t* data);
+int wh_NvmFlashLog_DestroyObjects(void* c, whNvmId list_count,
+        const whNvmId* id_list);
+int wh_NvmFlashLog_Read(void* c, whNvmId id, whNvmSize offset,
+        whNvmSize data_len, uint8_t* data);
+/* Compacts one block per call regardless of max_bytes */
+int wh_NvmFlashLog_Compact(void* c, uint32_t max_bytes);
+
+#define WH_NVM_FLASH_LOG_CB                             \
+{                                                       \
+    .Init = wh_NvmFlashLog_Init,                        \
+    .Cleanup = wh_NvmFlashLog_Cleanup,                  \
+    .List = wh_NvmFlashLog_List,                        \
+    .GetAvailable = wh_NvmFlashLog_GetAvailable,        \
+    .GetMetadata = wh_NvmFlashLog_GetMetadata,          \
+    .AddObject = wh_NvmFlashLog_AddObject,              \
+    .DestroyObjects = wh_NvmFlashLog_DestroyObjects,    \
+    .Read = wh_NvmFlashLog_Read,                        \
+    .Compact = wh_NvmFlashLog_Compact,                  \
+}
+
+#endif /* WOLFHSM_WH_NVM_FLASH_LOG_H_ */
@@ -21,6 +21,7 @@
 #ifndef WOLFHSM_PACKET_H
 #define WOLFHSM_PACKET_H
 #include "wolfhsm/wh_common.h"
+#include "wolfhsm/wh_comm.h"
 
 #if (defined(__IAR_SYSTEMS_ICC__) && (__IAR_SYSTEMS_ICC__ > 8)) || \
                                                     defined(__GNUC__)
@@ -76,6 +77,99 @@ typedef struct WOLFHSM_PACK wh_Packet_cipher_aesgcm_res
     /* uint8_t authTag[authTagSz] */
 } wh_Packet_cipher_aesgcm_res;
 
+typedef struct WOLFHSM_PACK wh_Packet_cipher_stream_init_req
+{
+    uint32_t type;
+    uint32_t enc;
+    uint32_t keyLen;
+    uint32_t ivSz;
+    /* key[keyLen] | iv[ivSz] */
+} wh_Packet_cipher_stream_init_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_cipher_stream_init_res
+{
+    uint32_t handle;
+} wh_Packet_cipher_stream_init_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_cipher_stream_update_req
+{
+    uint32_t handle;
+    uint32_t sz;
+    uint32_t authInSz;
+    /* in[sz] | authIn[authInSz] */
+} wh_Packet_cipher_stream_update_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_cipher_stream_update_res
+{
+    uint32_t sz;
+    /* uint8_t out[sz]; */
+} wh_Packet_cipher_stream_update_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_cipher_stream_final_req
+{
+    uint32_t handle;
+    uint32_t authTagSz;
+    /* authTag[authTagSz] */
+} wh_Packet_cipher_stream_final_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_cipher_stream_final_res
+{
+    uint32_t authTagSz;
+    /* uint8_t authTag[authTagSz], only for encryption */
+} wh_Packet_cipher_stream_final_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_cipher_dma_req
+{
+    uint64_t inAddr;
+    uint64_t outAddr;
+    uint64_t authInAddr;
+    uint32_t type;
+    uint32_t enc;
+    uint32_t keyLen;
+    uint32_t sz;
+    uint32_t ivSz;
+    uint32_t authInSz;
+    uint32_t authTagSz;
+    /* key[keyLen] | iv[ivSz] | authTag[authTagSz], authTag only to decrypt */
+} wh_Packet_cipher_dma_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_cipher_dma_res
+{
+    uint32_t sz;
+    uint32_t authTagSz;
+    /* uint8_t authTag[authTagSz], only for encryption */
+} wh_Packet_cipher_dma_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_hash_req
+{
+    uint32_t type;
+    uint32_t handle;
+    uint32_t keyId;
+    uint32_t sz;
+    uint32_t final;
+    /* in[sz] */
+} wh_Packet_hash_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_hash_res
+{
+    uint32_t handle;
+    uint32_t digestSz;
+    /* uint8_t digest[digestSz], only on final */
+} wh_Packet_hash_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_hash_dma_req
+{
+    uint64_t inAddr;
+    uint32_t type;
+    uint32_t sz;
+} wh_Packet_hash_dma_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_hash_dma_res
+{
+    uint32_t digestSz;
+    /* uint8_t digest[digestSz] */
+} wh_Packet_hash_dma_res;
+
 typedef struct WOLFHSM_PACK wh_Packet_pk_any_req
 {
     uint32_t type;
@@ -132,17 +226,26 @@ typedef struct WOLFHSM_PACK wh_Packet_pk_eckg_res
     uint32_t keyId;
 } wh_Packet_pk_eckg_res;
 
+/* Shared secret options.  With CACHE the secret is kept in the key cache under
+ * keyId, or a new id when WOLFHSM_KEYID_ERASED, with the NVM flags in flags.
+ * The response then carries the id and no secret */
+#define WH_PACKET_PK_SECRET_CACHE 0x1
+
 typedef struct WOLFHSM_PACK wh_Packet_pk_ecdh_req
 {
     uint32_t type;
     uint32_t privateKeyId;
     uint32_t publicKeyId;
     uint32_t curveId;
+    uint32_t options;
+    uint32_t keyId;
+    uint32_t flags;
 } wh_Packet_pk_ecdh_req;
 
 typedef struct WOLFHSM_PACK wh_Packet_pk_ecdh_res
 {
     uint32_t sz;
+    uint32_t keyId;
     /* uint8_t out[] */
 } wh_Packet_pk_ecdh_res;
 
@@ -177,6 +280,33 @@ typedef struct WOLFHSM_PACK wh_Packet_pk_ecc_verify_res
     uint32_t res;
 } wh_Packet_pk_ecc_verify_res;
 
+/* Most signatures checked by one batch verify message */
+#define WH_PACKET_ECC_VERIFY_BATCH_MAX 32
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ecc_verify_batch_req
+{
+    uint32_t curveId;
+    uint32_t count;
+    /* wh_Packet_pk_ecc_verify_item items[count], each then sig | hash */
+} wh_Packet_pk_ecc_verify_batch_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ecc_verify_item
+{
+    uint16_t keyId;
+    uint16_t sigSz;
+    uint16_t hashSz;
+    uint8_t  padding[2];
+    /* uint8_t sig[sigSz] */
+    /* uint8_t hash[hashSz] */
+} wh_Packet_pk_ecc_verify_item;
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ecc_verify_batch_res
+{
+    uint32_t count;
+    uint32_t valid;     /* bit i set when item i verified */
+    uint32_t failed;    /* bit i set when item i could not be checked */
+} wh_Packet_pk_ecc_verify_batch_res;
+
 typedef struct WOLFHSM_PACK wh_Packet_pk_ecc_check_req
 {
     uint32_t type;
@@ -206,14 +336,66 @@ typedef struct WOLFHSM_PACK wh_Packet_pk_curve25519_req
     uint32_t privateKeyId;
     uint32_t publicKeyId;
     uint32_t endian;
+    uint32_t options;   /* WH_PACKET_PK_SECRET_CACHE, as for ECDH */
+    uint32_t keyId;
+    uint32_t flags;
 } wh_Packet_pk_curve25519_req;
 
 typedef struct WOLFHSM_PACK wh_Packet_pk_curve25519_res
 {
     uint32_t sz;
+    uint32_t keyId;
     /* uint8_t out[]; */
 } wh_Packet_pk_curve25519_res;
 
+typedef struct WOLFHSM_PACK wh_Packet_pk_ed25519kg_req
+{
+    uint32_t type;
+    uint32_t sz;
+} wh_Packet_pk_ed25519kg_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ed25519kg_res
+{
+    uint32_t keyId;
+} wh_Packet_pk_ed25519kg_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ed25519_sign_req
+{
+    uint32_t type;
+    uint32_t keyId;
+    uint32_t sz;
+    uint8_t  signType;      /* Ed25519, Ed25519ctx or Ed25519ph */
+    uint8_t  contextSz;
+    uint8_t  padding[2];
+    /* uint8_t in[sz] */
+    /* uint8_t context[contextSz] */
+} wh_Packet_pk_ed25519_sign_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ed25519_sign_res
+{
+    uint32_t sz;
+    /* uint8_t sig[sz] */
+} wh_Packet_pk_ed25519_sign_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ed25519_verify_req
+{
+    uint32_t type;
+    uint32_t keyId;
+    uint32_t sigSz;
+    uint32_t sz;
+    uint8_t  signType;
+    uint8_t  contextSz;
+    uint8_t  padding[2];
+    /* uint8_t sig[sigSz] */
+    /* uint8_t msg[sz] */
+    /* uint8_t context[contextSz] */
+} wh_Packet_pk_ed25519_verify_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_pk_ed25519_verify_res
+{
+    uint32_t res;
+} wh_Packet_pk_ed25519_verify_res;
+
 typedef struct WOLFHSM_PACK wh_Packet_rng_req
 {
     uint32_t sz;
@@ -227,21 +409,23 @@ typedef struct WOLFHSM_PACK wh_Packet_rng_res
 
 typedef struct WOLFHSM_PACK wh_Packet_cmac_req
 {
-    uint8_t opType;
-    uint16_t keyId;
-    uint32_t outSz;
+    uint32_t handle;
+    uint32_t type;
     uint32_t inSz;
     uint32_t keySz;
-    uint32_t type;
+    uint32_t outSz;
+    uint16_t keyId;
+    uint8_t  final;
+    uint8_t  padding[1];
     /* uint8_t in[inSz] */
     /* uint8_t key[keySz] */
 } wh_Packet_cmac_req;
 
 typedef struct WOLFHSM_PACK wh_Packet_cmac_res
 {
-    uint16_t keyId;
+    uint32_t handle;
     uint32_t outSz;
-    /* uint8_t out[]; */
+    /* uint8_t out[outSz], only on final */
 } wh_Packet_cmac_res;
 
 typedef struct WOLFHSM_PACK wh_Packet_key_cache_req
@@ -291,6 +475,39 @@ typedef struct WOLFHSM_PACK wh_Packet_key_export_res
     /* uint8_t out[len]; */
 } wh_Packet_key_export_res;
 
+typedef struct WOLFHSM_PACK wh_Packet_key_export_public_req
+{
+    uint32_t id;
+    uint32_t type;      /* WOLFHSM_KEYFLAG_ECC or WOLFHSM_KEYFLAG_RSA */
+} wh_Packet_key_export_public_req;
+/* Response is wh_Packet_key_export_res, out being qx | qy for ECC or the
+ * public key DER for RSA */
+
+/* Key generation request has no fields */
+typedef struct WOLFHSM_PACK wh_Packet_key_generation_res
+{
+    uint32_t generation;    /* Changes whenever any key may have changed */
+} wh_Packet_key_generation_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_key_cache_dma_req
+{
+    uint64_t keyAddr;
+    uint32_t flags;
+    uint32_t sz;
+    uint32_t labelSz;
+    uint16_t id;
+    uint8_t label[WOLFHSM_NVM_LABEL_LEN];
+} wh_Packet_key_cache_dma_req;
+/* Response is wh_Packet_key_cache_res */
+
+typedef struct WOLFHSM_PACK wh_Packet_key_export_dma_req
+{
+    uint64_t keyAddr;
+    uint32_t sz;    /* Capacity of the client buffer */
+    uint32_t id;
+} wh_Packet_key_export_dma_req;
+/* Response is wh_Packet_key_export_res with no trailing data */
+
 typedef struct WOLFHSM_PACK wh_Packet_key_erase_req
 {
     uint32_t id;
@@ -301,6 +518,28 @@ typedef struct WOLFHSM_PACK wh_Packet_key_erase_res
     uint32_t ok;
 } wh_Packet_key_erase_res;
 
+typedef struct WOLFHSM_PACK wh_Packet_key_rsakg_start_req
+{
+    uint32_t size;
+    uint32_t e;
+} wh_Packet_key_rsakg_start_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_key_job_start_res
+{
+    uint32_t jobId;
+} wh_Packet_key_job_start_res;
+
+typedef struct WOLFHSM_PACK wh_Packet_key_job_status_req
+{
+    uint32_t jobId;
+} wh_Packet_key_job_status_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_key_job_status_res
+{
+    uint32_t done;
+    uint32_t keyId;
+} wh_Packet_key_job_status_res;
+
 typedef struct WOLFHSM_PACK wh_Packet_version_exchange
 {
     uint32_t version;
@@ -333,6 +572,18 @@ typedef struct WOLFHSM_PACK wh_Packet_she_secure_boot_update_res
     uint32_t status;
 } wh_Packet_she_secure_boot_update_res;
 
+/* bootloader is read from client memory over DMA */
+typedef struct WOLFHSM_PACK wh_Packet_she_secure_boot_dma_req
+{
+    uint64_t addr;
+    uint32_t sz;
+} wh_Packet_she_secure_boot_dma_req;
+
+typedef struct WOLFHSM_PACK wh_Packet_she_secure_boot_dma_res
+{
+    uint32_t status;
+} wh_Packet_she_secure_boot_dma_res;
+
 /* no req body for a finish request */
 typedef struct WOLFHSM_PACK wh_Packet_she_secure_boot_finish_res
 {
@@ -358,6 +609,21 @@ typedef struct WOLFHSM_PACK wh_Packet_she_load_key_res
     uint8_t messageFive[WOLFHSM_SHE_M5_SZ];
 } wh_Packet_she_load_key_res;
 
+typedef struct WOLFHSM_PACK wh_Packet_she_load_key_batch_req
+{
+    uint32_t count;
+    /* wh_Packet_she_load_key_req keys[count] */
+} wh_Packet_she_load_key_batch_req;
+
+/* keys are loaded in order until one fails, status is its error or
+ * ERC_NO_ERROR if all were loaded */
+typedef struct WOLFHSM_PACK wh_Packet_she_load_key_batch_res
+{
+    uint32_t count;
+    int32_t status;
+    /* wh_Packet_she_load_key_res keys[count] */
+} wh_Packet_she_load_key_batch_res;
+
 typedef struct WOLFHSM_PACK wh_Packet_she_load_plain_key_req
 {
     uint8_t key[WOLFHSM_SHE_KEY_SZ];
@@ -446,6 +712,24 @@ typedef struct WOLFHSM_PACK wh_Packet_she_dec_cbc_res
     /* uint8_t out[sz] */
 } wh_Packet_she_dec_cbc_res;
 
+/* in and out are read and written in client memory over DMA, the iv is
+ * ignored by ECB */
+typedef struct WOLFHSM_PACK wh_Packet_she_cipher_dma_req
+{
+    uint64_t inAddr;
+    uint64_t outAddr;
+    uint32_t sz;
+    uint8_t keyId;
+    uint8_t iv[WOLFHSM_SHE_KEY_SZ];
+} wh_Packet_she_cipher_dma_req;
+
+/* iv is the one to continue a CBC stream with */
+typedef struct WOLFHSM_PACK wh_Packet_she_cipher_dma_res
+{
+    uint32_t sz;
+    uint8_t iv[WOLFHSM_SHE_KEY_SZ];
+} wh_Packet_she_cipher_dma_res;
+
 typedef struct WOLFHSM_PACK wh_Packet_she_gen_mac_req
 {
     uint32_t keyId;
@@ -489,6 +773,13 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_cipher_aescbc_req cipherAesCbcReq;
         /* AES GCM */
         wh_Packet_cipher_aesgcm_req cipherAesGcmReq;
+        /* cipher streams */
+        wh_Packet_cipher_stream_init_req cipherStreamInitReq;
+        wh_Packet_cipher_stream_update_req cipherStreamUpdateReq;
+        wh_Packet_cipher_stream_final_req cipherStreamFinalReq;
+        wh_Packet_cipher_dma_req cipherDmaReq;
+        wh_Packet_hash_req hashReq;
+        wh_Packet_hash_dma_req hashDmaReq;
         /* pk */
         wh_Packet_pk_any_req pkAnyReq;
         /* RSA */
@@ -500,12 +791,20 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_pk_ecdh_req pkEcdhReq;
         wh_Packet_pk_ecc_sign_req pkEccSignReq;
         wh_Packet_pk_ecc_verify_req pkEccVerifyReq;
+        wh_Packet_pk_ecc_verify_batch_req pkEccVerifyBatchReq;
         wh_Packet_pk_ecc_check_req pkEccCheckReq;
         /* curve25519 */
         wh_Packet_pk_curve25519kg_req pkCurve25519kgReq;
         wh_Packet_pk_curve25519kg_res pkCurve25519kgRes;
         wh_Packet_pk_curve25519_req pkCurve25519Req;
         wh_Packet_pk_curve25519_res pkCurve25519Res;
+        /* ed25519 */
+        wh_Packet_pk_ed25519kg_req pkEd25519kgReq;
+        wh_Packet_pk_ed25519kg_res pkEd25519kgRes;
+        wh_Packet_pk_ed25519_sign_req pkEd25519SignReq;
+        wh_Packet_pk_ed25519_sign_res pkEd25519SignRes;
+        wh_Packet_pk_ed25519_verify_req pkEd25519VerifyReq;
+        wh_Packet_pk_ed25519_verify_res pkEd25519VerifyRes;
         /* rng */
         wh_Packet_rng_req rngReq;
         /* cmac */
@@ -518,8 +817,15 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_key_commit_req keyCommitReq;
         /* key export */
         wh_Packet_key_export_req keyExportReq;
+        wh_Packet_key_export_public_req keyExportPublicReq;
+        /* key cache and export over DMA */
+        wh_Packet_key_cache_dma_req keyCacheDmaReq;
+        wh_Packet_key_export_dma_req keyExportDmaReq;
         /* key erase */
         wh_Packet_key_erase_req keyEraseReq;
+        /* key jobs */
+        wh_Packet_key_rsakg_start_req keyRsakgStartReq;
+        wh_Packet_key_job_status_req keyJobStatusReq;
 
         /* FIXED SIZE RESPONSES */
         /* cipher */
@@ -527,6 +833,13 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_cipher_aescbc_res cipherAesCbcRes;
         /* AES GCM */
         wh_Packet_cipher_aesgcm_res cipherAesGcmRes;
+        /* cipher streams */
+        wh_Packet_cipher_stream_init_res cipherStreamInitRes;
+        wh_Packet_cipher_stream_update_res cipherStreamUpdateRes;
+        wh_Packet_cipher_stream_final_res cipherStreamFinalRes;
+        wh_Packet_cipher_dma_res cipherDmaRes;
+        wh_Packet_hash_res hashRes;
+        wh_Packet_hash_dma_res hashDmaRes;
         /* pk */
         /* RSA */
         wh_Packet_pk_rsakg_res pkRsakgRes;
@@ -537,6 +850,7 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_pk_ecdh_res pkEcdhRes;
         wh_Packet_pk_ecc_sign_res pkEccSignRes;
         wh_Packet_pk_ecc_verify_res pkEccVerifyRes;
+        wh_Packet_pk_ecc_verify_batch_res pkEccVerifyBatchRes;
         wh_Packet_pk_ecc_check_res pkEccCheckRes;
         /* rng */
         wh_Packet_rng_res rngRes;
@@ -550,8 +864,12 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_key_commit_res keyCommitRes;
         /* key export */
         wh_Packet_key_export_res keyExportRes;
+        wh_Packet_key_generation_res keyGenerationRes;
         /* key erase */
         wh_Packet_key_erase_res keyEraseRes;
+        /* key jobs */
+        wh_Packet_key_job_start_res keyJobStartRes;
+        wh_Packet_key_job_status_res keyJobStatusRes;
 
 #ifdef WOLFHSM_SHE_EXTENSION
         wh_Packet_she_set_uid_req sheSetUidReq;
@@ -559,10 +877,14 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_she_secure_boot_init_res sheSecureBootInitRes;
         wh_Packet_she_secure_boot_update_req sheSecureBootUpdateReq;
         wh_Packet_she_secure_boot_update_res sheSecureBootUpdateRes;
+        wh_Packet_she_secure_boot_dma_req sheSecureBootDmaReq;
+        wh_Packet_she_secure_boot_dma_res sheSecureBootDmaRes;
         wh_Packet_she_secure_boot_finish_res sheSecureBootFinishRes;
         wh_Packet_she_get_status_res sheGetStatusRes;
         wh_Packet_she_load_key_req sheLoadKeyReq;
         wh_Packet_she_load_key_res sheLoadKeyRes;
+        wh_Packet_she_load_key_batch_req sheLoadKeyBatchReq;
+        wh_Packet_she_load_key_batch_res sheLoadKeyBatchRes;
         wh_Packet_she_load_plain_key_req sheLoadPlainKeyReq;
         wh_Packet_she_export_ram_key_res sheExportRamKeyRes;
         wh_Packet_she_init_rng_res sheInitRngRes;
@@ -577,6 +899,8 @@ typedef struct WOLFHSM_PACK whPacket
         wh_Packet_she_enc_ecb_res sheDecEcbRes;
         wh_Packet_she_enc_cbc_req sheDecCbcReq;
         wh_Packet_she_enc_cbc_res sheDecCbcRes;
+        wh_Packet_she_cipher_dma_req sheCipherDmaReq;
+        wh_Packet_she_cipher_dma_res sheCipherDmaRes;
         wh_Packet_she_gen_mac_req sheGenMacReq;
         wh_Packet_she_gen_mac_res sheGenMacRes;
         wh_Packet_she_verify_mac_req sheVerifyMacReq;
@@ -585,6 +909,20 @@ typedef struct WOLFHSM_PACK whPacket
     };
 } whPacket;
 
+#ifndef WOLFHSM_NO_CRYPTO
+/* Translates the fixed fields of a key, crypto or SHE request of size bytes
+ * in place.  Returns the fields of the matching response for
+ * wh_Packet_TranslateResponse, or NULL when magic is native and neither needs
+ * any work.  The variable length data that follows is not translated */
+const whCommField* wh_Packet_TranslateRequest(uint16_t magic, uint16_t kind,
+        uint8_t* packet, uint16_t size);
+
+/* Translates a response of size bytes in place, using the fields returned for
+ * its request */
+void wh_Packet_TranslateResponse(uint16_t magic, const whCommField* fields,
+        uint8_t* packet, uint16_t size);
+#endif /* !WOLFHSM_NO_CRYPTO */
+
 #ifdef __cplusplus
     } /* extern "C" */
 #endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_replay.h
+ *
+ * Replay of a captured request stream.  Each request of a log, see
+ * wh_capture.h, is sent to a server over the client end of its memory
+ * transport and the time until the response arrives is recorded.  Requests
+ * are sent one at a time and as fast as the server answers, so runs over the
+ * same log and the same starting NVM contents are comparable across builds.
+ *
+ * Requests are sent as captured.  Keys and objects they refer to must exist
+ * in the server's NVM, and requests of every captured client share the one
+ * comm channel.  Requests that carry client memory addresses (the DMA actions
+ * of the NVM, key, crypto, SHE and custom groups, alone or inside a batch)
+ * are not sent, since the addresses would be resolved in the replay server's
+ * memory, and are only counted as skipped.
+ */
+
+#ifndef WOLFHSM_WH_REPLAY_H_
+#define WOLFHSM_WH_REPLAY_H_
+
+#include <stdint.h>
+
+#include "wolfhsm/wh_capture.h"
+#include "wolfhsm/wh_message.h"
+#include "wolfhsm/wh_server.h"
+#include "wolfhsm/wh_transport_mem.h"
+
+/* Times wh_Server_HandleRequestMessage is called for one response before
+ * giving up.  Only requests handed to a crypto worker need more than one */
+#ifndef WH_REPLAY_POLL_COUNT
+#define WH_REPLAY_POLL_COUNT 1000000
+#endif
+
+/* Message groups timed separately, indexed by WH_MESSAGE_GROUP(kind) >> 8 */
+#define WH_REPLAY_GROUP_COUNT ((WH_MESSAGE_GROUP_CUSTOM >> 8) + 1)
+
+/* Read the next record of a log into record and its packet into packet,
+ * which holds size bytes.
+ * Returns: 0 on success,
+ *          WH_ERROR_NOTFOUND at the end of the log
+ *          WH_ERROR_NOSPACE if the packet does not fit
+ *          WH_ERROR_ABORTED if the log is truncated or unreadable
+ */
+typedef int (*whReplayReadCb)(void* context, whCaptureRecord* record,
+        uint16_t size, void* packet);
+
+typedef struct {
+    whReplayReadCb   read_cb;
+    void*            read_context;
+    whCaptureTimeCb  time_cb;       /* Optional. Times are 0 without it */
+    void*            time_context;
+    whServerContext* server;        /* Initialized on the transport below */
+    whTransportMemClientContext* transport; /* Initialized client end */
+} whReplayConfig;
+
+/* Response times of a set of requests, in time_cb units */
+typedef struct {
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint32_t count;
+    uint8_t  padding[4];
+} whReplayTiming;
+
+typedef struct {
+    whReplayTiming all;
+    whReplayTiming group[WH_REPLAY_GROUP_COUNT];
+    uint64_t       captured;    /* Captured time from first to last request */
+    uint32_t       skipped;     /* DMA requests left out */
+    uint8_t        padding[4];
+} whReplayStats;
+
+/* Replay every record of the log.  Stops at the first request the server
+ * does not answer, or the first record that cannot be read.
+ * Returns: 0 once the whole log was replayed,
+ *          WH_ERROR_BADARGS if config or a required member is NULL
+ *          WH_ERROR_ABORTED if a request was not answered or is malformed
+ *          or an error from read_cb or the transport
+ */
+int wh_Replay_Run(const whReplayConfig* config, whReplayStats* out_stats);
+
+#endif /* WOLFHSM_WH_REPLAY_H_ */
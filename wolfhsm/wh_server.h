@@ -30,8 +30,11 @@
 
 #include "wolfhsm/wh_common.h"
 #include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_message_comm.h"
 #include "wolfhsm/wh_nvm.h"
+#include "wolfhsm/wh_counter.h"
 #include "wolfhsm/wh_message_customcb.h"
+#include "wolfhsm/wh_message_batch.h"
 
 #ifndef WOLFHSM_NO_CRYPTO
 #include "wolfssl/wolfcrypt/settings.h"
@@ -39,7 +42,12 @@
 #include "wolfssl/wolfcrypt/rsa.h"
 #include "wolfssl/wolfcrypt/ecc.h"
 #include "wolfssl/wolfcrypt/curve25519.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
 #include "wolfssl/wolfcrypt/cryptocb.h"
+#include "wolfssl/wolfcrypt/sha256.h"
+#include "wolfssl/wolfcrypt/sha512.h"
+#include "wolfssl/wolfcrypt/hmac.h"
+#include "wolfssl/wolfcrypt/cmac.h"
 #endif /* WOLFHSM_NO_CRYPTO */
 
 /* Forward declaration of the server structure so its elements can reference
@@ -50,24 +58,209 @@ typedef struct whServerContext_t whServerContext;
 /** Server crypto context and resource allocation */
 typedef struct CacheSlot {
     uint8_t       commited;
+    uint8_t       padding[3];
+    uint32_t      lastUse;  /* cacheTick of the most recent access */
+    uint32_t      useCount; /* Accesses since the key was cached */
+    uint32_t      size;     /* Capacity of buffer */
     whNvmMetadata meta[1];
-    uint8_t       buffer[WOLFHSM_KEYCACHE_BUFSIZE];
+    uint8_t*      buffer;   /* Points into the server's cache arena */
 } CacheSlot;
 
+/* Backing store of the key cache buffers. The first WOLFHSM_KEYCACHE_BIG_COUNT
+ * slots hold WOLFHSM_KEYCACHE_BIG_BUFSIZE bytes each and the last
+ * WOLFHSM_KEYCACHE_SMALL_COUNT slots only hold WOLFHSM_KEYCACHE_SMALL_BUFSIZE */
+#define WH_SERVER_KEYCACHE_ARENA_SIZE                                \
+    ((WOLFHSM_NUM_RAMKEYS - WOLFHSM_KEYCACHE_SMALL_COUNT -           \
+      WOLFHSM_KEYCACHE_BIG_COUNT) * WOLFHSM_KEYCACHE_BUFSIZE +       \
+     WOLFHSM_KEYCACHE_BIG_COUNT * WOLFHSM_KEYCACHE_BIG_BUFSIZE +     \
+     WOLFHSM_KEYCACHE_SMALL_COUNT * WOLFHSM_KEYCACHE_SMALL_BUFSIZE)
+
+/* Number of key id prefixes, i.e. key type and client_id, whose allocated
+ * ids are tracked at once. Further prefixes replace the maps in turn */
+#ifndef WH_SERVER_KEYID_MAP_COUNT
+#define WH_SERVER_KEYID_MAP_COUNT 4
+#endif
+
+/* Allocated ids below one prefix, including cached keys and all NVM objects */
+typedef struct {
+    uint32_t bits[(WOLFHSM_KEYID_MASK + 1) / 32];
+    uint16_t prefix;    /* Id bits above WOLFHSM_KEYID_MASK */
+    uint8_t  used;
+    uint8_t  padding[1];
+} whServerKeyIdMap;
+
+/* Working keys of the request being handled. Only the key types enabled in
+ * wolfCrypt are held */
 typedef struct {
     int    devId;
+#ifndef NO_AES
     Aes    aes[1];
+#endif
+#ifndef NO_RSA
     RsaKey rsa[1];
+#endif
 #ifdef HAVE_ECC
     ecc_key eccPrivate[1];
     ecc_key eccPublic[1];
 #endif
+#ifdef HAVE_CURVE25519
     curve25519_key curve25519Private[1];
     curve25519_key curve25519Public[1];
+#endif
+#ifdef HAVE_ED25519
+    ed25519_key    ed25519[1];
+#endif
     WC_RNG         rng[1];
 } crypto_context;
 
+/* Bytes of RNG output generated ahead of time by wh_Server_RunIdle and handed
+ * out to RNG requests. 0 generates the output of each request on demand */
+#ifndef WH_SERVER_RNG_POOL_SIZE
+#define WH_SERVER_RNG_POOL_SIZE 0
+#endif
+#ifdef WC_NO_RNG
+#undef WH_SERVER_RNG_POOL_SIZE
+#define WH_SERVER_RNG_POOL_SIZE 0
+#endif
+
+/* Ephemeral keypairs generated ahead of time by wh_Server_RunIdle, one per
+ * call, and moved into the key cache by keygen requests that match them, so
+ * a handshake does not wait for the keygen. 0 generates each key on demand.
+ * ECC keys are made with WH_SERVER_EPHEMERAL_ECC_SIZE and
+ * WH_SERVER_EPHEMERAL_ECC_CURVE, ECC_CURVE_DEF being what wc_ecc_make_key
+ * asks for. A request matches on the curve both ids resolve to, so with the
+ * defaults wc_ecc_make_key and an explicit ECC_SECP256R1 are both served */
+#ifndef WH_SERVER_EPHEMERAL_ECC_COUNT
+#define WH_SERVER_EPHEMERAL_ECC_COUNT 0
+#endif
+#ifndef WH_SERVER_EPHEMERAL_ECC_SIZE
+#define WH_SERVER_EPHEMERAL_ECC_SIZE 32
+#endif
+#ifndef WH_SERVER_EPHEMERAL_ECC_CURVE
+#define WH_SERVER_EPHEMERAL_ECC_CURVE ECC_CURVE_DEF
+#endif
+#ifndef WH_SERVER_EPHEMERAL_CURVE25519_COUNT
+#define WH_SERVER_EPHEMERAL_CURVE25519_COUNT 0
+#endif
+#ifndef HAVE_ECC
+#undef WH_SERVER_EPHEMERAL_ECC_COUNT
+#define WH_SERVER_EPHEMERAL_ECC_COUNT 0
+#endif
+#ifndef HAVE_CURVE25519
+#undef WH_SERVER_EPHEMERAL_CURVE25519_COUNT
+#define WH_SERVER_EPHEMERAL_CURVE25519_COUNT 0
+#endif
+
+#if (WH_SERVER_EPHEMERAL_ECC_COUNT > 0) || \
+    (WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0)
+/* Cached form of a pooled key: qx | qy | d for ECC, pub | priv for
+ * Curve25519 */
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+#define WH_SERVER_EPHEMERAL_ECC_LEN (3 * WH_SERVER_EPHEMERAL_ECC_SIZE)
+#else
+#define WH_SERVER_EPHEMERAL_ECC_LEN 0
+#endif
+#if (WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0) && \
+    (WH_SERVER_EPHEMERAL_ECC_LEN < 2 * CURVE25519_KEYSIZE)
+#define WH_SERVER_EPHEMERAL_KEY_SIZE (2 * CURVE25519_KEYSIZE)
+#else
+#define WH_SERVER_EPHEMERAL_KEY_SIZE WH_SERVER_EPHEMERAL_ECC_LEN
+#endif
+
+typedef struct {
+    uint16_t len;       /* 0 while empty */
+    uint8_t  padding[2];
+    uint8_t  key[WH_SERVER_EPHEMERAL_KEY_SIZE];
+} whServerEphemeralKey;
+#endif
+
+/* Number of keys kept decoded in wolfCrypt structs between requests. 0
+ * decodes the cached key again for every request */
+#ifndef WH_SERVER_DECODED_KEY_COUNT
+#define WH_SERVER_DECODED_KEY_COUNT 0
+#endif
+
+/* Number of decoded keys that may be held by ECC keys pinned in the key cache
+ * with WOLFHSM_NVM_FLAGS_PINNED. Other keys never displace them, so a pinned
+ * signing key keeps its imported state, and the wolfCrypt precomputation done
+ * on it, across requests. At most WH_SERVER_DECODED_KEY_COUNT - 1 */
+#ifndef WH_SERVER_ECC_PINNED_COUNT
+#define WH_SERVER_ECC_PINNED_COUNT 0
+#endif
+#if (WH_SERVER_ECC_PINNED_COUNT > 0) && \
+    (WH_SERVER_ECC_PINNED_COUNT >= WH_SERVER_DECODED_KEY_COUNT)
+#error "WH_SERVER_ECC_PINNED_COUNT must be less than WH_SERVER_DECODED_KEY_COUNT"
+#endif
+
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+/* A cached key already imported into wolfCrypt */
+typedef struct {
+    union {
+#ifndef NO_RSA
+        RsaKey         rsa[1];
+#endif
+#ifdef HAVE_ECC
+        ecc_key        ecc[1];
+#endif
+#ifdef HAVE_CURVE25519
+        curve25519_key curve25519[1];
+#endif
+#ifdef HAVE_ED25519
+        ed25519_key    ed25519[1];
+#endif
+#ifndef NO_AES
+        Aes            aes[1];
+#endif
+#ifdef WOLFSSL_CMAC
+        Cmac           cmac[1];
+#endif
+    } key;
+    uint32_t lastUse;   /* cacheTick of the most recent use */
+    int      curveId;   /* ECC curve the key was imported for */
+    int      devId;     /* devId the key was initialized with */
+    whKeyId  id;        /* Full key id, WOLFHSM_KEYID_ERASED if unused */
+    uint8_t  type;      /* Which member of key is initialized, 0 if none */
+    uint8_t  busy;      /* Held by a request */
+    uint8_t  stale;     /* Invalidated while busy, freed once released */
+    uint8_t  pinned;    /* Pinned ECC key, see WH_SERVER_ECC_PINNED_COUNT */
+    uint8_t  padding[6];
+} whServerDecodedKey;
+#endif
+
 #ifdef WOLFHSM_SHE_EXTENSION
+/* Number of SHE PRNG outputs computed ahead of time by wh_Server_RunIdle, 0
+ * computes each one on demand */
+#ifndef WH_SHE_RND_POOL_COUNT
+#define WH_SHE_RND_POOL_COUNT 0
+#endif
+
+/* Number of SHE auth keys whose K1 and K2 key update derivations are kept,
+ * 0 derives them for every key update */
+#ifndef WH_SHE_KDF_CACHE_COUNT
+#define WH_SHE_KDF_CACHE_COUNT 4
+#endif
+
+/* Bytes of client memory mapped and CMACed at a time by a DMA secure boot */
+#ifndef WH_SHE_SECURE_BOOT_DMA_BLOCK
+#define WH_SHE_SECURE_BOOT_DMA_BLOCK 4096
+#endif
+
+/* Bytes of client memory mapped at a time by a DMA SHE cipher request, a
+ * multiple of the AES block size */
+#ifndef WH_SHE_CIPHER_DMA_BLOCK
+#define WH_SHE_CIPHER_DMA_BLOCK 4096
+#endif
+
+#if WH_SHE_KDF_CACHE_COUNT > 0
+/* Derivations of one SHE key, found by comparing the key itself so a changed
+ * key never matches a stale entry */
+typedef struct {
+    uint8_t key[WOLFHSM_SHE_KEY_SZ];
+    uint8_t derived[2][WOLFHSM_SHE_KEY_SZ]; /* With KEY_UPDATE_ENC_C, MAC_C */
+    uint8_t valid;                          /* Bit per derived entry */
+} whSheKdfCacheEntry;
+#endif
+
 typedef struct {
     uint8_t  sbState;
     uint8_t  cmacKeyFound;
@@ -79,6 +272,15 @@ typedef struct {
     uint8_t  prngState[WOLFHSM_SHE_KEY_SZ];
     uint8_t  prngKey[WOLFHSM_SHE_KEY_SZ];
     uint8_t  uid[WOLFHSM_SHE_UID_SZ];
+#if WH_SHE_KDF_CACHE_COUNT > 0
+    uint8_t  kdfCacheNext;  /* Next entry to replace */
+    whSheKdfCacheEntry kdfCache[WH_SHE_KDF_CACHE_COUNT];
+#endif
+#if WH_SHE_RND_POOL_COUNT > 0
+    /* The next PRNG states, in order, prngState stays the last one used */
+    uint32_t rndPoolCount;
+    uint8_t  rndPool[WH_SHE_RND_POOL_COUNT][WOLFHSM_SHE_KEY_SZ];
+#endif
 } she_context;
 #endif
 #endif /* WOLFHSM_NO_CRYPTO */
@@ -92,10 +294,25 @@ typedef int (*whServerCustomCb)(
     whMessageCustomCb_Response*      resp /* response from callback to client */
 );
 
+/* Type definition for a bulk custom server callback. req_data and resp_data
+ * point directly into the comm buffers and may be the same memory, in which
+ * case the payload can be processed in place  */
+typedef int (*whServerCustomBulkCb)(
+    whServerContext* server,      /* points to dispatching server ctx */
+    uint32_t         id,          /* indentifier of registered callback */
+    const uint8_t*   req_data,    /* request payload from client */
+    uint16_t         req_size,    /* bytes in req_data */
+    uint8_t*         resp_data,   /* response payload to client */
+    uint16_t* inout_resp_size /* in: space in resp_data, out: bytes written */
+);
+
 
 /** Server DMA address translation and validation */
 
+/* Entries in each of the read and write allowlists */
+#ifndef WH_DMA_ADDR_ALLOWLIST_COUNT
 #define WH_DMA_ADDR_ALLOWLIST_COUNT (10)
+#endif
 
 /* Indicates to a DMA callback the type of memory operation the callback must
  * act on. Common use cases are remapping client addresses into server address
@@ -153,18 +370,210 @@ typedef struct {
     const whServerDmaAddrAllowList* dmaAddrAllowList; /* allowed addresses */
 } whServerDmaConfig;
 
+/* Ranges of an allowlist sorted by address, with overlapping and adjacent
+ * entries merged, for a binary search */
+typedef struct {
+    uintptr_t start[WH_DMA_ADDR_ALLOWLIST_COUNT];
+    uintptr_t end[WH_DMA_ADDR_ALLOWLIST_COUNT]; /* One past the last byte */
+    int       count;
+    uint8_t   padding[4];
+} whServerDmaAddrIndex;
+
 typedef struct {
     whServerDmaClientMem32Cb        cb32; /* DMA callback for 32-bit system */
     whServerDmaClientMem64Cb        cb64; /* DMA callback for 64-bit system */
     const whServerDmaAddrAllowList* dmaAddrAllowList; /* allowed addresses */
+    whServerDmaAddrIndex            readIndex;  /* built from readList */
+    whServerDmaAddrIndex            writeIndex; /* built from writeList */
 } whServerDmaContext;
 
 
+/** Server request statistics */
+
+#ifdef WOLFHSM_SERVER_STATS
+/* Number of message kinds counted separately, including the entry that
+ * collects all further kinds */
+#ifndef WH_SERVER_STATS_COUNT
+#define WH_SERVER_STATS_COUNT 32
+#endif
+
+/* Returns a free-running time stamp, usually in microseconds */
+typedef uint64_t (*whServerTimeCb)(void* context);
+#endif /* WOLFHSM_SERVER_STATS */
+
+
+/** Server crypto worker pool */
+
+/* Number of workers that crypto requests can be handed to. 0 disables the
+ * pool and every request is handled by the thread calling
+ * wh_Server_HandleRequestMessage */
+#ifndef WH_SERVER_WORKER_COUNT
+#define WH_SERVER_WORKER_COUNT 0
+#endif
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+/* Invoked once a request has been handed to a worker. The port must arrange
+ * for wh_Server_WorkerRun(server, index) to be called on the worker's thread
+ * or core. A non-zero return handles the request inline instead */
+typedef int (*whServerWorkerStartCb)(void* context, whServerContext* server,
+                                     uint16_t index);
+/* Mutual exclusion between the server and its workers. May be NULL when the
+ * port only ever runs one of them at a time */
+typedef void (*whServerLockCb)(void* context);
+
+/* Worker pool configuration. Each worker needs its own crypto context,
+ * including an initialized RNG. NULL entries leave that worker unused */
+typedef struct {
+    crypto_context*       crypto[WH_SERVER_WORKER_COUNT];
+    whServerWorkerStartCb start_cb;
+    whServerLockCb        lock_cb;
+    whServerLockCb        unlock_cb;
+    void*                 cb_context;
+} whServerWorkerConfig;
+
+typedef enum {
+    WH_SERVER_WORKER_UNUSED = 0,
+    WH_SERVER_WORKER_IDLE   = 1,
+    WH_SERVER_WORKER_BUSY   = 2, /* Request handed over, not yet handled */
+    WH_SERVER_WORKER_DONE   = 3, /* Response ready to be sent */
+} whServerWorkerState;
+
+/* A request in flight on a worker, processed in place in packet */
+typedef struct {
+    crypto_context* crypto;
+    int             state;      /* whServerWorkerState */
+    int             rc;
+    uint16_t        comm_index; /* Channel to send the response on */
+    uint16_t        magic;
+    uint16_t        kind;
+    uint16_t        seq;
+    uint16_t        size;
+    uint16_t        job;        /* 1 + index of a keygen job, or 0 */
+    uint16_t        req_size;
+    uint8_t         padding[2];
+#ifdef WOLFHSM_SERVER_STATS
+    uint64_t        start_time; /* When the request was handed over */
+#endif
+    uint64_t        packet[WH_COMM_MTU_U64_COUNT];
+} whServerWorker;
+#endif /* !WOLFHSM_NO_CRYPTO && WH_SERVER_WORKER_COUNT > 0 */
+
+/** Server key generation jobs */
+
+/* Number of keygen jobs that can be queued at once */
+#ifndef WH_SERVER_JOB_COUNT
+#define WH_SERVER_JOB_COUNT 1
+#endif
+
+#if !defined(WOLFHSM_NO_CRYPTO) && !defined(NO_RSA) && \
+    defined(WOLFSSL_KEY_GEN)
+#define WH_SERVER_KEYGEN_JOBS
+
+typedef enum {
+    WH_SERVER_JOB_FREE    = 0,
+    WH_SERVER_JOB_QUEUED  = 1,
+    WH_SERVER_JOB_RUNNING = 2,
+    WH_SERVER_JOB_DONE    = 3,
+} whServerJobState;
+
+/* An RSA keygen left to run while the server is otherwise idle, or on a
+ * crypto worker, instead of blocking the request that started it */
+typedef struct {
+    int      state;         /* whServerJobState */
+    int      rc;
+    uint32_t size;
+    uint32_t e;
+    uint16_t id;            /* Handle given to the client, never 0 */
+    uint16_t comm_index;    /* Channel of the client that owns the job */
+    whKeyId  keyId;         /* Full id of the cached key once done */
+    uint8_t  padding[2];
+} whServerJob;
+#endif
+
+/** Server streams */
+
+/* Number of AES, hash, HMAC and CMAC streams that can be open at once, 0
+ * disables them */
+#ifndef WH_SERVER_STREAM_COUNT
+#define WH_SERVER_STREAM_COUNT 2
+#endif
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_STREAM_COUNT > 0) && \
+    (!defined(NO_AES) || !defined(NO_SHA256) || defined(WOLFSSL_SHA384) || \
+     defined(WOLFSSL_SHA512))
+#define WH_SERVER_STREAMS
+
+/* Cipher or hash state kept between the requests of a stream too large for
+ * one packet */
+typedef struct {
+    union {
+#ifndef NO_AES
+        Aes       aes[1];
+#endif
+#ifndef NO_SHA256
+        wc_Sha256 sha256[1];
+#endif
+#ifdef WOLFSSL_SHA384
+        wc_Sha384 sha384[1];
+#endif
+#ifdef WOLFSSL_SHA512
+        wc_Sha512 sha512[1];
+#endif
+#ifndef NO_HMAC
+        Hmac      hmac[1];
+#endif
+#ifdef WOLFSSL_CMAC
+        Cmac      cmac[1];
+#endif
+    } state;
+    whCommServer* comm;     /* Client that opened the stream, NULL if free */
+    uint32_t      handle;   /* Handle given to the client, 1 to 0xFFFF */
+    uint32_t      algo;     /* WC_ALGO_TYPE_CIPHER, _HASH, _HMAC or _CMAC */
+    uint32_t      type;     /* WC_CIPHER_AES_* or WC_HASH_TYPE_* */
+    uint8_t       enc;
+    uint8_t       busy;     /* Held by a request */
+    uint8_t       padding[2];
+} whServerStream;
+#endif
+
+
+/** Server run loop */
+
+/* Sleeps until a transport may have a request or timeout_ms has elapsed, e.g.
+ * on an interrupt (WFI), a semaphore posted by the transport notify hooks, or
+ * poll/epoll on the transport fds. Early returns are harmless. A timeout_ms of
+ * 0 waits without a timeout. A non-zero return stops wh_Server_Run */
+typedef int (*whServerWaitCb)(void* context, uint32_t timeout_ms);
+
+/* Deferred maintenance done while no request is waiting, e.g. reseeding an
+ * RNG. Returns 1 if there is more to do, 0 if not, or a negative error */
+typedef int (*whServerIdleCb)(void* context, whServerContext* server);
+
+/* Settings for wh_Server_Run and wh_Server_RunIdle */
+typedef struct {
+    whServerWaitCb wait_cb;          /* Optional. Polls without it */
+    whServerIdleCb idle_cb;          /* Optional port maintenance */
+    void*          context;          /* Passed to both callbacks */
+    uint32_t       timeout_ms;       /* Longest sleep, 0 for no limit */
+    uint32_t       nvm_reclaim_size; /* Compact NVM once this many bytes can
+                                      * be reclaimed. 0 never compacts */
+    uint32_t       nvm_compact_size; /* Object bytes copied per compaction
+                                      * step. 0 compacts in a single step */
+    uint8_t        exit_disconnected; /* Nonzero for wh_Server_Run to return
+                                       * once no channel is connected */
+    uint8_t        padding[3];
+} whServerRunConfig;
+
+
 /** Server config and context */
 
 typedef struct whServerConfig_t {
     whCommServerConfig* comm_config;
+    uint8_t             comm_max_class; /* Highest WH_COMM_CLASS_* the client
+                                         * of comm_config may request */
+    uint8_t             comm_padding[7];
     whNvmContext*       nvm;
+    whCounterContext*   counter;    /* Optional counter store */
 
 #ifndef WOLFHSM_NO_CRYPTO
     crypto_context* crypto;
@@ -175,28 +584,123 @@ typedef struct whServerConfig_t {
                             */
     int devId;
 #endif
+#if WH_SERVER_WORKER_COUNT > 0
+    whServerWorkerConfig* worker_config; /* Optional crypto worker pool */
+#endif
+    /* Optional full key ids, including type and client_id, loaded into the
+     * key cache by wh_Server_Init along with NVM objects flagged
+     * WOLFHSM_NVM_FLAGS_PREFETCH */
+    const whNvmId* prefetch_ids;
+    uint16_t       prefetch_count;
 #endif /* WOLFHSM_NO_CRYPTO */
     whServerDmaConfig* dmaConfig;
+    whServerRunConfig* run_config;  /* Optional wh_Server_Run settings */
+#ifdef WOLFHSM_SERVER_STATS
+    whServerTimeCb stats_time_cb;   /* Optional. Times are 0 without it */
+    void*          stats_time_context;
+#endif
 } whServerConfig;
 
 
+/* Number of comm channels, e.g. one per client core, a server can service */
+#ifndef WH_SERVER_COMM_COUNT
+#define WH_SERVER_COMM_COUNT 1
+#endif
+
+/* State of one comm channel serviced by a server */
+typedef struct {
+    whServerContext* server;    /* For the transport connect callback */
+    whCommServer     comm[1];
+    int              connected;
+    uint8_t          priority;  /* Higher values are serviced first */
+    uint8_t          busy;      /* A worker holds this channel's request */
+    uint8_t          held;      /* A received request waits to be handled */
+    uint8_t          cls;       /* WH_COMM_CLASS_* of the waiting request */
+    uint8_t          max_cls;   /* Highest WH_COMM_CLASS_* allowed */
+    uint8_t          cls_padding[7];
+    uint16_t         magic;     /* Header of the waiting request */
+    uint16_t         kind;
+    uint16_t         seq;
+    uint16_t         size;
+} whServerComm;
+
 /* Context structure to maintain the state of an HSM server */
 struct whServerContext_t {
-    whCommServer  comm[1];
+    /* Channel of the request being handled. Handlers use its client_id */
+    whCommServer* comm;
+    whServerComm  comms[WH_SERVER_COMM_COUNT];
+    uint16_t      comm_count;
+    uint16_t      comm_current;  /* Index of comm */
+    uint16_t      comm_next;     /* Next channel to check at each priority */
+    uint8_t       comm_padding[2];
     whNvmContext* nvm;
+    whCounterContext* counter;
 #ifndef WOLFHSM_NO_CRYPTO
     crypto_context* crypto;
     CacheSlot       cache[WOLFHSM_NUM_RAMKEYS];
+    uint8_t         cacheArena[WH_SERVER_KEYCACHE_ARENA_SIZE];
+    /* Open addressing index of cached key ids, holding 1 + slot or 0 */
+    uint16_t        cacheIndex[WOLFHSM_KEYCACHE_INDEX_SIZE];
+    uint32_t        cacheTick;  /* Counts key cache accesses */
+    uint16_t        keyIdMapNext; /* Next map to replace */
+    uint8_t         cachePadding[2];
+    uint32_t        keyGeneration; /* Bumped whenever a cached key changes */
+    whServerKeyIdMap keyIdMap[WH_SERVER_KEYID_MAP_COUNT];
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+    whServerDecodedKey decoded[WH_SERVER_DECODED_KEY_COUNT];
+#endif
 #ifdef WOLFHSM_SHE_EXTENSION
     she_context* she;
 #endif
+#ifdef WH_SERVER_KEYGEN_JOBS
+    whServerJob job[WH_SERVER_JOB_COUNT];
+    uint16_t    job_next_id;
+    uint8_t     job_padding[6];
+#endif
+#ifdef WH_SERVER_STREAMS
+    whServerStream stream[WH_SERVER_STREAM_COUNT];
+    uint32_t       stream_next_handle;
+    uint8_t        stream_padding[4];
+#endif
+#if WH_SERVER_RNG_POOL_SIZE > 0
+    uint32_t rngPoolCount;  /* Unused bytes at the start of rngPool */
+    uint8_t  rngPoolPadding[4];
+    uint8_t  rngPool[WH_SERVER_RNG_POOL_SIZE];
+#endif
+#if WH_SERVER_EPHEMERAL_ECC_COUNT > 0
+    whServerEphemeralKey ephemeralEcc[WH_SERVER_EPHEMERAL_ECC_COUNT];
+#endif
+#if WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0
+    whServerEphemeralKey
+        ephemeralCurve25519[WH_SERVER_EPHEMERAL_CURVE25519_COUNT];
+#endif
+#if WH_SERVER_WORKER_COUNT > 0
+    whServerWorker worker[WH_SERVER_WORKER_COUNT];
+    whServerWorkerStartCb worker_start_cb;
+    whServerLockCb        lock_cb;
+    whServerLockCb        unlock_cb;
+    void*                 worker_cb_context;
+#endif
 #endif /* WOLFHSM_NO_CRYPTO */
     whServerCustomCb   customHandlerTable[WH_CUSTOM_CB_NUM_CALLBACKS];
+    whServerCustomBulkCb customBulkHandlerTable[WH_CUSTOM_CB_NUM_CALLBACKS];
     whServerDmaContext dma;
-    int                connected;
-#ifdef WOLFHSM_SHE_EXTENSION
+    whServerRunConfig  run;
+    int                nvm_compacting;  /* Compaction steps remain */
+    int                idle_error;      /* Last failed wh_Server_RunIdle of
+                                         * wh_Server_Run, 0 if none */
+#ifndef WOLFHSM_NO_BATCH
+    /* Copy of a batch request and the response buffer for each entry */
+    uint64_t batch_req[WH_MESSAGE_BATCH_U64_COUNT];
+    uint64_t batch_work[WH_MESSAGE_BATCH_U64_COUNT];
+#endif
+#ifdef WOLFHSM_SERVER_STATS
+    whMessageCommStatsEntry stats[WH_SERVER_STATS_COUNT];
+    uint16_t                stats_count;
+    uint8_t                 stats_padding[6];
+    whServerTimeCb          stats_time_cb;
+    void*                   stats_time_context;
 #endif
-    uint8_t padding[4];
 };
 
 
@@ -211,7 +715,10 @@ struct whServerContext_t {
  *
  * This function must be called before any other server functions are used on
  * the supplied context. Note that the NVM and Crypto components of the config
- * structure MUST be initialized before calling this function.
+ * structure MUST be initialized before calling this function. Keys listed in
+ * prefetch_ids or flagged WOLFHSM_NVM_FLAGS_PREFETCH are loaded into free
+ * key cache slots, and any that are missing or don't fit are loaded on first
+ * use as usual.
  *
  * @param[in] server Pointer to the server context.
  * @param[in] config Pointer to the server configuration.
@@ -259,6 +766,74 @@ int wh_Server_SetConnectedCb(void* s, whCommConnected connected);
 int wh_Server_GetConnected(whServerContext* server,
                            whCommConnected* out_connected);
 
+/**
+ * @brief Adds a comm channel for another client to the server.
+ *
+ * The comm channel in the server configuration is channel 0. Each additional
+ * channel, up to WH_SERVER_COMM_COUNT in total, serves one more client from
+ * the same NVM, key cache and crypto contexts. Keys remain isolated by the
+ * client_id each client sends during comm init. Its client may request at
+ * most the interactive class until wh_Server_SetCommMaxClass allows more.
+ *
+ * Channels are polled one after another, so no transport may block while it
+ * waits for a request. A blocking transport wait, such as a memory transport
+ * wait_cb without a timeout, stalls every other channel until it returns.
+ * Sleep in the whServerRunConfig wait_cb instead.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] config Pointer to the comm server configuration of the channel.
+ * @param[in] priority Scheduling priority. Higher values are serviced first.
+ * @param[out] out_index Optional pointer to store the index of the channel.
+ * @return int Returns 0 on success, WH_ERROR_BADARGS if the arguments are
+ * invalid, WH_ERROR_NOSPACE if all channels are in use, or WH_ERROR_ABORTED
+ * if the comm server fails to initialize.
+ */
+int wh_Server_AddComm(whServerContext* server, whCommServerConfig* config,
+                      uint8_t priority, uint16_t* out_index);
+
+/**
+ * @brief Sets the scheduling priority of a comm channel.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] index Index of the channel.
+ * @param[in] priority Scheduling priority. Higher values are serviced first.
+ * @return int Returns 0 on success, or WH_ERROR_BADARGS if the arguments are
+ * invalid.
+ */
+int wh_Server_SetCommPriority(whServerContext* server, uint16_t index,
+                              uint8_t priority);
+
+/**
+ * @brief Sets the highest request class the client of a comm channel may use.
+ *
+ * The class is chosen by the client, so a request of a higher class than
+ * allowed is scheduled as the allowed class instead. The realtime class is
+ * above interactive, which is above bulk.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] index Index of the channel.
+ * @param[in] max_cls Highest WH_COMM_CLASS_* allowed.
+ * @return int Returns 0 on success, or WH_ERROR_BADARGS if the arguments are
+ * invalid.
+ */
+int wh_Server_SetCommMaxClass(whServerContext* server, uint16_t index,
+                              uint8_t max_cls);
+
+/**
+ * @brief Sets the connection state of a single comm channel.
+ *
+ * wh_Server_SetConnected applies to the channel most recently serviced, which
+ * is channel 0 until a request has been handled.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] index Index of the channel.
+ * @param[in] connected The connection state to set.
+ * @return int Returns 0 on success, or WH_ERROR_BADARGS if the arguments are
+ * invalid.
+ */
+int wh_Server_SetCommConnected(whServerContext* server, uint16_t index,
+                               whCommConnected connected);
+
 /**
  * @brief Handles incoming request messages and dispatches them to the
  * appropriate handlers.
@@ -268,6 +843,16 @@ int wh_Server_GetConnected(whServerContext* server,
  * and dispatches the request to the appropriate handler. The function also
  * sends a response back to the client.
  *
+ * With several comm channels, at most one request is handled per call. The
+ * waiting requests are taken by the class carried in their header, see
+ * WH_COMM_CLASS_*, then from the highest channel priority down. Channels of
+ * equal rank take turns.
+ *
+ * With a crypto worker pool, crypto requests are handed to an idle worker, or
+ * handled inline when none is idle. Bulk class requests instead wait for a
+ * worker so they never hold up the server. Responses of finished workers are
+ * sent first, and a channel is not checked again until its response was sent.
+ *
  * @param[in] server Pointer to the server context.
  * @return int Returns 0 on success, WH_ERROR_BADARGS if the arguments are
  * invalid, WH_ERROR_NOTREADY if the server is not connected or no data is
@@ -275,6 +860,77 @@ int wh_Server_GetConnected(whServerContext* server,
  */
 int wh_Server_HandleRequestMessage(whServerContext* server);
 
+/**
+ * @brief Services requests until no comm channel is connected.
+ *
+ * Repeatedly calls wh_Server_HandleRequestMessage. Whenever there is nothing
+ * to do, deferred maintenance is done with wh_Server_RunIdle and then the
+ * server sleeps in the wait callback of the run configuration until a
+ * transport signals data or the timeout elapses. Without a wait callback the
+ * server keeps polling. A failed maintenance step is kept in idle_error and
+ * the server sleeps as if there was nothing to do, so it keeps serving.
+ *
+ * @param[in] server Pointer to the server context.
+ * @return int Returns 0 once all channels are disconnected if
+ * exit_disconnected is set, WH_ERROR_BADARGS if the arguments are invalid,
+ * the non-zero return of the wait callback, or a negative error code of a
+ * failed request.
+ */
+int wh_Server_Run(whServerContext* server);
+
+/**
+ * @brief Does one step of deferred maintenance.
+ *
+ * Compacts NVM once at least nvm_reclaim_size bytes can be reclaimed, one
+ * step of about nvm_compact_size bytes per call, if the NVM backend has
+ * GetAvailable and Compact callbacks, and otherwise calls the idle
+ * callback of the run configuration. Ports with
+ * their own loop may call this whenever wh_Server_HandleRequestMessage
+ * returns WH_ERROR_NOTREADY.
+ *
+ * @param[in] server Pointer to the server context.
+ * @return int Returns 1 if a step was done and there may be more to do, 0 if
+ * there is nothing to do, WH_ERROR_BADARGS if the arguments are invalid, or
+ * a negative error code on failure.
+ */
+int wh_Server_RunIdle(whServerContext* server);
+
+/**
+ * @brief Takes the lock shared by the server and its crypto workers.
+ *
+ * Handlers dispatched by wh_Server_HandleRequestMessage already run under the
+ * lock, except for crypto requests which only take it around key cache
+ * access. Does nothing when no worker pool or lock callback is configured.
+ *
+ * @param[in] server Pointer to the server context.
+ */
+void wh_Server_Lock(whServerContext* server);
+
+/**
+ * @brief Releases the lock taken by wh_Server_Lock.
+ *
+ * @param[in] server Pointer to the server context.
+ */
+void wh_Server_Unlock(whServerContext* server);
+
+#if !defined(WOLFHSM_NO_CRYPTO) && (WH_SERVER_WORKER_COUNT > 0)
+/**
+ * @brief Handles the crypto request handed to a worker.
+ *
+ * Called by the port on the worker's own thread or core after the worker
+ * start callback fired. Uses only the worker's crypto context. The response
+ * is sent on the originating comm channel by the next call to
+ * wh_Server_HandleRequestMessage, so the port should wake the server loop
+ * once this returns.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] index Index of the worker.
+ * @return int Returns 0 on success, WH_ERROR_BADARGS if the arguments are
+ * invalid, or WH_ERROR_NOTREADY if the worker has no request.
+ */
+int wh_Server_WorkerRun(whServerContext* server, uint16_t index);
+#endif
+
 /**
  * @brief Cleans up the server context and associated resources.
  *
@@ -306,6 +962,24 @@ int wh_Server_Cleanup(whServerContext* server);
 int wh_Server_RegisterCustomCb(whServerContext* server, uint16_t actionId,
                                whServerCustomCb cb);
 
+/**
+ * @brief Registers a bulk custom callback handler for a specific action.
+ *
+ * Bulk handlers serve WH_MESSAGE_CUSTOM_CB_TYPE_BULK requests, whose payload
+ * is passed in place and may use the whole comm data buffer less the
+ * whMessageCustomCb_BulkHeader. Regions larger than that are better described
+ * with a DMA32/DMA64 request and read with the server DMA functions. An action
+ * may have both a regular and a bulk handler.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] actionId The action ID for which the callback is being registered.
+ * @param[in] cb The bulk custom callback handler to register.
+ * @return int Returns WH_ERROR_OK on success, or WH_ERROR_BADARGS if the
+ * arguments are invalid.
+ */
+int wh_Server_RegisterCustomBulkCb(whServerContext* server, uint16_t actionId,
+                                   whServerCustomBulkCb cb);
+
 /**
  * @brief Handles incoming custom callback requests.
  *
@@ -371,7 +1045,9 @@ int wh_Server_DmaRegisterCb64(struct whServerContext_t* server,
  * This function allows the server to register a list of allowable client
  * addresses for DMA read and write operations. The server will check
  * these addresses during DMA operations to ensure they are within the
- * allowed range for the client
+ * allowed range for the client. The lists are sorted and merged into an index
+ * when registered, so changes made afterwards require registering them again.
+ * Overlapping or adjacent entries act as a single range.
  *
  * @param[in] server Pointer to the server context.
  * @param[in] allowlist Pointer to the list of allowable client addresses.
@@ -446,6 +1122,28 @@ int wh_Server_DmaProcessClientAddress64(struct whServerContext_t* server,
                                         uint64_t len, whServerDmaOper oper,
                                         whServerDmaFlags flags);
 
+/**
+ * @brief Processes a client address carried in a 64-bit request field.
+ *
+ * This function passes the address to wh_Server_DmaProcessClientAddress64,
+ * or to wh_Server_DmaProcessClientAddress32 when only the 32-bit callback is
+ * registered, as on a 32-bit platform.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] clientAddr The client address to be processed.
+ * @param[out] serverPtr Pointer to store the transformed server address.
+ * @param[in] len The length of the memory operation.
+ * @param[in] oper The DMA operation type (e.g., read or write).
+ * @param[in] flags Flags for the DMA operation.
+ * @return int Returns WH_ERROR_OK on success, WH_ERROR_BADARGS if the arguments
+ * are invalid or do not fit the 32-bit callback, or a negative error code on
+ * failure.
+ */
+int wh_Server_DmaProcessClientAddress(struct whServerContext_t* server,
+                                      uint64_t clientAddr, void** serverPtr,
+                                      uint64_t len, whServerDmaOper oper,
+                                      whServerDmaFlags flags);
+
 /**
  * @brief Copies data from a client address to a server address on 32-bit
  * systems.
@@ -531,4 +1229,77 @@ int whServerDma_CopyToClient32(struct whServerContext_t* server,
 int whServerDma_CopyToClient64(struct whServerContext_t* server,
                                uint64_t clientAddr, void* serverPtr, size_t len,
                                whServerDmaFlags flags);
+
+/**
+ * @brief Processes one segment of a scatter-gather client address list.
+ *
+ * This function passes the segment to wh_Server_DmaProcessClientAddress64 or,
+ * for a 32-bit client, to wh_Server_DmaProcessClientAddress32, so the
+ * registered DMA callback and the allowlist are applied to each segment.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] seg The client segment to process.
+ * @param[in] addr64 Nonzero if the segment holds a 64-bit client address.
+ * @param[out] xformedCliAddr Pointer to store the transformed address.
+ * @param[in] oper The DMA operation type (e.g., read or write).
+ * @param[in] flags Flags for the DMA operation.
+ * @return int Returns WH_ERROR_OK on success, WH_ERROR_BADARGS if the arguments
+ * are invalid or a 32-bit address does not fit, or a negative error code on
+ * failure.
+ */
+int wh_Server_DmaProcessClientSegment(struct whServerContext_t* server,
+                                      const whDmaSegment* seg, int addr64,
+                                      void** xformedCliAddr,
+                                      whServerDmaOper oper,
+                                      whServerDmaFlags flags);
+
+/**
+ * @brief Gathers data from a list of client segments into a server buffer.
+ *
+ * This function performs one DMA read per segment, copying the segments in
+ * order into consecutive bytes of the server buffer. The server buffer is
+ * checked against the allowlist once, and each client segment is processed
+ * with the DMA callback before and after its copy. Zero-length segments are
+ * skipped.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[out] serverPtr Pointer to the server memory where data will be copied.
+ * @param[in] len The length of the server buffer. Must equal the sum of the
+ * segment lengths.
+ * @param[in] segs The client segments to copy from.
+ * @param[in] count The number of segments, at most WH_DMA_MAX_SEGMENTS.
+ * @param[in] addr64 Nonzero if the segments hold 64-bit client addresses.
+ * @param[in] flags Flags for the DMA operation.
+ * @return int Returns WH_ERROR_OK on success, WH_ERROR_BADARGS if the arguments
+ * are invalid, or a negative error code on failure.
+ */
+int whServerDma_CopyFromClientSg(struct whServerContext_t* server,
+                                 void* serverPtr, size_t len,
+                                 const whDmaSegment* segs, uint16_t count,
+                                 int addr64, whServerDmaFlags flags);
+
+/**
+ * @brief Scatters data from a server buffer to a list of client segments.
+ *
+ * This function performs one DMA write per segment, copying consecutive bytes
+ * of the server buffer to the segments in order. The server buffer is checked
+ * against the allowlist once, and each client segment is processed with the
+ * DMA callback before and after its copy. Zero-length segments are skipped.
+ *
+ * @param[in] server Pointer to the server context.
+ * @param[in] segs The client segments to copy to.
+ * @param[in] count The number of segments, at most WH_DMA_MAX_SEGMENTS.
+ * @param[in] addr64 Nonzero if the segments hold 64-bit client addresses.
+ * @param[in] serverPtr Pointer to the server memory from which data will be
+ * copied.
+ * @param[in] len The length of the server buffer. Must equal the sum of the
+ * segment lengths.
+ * @param[in] flags Flags for the DMA operation.
+ * @return int Returns WH_ERROR_OK on success, WH_ERROR_BADARGS if the arguments
+ * are invalid, or a negative error code on failure.
+ */
+int whServerDma_CopyToClientSg(struct whServerContext_t* server,
+                               const whDmaSegment* segs, uint16_t count,
+                               int addr64, void* serverPtr, size_t len,
+                               whServerDmaFlags flags);
 #endif /* WOLFHSM_WH_SERVER_H_ */
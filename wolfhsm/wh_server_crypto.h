@@ -24,5 +24,44 @@
 int wh_Server_HandleCryptoRequest(whServerContext* server, uint16_t action,
     uint8_t* data, uint16_t* size);
 
+#ifndef WOLFHSM_NO_CRYPTO
+/* Same, using the given crypto context and acting for the client on comm */
+int wh_Server_HandleCryptoRequestEx(whServerContext* server,
+    crypto_context* crypto, whCommServer* comm, uint16_t action,
+    uint8_t* data, uint16_t* size);
+
+/* Read the public part of keyId, of type WOLFHSM_KEYFLAG_ECC or
+ * WOLFHSM_KEYFLAG_RSA, into out of *outSz bytes: qx | qy for ECC and the
+ * public key DER for RSA. The private part is wiped from out */
+int hsmExportPublicKey(whServerContext* server, whKeyId keyId, uint32_t type,
+    whNvmMetadata* outMeta, uint8_t* out, uint32_t* outSz);
+
+#if WH_SERVER_DECODED_KEY_COUNT > 0
+/* Drop the decoded copy of the full keyId, called with the server lock held
+ * whenever the cached key changes or leaves the cache */
+void hsmInvalidateDecodedKey(whServerContext* server, whKeyId keyId);
+/* Free all decoded keys */
+void hsmFreeDecodedKeys(whServerContext* server);
+#endif
+
+#if WH_SERVER_RNG_POOL_SIZE > 0
+/* Top up the RNG pool from the server DRBG. Returns 1 if bytes were added, 0
+ * if it was full, or a negative error */
+int hsmRefillRngPool(whServerContext* server);
+#endif
+
+#if (WH_SERVER_EPHEMERAL_ECC_COUNT > 0) || \
+    (WH_SERVER_EPHEMERAL_CURVE25519_COUNT > 0)
+/* Generate one ephemeral key for a pool with room. Returns 1 if a key was
+ * added, 0 if the pools were full, or a negative error */
+int hsmRefillEphemeralKeys(whServerContext* server);
+#endif
+
+#ifdef WH_SERVER_STREAMS
+/* Close the streams opened on comm, or all of them if comm is NULL */
+void hsmFreeStreams(whServerContext* server, whCommServer* comm);
+#endif
+#endif
+
 
 #endif
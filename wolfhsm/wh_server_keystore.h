@@ -22,14 +22,29 @@
 #include "wolfhsm/wh_server.h"
 
 int hsmGetUniqueId(whServerContext* server, whNvmId* outId);
-int hsmCacheFindSlot(whServerContext* server);
+/* Changes whenever any cached or NVM key may have changed */
+uint32_t hsmKeyGeneration(whServerContext* server);
+void hsmCacheInit(whServerContext* server);
+int hsmCacheFindSlot(whServerContext* server, uint32_t size);
+int hsmCacheFindKey(whServerContext* server, whNvmId keyId);
+int hsmKeyIsPinned(whServerContext* server, whNvmId keyId);
+void hsmCacheSetMeta(whServerContext* server, int slot,
+    const whNvmMetadata* meta);
 int hsmCacheKey(whServerContext* server, whNvmMetadata* meta, uint8_t* in);
 int hsmFreshenKey(whServerContext* server, whKeyId keyId);
+void hsmCachePrefetch(whServerContext* server, const whNvmId* ids,
+    uint16_t count);
 int hsmReadKey(whServerContext* server, whKeyId keyId, whNvmMetadata* outMeta,
     uint8_t* out, uint32_t* outSz);
 int hsmEvictKey(whServerContext* server, uint16_t keyId);
 int hsmCommitKey(whServerContext* server, uint16_t keyId);
 int hsmEraseKey(whServerContext* server, whNvmId keyId);
+#ifdef WH_SERVER_KEYGEN_JOBS
+int hsmStartKeygenJob(whServerContext* server, uint32_t size, uint32_t e,
+    uint32_t* outJobId);
+int hsmPollKeygenJob(whServerContext* server, uint32_t jobId,
+    uint32_t* outDone, uint32_t* outKeyId);
+#endif
 int wh_Server_HandleKeyRequest(whServerContext* server, uint16_t magic,
     uint16_t action, uint16_t seq, uint8_t* data, uint16_t* size);
 
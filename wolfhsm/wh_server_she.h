@@ -27,4 +27,11 @@ typedef struct {
 
 int wh_Server_HandleSheRequest(whServerContext* server,
     uint16_t action, uint8_t* data, uint16_t* size);
+
+#if WH_SHE_RND_POOL_COUNT > 0
+/* Compute the next SHE PRNG outputs ahead of time. Returns 1 if any were
+ * added, 0 if the pool was full or the PRNG is not initialized, or a negative
+ * error */
+int hsmSheRefillRnd(whServerContext* server);
+#endif
 #endif
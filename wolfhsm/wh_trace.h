@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_trace.h
+ *
+ * Hot path tracing.  Built with WOLFHSM_TRACE, probe points in the comm,
+ * server dispatch, keystore, NVM and flash layers record a time stamp into a
+ * ring buffer that can be read out later or streamed as entries are recorded.
+ * Without WOLFHSM_TRACE the probes compile to nothing.
+ *
+ * The ring is shared by everything in the image and is not locked.  Entries
+ * recorded by threads at the same time may overwrite each other.
+ */
+
+#ifndef WOLFHSM_WH_TRACE_H_
+#define WOLFHSM_WH_TRACE_H_
+
+#include <stdint.h>
+
+/* Events.  Each is recorded with two arguments as noted */
+enum {
+    WH_TRACE_NONE           = 0,
+    WH_TRACE_CLIENT_REQUEST = 1,  /* kind, seq << 16 | size */
+    WH_TRACE_TRANSPORT_SEND = 2,  /* kind, seq << 16 | size, once sent */
+    WH_TRACE_TRANSPORT_RECV = 3,  /* kind, seq << 16 | size, once received */
+    WH_TRACE_SERVER_BEGIN   = 4,  /* kind, seq.  Dispatch to a handler */
+    WH_TRACE_SERVER_END     = 5,  /* kind, rc */
+    WH_TRACE_KEY_HIT        = 6,  /* keyId, 0.  Served from the key cache */
+    WH_TRACE_KEY_MISS       = 7,  /* keyId, 0.  Read from NVM */
+    WH_TRACE_NVM_BEGIN      = 8,  /* WH_TRACE_NVM_*, id or 0 */
+    WH_TRACE_NVM_END        = 9,  /* WH_TRACE_NVM_*, rc */
+    WH_TRACE_FLASH_BEGIN    = 10, /* WH_TRACE_FLASH_*, bytes */
+    WH_TRACE_FLASH_END      = 11, /* WH_TRACE_FLASH_*, rc */
+};
+
+/* NVM operations */
+enum {
+    WH_TRACE_NVM_INIT           = 0,
+    WH_TRACE_NVM_ADD            = 1,
+    WH_TRACE_NVM_ADD_COMMIT     = 2,
+    WH_TRACE_NVM_LIST           = 3,
+    WH_TRACE_NVM_GETMETADATA    = 4,
+    WH_TRACE_NVM_DESTROY        = 5,
+    WH_TRACE_NVM_READ           = 6,
+    WH_TRACE_NVM_COMPACT        = 7,
+};
+
+/* Flash operations */
+enum {
+    WH_TRACE_FLASH_READ     = 0,
+    WH_TRACE_FLASH_PROGRAM  = 1,
+    WH_TRACE_FLASH_ERASE    = 2,
+    WH_TRACE_FLASH_COPY     = 3,
+};
+
+/* One recorded probe */
+typedef struct {
+    uint64_t time;      /* From the time source, 0 without one */
+    uint32_t arg;
+    uint16_t event;     /* WH_TRACE_* */
+    uint16_t arg16;
+} whTraceEntry;
+
+/* Returns a free-running cycle count or time stamp */
+typedef uint64_t (*whTraceTimeCb)(void* context);
+
+/* Called with each entry as it is recorded, e.g. to write it to a UART */
+typedef void (*whTraceStreamCb)(void* context, const whTraceEntry* entry);
+
+typedef struct {
+    whTraceTimeCb   time_cb;    /* Optional. Times are 0 without it */
+    whTraceStreamCb stream_cb;  /* Optional */
+    void*           context;    /* Passed to the callbacks */
+} whTraceConfig;
+
+#ifdef WOLFHSM_TRACE
+
+/* Entries kept in the ring.  The oldest are overwritten once it is full */
+#ifndef WH_TRACE_COUNT
+#define WH_TRACE_COUNT 256
+#endif
+
+/* A port may define WH_TRACE_TIMESTAMP() to read a cycle counter directly
+ * rather than through time_cb, e.g. the DWT CYCCNT register on Cortex-M */
+
+/* Empty the ring and set the callbacks.  NULL config clears them */
+int wh_Trace_Init(const whTraceConfig* config);
+
+void wh_Trace_Record(uint16_t event, uint16_t arg16, uint32_t arg);
+
+/* Move up to *inout_count of the oldest entries into out and update
+ * *inout_count with the number moved.  Optional out_lost is set to the
+ * number of entries overwritten before they were read since the last call */
+int wh_Trace_Read(whTraceEntry* out, uint32_t* inout_count,
+        uint32_t* out_lost);
+
+#define WH_TRACE(_event, _arg16, _arg) \
+    wh_Trace_Record((uint16_t)(_event), (uint16_t)(_arg16), (uint32_t)(_arg))
+
+#else
+
+#define WH_TRACE(_event, _arg16, _arg) do { } while (0)
+
+#endif /* WOLFHSM_TRACE */
+
+/* Pack a sequence number and a size into one argument */
+#define WH_TRACE_SEQ_SIZE(_seq, _size) \
+    ((((uint32_t)(_seq) & 0xFFFF) << 16) | ((uint32_t)(_size) & 0xFFFF))
+
+#endif /* WOLFHSM_WH_TRACE_H_ */
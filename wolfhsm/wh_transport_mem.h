@@ -54,6 +54,16 @@
  *  2. Set response id to requestid: resp->notify = req_id
  *  3. Optionally send notify interrupt to client
  *
+ * Optional notify/wait hooks let a port replace busy polling with an
+ * inter-processor interrupt, doorbell or semaphore.  When a receive would
+ * return WH_ERROR_NOTREADY, that side increments the wait field of its own
+ * CSR, rechecks the peer's notify and then calls the wait hook to sleep.
+ * After a send, each side compares the peer's wait field with the ack field
+ * of its own CSR.  If they differ, the peer is sleeping, so the ack is updated
+ * and the notify hook is called to wake it.  The wait hook may return early
+ * (e.g. on a timeout) since callers will simply retry.  Each side may use its
+ * own configuration so that the hooks and argument can differ.
+ *
  *
  * Example usage:
  *
@@ -95,10 +105,24 @@
 
 #include "wolfhsm/wh_comm.h"
 
+/* Optional hook to wake the other side, e.g. by raising an interrupt */
+typedef int (*whTransportMemNotifyCb)(void* arg);
+
+/* Optional hook to sleep until woken by the other side or a timeout. It is
+ * called from inside RecvRequest/RecvResponse, so it must return within a
+ * bounded time. On a server servicing several comm channels, a sleep here
+ * holds up every other channel and wh_Server_RunIdle until it returns. Such
+ * servers should leave it NULL on their side and sleep in the
+ * whServerRunConfig wait_cb instead */
+typedef int (*whTransportMemWaitCb)(void* arg);
+
 /** Common configuration structure */
 typedef struct {
     void* req;
     void* resp;
+    whTransportMemNotifyCb notify_cb;   /* Opt: Wake the other side */
+    whTransportMemWaitCb wait_cb;       /* Opt: Sleep until woken */
+    void* cb_arg;                       /* Opt: Passed to notify/wait hooks */
     uint16_t req_size;
     uint16_t resp_size;
     uint8_t padding[4];
@@ -123,6 +147,9 @@ typedef struct {
     volatile whTransportMemCsr* resp;
     void* req_data;
     void* resp_data;
+    whTransportMemNotifyCb notify_cb;
+    whTransportMemWaitCb wait_cb;
+    void* cb_arg;
     int initialized;
     uint16_t req_size;
     uint16_t resp_size;
@@ -143,20 +170,36 @@ int wh_TransportMem_RecvRequest(void* c, uint16_t *out_len, void* data);
 int wh_TransportMem_SendResponse(void* c, uint16_t len, const void* data);
 int wh_TransportMem_RecvResponse(void* c, uint16_t *out_len, void* data);
 
-#define WH_TRANSPORT_MEM_CLIENT_CB              \
-{                                               \
-    .Init =     wh_TransportMem_InitClear,      \
-    .Send =     wh_TransportMem_SendRequest,    \
-    .Recv =     wh_TransportMem_RecvResponse,   \
-    .Cleanup =  wh_TransportMem_Cleanup,        \
+/* Optional zero-copy callbacks.  These lend the shared request and response
+ * data buffers to the comm layer so packets are built and parsed in place.
+ * Send and Recv skip their copy when passed the lent buffer. */
+int wh_TransportMem_AcquireSendRequest(void* c, uint16_t *out_len,
+        void** out_buffer);
+int wh_TransportMem_AcquireRecvRequest(void* c, uint16_t *out_len,
+        void** out_buffer);
+int wh_TransportMem_AcquireSendResponse(void* c, uint16_t *out_len,
+        void** out_buffer);
+int wh_TransportMem_AcquireRecvResponse(void* c, uint16_t *out_len,
+        void** out_buffer);
+
+#define WH_TRANSPORT_MEM_CLIENT_CB                      \
+{                                                       \
+    .Init =         wh_TransportMem_InitClear,          \
+    .Send =         wh_TransportMem_SendRequest,        \
+    .Recv =         wh_TransportMem_RecvResponse,       \
+    .Cleanup =      wh_TransportMem_Cleanup,            \
+    .AcquireSend =  wh_TransportMem_AcquireSendRequest, \
+    .AcquireRecv =  wh_TransportMem_AcquireRecvResponse,\
 }
 
-#define WH_TRANSPORT_MEM_SERVER_CB              \
-{                                               \
-    .Init =     wh_TransportMem_Init,           \
-    .Recv =     wh_TransportMem_RecvRequest,    \
-    .Send =     wh_TransportMem_SendResponse,   \
-    .Cleanup =  wh_TransportMem_Cleanup,        \
+#define WH_TRANSPORT_MEM_SERVER_CB                      \
+{                                                       \
+    .Init =         wh_TransportMem_Init,               \
+    .Recv =         wh_TransportMem_RecvRequest,        \
+    .Send =         wh_TransportMem_SendResponse,       \
+    .Cleanup =      wh_TransportMem_Cleanup,            \
+    .AcquireRecv =  wh_TransportMem_AcquireRecvRequest, \
+    .AcquireSend =  wh_TransportMem_AcquireSendResponse,\
 }
 
 
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2024 wolfSSL Inc.
+ *
+ * This file is part of wolfHSM.
+ *
+ * wolfHSM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfHSM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfHSM.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * wolfhsm/wh_transport_memring.h
+ *
+ * wolfHSM Transport binding using 2 memory blocks split into multiple slots
+ */
+
+#ifndef WH_TRANSPORT_MEMRING_H_
+#define WH_TRANSPORT_MEMRING_H_
+
+/* Memory ring comms
+ * This is a variant of the memory block transport (wh_transport_mem.h) that
+ * divides each of the shared request and response buffers into slot_count
+ * equally sized slots.  Each slot begins with a whTransportMemCsr followed
+ * immediately by the slot data.  This allows a client to queue up to
+ * slot_count requests before the server has responded to the first one, and
+ * allows the server to drain queued requests back-to-back.
+ *
+ * Both sides keep a local count of the packets they have sent and received.
+ * Packet n (counting from 0) is always placed in slot n % slot_count and the
+ * slot notify is set to (n + 1) to mark it as filled.  The counts are 16 bits
+ * and wrap, so slot_count must be a power of 2 for the slots to stay in
+ * order across the wrap.
+ *
+ * The client sends a request by:
+ *  1. Ensure a slot is free: sent - received < slot_count
+ *  2. Write request data: req_slot[sent % slot_count]->data[] = data[]
+ *  3. Mark the slot filled: req_slot[sent % slot_count]->notify = ++sent
+ *
+ * The client receives a response by:
+ *  1. Check the next slot is filled: resp_slot[n]->notify == received + 1
+ *  2. Read response data: data[] = resp_slot[n]->data[]; received++
+ *
+ * The server handles a request by:
+ *  1. Check the next slot is filled: req_slot[n]->notify == received + 1
+ *  2. Read request data: data[] = req_slot[n]->data[]; received++
+ *
+ * The server sends a response by:
+ *  1. Ensure a request is outstanding: sent < received
+ *  2. Write response data: resp_slot[sent % slot_count]->data[] = data[]
+ *  3. Mark the slot filled: resp_slot[sent % slot_count]->notify = ++sent
+ *
+ * Responses are always delivered in the same order as the requests.
+ *
+ * Example usage:
+ *
+ * uint8_t req_buffer[8 * 1536];
+ * uint8_t resp_buffer[8 * 1536];
+ *
+ * whTransportMemRingConfig tmrcfg[1] = {{
+ *      .req = req_buffer,
+ *      .req_size = sizeof(req_buffer),
+ *      .resp = resp_buffer
+ *      .resp_size = sizeof(resp_buffer),
+ *      .slot_count = 8,
+ * }};
+ *
+ * whTransportClientCb tmrccb[1] = {WH_TRANSPORT_MEMRING_CLIENT_CB};
+ * whTransportMemRingClientContext tmrcc[1] = {0};
+ * whCommClientConfig ccc[1] = {{
+ *      .transport_cb = tmrccb,
+ *      .transport_context = tmrcc,
+ *      .transport_config = tmrcfg,
+ *      .client_id = 1234,
+ * }};
+ *
+ * whTransportServerCb tmrscb[1] = {WH_TRANSPORT_MEMRING_SERVER_CB};
+ * whTransportMemRingServerContext tmrsc[1] = {0};
+ * whCommServerConfig csc[1] = {{
+ *      .transport_cb = tmrscb,
+ *      .transport_context = tmrsc,
+ *      .transport_config = tmrcfg,
+ *      .server_id = 5678,
+ * }};
+ *
+ */
+
+#include <stdint.h>
+
+#include "wolfhsm/wh_comm.h"
+#include "wolfhsm/wh_transport_mem.h"   /* For whTransportMemCsr */
+
+/** Common configuration structure */
+typedef struct {
+    void* req;
+    void* resp;
+    uint16_t req_size;
+    uint16_t resp_size;
+    uint16_t slot_count;    /* Number of request/response slots. A power of 2 */
+    uint8_t padding[2];
+} whTransportMemRingConfig;
+
+
+/** Common context */
+typedef struct {
+    uint8_t* req;
+    uint8_t* resp;
+    uint16_t slot_count;
+    uint16_t slot_size;     /* Bytes per slot, including the CSR */
+    uint16_t sent;          /* Packets sent. Client: requests */
+    uint16_t received;      /* Packets received. Client: responses */
+    int initialized;
+    uint8_t padding[4];
+} whTransportMemRingContext;
+
+/* Naming conveniences. Reuses the same types. */
+typedef whTransportMemRingContext whTransportMemRingClientContext;
+typedef whTransportMemRingContext whTransportMemRingServerContext;
+
+/** Callback function declarations */
+int wh_TransportMemRing_Init(void* c, const void* cf,
+        whCommSetConnectedCb connectcb, void* connectcb_arg);
+int wh_TransportMemRing_InitClear(void* c, const void* cf,
+        whCommSetConnectedCb connectcb, void* connectcb_arg);
+int wh_TransportMemRing_Cleanup(void* c);
+int wh_TransportMemRing_SendRequest(void* c, uint16_t len, const void* data);
+int wh_TransportMemRing_RecvRequest(void* c, uint16_t *out_len, void* data);
+int wh_TransportMemRing_SendResponse(void* c, uint16_t len, const void* data);
+int wh_TransportMemRing_RecvResponse(void* c, uint16_t *out_len, void* data);
+
+/* Number of packets sent that have not been answered yet.  For a client, this
+ * is the number of requests in flight.  For a server, this is the number of
+ * requests received that still need a response. */
+int wh_TransportMemRing_GetPending(void* c, uint16_t *out_pending);
+
+#define WH_TRANSPORT_MEMRING_CLIENT_CB              \
+{                                                   \
+    .Init =     wh_TransportMemRing_InitClear,      \
+    .Send =     wh_TransportMemRing_SendRequest,    \
+    .Recv =     wh_TransportMemRing_RecvResponse,   \
+    .Cleanup =  wh_TransportMemRing_Cleanup,        \
+}
+
+#define WH_TRANSPORT_MEMRING_SERVER_CB              \
+{                                                   \
+    .Init =     wh_TransportMemRing_Init,           \
+    .Recv =     wh_TransportMemRing_RecvRequest,    \
+    .Send =     wh_TransportMemRing_SendResponse,   \
+    .Cleanup =  wh_TransportMemRing_Cleanup,        \
+}
+
+#endif /* WH_TRANSPORT_MEMRING_H_ */